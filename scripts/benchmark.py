@@ -0,0 +1,324 @@
+#! /usr/bin/env python
+
+"""
+Script for benchmarking Blacklight on reproducible mock data.
+
+Mock simulation files are generated with generate_mock_simulation.py (requiring numpy, as well as
+h5py for the HDF5 formats) and cached in the working directory. Each selected configuration is then
+run with profiling enabled, and the per-stage timings and counts from the resulting profile are
+reported as throughputs in a stable table that can be saved and compared against later runs.
+
+Configurations:
+  - unpolarized: unpolarized image of a single snapshot, based on example_simulation.input.
+  - polarized: as unpolarized, but with polarized transport.
+  - adaptive: adaptively refined polarized image, based on example_adaptive.input.
+  - slow_light: slow-light images interpolated through a sequence of time-dependent snapshots.
+  - render: false-color rendering, based on example_render.input.
+  - formula: unpolarized image of the formula model, requiring no simulation data.
+"""
+
+# Python standard modules
+import argparse
+import json
+import os
+import subprocess
+import sys
+
+# Locations of repository files
+repo_dir = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+generator = os.path.join(repo_dir, 'scripts', 'generate_mock_simulation.py')
+input_dir = os.path.join(repo_dir, 'input')
+
+# Dataset sizes
+sizes = {}
+sizes['small'] = {'grid': (77, 64, 128), 'athenak_num_blocks': 6, 'resolution': 64}
+sizes['medium'] = {'grid': (154, 128, 256), 'athenak_num_blocks': 12, 'resolution': 128}
+sizes['large'] = {'grid': (308, 256, 512), 'athenak_num_blocks': 24, 'resolution': 256}
+athenak_block_size = 16
+
+# Simulation formats
+formats = {}
+formats['athena'] = {'generator': 'athdf', 'extension': 'athdf', 'coord': 'sks'}
+formats['athenak'] = {'generator': 'athenak', 'extension': 'bin', 'coord': 'cks'}
+formats['iharm3d'] = {'generator': 'iharm3d', 'extension': 'h5', 'coord': 'mks'}
+
+# Run configurations
+configurations = {}
+configurations['unpolarized'] = {'input': 'example_simulation.input', 'options': {}}
+configurations['polarized'] = \
+    {'input': 'example_simulation.input', 'options': {'image_polarization': 'true'}}
+configurations['adaptive'] = {'input': 'example_adaptive.input', 'options': {}}
+configurations['slow_light'] = {'input': 'example_simulation.input', 'options': \
+    {'slow_light_on': 'true', 'slow_chunk_size': '10', 'slow_t_start': '115.0',
+    'slow_dt': '30.0', 'slow_num_images': '2'}}
+configurations['render'] = {'input': 'example_render.input', 'options': {}}
+configurations['formula'] = {'input': 'example_formula.input', 'options': {}}
+
+# Values for keys not given in all example input files
+defaults = {'image_z_turnings': 'false', 'cut_z_turnings': '-1', 'adaptive_num_regions': '0'}
+
+# Snapshot times for slow light
+slow_times = [10.0 * n for n in range(11)]
+slow_omega = 0.01
+
+# Report columns
+columns = ('configuration', 'format', 'size', 'threads', 'stage', 'calls', 'time_s',
+    'rays_per_s', 'samples_per_s', 'read_GB_per_s')
+widths = {'configuration': 13, 'format': 8, 'size': 6, 'threads': 7, 'stage': 31, 'calls': 6,
+    'time_s': 13, 'rays_per_s': 13, 'samples_per_s': 13, 'read_GB_per_s': 13}
+
+# Main function
+def main(**kwargs):
+
+  # Verify inputs
+  if not os.path.isfile(kwargs['executable']):
+    raise RuntimeError('Executable {0} not found.'.format(kwargs['executable']))
+  for size in kwargs['sizes']:
+    if size not in sizes:
+      raise RuntimeError('Unknown size {0}.'.format(size))
+  for simulation_format in kwargs['formats']:
+    if simulation_format not in formats:
+      raise RuntimeError('Unknown format {0}.'.format(simulation_format))
+  for configuration in kwargs['configurations']:
+    if configuration not in configurations:
+      raise RuntimeError('Unknown configuration {0}.'.format(configuration))
+  if kwargs['repeat'] < 1:
+    raise RuntimeError('Must have positive repeat.')
+  threads_list = kwargs['threads']
+  if threads_list is None:
+    threads_list = sorted(set((1, os.cpu_count() or 1)))
+  data_dir = os.path.join(kwargs['work'], 'data')
+  run_dir = os.path.join(kwargs['work'], 'runs')
+  os.makedirs(data_dir, exist_ok=True)
+  os.makedirs(run_dir, exist_ok=True)
+
+  # Run benchmarks
+  rows = []
+  skipped = set()
+  for configuration in kwargs['configurations']:
+    formats_used = ('none',) if configuration == 'formula' else kwargs['formats']
+    for simulation_format in formats_used:
+      for size in kwargs['sizes']:
+
+        # Prepare data
+        if simulation_format != 'none':
+          if (simulation_format, size) in skipped:
+            continue
+          num_files = len(slow_times) if configuration == 'slow_light' else 1
+          try:
+            simulation_file = generate_data(data_dir, simulation_format, size, num_files)
+          except (RuntimeError, subprocess.CalledProcessError) as error:
+            print('Skipping {0} {1} data: {2}'.format(simulation_format, size, error),
+                file=sys.stderr)
+            skipped.add((simulation_format, size))
+            continue
+        else:
+          simulation_file = None
+
+        # Run each thread count, keeping fastest repetition
+        for num_threads in threads_list:
+          label = '_'.join((configuration, simulation_format, size, str(num_threads)))
+          input_file = os.path.join(run_dir, label + '.input')
+          profile_file = os.path.join(run_dir, label + '.json')
+          write_input(input_file, profile_file, run_dir, label, configuration, simulation_format,
+              simulation_file, size, num_threads)
+          best_profile = None
+          for _ in range(kwargs['repeat']):
+            with open(os.path.join(run_dir, label + '.log'), 'w') as f_log:
+              subprocess.run((kwargs['executable'], input_file), stdout=f_log,
+                  stderr=subprocess.STDOUT, check=True)
+            with open(profile_file, 'r') as f:
+              profile = json.load(f)
+            if best_profile is None or profile['time'] < best_profile['time']:
+              best_profile = profile
+          rows += profile_rows(best_profile, configuration, simulation_format, size, num_threads)
+
+  # Report results
+  lines = format_rows(rows)
+  for line in lines:
+    print(line)
+  if kwargs['output'] is not None:
+    with open(kwargs['output'], 'w') as f:
+      for line in lines:
+        f.write(line + '\n')
+
+  # Compare against baseline
+  if kwargs['compare'] is not None:
+    regressions = compare_rows(rows, read_rows(kwargs['compare']), kwargs['tolerance'])
+    for regression in regressions:
+      print('Regression: ' + regression)
+    if len(regressions) > 0:
+      sys.exit(1)
+
+# Function for generating (or reusing) mock data
+def generate_data(data_dir, simulation_format, size, num_files):
+
+  # Determine file names
+  name = 'mock_{0}_{1}'.format(simulation_format, size)
+  extension = formats[simulation_format]['extension']
+  if num_files == 1:
+    filenames = [os.path.join(data_dir, '{0}.{1}'.format(name, extension))]
+    times = [0.0]
+    pattern = filenames[0]
+  else:
+    filenames = [os.path.join(data_dir, '{0}_{1:02d}.{2}'.format(name, n, extension))
+        for n in range(num_files)]
+    times = slow_times
+    pattern = os.path.join(data_dir, '{0}_{{2d}}.{1}'.format(name, extension))
+
+  # Generate missing files
+  n_r, n_th, n_ph = sizes[size]['grid']
+  for filename, time in zip(filenames, times):
+    if os.path.isfile(filename):
+      continue
+    command = [sys.executable, generator, filename + '.tmp', '--format',
+        formats[simulation_format]['generator'], '--n_r', str(n_r), '--n_th', str(n_th), '--n_ph',
+        str(n_ph), '--athenak_num_blocks', str(sizes[size]['athenak_num_blocks']),
+        '--athenak_block_size', str(athenak_block_size)]
+    if num_files > 1:
+      command += ['--time', repr(time), '--pert_omega', repr(slow_omega)]
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT,
+        universal_newlines=True)
+    if result.returncode != 0:
+      message = result.stdout.strip().splitlines()
+      raise RuntimeError(message[-1] if len(message) > 0 else 'generation failed')
+    os.replace(filename + '.tmp', filename)
+  return pattern
+
+# Function for writing input file
+def write_input(input_file, profile_file, run_dir, label, configuration, simulation_format,
+    simulation_file, size, num_threads):
+
+  # Collect options
+  options = {}
+  options['num_threads'] = str(num_threads)
+  options['camera_resolution'] = str(sizes[size]['resolution'])
+  options['output_file'] = os.path.join(run_dir, label + '.npz')
+  options['profile_on'] = 'true'
+  options['profile_file'] = profile_file
+  if simulation_file is not None:
+    options['simulation_format'] = simulation_format
+    options['simulation_file'] = simulation_file
+    options['simulation_coord'] = formats[simulation_format]['coord']
+  if configuration == 'slow_light':
+    options['output_file'] = os.path.join(run_dir, label + '_{1d}.npz')
+    options['simulation_multiple'] = 'true'
+    options['simulation_start'] = '0'
+    options['simulation_end'] = str(len(slow_times) - 1)
+  options.update(configurations[configuration]['options'])
+
+  # Replace existing keys and append remaining ones and missing defaults
+  with open(os.path.join(input_dir, configurations[configuration]['input']), 'r') as f:
+    lines_in = f.readlines()
+  keys_in = set(line.split('#')[0].split('=')[0].strip() for line in lines_in)
+  lines_out = []
+  remaining = dict(options)
+  for line in lines_in:
+    key = line.split('#')[0].split('=')[0].strip()
+    if key in remaining:
+      line = '{0} = {1}\n'.format(key, remaining.pop(key))
+    lines_out.append(line)
+  for key, val in defaults.items():
+    if key not in keys_in:
+      remaining[key] = val
+  if len(remaining) > 0:
+    lines_out.append('\n# Benchmark parameters\n')
+    for key, val in remaining.items():
+      lines_out.append('{0} = {1}\n'.format(key, val))
+  with open(input_file, 'w') as f:
+    f.writelines(lines_out)
+
+# Function for extracting throughputs from profile
+#   Overall throughputs use the largest count of any stage, since stages count the same rays and
+#       samples repeatedly.
+def profile_rows(profile, configuration, simulation_format, size, num_threads):
+  rows = []
+  for entry in profile['totals']:
+    rows.append(make_row(configuration, simulation_format, size, num_threads, entry['stage'],
+        entry['calls'], entry['time'], entry))
+  counts = {}
+  for name in ('rays', 'samples', 'bytes_read'):
+    counts[name] = max([entry[name] for entry in profile['totals']] + [0])
+  rows.append(make_row(configuration, simulation_format, size, num_threads, 'total', 1,
+      profile['time'], counts))
+  return rows
+
+# Function for constructing one report row
+def make_row(configuration, simulation_format, size, num_threads, stage, calls, time, counts):
+  def rate(count, scale=1.0):
+    return count / scale / time if time > 0.0 and count > 0 else 0.0
+  row = {'configuration': configuration, 'format': simulation_format, 'size': size,
+      'threads': num_threads, 'stage': stage, 'calls': calls, 'time_s': time}
+  row['rays_per_s'] = rate(counts.get('rays', 0))
+  row['samples_per_s'] = rate(counts.get('samples', 0))
+  row['read_GB_per_s'] = rate(counts.get('bytes_read', 0), 1.0e9)
+  return row
+
+# Function for formatting report rows
+def format_rows(rows):
+  lines = [' '.join('{0:>{1}}'.format(column, widths[column]) for column in columns)]
+  for row in rows:
+    fields = []
+    for column in columns:
+      if column in ('time_s', 'rays_per_s', 'samples_per_s', 'read_GB_per_s'):
+        fields.append('{0:>{1}.6e}'.format(row[column], widths[column]))
+      else:
+        fields.append('{0:>{1}}'.format(row[column], widths[column]))
+    lines.append(' '.join(fields))
+  return lines
+
+# Function for reading saved report
+def read_rows(filename):
+  rows = []
+  with open(filename, 'r') as f:
+    lines = f.readlines()
+  for line in lines[1:]:
+    fields = line.split()
+    if len(fields) != len(columns):
+      continue
+    row = dict(zip(columns, fields))
+    row['threads'] = int(row['threads'])
+    row['calls'] = int(row['calls'])
+    for column in ('time_s', 'rays_per_s', 'samples_per_s', 'read_GB_per_s'):
+      row[column] = float(row[column])
+    rows.append(row)
+  return rows
+
+# Function for finding stages slower than baseline
+def compare_rows(rows, baseline_rows, tolerance):
+  def key(row):
+    return (row['configuration'], row['format'], row['size'], row['threads'], row['stage'])
+  baseline = {key(row): row for row in baseline_rows}
+  regressions = []
+  for row in rows:
+    if key(row) not in baseline:
+      continue
+    time_old = baseline[key(row)]['time_s']
+    if time_old > 0.0 and row['time_s'] > time_old * (1.0 + tolerance):
+      regressions.append('{0}: {1:.6e} s vs. {2:.6e} s baseline'.format(' '.join(
+          str(field) for field in key(row)), row['time_s'], time_old))
+  return regressions
+
+# Parse inputs and execute main function
+if __name__ == '__main__':
+  parser = argparse.ArgumentParser()
+  parser.add_argument('--executable', default=os.path.join(repo_dir, 'bin', 'blacklight'),
+      help='Blacklight executable to benchmark')
+  parser.add_argument('--work', default=os.path.join(repo_dir, 'bench'),
+      help='directory for cached mock data and run outputs')
+  parser.add_argument('--sizes', nargs='+', default=['small'],
+      help='dataset sizes (small, medium, large) to run')
+  parser.add_argument('--formats', nargs='+', default=['athena', 'athenak', 'iharm3d'],
+      help='simulation formats (athena, athenak, iharm3d) to run')
+  parser.add_argument('--configurations', nargs='+', default=list(configurations.keys()),
+      help='configurations (' + ', '.join(configurations.keys()) + ') to run')
+  parser.add_argument('--threads', type=int, nargs='+',
+      help='thread counts to run (default: 1 and number of processors)')
+  parser.add_argument('--repeat', type=int, default=1,
+      help='number of repetitions of each run, keeping the fastest')
+  parser.add_argument('--output', help='file to which report should be saved')
+  parser.add_argument('--compare', help='saved report to compare against')
+  parser.add_argument('--tolerance', type=float, default=0.1,
+      help='fractional slowdown of any stage counted as a regression')
+  args = parser.parse_args()
+  main(**vars(args))
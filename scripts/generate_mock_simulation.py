@@ -5,6 +5,8 @@ Script for generating mock data to be read by Blacklight.
 
 Supported formats:
   - athena: Standard HDF5 (.athdf) format used by Athena++.
+  - athenak: Binary (.bin) format used by AthenaK, with the spherical data resampled onto a uniform
+      Cartesian mesh of blocks.
   - iharm3d: HDF5 format with most of the common iharm fields supplied.
   - harm3d: version of older Harm ascii/binary format without excessive duplicate information.
   - harm3d_ext: original version of harm3d, not supported by Blacklight but used by other
@@ -13,13 +15,11 @@ Supported formats:
 
 # Python standard modules
 import argparse
+import struct
 
 # Numerical modules
 import numpy as np
 
-# Other modules
-import h5py
-
 # Main function
 def main(**kwargs):
 
@@ -50,7 +50,7 @@ def main(**kwargs):
       / np.log(kwargs['cutoff_r_max'] / kwargs['cutoff_r_min']))
   pert_th = -np.cos(2.0 * np.pi * kwargs['pert_n_th'] * (th - kwargs['cutoff_th_min']) \
       / (np.pi - 2.0 * kwargs['cutoff_th_min']))
-  pert_ph = np.cos(kwargs['pert_n_ph'] * ph)
+  pert_ph = np.cos(kwargs['pert_n_ph'] * (ph - kwargs['pert_omega'] * kwargs['time']))
   pert = \
       1.0 + kwargs['pert_amp'] * pert_r[None,None,:] * pert_th[None,:,None] * pert_ph[:,None,None]
 
@@ -154,13 +154,17 @@ def main(**kwargs):
     bb2 = b2 * u0 - b0 * u2
     bb3 = b3 * u0 - b0 * u3
 
+  # Import HDF5 module only for formats that need it
+  if kwargs['format'] in ('athdf', 'iharm3d'):
+    import h5py
+
   # Open athdf file for writing
   if kwargs['format'] == 'athdf':
     with h5py.File(kwargs['filename'], 'w') as f_out:
 
       # Write file-level attributes
       f_out.attrs.create('NumCycles', 0, dtype=np.int32)
-      f_out.attrs.create('Time', 0.0, dtype=np.float32)
+      f_out.attrs.create('Time', kwargs['time'], dtype=np.float32)
       f_out.attrs.create('Coordinates', 'kerr-schild', dtype='|S11')
       f_out.attrs.create('RootGridX1', (rf[0], rf[-1], (rf[-1] / rf[0]) ** (1.0 / len(r))),
           dtype=np.float32)
@@ -204,7 +208,7 @@ def main(**kwargs):
       # Write header data
       f_out.create_dataset('header/version', data=('iharm-blacklight',), dtype='|S20')
       f_out.create_dataset('header/gam', data=kwargs['gamma_adi'], dtype=np.float64)
-      f_out.create_dataset('header/tf', data=0.0, dtype=np.float64)
+      f_out.create_dataset('header/tf', data=kwargs['time'], dtype=np.float64)
       f_out.create_dataset('header/n1', data=len(r), dtype=np.int32)
       f_out.create_dataset('header/n2', data=len(th), dtype=np.int32)
       f_out.create_dataset('header/n3', data=len(ph), dtype=np.int32)
@@ -227,7 +231,7 @@ def main(**kwargs):
       f_out.create_dataset('header/geom/mks/hslope', data=1.0, dtype=np.float64)
 
       # Write time
-      f_out.create_dataset('t', data=0.0, dtype=np.float64)
+      f_out.create_dataset('t', data=kwargs['time'], dtype=np.float64)
 
       # Write cell data
       data = []
@@ -247,7 +251,7 @@ def main(**kwargs):
     with open(kwargs['filename'], 'w') as f_out:
 
       # Write header data
-      f_out.write('0.0 ')
+      f_out.write('{0:24.16e} '.format(kwargs['time']))
       f_out.write('{0} {1} {2} '.format(len(r), len(th), len(ph)))
       f_out.write('{0:24.16e} {1:24.16e} {2:24.16e} '.format(lrf[0], x2f[0], phf[0]))
       f_out.write('{0:24.16e} {1:24.16e} {2:24.16e} '.format(dlr, dx2, dph))
@@ -283,7 +287,7 @@ def main(**kwargs):
     with open(kwargs['filename'], 'w') as f_out:
 
       # Write header data
-      f_out.write('0.0 ')
+      f_out.write('{0:24.16e} '.format(kwargs['time']))
       f_out.write('{0} {1} {2} '.format(len(r), len(th), len(ph)))
       f_out.write('{0:24.16e} {1:24.16e} {2:24.16e} '.format(lrf[0], x2f[0], phf[0]))
       f_out.write('{0:24.16e} {1:24.16e} {2:24.16e} '.format(dlr, dx2, dph))
@@ -333,6 +337,78 @@ def main(**kwargs):
       data = np.array(data, dtype=np.float32).transpose()
       data.tofile(f_out)
 
+  # Open athenak file for writing
+  elif kwargs['format'] == 'athenak':
+    with open(kwargs['filename'], 'wb') as f_out:
+
+      # Write header data
+      variable_names = ('dens', 'velx', 'vely', 'velz', 'eint', 'bcc1', 'bcc2', 'bcc3')
+      inputs = '<coord>\na = 0.0\n<mhd>\ngamma = {0:.17g}\n'.format(kwargs['gamma_adi'])
+      header = 'Athena binary output version=1.1\n'
+      header += '  size of preheader=5\n'
+      header += '  time={0:.17g}\n'.format(kwargs['time'])
+      header += '  cycle=0\n'
+      header += '  size of location=8\n'
+      header += '  size of variable=4\n'
+      header += '  number of variables={0}\n'.format(len(variable_names))
+      header += '  variables:  {0}\n'.format('  '.join(variable_names))
+      header += '  header offset={0}\n'.format(len(inputs))
+      f_out.write(header.encode())
+      f_out.write(inputs.encode())
+
+      # Prepare uniform Cartesian mesh
+      num_blocks = kwargs['athenak_num_blocks']
+      block_size = kwargs['athenak_block_size']
+      half_width = kwargs['athenak_half_width']
+      block_width = 2.0 * half_width / num_blocks
+      dx = block_width / block_size
+      offsets = (np.arange(block_size) + 0.5) * dx
+      ugas = pgas / (kwargs['gamma_adi'] - 1.0)
+
+      # Go through blocks
+      for bk in range(num_blocks):
+        for bj in range(num_blocks):
+          for bi in range(num_blocks):
+
+            # Write block layout and coordinates
+            x_min = -half_width + bi * block_width
+            y_min = -half_width + bj * block_width
+            z_min = -half_width + bk * block_width
+            f_out.write(struct.pack('6i', 2, block_size + 1, 2, block_size + 1, 2,
+                block_size + 1))
+            f_out.write(struct.pack('4i', bi, bj, bk, 0))
+            f_out.write(struct.pack('6d', x_min, x_min + block_width, y_min, y_min + block_width,
+                z_min, z_min + block_width))
+
+            # Locate nearest spherical cells
+            z_b = (z_min + offsets)[:,None,None]
+            y_b = (y_min + offsets)[None,:,None]
+            x_b = (x_min + offsets)[None,None,:]
+            r_b = np.sqrt(x_b ** 2 + y_b ** 2 + z_b ** 2)
+            th_b = np.arccos(z_b / r_b)
+            ph_b = np.arctan2(y_b, x_b) % (2.0 * np.pi)
+            ind_r = np.clip(((np.log(r_b) - lr_min) / dlr).astype(int), 0, len(r) - 1)
+            ind_th = np.clip((th_b / dth).astype(int), 0, len(th) - 1)
+            ind_ph = np.clip((ph_b / dph).astype(int), 0, len(ph) - 1)
+            inds = (ind_ph, ind_th, ind_r)
+
+            # Transform vectors from spherical to Cartesian components
+            sth = np.sin(th_b)
+            cth = np.cos(th_b)
+            sph = np.sin(ph_b)
+            cph = np.cos(ph_b)
+            def cartesian(v_r, v_th, v_ph):
+              v_x = sth * cph * v_r + r_b * cth * cph * v_th - r_b * sth * sph * v_ph
+              v_y = sth * sph * v_r + r_b * cth * sph * v_th + r_b * sth * cph * v_ph
+              v_z = cth * v_r - r_b * sth * v_th
+              return v_x, v_y, v_z
+            uux, uuy, uuz = cartesian(uur[inds], uuth[inds], uuph[inds])
+            bbx, bby, bbz = cartesian(bbr[inds], bbth[inds], bbph[inds])
+
+            # Write cell data
+            for data in (rho[inds], uux, uuy, uuz, ugas[inds], bbx, bby, bbz):
+              f_out.write(np.broadcast_to(data, r_b.shape).astype(np.float32).tobytes())
+
   # Report invalid file format
   else:
     raise RuntimeError('Invalid format {0}.'.format(kwargs['format']))
@@ -346,7 +422,8 @@ if __name__ == '__main__':
   # Prepare for filename input
   parser.add_argument('filename', help='name of simulation data file to write')
   parser.add_argument('--format', default='athdf',
-     help='file format (athdf, iharm3d, harm3d, harm3d_ext) to write')
+     help='file format (athdf, athenak, iharm3d, harm3d, harm3d_ext) to write')
+  parser.add_argument('--time', type=float, default=0.0, help='simulation time to record')
 
   # Prepare for grid inputs
   r_min = 2.0 * 25.0 ** (-1.0 / 75.0)
@@ -357,6 +434,12 @@ if __name__ == '__main__':
   parser.add_argument('--n_th', type=int, default=64, help='number of cells in polar direction')
   parser.add_argument('--n_ph', type=int, default=128,
       help='number of cells in azimuthal direction')
+  parser.add_argument('--athenak_num_blocks', type=int, default=8,
+      help='number of Cartesian blocks in each direction (athenak)')
+  parser.add_argument('--athenak_block_size', type=int, default=16,
+      help='number of Cartesian cells in each direction in each block (athenak)')
+  parser.add_argument('--athenak_half_width', type=float, default=50.0,
+      help='half width of Cartesian mesh (athenak)')
 
   # Prepare for density inputs
   parser.add_argument('--rho_amp', type=float, default=1.0, help='density coefficient')
@@ -419,6 +502,8 @@ if __name__ == '__main__':
       help='number (possibly fractional) of perturbation wavelengths in polar coordinate')
   parser.add_argument('--pert_n_ph', type=int, default=4,
       help='integer number of perturbation wavelengths in azimuthal coordinate')
+  parser.add_argument('--pert_omega', type=float, default=0.0,
+      help='angular pattern speed of perturbation, for series of files at different times')
 
   # Prepare for miscellaneous inputs
   parser.add_argument('--gamma_adi', type=float, default=13.0/9.0,
@@ -7,7 +7,7 @@
 #include <string>    // string
 
 // Library headers
-#include <omp.h>  // omp_get_wtime, omp_set_num_threads
+#include <omp.h>  // omp_get_wtime, omp_sched_t, omp_set_num_threads, omp_set_schedule
 
 // Blacklight headers
 #include "blacklight.hpp"
@@ -15,8 +15,12 @@
 #include "input_reader/input_reader.hpp"                  // InputReader
 #include "output_writer/output_writer.hpp"                // OutputWriter
 #include "radiation_integrator/radiation_integrator.hpp"  // RadiationIntegrator
+#include "render_server/render_server.hpp"                // RenderServer
 #include "simulation_reader/simulation_reader.hpp"        // SimulationReader
+#include "utils/array.hpp"                                // SetArrayMemoryOptions
+#include "utils/communication.hpp"                        // communication functions
 #include "utils/exceptions.hpp"                           // BlacklightException
+#include "utils/profiler.hpp"                             // profiling functions
 
 //--------------------------------------------------------------------------------------------------
 
@@ -38,6 +42,24 @@ int main(int argc, char *argv[])
   double time_image = 0.0;
   double time_render = 0.0;
 
+  // Start communication among ranks
+  try
+  {
+    CommStart(&argc, &argv);
+  }
+  catch (const BlacklightException &exception)
+  {
+    std::cout << exception.what();
+    return 1;
+  }
+  catch (...)
+  {
+    std::cout << "Error: Could not start communication.\n";
+    return 1;
+  }
+  int rank = CommRank();
+  int num_ranks = CommSize();
+
   // Parse command-line inputs
   if (argc != 2)
   {
@@ -48,17 +70,43 @@ int main(int argc, char *argv[])
 
   // Prepare pointers to objects
   InputReader *p_input_reader;
-  GeodesicIntegrator *p_geodesic_integrator;
+  GeodesicIntegrator **p_geodesic_integrators;
   SimulationReader *p_simulation_reader;
-  RadiationIntegrator *p_radiation_integrator;
-  OutputWriter *p_output_writer;
+  RadiationIntegrator **p_radiation_integrators;
+  OutputWriter **p_output_writers;
 
   // Read input file
   int num_runs;
+  int num_cameras = 1;
+  int num_models = 1;
+  int num_tiles = 1;
+  bool collect_tiles = false;
+  bool distribute_snapshots = false;
+  bool distribute_geodesic_checkpoint = false;
+  bool server_on = false;
+  bool adaptive_progressive = false;
   try
   {
     p_input_reader = new InputReader(input_file);
     num_runs = p_input_reader->Read();
+    if (p_input_reader->server_on.has_value())
+      server_on = p_input_reader->server_on.value();
+    if (p_input_reader->adaptive_progressive.has_value())
+      adaptive_progressive = p_input_reader->adaptive_progressive.value();
+    if (p_input_reader->batch_num_cameras.has_value())
+      num_cameras = p_input_reader->batch_num_cameras.value();
+    if (p_input_reader->sweep_num_models.has_value())
+      num_models = p_input_reader->sweep_num_models.value();
+    if (p_input_reader->memory_num_tiles.has_value())
+    {
+      num_tiles = p_input_reader->memory_num_tiles.value();
+      collect_tiles = true;
+    }
+    if (p_input_reader->distribute_snapshots.has_value())
+    {
+      distribute_snapshots = p_input_reader->distribute_snapshots.value();
+      distribute_geodesic_checkpoint = p_input_reader->distribute_geodesic_checkpoint.value();
+    }
   }
   catch (const BlacklightException &exception)
   {
@@ -87,11 +135,94 @@ int main(int argc, char *argv[])
     return 1;
   }
 
-  // Define camera and integrate geodesics
+  // Set scheduling of per-pixel loops
   try
   {
-    p_geodesic_integrator = new GeodesicIntegrator(p_input_reader);
-    time_geodesic += p_geodesic_integrator->Integrate();
+    omp_sched_t schedule_kind = omp_sched_static;
+    if (p_input_reader->parallel_schedule.has_value())
+    {
+      if (p_input_reader->parallel_schedule.value() == ParallelSchedule::dynamic)
+        schedule_kind = omp_sched_dynamic;
+      else if (p_input_reader->parallel_schedule.value() == ParallelSchedule::guided)
+        schedule_kind = omp_sched_guided;
+    }
+    int schedule_chunk = 0;
+    if (p_input_reader->parallel_chunk.has_value())
+      schedule_chunk = p_input_reader->parallel_chunk.value();
+    if (schedule_chunk < 0)
+      throw BlacklightException("Must have nonnegative parallel_chunk.");
+    omp_set_schedule(schedule_kind, schedule_chunk);
+  }
+  catch (const BlacklightException &exception)
+  {
+    std::cout << exception.what();
+    return 1;
+  }
+  catch (...)
+  {
+    std::cout << "Error: Could not set loop scheduling.\n";
+    return 1;
+  }
+
+  // Set memory options for arrays
+  try
+  {
+    bool memory_reuse = false;
+    if (p_input_reader->memory_reuse.has_value())
+      memory_reuse = p_input_reader->memory_reuse.value();
+    bool memory_huge_pages = false;
+    if (p_input_reader->memory_huge_pages.has_value())
+      memory_huge_pages = p_input_reader->memory_huge_pages.value();
+    SetArrayMemoryOptions(memory_reuse, memory_huge_pages);
+  }
+  catch (...)
+  {
+    std::cout << "Error: Could not set memory options.\n";
+    return 1;
+  }
+
+  // Start profiling
+  std::string profile_file;
+  std::string profile_trace_file;
+  try
+  {
+    if (p_input_reader->profile_on.has_value() and p_input_reader->profile_on.value())
+    {
+      profile_file = p_input_reader->profile_file.value();
+      if (p_input_reader->profile_trace_file.has_value())
+        profile_trace_file = p_input_reader->profile_trace_file.value();
+      ProfileStart(not profile_trace_file.empty());
+    }
+  }
+  catch (const std::bad_optional_access &exception)
+  {
+    std::cout << "Error: profile_file not specified in input file.\n";
+    return 1;
+  }
+  catch (...)
+  {
+    std::cout << "Error: Could not start profiling.\n";
+    return 1;
+  }
+
+  // Prepare per-camera objects
+  p_geodesic_integrators = new GeodesicIntegrator *[num_cameras]();
+  p_radiation_integrators = new RadiationIntegrator *[num_cameras]();
+  p_output_writers = new OutputWriter *[num_cameras * num_models]();
+
+  // Define cameras and integrate geodesics, loading any checkpoint shared by rank 0
+  try
+  {
+    if (distribute_geodesic_checkpoint and rank > 0)
+      CommBarrier();
+    for (int camera_num = 0; camera_num < num_cameras; camera_num++)
+    {
+      p_input_reader->SelectBatchCamera(camera_num);
+      p_geodesic_integrators[camera_num] = new GeodesicIntegrator(p_input_reader);
+      time_geodesic += p_geodesic_integrators[camera_num]->Integrate();
+    }
+    if (distribute_geodesic_checkpoint and rank == 0)
+      CommBarrier();
   }
   catch (const BlacklightException &exception)
   {
@@ -130,11 +261,16 @@ int main(int argc, char *argv[])
     return 1;
   }
 
-  // Set up radiation integrator
+  // Set up radiation integrators
   try
   {
-    p_radiation_integrator =
-        new RadiationIntegrator(p_input_reader, p_geodesic_integrator, p_simulation_reader);
+    for (int camera_num = 0; camera_num < num_cameras; camera_num++)
+    {
+      p_input_reader->SelectBatchCamera(camera_num);
+      p_input_reader->SelectSweepModel(0);
+      p_radiation_integrators[camera_num] = new RadiationIntegrator(p_input_reader,
+          p_geodesic_integrators[camera_num], p_simulation_reader);
+    }
   }
   catch (const BlacklightException &exception)
   {
@@ -152,11 +288,17 @@ int main(int argc, char *argv[])
     return 1;
   }
 
-  // Set up output writer
+  // Set up output writers
   try
   {
-    p_output_writer =
-        new OutputWriter(p_input_reader, p_geodesic_integrator, p_radiation_integrator);
+    for (int camera_num = 0; camera_num < num_cameras; camera_num++)
+      for (int model_num = 0; model_num < num_models; model_num++)
+      {
+        p_input_reader->SelectBatchCamera(camera_num);
+        p_input_reader->SelectSweepModel(model_num);
+        p_output_writers[camera_num*num_models+model_num] = new OutputWriter(p_input_reader,
+            p_geodesic_integrators[camera_num], p_radiation_integrators[camera_num]);
+      }
   }
   catch (const BlacklightException &exception)
   {
@@ -174,10 +316,44 @@ int main(int argc, char *argv[])
     return 1;
   }
 
+  // Serve jobs instead of going through runs
+  if (server_on)
+    try
+    {
+      RenderServer render_server(p_input_reader, &p_geodesic_integrators[0], p_simulation_reader,
+          &p_radiation_integrators[0]);
+      render_server.Serve();
+      time_geodesic += render_server.time_geodesic;
+      time_read += render_server.time_read;
+      time_sample += render_server.time_sample;
+      time_image += render_server.time_image;
+      time_render += render_server.time_render;
+    }
+    catch (const BlacklightException &exception)
+    {
+      std::cout << exception.what();
+      return 1;
+    }
+    catch (const std::bad_optional_access &exception)
+    {
+      std::cout << "Error: RenderServer unable to find all needed values in input file.\n";
+      return 1;
+    }
+    catch (...)
+    {
+      std::cout << "Error: Could not serve jobs.\n";
+      return 1;
+    }
+
   // Go through runs
-  for (int n = 0; n < num_runs; n++)
+  for (int n = 0; not server_on and n < num_runs; n++)
   {
+    // Leave run to another rank
+    if (distribute_snapshots and n % num_ranks != rank)
+      continue;
+
     // Read simulation file
+    ProfileSetSnapshot(n);
     try
     {
       time_read += p_simulation_reader->Read(n);
@@ -193,32 +369,162 @@ int main(int argc, char *argv[])
       return 1;
     }
 
-    // Iterate with adaptive refinement
-    bool adaptive_complete = false;
-    while (not adaptive_complete)
+    // Go through cameras, all sharing the simulation data just read
+    for (int camera_num = 0; camera_num < num_cameras; camera_num++)
     {
-      // Integrate radiation
-      try
-      {
-        adaptive_complete =
-            p_radiation_integrator->Integrate(n, &time_sample, &time_image, &time_render);
-      }
-      catch (const BlacklightException &exception)
-      {
-        std::cout << exception.what();
-        return 1;
-      }
-      catch (...)
+      // Go through plasma models, all sharing the samples taken for the first
+      for (int model_num = 0; model_num < num_models; model_num++)
       {
-        std::cout << "Error: Could not integrate radiation.\n";
-        return 1;
-      }
+        // Select plasma model
+        if (num_models > 1)
+          try
+          {
+            p_input_reader->SelectSweepModel(model_num);
+            p_radiation_integrators[camera_num]->SelectPlasmaModel(p_input_reader);
+          }
+          catch (const BlacklightException &exception)
+          {
+            std::cout << exception.what();
+            return 1;
+          }
+          catch (const std::bad_optional_access &exception)
+          {
+            std::cout << "Error: RadiationIntegrator unable to find all needed values in input "
+                "file.\n";
+            return 1;
+          }
+          catch (...)
+          {
+            std::cout << "Error: Could not select plasma model.\n";
+            return 1;
+          }
+
+        // Reuse samples for additional plasma models
+        if (model_num > 0)
+          try
+          {
+            p_radiation_integrators[camera_num]->IntegratePlasmaModel(&time_image,
+                &time_render);
+          }
+          catch (const BlacklightException &exception)
+          {
+            std::cout << exception.what();
+            return 1;
+          }
+          catch (...)
+          {
+            std::cout << "Error: Could not integrate radiation.\n";
+            return 1;
+          }
+
+        // Go through image tiles, integrating geodesics anew for each one
+        for (int tile_num = 0; tile_num < num_tiles; tile_num++)
+        {
+          // Replace integrators with ones for tile
+          if (num_tiles > 1 and (n > 0 or tile_num > 0))
+            try
+            {
+              delete p_radiation_integrators[camera_num];
+              p_radiation_integrators[camera_num] = nullptr;
+              delete p_geodesic_integrators[camera_num];
+              p_geodesic_integrators[camera_num] = nullptr;
+              p_input_reader->SelectTile(tile_num);
+              p_geodesic_integrators[camera_num] = new GeodesicIntegrator(p_input_reader);
+              time_geodesic += p_geodesic_integrators[camera_num]->Integrate();
+              p_radiation_integrators[camera_num] = new RadiationIntegrator(p_input_reader,
+                  p_geodesic_integrators[camera_num], p_simulation_reader);
+            }
+            catch (const BlacklightException &exception)
+            {
+              std::cout << exception.what();
+              return 1;
+            }
+            catch (...)
+            {
+              std::cout << "Error: Could not set up image tile.\n";
+              return 1;
+            }
+
+          // Iterate with adaptive refinement
+          bool adaptive_complete = model_num > 0;
+          while (not adaptive_complete)
+          {
+            // Integrate radiation
+            try
+            {
+              adaptive_complete = p_radiation_integrators[camera_num]->Integrate(n, &time_sample,
+                  &time_image, &time_render);
+            }
+            catch (const BlacklightException &exception)
+            {
+              std::cout << exception.what();
+              return 1;
+            }
+            catch (...)
+            {
+              std::cout << "Error: Could not integrate radiation.\n";
+              return 1;
+            }
+
+            // Write image from levels completed so far
+            if (adaptive_progressive and not adaptive_complete)
+              try
+              {
+                p_output_writers[camera_num*num_models+model_num]->Write(n);
+              }
+              catch (const BlacklightException &exception)
+              {
+                std::cout << exception.what();
+                return 1;
+              }
+              catch (...)
+              {
+                std::cout << "Error: Could not write output file.\n";
+                return 1;
+              }
+
+            // Sample additional geodesics
+            if (not adaptive_complete)
+              try
+              {
+                time_geodesic += p_geodesic_integrators[camera_num]->AddGeodesics(
+                    p_radiation_integrators[camera_num]);
+              }
+              catch (const BlacklightException &exception)
+              {
+                std::cout << exception.what();
+                return 1;
+              }
+              catch (...)
+              {
+                std::cout << "Error: Could not integrate geodesics.\n";
+                return 1;
+              }
+          }
 
-      // Sample additional geodesics
-      if (not adaptive_complete)
+          // Collect tile
+          if (collect_tiles)
+            try
+            {
+              p_output_writers[camera_num*num_models+model_num]->CopyTile(
+                  p_geodesic_integrators[camera_num], p_radiation_integrators[camera_num]);
+            }
+            catch (const BlacklightException &exception)
+            {
+              std::cout << exception.what();
+              return 1;
+            }
+            catch (...)
+            {
+              std::cout << "Error: Could not collect image tile.\n";
+              return 1;
+            }
+        }
+
+        // Write output
         try
         {
-          time_geodesic += p_geodesic_integrator->AddGeodesics(p_radiation_integrator);
+          p_output_writers[camera_num*num_models+model_num]->Write(n);
         }
         catch (const BlacklightException &exception)
         {
@@ -227,15 +533,33 @@ int main(int argc, char *argv[])
         }
         catch (...)
         {
-          std::cout << "Error: Could not integrate geodesics.\n";
+          std::cout << "Error: Could not write output file.\n";
           return 1;
         }
+      }
+
+      // Free refined levels, which need not match between snapshots
+      try
+      {
+        p_radiation_integrators[camera_num]->ReleaseLevels();
+        p_geodesic_integrators[camera_num]->ReleaseLevels();
+      }
+      catch (const BlacklightException &exception)
+      {
+        std::cout << exception.what();
+        return 1;
+      }
+      catch (...)
+      {
+        std::cout << "Error: Could not free refined levels.\n";
+        return 1;
+      }
     }
 
-    // Write output
+    // Restrict subsequent reads to blocks sampled by cameras
     try
     {
-      p_output_writer->Write(n);
+      p_simulation_reader->SelectBlocks(p_radiation_integrators, num_cameras);
     }
     catch (const BlacklightException &exception)
     {
@@ -244,20 +568,68 @@ int main(int argc, char *argv[])
     }
     catch (...)
     {
-      std::cout << "Error: Could not write output file.\n";
+      std::cout << "Error: Could not select simulation blocks.\n";
       return 1;
     }
   }
 
+  // Finish writing output
+  try
+  {
+    for (int writer_num = 0; writer_num < num_cameras * num_models; writer_num++)
+      p_output_writers[writer_num]->FinishWrite();
+  }
+  catch (const BlacklightException &exception)
+  {
+    std::cout << exception.what();
+    return 1;
+  }
+  catch (...)
+  {
+    std::cout << "Error: Could not write output file.\n";
+    return 1;
+  }
+
+  // Write profile
+  try
+  {
+    if (rank == 0)
+      ProfileWrite(profile_file, profile_trace_file);
+  }
+  catch (const BlacklightException &exception)
+  {
+    std::cout << exception.what();
+    return 1;
+  }
+  catch (...)
+  {
+    std::cout << "Error: Could not write profile.\n";
+    return 1;
+  }
+
   // Free memory
-  delete p_output_writer;
-  delete p_radiation_integrator;
+  for (int writer_num = 0; writer_num < num_cameras * num_models; writer_num++)
+    delete p_output_writers[writer_num];
+  for (int camera_num = 0; camera_num < num_cameras; camera_num++)
+    delete p_radiation_integrators[camera_num];
+  delete[] p_output_writers;
+  delete[] p_radiation_integrators;
   delete p_simulation_reader;
-  delete p_geodesic_integrator;
+  for (int camera_num = 0; camera_num < num_cameras; camera_num++)
+    delete p_geodesic_integrators[camera_num];
+  delete[] p_geodesic_integrators;
   delete p_input_reader;
 
-  // Report timings
-  double time_full = omp_get_wtime() - time_start;
+  // Report timings, taking slowest rank for each
+  double time_full = CommMax(omp_get_wtime() - time_start);
+  time_geodesic = CommMax(time_geodesic);
+  time_read = CommMax(time_read);
+  time_sample = CommMax(time_sample);
+  time_image = CommMax(time_image);
+  time_render = CommMax(time_render);
+  CommEnd();
+  if (rank > 0)
+    return 0;
   std::cout << std::setprecision(7);
   std::cout << "\nCalculation completed.";
   std::cout << "\nElapsed time:            " << time_full << " s";
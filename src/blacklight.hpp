@@ -31,11 +31,23 @@ namespace CellValues
 {
   enum : int {rho, n_e, p_gas, theta_e, bb, sigma, beta_inv, num_cell_values};
 }
+namespace SampleValues
+{
+  enum : int {rho, pgas, uu1, uu2, uu3, bb1, bb2, bb3, kappa};
+}
+namespace SampleGeometry
+{
+  enum : int {gcov_sim = 0, lapse_shift_sim = 16, jacobian = 20, gcov = 36, gcon = 52, kcon = 68,
+      num_sample_geometry = 72};
+}
 
 // Scoped enumerations
 enum struct ModelType {simulation, formula};
+enum struct ParallelSchedule {static_, dynamic, guided};
+enum struct ParallelDistribute {pixels, snapshots};
 enum struct OutputFormat {npz, npy, raw};
 enum struct SimulationFormat {athena, athenak, iharm3d, harm3d};
+enum struct PrimitivePrecision {single, bf16, scaled16};
 enum struct Coordinates {cks, sks, fmks};
 enum struct Camera {plane, pinhole};
 enum struct RayTerminate {photon, multiplicative, additive};
@@ -44,5 +56,6 @@ enum struct FrequencySpacing {lin_freq, lin_wave, log};
 enum struct FrequencyNormalization {camera, infinity};
 enum struct RenderType {fill, thresh, rise, fall};
 enum struct PlasmaModel {ti_te_beta, code_kappa};
+enum struct MetricType {flat, schwarzschild, kerr};
 
 #endif
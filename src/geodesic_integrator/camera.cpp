@@ -19,6 +19,8 @@
 // Notes:
 //   Allocates and initializes camera_pos[0], camera_dir[0], image_frequencies, and
 //       momentum_factors[0].
+//   Only sets up the camera_num_pix pixels starting at camera_pix_start, in order to cover a
+//       single tile of the full image.
 //   Neglects spacetime curvature at camera location.
 //   Symbols:
 //     n: unit outward normal
@@ -392,7 +394,8 @@ void GeodesicIntegrator::InitializeCamera()
       #pragma omp parallel for schedule(static)
       for (int m = 0; m < camera_num_pix; m++)
       {
-        SetPixelPlane(custom_x_all[m] / camera_width, custom_y_all[m] / camera_width, m,
+        int m_full = camera_pix_start + m;
+        SetPixelPlane(custom_x_all[m_full] / camera_width, custom_y_all[m_full] / camera_width, m,
                       camera_pos[0], camera_dir[0], momentum_factors[0]);
       }
     }
@@ -401,8 +404,8 @@ void GeodesicIntegrator::InitializeCamera()
       #pragma omp parallel for schedule(static)
       for (int m = 0; m < camera_num_pix; m++)
       {
-        int m2 = m / camera_resolution;
-        int m1 = m % camera_resolution;
+        int m2 = (camera_pix_start + m) / camera_resolution;
+        int m1 = (camera_pix_start + m) % camera_resolution;
         double u_ind = (m1 - camera_resolution / 2.0 + 0.5) / camera_resolution;
         double v_ind = (m2 - camera_resolution / 2.0 + 0.5) / camera_resolution;
         SetPixelPlane(u_ind, v_ind, m, camera_pos[0], camera_dir[0], momentum_factors[0]);
@@ -418,7 +421,8 @@ void GeodesicIntegrator::InitializeCamera()
       #pragma omp parallel for schedule(static)
       for (int m = 0; m < camera_num_pix; m++)
       {
-        SetPixelPinhole(custom_x_all[m] / camera_width, custom_y_all[m] / camera_width, m,
+        int m_full = camera_pix_start + m;
+        SetPixelPinhole(custom_x_all[m_full] / camera_width, custom_y_all[m_full] / camera_width, m,
                         camera_pos[0], camera_dir[0], momentum_factors[0]);
       }
     }
@@ -427,8 +431,8 @@ void GeodesicIntegrator::InitializeCamera()
       #pragma omp parallel for schedule(static)
       for (int m = 0; m < camera_num_pix; m++)
       {
-        int m2 = m / camera_resolution;
-        int m1 = m % camera_resolution;
+        int m2 = (camera_pix_start + m) / camera_resolution;
+        int m1 = (camera_pix_start + m) % camera_resolution;
         double u_ind = (m1 - camera_resolution / 2.0 + 0.5) / camera_resolution;
         double v_ind = (m2 - camera_resolution / 2.0 + 0.5) / camera_resolution;
         SetPixelPinhole(u_ind, v_ind, m, camera_pos[0], camera_dir[0], momentum_factors[0]);
@@ -1,14 +1,21 @@
 // Blacklight geodesic integrator - checkpoint saving and loading
 
 // C++ headers
-#include <fstream>  // ifstream, ofstream
-#include <ios>      // ios_base
+#include <cstdint>       // uintmax_t
+#include <cstring>       // memcmp
+#include <filesystem>    // resize_file
+#include <fstream>       // ifstream, ofstream
+#include <ios>           // ios_base
+#include <string>        // string
+#include <system_error>  // error_code
+#include <type_traits>   // is_same
 
 // Blacklight headers
 #include "geodesic_integrator.hpp"
+#include "../blacklight.hpp"        // enums
 #include "../utils/array.hpp"       // Array
-#include "../utils/exceptions.hpp"  // BlacklightException
-#include "../utils/file_io.hpp"     // ReadBinary, WriteBinary
+#include "../utils/exceptions.hpp"  // BlacklightException, BlacklightWarning
+#include "../utils/file_io.hpp"     // MapBinary, MapFile, ReadBinary, WriteBinary
 
 //--------------------------------------------------------------------------------------------------
 
@@ -16,45 +23,147 @@
 // Inputs: (none)
 // Outputs: (none)
 // Notes:
-//   Overwrites file specified by checkpoint_geodesic_file.
-//   Saves camera data (cam_x, u_con, u_cov, norm_con, norm_con_c, hor_con_c, vert_con_c,
-//       camera_pos[0], and camera_dir[0]).
-//   Does not save camera_num_pix, which is calculated by constructor.
-//   Saves image data (image_frequencies, momentum_factors[0]).
-//   Saves geodesic data (geodesic_num_steps[0], sample_flags[0], sample_num[0], sample_pos[0],
-//       sample_dir[0], and sample_len[0]).
+//   At the root level, overwrites file specified by checkpoint_geodesic_file; at refined levels,
+//       writes to this file in place of any record already saved for this level, truncating the
+//       file there, and otherwise appends to it.
+//   File begins with a header containing:
+//     magic string, format version, byte-order check, and sizes of basic types;
+//     parameters determining geodesics, as set by SetCheckpointParameters();
+//     camera data (cam_x, u_con, u_cov, norm_con, norm_con_c, hor_con_c, and vert_con_c);
+//     number of level slots, number of levels saved, and file offset of each saved level.
+//   Each level has a record containing the level, geodesic_num_steps for that level, and a table
+//       of arrays listing type, dimensions, and file offset of each, followed by the array data.
+//   Root level saves image_frequencies, camera_pos[0], camera_dir[0], momentum_factors[0],
+//       sample_flags[0], sample_num[0], sample_pos[0], sample_dir[0], and sample_len[0].
+//   Refined levels save camera_loc, sample_flags, sample_num, sample_pos, sample_dir, and
+//       sample_len at that level.
+//   Array data is aligned to checkpoint_alignment bytes, so that it can be memory-mapped and used
+//       in place by LoadGeodesics().
+//   Refined levels are saved in order, so replacing a level with that of a later snapshot also
+//       discards all higher levels, and the file holds exactly one record per level saved.
 //   Does not save geodesic_pos, geodesic_dir, or geodesic_len, which are deallocated after internal
 //       use.
 void GeodesicIntegrator::SaveGeodesics()
 {
+  // Calculate location of level directory
+  long int num_levels_pos = 8 + 7 * static_cast<long int>(sizeof(int))
+      + checkpoint_num_params * static_cast<long int>(sizeof(double))
+      + 28 * static_cast<long int>(sizeof(double)) + static_cast<long int>(sizeof(int));
+
+  // Discard any record for this level saved with an earlier snapshot
+  if (adaptive_level > 0)
+  {
+    std::ifstream directory_stream(checkpoint_geodesic_file,
+        std::ios_base::in | std::ios_base::binary);
+    if (not directory_stream.is_open())
+      throw BlacklightException("Could not open geodesic checkpoint file.");
+    int num_levels = 0;
+    long int level_pos_old = 0;
+    directory_stream.seekg(num_levels_pos);
+    ReadBinary(&directory_stream, &num_levels);
+    directory_stream.seekg(num_levels_pos + static_cast<long int>(sizeof(int))
+        + adaptive_level * static_cast<long int>(sizeof(long int)));
+    ReadBinary(&directory_stream, &level_pos_old);
+    if (not directory_stream.good())
+      throw BlacklightException("Geodesic checkpoint file is corrupt.");
+    directory_stream.close();
+    if (adaptive_level < num_levels)
+    {
+      std::error_code error;
+      std::filesystem::resize_file(checkpoint_geodesic_file,
+          static_cast<std::uintmax_t>(level_pos_old), error);
+      if (error)
+        throw BlacklightException("Could not write geodesic checkpoint file.");
+    }
+  }
+
   // Open checkpoint file for writing
-  std::ofstream checkpoint_stream(checkpoint_geodesic_file,
-      std::ios_base::out | std::ios_base::binary);
+  std::ios_base::openmode mode = std::ios_base::out | std::ios_base::binary;
+  if (adaptive_level > 0)
+    mode |= std::ios_base::in;
+  std::ofstream checkpoint_stream(checkpoint_geodesic_file, mode);
   if (not checkpoint_stream.is_open())
     throw BlacklightException("Could not open geodesic checkpoint file.");
 
-  // Write camera data
-  WriteBinary(&checkpoint_stream, cam_x, 4);
-  WriteBinary(&checkpoint_stream, u_con, 4);
-  WriteBinary(&checkpoint_stream, u_cov, 4);
-  WriteBinary(&checkpoint_stream, norm_con, 4);
-  WriteBinary(&checkpoint_stream, norm_con_c, 4);
-  WriteBinary(&checkpoint_stream, hor_con_c, 4);
-  WriteBinary(&checkpoint_stream, vert_con_c, 4);
-  WriteBinary(&checkpoint_stream, camera_pos[0]);
-  WriteBinary(&checkpoint_stream, camera_dir[0]);
-
-  // Write image data
-  WriteBinary(&checkpoint_stream, image_frequencies);
-  WriteBinary(&checkpoint_stream, momentum_factors[0]);
-
-  // Write geodesic data
-  WriteBinary(&checkpoint_stream, geodesic_num_steps[0]);
-  WriteBinary(&checkpoint_stream, sample_flags[0]);
-  WriteBinary(&checkpoint_stream, sample_num[0]);
-  WriteBinary(&checkpoint_stream, sample_pos[0]);
-  WriteBinary(&checkpoint_stream, sample_dir[0]);
-  WriteBinary(&checkpoint_stream, sample_len[0]);
+  // Write header
+  if (adaptive_level == 0)
+  {
+    // Write format data
+    char magic[8] = {'B', 'L', 'G', 'E', 'O', 'D', 'E', 'S'};
+    WriteBinary(&checkpoint_stream, magic, 8);
+    WriteBinary(&checkpoint_stream, checkpoint_geodesic_version);
+    WriteBinary(&checkpoint_stream, 0x01020304);
+    WriteBinary(&checkpoint_stream, static_cast<int>(sizeof(bool)));
+    WriteBinary(&checkpoint_stream, static_cast<int>(sizeof(int)));
+    WriteBinary(&checkpoint_stream, static_cast<int>(sizeof(long int)));
+    WriteBinary(&checkpoint_stream, static_cast<int>(sizeof(double)));
+
+    // Write parameters
+    double params[checkpoint_num_params];
+    const char *names[checkpoint_num_params];
+    SetCheckpointParameters(params, names);
+    WriteBinary(&checkpoint_stream, checkpoint_num_params);
+    WriteBinary(&checkpoint_stream, params, checkpoint_num_params);
+
+    // Write camera data
+    WriteBinary(&checkpoint_stream, cam_x, 4);
+    WriteBinary(&checkpoint_stream, u_con, 4);
+    WriteBinary(&checkpoint_stream, u_cov, 4);
+    WriteBinary(&checkpoint_stream, norm_con, 4);
+    WriteBinary(&checkpoint_stream, norm_con_c, 4);
+    WriteBinary(&checkpoint_stream, hor_con_c, 4);
+    WriteBinary(&checkpoint_stream, vert_con_c, 4);
+
+    // Write level directory
+    WriteBinary(&checkpoint_stream, adaptive_max_level + 1);
+    if (static_cast<long int>(checkpoint_stream.tellp()) != num_levels_pos)
+      throw BlacklightException("Could not write geodesic checkpoint file.");
+    WriteBinary(&checkpoint_stream, 0);
+    for (int level = 0; level <= adaptive_max_level; level++)
+      WriteBinary(&checkpoint_stream, 0l);
+  }
+
+  // Append to existing file
+  else
+    checkpoint_stream.seekp(0, std::ios_base::end);
+
+  // Write level record
+  long int level_pos = static_cast<long int>(checkpoint_stream.tellp());
+  int num_arrays = adaptive_level == 0 ? 9 : 6;
+  WriteBinary(&checkpoint_stream, adaptive_level);
+  WriteBinary(&checkpoint_stream, geodesic_num_steps[adaptive_level]);
+  WriteBinary(&checkpoint_stream, num_arrays);
+  long int entry_pos = static_cast<long int>(checkpoint_stream.tellp());
+  long int entry_size =
+      6 * static_cast<long int>(sizeof(int)) + static_cast<long int>(sizeof(long int));
+  checkpoint_stream.seekp(entry_pos + num_arrays * entry_size);
+
+  // Write arrays
+  if (adaptive_level == 0)
+  {
+    WriteCheckpointArray(&checkpoint_stream, image_frequencies, entry_pos);
+    WriteCheckpointArray(&checkpoint_stream, camera_pos[0], entry_pos += entry_size);
+    WriteCheckpointArray(&checkpoint_stream, camera_dir[0], entry_pos += entry_size);
+    WriteCheckpointArray(&checkpoint_stream, momentum_factors[0], entry_pos += entry_size);
+  }
+  else
+    WriteCheckpointArray(&checkpoint_stream, camera_loc[adaptive_level], entry_pos);
+  WriteCheckpointArray(&checkpoint_stream, sample_flags[adaptive_level], entry_pos += entry_size);
+  WriteCheckpointArray(&checkpoint_stream, sample_num[adaptive_level], entry_pos += entry_size);
+  WriteCheckpointArray(&checkpoint_stream, sample_pos[adaptive_level], entry_pos += entry_size);
+  WriteCheckpointArray(&checkpoint_stream, sample_dir[adaptive_level], entry_pos += entry_size);
+  WriteCheckpointArray(&checkpoint_stream, sample_len[adaptive_level], entry_pos += entry_size);
+
+  // Update level directory
+  checkpoint_stream.seekp(num_levels_pos);
+  WriteBinary(&checkpoint_stream, adaptive_level + 1);
+  checkpoint_stream.seekp(num_levels_pos + static_cast<long int>(sizeof(int))
+      + adaptive_level * static_cast<long int>(sizeof(long int)));
+  WriteBinary(&checkpoint_stream, level_pos);
+  for (int level = adaptive_level + 1; level <= adaptive_max_level; level++)
+    WriteBinary(&checkpoint_stream, 0l);
+  if (not checkpoint_stream.good())
+    throw BlacklightException("Could not write geodesic checkpoint file.");
   return;
 }
 
@@ -64,24 +173,66 @@ void GeodesicIntegrator::SaveGeodesics()
 // Inputs: (none)
 // Outputs: (none)
 // Notes:
-//   Reads file specified by checkpoint_geodesic_file.
-//   Initializes camera data (cam_x, u_con, u_cov, norm_con, norm_con_c, hor_con_c, vert_con_c,
-//       camera_pos[0], and camera_dir[0]), allocating arrays where necessary.
+//   Reads header of file specified by checkpoint_geodesic_file, as written by SaveGeodesics().
+//   Rejects files with unrecognized format or version, and files whose parameters do not match
+//       those of this run.
+//   Memory-maps file, initializing checkpoint_map, checkpoint_map_size, checkpoint_num_levels,
+//       and checkpoint_level_offsets.
+//   Initializes camera data (cam_x, u_con, u_cov, norm_con, norm_con_c, hor_con_c, vert_con_c).
 //   Does not initialize camera_num_pix, which is calculated by constructor.
-//   Initializes image data (image_frequencies, momentum_factors[0]), allocating arrays where
-//       necessary.
-//   Initializes geodesic data (geodesic_num_steps[0], sample_flags[0], sample_num[0],
-//       sample_pos[0], sample_dir[0], and sample_len[0]), allocating arrays where necessary.
+//   Loads root level via LoadGeodesicLevel().
 //   Does not initialize geodesic_pos, geodesic_dir, or geodesic_len, which are deallocated after
 //       internal use when no checkpoint is being loaded.
 void GeodesicIntegrator::LoadGeodesics()
 {
-  // Open checkpoint file for readiing
+  // Open checkpoint file for reading
   std::ifstream checkpoint_stream(checkpoint_geodesic_file,
       std::ios_base::in | std::ios_base::binary);
   if (not checkpoint_stream.is_open())
     throw BlacklightException("Could not open geodesic checkpoint file.");
 
+  // Read format data
+  char magic[8] = {};
+  char magic_expected[8] = {'B', 'L', 'G', 'E', 'O', 'D', 'E', 'S'};
+  ReadBinary(&checkpoint_stream, magic, 8);
+  if (not checkpoint_stream.good() or std::memcmp(magic, magic_expected, 8) != 0)
+    throw BlacklightException("Geodesic checkpoint file has unrecognized format.");
+  int version = 0;
+  ReadBinary(&checkpoint_stream, &version);
+  if (version != checkpoint_geodesic_version)
+    throw BlacklightException("Geodesic checkpoint file has unsupported version.");
+  int byte_order = 0;
+  int size_bool = 0, size_int = 0, size_long = 0, size_double = 0;
+  ReadBinary(&checkpoint_stream, &byte_order);
+  ReadBinary(&checkpoint_stream, &size_bool);
+  ReadBinary(&checkpoint_stream, &size_int);
+  ReadBinary(&checkpoint_stream, &size_long);
+  ReadBinary(&checkpoint_stream, &size_double);
+  if (byte_order != 0x01020304 or size_bool != static_cast<int>(sizeof(bool))
+      or size_int != static_cast<int>(sizeof(int))
+      or size_long != static_cast<int>(sizeof(long int))
+      or size_double != static_cast<int>(sizeof(double)))
+    throw BlacklightException("Geodesic checkpoint file written on incompatible architecture.");
+
+  // Check parameters
+  int num_params = 0;
+  ReadBinary(&checkpoint_stream, &num_params);
+  if (num_params != checkpoint_num_params)
+    throw BlacklightException("Geodesic checkpoint file has unrecognized format.");
+  double params_file[checkpoint_num_params];
+  double params[checkpoint_num_params];
+  const char *names[checkpoint_num_params];
+  ReadBinary(&checkpoint_stream, params_file, checkpoint_num_params);
+  SetCheckpointParameters(params, names);
+  for (int n = 0; n < checkpoint_num_params; n++)
+    if (not (params_file[n] == params[n]))
+    {
+      std::string message = "Geodesic checkpoint file does not match ";
+      message += names[n];
+      message += ".";
+      throw BlacklightException(message.c_str());
+    }
+
   // Read camera data
   ReadBinary(&checkpoint_stream, cam_x, 4);
   ReadBinary(&checkpoint_stream, u_con, 4);
@@ -90,19 +241,263 @@ void GeodesicIntegrator::LoadGeodesics()
   ReadBinary(&checkpoint_stream, norm_con_c, 4);
   ReadBinary(&checkpoint_stream, hor_con_c, 4);
   ReadBinary(&checkpoint_stream, vert_con_c, 4);
-  ReadBinary(&checkpoint_stream, &camera_pos[0]);
-  ReadBinary(&checkpoint_stream, &camera_dir[0]);
-
-  // Read image data
-  ReadBinary(&checkpoint_stream, &image_frequencies);
-  ReadBinary(&checkpoint_stream, &momentum_factors[0]);
-
-  // Read geodesic data
-  ReadBinary(&checkpoint_stream, &geodesic_num_steps[0]);
-  ReadBinary(&checkpoint_stream, &sample_flags[0]);
-  ReadBinary(&checkpoint_stream, &sample_num[0]);
-  ReadBinary(&checkpoint_stream, &sample_pos[0]);
-  ReadBinary(&checkpoint_stream, &sample_dir[0]);
-  ReadBinary(&checkpoint_stream, &sample_len[0]);
+
+  // Read level directory
+  int num_slots = 0;
+  ReadBinary(&checkpoint_stream, &num_slots);
+  ReadBinary(&checkpoint_stream, &checkpoint_num_levels);
+  if (not checkpoint_stream.good() or num_slots <= 0 or checkpoint_num_levels <= 0
+      or checkpoint_num_levels > num_slots)
+    throw BlacklightException("Geodesic checkpoint file is incomplete.");
+  checkpoint_level_offsets = new long int[num_slots];
+  ReadBinary(&checkpoint_stream, checkpoint_level_offsets, num_slots);
+  if (not checkpoint_stream.good())
+    throw BlacklightException("Geodesic checkpoint file is incomplete.");
+  checkpoint_stream.close();
+
+  // Map file and load root level
+  checkpoint_map = MapFile(checkpoint_geodesic_file, &checkpoint_map_size);
+  LoadGeodesicLevel();
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for loading geodesic data at current level from memory-mapped checkpoint
+// Inputs: (none)
+// Outputs:
+//   returned value: flag indicating geodesics were loaded
+// Notes:
+//   Assumes LoadGeodesics() has been called.
+//   At root level, initializes image_frequencies, camera_pos[0], camera_dir[0], and
+//       momentum_factors[0], using mapped memory as backing store.
+//   At refined levels, assumes camera_loc[adaptive_level] has been set, and only loads geodesics
+//       if the checkpoint has the same blocks at this level.
+//   Initializes geodesic_num_steps[adaptive_level] and, using mapped memory as backing store,
+//       sample_flags[adaptive_level], sample_num[adaptive_level], sample_pos[adaptive_level],
+//       sample_dir[adaptive_level], and sample_len[adaptive_level].
+bool GeodesicIntegrator::LoadGeodesicLevel()
+{
+  // Check for level in checkpoint
+  if (adaptive_level >= checkpoint_num_levels)
+    return false;
+
+  // Open checkpoint file for reading level record
+  std::ifstream checkpoint_stream(checkpoint_geodesic_file,
+      std::ios_base::in | std::ios_base::binary);
+  if (not checkpoint_stream.is_open())
+    throw BlacklightException("Could not open geodesic checkpoint file.");
+  checkpoint_stream.seekg(checkpoint_level_offsets[adaptive_level]);
+  int level = 0;
+  int num_steps = 0;
+  int num_arrays = 0;
+  ReadBinary(&checkpoint_stream, &level);
+  ReadBinary(&checkpoint_stream, &num_steps);
+  ReadBinary(&checkpoint_stream, &num_arrays);
+  if (not checkpoint_stream.good() or level != adaptive_level
+      or num_arrays != (adaptive_level == 0 ? 9 : 6))
+    throw BlacklightException("Geodesic checkpoint file is corrupt.");
+
+  // Map camera data at root level
+  if (adaptive_level == 0)
+  {
+    MapCheckpointArray(&checkpoint_stream, &image_frequencies);
+    MapCheckpointArray(&checkpoint_stream, &camera_pos[0]);
+    MapCheckpointArray(&checkpoint_stream, &camera_dir[0]);
+    MapCheckpointArray(&checkpoint_stream, &momentum_factors[0]);
+  }
+
+  // Compare blocks at refined level
+  else
+  {
+    Array<int> camera_loc_file;
+    MapCheckpointArray(&checkpoint_stream, &camera_loc_file);
+    bool match = camera_loc_file.n_tot == camera_loc[adaptive_level].n_tot
+        and std::memcmp(camera_loc_file.data, camera_loc[adaptive_level].data,
+        camera_loc_file.GetNumBytes()) == 0;
+    if (not match)
+    {
+      BlacklightWarning("Geodesic checkpoint refinement differs; integrating new geodesics.");
+      return false;
+    }
+  }
+
+  // Map geodesic data
+  geodesic_num_steps[adaptive_level] = num_steps;
+  MapCheckpointArray(&checkpoint_stream, &sample_flags[adaptive_level]);
+  MapCheckpointArray(&checkpoint_stream, &sample_num[adaptive_level]);
+  MapCheckpointArray(&checkpoint_stream, &sample_pos[adaptive_level]);
+  MapCheckpointArray(&checkpoint_stream, &sample_dir[adaptive_level]);
+  MapCheckpointArray(&checkpoint_stream, &sample_len[adaptive_level]);
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for collecting parameters that determine geodesics
+// Inputs: (none)
+// Outputs:
+//   params: values of parameters
+//   names: names of parameters, for reporting mismatches
+// Notes:
+//   Parameters not used by this run are set to 0.0, so that they do not affect comparisons.
+void GeodesicIntegrator::SetCheckpointParameters(double params[checkpoint_num_params],
+    const char *names[checkpoint_num_params])
+{
+  int n = 0;
+  names[n] = "model_type";
+  params[n++] = static_cast<double>(static_cast<int>(model_type));
+  names[n] = "camera_type";
+  params[n++] = static_cast<double>(static_cast<int>(camera_type));
+  names[n] = "camera_r";
+  params[n++] = camera_r;
+  names[n] = "camera_th";
+  params[n++] = camera_th;
+  names[n] = "camera_ph";
+  params[n++] = camera_ph;
+  names[n] = "camera_urn";
+  params[n++] = camera_urn;
+  names[n] = "camera_uthn";
+  params[n++] = camera_uthn;
+  names[n] = "camera_uphn";
+  params[n++] = camera_uphn;
+  names[n] = "camera_k_r";
+  params[n++] = camera_k_r;
+  names[n] = "camera_k_th";
+  params[n++] = camera_k_th;
+  names[n] = "camera_k_ph";
+  params[n++] = camera_k_ph;
+  names[n] = "camera_rotation";
+  params[n++] = camera_rotation;
+  names[n] = "camera_width";
+  params[n++] = camera_width;
+  names[n] = "camera_resolution";
+  params[n++] = static_cast<double>(camera_resolution);
+  names[n] = "camera_pole";
+  params[n++] = camera_pole ? 1.0 : 0.0;
+  names[n] = "number of pixels";
+  params[n++] = static_cast<double>(camera_num_pix);
+  names[n] = "black hole mass";
+  params[n++] = bh_m;
+  names[n] = "black hole spin";
+  params[n++] = bh_a;
+  names[n] = "ray_flat";
+  params[n++] = ray_flat ? 1.0 : 0.0;
+  names[n] = "ray_terminate";
+  params[n++] = static_cast<double>(static_cast<int>(ray_terminate));
+  names[n] = "termination radius";
+  params[n++] = r_terminate;
+  names[n] = "ray_integrator";
+  params[n++] = static_cast<double>(static_cast<int>(ray_integrator));
+  names[n] = "ray_step";
+  params[n++] = ray_step;
+  names[n] = "ray_max_steps";
+  params[n++] = static_cast<double>(ray_max_steps);
+  names[n] = "ray_max_retries";
+  params[n++] = ray_integrator == RayIntegrator::dp ? static_cast<double>(ray_max_retries) : 0.0;
+  names[n] = "ray_tol_abs";
+  params[n++] = ray_integrator == RayIntegrator::dp ? ray_tol_abs : 0.0;
+  names[n] = "ray_tol_rel";
+  params[n++] = ray_integrator == RayIntegrator::dp ? ray_tol_rel : 0.0;
+  names[n] = "image_num_frequencies";
+  params[n++] = static_cast<double>(image_num_frequencies);
+  names[n] = "image_frequency";
+  params[n++] = image_num_frequencies == 1 ? image_frequency : 0.0;
+  names[n] = "image_frequency_start";
+  params[n++] = image_num_frequencies > 1 ? image_frequency_start : 0.0;
+  names[n] = "image_frequency_end";
+  params[n++] = image_num_frequencies > 1 ? image_frequency_end : 0.0;
+  names[n] = "image_frequency_spacing";
+  params[n++] = image_num_frequencies > 1
+      ? static_cast<double>(static_cast<int>(image_frequency_spacing)) : 0.0;
+  names[n] = "image_normalization";
+  params[n++] = static_cast<double>(static_cast<int>(image_normalization));
+  names[n] = "adaptive_block_size";
+  params[n++] = adaptive_max_level > 0 ? static_cast<double>(adaptive_block_size) : 0.0;
+  names[n] = "adaptive_reuse_ratio";
+  params[n++] = adaptive_reuse_rays ? adaptive_reuse_ratio : 0.0;
+  names[n] = "adaptive_reuse_angle";
+  params[n++] = adaptive_reuse_rays ? adaptive_reuse_angle : 0.0;
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for writing Array to checkpoint file with entry in table of arrays
+// Inputs:
+//   *p_stream: open ofstream for checkpoint file, positioned after previous data
+//   array: Array to write
+//   entry_pos: file offset of table entry for this Array
+// Outputs: (none)
+// Notes:
+//   Table entry consists of type code (1 for bool, 2 for int, 3 for double), dimensions n1
+//       through n5, and file offset of data.
+//   Pads file so that data begins on a multiple of checkpoint_alignment bytes.
+//   Leaves stream positioned at end of data.
+template<typename type> void GeodesicIntegrator::WriteCheckpointArray(std::ofstream *p_stream,
+    const Array<type> &array, long int entry_pos)
+{
+  // Pad file
+  long int pad_pos = static_cast<long int>(p_stream->tellp());
+  long int data_pos = (pad_pos + checkpoint_alignment - 1) / checkpoint_alignment
+      * checkpoint_alignment;
+  char padding[checkpoint_alignment] = {};
+  WriteBinary(p_stream, padding, data_pos - pad_pos);
+
+  // Write data
+  WriteBinary(p_stream, array.data, array.n_tot);
+  long int end_pos = static_cast<long int>(p_stream->tellp());
+
+  // Write table entry
+  int type_code = std::is_same<type, bool>::value ? 1 : std::is_same<type, int>::value ? 2 : 3;
+  p_stream->seekp(entry_pos);
+  WriteBinary(p_stream, type_code);
+  WriteBinary(p_stream, array.n1);
+  WriteBinary(p_stream, array.n2);
+  WriteBinary(p_stream, array.n3);
+  WriteBinary(p_stream, array.n4);
+  WriteBinary(p_stream, array.n5);
+  WriteBinary(p_stream, data_pos);
+  p_stream->seekp(end_pos);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for mapping Array from checkpoint file according to entry in table of arrays
+// Inputs:
+//   *p_stream: open ifstream for checkpoint file, positioned at table entry
+// Outputs:
+//   *p_array: Array using memory-mapped checkpoint file as backing store
+// Notes:
+//   Assumes checkpoint_map and checkpoint_map_size have been set.
+//   Leaves stream positioned at next table entry.
+template<typename type> void GeodesicIntegrator::MapCheckpointArray(std::ifstream *p_stream,
+    Array<type> *p_array)
+{
+  // Read table entry
+  int type_code = 0;
+  int n1 = 0, n2 = 0, n3 = 0, n4 = 0, n5 = 0;
+  long int data_pos = 0;
+  ReadBinary(p_stream, &type_code);
+  ReadBinary(p_stream, &n1);
+  ReadBinary(p_stream, &n2);
+  ReadBinary(p_stream, &n3);
+  ReadBinary(p_stream, &n4);
+  ReadBinary(p_stream, &n5);
+  ReadBinary(p_stream, &data_pos);
+
+  // Check entry
+  int type_code_expected =
+      std::is_same<type, bool>::value ? 1 : std::is_same<type, int>::value ? 2 : 3;
+  long int num_bytes = static_cast<long int>(sizeof(type)) * n1 * n2 * n3 * n4 * n5;
+  if (not p_stream->good() or type_code != type_code_expected or n1 <= 0 or n2 <= 0 or n3 <= 0
+      or n4 <= 0 or n5 <= 0 or data_pos % checkpoint_alignment != 0
+      or data_pos + num_bytes > static_cast<long int>(checkpoint_map_size))
+    throw BlacklightException("Geodesic checkpoint file is corrupt.");
+
+  // Map data
+  p_array->Deallocate();
+  MapBinary(checkpoint_map, data_pos, n5, n4, n3, n2, n1, p_array);
   return;
 }
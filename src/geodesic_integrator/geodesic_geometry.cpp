@@ -5,8 +5,35 @@
 
 // Blacklight headers
 #include "geodesic_integrator.hpp"
+#include "../blacklight.hpp"        // enums
 #include "../utils/array.hpp"       // Array
 
+// Instantiations
+template double GeodesicIntegrator::RadialGeodesicCoordinate<MetricType::flat>(double x, double y,
+    double z);
+template double GeodesicIntegrator::RadialGeodesicCoordinate<MetricType::schwarzschild>(double x,
+    double y, double z);
+template double GeodesicIntegrator::RadialGeodesicCoordinate<MetricType::kerr>(double x, double y,
+    double z);
+template void GeodesicIntegrator::CovariantGeodesicMetric<MetricType::flat>(double x, double y,
+    double z, double gcov[4][4]);
+template void GeodesicIntegrator::CovariantGeodesicMetric<MetricType::schwarzschild>(double x,
+    double y, double z, double gcov[4][4]);
+template void GeodesicIntegrator::CovariantGeodesicMetric<MetricType::kerr>(double x, double y,
+    double z, double gcov[4][4]);
+template void GeodesicIntegrator::ContravariantGeodesicMetric<MetricType::flat>(double x, double y,
+    double z, double gcon[4][4]);
+template void GeodesicIntegrator::ContravariantGeodesicMetric<MetricType::schwarzschild>(double x,
+    double y, double z, double gcon[4][4]);
+template void GeodesicIntegrator::ContravariantGeodesicMetric<MetricType::kerr>(double x, double y,
+    double z, double gcon[4][4]);
+template void GeodesicIntegrator::ContravariantGeodesicMetricDerivative<MetricType::flat>(double x,
+    double y, double z, double dgcon[3][4][4]);
+template void GeodesicIntegrator::ContravariantGeodesicMetricDerivative<MetricType::schwarzschild>(
+    double x, double y, double z, double dgcon[3][4][4]);
+template void GeodesicIntegrator::ContravariantGeodesicMetricDerivative<MetricType::kerr>(double x,
+    double y, double z, double dgcon[3][4][4]);
+
 //--------------------------------------------------------------------------------------------------
 
 // Function for calculating radial coordinate given location in coordinates used for geodesics
@@ -15,9 +42,37 @@
 // Outputs:
 //   returned value: radial coordinate
 // Notes:
+//   Dispatches to version specialized for metric_type.
+double GeodesicIntegrator::RadialGeodesicCoordinate(double x, double y, double z)
+{
+  if (metric_type == MetricType::schwarzschild)
+    return RadialGeodesicCoordinate<MetricType::schwarzschild>(x, y, z);
+  else if (metric_type == MetricType::kerr)
+    return RadialGeodesicCoordinate<MetricType::kerr>(x, y, z);
+  else
+    return RadialGeodesicCoordinate<MetricType::flat>(x, y, z);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating radial coordinate given location in coordinates used for geodesics,
+//     specialized for given metric
+// Inputs:
+//   x, y, z: coordinates
+// Outputs:
+//   returned value: radial coordinate
+// Notes:
 //   Assumes Cartesian Kerr-Schild coordinates.
+//   Flat case uses the same spheroidal coordinate as the Kerr case, so that termination is
+//       unchanged.
+template<MetricType metric>
 double GeodesicIntegrator::RadialGeodesicCoordinate(double x, double y, double z)
 {
+  // Handle Schwarzschild case
+  if constexpr (metric == MetricType::schwarzschild)
+    return std::sqrt(x * x + y * y + z * z);
+
+  // Handle general case
   double a2 = bh_a * bh_a;
   double rr2 = x * x + y * y + z * z;
   double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
@@ -33,12 +88,34 @@ double GeodesicIntegrator::RadialGeodesicCoordinate(double x, double y, double z
 // Outputs:
 //   gcov: components set
 // Notes:
+//   Dispatches to version specialized for metric_type.
+void GeodesicIntegrator::CovariantGeodesicMetric(double x, double y, double z, double gcov[4][4])
+{
+  if (metric_type == MetricType::schwarzschild)
+    CovariantGeodesicMetric<MetricType::schwarzschild>(x, y, z, gcov);
+  else if (metric_type == MetricType::kerr)
+    CovariantGeodesicMetric<MetricType::kerr>(x, y, z, gcov);
+  else
+    CovariantGeodesicMetric<MetricType::flat>(x, y, z, gcov);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating covariant metric components for integrating geodesics, specialized for
+//     given metric
+// Inputs:
+//   x, y, z: coordinates
+// Outputs:
+//   gcov: components set
+// Notes:
 //   Assumes gcov is allocated to be 4*4.
-//   Assumes Cartesian Kerr-Schild coordinates (assumes Minkowski coordinates if ray_flat == true).
+//   Assumes Cartesian Kerr-Schild coordinates (Minkowski coordinates for flat metric).
+template<MetricType metric>
 void GeodesicIntegrator::CovariantGeodesicMetric(double x, double y, double z, double gcov[4][4])
 {
   // Handle flat case
-  if (ray_flat)
+  if constexpr (metric == MetricType::flat)
   {
     gcov[0][0] = -1.0;
     gcov[0][1] = 0.0;
@@ -59,18 +136,28 @@ void GeodesicIntegrator::CovariantGeodesicMetric(double x, double y, double z, d
     return;
   }
 
-  // Calculate useful quantities
-  double a2 = bh_a * bh_a;
-  double rr2 = x * x + y * y + z * z;
-  double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
-  double r = std::sqrt(r2);
-  double f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
-
-  // Calculate null vector
+  // Calculate useful quantities and null vector
+  double f, l_1, l_2, l_3;
+  if constexpr (metric == MetricType::schwarzschild)
+  {
+    double r = std::sqrt(x * x + y * y + z * z);
+    f = 2.0 * bh_m / r;
+    l_1 = x / r;
+    l_2 = y / r;
+    l_3 = z / r;
+  }
+  else
+  {
+    double a2 = bh_a * bh_a;
+    double rr2 = x * x + y * y + z * z;
+    double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
+    double r = std::sqrt(r2);
+    f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
+    l_1 = (r * x + bh_a * y) / (r2 + a2);
+    l_2 = (r * y - bh_a * x) / (r2 + a2);
+    l_3 = z / r;
+  }
   double l_0 = 1.0;
-  double l_1 = (r * x + bh_a * y) / (r2 + a2);
-  double l_2 = (r * y - bh_a * x) / (r2 + a2);
-  double l_3 = z / r;
 
   // Calculate metric components
   gcov[0][0] = f * l_0 * l_0 - 1.0;
@@ -100,13 +187,36 @@ void GeodesicIntegrator::CovariantGeodesicMetric(double x, double y, double z, d
 // Outputs:
 //   gcon: components set
 // Notes:
+//   Dispatches to version specialized for metric_type.
+void GeodesicIntegrator::ContravariantGeodesicMetric(double x, double y, double z,
+    double gcon[4][4])
+{
+  if (metric_type == MetricType::schwarzschild)
+    ContravariantGeodesicMetric<MetricType::schwarzschild>(x, y, z, gcon);
+  else if (metric_type == MetricType::kerr)
+    ContravariantGeodesicMetric<MetricType::kerr>(x, y, z, gcon);
+  else
+    ContravariantGeodesicMetric<MetricType::flat>(x, y, z, gcon);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating contravariant metric components for integrating geodesics, specialized
+//     for given metric
+// Inputs:
+//   x, y, z: coordinates
+// Outputs:
+//   gcon: components set
+// Notes:
 //   Assumes gcon is allocated to be 4*4.
-//   Assumes Cartesian Kerr-Schild coordinates (assumes Minkowski coordinates if ray_flat == true).
+//   Assumes Cartesian Kerr-Schild coordinates (Minkowski coordinates for flat metric).
+template<MetricType metric>
 void GeodesicIntegrator::ContravariantGeodesicMetric(double x, double y, double z,
     double gcon[4][4])
 {
   // Handle flat case
-  if (ray_flat)
+  if constexpr (metric == MetricType::flat)
   {
     gcon[0][0] = -1.0;
     gcon[0][1] = 0.0;
@@ -127,18 +237,28 @@ void GeodesicIntegrator::ContravariantGeodesicMetric(double x, double y, double
     return;
   }
 
-  // Calculate useful quantities
-  double a2 = bh_a * bh_a;
-  double rr2 = x * x + y * y + z * z;
-  double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
-  double r = std::sqrt(r2);
-  double f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
-
-  // Calculate null vector
+  // Calculate useful quantities and null vector
+  double f, l1, l2, l3;
+  if constexpr (metric == MetricType::schwarzschild)
+  {
+    double r = std::sqrt(x * x + y * y + z * z);
+    f = 2.0 * bh_m / r;
+    l1 = x / r;
+    l2 = y / r;
+    l3 = z / r;
+  }
+  else
+  {
+    double a2 = bh_a * bh_a;
+    double rr2 = x * x + y * y + z * z;
+    double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
+    double r = std::sqrt(r2);
+    f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
+    l1 = (r * x + bh_a * y) / (r2 + a2);
+    l2 = (r * y - bh_a * x) / (r2 + a2);
+    l3 = z / r;
+  }
   double l0 = -1.0;
-  double l1 = (r * x + bh_a * y) / (r2 + a2);
-  double l2 = (r * y - bh_a * x) / (r2 + a2);
-  double l3 = z / r;
 
   // Calculate metric components
   gcon[0][0] = -f * l0 * l0 - 1.0;
@@ -169,12 +289,14 @@ void GeodesicIntegrator::ContravariantGeodesicMetric(double x, double y, double
 //   dgcon: components set
 // Notes:
 //   Assumes dgcon is allocated to be 3*4*4.
-//   Assumes Cartesian Kerr-Schild coordinates (assumes Minkowski coordinates if ray_flat == true).
+//   Assumes Cartesian Kerr-Schild coordinates (Minkowski coordinates for flat metric).
+//   Schwarzschild case uses d(l^i) / d(x^j) = (delta^i_j - l^i l^j) / r.
+template<MetricType metric>
 void GeodesicIntegrator::ContravariantGeodesicMetricDerivative(double x, double y, double z,
     double dgcon[3][4][4])
 {
   // Handle flat case
-  if (ray_flat)
+  if constexpr (metric == MetricType::flat)
   {
     for (int a = 0; a < 3; a++)
       for (int mu = 0; mu < 4; mu++)
@@ -183,41 +305,75 @@ void GeodesicIntegrator::ContravariantGeodesicMetricDerivative(double x, double
     return;
   }
 
-  // Calculate useful quantities
-  double a2 = bh_a * bh_a;
-  double rr2 = x * x + y * y + z * z;
-  double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
-  double r = std::sqrt(r2);
-  double f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
+  // Calculate null vector and its derivatives
+  double f, l1, l2, l3;
+  double df_dx, df_dy, df_dz;
+  double dl1_dx, dl1_dy, dl1_dz, dl2_dx, dl2_dy, dl2_dz, dl3_dx, dl3_dy, dl3_dz;
+  if constexpr (metric == MetricType::schwarzschild)
+  {
+    // Calculate useful quantities
+    double r = std::sqrt(x * x + y * y + z * z);
+    f = 2.0 * bh_m / r;
 
-  // Calculate null vector
+    // Calculate null vector
+    l1 = x / r;
+    l2 = y / r;
+    l3 = z / r;
+
+    // Calculate scalar derivatives
+    df_dx = -f * l1 / r;
+    df_dy = -f * l2 / r;
+    df_dz = -f * l3 / r;
+
+    // Calculate vector derivatives
+    dl1_dx = (1.0 - l1 * l1) / r;
+    dl1_dy = -l1 * l2 / r;
+    dl1_dz = -l1 * l3 / r;
+    dl2_dx = -l2 * l1 / r;
+    dl2_dy = (1.0 - l2 * l2) / r;
+    dl2_dz = -l2 * l3 / r;
+    dl3_dx = -l3 * l1 / r;
+    dl3_dy = -l3 * l2 / r;
+    dl3_dz = (1.0 - l3 * l3) / r;
+  }
+  else
+  {
+    // Calculate useful quantities
+    double a2 = bh_a * bh_a;
+    double rr2 = x * x + y * y + z * z;
+    double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
+    double r = std::sqrt(r2);
+    f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
+
+    // Calculate null vector
+    l1 = (r * x + bh_a * y) / (r2 + a2);
+    l2 = (r * y - bh_a * x) / (r2 + a2);
+    l3 = z / r;
+
+    // Calculate scalar derivatives
+    double dr_dx = r * x / (2.0 * r2 - rr2 + a2);
+    double dr_dy = r * y / (2.0 * r2 - rr2 + a2);
+    double dr_dz = (r * z + a2 * z / r) / (2.0 * r2 - rr2 + a2);
+    df_dx = -(r2 * r2 - 3.0 * a2 * z * z) * dr_dx / (r * (r2 * r2 + a2 * z * z)) * f;
+    df_dy = -(r2 * r2 - 3.0 * a2 * z * z) * dr_dy / (r * (r2 * r2 + a2 * z * z)) * f;
+    df_dz = -((r2 * r2 - 3.0 * a2 * z * z) * dr_dz + 2.0 * a2 * r * z)
+        / (r * (r2 * r2 + a2 * z * z)) * f;
+
+    // Calculate vector derivatives
+    dl1_dx = ((x - 2.0 * r * l1) * dr_dx + r) / (r2 + a2);
+    dl1_dy = ((x - 2.0 * r * l1) * dr_dy + bh_a) / (r2 + a2);
+    dl1_dz = (x - 2.0 * r * l1) * dr_dz / (r2 + a2);
+    dl2_dx = ((y - 2.0 * r * l2) * dr_dx - bh_a) / (r2 + a2);
+    dl2_dy = ((y - 2.0 * r * l2) * dr_dy + r) / (r2 + a2);
+    dl2_dz = (y - 2.0 * r * l2) * dr_dz / (r2 + a2);
+    dl3_dx = -z / r2 * dr_dx;
+    dl3_dy = -z / r2 * dr_dy;
+    dl3_dz = -z / r2 * dr_dz + 1.0 / r;
+  }
   double l0 = -1.0;
-  double l1 = (r * x + bh_a * y) / (r2 + a2);
-  double l2 = (r * y - bh_a * x) / (r2 + a2);
-  double l3 = z / r;
-
-  // Calculate scalar derivatives
-  double dr_dx = r * x / (2.0 * r2 - rr2 + a2);
-  double dr_dy = r * y / (2.0 * r2 - rr2 + a2);
-  double dr_dz = (r * z + a2 * z / r) / (2.0 * r2 - rr2 + a2);
-  double df_dx = -(r2 * r2 - 3.0 * a2 * z * z) * dr_dx / (r * (r2 * r2 + a2 * z * z)) * f;
-  double df_dy = -(r2 * r2 - 3.0 * a2 * z * z) * dr_dy / (r * (r2 * r2 + a2 * z * z)) * f;
-  double df_dz =
-      -((r2 * r2 - 3.0 * a2 * z * z) * dr_dz + 2.0 * a2 * r * z) / (r * (r2 * r2 + a2 * z * z)) * f;
-
-  // Calculate vector derivatives
   double dl0_dx = 0.0;
   double dl0_dy = 0.0;
   double dl0_dz = 0.0;
-  double dl1_dx = ((x - 2.0 * r * l1) * dr_dx + r) / (r2 + a2);
-  double dl1_dy = ((x - 2.0 * r * l1) * dr_dy + bh_a) / (r2 + a2);
-  double dl1_dz = (x - 2.0 * r * l1) * dr_dz / (r2 + a2);
-  double dl2_dx = ((y - 2.0 * r * l2) * dr_dx - bh_a) / (r2 + a2);
-  double dl2_dy = ((y - 2.0 * r * l2) * dr_dy + r) / (r2 + a2);
-  double dl2_dz = (y - 2.0 * r * l2) * dr_dz / (r2 + a2);
-  double dl3_dx = -z / r2 * dr_dx;
-  double dl3_dy = -z / r2 * dr_dy;
-  double dl3_dz = -z / r2 * dr_dz + 1.0 / r;
 
   // Calculate metric component x-derivatives
   dgcon[0][0][0] = -(df_dx * l0 * l0 + f * dl0_dx * l0 + f * l0 * dl0_dx);
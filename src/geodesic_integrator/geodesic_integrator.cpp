@@ -2,6 +2,7 @@
 
 // C++ headers
 #include <cmath>     // abs, acos, cos, sqrt
+#include <cstddef>   // size_t
 #include <optional>  // optional
 #include <string>    // string
 
@@ -13,7 +14,8 @@
 #include "../blacklight.hpp"                                 // enums
 #include "../input_reader/input_reader.hpp"                  // InputReader
 #include "../radiation_integrator/radiation_integrator.hpp"  // RadiationIntegrator
-#include "../utils/exceptions.hpp"                           // BlacklightException
+#include "../utils/exceptions.hpp"                           // BlacklightException, BlacklightWarning
+#include "../utils/file_io.hpp"                              // UnmapFile
 
 //--------------------------------------------------------------------------------------------------
 
@@ -68,7 +70,38 @@ GeodesicIntegrator::GeodesicIntegrator(const InputReader *p_input_reader)
       throw BlacklightException("Must have nonnegative ray_max_retries.");
     ray_tol_abs = p_input_reader->ray_tol_abs.value();
     ray_tol_rel = p_input_reader->ray_tol_rel.value();
+    ray_packet_size = 1;
+    if (p_input_reader->ray_packet_size.has_value())
+      ray_packet_size = p_input_reader->ray_packet_size.value();
+    if (ray_packet_size != 1 and ray_packet_size != 4 and ray_packet_size != 8)
+      throw BlacklightException("Must have ray_packet_size of 1, 4, or 8.");
   }
+  else
+  {
+    ray_packet_size = 1;
+    if (p_input_reader->ray_packet_size.has_value()
+        and p_input_reader->ray_packet_size.value() != 1)
+      BlacklightWarning("Ignoring ray_packet_size selection.");
+  }
+  ray_streaming = false;
+  if (p_input_reader->ray_streaming.has_value())
+    ray_streaming = p_input_reader->ray_streaming.value();
+  ray_offload = false;
+  if (p_input_reader->ray_offload.has_value())
+    ray_offload = p_input_reader->ray_offload.value();
+  if (ray_offload and ray_integrator == RayIntegrator::dp)
+  {
+    BlacklightWarning("Ignoring ray_offload selection.");
+    ray_offload = false;
+  }
+  if (ray_offload and ray_streaming)
+  {
+    BlacklightWarning("Ignoring ray_streaming selection.");
+    ray_streaming = false;
+  }
+  ray_sample_float = false;
+  if (p_input_reader->ray_sample_float.has_value())
+    ray_sample_float = p_input_reader->ray_sample_float.value();
 
   // Copy image parameters
   image_num_frequencies = p_input_reader->image_num_frequencies.value();
@@ -102,6 +135,27 @@ GeodesicIntegrator::GeodesicIntegrator(const InputReader *p_input_reader)
     if (camera_resolution % adaptive_block_size != 0)
       throw BlacklightException("Must have adaptive_block_size divide camera_resolution.");
   }
+  adaptive_reuse_rays = false;
+  if (p_input_reader->adaptive_reuse_rays.has_value())
+    adaptive_reuse_rays = p_input_reader->adaptive_reuse_rays.value();
+  if (adaptive_reuse_rays and (adaptive_max_level <= 0 or ray_sample_float))
+  {
+    BlacklightWarning("Ignoring adaptive_reuse_rays selection.");
+    adaptive_reuse_rays = false;
+  }
+  if (adaptive_reuse_rays)
+  {
+    adaptive_reuse_ratio = 1.1;
+    if (p_input_reader->adaptive_reuse_ratio.has_value())
+      adaptive_reuse_ratio = p_input_reader->adaptive_reuse_ratio.value();
+    if (adaptive_reuse_ratio < 1.0)
+      throw BlacklightException("Must have adaptive_reuse_ratio of at least 1.");
+    adaptive_reuse_angle = 0.5;
+    if (p_input_reader->adaptive_reuse_angle.has_value())
+      adaptive_reuse_angle = p_input_reader->adaptive_reuse_angle.value();
+    if (adaptive_reuse_angle < 0.0)
+      throw BlacklightException("Must have nonnegative adaptive_reuse_angle.");
+  }
 
   // Set and calculate geometry data
   if (model_type == ModelType::simulation)
@@ -122,6 +176,16 @@ GeodesicIntegrator::GeodesicIntegrator(const InputReader *p_input_reader)
   else if (ray_terminate == RayTerminate::additive)
     r_terminate = r_horizon + ray_factor;
 
+  // Select metric kernels, where simplified Schwarzschild expressions round differently from Kerr
+  // ones, changing intensity and optical depth by up to about 1e-4 relative (time and length by
+  // about 4e-7) in a zero-spin AthenaK test
+  if (ray_flat)
+    metric_type = MetricType::flat;
+  else if (bh_a == 0.0)
+    metric_type = MetricType::schwarzschild;
+  else
+    metric_type = MetricType::kerr;
+
   // Calculate number of pixels
   if (p_input_reader->custom_pixels)
   {
@@ -140,21 +204,36 @@ GeodesicIntegrator::GeodesicIntegrator(const InputReader *p_input_reader)
     use_custom_pixels = false;
   }
 
+  // Restrict pixels to selected tile
+  camera_num_pix_total = camera_num_pix;
+  camera_pix_start = 0;
+  if (p_input_reader->tile_num_pix.has_value())
+  {
+    camera_pix_start = p_input_reader->tile_pix_start.value();
+    camera_num_pix = p_input_reader->tile_num_pix.value();
+  }
+
   // Allocate space for camera data
-  camera_loc = new Array<int>[adaptive_max_level+1];
-  camera_pos = new Array<double>[adaptive_max_level+1];
-  camera_dir = new Array<double>[adaptive_max_level+1];
+  if (adaptive_max_level < 0)
+    throw BlacklightException("Must have nonnegative adaptive_max_level.");
+  std::size_t num_levels = static_cast<std::size_t>(adaptive_max_level) + 1;
+  camera_loc = new Array<int>[num_levels];
+  camera_pos = new Array<double>[num_levels];
+  camera_dir = new Array<double>[num_levels];
 
   // Allocate space for image data
-  momentum_factors = new Array<double>[adaptive_max_level+1];
+  momentum_factors = new Array<double>[num_levels];
 
   // Allocate space for geodesic data
-  geodesic_num_steps = new int[adaptive_max_level+1];
-  sample_flags = new Array<bool>[adaptive_max_level+1];
-  sample_num = new Array<int>[adaptive_max_level+1];
-  sample_pos = new Array<double>[adaptive_max_level+1];
-  sample_dir = new Array<double>[adaptive_max_level+1];
-  sample_len = new Array<double>[adaptive_max_level+1];
+  geodesic_num_steps = new int[num_levels];
+  sample_flags = new Array<bool>[num_levels];
+  sample_num = new Array<int>[num_levels];
+  sample_pos = new Array<double>[num_levels];
+  sample_dir = new Array<double>[num_levels];
+  sample_len = new Array<double>[num_levels];
+  sample_pos_float = new Array<float>[num_levels];
+  sample_dir_float = new Array<float>[num_levels];
+  sample_len_float = new Array<float>[num_levels];
 
   // Prepare bookkeeping for adaptive refinement
   if (adaptive_max_level > 0)
@@ -187,6 +266,9 @@ GeodesicIntegrator::~GeodesicIntegrator()
     sample_pos[level].Deallocate();
     sample_dir[level].Deallocate();
     sample_len[level].Deallocate();
+    sample_pos_float[level].Deallocate();
+    sample_dir_float[level].Deallocate();
+    sample_len_float[level].Deallocate();
   }
   delete[] camera_loc;
   delete[] camera_pos;
@@ -198,6 +280,13 @@ GeodesicIntegrator::~GeodesicIntegrator()
   delete[] sample_pos;
   delete[] sample_dir;
   delete[] sample_len;
+  delete[] sample_pos_float;
+  delete[] sample_dir_float;
+  delete[] sample_len_float;
+  delete[] stream_buffers;
+  delete[] stream_sizes;
+  delete[] checkpoint_level_offsets;
+  UnmapFile(checkpoint_map, checkpoint_map_size);
   // delete[] custom_x_all;
   // delete[] custom_y_all;
 }
@@ -224,19 +313,21 @@ double GeodesicIntegrator::Integrate()
   if (not checkpoint_geodesic_load)
   {
     InitializeCamera();
-    if (ray_integrator == RayIntegrator::dp)
-      IntegrateGeodesicsDP();
-    else if (ray_integrator == RayIntegrator::rk4)
-      IntegrateGeodesicsRK4();
-    else if (ray_integrator == RayIntegrator::rk2)
-      IntegrateGeodesicsRK2();
-    ReverseGeodesics();
+    IntegrateGeodesics();
+    if (ray_streaming)
+      UnpackGeodesics();
+    else
+      ReverseGeodesics();
   }
 
   // Save data to checkpoint
   if (checkpoint_geodesic_save)
     SaveGeodesics();
 
+  // Reduce precision of stored samples
+  if (ray_sample_float)
+    ConvertSamples();
+
   // Calculate elapsed time
   return omp_get_wtime() - time_start;
 }
@@ -250,6 +341,10 @@ double GeodesicIntegrator::Integrate()
 //   returned value: execution time in seconds
 // Notes:
 //   Acquires values from RadiationIntegrator that were not available at construction.
+//   Frees samples at the previous level if it is a refined level, since they are only needed for
+//       radiation integration at that level and for seeding this level.
+//   When loading a checkpoint, geodesics are taken from it if it contains this level with the same
+//       refined blocks, and are integrated otherwise.
 double GeodesicIntegrator::AddGeodesics(const RadiationIntegrator *p_radiation_integrator)
 {
   // Prepare timer
@@ -262,16 +357,80 @@ double GeodesicIntegrator::AddGeodesics(const RadiationIntegrator *p_radiation_i
   block_counts = p_radiation_integrator->block_counts;
   refinement_flags = p_radiation_integrator->refinement_flags;
 
-  // Calculate geodesics
+  // Prepare geodesics
   AugmentCamera();
-  if (ray_integrator == RayIntegrator::dp)
-    IntegrateGeodesicsDP();
-  else if (ray_integrator == RayIntegrator::rk4)
-    IntegrateGeodesicsRK4();
-  else if (ray_integrator == RayIntegrator::rk2)
-    IntegrateGeodesicsRK2();
-  ReverseGeodesics();
+  bool loaded = false;
+  if (checkpoint_geodesic_load)
+    loaded = LoadGeodesicLevel();
+  if (not loaded and adaptive_reuse_rays)
+    SeedGeodesics();
+
+  // Free samples from previous refined level, which have been integrated and seeded
+  if (adaptive_level > 1)
+    ReleaseSamples(adaptive_level - 1);
+
+  // Calculate geodesics
+  if (not loaded)
+  {
+    IntegrateGeodesics();
+    if (ray_streaming)
+      UnpackGeodesics();
+    else
+      ReverseGeodesics();
+    if (adaptive_reuse_rays)
+      MergeSeededGeodesics();
+  }
+
+  // Save data to checkpoint
+  if (checkpoint_geodesic_save)
+    SaveGeodesics();
+
+  // Reduce precision of stored samples
+  if (ray_sample_float)
+    ConvertSamples();
 
   // Calculate elapsed time
   return omp_get_wtime() - time_start;
 }
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for freeing data from refined levels
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Deallocates camera and sample data at all levels beyond the root, and resets the level counter,
+//       so that the next snapshot can refine different blocks.
+//   Should only be called once output has been written for the current snapshot.
+void GeodesicIntegrator::ReleaseLevels()
+{
+  for (int level = 1; level <= adaptive_max_level; level++)
+  {
+    camera_loc[level].Deallocate();
+    camera_pos[level].Deallocate();
+    camera_dir[level].Deallocate();
+    momentum_factors[level].Deallocate();
+    ReleaseSamples(level);
+  }
+  adaptive_level = 0;
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for freeing geodesic samples at a single level
+// Inputs:
+//   level: refinement level
+// Outputs: (none)
+void GeodesicIntegrator::ReleaseSamples(int level)
+{
+  sample_flags[level].Deallocate();
+  sample_num[level].Deallocate();
+  sample_pos[level].Deallocate();
+  sample_dir[level].Deallocate();
+  sample_len[level].Deallocate();
+  sample_pos_float[level].Deallocate();
+  sample_dir_float[level].Deallocate();
+  sample_len_float[level].Deallocate();
+  return;
+}
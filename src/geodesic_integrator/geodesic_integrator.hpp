@@ -4,7 +4,9 @@
 #define GEODESIC_INTEGRATOR_H_
 
 // C++ headers
-#include <string>  // string
+#include <cstddef>  // size_t
+#include <fstream>  // ifstream, ofstream
+#include <string>   // string
 
 // Blacklight headers
 #include "../blacklight.hpp"                 // enums
@@ -34,6 +36,16 @@ struct GeodesicIntegrator
   bool checkpoint_geodesic_load;
   std::string checkpoint_geodesic_file;
 
+  // Checkpoint data
+  static constexpr int checkpoint_geodesic_version = 1;
+  static constexpr int checkpoint_num_params = 36;
+  static constexpr long int checkpoint_alignment = 4096;
+  static constexpr long int offload_chunk_bytes = 1L << 30;
+  char *checkpoint_map = nullptr;
+  std::size_t checkpoint_map_size;
+  int checkpoint_num_levels;
+  long int *checkpoint_level_offsets = nullptr;
+
   // Input data - camera parameters
   Camera camera_type;
   double camera_r;
@@ -60,6 +72,10 @@ struct GeodesicIntegrator
   int ray_max_retries;
   double ray_tol_abs;
   double ray_tol_rel;
+  int ray_packet_size;
+  bool ray_streaming;
+  bool ray_offload;
+  bool ray_sample_float;
 
   // Input data - image parameters
   int image_num_frequencies;
@@ -72,16 +88,22 @@ struct GeodesicIntegrator
   // Input data - adaptive parameters
   int adaptive_max_level;
   int adaptive_block_size;
+  bool adaptive_reuse_rays;
+  double adaptive_reuse_ratio;
+  double adaptive_reuse_angle;
 
   // Geometry data
   double bh_m;
   double bh_a;
   double r_horizon;
   double r_terminate;
+  MetricType metric_type;
 
   // Camera data
   bool use_custom_pixels;
   int camera_num_pix;
+  int camera_num_pix_total;
+  int camera_pix_start;
   double cam_x[4];
   double u_con[4], u_cov[4];
   double norm_con[4], norm_con_c[4];
@@ -107,6 +129,26 @@ struct GeodesicIntegrator
   Array<double> *sample_pos = nullptr;
   Array<double> *sample_dir = nullptr;
   Array<double> *sample_len = nullptr;
+  Array<float> *sample_pos_float = nullptr;
+  Array<float> *sample_dir_float = nullptr;
+  Array<float> *sample_len_float = nullptr;
+
+  // Streamed geodesic data
+  int stream_num_threads;
+  Array<double> *stream_buffers = nullptr;
+  int *stream_sizes = nullptr;
+  Array<int> stream_locs;
+
+  // Seeded geodesic data
+  int seed_num_pix;
+  int seed_num_steps;
+  Array<int> seed_locs;
+  Array<int> seed_num;
+  Array<double> seed_pos;
+  Array<double> seed_dir;
+  Array<double> seed_len;
+  Array<double> seed_camera_pos;
+  Array<double> seed_camera_dir;
 
   // Adaptive data
   int adaptive_level;
@@ -118,10 +160,20 @@ struct GeodesicIntegrator
   // External functions
   double Integrate();
   double AddGeodesics(const RadiationIntegrator *p_radiation_integrator);
+  void ReleaseLevels();
+
+  // Internal functions - geodesic_integrator.cpp
+  void ReleaseSamples(int level);
 
   // Internal functions - geodesic_checkpoint.cpp
   void SaveGeodesics();
   void LoadGeodesics();
+  bool LoadGeodesicLevel();
+  void SetCheckpointParameters(double params[checkpoint_num_params],
+      const char *names[checkpoint_num_params]);
+  template<typename type> void WriteCheckpointArray(std::ofstream *p_stream,
+      const Array<type> &array, long int entry_pos);
+  template<typename type> void MapCheckpointArray(std::ifstream *p_stream, Array<type> *p_array);
 
   // Internal functions - camera.cpp
   void InitializeCamera();
@@ -132,18 +184,48 @@ struct GeodesicIntegrator
       Array<double> &direction, Array<double> &factor);
 
   // Internal functions - geodesics.cpp
-  void IntegrateGeodesicsDP();
-  void IntegrateGeodesicsRK4();
-  void IntegrateGeodesicsRK2();
+  void IntegrateGeodesics();
+  template<MetricType metric> void IntegrateGeodesics();
+  template<MetricType metric> void IntegrateGeodesicsDP();
+  template<MetricType metric> void IntegrateGeodesicsRK4();
+  template<MetricType metric> void IntegrateGeodesicsRK2();
   void ReverseGeodesics();
-  void GeodesicSubstepWithDistance(double y[9], double k[9]);
-  void GeodesicSubstepWithoutDistance(double y[8], double k[8]);
+  template<MetricType metric> void GeodesicSubstepWithDistance(double y[9], double k[9]);
+  template<MetricType metric> void GeodesicSubstepWithoutDistance(double y[8], double k[8]);
+
+  // Internal functions - geodesics_packet.cpp
+  template<int num_lanes, MetricType metric> void IntegrateGeodesicsDPPacket();
+  template<int num_lanes, MetricType metric> void GeodesicSubstepWithDistancePacket(double y[9][8],
+      double k[9][8]);
+
+  // Internal functions - geodesics_offload.cpp
+  void IntegrateGeodesicsOffload();
+
+  // Internal functions - geodesic_streaming.cpp
+  void PrepareGeodesicStreams(int num_pix);
+  void StreamGeodesic(int m, int m_ray, const Array<double> &ray_pos, Array<double> &ray_dir,
+      const Array<double> &ray_len);
+  void UnpackGeodesics();
+
+  // Internal functions - geodesic_precision.cpp
+  void ConvertSamples();
+
+  // Internal functions - geodesic_seeding.cpp
+  void SeedGeodesics();
+  bool FindParentPixel(int v, int u, const Array<int> &block_map, int *p_m);
+  void MergeSeededGeodesics();
 
   // Internal functions - geodesic_geometry.cpp
   double RadialGeodesicCoordinate(double x, double y, double z);
+  template<MetricType metric> double RadialGeodesicCoordinate(double x, double y, double z);
   void CovariantGeodesicMetric(double x, double y, double z, double gcov[4][4]);
+  template<MetricType metric> void CovariantGeodesicMetric(double x, double y, double z,
+      double gcov[4][4]);
   void ContravariantGeodesicMetric(double x, double y, double z, double gcon[4][4]);
-  void ContravariantGeodesicMetricDerivative(double x, double y, double z, double dgcon[3][4][4]);
+  template<MetricType metric> void ContravariantGeodesicMetric(double x, double y, double z,
+      double gcon[4][4]);
+  template<MetricType metric> void ContravariantGeodesicMetricDerivative(double x, double y,
+      double z, double dgcon[3][4][4]);
 };
 
 #endif
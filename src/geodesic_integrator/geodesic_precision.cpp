@@ -0,0 +1,91 @@
+// Blacklight geodesic integrator - reduced-precision sample storage
+
+// C++ headers
+#include <algorithm>  // max
+#include <cmath>      // abs, isfinite
+#include <ios>        // streamsize
+#include <iostream>   // cout
+
+// Library headers
+#include <omp.h>  // pragmas
+
+// Blacklight headers
+#include "geodesic_integrator.hpp"
+#include "../utils/array.hpp"       // Array
+#include "../utils/exceptions.hpp"  // BlacklightException
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for converting samples at current level to single precision
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes sample_num[adaptive_level], sample_pos[adaptive_level], sample_dir[adaptive_level], and
+//       sample_len[adaptive_level] have been set.
+//   Allocates and initializes sample_pos_float[adaptive_level], sample_dir_float[adaptive_level],
+//       and sample_len_float[adaptive_level], and deallocates the double-precision versions.
+//   Reports the largest relative change in any position, momentum, or step-length component.
+void GeodesicIntegrator::ConvertSamples()
+{
+  // Allocate arrays
+  int num_pix = sample_pos[adaptive_level].n3;
+  int num_steps = sample_pos[adaptive_level].n2;
+  sample_pos_float[adaptive_level].Allocate(num_pix, num_steps, 4);
+  sample_dir_float[adaptive_level].Allocate(num_pix, num_steps, 4);
+  sample_len_float[adaptive_level].Allocate(num_pix, num_steps);
+
+  // Convert values
+  double pos_error = 0.0;
+  double dir_error = 0.0;
+  double len_error = 0.0;
+  bool finite = true;
+  #pragma omp parallel for schedule(static) reduction(max: pos_error, dir_error, len_error) \
+      reduction(&&: finite)
+  for (int m = 0; m < num_pix; m++)
+    for (int n = 0; n < num_steps; n++)
+    {
+      bool used = n < sample_num[adaptive_level](m);
+      for (int mu = 0; mu < 4; mu++)
+      {
+        double pos_val = sample_pos[adaptive_level](m,n,mu);
+        double dir_val = sample_dir[adaptive_level](m,n,mu);
+        float pos_val_float = static_cast<float>(pos_val);
+        float dir_val_float = static_cast<float>(dir_val);
+        sample_pos_float[adaptive_level](m,n,mu) = pos_val_float;
+        sample_dir_float[adaptive_level](m,n,mu) = dir_val_float;
+        if (not used)
+          continue;
+        finite = finite and std::isfinite(pos_val_float) and std::isfinite(dir_val_float);
+        if (pos_val != 0.0)
+          pos_error = std::max(pos_error,
+              std::abs(static_cast<double>(pos_val_float) - pos_val) / std::abs(pos_val));
+        if (dir_val != 0.0)
+          dir_error = std::max(dir_error,
+              std::abs(static_cast<double>(dir_val_float) - dir_val) / std::abs(dir_val));
+      }
+      double len_val = sample_len[adaptive_level](m,n);
+      float len_val_float = static_cast<float>(len_val);
+      sample_len_float[adaptive_level](m,n) = len_val_float;
+      if (not used)
+        continue;
+      finite = finite and std::isfinite(len_val_float);
+      if (len_val != 0.0)
+        len_error = std::max(len_error,
+            std::abs(static_cast<double>(len_val_float) - len_val) / std::abs(len_val));
+    }
+  if (not finite)
+    throw BlacklightException("Geodesic samples cannot be represented in single precision.");
+
+  // Free double-precision values
+  sample_pos[adaptive_level].Deallocate();
+  sample_dir[adaptive_level].Deallocate();
+  sample_len[adaptive_level].Deallocate();
+
+  // Report error bounds
+  std::streamsize precision = std::cout.precision(3);
+  std::cout << "Level " << adaptive_level << " geodesic samples stored as floats (maximum relative"
+      << " errors: position " << pos_error << ", momentum " << dir_error << ", step length "
+      << len_error << ").\n";
+  std::cout.precision(precision);
+  return;
+}
@@ -0,0 +1,414 @@
+// Blacklight geodesic integrator - seeding of refined geodesics from parent level
+
+// C++ headers
+#include <algorithm>  // max, min
+#include <cmath>      // acos, cos, sqrt
+#include <ios>        // streamsize
+#include <iostream>   // cout
+#include <utility>    // move
+
+// Library headers
+#include <omp.h>  // pragmas
+
+// Blacklight headers
+#include "geodesic_integrator.hpp"
+#include "../blacklight.hpp"   // Math
+#include "../utils/array.hpp"  // Array
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for seeding geodesics at new refinement level from geodesics at previous level
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes camera_loc[adaptive_level], camera_pos[adaptive_level], and camera_dir[adaptive_level]
+//       have been set, and that sample_flags, sample_num, sample_pos, sample_dir, and sample_len
+//       have been set at level adaptive_level-1.
+//   Each child pixel center lies inside a 2x2 stencil of parent pixel centers. The child is
+//       seeded if all four parents exist, terminated properly by escaping outward rather than by
+//       approaching the horizon, and have sample counts within a factor of adaptive_reuse_ratio of
+//       one another. In addition, the momentum of each parent at its far end must be within
+//       adaptive_reuse_angle degrees of that of the nearest parent, which excludes strongly lensed
+//       rays whose neighbors diverge.
+//   Seeding is approximate, so images differ from those with traced rays, and the refinement
+//       criteria can select different blocks at later levels. The number of seeded pixels and the
+//       largest accepted angle are reported for each level.
+//   Seeded geodesics are bilinear interpolations of the parent geodesics, with samples matched by
+//       affine parameter measured from the camera. They have the same steps as the parent
+//       containing the child, and their momenta are renormalized to be null.
+//   Allocates and initializes seed_locs, seed_num, seed_pos, seed_dir, and seed_len, and
+//       initializes seed_num_pix and seed_num_steps.
+//   Replaces camera_pos[adaptive_level] and camera_dir[adaptive_level] with only those pixels that
+//       must still be integrated, keeping the full arrays in seed_camera_pos and seed_camera_dir.
+//   At least one pixel is always left to be integrated.
+void GeodesicIntegrator::SeedGeodesics()
+{
+  // Prepare map of blocks at previous level
+  int level_old = adaptive_level - 1;
+  Array<int> block_map;
+  if (level_old > 0)
+  {
+    int linear_blocks_old = linear_root_blocks;
+    for (int n = 1; n <= level_old; n++)
+      linear_blocks_old *= 2;
+    block_map.Allocate(linear_blocks_old, linear_blocks_old);
+    for (int block_v = 0; block_v < linear_blocks_old; block_v++)
+      for (int block_u = 0; block_u < linear_blocks_old; block_u++)
+        block_map(block_v,block_u) = -1;
+    for (int block = 0; block < block_counts[level_old]; block++)
+      block_map(camera_loc[level_old](block,0),camera_loc[level_old](block,1)) = block;
+  }
+
+  // Select parents for each pixel
+  int num_pix = block_counts[adaptive_level] * block_num_pix;
+  double r_escape = 0.5 * (camera_r + r_terminate);
+  double cos_angle_min = std::cos(adaptive_reuse_angle * Math::pi / 180.0);
+  double cos_seeded_min = 1.0;
+  Array<int> parents(num_pix, 4);
+  seed_locs.Allocate(num_pix, 2);
+  #pragma omp parallel for schedule(static) reduction(min: cos_seeded_min)
+  for (int m = 0; m < num_pix; m++)
+  {
+    // Locate pixel and parent stencil
+    int block = m / block_num_pix;
+    int v = camera_loc[adaptive_level](block,0) * adaptive_block_size
+        + m % block_num_pix / adaptive_block_size;
+    int u = camera_loc[adaptive_level](block,1) * adaptive_block_size
+        + m % block_num_pix % adaptive_block_size;
+    int v_old = (v + 1) / 2 - 1;
+    int u_old = (u + 1) / 2 - 1;
+
+    // Check parents
+    bool seed = true;
+    int num_min = ray_max_steps;
+    int num_max = 0;
+    for (int p = 0; p < 4 and seed; p++)
+    {
+      int m_old = 0;
+      seed = FindParentPixel(v_old + p / 2, u_old + p % 2, block_map, &m_old);
+      if (seed)
+      {
+        parents(m,p) = m_old;
+        num_min = std::min(num_min, sample_num[level_old](m_old));
+        num_max = std::max(num_max, sample_num[level_old](m_old));
+        seed = not sample_flags[level_old](m_old) and sample_num[level_old](m_old) > 1;
+      }
+      if (seed)
+        seed = RadialGeodesicCoordinate(sample_pos[level_old](m_old,0,1),
+            sample_pos[level_old](m_old,0,2), sample_pos[level_old](m_old,0,3)) > r_escape;
+    }
+    if (seed)
+      seed = num_max <= adaptive_reuse_ratio * num_min;
+
+    // Check agreement of parent directions at far end
+    if (seed)
+    {
+      double dirs[4][3];
+      for (int p = 0; p < 4; p++)
+      {
+        double norm = 0.0;
+        for (int a = 0; a < 3; a++)
+        {
+          dirs[p][a] = sample_dir[level_old](parents(m,p),0,a+1);
+          norm += dirs[p][a] * dirs[p][a];
+        }
+        norm = std::sqrt(norm);
+        for (int a = 0; a < 3; a++)
+          dirs[p][a] /= norm;
+      }
+      int p_near = (1 - v % 2) * 2 + (1 - u % 2);
+      double cos_min = 1.0;
+      for (int p = 0; p < 4; p++)
+        cos_min = std::min(cos_min, dirs[p][0] * dirs[p_near][0] + dirs[p][1] * dirs[p_near][1]
+            + dirs[p][2] * dirs[p_near][2]);
+      seed = cos_min >= cos_angle_min;
+      if (seed)
+        cos_seeded_min = std::min(cos_seeded_min, cos_min);
+    }
+    seed_locs(m,0) = seed ? 1 : 0;
+  }
+
+  // Assign storage locations
+  seed_num_pix = 0;
+  int num_integrate = 0;
+  for (int m = 0; m < num_pix; m++)
+  {
+    if (m == num_pix - 1 and num_integrate == 0)
+      seed_locs(m,0) = 0;
+    if (seed_locs(m,0) == 1)
+      seed_locs(m,1) = seed_num_pix++;
+    else
+      seed_locs(m,1) = num_integrate++;
+  }
+
+  // Report seeding
+  std::streamsize precision = std::cout.precision(3);
+  std::cout << "Level " << adaptive_level << " geodesics: " << seed_num_pix << " of " << num_pix
+      << " interpolated from parents";
+  if (seed_num_pix > 0)
+    std::cout << " (maximum parent angle " << std::acos(std::min(cos_seeded_min, 1.0)) * 180.0
+        / Math::pi << " degrees)";
+  std::cout << ".\n";
+  std::cout.precision(precision);
+  if (seed_num_pix == 0)
+  {
+    seed_locs.Deallocate();
+    return;
+  }
+
+  // Calculate number of samples for seeded geodesics
+  seed_num.Allocate(seed_num_pix);
+  seed_num_steps = 0;
+  for (int m = 0; m < num_pix; m++)
+    if (seed_locs(m,0) == 1)
+    {
+      int v = camera_loc[adaptive_level](m / block_num_pix,0) * adaptive_block_size
+          + m % block_num_pix / adaptive_block_size;
+      int u = camera_loc[adaptive_level](m / block_num_pix,1) * adaptive_block_size
+          + m % block_num_pix % adaptive_block_size;
+      int p_near = (1 - v % 2) * 2 + (1 - u % 2);
+      int num_samples = sample_num[level_old](parents(m,p_near));
+      seed_num(seed_locs(m,1)) = num_samples;
+      seed_num_steps = std::max(seed_num_steps, num_samples);
+    }
+
+  // Interpolate seeded geodesics
+  seed_pos.Allocate(seed_num_pix, seed_num_steps, 4);
+  seed_dir.Allocate(seed_num_pix, seed_num_steps, 4);
+  seed_len.Allocate(seed_num_pix, seed_num_steps);
+  seed_len.Zero();
+  #pragma omp parallel for schedule(runtime)
+  for (int m = 0; m < num_pix; m++)
+  {
+    // Skip pixels to be integrated
+    if (seed_locs(m,0) != 1)
+      continue;
+
+    // Calculate stencil weights
+    int block = m / block_num_pix;
+    int v = camera_loc[adaptive_level](block,0) * adaptive_block_size
+        + m % block_num_pix / adaptive_block_size;
+    int u = camera_loc[adaptive_level](block,1) * adaptive_block_size
+        + m % block_num_pix % adaptive_block_size;
+    double weight_v = v % 2 == 0 ? 0.25 : 0.75;
+    double weight_u = u % 2 == 0 ? 0.25 : 0.75;
+    double weights[4];
+    weights[0] = weight_v * weight_u;
+    weights[1] = weight_v * (1.0 - weight_u);
+    weights[2] = (1.0 - weight_v) * weight_u;
+    weights[3] = (1.0 - weight_v) * (1.0 - weight_u);
+
+    // Prepare to march along parent geodesics from camera
+    int p_near = (1 - v % 2) * 2 + (1 - u % 2);
+    int m_near = parents(m,p_near);
+    int n_vals[4];
+    double lambda_vals[4];
+    for (int p = 0; p < 4; p++)
+    {
+      n_vals[p] = sample_num[level_old](parents(m,p)) - 1;
+      lambda_vals[p] = 0.5 * sample_len[level_old](parents(m,p),n_vals[p]);
+    }
+
+    // Go through samples
+    int k = seed_locs(m,1);
+    int num_samples = seed_num(k);
+    double lambda = 0.0;
+    for (int n = num_samples - 1; n >= 0; n--)
+    {
+      // Calculate affine parameter from camera along nearest parent
+      if (n == num_samples - 1)
+        lambda = 0.5 * sample_len[level_old](m_near,n);
+      else
+        lambda += 0.5 * (sample_len[level_old](m_near,n+1) + sample_len[level_old](m_near,n));
+
+      // Interpolate parent samples at same affine parameter
+      double pos[4] = {};
+      double dir[4] = {};
+      for (int p = 0; p < 4; p++)
+      {
+        int m_old = parents(m,p);
+        while (n_vals[p] > 0)
+        {
+          double lambda_next = lambda_vals[p] + 0.5 * (sample_len[level_old](m_old,n_vals[p])
+              + sample_len[level_old](m_old,n_vals[p]-1));
+          if (lambda_next > lambda)
+            break;
+          n_vals[p]--;
+          lambda_vals[p] = lambda_next;
+        }
+        int n_a = n_vals[p];
+        int n_b = std::max(n_a - 1, 0);
+        double weight_b = 0.0;
+        if (n_b < n_a and lambda > lambda_vals[p])
+          weight_b = (lambda - lambda_vals[p]) / (0.5 * (sample_len[level_old](m_old,n_a)
+              + sample_len[level_old](m_old,n_b)));
+        double weight_a = 1.0 - weight_b;
+        for (int mu = 0; mu < 4; mu++)
+        {
+          pos[mu] += weights[p] * (weight_a * sample_pos[level_old](m_old,n_a,mu)
+              + weight_b * sample_pos[level_old](m_old,n_b,mu));
+          dir[mu] += weights[p] * (weight_a * sample_dir[level_old](m_old,n_a,mu)
+              + weight_b * sample_dir[level_old](m_old,n_b,mu));
+        }
+      }
+
+      // Renormalize momentum
+      double gcon[4][4];
+      ContravariantGeodesicMetric(pos[1], pos[2], pos[3], gcon);
+      double temp_a = 0.0;
+      for (int a = 1; a < 4; a++)
+        for (int b = 1; b < 4; b++)
+          temp_a += gcon[a][b] * dir[a] * dir[b];
+      double temp_b = 0.0;
+      for (int a = 1; a < 4; a++)
+        temp_b += 2.0 * gcon[0][a] * dir[0] * dir[a];
+      double temp_c = gcon[0][0] * dir[0] * dir[0];
+      double temp_d = std::sqrt(temp_b * temp_b - 4.0 * temp_a * temp_c);
+      double factor =
+          temp_b < 0.0 ? (temp_d - temp_b) / (2.0 * temp_a) : -2.0 * temp_c / (temp_b + temp_d);
+      for (int a = 1; a < 4; a++)
+        dir[a] *= factor;
+
+      // Store sample
+      for (int mu = 0; mu < 4; mu++)
+      {
+        seed_pos(k,n,mu) = pos[mu];
+        seed_dir(k,n,mu) = dir[mu];
+      }
+      seed_len(k,n) = sample_len[level_old](m_near,n);
+    }
+  }
+
+  // Retain only pixels to be integrated in camera
+  seed_camera_pos.Allocate(num_integrate, 4);
+  seed_camera_dir.Allocate(num_integrate, 4);
+  #pragma omp parallel for schedule(static)
+  for (int m = 0; m < num_pix; m++)
+    if (seed_locs(m,0) != 1)
+      for (int mu = 0; mu < 4; mu++)
+      {
+        seed_camera_pos(seed_locs(m,1),mu) = camera_pos[adaptive_level](m,mu);
+        seed_camera_dir(seed_locs(m,1),mu) = camera_dir[adaptive_level](m,mu);
+      }
+  camera_pos[adaptive_level].Swap(seed_camera_pos);
+  camera_dir[adaptive_level].Swap(seed_camera_dir);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for locating pixel at previous refinement level
+// Inputs:
+//   v: vertical pixel index at previous level
+//   u: horizontal pixel index at previous level
+//   block_map: block indices at previous level, indexed by block location, or -1 if block does
+//       not exist; unused if previous level is root
+// Outputs:
+//   returned value: flag indicating pixel exists at previous level
+//   *p_m: index of pixel in previous level's arrays, if it exists
+bool GeodesicIntegrator::FindParentPixel(int v, int u, const Array<int> &block_map, int *p_m)
+{
+  // Locate pixel at root level
+  if (adaptive_level == 1)
+  {
+    if (v < 0 or v >= camera_resolution or u < 0 or u >= camera_resolution)
+      return false;
+    *p_m = v * camera_resolution + u;
+    return true;
+  }
+
+  // Locate pixel at refined level
+  int linear_pix_old = block_map.n1 * adaptive_block_size;
+  if (v < 0 or v >= linear_pix_old or u < 0 or u >= linear_pix_old)
+    return false;
+  int block = block_map(v / adaptive_block_size,u / adaptive_block_size);
+  if (block < 0)
+    return false;
+  *p_m = block * block_num_pix + v % adaptive_block_size * adaptive_block_size
+      + u % adaptive_block_size;
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for merging seeded and integrated geodesics at new refinement level
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes SeedGeodesics() has been called, followed by integration and reversal of the
+//       remaining geodesics.
+//   Reallocates and initializes sample_flags[adaptive_level], sample_num[adaptive_level],
+//       sample_pos[adaptive_level], sample_dir[adaptive_level], and sample_len[adaptive_level] to
+//       cover all pixels, and updates geodesic_num_steps[adaptive_level].
+//   Restores camera_pos[adaptive_level] and camera_dir[adaptive_level] to cover all pixels.
+//   Deallocates seed_locs, seed_num, seed_pos, seed_dir, seed_len, seed_camera_pos, and
+//       seed_camera_dir.
+void GeodesicIntegrator::MergeSeededGeodesics()
+{
+  // Check for seeded geodesics
+  if (seed_num_pix == 0)
+    return;
+
+  // Allocate arrays
+  int num_pix = block_counts[adaptive_level] * block_num_pix;
+  int num_steps = std::max(geodesic_num_steps[adaptive_level], seed_num_steps);
+  Array<bool> flags(num_pix);
+  Array<int> nums(num_pix);
+  Array<double> pos(num_pix, num_steps, 4);
+  Array<double> dir(num_pix, num_steps, 4);
+  Array<double> len(num_pix, num_steps);
+  len.Zero();
+
+  // Go through pixels
+  #pragma omp parallel for schedule(static)
+  for (int m = 0; m < num_pix; m++)
+  {
+    int k = seed_locs(m,1);
+    if (seed_locs(m,0) == 1)
+    {
+      flags(m) = false;
+      nums(m) = seed_num(k);
+      for (int n = 0; n < seed_num(k); n++)
+      {
+        for (int mu = 0; mu < 4; mu++)
+        {
+          pos(m,n,mu) = seed_pos(k,n,mu);
+          dir(m,n,mu) = seed_dir(k,n,mu);
+        }
+        len(m,n) = seed_len(k,n);
+      }
+    }
+    else
+    {
+      flags(m) = sample_flags[adaptive_level](k);
+      nums(m) = sample_num[adaptive_level](k);
+      for (int n = 0; n < sample_num[adaptive_level](k); n++)
+      {
+        for (int mu = 0; mu < 4; mu++)
+        {
+          pos(m,n,mu) = sample_pos[adaptive_level](k,n,mu);
+          dir(m,n,mu) = sample_dir[adaptive_level](k,n,mu);
+        }
+        len(m,n) = sample_len[adaptive_level](k,n);
+      }
+    }
+  }
+
+  // Replace arrays
+  sample_flags[adaptive_level] = std::move(flags);
+  sample_num[adaptive_level] = std::move(nums);
+  sample_pos[adaptive_level] = std::move(pos);
+  sample_dir[adaptive_level] = std::move(dir);
+  sample_len[adaptive_level] = std::move(len);
+  geodesic_num_steps[adaptive_level] = num_steps;
+  camera_pos[adaptive_level] = std::move(seed_camera_pos);
+  camera_dir[adaptive_level] = std::move(seed_camera_dir);
+
+  // Deallocate seeding arrays
+  seed_locs.Deallocate();
+  seed_num.Deallocate();
+  seed_pos.Deallocate();
+  seed_dir.Deallocate();
+  seed_len.Deallocate();
+  return;
+}
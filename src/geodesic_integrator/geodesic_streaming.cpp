@@ -0,0 +1,186 @@
+// Blacklight geodesic integrator - streamed geodesic storage
+
+// C++ headers
+#include <algorithm>  // max
+#include <cmath>      // sqrt
+#include <cstddef>    // size_t
+
+// Library headers
+#include <omp.h>  // omp_get_max_threads, omp_get_thread_num, pragmas
+
+// Blacklight headers
+#include "geodesic_integrator.hpp"
+#include "../utils/array.hpp"       // Array
+#include "../utils/exceptions.hpp"  // BlacklightException
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for preparing per-thread buffers for streamed geodesics
+// Inputs:
+//   num_pix: number of pixels to be integrated
+// Outputs: (none)
+// Notes:
+//   Allocates and initializes stream_buffers, stream_sizes, and stream_locs.
+//   Buffers start small and grow as needed, so that total storage tracks the number of samples
+//       actually taken rather than num_pix * ray_max_steps.
+void GeodesicIntegrator::PrepareGeodesicStreams(int num_pix)
+{
+  stream_num_threads = omp_get_max_threads();
+  if (stream_num_threads <= 0)
+    throw BlacklightException("Must have positive number of threads for streamed geodesics.");
+  std::size_t num_buffers = static_cast<std::size_t>(stream_num_threads);
+  stream_buffers = new Array<double>[num_buffers];
+  stream_sizes = new int[num_buffers];
+  int num_rows = std::max(ray_max_steps, 1024);
+  for (int thread = 0; thread < stream_num_threads; thread++)
+  {
+    stream_buffers[thread].Allocate(num_rows, 9);
+    stream_sizes[thread] = 0;
+  }
+  stream_locs.Allocate(num_pix, 2);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for finishing a single geodesic and appending it to the calling thread's buffer
+// Inputs:
+//   m: pixel index
+//   m_ray: index of ray in scratch arrays
+//   ray_pos: scratch array of positions along ray
+//   ray_dir: scratch array of directions along ray
+//   ray_len: scratch array of step lengths along ray
+// Outputs:
+//   ray_dir: momenta renormalized
+// Notes:
+//   Assumes sample_num[adaptive_level](m) has been set by the integrator.
+//   Performs the same truncation and momentum renormalization done for the full scratch arrays
+//       in the integrators, but one ray at a time.
+//   Stores samples already reversed and with negated lengths, as done in ReverseGeodesics().
+//   Must be called from within a parallel region, with each thread appending only to its own
+//       buffer.
+void GeodesicIntegrator::StreamGeodesic(int m, int m_ray, const Array<double> &ray_pos,
+    Array<double> &ray_dir, const Array<double> &ray_len)
+{
+  // Truncate geodesic at boundaries
+  int num_samples = sample_num[adaptive_level](m);
+  if (num_samples > 1)
+  {
+    double r_new =
+        RadialGeodesicCoordinate(ray_pos(m_ray,0,1), ray_pos(m_ray,0,2), ray_pos(m_ray,0,3));
+    for (int n = 1; n < num_samples; n++)
+    {
+      double r_old = r_new;
+      r_new = RadialGeodesicCoordinate(ray_pos(m_ray,n,1), ray_pos(m_ray,n,2), ray_pos(m_ray,n,3));
+      bool terminate_outer = r_new > camera_r and r_new > r_old;
+      bool terminate_inner = r_new < r_terminate;
+      if (terminate_outer or terminate_inner)
+      {
+        sample_num[adaptive_level](m) = n;
+        break;
+      }
+    }
+  }
+  num_samples = sample_num[adaptive_level](m);
+
+  // Renormalize momenta
+  double gcon[4][4];
+  for (int n = 0; n < num_samples; n++)
+  {
+    ContravariantGeodesicMetric(ray_pos(m_ray,n,1), ray_pos(m_ray,n,2), ray_pos(m_ray,n,3), gcon);
+    double temp_a = 0.0;
+    for (int a = 1; a < 4; a++)
+      for (int b = 1; b < 4; b++)
+        temp_a += gcon[a][b] * ray_dir(m_ray,n,a) * ray_dir(m_ray,n,b);
+    double temp_b = 0.0;
+    for (int a = 1; a < 4; a++)
+      temp_b += 2.0 * gcon[0][a] * ray_dir(m_ray,n,0) * ray_dir(m_ray,n,a);
+    double temp_c = gcon[0][0] * ray_dir(m_ray,n,0) * ray_dir(m_ray,n,0);
+    double temp_d = std::sqrt(temp_b * temp_b - 4.0 * temp_a * temp_c);
+    double factor =
+        temp_b < 0.0 ? (temp_d - temp_b) / (2.0 * temp_a) : -2.0 * temp_c / (temp_b + temp_d);
+    for (int a = 1; a < 4; a++)
+      ray_dir(m_ray,n,a) *= factor;
+  }
+
+  // Grow buffer if necessary
+  int thread = omp_get_thread_num();
+  int offset = stream_sizes[thread];
+  if (num_samples > stream_buffers[thread].n2 - offset)
+  {
+    if (num_samples > 2147483647 - offset)
+      throw BlacklightException("Streamed geodesic buffer too large.");
+    long int num_rows_new = std::max(2l * stream_buffers[thread].n2,
+        static_cast<long int>(offset) + static_cast<long int>(num_samples));
+    num_rows_new = std::min(num_rows_new, 2147483647l);
+    Array<double> buffer_new(static_cast<int>(num_rows_new), 9);
+    if (offset > 0)
+      buffer_new.CopyFrom(stream_buffers[thread], 0, 0, static_cast<long int>(offset) * 9);
+    stream_buffers[thread].Swap(buffer_new);
+  }
+
+  // Append samples in reverse order
+  for (int n = 0; n < num_samples; n++)
+  {
+    int row = offset + num_samples - 1 - n;
+    for (int mu = 0; mu < 4; mu++)
+    {
+      stream_buffers[thread](row,mu) = ray_pos(m_ray,n,mu);
+      stream_buffers[thread](row,4+mu) = ray_dir(m_ray,n,mu);
+    }
+    stream_buffers[thread](row,8) = -ray_len(m_ray,n);
+  }
+  stream_sizes[thread] = offset + num_samples;
+  stream_locs(m,0) = thread;
+  stream_locs(m,1) = offset;
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for unpacking streamed geodesics
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes geodesic_num_steps[adaptive_level], sample_num[adaptive_level], stream_buffers,
+//       stream_sizes, and stream_locs have been set.
+//   Allocates and initializes sample_pos[adaptive_level], sample_dir[adaptive_level], and
+//       sample_len[adaptive_level], with the same layout produced by ReverseGeodesics().
+//   Deallocates stream_buffers, stream_sizes, and stream_locs.
+void GeodesicIntegrator::UnpackGeodesics()
+{
+  // Allocate arrays
+  int num_pix = camera_pos[adaptive_level].n2;
+  sample_pos[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level], 4);
+  sample_dir[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level], 4);
+  sample_len[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
+  sample_len[adaptive_level].Zero();
+
+  // Go through samples
+  #pragma omp parallel for schedule(static)
+  for (int m = 0; m < num_pix; m++)
+  {
+    int thread = stream_locs(m,0);
+    int offset = stream_locs(m,1);
+    int num_steps = sample_num[adaptive_level](m);
+    for (int n = 0; n < num_steps; n++)
+    {
+      for (int mu = 0; mu < 4; mu++)
+      {
+        sample_pos[adaptive_level](m,n,mu) = stream_buffers[thread](offset+n,mu);
+        sample_dir[adaptive_level](m,n,mu) = stream_buffers[thread](offset+n,4+mu);
+      }
+      sample_len[adaptive_level](m,n) = stream_buffers[thread](offset+n,8);
+    }
+  }
+
+  // Deallocate buffers
+  for (int thread = 0; thread < stream_num_threads; thread++)
+    stream_buffers[thread].Deallocate();
+  delete[] stream_buffers;
+  delete[] stream_sizes;
+  stream_buffers = nullptr;
+  stream_sizes = nullptr;
+  stream_locs.Deallocate();
+  return;
+}
@@ -6,12 +6,64 @@
 #include <sstream>    // ostringstream
 
 // Library headers
-#include <omp.h>  // pragmas
+#include <omp.h>  // omp_get_wtime, pragmas
 
 // Blacklight headers
 #include "geodesic_integrator.hpp"
-#include "../utils/array.hpp"       // Array
+#include "../blacklight.hpp"        // enums
+#include "../utils/array.hpp"       // Array, ArrayView
 #include "../utils/exceptions.hpp"  // BlacklightWarning
+#include "../utils/profiler.hpp"    // profiling functions
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating ray positions and directions with selected integrator and metric
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Dispatches once on metric_type, so that the integrators run metric kernels specialized at
+//       compile time.
+//   Device integration dispatches on metric_type itself.
+void GeodesicIntegrator::IntegrateGeodesics()
+{
+  double time_start = omp_get_wtime();
+  if (ray_offload)
+    IntegrateGeodesicsOffload();
+  else if (metric_type == MetricType::flat)
+    IntegrateGeodesics<MetricType::flat>();
+  else if (metric_type == MetricType::schwarzschild)
+    IntegrateGeodesics<MetricType::schwarzschild>();
+  else if (metric_type == MetricType::kerr)
+    IntegrateGeodesics<MetricType::kerr>();
+  ProfileCounts profile_counts;
+  profile_counts.rays = camera_pos[adaptive_level].n2;
+  ProfileRecord("IntegrateGeodesics", ProfileSnapshot(), adaptive_level, time_start,
+      omp_get_wtime(), profile_counts);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating ray positions and directions with selected integrator
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Dispatches on ray_integrator and ray_packet_size.
+template<MetricType metric>
+void GeodesicIntegrator::IntegrateGeodesics()
+{
+  if (ray_integrator == RayIntegrator::dp and ray_packet_size == 4)
+    IntegrateGeodesicsDPPacket<4, metric>();
+  else if (ray_integrator == RayIntegrator::dp and ray_packet_size == 8)
+    IntegrateGeodesicsDPPacket<8, metric>();
+  else if (ray_integrator == RayIntegrator::dp)
+    IntegrateGeodesicsDP<metric>();
+  else if (ray_integrator == RayIntegrator::rk4)
+    IntegrateGeodesicsRK4<metric>();
+  else if (ray_integrator == RayIntegrator::rk2)
+    IntegrateGeodesicsRK2<metric>();
+  return;
+}
 
 //--------------------------------------------------------------------------------------------------
 
@@ -23,6 +75,9 @@
 //   Initializes geodesic_num_steps[adaptive_level].
 //   Allocates and initializes geodesic_pos, geodesic_dir, geodesic_len,
 //       sample_flags[adaptive_level], and sample_num[adaptive_level].
+//   If ray_streaming == true, geodesic_pos, geodesic_dir, and geodesic_len are not allocated;
+//       instead each ray is integrated into per-thread scratch space and passed to
+//       StreamGeodesic() when finished.
 //   Assumes x^0 is ignorable.
 //   Integrates via the Dormand-Prince method (5th-order adaptive Runge-Kutta).
 //     Method is RK5(4)7M of 1980 JCoAM 6 19.
@@ -36,6 +91,7 @@
 //     Interpolation is used to take steps small enough to satisfy user input ray_step, in that the
 //         proper length of a step must be less than the product of ray_step with the radial
 //         coordinate.
+template<MetricType metric>
 void GeodesicIntegrator::IntegrateGeodesicsDP()
 {
   // Define coefficients
@@ -78,13 +134,16 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
   double ray_max_factor = 10.0;
 
   // Allocate arrays
-  int num_pix = camera_num_pix;
-  if (adaptive_level > 0)
-    num_pix = block_counts[adaptive_level] * block_num_pix;
-  geodesic_pos.Allocate(num_pix, ray_max_steps, 4);
-  geodesic_dir.Allocate(num_pix, ray_max_steps, 4);
-  geodesic_len.Allocate(num_pix, ray_max_steps);
-  geodesic_len.Zero();
+  int num_pix = camera_pos[adaptive_level].n2;
+  if (ray_streaming)
+    PrepareGeodesicStreams(num_pix);
+  else
+  {
+    geodesic_pos.Allocate(num_pix, ray_max_steps, 4);
+    geodesic_dir.Allocate(num_pix, ray_max_steps, 4);
+    geodesic_len.Allocate(num_pix, ray_max_steps);
+    geodesic_len.Zero();
+  }
   sample_flags[adaptive_level].Allocate(num_pix);
   sample_flags[adaptive_level].Zero();
   sample_num[adaptive_level].Allocate(num_pix);
@@ -105,8 +164,27 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
     double k_vals[7][9];
     double r_vals[4][8];
 
+    // Prepare storage for rays
+    Array<double> ray_pos;
+    Array<double> ray_dir;
+    Array<double> ray_len;
+    if (ray_streaming)
+    {
+      ray_pos.Allocate(1, ray_max_steps, 4);
+      ray_dir.Allocate(1, ray_max_steps, 4);
+      ray_len.Allocate(1, ray_max_steps);
+    }
+    else
+    {
+      ray_pos = geodesic_pos;
+      ray_dir = geodesic_dir;
+      ray_len = geodesic_len;
+    }
+
     // Go through pixels
-    #pragma omp for schedule(static)
+    ProfileCounts profile_counts;
+    double profile_time_start = omp_get_wtime();
+    #pragma omp for schedule(runtime) nowait
     for (int m = 0; m < num_pix; m++)
     {
       // Extract initial position
@@ -127,11 +205,14 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
       // Prepare to take steps
       for (int p = 0; p < 9; p++)
         y_vals_5[p] = y_vals[p];
-      double r_new = RadialGeodesicCoordinate(y_vals[1], y_vals[2], y_vals[3]);
+      double r_new = RadialGeodesicCoordinate<metric>(y_vals[1], y_vals[2], y_vals[3]);
       double h_new = -ray_step * r_new;
       int num_retry = 0;
       bool previous_fail = false;
 
+      // Select storage for ray
+      int m_ray = ray_streaming ? 0 : m;
+
       // Take steps
       for (int n = 0; n < ray_max_steps; )
       {
@@ -153,10 +234,10 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
             k_vals[0][p] = k_vals[6][p];
           }
         if (not previous_fail and n == 0)
-          GeodesicSubstepWithDistance(y_vals, k_vals[0]);
+          GeodesicSubstepWithDistance<metric>(y_vals, k_vals[0]);
         double r = r_new;
         if (previous_fail)
-          r = RadialGeodesicCoordinate(y_vals[1], y_vals[2], y_vals[3]);
+          r = RadialGeodesicCoordinate<metric>(y_vals[1], y_vals[2], y_vals[3]);
 
         // Calculate substeps
         for (int substep = 1; substep < 7; substep++)
@@ -166,7 +247,7 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
           for (int q = 0; q < substep; q++)
             for (int p = 0; p < 9; p++)
               y_vals_temp[p] += a_vals[substep][q] * h * k_vals[q][p];
-          GeodesicSubstepWithDistance(y_vals_temp, k_vals[substep]);
+          GeodesicSubstepWithDistance<metric>(y_vals_temp, k_vals[substep]);
         }
 
         // Calculate values at end of full step
@@ -181,7 +262,7 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
             y_vals_5[p] += b_vals_5[q] * h * k_vals[q][p];
             y_vals_4[p] += b_vals_4[q] * h * k_vals[q][p];
           }
-        r_new = RadialGeodesicCoordinate(y_vals_5[1], y_vals_5[2], y_vals_5[3]);
+        r_new = RadialGeodesicCoordinate<metric>(y_vals_5[1], y_vals_5[2], y_vals_5[3]);
 
         // Estimate error
         double error = 0.0;
@@ -204,6 +285,7 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
           }
           h_new = h * h_factor;
           num_retry += 1;
+          profile_counts.retries++;
           previous_fail = true;
           continue;
         }
@@ -231,7 +313,7 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
             y_vals_4m[p] += b_vals_4m[q] * h * k_vals[q][p];
 
         // Subdivide full step
-        double r_mid = RadialGeodesicCoordinate(y_vals_4m[1], y_vals_4m[2], y_vals_4m[3]);
+        double r_mid = RadialGeodesicCoordinate<metric>(y_vals_4m[1], y_vals_4m[2], y_vals_4m[3]);
         double delta_s_step = ray_step * r_mid;
         double delta_s_full = y_vals_5[8] - y_vals[8];
         int num_steps_ideal = static_cast<int>(std::ceil(delta_s_full / delta_s_step));
@@ -247,15 +329,15 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
         // Calculate step midpoint if no subdivision necessary
         if (num_steps_ideal == 1)
         {
-          geodesic_pos(m,n,0) = y_vals_4m[0];
-          geodesic_pos(m,n,1) = y_vals_4m[1];
-          geodesic_pos(m,n,2) = y_vals_4m[2];
-          geodesic_pos(m,n,3) = y_vals_4m[3];
-          geodesic_dir(m,n,0) = y_vals_4m[4];
-          geodesic_dir(m,n,1) = y_vals_4m[5];
-          geodesic_dir(m,n,2) = y_vals_4m[6];
-          geodesic_dir(m,n,3) = y_vals_4m[7];
-          geodesic_len(m,n) = h;
+          ray_pos(m_ray,n,0) = y_vals_4m[0];
+          ray_pos(m_ray,n,1) = y_vals_4m[1];
+          ray_pos(m_ray,n,2) = y_vals_4m[2];
+          ray_pos(m_ray,n,3) = y_vals_4m[3];
+          ray_dir(m_ray,n,0) = y_vals_4m[4];
+          ray_dir(m_ray,n,1) = y_vals_4m[5];
+          ray_dir(m_ray,n,2) = y_vals_4m[6];
+          ray_dir(m_ray,n,3) = y_vals_4m[7];
+          ray_len(m_ray,n) = h;
         }
 
         // Calculate interpolating coefficients for subdivisions
@@ -281,19 +363,19 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
             for (int p = 0; p < 8; p++)
               y_vals_temp[p] = y_vals[p] + frac * (r_vals[0][p] + (1.0 - frac) * (r_vals[1][p]
                   + frac * (r_vals[2][p] + (1.0 - frac) * r_vals[3][p])));
-            geodesic_pos(m,n+nn,0) = y_vals_temp[0];
-            geodesic_pos(m,n+nn,1) = y_vals_temp[1];
-            geodesic_pos(m,n+nn,2) = y_vals_temp[2];
-            geodesic_pos(m,n+nn,3) = y_vals_temp[3];
-            geodesic_dir(m,n+nn,0) = y_vals_temp[4];
-            geodesic_dir(m,n+nn,1) = y_vals_temp[5];
-            geodesic_dir(m,n+nn,2) = y_vals_temp[6];
-            geodesic_dir(m,n+nn,3) = y_vals_temp[7];
-            geodesic_len(m,n+nn) = h / num_steps_ideal;
+            ray_pos(m_ray,n+nn,0) = y_vals_temp[0];
+            ray_pos(m_ray,n+nn,1) = y_vals_temp[1];
+            ray_pos(m_ray,n+nn,2) = y_vals_temp[2];
+            ray_pos(m_ray,n+nn,3) = y_vals_temp[3];
+            ray_dir(m_ray,n+nn,0) = y_vals_temp[4];
+            ray_dir(m_ray,n+nn,1) = y_vals_temp[5];
+            ray_dir(m_ray,n+nn,2) = y_vals_temp[6];
+            ray_dir(m_ray,n+nn,3) = y_vals_temp[7];
+            ray_len(m_ray,n+nn) = h / num_steps_ideal;
           }
 
         // Renormalize momentum
-        ContravariantGeodesicMetric(y_vals_5[1], y_vals_5[2], y_vals_5[3], gcon);
+        ContravariantGeodesicMetric<metric>(y_vals_5[1], y_vals_5[2], y_vals_5[3], gcon);
         double temp_a = 0.0;
         for (int a = 1; a < 4; a++)
           for (int b = 1; b < 4; b++)
@@ -310,6 +392,7 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
 
         // Check termination
         sample_num[adaptive_level](m) += num_steps;
+        profile_counts.samples += num_steps;
         bool terminate_outer = r_new > camera_r and r_new > r;
         bool terminate_inner = r_new < r_terminate;
         if (terminate_outer or terminate_inner)
@@ -321,54 +404,68 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
         // Prepare for next step
         n += num_steps;
       }
+
+      // Finish streamed ray
+      if (ray_streaming)
+        StreamGeodesic(m, m_ray, ray_pos, ray_dir, ray_len);
     }
+    ProfileRecordThread("IntegrateGeodesics", ProfileSnapshot(), adaptive_level,
+        profile_time_start, omp_get_wtime(), profile_counts);
+    #pragma omp barrier
 
     // Truncate geodesics at boundaries
-    #pragma omp for schedule(static)
-    for (int m = 0; m < num_pix; m++)
+    if (not ray_streaming)
     {
-      int num_samples = sample_num[adaptive_level](m);
-      if (num_samples > 1)
+      #pragma omp for schedule(runtime)
+      for (int m = 0; m < num_pix; m++)
       {
-        double r_new =
-            RadialGeodesicCoordinate(geodesic_pos(m,0,1), geodesic_pos(m,0,2), geodesic_pos(m,0,3));
-        for (int n = 1; n < num_samples; n++)
+        int num_samples = sample_num[adaptive_level](m);
+        if (num_samples > 1)
         {
-          double r_old = r_new;
-          r_new = RadialGeodesicCoordinate(geodesic_pos(m,n,1), geodesic_pos(m,n,2),
-              geodesic_pos(m,n,3));
-          bool terminate_outer = r_new > camera_r and r_new > r_old;
-          bool terminate_inner = r_new < r_terminate;
-          if (terminate_outer or terminate_inner)
+          double r_new =
+              RadialGeodesicCoordinate<metric>(geodesic_pos(m,0,1), geodesic_pos(m,0,2),
+              geodesic_pos(m,0,3));
+          for (int n = 1; n < num_samples; n++)
           {
-            sample_num[adaptive_level](m) = n;
-            break;
+            double r_old = r_new;
+            r_new = RadialGeodesicCoordinate<metric>(geodesic_pos(m,n,1), geodesic_pos(m,n,2),
+                geodesic_pos(m,n,3));
+            bool terminate_outer = r_new > camera_r and r_new > r_old;
+            bool terminate_inner = r_new < r_terminate;
+            if (terminate_outer or terminate_inner)
+            {
+              sample_num[adaptive_level](m) = n;
+              break;
+            }
           }
         }
       }
     }
 
     // Renormalize momenta
-    #pragma omp for schedule(static)
-    for (int m = 0; m < num_pix; m++)
-      for (int n = 0; n < sample_num[adaptive_level](m); n++)
-      {
-        ContravariantGeodesicMetric(geodesic_pos(m,n,1), geodesic_pos(m,n,2), geodesic_pos(m,n,3),
-            gcon);
-        double temp_a = 0.0;
-        for (int a = 1; a < 4; a++)
-          for (int b = 1; b < 4; b++)
-            temp_a += gcon[a][b] * geodesic_dir(m,n,a) * geodesic_dir(m,n,b);
-        double temp_b = 0.0;
-        for (int a = 1; a < 4; a++)
-          temp_b += 2.0 * gcon[0][a] * geodesic_dir(m,n,0) * geodesic_dir(m,n,a);
-        double temp_c = gcon[0][0] * geodesic_dir(m,n,0) * geodesic_dir(m,n,0);
-        double temp_d = std::sqrt(temp_b * temp_b - 4.0 * temp_a * temp_c);
-        double factor =
-            temp_b < 0.0 ? (temp_d - temp_b) / (2.0 * temp_a) : -2.0 * temp_c / (temp_b + temp_d);
-        for (int a = 1; a < 4; a++)
-          geodesic_dir(m,n,a) *= factor;
-      }
+    if (not ray_streaming)
+    {
+      #pragma omp for schedule(runtime)
+      for (int m = 0; m < num_pix; m++)
+        for (int n = 0; n < sample_num[adaptive_level](m); n++)
+        {
+          ContravariantGeodesicMetric<metric>(geodesic_pos(m,n,1), geodesic_pos(m,n,2),
+              geodesic_pos(m,n,3), gcon);
+          double temp_a = 0.0;
+          for (int a = 1; a < 4; a++)
+            for (int b = 1; b < 4; b++)
+              temp_a += gcon[a][b] * geodesic_dir(m,n,a) * geodesic_dir(m,n,b);
+          double temp_b = 0.0;
+          for (int a = 1; a < 4; a++)
+            temp_b += 2.0 * gcon[0][a] * geodesic_dir(m,n,0) * geodesic_dir(m,n,a);
+          double temp_c = gcon[0][0] * geodesic_dir(m,n,0) * geodesic_dir(m,n,0);
+          double temp_d = std::sqrt(temp_b * temp_b - 4.0 * temp_a * temp_c);
+          double factor =
+              temp_b < 0.0 ? (temp_d - temp_b) / (2.0 * temp_a) : -2.0 * temp_c / (temp_b + temp_d);
+          for (int a = 1; a < 4; a++)
+            geodesic_dir(m,n,a) *= factor;
+        }
+    }
 
     // Calculate maximum number of steps actually taken
     #pragma omp for schedule(static) reduction(max: geodesic_num_steps_local)
@@ -405,6 +502,9 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
 //   Initializes geodesic_num_steps[adaptive_level].
 //   Allocates and initializes geodesic_pos, geodesic_dir, geodesic_len,
 //       sample_flags[adaptive_level], and sample_num[adaptive_level].
+//   If ray_streaming == true, geodesic_pos, geodesic_dir, and geodesic_len are not allocated;
+//       instead each ray is integrated into per-thread scratch space and passed to
+//       StreamGeodesic() when finished.
 //   Assumes x^0 is ignorable.
 //   Integrates via 4th-order Runge-Kutta with Butcher tableau
 //        0  |
@@ -415,16 +515,20 @@ void GeodesicIntegrator::IntegrateGeodesicsDP()
 //             1/6 1/3 1/3 1/6
 //   Step size in affine parameter is taken to be the product of user input ray_step with the radial
 //       displacement above the horizon.
+template<MetricType metric>
 void GeodesicIntegrator::IntegrateGeodesicsRK4()
 {
   // Allocate arrays
-  int num_pix = camera_num_pix;
-  if (adaptive_level > 0)
-    num_pix = block_counts[adaptive_level] * block_num_pix;
-  geodesic_pos.Allocate(num_pix, ray_max_steps, 4);
-  geodesic_dir.Allocate(num_pix, ray_max_steps, 4);
-  geodesic_len.Allocate(num_pix, ray_max_steps);
-  geodesic_len.Zero();
+  int num_pix = camera_pos[adaptive_level].n2;
+  if (ray_streaming)
+    PrepareGeodesicStreams(num_pix);
+  else
+  {
+    geodesic_pos.Allocate(num_pix, ray_max_steps, 4);
+    geodesic_dir.Allocate(num_pix, ray_max_steps, 4);
+    geodesic_len.Allocate(num_pix, ray_max_steps);
+    geodesic_len.Zero();
+  }
   sample_flags[adaptive_level].Allocate(num_pix);
   sample_flags[adaptive_level].Zero();
   sample_num[adaptive_level].Allocate(num_pix);
@@ -442,8 +546,27 @@ void GeodesicIntegrator::IntegrateGeodesicsRK4()
     double y_vals_accumulate[8];
     double k_vals[8];
 
+    // Prepare storage for rays
+    Array<double> ray_pos;
+    Array<double> ray_dir;
+    Array<double> ray_len;
+    if (ray_streaming)
+    {
+      ray_pos.Allocate(1, ray_max_steps, 4);
+      ray_dir.Allocate(1, ray_max_steps, 4);
+      ray_len.Allocate(1, ray_max_steps);
+    }
+    else
+    {
+      ray_pos = geodesic_pos;
+      ray_dir = geodesic_dir;
+      ray_len = geodesic_len;
+    }
+
     // Go through pixels
-    #pragma omp for schedule(static)
+    ProfileCounts profile_counts;
+    double profile_time_start = omp_get_wtime();
+    #pragma omp for schedule(runtime) nowait
     for (int m = 0; m < num_pix; m++)
     {
       // Extract initial position
@@ -451,7 +574,7 @@ void GeodesicIntegrator::IntegrateGeodesicsRK4()
       y_vals[1] = camera_pos[adaptive_level](m,1);
       y_vals[2] = camera_pos[adaptive_level](m,2);
       y_vals[3] = camera_pos[adaptive_level](m,3);
-      double r_new = RadialGeodesicCoordinate(y_vals[1], y_vals[2], y_vals[3]);
+      double r_new = RadialGeodesicCoordinate<metric>(y_vals[1], y_vals[2], y_vals[3]);
 
       // Extract initial momentum
       y_vals[4] = camera_dir[adaptive_level](m,0);
@@ -459,6 +582,9 @@ void GeodesicIntegrator::IntegrateGeodesicsRK4()
       y_vals[6] = camera_dir[adaptive_level](m,2);
       y_vals[7] = camera_dir[adaptive_level](m,3);
 
+      // Select storage for ray
+      int m_ray = ray_streaming ? 0 : m;
+
       // Take steps
       for (int n = 0; n < ray_max_steps; n++)
       {
@@ -467,45 +593,45 @@ void GeodesicIntegrator::IntegrateGeodesicsRK4()
         double h = -ray_step * (r - r_horizon);
 
         // Calculate and accumulate first substep
-        GeodesicSubstepWithoutDistance(y_vals, k_vals);
+        GeodesicSubstepWithoutDistance<metric>(y_vals, k_vals);
         for (int p = 0; p < 8; p++)
           y_vals_accumulate[p] = y_vals[p] + 1.0 / 6.0 * h * k_vals[p];
 
         // Calculate and accumulate second substep
         for (int p = 0; p < 8; p++)
           y_vals_substep[p] = y_vals[p] + 0.5 * h * k_vals[p];
-        GeodesicSubstepWithoutDistance(y_vals_substep, k_vals);
+        GeodesicSubstepWithoutDistance<metric>(y_vals_substep, k_vals);
         for (int p = 0; p < 8; p++)
           y_vals_accumulate[p] += 1.0 / 3.0 * h * k_vals[p];
 
         // Calculate and accumulate third substep
         for (int p = 0; p < 8; p++)
           y_vals_substep[p] = y_vals[p] + 0.5 * h * k_vals[p];
-        GeodesicSubstepWithoutDistance(y_vals_substep, k_vals);
+        GeodesicSubstepWithoutDistance<metric>(y_vals_substep, k_vals);
         for (int p = 0; p < 8; p++)
           y_vals_accumulate[p] += 1.0 / 3.0 * h * k_vals[p];
 
         // Calculate and accumulate fourth substep
         for (int p = 0; p < 8; p++)
           y_vals_substep[p] = y_vals[p] + h * k_vals[p];
-        GeodesicSubstepWithoutDistance(y_vals_substep, k_vals);
+        GeodesicSubstepWithoutDistance<metric>(y_vals_substep, k_vals);
         for (int p = 0; p < 8; p++)
           y_vals_accumulate[p] += 1.0 / 6.0 * h * k_vals[p];
 
         // Store midpoint
         for (int mu = 0; mu < 4; mu++)
         {
-          geodesic_pos(m,n,mu) = 0.5 * (y_vals[mu] + y_vals_accumulate[mu]);
-          geodesic_dir(m,n,mu) = 0.5 * (y_vals[4+mu] + y_vals_accumulate[4+mu]);
+          ray_pos(m_ray,n,mu) = 0.5 * (y_vals[mu] + y_vals_accumulate[mu]);
+          ray_dir(m_ray,n,mu) = 0.5 * (y_vals[4+mu] + y_vals_accumulate[4+mu]);
         }
-        geodesic_len(m,n) = h;
+        ray_len(m_ray,n) = h;
 
         // Take step
         for (int p = 0; p < 8; p++)
           y_vals[p] = y_vals_accumulate[p];
 
         // Renormalize momentum
-        ContravariantGeodesicMetric(y_vals[1], y_vals[2], y_vals[3], gcon);
+        ContravariantGeodesicMetric<metric>(y_vals[1], y_vals[2], y_vals[3], gcon);
         double temp_a = 0.0;
         for (int a = 1; a < 4; a++)
           for (int b = 1; b < 4; b++)
@@ -522,7 +648,8 @@ void GeodesicIntegrator::IntegrateGeodesicsRK4()
 
         // Check termination
         sample_num[adaptive_level](m)++;
-        r_new = RadialGeodesicCoordinate(y_vals[1], y_vals[2], y_vals[3]);
+        profile_counts.samples++;
+        r_new = RadialGeodesicCoordinate<metric>(y_vals[1], y_vals[2], y_vals[3]);
         bool terminate_outer = r_new > camera_r and r_new > r;
         bool terminate_inner = r_new < r_terminate;
         if (terminate_outer or terminate_inner)
@@ -531,54 +658,68 @@ void GeodesicIntegrator::IntegrateGeodesicsRK4()
         if (last_step)
           sample_flags[adaptive_level](m) = true;
       }
+
+      // Finish streamed ray
+      if (ray_streaming)
+        StreamGeodesic(m, m_ray, ray_pos, ray_dir, ray_len);
     }
+    ProfileRecordThread("IntegrateGeodesics", ProfileSnapshot(), adaptive_level,
+        profile_time_start, omp_get_wtime(), profile_counts);
+    #pragma omp barrier
 
     // Truncate geodesics at boundaries
-    #pragma omp for schedule(static)
-    for (int m = 0; m < num_pix; m++)
+    if (not ray_streaming)
     {
-      int num_samples = sample_num[adaptive_level](m);
-      if (num_samples > 1)
+      #pragma omp for schedule(runtime)
+      for (int m = 0; m < num_pix; m++)
       {
-        double r_new =
-            RadialGeodesicCoordinate(geodesic_pos(m,0,1), geodesic_pos(m,0,2), geodesic_pos(m,0,3));
-        for (int n = 1; n < num_samples; n++)
+        int num_samples = sample_num[adaptive_level](m);
+        if (num_samples > 1)
         {
-          double r_old = r_new;
-          r_new = RadialGeodesicCoordinate(geodesic_pos(m,n,1), geodesic_pos(m,n,2),
-              geodesic_pos(m,n,3));
-          bool terminate_outer = r_new > camera_r and r_new > r_old;
-          bool terminate_inner = r_new < r_terminate;
-          if (terminate_outer or terminate_inner)
+          double r_new =
+              RadialGeodesicCoordinate<metric>(geodesic_pos(m,0,1), geodesic_pos(m,0,2),
+              geodesic_pos(m,0,3));
+          for (int n = 1; n < num_samples; n++)
           {
-            sample_num[adaptive_level](m) = n;
-            break;
+            double r_old = r_new;
+            r_new = RadialGeodesicCoordinate<metric>(geodesic_pos(m,n,1), geodesic_pos(m,n,2),
+                geodesic_pos(m,n,3));
+            bool terminate_outer = r_new > camera_r and r_new > r_old;
+            bool terminate_inner = r_new < r_terminate;
+            if (terminate_outer or terminate_inner)
+            {
+              sample_num[adaptive_level](m) = n;
+              break;
+            }
           }
         }
       }
     }
 
     // Renormalize momenta
-    #pragma omp for schedule(static)
-    for (int m = 0; m < num_pix; m++)
-      for (int n = 0; n < sample_num[adaptive_level](m); n++)
-      {
-        ContravariantGeodesicMetric(geodesic_pos(m,n,1), geodesic_pos(m,n,2), geodesic_pos(m,n,3),
-            gcon);
-        double temp_a = 0.0;
-        for (int a = 1; a < 4; a++)
-          for (int b = 1; b < 4; b++)
-            temp_a += gcon[a][b] * geodesic_dir(m,n,a) * geodesic_dir(m,n,b);
-        double temp_b = 0.0;
-        for (int a = 1; a < 4; a++)
-          temp_b += 2.0 * gcon[0][a] * geodesic_dir(m,n,0) * geodesic_dir(m,n,a);
-        double temp_c = gcon[0][0] * geodesic_dir(m,n,0) * geodesic_dir(m,n,0);
-        double temp_d = std::sqrt(temp_b * temp_b - 4.0 * temp_a * temp_c);
-        double factor =
-            temp_b < 0.0 ? (temp_d - temp_b) / (2.0 * temp_a) : -2.0 * temp_c / (temp_b + temp_d);
-        for (int a = 1; a < 4; a++)
-          geodesic_dir(m,n,a) *= factor;
-      }
+    if (not ray_streaming)
+    {
+      #pragma omp for schedule(runtime)
+      for (int m = 0; m < num_pix; m++)
+        for (int n = 0; n < sample_num[adaptive_level](m); n++)
+        {
+          ContravariantGeodesicMetric<metric>(geodesic_pos(m,n,1), geodesic_pos(m,n,2),
+              geodesic_pos(m,n,3), gcon);
+          double temp_a = 0.0;
+          for (int a = 1; a < 4; a++)
+            for (int b = 1; b < 4; b++)
+              temp_a += gcon[a][b] * geodesic_dir(m,n,a) * geodesic_dir(m,n,b);
+          double temp_b = 0.0;
+          for (int a = 1; a < 4; a++)
+            temp_b += 2.0 * gcon[0][a] * geodesic_dir(m,n,0) * geodesic_dir(m,n,a);
+          double temp_c = gcon[0][0] * geodesic_dir(m,n,0) * geodesic_dir(m,n,0);
+          double temp_d = std::sqrt(temp_b * temp_b - 4.0 * temp_a * temp_c);
+          double factor =
+              temp_b < 0.0 ? (temp_d - temp_b) / (2.0 * temp_a) : -2.0 * temp_c / (temp_b + temp_d);
+          for (int a = 1; a < 4; a++)
+            geodesic_dir(m,n,a) *= factor;
+        }
+    }
 
     // Calculate maximum number of steps actually taken
     #pragma omp for schedule(static) reduction(max: geodesic_num_steps_local)
@@ -615,6 +756,9 @@ void GeodesicIntegrator::IntegrateGeodesicsRK4()
 //   Initializes geodesic_num_steps[adaptive_level].
 //   Allocates and initializes geodesic_pos, geodesic_dir, geodesic_len,
 //       sample_flags[adaptive_level], and sample_num[adaptive_level].
+//   If ray_streaming == true, geodesic_pos, geodesic_dir, and geodesic_len are not allocated;
+//       instead each ray is integrated into per-thread scratch space and passed to
+//       StreamGeodesic() when finished.
 //   Assumes x^0 is ignorable.
 //   Integrates via 2nd-order Runge-Kutta (Heun's method) with Butcher tableau
 //       0 |
@@ -623,16 +767,20 @@ void GeodesicIntegrator::IntegrateGeodesicsRK4()
 //           1/2 1/2
 //   Step size in affine parameter is taken to be the product of user input ray_step with the radial
 //       displacement above the horizon.
+template<MetricType metric>
 void GeodesicIntegrator::IntegrateGeodesicsRK2()
 {
   // Allocate arrays
-  int num_pix = camera_num_pix;
-  if (adaptive_level > 0)
-    num_pix = block_counts[adaptive_level] * block_num_pix;
-  geodesic_pos.Allocate(num_pix, ray_max_steps, 4);
-  geodesic_dir.Allocate(num_pix, ray_max_steps, 4);
-  geodesic_len.Allocate(num_pix, ray_max_steps);
-  geodesic_len.Zero();
+  int num_pix = camera_pos[adaptive_level].n2;
+  if (ray_streaming)
+    PrepareGeodesicStreams(num_pix);
+  else
+  {
+    geodesic_pos.Allocate(num_pix, ray_max_steps, 4);
+    geodesic_dir.Allocate(num_pix, ray_max_steps, 4);
+    geodesic_len.Allocate(num_pix, ray_max_steps);
+    geodesic_len.Zero();
+  }
   sample_flags[adaptive_level].Allocate(num_pix);
   sample_flags[adaptive_level].Zero();
   sample_num[adaptive_level].Allocate(num_pix);
@@ -649,8 +797,27 @@ void GeodesicIntegrator::IntegrateGeodesicsRK2()
     double y_vals_substep[8];
     double k_vals[8];
 
+    // Prepare storage for rays
+    Array<double> ray_pos;
+    Array<double> ray_dir;
+    Array<double> ray_len;
+    if (ray_streaming)
+    {
+      ray_pos.Allocate(1, ray_max_steps, 4);
+      ray_dir.Allocate(1, ray_max_steps, 4);
+      ray_len.Allocate(1, ray_max_steps);
+    }
+    else
+    {
+      ray_pos = geodesic_pos;
+      ray_dir = geodesic_dir;
+      ray_len = geodesic_len;
+    }
+
     // Go through pixels
-    #pragma omp for schedule(static)
+    ProfileCounts profile_counts;
+    double profile_time_start = omp_get_wtime();
+    #pragma omp for schedule(runtime) nowait
     for (int m = 0; m < num_pix; m++)
     {
       // Extract initial position
@@ -658,7 +825,7 @@ void GeodesicIntegrator::IntegrateGeodesicsRK2()
       y_vals[1] = camera_pos[adaptive_level](m,1);
       y_vals[2] = camera_pos[adaptive_level](m,2);
       y_vals[3] = camera_pos[adaptive_level](m,3);
-      double r_new = RadialGeodesicCoordinate(y_vals[1], y_vals[2], y_vals[3]);
+      double r_new = RadialGeodesicCoordinate<metric>(y_vals[1], y_vals[2], y_vals[3]);
 
       // Extract initial momentum
       y_vals[4] = camera_dir[adaptive_level](m,0);
@@ -666,6 +833,9 @@ void GeodesicIntegrator::IntegrateGeodesicsRK2()
       y_vals[6] = camera_dir[adaptive_level](m,2);
       y_vals[7] = camera_dir[adaptive_level](m,3);
 
+      // Select storage for ray
+      int m_ray = ray_streaming ? 0 : m;
+
       // Take steps
       for (int n = 0; n < ray_max_steps; n++)
       {
@@ -674,7 +844,7 @@ void GeodesicIntegrator::IntegrateGeodesicsRK2()
         double h = -ray_step * (r - r_horizon);
 
         // Calculate and accumulate first substep
-        GeodesicSubstepWithoutDistance(y_vals, k_vals);
+        GeodesicSubstepWithoutDistance<metric>(y_vals, k_vals);
         for (int p = 0; p < 8; p++)
           y_vals_substep[p] = y_vals[p] + h * k_vals[p];
         for (int p = 0; p < 8; p++)
@@ -683,18 +853,18 @@ void GeodesicIntegrator::IntegrateGeodesicsRK2()
         // Store midpoint
         for (int mu = 0; mu < 4; mu++)
         {
-          geodesic_pos(m,n,mu) = y_vals[mu];
-          geodesic_dir(m,n,mu) = y_vals[4+mu];
+          ray_pos(m_ray,n,mu) = y_vals[mu];
+          ray_dir(m_ray,n,mu) = y_vals[4+mu];
         }
-        geodesic_len(m,n) = h;
+        ray_len(m_ray,n) = h;
 
         // Calculate and accumulate second substep
-        GeodesicSubstepWithoutDistance(y_vals_substep, k_vals);
+        GeodesicSubstepWithoutDistance<metric>(y_vals_substep, k_vals);
         for (int p = 0; p < 8; p++)
           y_vals[p] += 1.0 / 2.0 * h * k_vals[p];
 
         // Renormalize momentum
-        ContravariantGeodesicMetric(y_vals[1], y_vals[2], y_vals[3], gcon);
+        ContravariantGeodesicMetric<metric>(y_vals[1], y_vals[2], y_vals[3], gcon);
         double temp_a = 0.0;
         for (int a = 1; a < 4; a++)
           for (int b = 1; b < 4; b++)
@@ -711,7 +881,8 @@ void GeodesicIntegrator::IntegrateGeodesicsRK2()
 
         // Check termination
         sample_num[adaptive_level](m)++;
-        r_new = RadialGeodesicCoordinate(y_vals[1], y_vals[2], y_vals[3]);
+        profile_counts.samples++;
+        r_new = RadialGeodesicCoordinate<metric>(y_vals[1], y_vals[2], y_vals[3]);
         bool terminate_outer = r_new > camera_r and r_new > r;
         bool terminate_inner = r_new < r_terminate;
         if (terminate_outer or terminate_inner)
@@ -720,54 +891,68 @@ void GeodesicIntegrator::IntegrateGeodesicsRK2()
         if (last_step)
           sample_flags[adaptive_level](m) = true;
       }
+
+      // Finish streamed ray
+      if (ray_streaming)
+        StreamGeodesic(m, m_ray, ray_pos, ray_dir, ray_len);
     }
+    ProfileRecordThread("IntegrateGeodesics", ProfileSnapshot(), adaptive_level,
+        profile_time_start, omp_get_wtime(), profile_counts);
+    #pragma omp barrier
 
     // Truncate geodesics at boundaries
-    #pragma omp for schedule(static)
-    for (int m = 0; m < num_pix; m++)
+    if (not ray_streaming)
     {
-      int num_samples = sample_num[adaptive_level](m);
-      if (num_samples > 1)
+      #pragma omp for schedule(runtime)
+      for (int m = 0; m < num_pix; m++)
       {
-        double r_new =
-            RadialGeodesicCoordinate(geodesic_pos(m,0,1), geodesic_pos(m,0,2), geodesic_pos(m,0,3));
-        for (int n = 1; n < num_samples; n++)
+        int num_samples = sample_num[adaptive_level](m);
+        if (num_samples > 1)
         {
-          double r_old = r_new;
-          r_new = RadialGeodesicCoordinate(geodesic_pos(m,n,1), geodesic_pos(m,n,2),
-              geodesic_pos(m,n,3));
-          bool terminate_outer = r_new > camera_r and r_new > r_old;
-          bool terminate_inner = r_new < r_terminate;
-          if (terminate_outer or terminate_inner)
+          double r_new =
+              RadialGeodesicCoordinate<metric>(geodesic_pos(m,0,1), geodesic_pos(m,0,2),
+              geodesic_pos(m,0,3));
+          for (int n = 1; n < num_samples; n++)
           {
-            sample_num[adaptive_level](m) = n;
-            break;
+            double r_old = r_new;
+            r_new = RadialGeodesicCoordinate<metric>(geodesic_pos(m,n,1), geodesic_pos(m,n,2),
+                geodesic_pos(m,n,3));
+            bool terminate_outer = r_new > camera_r and r_new > r_old;
+            bool terminate_inner = r_new < r_terminate;
+            if (terminate_outer or terminate_inner)
+            {
+              sample_num[adaptive_level](m) = n;
+              break;
+            }
           }
         }
       }
     }
 
     // Renormalize momenta
-    #pragma omp for schedule(static)
-    for (int m = 0; m < num_pix; m++)
-      for (int n = 0; n < sample_num[adaptive_level](m); n++)
-      {
-        ContravariantGeodesicMetric(geodesic_pos(m,n,1), geodesic_pos(m,n,2), geodesic_pos(m,n,3),
-            gcon);
-        double temp_a = 0.0;
-        for (int a = 1; a < 4; a++)
-          for (int b = 1; b < 4; b++)
-            temp_a += gcon[a][b] * geodesic_dir(m,n,a) * geodesic_dir(m,n,b);
-        double temp_b = 0.0;
-        for (int a = 1; a < 4; a++)
-          temp_b += 2.0 * gcon[0][a] * geodesic_dir(m,n,0) * geodesic_dir(m,n,a);
-        double temp_c = gcon[0][0] * geodesic_dir(m,n,0) * geodesic_dir(m,n,0);
-        double temp_d = std::sqrt(temp_b * temp_b - 4.0 * temp_a * temp_c);
-        double factor =
-            temp_b < 0.0 ? (temp_d - temp_b) / (2.0 * temp_a) : -2.0 * temp_c / (temp_b + temp_d);
-        for (int a = 1; a < 4; a++)
-          geodesic_dir(m,n,a) *= factor;
-      }
+    if (not ray_streaming)
+    {
+      #pragma omp for schedule(runtime)
+      for (int m = 0; m < num_pix; m++)
+        for (int n = 0; n < sample_num[adaptive_level](m); n++)
+        {
+          ContravariantGeodesicMetric<metric>(geodesic_pos(m,n,1), geodesic_pos(m,n,2),
+              geodesic_pos(m,n,3), gcon);
+          double temp_a = 0.0;
+          for (int a = 1; a < 4; a++)
+            for (int b = 1; b < 4; b++)
+              temp_a += gcon[a][b] * geodesic_dir(m,n,a) * geodesic_dir(m,n,b);
+          double temp_b = 0.0;
+          for (int a = 1; a < 4; a++)
+            temp_b += 2.0 * gcon[0][a] * geodesic_dir(m,n,0) * geodesic_dir(m,n,a);
+          double temp_c = gcon[0][0] * geodesic_dir(m,n,0) * geodesic_dir(m,n,0);
+          double temp_d = std::sqrt(temp_b * temp_b - 4.0 * temp_a * temp_c);
+          double factor =
+              temp_b < 0.0 ? (temp_d - temp_b) / (2.0 * temp_a) : -2.0 * temp_c / (temp_b + temp_d);
+          for (int a = 1; a < 4; a++)
+            geodesic_dir(m,n,a) *= factor;
+        }
+    }
 
     // Calculate maximum number of steps actually taken
     #pragma omp for schedule(static) reduction(max: geodesic_num_steps_local)
@@ -808,36 +993,49 @@ void GeodesicIntegrator::IntegrateGeodesicsRK2()
 void GeodesicIntegrator::ReverseGeodesics()
 {
   // Allocate arrays
-  int num_pix = camera_num_pix;
-  if (adaptive_level > 0)
-    num_pix = block_counts[adaptive_level] * block_num_pix;
+  double time_start = omp_get_wtime();
+  int num_pix = camera_pos[adaptive_level].n2;
   sample_pos[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level], 4);
   sample_dir[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level], 4);
   sample_len[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
   sample_len[adaptive_level].Zero();
 
+  // Prepare views
+  ArrayView<double> geodesic_pos_view(geodesic_pos);
+  ArrayView<double> geodesic_dir_view(geodesic_dir);
+  ArrayView<double> geodesic_len_view(geodesic_len);
+  ArrayView<double> sample_pos_view(sample_pos[adaptive_level]);
+  ArrayView<double> sample_dir_view(sample_dir[adaptive_level]);
+  ArrayView<double> sample_len_view(sample_len[adaptive_level]);
+
   // Go through samples
   #pragma omp parallel for schedule(static)
   for (int m = 0; m < num_pix; m++)
   {
+    // Locate rays
     int num_steps = sample_num[adaptive_level](m);
+    ArrayView<double> pos_old = geodesic_pos_view.Subview(3, m);
+    ArrayView<double> dir_old = geodesic_dir_view.Subview(3, m);
+    ArrayView<double> len_old = geodesic_len_view.Subview(2, m);
+    ArrayView<double> pos_new = sample_pos_view.Subview(3, m);
+    ArrayView<double> dir_new = sample_dir_view.Subview(3, m);
+    ArrayView<double> len_new = sample_len_view.Subview(2, m);
+
+    // Go through samples along ray
     for (int n = 0; n < num_steps; n++)
     {
       // Skip terminated geodesics
-      double len = geodesic_len(m,n);
+      double len = len_old(n);
       if (len == 0.0)
         break;
 
       // Set new arrays in reverse order
-      sample_pos[adaptive_level](m,num_steps-1-n,0) = geodesic_pos(m,n,0);
-      sample_pos[adaptive_level](m,num_steps-1-n,1) = geodesic_pos(m,n,1);
-      sample_pos[adaptive_level](m,num_steps-1-n,2) = geodesic_pos(m,n,2);
-      sample_pos[adaptive_level](m,num_steps-1-n,3) = geodesic_pos(m,n,3);
-      sample_dir[adaptive_level](m,num_steps-1-n,0) = geodesic_dir(m,n,0);
-      sample_dir[adaptive_level](m,num_steps-1-n,1) = geodesic_dir(m,n,1);
-      sample_dir[adaptive_level](m,num_steps-1-n,2) = geodesic_dir(m,n,2);
-      sample_dir[adaptive_level](m,num_steps-1-n,3) = geodesic_dir(m,n,3);
-      sample_len[adaptive_level](m,num_steps-1-n) = -len;
+      for (int mu = 0; mu < 4; mu++)
+      {
+        pos_new(num_steps-1-n,mu) = pos_old(n,mu);
+        dir_new(num_steps-1-n,mu) = dir_old(n,mu);
+      }
+      len_new(num_steps-1-n) = -len;
     }
   }
 
@@ -845,6 +1043,8 @@ void GeodesicIntegrator::ReverseGeodesics()
   geodesic_pos.Deallocate();
   geodesic_dir.Deallocate();
   geodesic_len.Deallocate();
+  ProfileRecord("ReverseGeodesics", ProfileSnapshot(), adaptive_level, time_start,
+      omp_get_wtime(), ProfileCounts());
   return;
 }
 
@@ -864,14 +1064,15 @@ void GeodesicIntegrator::ReverseGeodesics()
 //     d(s) / d(lambda) = -(g_{i j} (g^{i mu} - g^{0 i} g^{0 mu} / g^{0 0}) p_mu
 //         (g^{j nu} - g^{0 j} g^{0 nu} / g^{0 0}) p_nu)^(1/2).
 //   Assumes x^0 is ignorable.
+template<MetricType metric>
 void GeodesicIntegrator::GeodesicSubstepWithDistance(double y[9], double k[9])
 {
   double gcov[4][4];
   double gcon[4][4];
   double dgcon[3][4][4];
-  CovariantGeodesicMetric(y[1], y[2], y[3], gcov);
-  ContravariantGeodesicMetric(y[1], y[2], y[3], gcon);
-  ContravariantGeodesicMetricDerivative(y[1], y[2], y[3], dgcon);
+  CovariantGeodesicMetric<metric>(y[1], y[2], y[3], gcov);
+  ContravariantGeodesicMetric<metric>(y[1], y[2], y[3], gcon);
+  ContravariantGeodesicMetricDerivative<metric>(y[1], y[2], y[3], dgcon);
   for (int p = 0; p < 9; p++)
     k[p] = 0.0;
   for (int mu = 0; mu < 4; mu++)
@@ -906,12 +1107,13 @@ void GeodesicIntegrator::GeodesicSubstepWithDistance(double y[9], double k[9])
 //     d(p_0) / d(lambda) = 0,
 //     d(p_i) / d(lambda) = -1/2 * d(g^{mu nu}) / d(x^i) p_mu p_nu,
 //   Assumes x^0 is ignorable.
+template<MetricType metric>
 void GeodesicIntegrator::GeodesicSubstepWithoutDistance(double y[8], double k[8])
 {
   double gcon[4][4];
   double dgcon[3][4][4];
-  ContravariantGeodesicMetric(y[1], y[2], y[3], gcon);
-  ContravariantGeodesicMetricDerivative(y[1], y[2], y[3], dgcon);
+  ContravariantGeodesicMetric<metric>(y[1], y[2], y[3], gcon);
+  ContravariantGeodesicMetricDerivative<metric>(y[1], y[2], y[3], dgcon);
   for (int p = 0; p < 8; p++)
     k[p] = 0.0;
   for (int mu = 0; mu < 4; mu++)
@@ -0,0 +1,698 @@
+// Blacklight geodesic integrator - packetized geodesic integration
+
+// C++ headers
+#include <algorithm>  // max, min
+#include <cmath>      // abs, ceil, isfinite, pow, sqrt
+#include <sstream>    // ostringstream
+
+// Library headers
+#include <omp.h>  // omp_get_wtime, pragmas
+
+// Blacklight headers
+#include "geodesic_integrator.hpp"
+#include "../blacklight.hpp"        // enums
+#include "../utils/array.hpp"       // Array
+#include "../utils/exceptions.hpp"  // BlacklightWarning
+#include "../utils/profiler.hpp"    // profiling functions
+
+// Instantiations
+template void GeodesicIntegrator::IntegrateGeodesicsDPPacket<4, MetricType::flat>();
+template void GeodesicIntegrator::IntegrateGeodesicsDPPacket<4, MetricType::schwarzschild>();
+template void GeodesicIntegrator::IntegrateGeodesicsDPPacket<4, MetricType::kerr>();
+template void GeodesicIntegrator::IntegrateGeodesicsDPPacket<8, MetricType::flat>();
+template void GeodesicIntegrator::IntegrateGeodesicsDPPacket<8, MetricType::schwarzschild>();
+template void GeodesicIntegrator::IntegrateGeodesicsDPPacket<8, MetricType::kerr>();
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating ray positions and directions through space via Dormand-Prince, with
+//     several rays advanced together
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes camera_pos[adaptive_level] and camera_dir[adaptive_level] have been set.
+//   Initializes geodesic_num_steps[adaptive_level].
+//   Allocates and initializes geodesic_pos, geodesic_dir, geodesic_len,
+//       sample_flags[adaptive_level], and sample_num[adaptive_level].
+//   If ray_streaming == true, geodesic_pos, geodesic_dir, and geodesic_len are not allocated;
+//       instead each ray is integrated into per-thread scratch space and passed to
+//       StreamGeodesic() when finished.
+//   Assumes x^0 is ignorable.
+//   Follows the algorithm of IntegrateGeodesicsDP(), including step size control, retries,
+//       interpolation, and termination, on a per-ray basis.
+//   The metric is contracted with the momentum directly rather than formed as arrays, so substeps
+//       differ at roundoff, and step acceptance can then differ near the error tolerance. Step
+//       sequences are therefore not identical to those of IntegrateGeodesicsDP(), and images agree
+//       only to the level of the integration error (about 2e-4 relative in intensity and optical
+//       depth for a Kerr AthenaK test).
+//   A different step sequence also moves where the last, coarse step at the far end of a ray is
+//       truncated at the boundary, so time and length can differ at the 1e-2 relative level for
+//       rays leaving the domain (7e-3 at edge pixels in the same test).
+//   Rays are stored in structure-of-arrays form with num_lanes (at most 8) lanes, so that the
+//       substep evaluations (which dominate the cost) can be vectorized across rays.
+//   Each lane has its own step size and retry count; lanes whose rays have terminated are masked
+//       out of the bookkeeping and refilled with the next ray from the same chunk of pixels.
+template<int num_lanes, MetricType metric>
+void GeodesicIntegrator::IntegrateGeodesicsDPPacket()
+{
+  // Define coefficients
+  double a_vals[7][6] = {};
+  a_vals[1][0] = 1.0 / 5.0;
+  a_vals[2][0] = 3.0 / 40.0;
+  a_vals[2][1] = 9.0 / 40.0;
+  a_vals[3][0] = 44.0 / 45.0;
+  a_vals[3][1] = -56.0 / 15.0;
+  a_vals[3][2] = 32.0 / 9.0;
+  a_vals[4][0] = 19372.0 / 6561.0;
+  a_vals[4][1] = -25360.0 / 2187.0;
+  a_vals[4][2] = 64448.0 / 6561.0;
+  a_vals[4][3] = -212.0 / 729.0;
+  a_vals[5][0] = 9017.0 / 3168.0;
+  a_vals[5][1] = -355.0 / 33.0;
+  a_vals[5][2] = 46732.0 / 5247.0;
+  a_vals[5][3] = 49.0 / 176.0;
+  a_vals[5][4] = -5103.0 / 18656.0;
+  a_vals[6][0] = 35.0 / 384.0;
+  a_vals[6][2] = 500.0 / 1113.0;
+  a_vals[6][3] = 125.0 / 192.0;
+  a_vals[6][4] = -2187.0 / 6784.0;
+  a_vals[6][5] = 11.0 / 84.0;
+  double b_vals_5[7] =
+      {35.0 / 384.0, 0.0, 500.0 / 1113.0, 125.0 / 192.0, -2187.0 / 6784.0, 11.0 / 84.0, 0.0};
+  double b_vals_4[7] = {5179.0 / 57600.0, 0.0, 7571.0 / 16695.0, 393.0 / 640.0, -92097.0 / 339200.0,
+      187.0 / 2100.0, 1.0 / 40.0};
+  double b_vals_4m[7] = {6025192743.0 / 30085553152.0, 0.0, 51252292925.0 / 65400821598.0,
+      -2691868925.0 / 45128329728.0, 187940372067.0 / 1594534317056.0,
+      -1776094331.0 / 19743644256.0, 11237099.0 / 235043384.0};
+  double d_vals[7] = {-12715105075.0 / 11282082432.0, 0.0, 87487479700.0 / 32700410799.0,
+      -10690763975.0 / 1880347072.0, 701980252875.0 / 199316789632.0, -1453857185.0 / 822651844.0,
+      69997945.0 / 29380423.0};
+
+  // Define numerical parameters
+  double err_power = 0.2;
+  double ray_err_factor = 0.9;
+  double ray_min_factor = 0.2;
+  double ray_max_factor = 10.0;
+  int packets_per_chunk = 16;
+
+  // Allocate arrays
+  int num_pix = camera_pos[adaptive_level].n2;
+  if (ray_streaming)
+    PrepareGeodesicStreams(num_pix);
+  else
+  {
+    geodesic_pos.Allocate(num_pix, ray_max_steps, 4);
+    geodesic_dir.Allocate(num_pix, ray_max_steps, 4);
+    geodesic_len.Allocate(num_pix, ray_max_steps);
+    geodesic_len.Zero();
+  }
+  sample_flags[adaptive_level].Allocate(num_pix);
+  sample_flags[adaptive_level].Zero();
+  sample_num[adaptive_level].Allocate(num_pix);
+  sample_num[adaptive_level].Zero();
+
+  // Divide pixels into chunks
+  int chunk_size = packets_per_chunk * num_lanes;
+  int num_chunks = (num_pix + chunk_size - 1) / chunk_size;
+
+  // Work in parallel
+  int geodesic_num_steps_local = 0;
+  int num_bad_geodesics = 0;
+  #pragma omp parallel
+  {
+    // Allocate scratch arrays
+    double gcon[4][4];
+    double y_vals_4m[8];
+    double y_vals_sub[8];
+    double r_vals[4][8];
+    alignas(64) double y_vals[9][8];
+    alignas(64) double y_vals_temp[9][8];
+    alignas(64) double y_vals_5[9][8];
+    alignas(64) double y_vals_4[9][8];
+    alignas(64) double k_vals[7][9][8];
+    alignas(64) double k_vals_init[9][8];
+    alignas(64) double lane_h[8];
+
+    // Allocate lane bookkeeping
+    int lane_pix[8];
+    int lane_step[8];
+    int lane_retry[8];
+    bool lane_fail[8];
+    double lane_h_new[8];
+    double lane_r[8];
+    double lane_r_new[8];
+
+    // Prepare storage for rays
+    Array<double> ray_pos;
+    Array<double> ray_dir;
+    Array<double> ray_len;
+    if (ray_streaming)
+    {
+      ray_pos.Allocate(num_lanes, ray_max_steps, 4);
+      ray_dir.Allocate(num_lanes, ray_max_steps, 4);
+      ray_len.Allocate(num_lanes, ray_max_steps);
+    }
+    else
+    {
+      ray_pos = geodesic_pos;
+      ray_dir = geodesic_dir;
+      ray_len = geodesic_len;
+    }
+
+    // Go through chunks of pixels
+    ProfileCounts profile_counts;
+    double profile_time_start = omp_get_wtime();
+    #pragma omp for schedule(runtime) nowait
+    for (int chunk = 0; chunk < num_chunks; chunk++)
+    {
+      // Prepare lanes
+      int m_next = chunk * chunk_size;
+      int m_end = std::min(m_next + chunk_size, num_pix);
+      for (int lane = 0; lane < num_lanes; lane++)
+      {
+        lane_pix[lane] = -1;
+        for (int p = 0; p < 4; p++)
+        {
+          y_vals[p][lane] = camera_pos[adaptive_level](m_next,p);
+          y_vals[4+p][lane] = camera_dir[adaptive_level](m_next,p);
+        }
+        y_vals[8][lane] = 0.0;
+      }
+
+      // Take steps until all rays in chunk are done
+      while (true)
+      {
+        // Assign new rays to idle lanes
+        bool new_rays = false;
+        int num_active = 0;
+        for (int lane = 0; lane < num_lanes; lane++)
+        {
+          if (lane_pix[lane] < 0 and m_next < m_end)
+          {
+            int m = m_next++;
+            lane_pix[lane] = m;
+            for (int p = 0; p < 4; p++)
+            {
+              y_vals[p][lane] = camera_pos[adaptive_level](m,p);
+              y_vals[4+p][lane] = camera_dir[adaptive_level](m,p);
+            }
+            y_vals[8][lane] = 0.0;
+            for (int p = 0; p < 9; p++)
+              y_vals_5[p][lane] = y_vals[p][lane];
+            lane_r_new[lane] = RadialGeodesicCoordinate<metric>(y_vals[1][lane], y_vals[2][lane],
+                y_vals[3][lane]);
+            lane_h_new[lane] = -ray_step * lane_r_new[lane];
+            lane_step[lane] = 0;
+            lane_retry[lane] = 0;
+            lane_fail[lane] = false;
+            new_rays = true;
+          }
+          if (lane_pix[lane] >= 0)
+            num_active++;
+        }
+        if (num_active == 0)
+          break;
+
+        // Calculate initial derivatives for new rays
+        if (new_rays)
+        {
+          GeodesicSubstepWithDistancePacket<num_lanes, metric>(y_vals, k_vals_init);
+          for (int lane = 0; lane < num_lanes; lane++)
+            if (lane_pix[lane] >= 0 and lane_step[lane] == 0 and not lane_fail[lane])
+              for (int p = 0; p < 9; p++)
+                k_vals[0][p][lane] = k_vals_init[p][lane];
+        }
+
+        // Prepare step in each lane
+        for (int lane = 0; lane < num_lanes; lane++)
+        {
+          // Skip idle lanes
+          int m = lane_pix[lane];
+          if (m < 0)
+          {
+            lane_h[lane] = 0.0;
+            continue;
+          }
+
+          // Check for too many retries
+          if (lane_retry[lane] > ray_max_retries)
+          {
+            sample_flags[adaptive_level](m) = true;
+            if (ray_streaming)
+              StreamGeodesic(m, lane, ray_pos, ray_dir, ray_len);
+            lane_pix[lane] = -1;
+            lane_h[lane] = 0.0;
+            continue;
+          }
+
+          // Update step size
+          lane_h[lane] = lane_h_new[lane];
+
+          // Copy previous results
+          if (not lane_fail[lane] and lane_step[lane] > 0)
+            for (int p = 0; p < 9; p++)
+            {
+              y_vals[p][lane] = y_vals_5[p][lane];
+              k_vals[0][p][lane] = k_vals[6][p][lane];
+            }
+          lane_r[lane] = lane_r_new[lane];
+          if (lane_fail[lane])
+            lane_r[lane] =
+                RadialGeodesicCoordinate<metric>(y_vals[1][lane], y_vals[2][lane], y_vals[3][lane]);
+        }
+
+        // Calculate substeps
+        for (int substep = 1; substep < 7; substep++)
+        {
+          for (int p = 0; p < 9; p++)
+          {
+            #pragma omp simd
+            for (int lane = 0; lane < num_lanes; lane++)
+              y_vals_temp[p][lane] = y_vals[p][lane];
+            for (int q = 0; q < substep; q++)
+            {
+              #pragma omp simd
+              for (int lane = 0; lane < num_lanes; lane++)
+                y_vals_temp[p][lane] += a_vals[substep][q] * lane_h[lane] * k_vals[q][p][lane];
+            }
+          }
+          GeodesicSubstepWithDistancePacket<num_lanes, metric>(y_vals_temp, k_vals[substep]);
+        }
+
+        // Calculate values at end of full step
+        for (int p = 0; p < 9; p++)
+        {
+          #pragma omp simd
+          for (int lane = 0; lane < num_lanes; lane++)
+          {
+            y_vals_5[p][lane] = y_vals[p][lane];
+            y_vals_4[p][lane] = y_vals[p][lane];
+          }
+          for (int q = 0; q < 7; q++)
+          {
+            #pragma omp simd
+            for (int lane = 0; lane < num_lanes; lane++)
+            {
+              y_vals_5[p][lane] += b_vals_5[q] * lane_h[lane] * k_vals[q][p][lane];
+              y_vals_4[p][lane] += b_vals_4[q] * lane_h[lane] * k_vals[q][p][lane];
+            }
+          }
+        }
+
+        // Complete step in each lane
+        for (int lane = 0; lane < num_lanes; lane++)
+        {
+          // Skip idle lanes
+          int m = lane_pix[lane];
+          if (m < 0)
+            continue;
+          double h = lane_h[lane];
+          double r = lane_r[lane];
+          int n = lane_step[lane];
+          int m_ray = ray_streaming ? lane : m;
+          lane_r_new[lane] = RadialGeodesicCoordinate<metric>(y_vals_5[1][lane], y_vals_5[2][lane],
+              y_vals_5[3][lane]);
+          double r_new = lane_r_new[lane];
+
+          // Estimate error
+          double error = 0.0;
+          for (int p = 0; p < 8; p++)
+          {
+            double y_abs = std::max(std::abs(y_vals[p][lane]), std::abs(y_vals_5[p][lane]));
+            double error_scale = ray_tol_abs + ray_tol_rel * y_abs;
+            double delta_y = std::abs(y_vals_5[p][lane] - y_vals_4[p][lane]);
+            error = std::max(error, delta_y / error_scale);
+          }
+
+          // Decide if step is too far
+          if (not (error <= 1.0))
+          {
+            double h_factor = ray_min_factor;
+            if (std::isfinite(error))
+            {
+              double h_factor_ideal = ray_err_factor * std::pow(error, -err_power);
+              h_factor = std::max(h_factor_ideal, ray_min_factor);
+            }
+            lane_h_new[lane] = h * h_factor;
+            lane_retry[lane] += 1;
+            profile_counts.retries++;
+            lane_fail[lane] = true;
+            continue;
+          }
+          else
+          {
+            double h_factor = ray_max_factor;
+            if (error > 0.0)
+            {
+              h_factor = ray_err_factor * std::pow(error, -err_power);
+              h_factor = std::max(h_factor, ray_min_factor);
+              h_factor = std::min(h_factor, ray_max_factor);
+            }
+            if (lane_fail[lane])
+              h_factor = std::min(h_factor, 1.0);
+            lane_h_new[lane] = h * h_factor;
+            lane_retry[lane] = 0;
+            lane_fail[lane] = false;
+          }
+
+          // Calculate values at middle of full step
+          for (int p = 0; p < 8; p++)
+            y_vals_4m[p] = y_vals[p][lane];
+          for (int q = 0; q < 7; q++)
+            for (int p = 0; p < 8; p++)
+              y_vals_4m[p] += b_vals_4m[q] * h * k_vals[q][p][lane];
+
+          // Subdivide full step
+          double r_mid = RadialGeodesicCoordinate<metric>(y_vals_4m[1], y_vals_4m[2], y_vals_4m[3]);
+          double delta_s_step = ray_step * r_mid;
+          double delta_s_full = y_vals_5[8][lane] - y_vals[8][lane];
+          int num_steps_ideal = static_cast<int>(std::ceil(delta_s_full / delta_s_step));
+          delta_s_step = delta_s_full / num_steps_ideal;
+          int num_steps_max = ray_max_steps - n;
+          int num_steps = num_steps_ideal;
+          if (num_steps > num_steps_max)
+          {
+            num_steps = num_steps_max;
+            sample_flags[adaptive_level](m) = true;
+          }
+
+          // Calculate step midpoint if no subdivision necessary
+          if (num_steps_ideal == 1)
+          {
+            ray_pos(m_ray,n,0) = y_vals_4m[0];
+            ray_pos(m_ray,n,1) = y_vals_4m[1];
+            ray_pos(m_ray,n,2) = y_vals_4m[2];
+            ray_pos(m_ray,n,3) = y_vals_4m[3];
+            ray_dir(m_ray,n,0) = y_vals_4m[4];
+            ray_dir(m_ray,n,1) = y_vals_4m[5];
+            ray_dir(m_ray,n,2) = y_vals_4m[6];
+            ray_dir(m_ray,n,3) = y_vals_4m[7];
+            ray_len(m_ray,n) = h;
+          }
+
+          // Calculate interpolating coefficients for subdivisions
+          if (num_steps_ideal > 1)
+          {
+            for (int p = 0; p < 8; p++)
+            {
+              r_vals[0][p] = y_vals_5[p][lane] - y_vals[p][lane];
+              r_vals[1][p] = y_vals[p][lane] - y_vals_5[p][lane] + h * k_vals[0][p][lane];
+              r_vals[2][p] = 2.0 * (y_vals_5[p][lane] - y_vals[p][lane])
+                  - h * (k_vals[0][p][lane] + k_vals[6][p][lane]);
+              r_vals[3][p] = 0.0;
+            }
+            for (int q = 0; q < 7; q++)
+              for (int p = 0; p < 8; p++)
+                r_vals[3][p] += d_vals[q] * h * k_vals[q][p][lane];
+          }
+
+          // Calculate subdivided steps
+          if (num_steps_ideal > 1)
+            for (int nn = 0; nn < num_steps; nn++)
+            {
+              double frac = (nn + 0.5) / num_steps_ideal;
+              for (int p = 0; p < 8; p++)
+                y_vals_sub[p] = y_vals[p][lane] + frac * (r_vals[0][p] + (1.0 - frac)
+                    * (r_vals[1][p] + frac * (r_vals[2][p] + (1.0 - frac) * r_vals[3][p])));
+              ray_pos(m_ray,n+nn,0) = y_vals_sub[0];
+              ray_pos(m_ray,n+nn,1) = y_vals_sub[1];
+              ray_pos(m_ray,n+nn,2) = y_vals_sub[2];
+              ray_pos(m_ray,n+nn,3) = y_vals_sub[3];
+              ray_dir(m_ray,n+nn,0) = y_vals_sub[4];
+              ray_dir(m_ray,n+nn,1) = y_vals_sub[5];
+              ray_dir(m_ray,n+nn,2) = y_vals_sub[6];
+              ray_dir(m_ray,n+nn,3) = y_vals_sub[7];
+              ray_len(m_ray,n+nn) = h / num_steps_ideal;
+            }
+
+          // Renormalize momentum
+          ContravariantGeodesicMetric<metric>(y_vals_5[1][lane], y_vals_5[2][lane],
+              y_vals_5[3][lane], gcon);
+          double temp_a = 0.0;
+          for (int a = 1; a < 4; a++)
+            for (int b = 1; b < 4; b++)
+              temp_a += gcon[a][b] * y_vals_5[4+a][lane] * y_vals_5[4+b][lane];
+          double temp_b = 0.0;
+          for (int a = 1; a < 4; a++)
+            temp_b += 2.0 * gcon[0][a] * y_vals_5[4][lane] * y_vals_5[4+a][lane];
+          double temp_c = gcon[0][0] * y_vals_5[4][lane] * y_vals_5[4][lane];
+          double temp_d = std::sqrt(temp_b * temp_b - 4.0 * temp_a * temp_c);
+          double factor =
+              temp_b < 0.0 ? (temp_d - temp_b) / (2.0 * temp_a) : -2.0 * temp_c / (temp_b + temp_d);
+          for (int a = 1; a < 4; a++)
+            y_vals_5[4+a][lane] *= factor;
+
+          // Check termination
+          sample_num[adaptive_level](m) += num_steps;
+          profile_counts.samples += num_steps;
+          bool terminate_outer = r_new > camera_r and r_new > r;
+          bool terminate_inner = r_new < r_terminate;
+          if (terminate_outer or terminate_inner)
+          {
+            if (ray_streaming)
+              StreamGeodesic(m, m_ray, ray_pos, ray_dir, ray_len);
+            lane_pix[lane] = -1;
+            continue;
+          }
+          bool last_step = n + num_steps >= ray_max_steps;
+          if (last_step)
+          {
+            sample_flags[adaptive_level](m) = true;
+            if (ray_streaming)
+              StreamGeodesic(m, m_ray, ray_pos, ray_dir, ray_len);
+            lane_pix[lane] = -1;
+            continue;
+          }
+
+          // Prepare for next step
+          lane_step[lane] = n + num_steps;
+        }
+      }
+    }
+    ProfileRecordThread("IntegrateGeodesics", ProfileSnapshot(), adaptive_level,
+        profile_time_start, omp_get_wtime(), profile_counts);
+    #pragma omp barrier
+
+    // Truncate geodesics at boundaries
+    if (not ray_streaming)
+    {
+      #pragma omp for schedule(runtime)
+      for (int m = 0; m < num_pix; m++)
+      {
+        int num_samples = sample_num[adaptive_level](m);
+        if (num_samples > 1)
+        {
+          double r_new =
+              RadialGeodesicCoordinate<metric>(geodesic_pos(m,0,1), geodesic_pos(m,0,2),
+              geodesic_pos(m,0,3));
+          for (int n = 1; n < num_samples; n++)
+          {
+            double r_old = r_new;
+            r_new = RadialGeodesicCoordinate<metric>(geodesic_pos(m,n,1), geodesic_pos(m,n,2),
+                geodesic_pos(m,n,3));
+            bool terminate_outer = r_new > camera_r and r_new > r_old;
+            bool terminate_inner = r_new < r_terminate;
+            if (terminate_outer or terminate_inner)
+            {
+              sample_num[adaptive_level](m) = n;
+              break;
+            }
+          }
+        }
+      }
+    }
+
+    // Renormalize momenta
+    if (not ray_streaming)
+    {
+      #pragma omp for schedule(runtime)
+      for (int m = 0; m < num_pix; m++)
+        for (int n = 0; n < sample_num[adaptive_level](m); n++)
+        {
+          ContravariantGeodesicMetric<metric>(geodesic_pos(m,n,1), geodesic_pos(m,n,2),
+              geodesic_pos(m,n,3), gcon);
+          double temp_a = 0.0;
+          for (int a = 1; a < 4; a++)
+            for (int b = 1; b < 4; b++)
+              temp_a += gcon[a][b] * geodesic_dir(m,n,a) * geodesic_dir(m,n,b);
+          double temp_b = 0.0;
+          for (int a = 1; a < 4; a++)
+            temp_b += 2.0 * gcon[0][a] * geodesic_dir(m,n,0) * geodesic_dir(m,n,a);
+          double temp_c = gcon[0][0] * geodesic_dir(m,n,0) * geodesic_dir(m,n,0);
+          double temp_d = std::sqrt(temp_b * temp_b - 4.0 * temp_a * temp_c);
+          double factor =
+              temp_b < 0.0 ? (temp_d - temp_b) / (2.0 * temp_a) : -2.0 * temp_c / (temp_b + temp_d);
+          for (int a = 1; a < 4; a++)
+            geodesic_dir(m,n,a) *= factor;
+        }
+    }
+
+    // Calculate maximum number of steps actually taken
+    #pragma omp for schedule(static) reduction(max: geodesic_num_steps_local)
+    for (int m = 0; m < num_pix; m++)
+      geodesic_num_steps_local = std::max(geodesic_num_steps_local, sample_num[adaptive_level](m));
+
+    // Calculate number of geodesics that do not terminate properly
+    #pragma omp for schedule(static) reduction(+: num_bad_geodesics)
+    for (int m = 0; m < num_pix; m++)
+      if (sample_flags[adaptive_level](m))
+        num_bad_geodesics++;
+  }
+
+  // Record number of steps taken
+  geodesic_num_steps[adaptive_level] = geodesic_num_steps_local;
+
+  // Report improperly terminated geodesics
+  if (num_bad_geodesics > 0)
+  {
+    std::ostringstream message;
+    message << num_bad_geodesics << " out of " << num_pix << " geodesics terminate unexpectedly.";
+    BlacklightWarning(message.str().c_str());
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for taking single forward-Euler substep in time while computing proper distance, for
+//     several rays at once
+// Inputs:
+//   y: dependent variables (positions, momenta, proper distance), one column per lane
+// Outputs:
+//   k: derivatives with respect to independent variable (affine parameter), one column per lane
+// Notes:
+//   Assumes y and k are allocated to be 9*8, with only the first num_lanes lanes used.
+//   Integrates the same equations as GeodesicSubstepWithDistance().
+//   Assumes Cartesian Kerr-Schild coordinates (Minkowski coordinates for flat metric).
+//   Rather than forming g^{mu nu} and its derivatives, uses g^{mu nu} = eta^{mu nu} - f l^mu l^nu
+//       to contract with p_mu directly:
+//     g^{mu nu} p_nu = eta^{mu nu} p_nu - f l^mu L, where L = l^nu p_nu;
+//     -1/2 * d(g^{mu nu}) / d(x^i) p_mu p_nu
+//         = 1/2 * L * (d(f) / d(x^i) L + 2 f d(l^mu) / d(x^i) p_mu).
+//   Lanes are independent and can be vectorized.
+template<int num_lanes, MetricType metric>
+void GeodesicIntegrator::GeodesicSubstepWithDistancePacket(double y[9][8], double k[9][8])
+{
+  // Handle flat case
+  if constexpr (metric == MetricType::flat)
+  {
+    #pragma omp simd
+    for (int lane = 0; lane < num_lanes; lane++)
+    {
+      k[0][lane] = -y[4][lane];
+      k[1][lane] = y[5][lane];
+      k[2][lane] = y[6][lane];
+      k[3][lane] = y[7][lane];
+      k[4][lane] = 0.0;
+      k[5][lane] = 0.0;
+      k[6][lane] = 0.0;
+      k[7][lane] = 0.0;
+      k[8][lane] = -std::sqrt(y[5][lane] * y[5][lane] + y[6][lane] * y[6][lane]
+          + y[7][lane] * y[7][lane]);
+    }
+    return;
+  }
+
+  // Go through lanes
+  double a2 = bh_a * bh_a;
+  #pragma omp simd
+  for (int lane = 0; lane < num_lanes; lane++)
+  {
+    // Extract position and momentum
+    double x = y[1][lane];
+    double yy = y[2][lane];
+    double z = y[3][lane];
+    double p_0 = y[4][lane];
+    double p_1 = y[5][lane];
+    double p_2 = y[6][lane];
+    double p_3 = y[7][lane];
+
+    // Calculate null vector and its derivatives
+    double f, l1, l2, l3;
+    double df_dx, df_dy, df_dz;
+    double dl1_dx, dl1_dy, dl1_dz, dl2_dx, dl2_dy, dl2_dz, dl3_dx, dl3_dy, dl3_dz;
+    if constexpr (metric == MetricType::schwarzschild)
+    {
+      double r = std::sqrt(x * x + yy * yy + z * z);
+      f = 2.0 * bh_m / r;
+      l1 = x / r;
+      l2 = yy / r;
+      l3 = z / r;
+      df_dx = -f * l1 / r;
+      df_dy = -f * l2 / r;
+      df_dz = -f * l3 / r;
+      dl1_dx = (1.0 - l1 * l1) / r;
+      dl1_dy = -l1 * l2 / r;
+      dl1_dz = -l1 * l3 / r;
+      dl2_dx = -l2 * l1 / r;
+      dl2_dy = (1.0 - l2 * l2) / r;
+      dl2_dz = -l2 * l3 / r;
+      dl3_dx = -l3 * l1 / r;
+      dl3_dy = -l3 * l2 / r;
+      dl3_dz = (1.0 - l3 * l3) / r;
+    }
+    else
+    {
+      // Calculate useful quantities
+      double rr2 = x * x + yy * yy + z * z;
+      double r2 = 0.5 * (rr2 - a2 + std::sqrt((rr2 - a2) * (rr2 - a2) + 4.0 * a2 * z * z));
+      double r = std::sqrt(r2);
+      f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
+
+      // Calculate null vector
+      l1 = (r * x + bh_a * yy) / (r2 + a2);
+      l2 = (r * yy - bh_a * x) / (r2 + a2);
+      l3 = z / r;
+
+      // Calculate scalar derivatives
+      double dr_dx = r * x / (2.0 * r2 - rr2 + a2);
+      double dr_dy = r * yy / (2.0 * r2 - rr2 + a2);
+      double dr_dz = (r * z + a2 * z / r) / (2.0 * r2 - rr2 + a2);
+      df_dx = -(r2 * r2 - 3.0 * a2 * z * z) * dr_dx / (r * (r2 * r2 + a2 * z * z)) * f;
+      df_dy = -(r2 * r2 - 3.0 * a2 * z * z) * dr_dy / (r * (r2 * r2 + a2 * z * z)) * f;
+      df_dz = -((r2 * r2 - 3.0 * a2 * z * z) * dr_dz + 2.0 * a2 * r * z)
+          / (r * (r2 * r2 + a2 * z * z)) * f;
+
+      // Calculate vector derivatives
+      dl1_dx = ((x - 2.0 * r * l1) * dr_dx + r) / (r2 + a2);
+      dl1_dy = ((x - 2.0 * r * l1) * dr_dy + bh_a) / (r2 + a2);
+      dl1_dz = (x - 2.0 * r * l1) * dr_dz / (r2 + a2);
+      dl2_dx = ((yy - 2.0 * r * l2) * dr_dx - bh_a) / (r2 + a2);
+      dl2_dy = ((yy - 2.0 * r * l2) * dr_dy + r) / (r2 + a2);
+      dl2_dz = (yy - 2.0 * r * l2) * dr_dz / (r2 + a2);
+      dl3_dx = -z / r2 * dr_dx;
+      dl3_dy = -z / r2 * dr_dy;
+      dl3_dz = -z / r2 * dr_dz + 1.0 / r;
+    }
+    double ll = -p_0 + l1 * p_1 + l2 * p_2 + l3 * p_3;
+    double dll_dx = dl1_dx * p_1 + dl2_dx * p_2 + dl3_dx * p_3;
+    double dll_dy = dl1_dy * p_1 + dl2_dy * p_2 + dl3_dy * p_3;
+    double dll_dz = dl1_dz * p_1 + dl2_dz * p_2 + dl3_dz * p_3;
+
+    // Calculate position derivatives
+    double k_0 = -p_0 + f * ll;
+    double k_1 = p_1 - f * l1 * ll;
+    double k_2 = p_2 - f * l2 * ll;
+    double k_3 = p_3 - f * l3 * ll;
+    k[0][lane] = k_0;
+    k[1][lane] = k_1;
+    k[2][lane] = k_2;
+    k[3][lane] = k_3;
+
+    // Calculate momentum derivatives
+    k[4][lane] = 0.0;
+    k[5][lane] = 0.5 * ll * (df_dx * ll + 2.0 * f * dll_dx);
+    k[6][lane] = 0.5 * ll * (df_dy * ll + 2.0 * f * dll_dy);
+    k[7][lane] = 0.5 * ll * (df_dz * ll + 2.0 * f * dll_dz);
+
+    // Calculate proper distance derivative
+    double factor = f / (1.0 + f) * k_0;
+    double temp_1 = k_1 + factor * l1;
+    double temp_2 = k_2 + factor * l2;
+    double temp_3 = k_3 + factor * l3;
+    double temp_l = l1 * temp_1 + l2 * temp_2 + l3 * temp_3;
+    k[8][lane] = -std::sqrt(temp_1 * temp_1 + temp_2 * temp_2 + temp_3 * temp_3
+        + f * temp_l * temp_l);
+  }
+  return;
+}
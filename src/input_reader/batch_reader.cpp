@@ -0,0 +1,220 @@
+// Blacklight input reader - batch reader
+
+// C++ headers
+#include <cstddef>   // size_t
+#include <optional>  // optional
+#include <sstream>   // ostringstream
+#include <string>    // stod, stoi, string
+
+// Blacklight headers
+#include "input_reader.hpp"
+#include "../blacklight.hpp"        // Math
+#include "../utils/exceptions.hpp"  // BlacklightException
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for parsing batch camera options
+// Inputs:
+//   key: input key as a string without leading "batch_" or "batch_camera_"
+//   val: input value as a string
+// Outputs: (none)
+// Notes:
+//   Values are only recorded if space is allocated for them, so the keys should occur in a sensible
+//       order in the input file.
+//   Variables indexed beyond what is allocated (e.g. batch_camera_3_th, when batch_num_cameras = 2)
+//       are silently ignored.
+void InputReader::ReadBatch(const std::string &key, const std::string &val)
+{
+  // Read total number of cameras
+  if (key == "num_cameras")
+  {
+    batch_num_cameras = std::stoi(val);
+    if (batch_num_cameras.value() < 0)
+      throw BlacklightException("Must have nonnegative batch_num_cameras.");
+    if (batch_num_cameras.value() > 0)
+    {
+      std::size_t num_cameras = static_cast<std::size_t>(batch_num_cameras.value());
+      batch_camera_r_vals = new std::optional<double>[num_cameras];
+      batch_camera_th_vals = new std::optional<double>[num_cameras];
+      batch_camera_ph_vals = new std::optional<double>[num_cameras];
+      batch_camera_urn_vals = new std::optional<double>[num_cameras];
+      batch_camera_uthn_vals = new std::optional<double>[num_cameras];
+      batch_camera_uphn_vals = new std::optional<double>[num_cameras];
+      batch_camera_k_r_vals = new std::optional<double>[num_cameras];
+      batch_camera_k_th_vals = new std::optional<double>[num_cameras];
+      batch_camera_k_ph_vals = new std::optional<double>[num_cameras];
+      batch_camera_rotation_vals = new std::optional<double>[num_cameras];
+      batch_camera_width_vals = new std::optional<double>[num_cameras];
+      batch_camera_poles = new std::optional<bool>[num_cameras];
+      batch_camera_files = new std::optional<std::string>[num_cameras];
+      batch_camera_geodesic_files = new std::optional<std::string>[num_cameras];
+      batch_camera_sample_files = new std::optional<std::string>[num_cameras];
+    }
+    return;
+  }
+
+  // Split key into camera number and camera parameter
+  std::string::size_type pos = key.find('_');
+  if (pos == std::string::npos or pos == 0)
+  {
+    std::ostringstream message;
+    message << "Unknown key (batch_camera_" << key << ") in input file.";
+    throw BlacklightException(message.str().c_str());
+  }
+  int camera_num = std::stoi(key.substr(0, pos)) - 1;
+  std::string name = key.substr(pos + 1);
+  if (camera_num >= batch_num_cameras.value())
+    return;
+
+  // Read camera parameter
+  if (name == "r")
+    batch_camera_r_vals[camera_num] = std::stod(val);
+  else if (name == "th")
+    batch_camera_th_vals[camera_num] =
+        ReadPole(val, &batch_camera_poles[camera_num]) * Math::pi / 180.0;
+  else if (name == "ph")
+    batch_camera_ph_vals[camera_num] = std::stod(val) * Math::pi / 180.0;
+  else if (name == "urn")
+    batch_camera_urn_vals[camera_num] = std::stod(val);
+  else if (name == "uthn")
+    batch_camera_uthn_vals[camera_num] = std::stod(val);
+  else if (name == "uphn")
+    batch_camera_uphn_vals[camera_num] = std::stod(val);
+  else if (name == "k_r")
+    batch_camera_k_r_vals[camera_num] = std::stod(val);
+  else if (name == "k_th")
+    batch_camera_k_th_vals[camera_num] = std::stod(val);
+  else if (name == "k_ph")
+    batch_camera_k_ph_vals[camera_num] = std::stod(val);
+  else if (name == "rotation")
+    batch_camera_rotation_vals[camera_num] = std::stod(val) * Math::pi / 180.0;
+  else if (name == "width")
+    batch_camera_width_vals[camera_num] = std::stod(val);
+  else if (name == "file")
+    batch_camera_files[camera_num] = val;
+  else if (name == "checkpoint_geodesic_file")
+    batch_camera_geodesic_files[camera_num] = val;
+  else if (name == "checkpoint_sample_file")
+    batch_camera_sample_files[camera_num] = val;
+
+  // Handle unknown entry
+  else
+  {
+    std::ostringstream message;
+    message << "Unknown key (batch_camera_" << key << ") in input file.";
+    throw BlacklightException(message.str().c_str());
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for filling in and checking batch camera options
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Any camera parameter not given for a particular camera is taken from the corresponding camera_*
+//       value.
+//   With more than one camera, each camera must name its own output file, as well as its own
+//       checkpoint files for any checkpoints that are saved or loaded.
+//   A batch_num_cameras of 0 disables batch cameras, ignoring any batch_camera_N_* values.
+void InputReader::SetBatchDefaults()
+{
+  // Check number of cameras
+  if (batch_num_cameras.value() == 0)
+  {
+    batch_num_cameras.reset();
+    return;
+  }
+  if (batch_num_cameras.value() < 0)
+    throw BlacklightException("Must have nonnegative batch_num_cameras.");
+  int num_cameras = batch_num_cameras.value();
+
+  // Check for needed file names
+  bool geodesic_checkpoint = (checkpoint_geodesic_save.has_value()
+      and checkpoint_geodesic_save.value()) or (checkpoint_geodesic_load.has_value()
+      and checkpoint_geodesic_load.value());
+  bool sample_checkpoint = (checkpoint_sample_save.has_value() and checkpoint_sample_save.value())
+      or (checkpoint_sample_load.has_value() and checkpoint_sample_load.value());
+  if (num_cameras > 1)
+    for (int camera_num = 0; camera_num < num_cameras; camera_num++)
+    {
+      if (not batch_camera_files[camera_num].has_value())
+        throw BlacklightException("Must specify batch_camera_N_file for each batch camera.");
+      if (geodesic_checkpoint and not batch_camera_geodesic_files[camera_num].has_value())
+        throw BlacklightException(
+            "Must specify batch_camera_N_checkpoint_geodesic_file for each batch camera.");
+      if (sample_checkpoint and not batch_camera_sample_files[camera_num].has_value())
+        throw BlacklightException(
+            "Must specify batch_camera_N_checkpoint_sample_file for each batch camera.");
+    }
+
+  // Fill in missing values from shared camera parameters
+  for (int camera_num = 0; camera_num < num_cameras; camera_num++)
+  {
+    if (not batch_camera_r_vals[camera_num].has_value())
+      batch_camera_r_vals[camera_num] = camera_r;
+    if (not batch_camera_th_vals[camera_num].has_value())
+    {
+      batch_camera_th_vals[camera_num] = camera_th;
+      batch_camera_poles[camera_num] = camera_pole;
+    }
+    if (not batch_camera_ph_vals[camera_num].has_value())
+      batch_camera_ph_vals[camera_num] = camera_ph;
+    if (not batch_camera_urn_vals[camera_num].has_value())
+      batch_camera_urn_vals[camera_num] = camera_urn;
+    if (not batch_camera_uthn_vals[camera_num].has_value())
+      batch_camera_uthn_vals[camera_num] = camera_uthn;
+    if (not batch_camera_uphn_vals[camera_num].has_value())
+      batch_camera_uphn_vals[camera_num] = camera_uphn;
+    if (not batch_camera_k_r_vals[camera_num].has_value())
+      batch_camera_k_r_vals[camera_num] = camera_k_r;
+    if (not batch_camera_k_th_vals[camera_num].has_value())
+      batch_camera_k_th_vals[camera_num] = camera_k_th;
+    if (not batch_camera_k_ph_vals[camera_num].has_value())
+      batch_camera_k_ph_vals[camera_num] = camera_k_ph;
+    if (not batch_camera_rotation_vals[camera_num].has_value())
+      batch_camera_rotation_vals[camera_num] = camera_rotation;
+    if (not batch_camera_width_vals[camera_num].has_value())
+      batch_camera_width_vals[camera_num] = camera_width;
+    if (not batch_camera_files[camera_num].has_value())
+      batch_camera_files[camera_num] = output_file;
+    if (not batch_camera_geodesic_files[camera_num].has_value())
+      batch_camera_geodesic_files[camera_num] = checkpoint_geodesic_file;
+    if (not batch_camera_sample_files[camera_num].has_value())
+      batch_camera_sample_files[camera_num] = checkpoint_sample_file;
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for making one batch camera the active camera
+// Inputs:
+//   camera_num: index (0-indexed) of camera to use
+// Outputs: (none)
+// Notes:
+//   Overwrites camera_*, output_file, and checkpoint file values with those of the given camera, so
+//       that objects constructed afterward see that camera.
+//   Does nothing if batch_num_cameras is not set.
+void InputReader::SelectBatchCamera(int camera_num)
+{
+  if (not batch_num_cameras.has_value())
+    return;
+  camera_r = batch_camera_r_vals[camera_num];
+  camera_th = batch_camera_th_vals[camera_num];
+  camera_pole = batch_camera_poles[camera_num];
+  camera_ph = batch_camera_ph_vals[camera_num];
+  camera_urn = batch_camera_urn_vals[camera_num];
+  camera_uthn = batch_camera_uthn_vals[camera_num];
+  camera_uphn = batch_camera_uphn_vals[camera_num];
+  camera_k_r = batch_camera_k_r_vals[camera_num];
+  camera_k_th = batch_camera_k_th_vals[camera_num];
+  camera_k_ph = batch_camera_k_ph_vals[camera_num];
+  camera_rotation = batch_camera_rotation_vals[camera_num];
+  camera_width = batch_camera_width_vals[camera_num];
+  output_file = batch_camera_files[camera_num];
+  checkpoint_geodesic_file = batch_camera_geodesic_files[camera_num];
+  checkpoint_sample_file = batch_camera_sample_files[camera_num];
+  return;
+}
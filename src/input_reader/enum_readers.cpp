@@ -31,6 +31,51 @@ ModelType InputReader::ReadModelType(const std::string &string)
 
 //--------------------------------------------------------------------------------------------------
 
+// Function for interpreting strings as ParallelSchedule enums
+// Inputs:
+//   string: string to be interpreted
+// Outputs:
+//   returned value: valid ParallelSchedule
+// Notes:
+//   Valid options:
+//     "static": pixels divided evenly among threads ahead of time
+//     "dynamic": chunks of pixels handed to threads as they become idle
+//     "guided": like dynamic, but with chunk sizes decreasing as work runs out
+ParallelSchedule InputReader::ReadParallelSchedule(const std::string &string)
+{
+  if (string == "static")
+    return ParallelSchedule::static_;
+  else if (string == "dynamic")
+    return ParallelSchedule::dynamic;
+  else if (string == "guided")
+    return ParallelSchedule::guided;
+  else
+    throw BlacklightException("Unknown string used for ParallelSchedule value.");
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for interpreting strings as ParallelDistribute enums
+// Inputs:
+//   string: string to be interpreted
+// Outputs:
+//   returned value: valid ParallelDistribute
+// Notes:
+//   Valid options:
+//     "pixels": each MPI rank integrates a contiguous band of the image for every snapshot
+//     "snapshots": each MPI rank integrates the full image for a subset of snapshots
+ParallelDistribute InputReader::ReadParallelDistribute(const std::string &string)
+{
+  if (string == "pixels")
+    return ParallelDistribute::pixels;
+  else if (string == "snapshots")
+    return ParallelDistribute::snapshots;
+  else
+    throw BlacklightException("Unknown string used for ParallelDistribute value.");
+}
+
+//--------------------------------------------------------------------------------------------------
+
 // Function for interpreting strings as OutputFormat enums
 // Inputs:
 //   string: string to be interpreted
@@ -82,6 +127,31 @@ SimulationFormat InputReader::ReadSimulationFormat(const std::string &string)
 
 //--------------------------------------------------------------------------------------------------
 
+// Function for interpreting strings as PrimitivePrecision enums
+// Inputs:
+//   string: string to be interpreted
+// Outputs:
+//   returned value: valid PrimitivePrecision
+// Notes:
+//   Valid options:
+//     "single": 4-byte floats as read
+//     "bf16": upper 2 bytes of each float, rounded
+//     "scaled16": 2-byte integers scaled to range of each variable in each block, logarithmically
+//         for density and pressure
+PrimitivePrecision InputReader::ReadPrimitivePrecision(const std::string &string)
+{
+  if (string == "single")
+    return PrimitivePrecision::single;
+  else if (string == "bf16")
+    return PrimitivePrecision::bf16;
+  else if (string == "scaled16")
+    return PrimitivePrecision::scaled16;
+  else
+    throw BlacklightException("Unknown string used for PrimitivePrecision value.");
+}
+
+//--------------------------------------------------------------------------------------------------
+
 // Function for interpreting strings as Coordinates enums
 // Inputs:
 //   string: string to be interpreted
@@ -12,7 +12,7 @@
 // Blacklight headers
 #include "input_reader.hpp"
 #include "../blacklight.hpp"        // Math, enums
-#include "../utils/exceptions.hpp"  // BlacklightException
+#include "../utils/exceptions.hpp"  // BlacklightException, BlacklightWarning
 #include "../utils/cnpy.h"          // numpy io
 
 // Instantiations
@@ -62,6 +62,37 @@ InputReader::~InputReader()
   delete[] adaptive_region_x_max_vals;
   delete[] adaptive_region_y_min_vals;
   delete[] adaptive_region_y_max_vals;
+  delete[] batch_camera_r_vals;
+  delete[] batch_camera_th_vals;
+  delete[] batch_camera_ph_vals;
+  delete[] batch_camera_urn_vals;
+  delete[] batch_camera_uthn_vals;
+  delete[] batch_camera_uphn_vals;
+  delete[] batch_camera_k_r_vals;
+  delete[] batch_camera_k_th_vals;
+  delete[] batch_camera_k_ph_vals;
+  delete[] batch_camera_rotation_vals;
+  delete[] batch_camera_width_vals;
+  delete[] batch_camera_poles;
+  delete[] batch_camera_files;
+  delete[] batch_camera_geodesic_files;
+  delete[] batch_camera_sample_files;
+  delete[] sweep_model_rho_cgs_vals;
+  delete[] sweep_model_rat_low_vals;
+  delete[] sweep_model_rat_high_vals;
+  delete[] sweep_model_power_frac_vals;
+  delete[] sweep_model_kappa_frac_vals;
+  delete[] sweep_model_kappa_vals;
+  delete[] sweep_model_formula_r0_vals;
+  delete[] sweep_model_formula_h_vals;
+  delete[] sweep_model_formula_l0_vals;
+  delete[] sweep_model_formula_q_vals;
+  delete[] sweep_model_formula_nup_vals;
+  delete[] sweep_model_formula_cn0_vals;
+  delete[] sweep_model_formula_alpha_vals;
+  delete[] sweep_model_formula_a_vals;
+  delete[] sweep_model_formula_beta_vals;
+  delete[] sweep_model_files;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -80,30 +111,30 @@ int InputReader::Read()
   // Process file line by line
   for (std::string line; std::getline(input_stream, line); )
   {
-    // Remove spaces
-    line.erase(std::remove_if(line.begin(), line.end(), RemoveableSpace), line.end());
-
-    // Remove comments
-    std::string::size_type pos = line.find('#');
-    if (pos != std::string::npos)
-      line.erase(pos);
-
-    // Skip blank lines
-    if (line.empty())
+    // Split line into key and value, skipping blank lines
+    std::string key, val;
+    if (not ReadAssignment(line, &key, &val))
       continue;
 
-    // Split on '='
-    pos = line.find('=');
-    if (pos == std::string::npos)
-      throw BlacklightException("Invalid assignment in input file.");
-    std::string key = line.substr(0, pos);
-    std::string val = line.substr(pos + 1, line.size());
-
     // Store general data
     if (key == "model_type")
       model_type = ReadModelType(val);
     else if (key == "num_threads")
       num_threads = std::stoi(val);
+    else if (key == "parallel_schedule")
+      parallel_schedule = ReadParallelSchedule(val);
+    else if (key == "parallel_chunk")
+      parallel_chunk = std::stoi(val);
+    else if (key == "parallel_distribute")
+      parallel_distribute = ReadParallelDistribute(val);
+    else if (key == "memory_reuse")
+      memory_reuse = ReadBool(val);
+    else if (key == "memory_huge_pages")
+      memory_huge_pages = ReadBool(val);
+    else if (key == "memory_limit")
+      memory_limit = std::stod(val);
+    else if (key == "memory_plan")
+      memory_plan = ReadBool(val);
 
     // Store custom pixel allocation parameters
     else if (key == "custom_pixels")
@@ -116,6 +147,20 @@ int InputReader::Read()
       output_file = val;
     else if (key == "output_camera")
       output_camera = ReadBool(val);
+    else if (key == "output_compression")
+      output_compression = ReadBool(val);
+    else if (key == "output_async")
+      output_async = ReadBool(val);
+    else if (key == "output_append")
+      output_append = ReadBool(val);
+
+    // Store profiling parameters
+    else if (key == "profile_on")
+      profile_on = ReadBool(val);
+    else if (key == "profile_file")
+      profile_file = val;
+    else if (key == "profile_trace_file")
+      profile_trace_file = val;
 
     // Store checkpoint parameters
     else if (key == "checkpoint_geodesic_save")
@@ -142,6 +187,12 @@ int InputReader::Read()
       simulation_start = std::stoi(val);
     else if (key == "simulation_end")
       simulation_end = std::stoi(val);
+    else if (key == "simulation_prefetch")
+      simulation_prefetch = ReadBool(val);
+    else if (key == "simulation_block_select")
+      simulation_block_select = ReadBool(val);
+    else if (key == "simulation_sks_map_file")
+      simulation_sks_map_file = val;
     else if (key == "simulation_coord")
       simulation_coord = ReadCoordinates(val);
     else if (key == "simulation_a")
@@ -156,6 +207,12 @@ int InputReader::Read()
       simulation_interp = ReadBool(val);
     else if (key == "simulation_block_interp")
       simulation_block_interp = ReadBool(val);
+    else if (key == "simulation_geom_cache")
+      simulation_geom_cache = ReadBool(val);
+    else if (key == "simulation_fused_coeffs")
+      simulation_fused_coeffs = ReadBool(val);
+    else if (key == "simulation_precision")
+      simulation_precision = ReadPrimitivePrecision(val);
 
     // Store formula parameters
     else if (key == "formula_mass")
@@ -209,6 +266,12 @@ int InputReader::Read()
     else if (key == "camera_resolution")
       camera_resolution = std::stoi(val);
 
+    // Store batch parameters
+    else if (key == "batch_num_cameras")
+      ReadBatch(key.substr(6), val);
+    else if (key.compare(0, 13, "batch_camera_") == 0)
+      ReadBatch(key.substr(13), val);
+
     // Store ray-tracing parameters
     else if (key == "ray_flat")
       ray_flat = ReadBool(val);
@@ -228,6 +291,14 @@ int InputReader::Read()
       ray_tol_abs = std::stod(val);
     else if (key == "ray_tol_rel")
       ray_tol_rel = std::stod(val);
+    else if (key == "ray_packet_size")
+      ray_packet_size = std::stoi(val);
+    else if (key == "ray_streaming")
+      ray_streaming = ReadBool(val);
+    else if (key == "ray_offload")
+      ray_offload = ReadBool(val);
+    else if (key == "ray_sample_float")
+      ray_sample_float = ReadBool(val);
 
     // Store image parameters
     else if (key == "image_light")
@@ -248,6 +319,8 @@ int InputReader::Read()
       image_polarization = ReadBool(val);
     else if (key == "image_rotation_split")
       image_rotation_split = ReadBool(val);
+    else if (key == "image_stokes_transport")
+      image_stokes_transport = ReadBool(val);
     else if (key == "image_time")
       image_time = ReadBool(val);
     else if (key == "image_length")
@@ -294,6 +367,12 @@ int InputReader::Read()
       adaptive_max_level = std::stoi(val);
     else if (key == "adaptive_block_size")
       adaptive_block_size = std::stoi(val);
+    else if (key == "adaptive_reuse_rays")
+      adaptive_reuse_rays = ReadBool(val);
+    else if (key == "adaptive_reuse_ratio")
+      adaptive_reuse_ratio = std::stod(val);
+    else if (key == "adaptive_reuse_angle")
+      adaptive_reuse_angle = std::stod(val);
     else if (key == "adaptive_frequency_num")
       adaptive_frequency_num = std::stoi(val);
     else if (key == "adaptive_val_cut")
@@ -316,6 +395,12 @@ int InputReader::Read()
       adaptive_rel_lapl_cut = std::stod(val);
     else if (key == "adaptive_rel_lapl_frac")
       adaptive_rel_lapl_frac = std::stod(val);
+    else if (key == "adaptive_progressive")
+      adaptive_progressive = ReadBool(val);
+    else if (key == "adaptive_time_budget")
+      adaptive_time_budget = std::stod(val);
+    else if (key == "adaptive_ray_budget")
+      adaptive_ray_budget = std::stoi(val);
     else if (key == "adaptive_num_regions")
       ReadAdaptive(key.substr(9), val);
     else if (key.compare(0, 16, "adaptive_region_") == 0)
@@ -354,6 +439,16 @@ int InputReader::Read()
       plasma_kappa = std::stod(val);
     else if (key == "plasma_w")
       plasma_w = std::stod(val);
+    else if (key == "plasma_table")
+      plasma_table = ReadBool(val);
+    else if (key == "plasma_table_file")
+      plasma_table_file = val;
+
+    // Store sweep parameters
+    else if (key == "sweep_num_models")
+      ReadSweep(key.substr(6), val);
+    else if (key.compare(0, 12, "sweep_model_") == 0)
+      ReadSweep(key.substr(12), val);
 
     // Store cut parameters
     else if (key == "cut_rho_min")
@@ -404,6 +499,8 @@ int InputReader::Read()
       ReadTriple(val, &cut_plane_normal_x, &cut_plane_normal_y, &cut_plane_normal_z);
     else if (key == "cut_z_turnings")
       cut_z_turnings = std::stoi(val);
+    else if (key == "cut_tau_max")
+      cut_tau_max = std::stod(val);
 
     // Store fallback parameters
     else if (key == "fallback_nan")
@@ -415,6 +512,14 @@ int InputReader::Read()
     else if (key == "fallback_kappa")
       fallback_kappa = std::stof(val);
 
+    // Store server parameters
+    else if (key == "server_on")
+      server_on = ReadBool(val);
+    else if (key == "server_job_dir")
+      server_job_dir = val;
+    else if (key == "server_poll")
+      server_poll = std::stod(val);
+
     // Handle unknown entry
     else
     {
@@ -424,6 +529,26 @@ int InputReader::Read()
     }
   }
 
+  // Complete batch camera parameters
+  if (batch_num_cameras.has_value())
+    SetBatchDefaults();
+
+  // Complete plasma sweep parameters
+  if (sweep_num_models.has_value())
+    SetSweepDefaults();
+
+  // Divide work among ranks, estimate memory, and divide image into tiles
+  PlanDistribution();
+  PlanMemory();
+
+  // Check progressive refinement
+  if (adaptive_progressive.has_value() and adaptive_progressive.value()
+      and not (adaptive_max_level.has_value() and adaptive_max_level.value() > 0))
+  {
+    BlacklightWarning("Ignoring adaptive_progressive selection.");
+    adaptive_progressive = false;
+  }
+
   // Count number of runs to do
   int num_runs = 1;
   if (model_type.value() == ModelType::simulation and simulation_multiple.value())
@@ -433,11 +558,52 @@ int InputReader::Read()
     else
       num_runs = simulation_end.value() - simulation_start.value() + 1;
   }
+
+  // Check server parameters
+  server_num_runs = num_runs;
+  if (server_on.has_value() and server_on.value())
+    SetServerDefaults();
   return num_runs;
 }
 
 //--------------------------------------------------------------------------------------------------
 
+// Function for splitting a line of an input file into key and value
+// Inputs:
+//   line: line of file
+// Outputs:
+//   returned value: flag indicating line contains an assignment
+//   *p_key: key, if line contains an assignment
+//   *p_val: value, if line contains an assignment
+// Notes:
+//   Removes all spaces and anything after '#'.
+//   Returns false for lines that are then empty, and throws an exception for other lines without
+//       '='.
+bool InputReader::ReadAssignment(std::string line, std::string *p_key, std::string *p_val)
+{
+  // Remove spaces
+  line.erase(std::remove_if(line.begin(), line.end(), RemoveableSpace), line.end());
+
+  // Remove comments
+  std::string::size_type pos = line.find('#');
+  if (pos != std::string::npos)
+    line.erase(pos);
+
+  // Skip blank lines
+  if (line.empty())
+    return false;
+
+  // Split on '='
+  pos = line.find('=');
+  if (pos == std::string::npos)
+    throw BlacklightException("Invalid assignment in input file.");
+  *p_key = line.substr(0, pos);
+  *p_val = line.substr(pos + 1, line.size());
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+
 // Definition of what constitutes a space
 // Inputs:
 //   c: character to be tested
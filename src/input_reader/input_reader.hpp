@@ -28,6 +28,13 @@ struct InputReader
   // Data - general
   std::optional<ModelType> model_type;
   std::optional<int> num_threads;
+  std::optional<ParallelSchedule> parallel_schedule;
+  std::optional<int> parallel_chunk;
+  std::optional<ParallelDistribute> parallel_distribute;
+  std::optional<bool> memory_reuse;
+  std::optional<bool> memory_huge_pages;
+  std::optional<double> memory_limit;
+  std::optional<bool> memory_plan;
 
   // Data - custom pixel allocation
   std::optional<cnpy::npz_t> custom_pixels;
@@ -36,6 +43,14 @@ struct InputReader
   std::optional<OutputFormat> output_format;
   std::optional<std::string> output_file;
   std::optional<bool> output_camera;
+  std::optional<bool> output_compression;
+  std::optional<bool> output_async;
+  std::optional<bool> output_append;
+
+  // Data - profiling parameters
+  std::optional<bool> profile_on;
+  std::optional<std::string> profile_file;
+  std::optional<std::string> profile_trace_file;
 
   // Data - checkpoint parameters
   std::optional<bool> checkpoint_geodesic_save;
@@ -51,6 +66,9 @@ struct InputReader
   std::optional<bool> simulation_multiple;
   std::optional<int> simulation_start;
   std::optional<int> simulation_end;
+  std::optional<bool> simulation_prefetch;
+  std::optional<bool> simulation_block_select;
+  std::optional<std::string> simulation_sks_map_file;
   std::optional<Coordinates> simulation_coord;
   std::optional<double> simulation_a;
   std::optional<double> simulation_m_msun;
@@ -58,6 +76,9 @@ struct InputReader
   std::optional<std::string> simulation_kappa_name;
   std::optional<bool> simulation_interp;
   std::optional<bool> simulation_block_interp;
+  std::optional<bool> simulation_geom_cache;
+  std::optional<bool> simulation_fused_coeffs;
+  std::optional<PrimitivePrecision> simulation_precision;
 
   // Data - formula parameters
   std::optional<double> formula_mass;
@@ -88,6 +109,24 @@ struct InputReader
   std::optional<int> camera_resolution;
   std::optional<bool> camera_pole;
 
+  // Data - batch parameters
+  std::optional<int> batch_num_cameras;
+  std::optional<double> *batch_camera_r_vals = nullptr;
+  std::optional<double> *batch_camera_th_vals = nullptr;
+  std::optional<double> *batch_camera_ph_vals = nullptr;
+  std::optional<double> *batch_camera_urn_vals = nullptr;
+  std::optional<double> *batch_camera_uthn_vals = nullptr;
+  std::optional<double> *batch_camera_uphn_vals = nullptr;
+  std::optional<double> *batch_camera_k_r_vals = nullptr;
+  std::optional<double> *batch_camera_k_th_vals = nullptr;
+  std::optional<double> *batch_camera_k_ph_vals = nullptr;
+  std::optional<double> *batch_camera_rotation_vals = nullptr;
+  std::optional<double> *batch_camera_width_vals = nullptr;
+  std::optional<bool> *batch_camera_poles = nullptr;
+  std::optional<std::string> *batch_camera_files = nullptr;
+  std::optional<std::string> *batch_camera_geodesic_files = nullptr;
+  std::optional<std::string> *batch_camera_sample_files = nullptr;
+
   // Data - ray-tracing parameters
   std::optional<bool> ray_flat;
   std::optional<RayTerminate> ray_terminate;
@@ -98,6 +137,10 @@ struct InputReader
   std::optional<int> ray_max_retries;
   std::optional<double> ray_tol_abs;
   std::optional<double> ray_tol_rel;
+  std::optional<int> ray_packet_size;
+  std::optional<bool> ray_streaming;
+  std::optional<bool> ray_offload;
+  std::optional<bool> ray_sample_float;
 
   // Data - image parameters
   std::optional<bool> image_light;
@@ -109,6 +152,7 @@ struct InputReader
   std::optional<FrequencyNormalization> image_normalization;
   std::optional<bool> image_polarization;
   std::optional<bool> image_rotation_split;
+  std::optional<bool> image_stokes_transport;
   std::optional<bool> image_time;
   std::optional<bool> image_length;
   std::optional<bool> image_lambda;
@@ -146,6 +190,9 @@ struct InputReader
   // Data - adaptive parameters
   std::optional<int> adaptive_max_level;
   std::optional<int> adaptive_block_size;
+  std::optional<bool> adaptive_reuse_rays;
+  std::optional<double> adaptive_reuse_ratio;
+  std::optional<double> adaptive_reuse_angle;
   std::optional<int> adaptive_frequency_num;
   std::optional<double> adaptive_val_cut;
   std::optional<double> adaptive_val_frac;
@@ -157,6 +204,9 @@ struct InputReader
   std::optional<double> adaptive_abs_lapl_frac;
   std::optional<double> adaptive_rel_lapl_cut;
   std::optional<double> adaptive_rel_lapl_frac;
+  std::optional<bool> adaptive_progressive;
+  std::optional<double> adaptive_time_budget;
+  std::optional<int> adaptive_ray_budget;
   std::optional<int> adaptive_num_regions;
   std::optional<int> *adaptive_region_levels = nullptr;
   std::optional<double> *adaptive_region_x_min_vals = nullptr;
@@ -181,6 +231,40 @@ struct InputReader
   std::optional<double> plasma_kappa_frac;
   std::optional<double> plasma_kappa;
   std::optional<double> plasma_w;
+  std::optional<bool> plasma_table;
+  std::optional<std::string> plasma_table_file;
+
+  // Data - sweep parameters
+  std::optional<int> sweep_num_models;
+  std::optional<double> *sweep_model_rho_cgs_vals = nullptr;
+  std::optional<double> *sweep_model_rat_low_vals = nullptr;
+  std::optional<double> *sweep_model_rat_high_vals = nullptr;
+  std::optional<double> *sweep_model_power_frac_vals = nullptr;
+  std::optional<double> *sweep_model_kappa_frac_vals = nullptr;
+  std::optional<double> *sweep_model_kappa_vals = nullptr;
+  std::optional<double> *sweep_model_formula_r0_vals = nullptr;
+  std::optional<double> *sweep_model_formula_h_vals = nullptr;
+  std::optional<double> *sweep_model_formula_l0_vals = nullptr;
+  std::optional<double> *sweep_model_formula_q_vals = nullptr;
+  std::optional<double> *sweep_model_formula_nup_vals = nullptr;
+  std::optional<double> *sweep_model_formula_cn0_vals = nullptr;
+  std::optional<double> *sweep_model_formula_alpha_vals = nullptr;
+  std::optional<double> *sweep_model_formula_a_vals = nullptr;
+  std::optional<double> *sweep_model_formula_beta_vals = nullptr;
+  std::optional<std::string> *sweep_model_files = nullptr;
+
+  // Data - distribution parameters
+  std::optional<bool> distribute_snapshots;
+  std::optional<bool> distribute_geodesic_checkpoint;
+
+  // Data - tile parameters
+  std::optional<int> memory_num_pix;
+  std::optional<int> memory_num_tiles;
+  std::optional<int> memory_tile_num_pix;
+  std::optional<int> tile_rank_pix_start;
+  std::optional<int> tile_rank_num_pix;
+  std::optional<int> tile_pix_start;
+  std::optional<int> tile_num_pix;
 
   // Data - cut parameters
   std::optional<double> cut_rho_min;
@@ -211,6 +295,7 @@ struct InputReader
   std::optional<double> cut_plane_normal_y;
   std::optional<double> cut_plane_normal_z;
   std::optional<int> cut_z_turnings;
+  std::optional<double> cut_tau_max;
 
   // Data - fallback parameters
   std::optional<bool> fallback_nan;
@@ -218,10 +303,25 @@ struct InputReader
   std::optional<float> fallback_pgas;
   std::optional<float> fallback_kappa;
 
-  // External function
+  // Data - server parameters
+  std::optional<bool> server_on;
+  std::optional<std::string> server_job_dir;
+  std::optional<double> server_poll;
+  int server_num_runs = 1;
+  std::optional<int> server_job_snapshot;
+  bool server_job_stop = false;
+  bool server_job_geodesics = false;
+  bool server_job_plasma = false;
+
+  // External functions
   int Read();
+  void SelectBatchCamera(int camera_num);
+  void SelectSweepModel(int model_num);
+  void SelectTile(int tile_num);
+  void ReadServerJob(const std::string &job_file);
 
   // Internal functions - input_reader.cpp
+  static bool ReadAssignment(std::string line, std::string *p_key, std::string *p_val);
   static bool RemoveableSpace(unsigned char c);
   bool ReadBool(const std::string &string);
   template<typename type> void ReadTriple(const std::string &string, type *p_x, type *p_y,
@@ -230,8 +330,11 @@ struct InputReader
 
   // Internal functions - enum_readers.cpp
   ModelType ReadModelType(const std::string &string);
+  ParallelSchedule ReadParallelSchedule(const std::string &string);
+  ParallelDistribute ReadParallelDistribute(const std::string &string);
   OutputFormat ReadOutputFormat(const std::string &string);
   SimulationFormat ReadSimulationFormat(const std::string &string);
+  PrimitivePrecision ReadPrimitivePrecision(const std::string &string);
   Coordinates ReadCoordinates(const std::string &string);
   Camera ReadCamera(const std::string &string);
   RayTerminate ReadRayTerminate(const std::string &string);
@@ -245,6 +348,23 @@ struct InputReader
 
   // Internal functions - adaptive_reader.cpp
   void ReadAdaptive(const std::string &key, const std::string &val);
+
+  // Internal functions - batch_reader.cpp
+  void ReadBatch(const std::string &key, const std::string &val);
+  void SetBatchDefaults();
+
+  // Internal functions - sweep_reader.cpp
+  void ReadSweep(const std::string &key, const std::string &val);
+  void SetSweepDefaults();
+
+  // Internal functions - server_reader.cpp
+  void SetServerDefaults();
+  std::optional<double> *ServerJobValue(const std::string &key, bool *p_geodesics);
+  bool ServerOutputFileValid(const std::string &file) const;
+
+  // Internal functions - memory_planner.cpp
+  void PlanDistribution();
+  void PlanMemory();
 };
 
 #endif
@@ -0,0 +1,321 @@
+// Blacklight input reader - memory planner
+
+// C++ headers
+#include <algorithm>  // max, min
+#include <cstddef>    // size_t
+#include <iomanip>    // setprecision
+#include <iostream>   // cout
+#include <optional>   // optional
+
+// Blacklight headers
+#include "input_reader.hpp"
+#include "../blacklight.hpp"           // SampleGeometry, SampleValues, enums
+#include "../utils/communication.hpp"  // CommRank, CommSize
+#include "../utils/exceptions.hpp"     // BlacklightException, BlacklightWarning
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for checking optional flags
+// Inputs:
+//   flag: optional flag from input file
+// Outputs:
+//   returned value: true only if flag is present and set
+static bool FlagSet(const std::optional<bool> &flag)
+{
+  return flag.has_value() and flag.value();
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for dividing snapshots among ranks
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Does nothing unless there are multiple ranks and parallel_distribute is snapshots.
+//   Each rank takes every CommSize()-th run, writing its own output files.
+//   With checkpoint_geodesic_save, only rank 0 integrates and saves geodesics, with other ranks
+//       loading them once it has finished.
+//   Sets distribute_snapshots and distribute_geodesic_checkpoint in this case.
+void InputReader::PlanDistribution()
+{
+  // Check whether snapshots are distributed
+  if (CommSize() == 1 or not parallel_distribute.has_value()
+      or parallel_distribute.value() != ParallelDistribute::snapshots)
+    return;
+
+  // Check compatibility with other options
+  if (model_type.value() != ModelType::simulation or not simulation_multiple.value())
+    throw BlacklightException("Must have simulation_multiple to distribute snapshots.");
+  if (FlagSet(output_append))
+    throw BlacklightException("Cannot distribute snapshots with output_append.");
+  if (FlagSet(checkpoint_sample_save))
+    throw BlacklightException("Cannot distribute snapshots with checkpoint_sample_save.");
+
+  // Share geodesic checkpoint
+  distribute_snapshots = true;
+  distribute_geodesic_checkpoint = FlagSet(checkpoint_geodesic_save);
+  if (distribute_geodesic_checkpoint.value() and CommRank() > 0)
+  {
+    checkpoint_geodesic_save = false;
+    checkpoint_geodesic_load = true;
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for estimating memory use and dividing image among ranks and into tiles
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Does nothing unless memory_limit or memory_plan is set, or there are multiple ranks with
+//       parallel_distribute not set to snapshots.
+//   Ranks divide the image into contiguous bands of whole rows (or runs of custom pixels), which
+//       are gathered onto rank 0 for output.
+//   Estimates are upper bounds on the largest arrays allocated for each stage, assuming every ray
+//       takes ray_max_steps steps and every sample is kept. They exclude simulation data, which
+//       does not depend on the number of pixels.
+//   Arrays from sampling, coefficients, and transfer are kept until the end of the calculation,
+//       sharing memory only with the geodesic samples, while the geodesic scratch arrays are freed
+//       once rays have been reversed.
+//   If the estimate for the pixels of a rank exceeds a positive memory_limit (in GB), its band is
+//       split into contiguous tiles of whole rows where possible, each small enough to be
+//       integrated within the limit alongside the full output image.
+//   Sets memory_num_pix, memory_num_tiles, memory_tile_num_pix, tile_rank_pix_start, and
+//       tile_rank_num_pix if there is more than one tile or rank, and selects the first tile.
+void InputReader::PlanMemory()
+{
+  // Check whether planning is requested
+  int num_ranks = CommSize();
+  bool rank_split = num_ranks > 1 and (not parallel_distribute.has_value()
+      or parallel_distribute.value() == ParallelDistribute::pixels);
+  bool plan_report = FlagSet(memory_plan) and CommRank() == 0;
+  double limit = 0.0;
+  if (memory_limit.has_value())
+  {
+    if (memory_limit.value() < 0.0)
+      throw BlacklightException("Must have nonnegative memory_limit.");
+    limit = memory_limit.value() * 1.0e9;
+  }
+  if (not FlagSet(memory_plan) and limit == 0.0 and not rank_split)
+    return;
+
+  // Determine problem size
+  bool simulation = model_type.value() == ModelType::simulation;
+  long int num_pix_long = static_cast<long int>(camera_resolution.value())
+      * static_cast<long int>(camera_resolution.value());
+  if (custom_pixels.has_value())
+    num_pix_long = static_cast<long int>(custom_pixels.value().at("x_all").num_vals);
+  double num_pix_total = static_cast<double>(num_pix_long);
+
+  // Divide image among ranks
+  long int rank_pix_start = 0;
+  long int rank_num_pix = num_pix_long;
+  if (rank_split)
+  {
+    long int row_length = custom_pixels.has_value() ? 1 : camera_resolution.value();
+    long int num_rows = num_pix_long / row_length;
+    if (num_rows < num_ranks)
+      throw BlacklightException("Must have at least one image row per rank.");
+    long int rank = CommRank();
+    long int row_start = num_rows * rank / num_ranks;
+    long int row_end = num_rows * (rank + 1) / num_ranks;
+    rank_pix_start = row_start * row_length;
+    rank_num_pix = (row_end - row_start) * row_length;
+  }
+  double num_pix = static_cast<double>(rank_num_pix);
+  double num_steps = static_cast<double>(ray_max_steps.value());
+  double num_freq = static_cast<double>(image_num_frequencies.value());
+  double num_threads_used = static_cast<double>(num_threads.value());
+  double num_lanes = 1.0;
+  if (ray_integrator.value() == RayIntegrator::dp and ray_packet_size.has_value())
+    num_lanes = static_cast<double>(ray_packet_size.value());
+  int num_renders = render_num_images.value();
+  bool polarized = simulation and image_light.value() and image_polarization.value();
+  bool slow = simulation and slow_light_on.value();
+
+  // Estimate geodesic memory, with scratch arrays and reversed samples existing together
+  const double double_size = static_cast<double>(sizeof(double));
+  const double float_size = static_cast<double>(sizeof(float));
+  const double int_size = static_cast<double>(sizeof(int));
+  double bytes_camera = 9.0 * double_size + static_cast<double>(sizeof(bool)) + int_size;
+  double bytes_ray = 9.0 * double_size * num_steps;
+  double geodesic_pix = bytes_camera + 2.0 * bytes_ray;
+  double geodesic_fixed = num_threads_used * num_lanes * bytes_ray;
+  double kept_pix = bytes_camera + (FlagSet(ray_sample_float) ? 0.5 : 1.0) * bytes_ray;
+
+  // Estimate sampling memory
+  double sampling_pix = int_size;
+  if (simulation)
+  {
+    bool interp = simulation_interp.value();
+    double num_inds = slow ? 5.0 : 4.0;
+    if ((simulation_format.value() == SimulationFormat::athena
+        or simulation_format.value() == SimulationFormat::athenak) and interp
+        and simulation_block_interp.value())
+      num_inds *= 8.0;
+    double num_fracs = (interp ? 3.0 : 0.0) + (slow and slow_interp.value() ? 1.0 : 0.0);
+    double num_prim = SampleValues::kappa;
+    if (plasma_model.value() == PlasmaModel::code_kappa)
+      num_prim += 1.0;
+    double bytes_record = 1.0 + int_size * num_inds + double_size * num_fracs
+        + float_size * num_prim;
+    if (FlagSet(simulation_geom_cache))
+      bytes_record += double_size * SampleGeometry::num_sample_geometry;
+    sampling_pix += bytes_record * num_steps;
+  }
+
+  // Estimate coefficient memory, which is only needed per thread when fused with integration
+  double num_coeffs = 0.0;
+  if (image_light.value() or image_emission.value() or image_emission_ave.value())
+    num_coeffs += 1.0;
+  if (image_light.value() or image_tau.value() or image_tau_int.value())
+    num_coeffs += 1.0;
+  if (polarized)
+    num_coeffs += 6.0;
+  double bytes_coeff = double_size * num_freq * num_coeffs;
+  if (simulation and (image_lambda_ave.value() or image_emission_ave.value()
+      or image_tau_int.value() or num_renders > 0))
+    bytes_coeff += double_size * CellValues::num_cell_values;
+  if (simulation and num_renders > 0)
+    bytes_coeff += double_size;
+  double coefficient_pix = 0.0;
+  double coefficient_fixed = 0.0;
+  if (simulation and not FlagSet(simulation_fused_coeffs))
+    coefficient_pix = bytes_coeff * num_steps;
+  else
+    coefficient_fixed = num_threads_used * bytes_coeff * num_steps;
+
+  // Estimate transfer memory
+  double num_images = 0.0;
+  if (image_light.value())
+    num_images += num_freq * (polarized ? 4.0 : 1.0);
+  if (image_time.value())
+    num_images += 1.0;
+  if (image_length.value())
+    num_images += 1.0;
+  if (image_lambda.value())
+    num_images += num_freq;
+  if (image_emission.value())
+    num_images += num_freq;
+  if (image_tau.value())
+    num_images += num_freq;
+  if (image_lambda_ave.value())
+    num_images += num_freq * CellValues::num_cell_values;
+  if (image_emission_ave.value())
+    num_images += num_freq * CellValues::num_cell_values;
+  if (image_tau_int.value())
+    num_images += num_freq * CellValues::num_cell_values;
+  if (image_crossings.value())
+    num_images += 1.0;
+  if (image_z_turnings.value())
+    num_images += 1.0;
+  double transfer_pix = double_size * (num_images + 3.0 * num_renders);
+
+  // Estimate memory for copies of images held by output writer
+  double output_pix = transfer_pix;
+  if (FlagSet(output_camera))
+    output_pix += 4.0 * double_size;
+
+  // Calculate peak for untiled image
+  double tile_pix = std::max(geodesic_pix,
+      kept_pix + sampling_pix + coefficient_pix + transfer_pix);
+  double tile_fixed = geodesic_fixed + coefficient_fixed;
+  bool output_copied = FlagSet(output_async) or rank_split;
+  double peak = tile_fixed + num_pix * tile_pix
+      + (output_copied ? num_pix_total * output_pix : 0.0);
+
+  // Divide image into tiles
+  int num_tiles = 1;
+  double tile_size = num_pix;
+  if (limit > 0.0 and peak > limit)
+  {
+    double available = limit - tile_fixed - num_pix_total * output_pix;
+    tile_size = available > 0.0 ? static_cast<double>(static_cast<long int>(available
+        / tile_pix)) : 0.0;
+    if (tile_size < 1.0)
+      throw BlacklightException("Must have larger memory_limit to hold image.");
+    double row_length = static_cast<double>(camera_resolution.value());
+    if (not custom_pixels.has_value() and tile_size >= row_length)
+      tile_size = row_length * static_cast<double>(static_cast<long int>(tile_size
+          / row_length));
+    num_tiles = static_cast<int>((rank_num_pix + static_cast<long int>(tile_size) - 1)
+        / static_cast<long int>(tile_size));
+    output_copied = true;
+    peak = tile_fixed + tile_size * tile_pix + num_pix_total * output_pix;
+  }
+
+  // Report estimates
+  if (plan_report)
+  {
+    double geodesic_bytes = geodesic_fixed + tile_size * geodesic_pix;
+    double sampling_bytes = tile_size * sampling_pix;
+    double coefficient_bytes = coefficient_fixed + tile_size * coefficient_pix;
+    double transfer_bytes = tile_size * transfer_pix;
+    double output_bytes = output_copied ? num_pix_total * output_pix : 0.0;
+    std::cout << std::setprecision(4);
+    std::cout << "Estimated memory for " << static_cast<long int>(tile_size) << " pixels";
+    std::cout << " (upper bounds excluding simulation data):\n";
+    std::cout << "  Geodesics:    " << geodesic_bytes / 1.0e9 << " GB\n";
+    std::cout << "  Sampling:     " << sampling_bytes / 1.0e9 << " GB\n";
+    std::cout << "  Coefficients: " << coefficient_bytes / 1.0e9 << " GB\n";
+    std::cout << "  Transfer:     " << transfer_bytes / 1.0e9 << " GB\n";
+    std::cout << "  Output:       " << output_bytes / 1.0e9 << " GB\n";
+    std::cout << "  Peak:         " << peak / 1.0e9 << " GB\n";
+  }
+  if (num_tiles == 1 and not rank_split)
+    return;
+  if (CommRank() == 0 and rank_split)
+    std::cout << "Dividing image among " << num_ranks << " ranks.\n";
+  if (CommRank() == 0 and num_tiles > 1)
+  {
+    std::cout << "Dividing image" << (rank_split ? " band" : "") << " into " << num_tiles;
+    std::cout << " tiles of up to " << static_cast<long int>(tile_size) << " pixels.\n";
+  }
+
+  // Check compatibility with other options
+  if (adaptive_max_level.value() > 0)
+    throw BlacklightException("Cannot divide image with adaptive ray tracing.");
+  if (batch_num_cameras.has_value() and batch_num_cameras.value() > 1)
+    throw BlacklightException("Cannot divide image with more than one batch camera.");
+  if (sweep_num_models.has_value() and sweep_num_models.value() > 1)
+    throw BlacklightException("Cannot divide image with more than one sweep model.");
+  if (FlagSet(checkpoint_geodesic_save) or FlagSet(checkpoint_geodesic_load)
+      or FlagSet(checkpoint_sample_save) or FlagSet(checkpoint_sample_load))
+    throw BlacklightException("Cannot divide image with checkpoints.");
+  if (simulation and num_tiles > 1 and FlagSet(simulation_block_select))
+  {
+    BlacklightWarning("Ignoring simulation_block_select selection.");
+    simulation_block_select = false;
+  }
+
+  // Record tiles and select first one
+  memory_num_pix = static_cast<int>(num_pix_long);
+  memory_num_tiles = num_tiles;
+  memory_tile_num_pix = static_cast<int>(tile_size);
+  tile_rank_pix_start = static_cast<int>(rank_pix_start);
+  tile_rank_num_pix = static_cast<int>(rank_num_pix);
+  SelectTile(0);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for making one image tile the active tile
+// Inputs:
+//   tile_num: index (0-indexed) of tile to use
+// Outputs: (none)
+// Notes:
+//   Sets tile_pix_start and tile_num_pix to the range of pixels covered by the given tile of this
+//       rank's band, so that objects constructed afterward integrate only that range.
+//   Does nothing if memory_num_tiles is not set.
+void InputReader::SelectTile(int tile_num)
+{
+  if (not memory_num_tiles.has_value())
+    return;
+  int pix_start = tile_rank_pix_start.value() + tile_num * memory_tile_num_pix.value();
+  int pix_end = tile_rank_pix_start.value() + tile_rank_num_pix.value();
+  tile_pix_start = pix_start;
+  tile_num_pix = std::min(memory_tile_num_pix.value(), pix_end - pix_start);
+  return;
+}
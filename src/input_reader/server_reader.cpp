@@ -0,0 +1,243 @@
+// Blacklight input reader - server job reader
+
+// C++ headers
+#include <cstddef>   // size_t
+#include <fstream>   // ifstream
+#include <optional>  // optional
+#include <sstream>   // ostringstream
+#include <string>    // getline, stod, stoi, string
+#include <vector>    // vector
+
+// Blacklight headers
+#include "input_reader.hpp"
+#include "../blacklight.hpp"           // enums
+#include "../utils/communication.hpp"  // CommSize
+#include "../utils/exceptions.hpp"     // BlacklightException
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for filling in and checking server options
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes server_on has been set to true.
+//   Server mode keeps a single camera and plasma model resident, so it cannot be combined with
+//       batch cameras, plasma sweeps, image tiles, multiple ranks, or appended output.
+void InputReader::SetServerDefaults()
+{
+  // Check parameters
+  if (not server_job_dir.has_value())
+    throw BlacklightException("Must specify server_job_dir with server_on.");
+  if (not server_poll.has_value())
+    server_poll = 1.0;
+  if (server_poll.value() <= 0.0)
+    throw BlacklightException("Must have positive server_poll.");
+
+  // Check compatibility with other options
+  if (CommSize() > 1)
+    throw BlacklightException("Cannot use server_on with more than one rank.");
+  if (batch_num_cameras.has_value() and batch_num_cameras.value() > 1)
+    throw BlacklightException("Cannot use server_on with more than one batch camera.");
+  if (sweep_num_models.has_value())
+    throw BlacklightException("Cannot use server_on with plasma sweeps.");
+  if (memory_num_tiles.has_value())
+    throw BlacklightException("Cannot use server_on with image tiles.");
+  if (output_append.has_value() and output_append.value())
+    throw BlacklightException("Cannot use server_on with output_append.");
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for reading a server job
+// Inputs:
+//   job_file: name of file containing job
+// Outputs: (none)
+// Notes:
+//   Job files have the same format as input files, but only the following keys are allowed:
+//     snapshot: index (0-indexed) of run to perform, defaulting to the previous one
+//     output_file: file to write
+//     image_frequency, or image_frequency_start and image_frequency_end
+//     simulation_rho_cgs and plasma_{rat_low,rat_high,power_frac,kappa_frac,kappa} for
+//         simulations, and formula_{r0,h,l0,q,nup,cn0,alpha,a,beta} for formulas
+//     server_stop: flag indicating server should exit without rendering
+//   Checks all assignments before changing any values, so a rejected job leaves values unchanged.
+//   Checks output_file values with ServerOutputFileValid(), so that a job whose output file name
+//       the output writer would refuse is rejected rather than failing after rendering.
+//   Overwrites the corresponding values, so that objects constructed or updated afterward see
+//       them, and later jobs start from them.
+//   Sets server_job_snapshot, server_job_stop, server_job_geodesics (any frequency changed), and
+//       server_job_plasma (any plasma or formula parameter changed).
+void InputReader::ReadServerJob(const std::string &job_file)
+{
+  // Open job file
+  std::ifstream job_stream(job_file);
+  if (not job_stream.is_open())
+    throw BlacklightException("Could not open server job file.");
+
+  // Read assignments
+  std::vector<std::string> keys;
+  std::vector<std::string> vals;
+  for (std::string line; std::getline(job_stream, line); )
+  {
+    std::string key, val;
+    if (not ReadAssignment(line, &key, &val))
+      continue;
+    keys.push_back(key);
+    vals.push_back(val);
+  }
+
+  // Check assignments
+  for (std::size_t n = 0; n < keys.size(); n++)
+  {
+    bool geodesics = false;
+    if (keys[n] == "snapshot")
+    {
+      int snapshot = std::stoi(vals[n]);
+      if (snapshot < 0 or snapshot >= server_num_runs)
+        throw BlacklightException("Server job snapshot out of range.");
+    }
+    else if (keys[n] == "server_stop")
+      ReadBool(vals[n]);
+    else if (keys[n] == "output_file")
+    {
+      if (not ServerOutputFileValid(vals[n]))
+        throw BlacklightException("Invalid output_file for multiple runs in server job.");
+    }
+    else
+    {
+      if (ServerJobValue(keys[n], &geodesics) == nullptr)
+      {
+        std::ostringstream message;
+        message << "Key (" << keys[n] << ") cannot be set in server job.";
+        throw BlacklightException(message.str().c_str());
+      }
+      std::stod(vals[n]);
+    }
+  }
+
+  // Store values
+  server_job_snapshot.reset();
+  server_job_stop = false;
+  server_job_geodesics = false;
+  server_job_plasma = false;
+  for (std::size_t n = 0; n < keys.size(); n++)
+  {
+    if (keys[n] == "snapshot")
+      server_job_snapshot = std::stoi(vals[n]);
+    else if (keys[n] == "server_stop")
+      server_job_stop = ReadBool(vals[n]);
+    else if (keys[n] == "output_file")
+      output_file = vals[n];
+    else
+    {
+      bool geodesics = false;
+      std::optional<double> *p_value = ServerJobValue(keys[n], &geodesics);
+      double value = std::stod(vals[n]);
+      if (p_value->has_value() and p_value->value() == value)
+        continue;
+      *p_value = value;
+      if (geodesics)
+        server_job_geodesics = true;
+      else
+        server_job_plasma = true;
+    }
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for checking an output file name for server jobs
+// Inputs:
+//   file: output file name
+// Outputs:
+//   returned value: flag indicating name is usable
+// Notes:
+//   Assumes model_type and simulation_multiple have been set.
+//   With multiple simulation runs, requires a pattern such as {05d} that
+//       OutputWriter::FormatFilename() can fill, with only digits before the d.
+bool InputReader::ServerOutputFileValid(const std::string &file) const
+{
+  // Check name
+  if (file.empty())
+    return false;
+  if (model_type.value() != ModelType::simulation or not simulation_multiple.value())
+    return true;
+
+  // Check pattern
+  std::string::size_type pos_open = file.find_first_of('{');
+  if (pos_open == std::string::npos)
+    return false;
+  std::string::size_type pos_close = file.find_first_of('}', pos_open);
+  if (pos_close == std::string::npos or pos_close < pos_open + 2 or file[pos_close-1] != 'd')
+    return false;
+  for (std::string::size_type pos = pos_open + 1; pos < pos_close - 1; pos++)
+    if (file[pos] < '0' or file[pos] > '9')
+      return false;
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for locating a value that can be changed by a server job
+// Inputs:
+//   key: input key as a string
+// Outputs:
+//   returned value: pointer to value, or nullptr if key cannot be changed
+//   *p_geodesics: flag indicating value affects geodesics
+// Notes:
+//   See ReadServerJob().
+std::optional<double> *InputReader::ServerJobValue(const std::string &key, bool *p_geodesics)
+{
+  // Locate frequencies
+  *p_geodesics = true;
+  if (image_num_frequencies.value() == 1 and key == "image_frequency")
+    return &image_frequency;
+  if (image_num_frequencies.value() > 1 and key == "image_frequency_start")
+    return &image_frequency_start;
+  if (image_num_frequencies.value() > 1 and key == "image_frequency_end")
+    return &image_frequency_end;
+
+  // Locate plasma parameters
+  *p_geodesics = false;
+  if (model_type.value() == ModelType::simulation)
+  {
+    if (key == "simulation_rho_cgs")
+      return &simulation_rho_cgs;
+    if (key == "plasma_rat_low")
+      return &plasma_rat_low;
+    if (key == "plasma_rat_high")
+      return &plasma_rat_high;
+    if (key == "plasma_power_frac")
+      return &plasma_power_frac;
+    if (key == "plasma_kappa_frac")
+      return &plasma_kappa_frac;
+    if (key == "plasma_kappa")
+      return &plasma_kappa;
+  }
+
+  // Locate formula parameters
+  if (model_type.value() == ModelType::formula)
+  {
+    if (key == "formula_r0")
+      return &formula_r0;
+    if (key == "formula_h")
+      return &formula_h;
+    if (key == "formula_l0")
+      return &formula_l0;
+    if (key == "formula_q")
+      return &formula_q;
+    if (key == "formula_nup")
+      return &formula_nup;
+    if (key == "formula_cn0")
+      return &formula_cn0;
+    if (key == "formula_alpha")
+      return &formula_alpha;
+    if (key == "formula_a")
+      return &formula_a;
+    if (key == "formula_beta")
+      return &formula_beta;
+  }
+  return nullptr;
+}
@@ -0,0 +1,249 @@
+// Blacklight input reader - sweep reader
+
+// C++ headers
+#include <cstddef>   // size_t
+#include <optional>  // optional
+#include <sstream>   // ostringstream
+#include <string>    // stod, stoi, string
+
+// Blacklight headers
+#include "input_reader.hpp"
+#include "../blacklight.hpp"        // enums
+#include "../utils/exceptions.hpp"  // BlacklightException, BlacklightWarning
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for parsing plasma sweep options
+// Inputs:
+//   key: input key as a string without leading "sweep_" or "sweep_model_"
+//   val: input value as a string
+// Outputs: (none)
+// Notes:
+//   Values are only recorded if space is allocated for them, so the keys should occur in a sensible
+//       order in the input file.
+//   Variables indexed beyond what is allocated (e.g. sweep_model_3_rat_high, when
+//       sweep_num_models = 2) are silently ignored.
+void InputReader::ReadSweep(const std::string &key, const std::string &val)
+{
+  // Read total number of models
+  if (key == "num_models")
+  {
+    sweep_num_models = std::stoi(val);
+    if (sweep_num_models.value() < 0)
+      throw BlacklightException("Must have nonnegative sweep_num_models.");
+    if (sweep_num_models.value() > 0)
+    {
+      std::size_t num_models = static_cast<std::size_t>(sweep_num_models.value());
+      sweep_model_rho_cgs_vals = new std::optional<double>[num_models];
+      sweep_model_rat_low_vals = new std::optional<double>[num_models];
+      sweep_model_rat_high_vals = new std::optional<double>[num_models];
+      sweep_model_power_frac_vals = new std::optional<double>[num_models];
+      sweep_model_kappa_frac_vals = new std::optional<double>[num_models];
+      sweep_model_kappa_vals = new std::optional<double>[num_models];
+      sweep_model_formula_r0_vals = new std::optional<double>[num_models];
+      sweep_model_formula_h_vals = new std::optional<double>[num_models];
+      sweep_model_formula_l0_vals = new std::optional<double>[num_models];
+      sweep_model_formula_q_vals = new std::optional<double>[num_models];
+      sweep_model_formula_nup_vals = new std::optional<double>[num_models];
+      sweep_model_formula_cn0_vals = new std::optional<double>[num_models];
+      sweep_model_formula_alpha_vals = new std::optional<double>[num_models];
+      sweep_model_formula_a_vals = new std::optional<double>[num_models];
+      sweep_model_formula_beta_vals = new std::optional<double>[num_models];
+      sweep_model_files = new std::optional<std::string>[num_models];
+    }
+    return;
+  }
+
+  // Split key into model number and model parameter
+  std::string::size_type pos = key.find('_');
+  if (pos == std::string::npos or pos == 0)
+  {
+    std::ostringstream message;
+    message << "Unknown key (sweep_model_" << key << ") in input file.";
+    throw BlacklightException(message.str().c_str());
+  }
+  int model_num = std::stoi(key.substr(0, pos)) - 1;
+  std::string name = key.substr(pos + 1);
+  if (model_num >= sweep_num_models.value())
+    return;
+
+  // Read model parameter
+  if (name == "rho_cgs")
+    sweep_model_rho_cgs_vals[model_num] = std::stod(val);
+  else if (name == "rat_low")
+    sweep_model_rat_low_vals[model_num] = std::stod(val);
+  else if (name == "rat_high")
+    sweep_model_rat_high_vals[model_num] = std::stod(val);
+  else if (name == "power_frac")
+    sweep_model_power_frac_vals[model_num] = std::stod(val);
+  else if (name == "kappa_frac")
+    sweep_model_kappa_frac_vals[model_num] = std::stod(val);
+  else if (name == "kappa")
+    sweep_model_kappa_vals[model_num] = std::stod(val);
+  else if (name == "formula_r0")
+    sweep_model_formula_r0_vals[model_num] = std::stod(val);
+  else if (name == "formula_h")
+    sweep_model_formula_h_vals[model_num] = std::stod(val);
+  else if (name == "formula_l0")
+    sweep_model_formula_l0_vals[model_num] = std::stod(val);
+  else if (name == "formula_q")
+    sweep_model_formula_q_vals[model_num] = std::stod(val);
+  else if (name == "formula_nup")
+    sweep_model_formula_nup_vals[model_num] = std::stod(val);
+  else if (name == "formula_cn0")
+    sweep_model_formula_cn0_vals[model_num] = std::stod(val);
+  else if (name == "formula_alpha")
+    sweep_model_formula_alpha_vals[model_num] = std::stod(val);
+  else if (name == "formula_a")
+    sweep_model_formula_a_vals[model_num] = std::stod(val);
+  else if (name == "formula_beta")
+    sweep_model_formula_beta_vals[model_num] = std::stod(val);
+  else if (name == "file")
+    sweep_model_files[model_num] = val;
+
+  // Handle unknown entry
+  else
+  {
+    std::ostringstream message;
+    message << "Unknown key (sweep_model_" << key << ") in input file.";
+    throw BlacklightException(message.str().c_str());
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for filling in and checking plasma sweep options
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Any model parameter not given for a particular model is taken from the corresponding plasma_*
+//       or simulation_rho_cgs value for simulation models, or formula_* value for formula models.
+//   With more than one model, each model must name its own output file, and there can be no
+//       adaptive refinement, since only root-level samples are kept for reuse.
+//   Model output files cannot be combined with more than one batch camera, each of which names its
+//       own file.
+//   Sweeps apply to simulation and formula models, sharing geodesics and, for simulations,
+//       sampled data among all models.
+//   A sweep_num_models of 0 disables sweeps, ignoring any sweep_model_N_* values.
+void InputReader::SetSweepDefaults()
+{
+  // Check for disabled sweep
+  if (sweep_num_models.value() == 0)
+  {
+    sweep_num_models.reset();
+    return;
+  }
+
+  // Check applicability
+  if (model_type.value() != ModelType::simulation and model_type.value() != ModelType::formula)
+  {
+    BlacklightWarning("Ignoring sweep_num_models selection.");
+    sweep_num_models.reset();
+    return;
+  }
+
+  // Check number of models
+  if (sweep_num_models.value() < 0)
+    throw BlacklightException("Must have nonnegative sweep_num_models.");
+  int num_models = sweep_num_models.value();
+
+  // Check compatibility with other options
+  if (batch_num_cameras.has_value() and batch_num_cameras.value() > 1
+      and (num_models > 1 or sweep_model_files[0].has_value()))
+    throw BlacklightException("Cannot sweep plasma models with more than one batch camera.");
+  if (num_models > 1)
+  {
+    if (adaptive_max_level.has_value() and adaptive_max_level.value() > 0)
+      throw BlacklightException("Cannot sweep plasma models with adaptive ray tracing.");
+    for (int model_num = 0; model_num < num_models; model_num++)
+      if (not sweep_model_files[model_num].has_value())
+        throw BlacklightException("Must specify sweep_model_N_file for each sweep model.");
+  }
+
+  // Fill in missing values from shared formula parameters
+  if (model_type.value() == ModelType::formula)
+  {
+    for (int model_num = 0; model_num < num_models; model_num++)
+    {
+      if (not sweep_model_formula_r0_vals[model_num].has_value())
+        sweep_model_formula_r0_vals[model_num] = formula_r0;
+      if (not sweep_model_formula_h_vals[model_num].has_value())
+        sweep_model_formula_h_vals[model_num] = formula_h;
+      if (not sweep_model_formula_l0_vals[model_num].has_value())
+        sweep_model_formula_l0_vals[model_num] = formula_l0;
+      if (not sweep_model_formula_q_vals[model_num].has_value())
+        sweep_model_formula_q_vals[model_num] = formula_q;
+      if (not sweep_model_formula_nup_vals[model_num].has_value())
+        sweep_model_formula_nup_vals[model_num] = formula_nup;
+      if (not sweep_model_formula_cn0_vals[model_num].has_value())
+        sweep_model_formula_cn0_vals[model_num] = formula_cn0;
+      if (not sweep_model_formula_alpha_vals[model_num].has_value())
+        sweep_model_formula_alpha_vals[model_num] = formula_alpha;
+      if (not sweep_model_formula_a_vals[model_num].has_value())
+        sweep_model_formula_a_vals[model_num] = formula_a;
+      if (not sweep_model_formula_beta_vals[model_num].has_value())
+        sweep_model_formula_beta_vals[model_num] = formula_beta;
+    }
+    return;
+  }
+
+  // Fill in missing values from shared plasma parameters
+  for (int model_num = 0; model_num < num_models; model_num++)
+  {
+    if (not sweep_model_rho_cgs_vals[model_num].has_value())
+      sweep_model_rho_cgs_vals[model_num] = simulation_rho_cgs;
+    if (not sweep_model_rat_low_vals[model_num].has_value())
+      sweep_model_rat_low_vals[model_num] = plasma_rat_low;
+    if (not sweep_model_rat_high_vals[model_num].has_value())
+      sweep_model_rat_high_vals[model_num] = plasma_rat_high;
+    if (not sweep_model_power_frac_vals[model_num].has_value())
+      sweep_model_power_frac_vals[model_num] = plasma_power_frac;
+    if (not sweep_model_kappa_frac_vals[model_num].has_value())
+      sweep_model_kappa_frac_vals[model_num] = plasma_kappa_frac;
+    if (not sweep_model_kappa_vals[model_num].has_value())
+      sweep_model_kappa_vals[model_num] = plasma_kappa;
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for making one sweep model the active plasma model
+// Inputs:
+//   model_num: index (0-indexed) of model to use
+// Outputs: (none)
+// Notes:
+//   Overwrites simulation_rho_cgs and plasma_* values, or formula_* values for formula models, with
+//       those of the given model, as well as output_file if the model names a file, so that objects
+//       constructed or updated afterward see that model.
+//   Does nothing if sweep_num_models is not set.
+void InputReader::SelectSweepModel(int model_num)
+{
+  if (not sweep_num_models.has_value())
+    return;
+  if (model_type.value() == ModelType::formula)
+  {
+    formula_r0 = sweep_model_formula_r0_vals[model_num];
+    formula_h = sweep_model_formula_h_vals[model_num];
+    formula_l0 = sweep_model_formula_l0_vals[model_num];
+    formula_q = sweep_model_formula_q_vals[model_num];
+    formula_nup = sweep_model_formula_nup_vals[model_num];
+    formula_cn0 = sweep_model_formula_cn0_vals[model_num];
+    formula_alpha = sweep_model_formula_alpha_vals[model_num];
+    formula_a = sweep_model_formula_a_vals[model_num];
+    formula_beta = sweep_model_formula_beta_vals[model_num];
+    if (sweep_model_files[model_num].has_value())
+      output_file = sweep_model_files[model_num];
+    return;
+  }
+  simulation_rho_cgs = sweep_model_rho_cgs_vals[model_num];
+  plasma_rat_low = sweep_model_rat_low_vals[model_num];
+  plasma_rat_high = sweep_model_rat_high_vals[model_num];
+  plasma_power_frac = sweep_model_power_frac_vals[model_num];
+  plasma_kappa_frac = sweep_model_kappa_frac_vals[model_num];
+  plasma_kappa = sweep_model_kappa_vals[model_num];
+  if (sweep_model_files[model_num].has_value())
+    output_file = sweep_model_files[model_num];
+  return;
+}
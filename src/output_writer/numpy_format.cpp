@@ -1,11 +1,11 @@
 // Blacklight output writer - NumPy output formats
 
 // C++ headers
-#include <cstdint>  // uint8_t, uint16_t
+#include <cstdint>  // uint8_t, uint16_t, uint32_t, uint64_t
 #include <cstdio>   // size_t, snprintf
 #include <cstring>  // memcpy, memset
 #include <fstream>  // ofstream
-#include <ios>      // streamsize
+#include <ios>      // streamoff, streamsize
 
 // Blacklight headers
 #include "output_writer.hpp"
@@ -22,13 +22,62 @@
 //   Writes data to file.
 void OutputWriter::WriteNpy()
 {
-  uint8_t *image_buffer;
-  std::size_t image_size = GenerateNpyFromArray(image[0], 3 - int(use_custom_pixels),
-                                                &image_buffer);
-  char *buffer = reinterpret_cast<char *>(image_buffer);
-  std::streamsize buffer_length = static_cast<std::streamsize>(image_size);
+  uint8_t npy_header[npy_header_length];
+  GenerateNpyHeader(image[0], 3 - int(use_custom_pixels), npy_header);
+  char *buffer = reinterpret_cast<char *>(npy_header);
+  std::streamsize buffer_length = static_cast<std::streamsize>(npy_header_length);
   p_output_stream->write(buffer, buffer_length);
-  delete[] image_buffer;
+  WriteNpyData(image[0], nullptr);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Output writer for appending a snapshot to a NumPy .npy file
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Writes data to file.
+//   Snapshots are stacked along a new leading axis, with snapshot n placed n images after the
+//       header, so the file can be memory-mapped with a fixed layout.
+//   File is extended to hold all snapshots when the first is written.
+//   Header is rewritten after the data for each snapshot, so its leading dimension always counts
+//       the snapshots completely written so far.
+void OutputWriter::AppendNpy()
+{
+  // Prepare header with leading dimension for snapshots
+  Array<double> snapshots_array = image[0];
+  int num_dims = 3 - int(use_custom_pixels);
+  if (use_custom_pixels)
+    snapshots_array.n3 = append_snapshot + 1;
+  else
+    snapshots_array.n4 = append_snapshot + 1;
+  uint8_t npy_header[npy_header_length];
+  std::size_t data_length = GenerateNpyHeader(snapshots_array, num_dims + 1, npy_header);
+
+  // Extend file to hold all snapshots
+  if (append_snapshot == 0)
+  {
+    std::size_t file_length =
+        npy_header_length + static_cast<std::size_t>(simulation_num_snapshots) * data_length;
+    p_output_stream->seekp(static_cast<std::streamoff>(file_length - 1));
+    p_output_stream->put('\0');
+  }
+
+  // Write data
+  std::size_t data_offset =
+      npy_header_length + static_cast<std::size_t>(append_snapshot) * data_length;
+  p_output_stream->seekp(static_cast<std::streamoff>(data_offset));
+  WriteNpyData(image[0], nullptr);
+
+  // Write header
+  p_output_stream->seekp(0);
+  char *buffer = reinterpret_cast<char *>(npy_header);
+  std::streamsize buffer_length = static_cast<std::streamsize>(npy_header_length);
+  p_output_stream->write(buffer, buffer_length);
+  p_output_stream->flush();
+  if (not p_output_stream->good())
+    throw BlacklightException("Could not write output file.");
   return;
 }
 
@@ -42,11 +91,14 @@ void OutputWriter::WriteNpy()
 //   NumPy .npz files are simply ZIP files with each record containing a .npy file and named
 //       according to the name of the array.
 //   Implements ZIP format version 2.0: pkware.cachefly.net/webdocs/casestudies/APPNOTE.TXT
-//   Does not implement ZIP64, and thus has a reasonably low limit to data sizes that should still
-//       be plenty for almost all ray tracing applications.
+//   Uses ZIP64 extensions (version 4.5) only for records, offsets, and directories too large for
+//       the original format.
+//   Records are deflated if output_compression is set, and stored otherwise.
+//   Records are streamed to file as they are generated, with only the central directory kept in
+//       memory until the end.
 void OutputWriter::WriteNpz()
 {
-  // Prepare buffers for data and headers
+  // Prepare buffers for headers
   int num_image_arrays = (image_light ? 1 : 0)
       + (image_light and model_type == ModelType::simulation and image_polarization ? 3 : 0)
       + (image_time ? 1 : 0) + (image_length ? 1 : 0) + (image_lambda ? 1 : 0)
@@ -61,71 +113,52 @@ void OutputWriter::WriteNpz()
        + adaptive_num_levels_array(0) * (1 + num_full_arrays);
   const int max_name_length = 128;
   char *name_buffer = new char[max_name_length];
-  uint8_t **data_buffers = new uint8_t *[num_arrays];
-  uint8_t **local_header_buffers = new uint8_t *[num_arrays];
   uint8_t **central_header_buffers = new uint8_t *[num_arrays];
-  std::size_t *data_lengths = new std::size_t[num_arrays];
-  std::size_t *local_header_lengths = new std::size_t[num_arrays];
   std::size_t *central_header_lengths = new std::size_t[num_arrays];
   int array_offset = 0;
+  output_offset = 0;
 
-  // Write output parameters and metadata to buffers
-  data_lengths[array_offset] =
-      GenerateNpyFromArray(mass_msun_array, 1, &data_buffers[array_offset]);
-  local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-      data_lengths[array_offset], "mass_msun", &local_header_buffers[array_offset]);
+  // Write output parameters and metadata to file
+  central_header_lengths[array_offset] = WriteNpzRecord(mass_msun_array, 1, "mass_msun",
+      &central_header_buffers[array_offset]);
   array_offset++;
-  data_lengths[array_offset] =
-      GenerateNpyFromArray(camera_width_array, 1, &data_buffers[array_offset]);
-  local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-      data_lengths[array_offset], "width", &local_header_buffers[array_offset]);
+  central_header_lengths[array_offset] = WriteNpzRecord(camera_width_array, 1, "width",
+      &central_header_buffers[array_offset]);
   array_offset++;
-  data_lengths[array_offset] =
-      GenerateNpyFromArray(image_frequencies, 1, &data_buffers[array_offset]);
-  local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-      data_lengths[array_offset], "frequency", &local_header_buffers[array_offset]);
+  central_header_lengths[array_offset] = WriteNpzRecord(image_frequencies, 1, "frequency",
+      &central_header_buffers[array_offset]);
   array_offset++;
 
-  // Write number of adaptive levels and metadata to buffers
-  data_lengths[array_offset] =
-      GenerateNpyFromArray(adaptive_num_levels_array, 1, &data_buffers[array_offset]);
-  local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-      data_lengths[array_offset], "adaptive_num_levels", &local_header_buffers[array_offset]);
+  // Write number of adaptive levels and metadata to file
+  central_header_lengths[array_offset] = WriteNpzRecord(adaptive_num_levels_array, 1,
+      "adaptive_num_levels", &central_header_buffers[array_offset]);
   array_offset++;
 
-  // Write numbers of adaptive blocks and metadata to buffers
+  // Write numbers of adaptive blocks and metadata to file
   if (adaptive_max_level > 0)
   {
-    data_lengths[array_offset] =
-        GenerateNpyFromArray(block_counts_array, 1, &data_buffers[array_offset]);
-    local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-        data_lengths[array_offset], "adaptive_num_blocks", &local_header_buffers[array_offset]);
+    central_header_lengths[array_offset] = WriteNpzRecord(block_counts_array, 1,
+        "adaptive_num_blocks", &central_header_buffers[array_offset]);
     array_offset++;
   }
 
-  // Write root camera data and metadata to buffers
+  // Write root camera data and metadata to file
   if (output_camera)
   {
     if (camera_type == Camera::plane)
     {
-      data_lengths[array_offset] =
-          GenerateNpyFromArray(camera_pos[0], 3 - int(use_custom_pixels),
-                               &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], "positions", &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(camera_pos[0],
+          3 - int(use_custom_pixels), "positions", &central_header_buffers[array_offset]);
     }
     else if (camera_type == Camera::pinhole)
     {
-      data_lengths[array_offset] =
-          GenerateNpyFromArray(camera_dir[0], 3 - int(use_custom_pixels),
-                               &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], "directions", &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(camera_dir[0],
+          3 - int(use_custom_pixels), "directions", &central_header_buffers[array_offset]);
     }
     array_offset++;
   }
 
-  // Write root intensity image data and metadata to buffers
+  // Write root intensity image data and metadata to file
   Array<double> image_deep_copy;
   int num_pix = camera_num_pix;
   int num_dims = image_num_frequencies == 1 ? 2 : 3;
@@ -143,57 +176,45 @@ void OutputWriter::WriteNpz()
   {
     for (int l = 0; l < image_num_frequencies; l++)
       image_deep_copy.CopyFrom(image[0], l * image_stride * num_pix, l * num_pix, num_pix);
-    data_lengths[array_offset] = GenerateNpyFromArray(
-        image_deep_copy, num_dims - int(use_custom_pixels), &data_buffers[array_offset]);
-    local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-        data_lengths[array_offset], "I_nu", &local_header_buffers[array_offset]);
+    central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+        num_dims - int(use_custom_pixels), "I_nu", &central_header_buffers[array_offset]);
     array_offset++;
     if (model_type == ModelType::simulation and image_polarization)
     {
       for (int l = 0; l < image_num_frequencies; l++)
         image_deep_copy.CopyFrom(image[0], (l * image_stride + 1) * num_pix, l * num_pix, num_pix);
-      data_lengths[array_offset] = GenerateNpyFromArray(
-          image_deep_copy, num_dims - int(use_custom_pixels), &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], "Q_nu", &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+          num_dims - int(use_custom_pixels), "Q_nu", &central_header_buffers[array_offset]);
       array_offset++;
       for (int l = 0; l < image_num_frequencies; l++)
         image_deep_copy.CopyFrom(image[0], (l * image_stride + 2) * num_pix, l * num_pix, num_pix);
-      data_lengths[array_offset] = GenerateNpyFromArray(
-          image_deep_copy, num_dims - int(use_custom_pixels), &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], "U_nu", &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+          num_dims - int(use_custom_pixels), "U_nu", &central_header_buffers[array_offset]);
       array_offset++;
       for (int l = 0; l < image_num_frequencies; l++)
         image_deep_copy.CopyFrom(image[0], (l * image_stride + 3) * num_pix, l * num_pix, num_pix);
-      data_lengths[array_offset] = GenerateNpyFromArray(
-          image_deep_copy, num_dims - int(use_custom_pixels), &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], "V_nu", &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+          num_dims - int(use_custom_pixels), "V_nu", &central_header_buffers[array_offset]);
       array_offset++;
     }
   }
 
-  // Write root alternate image data and metadata to buffers
+  // Write root alternate image data and metadata to file
   Array<double> image_shallow_copy;
   if (image_time)
   {
     image_shallow_copy = image[0];
     image_shallow_copy.Slice(3 - int(use_custom_pixels), image_offset_time, image_offset_time);
-    data_lengths[array_offset] = GenerateNpyFromArray(
-        image_shallow_copy, 2 - int(use_custom_pixels), &data_buffers[array_offset]);
-    local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-        data_lengths[array_offset], "time", &local_header_buffers[array_offset]);
+    central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy,
+        2 - int(use_custom_pixels), "time", &central_header_buffers[array_offset]);
     array_offset++;
   }
   if (image_length)
   {
     image_shallow_copy = image[0];
     image_shallow_copy.Slice(3 - int(use_custom_pixels), image_offset_length, image_offset_length);
-    data_lengths[array_offset] = GenerateNpyFromArray(
-        image_shallow_copy, 2 - int(use_custom_pixels), &data_buffers[array_offset]);
-    local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-        data_lengths[array_offset], "length", &local_header_buffers[array_offset]);
+    central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy,
+        2 - int(use_custom_pixels), "length", &central_header_buffers[array_offset]);
     array_offset++;
   }
   if (image_lambda)
@@ -201,10 +222,8 @@ void OutputWriter::WriteNpz()
     image_shallow_copy = image[0];
     image_shallow_copy.Slice(3 - int(use_custom_pixels), image_offset_lambda,
                              image_offset_lambda + image_num_frequencies - 1);
-    data_lengths[array_offset] = GenerateNpyFromArray(
-        image_shallow_copy, num_dims - int(use_custom_pixels), &data_buffers[array_offset]);
-    local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-        data_lengths[array_offset], "lambda", &local_header_buffers[array_offset]);
+    central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy,
+        num_dims - int(use_custom_pixels), "lambda", &central_header_buffers[array_offset]);
     array_offset++;
   }
   if (image_emission)
@@ -212,10 +231,8 @@ void OutputWriter::WriteNpz()
     image_shallow_copy = image[0];
     image_shallow_copy.Slice(3 - int(use_custom_pixels), image_offset_emission,
         image_offset_emission + image_num_frequencies - 1);
-    data_lengths[array_offset] = GenerateNpyFromArray(
-        image_shallow_copy, num_dims - int(use_custom_pixels), &data_buffers[array_offset]);
-    local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-        data_lengths[array_offset], "emission", &local_header_buffers[array_offset]);
+    central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy,
+        num_dims - int(use_custom_pixels), "emission", &central_header_buffers[array_offset]);
     array_offset++;
   }
   if (image_tau)
@@ -223,10 +240,8 @@ void OutputWriter::WriteNpz()
     image_shallow_copy = image[0];
     image_shallow_copy.Slice(3 - int(use_custom_pixels), image_offset_tau,
                              image_offset_tau + image_num_frequencies - 1);
-    data_lengths[array_offset] = GenerateNpyFromArray(
-        image_shallow_copy, num_dims - int(use_custom_pixels), &data_buffers[array_offset]);
-    local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-        data_lengths[array_offset], "tau", &local_header_buffers[array_offset]);
+    central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy,
+        num_dims - int(use_custom_pixels), "tau", &central_header_buffers[array_offset]);
     array_offset++;
   }
   if (image_lambda_ave)
@@ -239,10 +254,8 @@ void OutputWriter::WriteNpz()
         image_deep_copy.CopyFrom(image[0],
             (image_offset_lambda_ave + l * CellValues::num_cell_values + n) * num_pix, l * num_pix,
             num_pix);
-      data_lengths[array_offset] = GenerateNpyFromArray(
-          image_deep_copy, num_dims - int(use_custom_pixels), &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+          num_dims - int(use_custom_pixels), name_buffer, &central_header_buffers[array_offset]);
       array_offset++;
     }
   if (image_emission_ave)
@@ -256,10 +269,8 @@ void OutputWriter::WriteNpz()
         image_deep_copy.CopyFrom(image[0],
             (image_offset_emission_ave + l * CellValues::num_cell_values + n) * num_pix,
             l * num_pix, num_pix);
-      data_lengths[array_offset] = GenerateNpyFromArray(
-          image_deep_copy, num_dims - int(use_custom_pixels), &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+          num_dims - int(use_custom_pixels), name_buffer, &central_header_buffers[array_offset]);
       array_offset++;
     }
   if (image_tau_int)
@@ -272,10 +283,8 @@ void OutputWriter::WriteNpz()
         image_deep_copy.CopyFrom(image[0],
             (image_offset_tau_int + l * CellValues::num_cell_values + n) * num_pix, l * num_pix,
             num_pix);
-      data_lengths[array_offset] = GenerateNpyFromArray(
-          image_deep_copy, num_dims - int(use_custom_pixels), &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+          num_dims - int(use_custom_pixels), name_buffer, &central_header_buffers[array_offset]);
       array_offset++;
     }
   if (image_crossings)
@@ -283,10 +292,8 @@ void OutputWriter::WriteNpz()
     image_shallow_copy = image[0];
     image_shallow_copy.Slice(3 - int(use_custom_pixels), image_offset_crossings,
                              image_offset_crossings);
-    data_lengths[array_offset] = GenerateNpyFromArray(
-        image_shallow_copy, 2 - int(use_custom_pixels), &data_buffers[array_offset]);
-    local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-        data_lengths[array_offset], "crossings", &local_header_buffers[array_offset]);
+    central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy,
+        2 - int(use_custom_pixels), "crossings", &central_header_buffers[array_offset]);
     array_offset++;
   }
   if (image_z_turnings)
@@ -294,38 +301,33 @@ void OutputWriter::WriteNpz()
     image_shallow_copy = image[0];
     image_shallow_copy.Slice(3 - int(use_custom_pixels), image_offset_z_turnings,
                              image_offset_z_turnings);
-    data_lengths[array_offset] = GenerateNpyFromArray(
-        image_shallow_copy, 2 - int(use_custom_pixels), &data_buffers[array_offset]);
-    local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-        data_lengths[array_offset], "z_turnings", &local_header_buffers[array_offset]);
+    central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy,
+        2 - int(use_custom_pixels), "z_turnings", &central_header_buffers[array_offset]);
     array_offset++;
   }
   image_deep_copy.Deallocate();
 
-  // Write root render data and metadata to buffers
+  // Write root render data and metadata to file
   if (render_num_images > 0)
   {
-    data_lengths[array_offset] = GenerateNpyFromArray(render[0], 4, &data_buffers[array_offset]);
-    local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-        data_lengths[array_offset], "rendering", &local_header_buffers[array_offset]);
+    central_header_lengths[array_offset] = WriteNpzRecord(render[0], 4, "rendering",
+        &central_header_buffers[array_offset]);
     array_offset++;
   }
 
-  // Write adaptive data and metadata to buffers
+  // Write adaptive data and metadata to file
   num_dims++;
   for (int level = 1; level <= adaptive_num_levels_array(0); level++)
   {
-    // Write adaptive refinement structure and metadata to buffers
+    // Write adaptive refinement structure and metadata to file
     int num_written = std::snprintf(name_buffer, max_name_length, "adaptive_block_locs_%d", level);
     if (num_written < 0 or num_written >= max_name_length)
       throw BlacklightException("Error naming output array.");
-    data_lengths[array_offset] =
-        GenerateNpyFromArray(camera_loc[level], 2, &data_buffers[array_offset]);
-    local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-        data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+    central_header_lengths[array_offset] = WriteNpzRecord(camera_loc[level], 2, name_buffer,
+        &central_header_buffers[array_offset]);
     array_offset++;
 
-    // Write adaptive camera data and metadata to buffers
+    // Write adaptive camera data and metadata to file
     if (output_camera)
     {
       if (camera_type == Camera::plane)
@@ -333,25 +335,21 @@ void OutputWriter::WriteNpz()
         num_written = std::snprintf(name_buffer, max_name_length, "adaptive_positions_%d", level);
         if (num_written < 0 or num_written >= max_name_length)
           throw BlacklightException("Error naming output array.");
-        data_lengths[array_offset] =
-            GenerateNpyFromArray(camera_pos[level], 4, &data_buffers[array_offset]);
-        local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-            data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+        central_header_lengths[array_offset] = WriteNpzRecord(camera_pos[level], 4, name_buffer,
+            &central_header_buffers[array_offset]);
       }
       else if (camera_type == Camera::pinhole)
       {
         num_written = std::snprintf(name_buffer, max_name_length, "adaptive_directions_%d", level);
         if (num_written < 0 or num_written >= max_name_length)
           throw BlacklightException("Error naming output array.");
-        data_lengths[array_offset] =
-            GenerateNpyFromArray(camera_dir[level], 4, &data_buffers[array_offset]);
-        local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-            data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+        central_header_lengths[array_offset] = WriteNpzRecord(camera_dir[level], 4, name_buffer,
+            &central_header_buffers[array_offset]);
       }
       array_offset++;
     }
 
-    // Write adaptive intensity image data and metadata to buffers
+    // Write adaptive intensity image data and metadata to file
     if (image_light or image_lambda_ave or image_emission_ave or image_tau_int)
       image_deep_copy.Allocate(image_num_frequencies, block_counts_array(level),
           adaptive_block_size, adaptive_block_size);
@@ -363,10 +361,8 @@ void OutputWriter::WriteNpz()
         throw BlacklightException("Error naming output array.");
       for (int l = 0; l < image_num_frequencies; l++)
         image_deep_copy.CopyFrom(image[level], l * image_stride * num_pix, l * num_pix, num_pix);
-      data_lengths[array_offset] =
-          GenerateNpyFromArray(image_deep_copy, num_dims, &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy, num_dims, name_buffer,
+          &central_header_buffers[array_offset]);
       array_offset++;
       if (model_type == ModelType::simulation and image_polarization)
       {
@@ -376,10 +372,8 @@ void OutputWriter::WriteNpz()
         for (int l = 0; l < image_num_frequencies; l++)
           image_deep_copy.CopyFrom(image[level], (l * image_stride + 1) * num_pix, l * num_pix,
               num_pix);
-        data_lengths[array_offset] =
-            GenerateNpyFromArray(image_deep_copy, num_dims, &data_buffers[array_offset]);
-        local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-            data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+        central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+            num_dims, name_buffer, &central_header_buffers[array_offset]);
         array_offset++;
         num_written = std::snprintf(name_buffer, max_name_length, "adaptive_U_nu_%d", level);
         if (num_written < 0 or num_written >= max_name_length)
@@ -387,10 +381,8 @@ void OutputWriter::WriteNpz()
         for (int l = 0; l < image_num_frequencies; l++)
           image_deep_copy.CopyFrom(image[level], (l * image_stride + 2) * num_pix, l * num_pix,
               num_pix);
-        data_lengths[array_offset] =
-            GenerateNpyFromArray(image_deep_copy, num_dims, &data_buffers[array_offset]);
-        local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-            data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+        central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+            num_dims, name_buffer, &central_header_buffers[array_offset]);
         array_offset++;
         num_written = std::snprintf(name_buffer, max_name_length, "adaptive_V_nu_%d", level);
         if (num_written < 0 or num_written >= max_name_length)
@@ -398,15 +390,13 @@ void OutputWriter::WriteNpz()
         for (int l = 0; l < image_num_frequencies; l++)
           image_deep_copy.CopyFrom(image[level], (l * image_stride + 3) * num_pix, l * num_pix,
               num_pix);
-        data_lengths[array_offset] =
-            GenerateNpyFromArray(image_deep_copy, num_dims, &data_buffers[array_offset]);
-        local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-            data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+        central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+            num_dims, name_buffer, &central_header_buffers[array_offset]);
         array_offset++;
       }
     }
 
-    // Write adaptive alternate image data and metadata to buffers
+    // Write adaptive alternate image data and metadata to file
     if (image_time)
     {
       num_written = std::snprintf(name_buffer, max_name_length, "adaptive_time_%d", level);
@@ -414,10 +404,8 @@ void OutputWriter::WriteNpz()
         throw BlacklightException("Error naming output array.");
       image_shallow_copy = image[level];
       image_shallow_copy.Slice(4, image_offset_time, image_offset_time);
-      data_lengths[array_offset] =
-          GenerateNpyFromArray(image_shallow_copy, 3, &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy, 3, name_buffer,
+          &central_header_buffers[array_offset]);
       array_offset++;
     }
     if (image_length)
@@ -427,10 +415,8 @@ void OutputWriter::WriteNpz()
         throw BlacklightException("Error naming output array.");
       image_shallow_copy = image[level];
       image_shallow_copy.Slice(4, image_offset_length, image_offset_length);
-      data_lengths[array_offset] =
-          GenerateNpyFromArray(image_shallow_copy, 3, &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy, 3, name_buffer,
+          &central_header_buffers[array_offset]);
       array_offset++;
     }
     if (image_lambda)
@@ -441,10 +427,8 @@ void OutputWriter::WriteNpz()
       image_shallow_copy = image[level];
       image_shallow_copy.Slice(4, image_offset_lambda,
           image_offset_lambda + image_num_frequencies - 1);
-      data_lengths[array_offset] =
-          GenerateNpyFromArray(image_shallow_copy, num_dims, &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy,
+          num_dims, name_buffer, &central_header_buffers[array_offset]);
       array_offset++;
     }
     if (image_emission)
@@ -455,10 +439,8 @@ void OutputWriter::WriteNpz()
       image_shallow_copy = image[level];
       image_shallow_copy.Slice(4, image_offset_emission,
           image_offset_emission + image_num_frequencies - 1);
-      data_lengths[array_offset] =
-          GenerateNpyFromArray(image_shallow_copy, num_dims, &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy,
+          num_dims, name_buffer, &central_header_buffers[array_offset]);
       array_offset++;
     }
     if (image_tau)
@@ -468,10 +450,8 @@ void OutputWriter::WriteNpz()
         throw BlacklightException("Error naming output array.");
       image_shallow_copy = image[level];
       image_shallow_copy.Slice(4, image_offset_tau, image_offset_tau + image_num_frequencies - 1);
-      data_lengths[array_offset] =
-          GenerateNpyFromArray(image_shallow_copy, num_dims, &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy,
+          num_dims, name_buffer, &central_header_buffers[array_offset]);
       array_offset++;
     }
     if (image_lambda_ave)
@@ -485,10 +465,8 @@ void OutputWriter::WriteNpz()
           image_deep_copy.CopyFrom(image[level],
               (image_offset_lambda_ave + l * CellValues::num_cell_values + n) * num_pix,
               l * num_pix, num_pix);
-        data_lengths[array_offset] =
-            GenerateNpyFromArray(image_deep_copy, num_dims, &data_buffers[array_offset]);
-        local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-            data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+        central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+            num_dims, name_buffer, &central_header_buffers[array_offset]);
         array_offset++;
       }
     if (image_emission_ave)
@@ -502,10 +480,8 @@ void OutputWriter::WriteNpz()
           image_deep_copy.CopyFrom(image[level],
               (image_offset_emission_ave + l * CellValues::num_cell_values + n) * num_pix,
               l * num_pix, num_pix);
-        data_lengths[array_offset] =
-            GenerateNpyFromArray(image_deep_copy, num_dims, &data_buffers[array_offset]);
-        local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-            data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+        central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+            num_dims, name_buffer, &central_header_buffers[array_offset]);
         array_offset++;
       }
     if (image_tau_int)
@@ -519,10 +495,8 @@ void OutputWriter::WriteNpz()
           image_deep_copy.CopyFrom(image[level],
               (image_offset_tau_int + l * CellValues::num_cell_values + n) * num_pix, l * num_pix,
               num_pix);
-        data_lengths[array_offset] =
-            GenerateNpyFromArray(image_deep_copy, num_dims, &data_buffers[array_offset]);
-        local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-            data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+        central_header_lengths[array_offset] = WriteNpzRecord(image_deep_copy,
+            num_dims, name_buffer, &central_header_buffers[array_offset]);
         array_offset++;
       }
     if (image_crossings)
@@ -532,10 +506,8 @@ void OutputWriter::WriteNpz()
         throw BlacklightException("Error naming output array.");
       image_shallow_copy = image[level];
       image_shallow_copy.Slice(4, image_offset_crossings, image_offset_crossings);
-      data_lengths[array_offset] =
-          GenerateNpyFromArray(image_shallow_copy, 3, &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy, 3, name_buffer,
+          &central_header_buffers[array_offset]);
       array_offset++;
     }
     if (image_z_turnings)
@@ -545,90 +517,133 @@ void OutputWriter::WriteNpz()
         throw BlacklightException("Error naming output array.");
       image_shallow_copy = image[level];
       image_shallow_copy.Slice(4, image_offset_z_turnings, image_offset_z_turnings);
-      data_lengths[array_offset] =
-          GenerateNpyFromArray(image_shallow_copy, 3, &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(image_shallow_copy, 3, name_buffer,
+          &central_header_buffers[array_offset]);
       array_offset++;
     }
     image_deep_copy.Deallocate();
 
-    // Write adaptive render data and metadata to buffers
+    // Write adaptive render data and metadata to file
     if (render_num_images > 0)
     {
       num_written = std::snprintf(name_buffer, max_name_length, "adaptive_rendering_%d", level);
       if (num_written < 0 or num_written >= max_name_length)
         throw BlacklightException("Error naming output array.");
-      data_lengths[array_offset] =
-          GenerateNpyFromArray(render[level], 5, &data_buffers[array_offset]);
-      local_header_lengths[array_offset] = GenerateZIPLocalFileHeader(data_buffers[array_offset],
-          data_lengths[array_offset], name_buffer, &local_header_buffers[array_offset]);
+      central_header_lengths[array_offset] = WriteNpzRecord(render[level], 5, name_buffer,
+          &central_header_buffers[array_offset]);
       array_offset++;
     }
   }
 
-  // Write central directory headers to buffers
-  std::size_t offset = 0;
-  for (int n = 0; n < num_arrays; n++)
-  {
-    central_header_lengths[n] = GenerateZIPCentralDirectoryHeader(local_header_buffers[n], offset,
-        &central_header_buffers[n]);
-    offset += local_header_lengths[n] + data_lengths[n];
-  }
-
-  // Write end of central directory record to buffer
+  // Write central directory headers to file
+  std::size_t central_directory_offset = output_offset;
   std::size_t central_directory_length = 0;
-  for (int n = 0; n < num_arrays; n++)
-    central_directory_length += central_header_lengths[n];
-  uint8_t *end_of_directory_buffer = nullptr;
-  std::size_t end_of_directory_length = GenerateZIPEndOfCentralDirectoryRecord(offset,
-      central_directory_length, num_arrays, &end_of_directory_buffer);
-
-  // Write buffers to file
-  for (int n = 0; n < num_arrays; n++)
-  {
-    char *buffer = reinterpret_cast<char *>(local_header_buffers[n]);
-    std::streamsize length = static_cast<std::streamsize>(local_header_lengths[n]);
-    p_output_stream->write(buffer, length);
-    buffer = reinterpret_cast<char *>(data_buffers[n]);
-    length = static_cast<std::streamsize>(data_lengths[n]);
-    p_output_stream->write(buffer, length);
-  }
   for (int n = 0; n < num_arrays; n++)
   {
     char *buffer = reinterpret_cast<char *>(central_header_buffers[n]);
     std::streamsize length = static_cast<std::streamsize>(central_header_lengths[n]);
     p_output_stream->write(buffer, length);
+    central_directory_length += central_header_lengths[n];
   }
+
+  // Write end of central directory record to file
+  uint8_t *end_of_directory_buffer = nullptr;
+  std::size_t end_of_directory_length = GenerateZIPEndOfCentralDirectoryRecord(
+      central_directory_offset, central_directory_length, num_arrays, &end_of_directory_buffer);
   char *buffer = reinterpret_cast<char *>(end_of_directory_buffer);
   std::streamsize length = static_cast<std::streamsize>(end_of_directory_length);
   p_output_stream->write(buffer, length);
 
   // Free memory
   for (int n = 0; n < num_arrays; n++)
-  {
-    delete[] data_buffers[n];
-    delete[] local_header_buffers[n];
     delete[] central_header_buffers[n];
-  }
   delete[] name_buffer;
-  delete[] data_buffers;
-  delete[] local_header_buffers;
   delete[] central_header_buffers;
+  delete[] central_header_lengths;
   delete[] end_of_directory_buffer;
   return;
 }
 
 //--------------------------------------------------------------------------------------------------
 
-// Function for populating a buffer with the contents of a NumPy .npy file from a double Array
+// Function for writing a NumPy .npy file from an Array as a record in a .npz file
 // Inputs:
-//   array: Array to be written to buffer
+//   array: Array to be written to file
 //   num_dims: number of dimensions in Array
+//   record_name: name of record to encode in headers
 // Outputs:
-//   p_buffer: value set to newly allocated buffer that has been initialized with file contents
+//   p_central_header: value set to newly allocated buffer that has been initialized with central
+//       directory header for record
 //   returned value: length of allocated buffer
 // Notes:
+//   Writes record to file at output_offset, advancing output_offset past record.
+//   Streams data directly from Array, calculating CRC-32 (and deflating, if output_compression is
+//       set) along the way and then filling in the already written local file header.
+template<typename type> std::size_t OutputWriter::WriteNpzRecord(const Array<type> &array,
+    int num_dims, const char *record_name, uint8_t **p_central_header)
+{
+  // Prepare headers
+  uint8_t npy_header[npy_header_length];
+  std::size_t data_length = GenerateNpyHeader(array, num_dims, npy_header);
+  std::size_t record_length = npy_header_length + data_length;
+  uint8_t *local_header;
+  std::size_t local_header_length =
+      GenerateZIPLocalFileHeader(record_length, record_name, &local_header);
+  std::size_t local_header_offset = output_offset;
+
+  // Write local file header to file
+  char *buffer = reinterpret_cast<char *>(local_header);
+  std::streamsize length = static_cast<std::streamsize>(local_header_length);
+  p_output_stream->write(buffer, length);
+
+  // Write record to file
+  record_stored_length = 0;
+  deflate_window_length = 0;
+  uint32_t crc_32 = CalculateCRC32(0, npy_header, npy_header_length);
+  WriteZIPRecordData(npy_header, npy_header_length, false);
+  WriteNpyData(array, &crc_32);
+  output_offset += local_header_length + record_stored_length;
+
+  // Fill in CRC-32 and compressed size
+  std::memcpy(local_header + 14, reinterpret_cast<const uint8_t *>(&crc_32), 4);
+  uint16_t extra_field_length = *reinterpret_cast<const uint16_t *>(local_header + 28);
+  if (extra_field_length > 0)
+  {
+    uint64_t record_stored_length_64 = record_stored_length;
+    std::memcpy(local_header + local_header_length - 8,
+        reinterpret_cast<const uint8_t *>(&record_stored_length_64), 8);
+  }
+  else if (record_stored_length >= UINT32_MAX)
+    throw BlacklightException("Compressed array and metadata too large for ZIP record.");
+  else
+  {
+    uint32_t record_stored_length_32 = static_cast<uint32_t>(record_stored_length);
+    std::memcpy(local_header + 18, reinterpret_cast<const uint8_t *>(&record_stored_length_32),
+        4);
+  }
+  p_output_stream->seekp(static_cast<std::streamoff>(local_header_offset));
+  p_output_stream->write(buffer, length);
+  p_output_stream->seekp(static_cast<std::streamoff>(output_offset));
+  if (not p_output_stream->good())
+    throw BlacklightException("Error writing output file.");
+
+  // Prepare central directory header
+  std::size_t central_header_length = GenerateZIPCentralDirectoryHeader(local_header,
+      record_length, record_stored_length, local_header_offset, p_central_header);
+  delete[] local_header;
+  return central_header_length;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for populating a buffer with the header of a NumPy .npy file from a double Array
+// Inputs:
+//   array: Array to be written to file
+//   num_dims: number of dimensions in Array
+// Outputs:
+//   buffer: initialized with npy_header_length bytes of header contents
+//   returned value: number of bytes of data to follow header
+// Notes:
 //   Must be run on little-endian machine.
 //   If num_dims is greater than the number of non-singleton dimensions in the Array, the output
 //       array will have leading singleton dimensions.
@@ -637,88 +652,69 @@ void OutputWriter::WriteNpz()
 //   A .npy file is simply a binary dump of a NumPy array prepended with an ASCII string that can be
 //       interpreted as a Python dictionary literal with certain entries.
 //   Also overloaded for int Array.
-std::size_t OutputWriter::GenerateNpyFromArray(const Array<double> &array, int num_dims,
-    uint8_t **p_buffer)
+std::size_t OutputWriter::GenerateNpyHeader(const Array<double> &array, int num_dims,
+    uint8_t *buffer)
 {
-  // Prepare buffer
-  const std::size_t header_length = 128;
-  std::size_t data_length = array.GetNumBytes() / 2.; // ***** remove / 2. for double output *****
-  std::size_t buffer_length = header_length + data_length;
-  *p_buffer = new uint8_t[buffer_length];
+  // Calculate data length
+  std::size_t data_length = array.GetNumBytes() / 2; // ***** remove / 2 for double output *****
 
   // Write magic string and version number to buffer
   std::size_t length = 0;
   const char *magic_string = "\x93NUMPY";
-  std::memcpy(*p_buffer + length, magic_string, 6);
+  std::memcpy(buffer + length, magic_string, 6);
   length += 6;
   const char *version = "\x01\x00";
-  std::memcpy(*p_buffer + length, version, 2);
+  std::memcpy(buffer + length, version, 2);
   length += 2;
 
   // Write length of header proper to buffer
-  uint16_t header_len = static_cast<uint16_t>(header_length - length - 2);
-  std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&header_len), 2);
+  uint16_t header_len = static_cast<uint16_t>(npy_header_length - length - 2);
+  std::memcpy(buffer + length, reinterpret_cast<const uint8_t *>(&header_len), 2);
   length += 2;
 
   // Write header proper to buffer
-  char *buffer_address = reinterpret_cast<char *>(*p_buffer + length);
+  char *buffer_address = reinterpret_cast<char *>(buffer + length);
   int num_written = -1;
   // ***** change all the five <f4's below to <f8's for double output *****
   if (num_dims == 1 and array.n2 == 1 and array.n3 == 1 and array.n4 == 1 and array.n5 == 1)
-    num_written = std::snprintf(buffer_address, header_length - length,
+    num_written = std::snprintf(buffer_address, npy_header_length - length,
         "{'descr': '<f4', 'fortran_order': False, 'shape': (%d,)}", array.n1);
   else if (num_dims == 2 and array.n3 == 1 and array.n4 == 1 and array.n5 == 1)
-    num_written = std::snprintf(buffer_address, header_length - length,
+    num_written = std::snprintf(buffer_address, npy_header_length - length,
         "{'descr': '<f4', 'fortran_order': False, 'shape': (%d, %d)}", array.n2, array.n1);
   else if (num_dims == 3 and array.n4 == 1 and array.n5 == 1)
-    num_written = std::snprintf(buffer_address, header_length - length,
+    num_written = std::snprintf(buffer_address, npy_header_length - length,
         "{'descr': '<f4', 'fortran_order': False, 'shape': (%d, %d, %d)}", array.n3, array.n2,
         array.n1);
   else if (num_dims == 4 and array.n5 == 1)
-    num_written = std::snprintf(buffer_address, header_length - length,
+    num_written = std::snprintf(buffer_address, npy_header_length - length,
         "{'descr': '<f4', 'fortran_order': False, 'shape': (%d, %d, %d, %d)}", array.n4, array.n3,
         array.n2, array.n1);
   else if (num_dims == 5)
-    num_written = std::snprintf(buffer_address, header_length - length,
+    num_written = std::snprintf(buffer_address, npy_header_length - length,
         "{'descr': '<f4', 'fortran_order': False, 'shape': (%d, %d, %d, %d, %d)}", array.n5,
         array.n4, array.n3, array.n2, array.n1);
   else
     throw BlacklightException("Attempt to truncate array while writing to .npy format.");
-  if (num_written < 0 or num_written > static_cast<int>(header_length - length - 1))
+  if (num_written < 0 or num_written > static_cast<int>(npy_header_length - length - 1))
     throw BlacklightException("Error converting data to .npy format.");
   std::size_t num_spaces =
-      static_cast<std::size_t>(static_cast<int>(header_length - length - 1) - num_written);
+      static_cast<std::size_t>(static_cast<int>(npy_header_length - length - 1) - num_written);
   if (num_spaces > 0)
     std::memset(buffer_address + num_written, ' ', num_spaces);
-  (*p_buffer)[header_length-1] = '\n';
-  length = header_length;
-
-  // Write array to buffer ***** double output version commented out below *****
-  // const uint8_t *data_pointer = reinterpret_cast<const uint8_t *>(array.data);
-  // std::memcpy(*p_buffer + length, data_pointer, data_length);
-  // length += data_length;
-  // return buffer_length;
-
-  // Write array to buffer
-  Array<float> data_copy;
-  data_copy.Allocate(array.n5, array.n4, array.n3, array.n2, array.n1);
-  for (long int n = 0; n < array.n_tot; n++)
-    data_copy.data[n] = array.data[n];
-  const uint8_t *data_pointer = reinterpret_cast<const uint8_t *>(data_copy.data);
-  std::memcpy(*p_buffer + length, data_pointer, data_length);
-  length += data_length;
-  return buffer_length;
+  buffer[npy_header_length-1] = '\n';
+  return data_length;
 }
 
 //--------------------------------------------------------------------------------------------------
 
-// Function for populating a buffer with the contents of a NumPy .npy file from an int Array
+// Function for populating a buffer with the header of a NumPy .npy file from an int Array
 // Inputs:
-//   array: Array to be written to buffer
+//   array: Array to be written to file
 //   num_dims: number of dimensions in Array
 // Outputs:
-//   p_buffer: value set to newly allocated buffer that has been initialized with file contents
-//   returned value: length of allocated buffer
+//   buffer: initialized with npy_header_length bytes of header contents
+//   returned value: number of bytes of data to follow header
 // Notes:
 //   Must be run on little-endian machine.
 //   If num_dims is greater than the number of non-singleton dimensions in the Array, the output
@@ -728,64 +724,129 @@ std::size_t OutputWriter::GenerateNpyFromArray(const Array<double> &array, int n
 //   A .npy file is simply a binary dump of a NumPy array prepended with an ASCII string that can be
 //       interpreted as a Python dictionary literal with certain entries.
 //   Also overloaded for double Array.
-std::size_t OutputWriter::GenerateNpyFromArray(const Array<int> &array, int num_dims,
-    uint8_t **p_buffer)
+std::size_t OutputWriter::GenerateNpyHeader(const Array<int> &array, int num_dims, uint8_t *buffer)
 {
-  // Prepare buffer
-  const std::size_t header_length = 128;
+  // Calculate data length
   std::size_t data_length = array.GetNumBytes();
-  std::size_t buffer_length = header_length + data_length;
-  *p_buffer = new uint8_t[buffer_length];
 
   // Write magic string and version number to buffer
   std::size_t length = 0;
   const char *magic_string = "\x93NUMPY";
-  std::memcpy(*p_buffer + length, magic_string, 6);
+  std::memcpy(buffer + length, magic_string, 6);
   length += 6;
   const char *version = "\x01\x00";
-  std::memcpy(*p_buffer + length, version, 2);
+  std::memcpy(buffer + length, version, 2);
   length += 2;
 
   // Write length of header proper to buffer
-  uint16_t header_len = static_cast<uint16_t>(header_length - length - 2);
-  std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&header_len), 2);
+  uint16_t header_len = static_cast<uint16_t>(npy_header_length - length - 2);
+  std::memcpy(buffer + length, reinterpret_cast<const uint8_t *>(&header_len), 2);
   length += 2;
 
   // Write header proper to buffer
-  char *buffer_address = reinterpret_cast<char *>(*p_buffer + length);
+  char *buffer_address = reinterpret_cast<char *>(buffer + length);
   int num_written = -1;
   if (num_dims == 1 and array.n2 == 1 and array.n3 == 1 and array.n4 == 1 and array.n5 == 1)
-    num_written = std::snprintf(buffer_address, header_length - length,
+    num_written = std::snprintf(buffer_address, npy_header_length - length,
         "{'descr': '<i4', 'fortran_order': False, 'shape': (%d,)}", array.n1);
   else if (num_dims == 2 and array.n3 == 1 and array.n4 == 1 and array.n5 == 1)
-    num_written = std::snprintf(buffer_address, header_length - length,
+    num_written = std::snprintf(buffer_address, npy_header_length - length,
         "{'descr': '<i4', 'fortran_order': False, 'shape': (%d, %d)}", array.n2, array.n1);
   else if (num_dims == 3 and array.n4 == 1 and array.n5 == 1)
-    num_written = std::snprintf(buffer_address, header_length - length,
+    num_written = std::snprintf(buffer_address, npy_header_length - length,
         "{'descr': '<i4', 'fortran_order': False, 'shape': (%d, %d, %d)}", array.n3, array.n2,
         array.n1);
   else if (num_dims == 4 and array.n5 == 1)
-    num_written = std::snprintf(buffer_address, header_length - length,
+    num_written = std::snprintf(buffer_address, npy_header_length - length,
         "{'descr': '<i4', 'fortran_order': False, 'shape': (%d, %d, %d, %d)}", array.n4, array.n3,
         array.n2, array.n1);
   else if (num_dims == 5)
-    num_written = std::snprintf(buffer_address, header_length - length,
+    num_written = std::snprintf(buffer_address, npy_header_length - length,
         "{'descr': '<i4', 'fortran_order': False, 'shape': (%d, %d, %d, %d, %d)}", array.n5,
         array.n4, array.n3, array.n2, array.n1);
   else
     throw BlacklightException("Attempt to truncate array while writing to .npy format.");
-  if (num_written < 0 or num_written > static_cast<int>(header_length - length - 1))
+  if (num_written < 0 or num_written > static_cast<int>(npy_header_length - length - 1))
     throw BlacklightException("Error converting data to .npy format.");
   std::size_t num_spaces =
-      static_cast<std::size_t>(static_cast<int>(header_length - length - 1) - num_written);
+      static_cast<std::size_t>(static_cast<int>(npy_header_length - length - 1) - num_written);
   if (num_spaces > 0)
     std::memset(buffer_address + num_written, ' ', num_spaces);
-  (*p_buffer)[header_length-1] = '\n';
-  length = header_length;
+  buffer[npy_header_length-1] = '\n';
+  return data_length;
+}
 
-  // Write array to buffer
+//--------------------------------------------------------------------------------------------------
+
+// Function for writing the data of a NumPy .npy file from a double Array
+// Inputs:
+//   array: Array to be written to file
+//   p_crc_32: pointer to CRC-32 of preceding data, or nullptr if no check is needed
+// Outputs:
+//   *p_crc_32: updated to include data written
+// Notes:
+//   Must be run on little-endian machine.
+//   Converts data to single precision in chunks of npy_chunk_length values, so only one chunk is
+//       ever copied.
+//   Ends record written with WriteZIPRecordData().
+//   Also overloaded for int Array.
+void OutputWriter::WriteNpyData(const Array<double> &array, uint32_t *p_crc_32)
+{
+  // Write array to file ***** double output version commented out below *****
+  // const uint8_t *data_pointer = reinterpret_cast<const uint8_t *>(array.data);
+  // std::size_t data_length = array.GetNumBytes();
+  // if (p_crc_32 != nullptr)
+  //   *p_crc_32 = CalculateCRC32(*p_crc_32, data_pointer, data_length);
+  // WriteZIPRecordData(data_pointer, data_length, true);
+  // return;
+
+  // Prepare buffer
+  if (array.n_tot <= 0)
+  {
+    WriteZIPRecordData(nullptr, 0, true);
+    return;
+  }
+  long int chunk_length = array.n_tot < npy_chunk_length ? array.n_tot : npy_chunk_length;
+  Array<float> data_copy;
+  data_copy.Allocate(static_cast<int>(chunk_length));
+
+  // Convert and write array in chunks
+  for (long int chunk_start = 0; chunk_start < array.n_tot; chunk_start += chunk_length)
+  {
+    long int length = array.n_tot - chunk_start < chunk_length ? array.n_tot - chunk_start
+        : chunk_length;
+    const double *chunk_data = array.data + chunk_start;
+    #pragma omp parallel for schedule(static) if (length >= npy_parallel_length)
+    for (long int n = 0; n < length; n++)
+      data_copy.data[n] = static_cast<float>(chunk_data[n]);
+    const uint8_t *data_pointer = reinterpret_cast<const uint8_t *>(data_copy.data);
+    std::size_t data_length = static_cast<std::size_t>(length) * sizeof(float);
+    if (p_crc_32 != nullptr)
+      *p_crc_32 = CalculateCRC32(*p_crc_32, data_pointer, data_length);
+    WriteZIPRecordData(data_pointer, data_length, chunk_start + length == array.n_tot);
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for writing the data of a NumPy .npy file from an int Array
+// Inputs:
+//   array: Array to be written to file
+//   p_crc_32: pointer to CRC-32 of preceding data, or nullptr if no check is needed
+// Outputs:
+//   *p_crc_32: updated to include data written
+// Notes:
+//   Must be run on little-endian machine.
+//   Writes directly from Array without copying.
+//   Ends record written with WriteZIPRecordData().
+//   Also overloaded for double Array.
+void OutputWriter::WriteNpyData(const Array<int> &array, uint32_t *p_crc_32)
+{
   const uint8_t *data_pointer = reinterpret_cast<const uint8_t *>(array.data);
-  std::memcpy(*p_buffer + length, data_pointer, data_length);
-  length += data_length;
-  return buffer_length;
+  std::size_t data_length = array.GetNumBytes();
+  if (p_crc_32 != nullptr)
+    *p_crc_32 = CalculateCRC32(*p_crc_32, data_pointer, data_length);
+  WriteZIPRecordData(data_pointer, data_length, true);
+  return;
 }
@@ -1,12 +1,18 @@
 // Blacklight output writer
 
 // C++ headers
-#include <cstdio>    // snprintf
-#include <fstream>   // ofstream
-#include <ios>       // ios_base
-#include <optional>  // optional
-#include <sstream>   // ostringstream
-#include <string>    // stoi, string
+#include <cstddef>    // size_t
+#include <cstdio>     // snprintf
+#include <exception>  // current_exception, rethrow_exception
+#include <fstream>    // ofstream
+#include <ios>        // ios_base
+#include <optional>   // optional
+#include <sstream>    // ostringstream
+#include <string>     // stoi, string
+#include <thread>     // thread
+
+// Library headers
+#include <omp.h>  // omp_get_wtime, omp_set_num_threads
 
 // Blacklight headers
 #include "output_writer.hpp"
@@ -15,7 +21,9 @@
 #include "../input_reader/input_reader.hpp"                  // InputReader
 #include "../radiation_integrator/radiation_integrator.hpp"  // RadiationIntegrator
 #include "../utils/array.hpp"                                // Array
-#include "../utils/exceptions.hpp"                           // BlacklightException
+#include "../utils/communication.hpp"                        // CommGatherPixels, CommRank
+#include "../utils/exceptions.hpp"                           // BlacklightException, BlacklightWarning
+#include "../utils/profiler.hpp"                             // ProfileCounts, ProfileRecord
 
 //--------------------------------------------------------------------------------------------------
 
@@ -42,6 +50,25 @@ OutputWriter::OutputWriter(const InputReader *p_input_reader_,
   output_file = p_input_reader->output_file.value();
   if (output_format == OutputFormat::npz)
     output_camera = p_input_reader->output_camera.value();
+  output_compression = false;
+  if (output_format == OutputFormat::npz and p_input_reader->output_compression.has_value())
+    output_compression = p_input_reader->output_compression.value();
+  else if (p_input_reader->output_compression.has_value()
+      and p_input_reader->output_compression.value())
+    BlacklightWarning("Ignoring output_compression selection.");
+  output_async = false;
+  if (p_input_reader->output_async.has_value())
+    output_async = p_input_reader->output_async.value();
+  output_append = false;
+  if (p_input_reader->output_append.has_value() and p_input_reader->output_append.value())
+  {
+    if (model_type == ModelType::simulation and p_input_reader->simulation_multiple.value())
+      output_append = true;
+    else
+      BlacklightWarning("Ignoring output_append selection.");
+  }
+  if (output_append and output_format == OutputFormat::npz)
+    throw BlacklightException("Only npy or raw outputs support output_append.");
 
   // Copy simulation parameters
   if (model_type == ModelType::simulation)
@@ -49,6 +76,11 @@ OutputWriter::OutputWriter(const InputReader *p_input_reader_,
     simulation_multiple = p_input_reader->simulation_multiple.value();
     if (simulation_multiple)
       simulation_start = p_input_reader->simulation_start.value();
+    if (output_append and p_input_reader->slow_light_on.value())
+      simulation_num_snapshots = p_input_reader->slow_num_images.value();
+    else if (output_append)
+      simulation_num_snapshots =
+          p_input_reader->simulation_end.value() - p_input_reader->simulation_start.value() + 1;
   }
 
   // Copy camera parameters
@@ -56,7 +88,15 @@ OutputWriter::OutputWriter(const InputReader *p_input_reader_,
     camera_type = p_input_reader->camera_type.value();
   camera_resolution = p_input_reader->camera_resolution.value();
   use_custom_pixels = p_geodesic_integrator->use_custom_pixels;
-  camera_num_pix = p_geodesic_integrator->camera_num_pix;
+  camera_num_pix = p_geodesic_integrator->camera_num_pix_total;
+  camera_tiled = p_input_reader->memory_num_tiles.has_value();
+  camera_split = false;
+  if (camera_tiled)
+  {
+    camera_rank_pix_start = p_input_reader->tile_rank_pix_start.value();
+    camera_rank_num_pix = p_input_reader->tile_rank_num_pix.value();
+    camera_split = camera_rank_num_pix < camera_num_pix;
+  }
 
   // Copy image parameters
   image_light = p_input_reader->image_light.value();
@@ -124,7 +164,14 @@ OutputWriter::OutputWriter(const InputReader *p_input_reader_,
     mass_msun_array(0) = p_radiation_integrator->mass_msun;
     camera_width_array.Allocate(1);
     camera_width_array(0) = p_input_reader->camera_width.value();
-    image_frequencies = p_geodesic_integrator->image_frequencies;
+    if (camera_tiled)
+    {
+      const Array<double> &frequencies = p_geodesic_integrator->image_frequencies;
+      image_frequencies.Allocate(frequencies.n1);
+      image_frequencies.CopyFrom(frequencies, 0, 0, frequencies.n_tot);
+    }
+    else
+      image_frequencies = p_geodesic_integrator->image_frequencies;
   }
 
   // Allocate space for camera data
@@ -140,6 +187,10 @@ OutputWriter::OutputWriter(const InputReader *p_input_reader_,
 
   // Allocate space for adaptive data
   adaptive_num_levels_array.Allocate(1);
+
+  // Prepare lookup tables for checksums
+  if (output_format == OutputFormat::npz)
+    CalculateCRC32Tables();
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -147,6 +198,9 @@ OutputWriter::OutputWriter(const InputReader *p_input_reader_,
 // Output writer destructor
 OutputWriter::~OutputWriter()
 {
+  if (write_thread.joinable())
+    write_thread.join();
+  delete p_output_stream;
   for (int level = 0; level <= adaptive_max_level; level++)
   {
     camera_loc[level].Deallocate();
@@ -164,14 +218,70 @@ OutputWriter::~OutputWriter()
 
 //--------------------------------------------------------------------------------------------------
 
+// Function for collecting one tile of the image
+// Inputs:
+//   p_geodesic_integrator_: pointer to object containing ray data for tile
+//   p_radiation_integrator_: pointer to object containing processed image for tile
+// Outputs: (none)
+// Notes:
+//   Only used when the image is divided into tiles or among ranks, in which case this writer holds
+//       its own copy of the full image, filled in by calling this function once for each tile of
+//       this rank, in order, before Write() is called.
+//   Waits for any previous write to finish before overwriting the first tile.
+//   Replaces the pointers to other objects, which must remain valid until Write() has been called,
+//       since the objects for earlier tiles may have been deleted.
+void OutputWriter::CopyTile(const GeodesicIntegrator *p_geodesic_integrator_,
+    const RadiationIntegrator *p_radiation_integrator_)
+{
+  // Update pointers
+  p_geodesic_integrator = p_geodesic_integrator_;
+  p_radiation_integrator = p_radiation_integrator_;
+  if (p_geodesic_integrator->camera_pix_start == camera_rank_pix_start)
+    FinishWrite();
+
+  // Copy camera data
+  if (output_format == OutputFormat::npz and output_camera and camera_type == Camera::plane)
+    CopyTileArray(p_geodesic_integrator->camera_pos[0], 4, &camera_pos[0]);
+  if (output_format == OutputFormat::npz and output_camera and camera_type == Camera::pinhole)
+    CopyTileArray(p_geodesic_integrator->camera_dir[0], 4, &camera_dir[0]);
+
+  // Copy image data
+  if (image_light or image_time or image_length or image_lambda or image_emission or image_tau
+      or image_lambda_ave or image_emission_ave or image_tau_int or image_crossings
+      or image_z_turnings)
+    CopyTileArray(p_radiation_integrator->image[0], 1, &image[0]);
+
+  // Copy render data
+  if (render_num_images > 0)
+    CopyTileArray(p_radiation_integrator->render[0], 1, &render[0]);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
 // Output writer write function
 // Inputs:
 //   snapshot: index (starting at 0) of which snapshot is about to be written
 // Outputs: (none)
 // Notes:
-//   Opens and closes stream for reading.
+//   Opens stream for writing, which is closed by WriteFile().
+//   With output_append, opens output_file unformatted for the first snapshot only, keeping the
+//       stream open until the last snapshot has been written into its slot.
+//   With output_async, deep copies all data from other objects and writes the file on a separate
+//       thread, which uses its own OpenMP thread team, returning immediately. Each writer has at
+//       most one write in progress, waiting for the previous one to finish before starting another,
+//       so memory is bounded by one copy of the outputs per writer.
+//   When the image is divided among ranks, gathers all pixels onto rank 0, which alone writes the
+//       file, and must be called by all ranks.
 void OutputWriter::Write(int snapshot)
 {
+  // Wait for previous write
+  FinishWrite();
+
+  // Collect pixels from other ranks
+  if (camera_split)
+    GatherTiles();
+
   // Copy adaptive data
   adaptive_num_levels_array(0) = p_radiation_integrator->adaptive_num_levels;
   if (adaptive_max_level > 0)
@@ -182,12 +292,13 @@ void OutputWriter::Write(int snapshot)
       block_counts_array(level) = p_radiation_integrator->block_counts[level];
   }
 
-  // Make shallow copies of camera data, reshaping the arrays
+  // Make copies of camera data, reshaping the arrays
   for (int level = 1; level <= adaptive_num_levels_array(0); level++)
-    camera_loc[level] = p_geodesic_integrator->camera_loc[level];
+    CopyArray(p_geodesic_integrator->camera_loc[level], &camera_loc[level]);
   if (output_format == OutputFormat::npz and output_camera and camera_type == Camera::plane)
   {
-    camera_pos[0] = p_geodesic_integrator->camera_pos[0];
+    if (not camera_tiled)
+      CopyArray(p_geodesic_integrator->camera_pos[0], &camera_pos[0]);
     if (not use_custom_pixels)
     {
       camera_pos[0].n3 = camera_resolution;
@@ -195,7 +306,7 @@ void OutputWriter::Write(int snapshot)
     }
     for (int level = 1; level <= adaptive_num_levels_array(0); level++)
     {
-      camera_pos[level] = p_geodesic_integrator->camera_pos[level];
+      CopyArray(p_geodesic_integrator->camera_pos[level], &camera_pos[level]);
       camera_pos[level].n4 = block_counts_array(level);
       camera_pos[level].n3 = adaptive_block_size;
       camera_pos[level].n2 = adaptive_block_size;
@@ -203,7 +314,8 @@ void OutputWriter::Write(int snapshot)
   }
   if (output_format == OutputFormat::npz and output_camera and camera_type == Camera::pinhole)
   {
-    camera_dir[0] = p_geodesic_integrator->camera_dir[0];
+    if (not camera_tiled)
+      CopyArray(p_geodesic_integrator->camera_dir[0], &camera_dir[0]);
     if (not use_custom_pixels)
     {
       camera_dir[0].n3 = camera_resolution;
@@ -211,19 +323,20 @@ void OutputWriter::Write(int snapshot)
     }
     for (int level = 1; level <= adaptive_num_levels_array(0); level++)
     {
-      camera_dir[level] = p_geodesic_integrator->camera_dir[level];
+      CopyArray(p_geodesic_integrator->camera_dir[level], &camera_dir[level]);
       camera_dir[level].n4 = block_counts_array(level);
       camera_dir[level].n3 = adaptive_block_size;
       camera_dir[level].n2 = adaptive_block_size;
     }
   }
 
-  // Make shallow copies of image data, reshaping the arrays
+  // Make copies of image data, reshaping the arrays
   if (image_light or image_time or image_length or image_lambda or image_emission or image_tau
       or image_lambda_ave or image_emission_ave or image_tau_int or image_crossings
       or image_z_turnings)
   {
-    image[0] = p_radiation_integrator->image[0];
+    if (not camera_tiled)
+      CopyArray(p_radiation_integrator->image[0], &image[0]);
     if (not use_custom_pixels)
     {
       image[0].n3 = image[0].n2;
@@ -232,7 +345,7 @@ void OutputWriter::Write(int snapshot)
     }
     for (int level = 1; level <= adaptive_num_levels_array(0); level++)
     {
-      image[level] = p_radiation_integrator->image[level];
+      CopyArray(p_radiation_integrator->image[level], &image[level]);
       image[level].n4 = image[level].n2;
       image[level].n3 = block_counts_array(level);
       image[level].n2 = adaptive_block_size;
@@ -240,10 +353,11 @@ void OutputWriter::Write(int snapshot)
     }
   }
 
-  // Make shallow copies of render data, reshaping the arrays
+  // Make copies of render data, reshaping the arrays
   if (render_num_images > 0)
   {
-    render[0] = p_radiation_integrator->render[0];
+    if (not camera_tiled)
+      CopyArray(p_radiation_integrator->render[0], &render[0]);
     if (not use_custom_pixels)
     {
       render[0].n4 = render[0].n3;
@@ -253,7 +367,7 @@ void OutputWriter::Write(int snapshot)
     }
     for (int level = 1; level <= adaptive_num_levels_array(0); level++)
     {
-      render[level] = p_radiation_integrator->render[level];
+      CopyArray(p_radiation_integrator->render[level], &render[level]);
       render[level].n5 = render[level].n3;
       render[level].n4 = render[level].n2;
       render[level].n3 = block_counts_array(level);
@@ -262,28 +376,108 @@ void OutputWriter::Write(int snapshot)
     }
   }
 
+  // Leave output to rank holding full image
+  if (camera_split and CommRank() != 0)
+    return;
+
   // Open output file
   std::string output_file_formatted = output_file;
-  if (model_type == ModelType::simulation and simulation_multiple)
+  if (model_type == ModelType::simulation and simulation_multiple and not output_append)
   {
     int file_number = snapshot + (slow_light_on ? slow_offset : simulation_start);
     output_file_formatted = FormatFilename(file_number);
   }
-  p_output_stream =
-      new std::ofstream(output_file_formatted, std::ios_base::out | std::ios_base::binary);
+  if (p_output_stream == nullptr)
+    p_output_stream =
+        new std::ofstream(output_file_formatted, std::ios_base::out | std::ios_base::binary);
   if (not p_output_stream->is_open())
     throw BlacklightException("Could not open output file.");
+  append_snapshot = snapshot;
+
+  // Write file, possibly in background
+  if (output_async)
+  {
+    write_exception = nullptr;
+    int num_threads = p_input_reader->num_threads.value();
+    write_thread = std::thread([this, num_threads]()
+    {
+      try
+      {
+        omp_set_num_threads(num_threads);
+        WriteFile();
+      }
+      catch (...)
+      {
+        write_exception = std::current_exception();
+      }
+    });
+  }
+  else
+    WriteFile();
+  return;
+}
 
+//--------------------------------------------------------------------------------------------------
+
+// Function for completing any background write
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Does nothing if no write is in progress.
+//   Rethrows any exception encountered by the background thread.
+void OutputWriter::FinishWrite()
+{
+  if (not write_thread.joinable())
+    return;
+  write_thread.join();
+  if (write_exception)
+    std::rethrow_exception(write_exception);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for writing prepared data to file
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes Write() has prepared data and opened stream.
+//   Closes stream, unless more snapshots are to be appended to it.
+//   Profiled bytes are those of the whole file, or of the snapshot and header when appending.
+void OutputWriter::WriteFile()
+{
   // Write image data based on desired file format
+  double time_start = omp_get_wtime();
   if (output_format == OutputFormat::npz)
     WriteNpz();
+  else if (output_format == OutputFormat::npy and output_append)
+    AppendNpy();
   else if (output_format == OutputFormat::npy)
     WriteNpy();
+  else if (output_format == OutputFormat::raw and output_append)
+    AppendRaw();
   else if (output_format == OutputFormat::raw)
     WriteRaw();
 
+  // Record time and data volume
+  ProfileCounts profile_counts;
+  if (not output_append)
+    profile_counts.bytes_written = static_cast<long int>(p_output_stream->tellp());
+  else
+  {
+    std::size_t data_length = image[0].GetNumBytes();
+    if (output_format == OutputFormat::npy)
+      data_length += npy_header_length;
+    profile_counts.bytes_written = static_cast<long int>(data_length);
+  }
+  ProfileRecord("Write", append_snapshot, -1, time_start, omp_get_wtime(), profile_counts);
+
   // Close output file
-  delete p_output_stream;
+  if (not output_append or append_snapshot == simulation_num_snapshots - 1)
+  {
+    delete p_output_stream;
+    p_output_stream = nullptr;
+  }
 
   // Free memory
   block_counts_array.Deallocate();
@@ -292,6 +486,128 @@ void OutputWriter::Write(int snapshot)
 
 //--------------------------------------------------------------------------------------------------
 
+// Function for copying an Array from another object
+// Inputs:
+//   source: Array to be copied
+// Outputs:
+//   *p_destination: shallow copy of source, or deep copy with output_async
+// Notes:
+//   Deep copies reuse the destination's memory if it has the right size, so that the destination
+//       can be reshaped after copying.
+template<typename type> void OutputWriter::CopyArray(const Array<type> &source,
+    Array<type> *p_destination)
+{
+  if (not output_async)
+  {
+    *p_destination = source;
+    return;
+  }
+  if (not source.allocated)
+  {
+    p_destination->Deallocate();
+    return;
+  }
+  if (not p_destination->allocated or p_destination->n_tot != source.n_tot)
+  {
+    p_destination->Deallocate();
+    p_destination->Allocate(source.n5, source.n4, source.n3, source.n2, source.n1);
+  }
+  p_destination->n5 = source.n5;
+  p_destination->n4 = source.n4;
+  p_destination->n3 = source.n3;
+  p_destination->n2 = source.n2;
+  p_destination->n1 = source.n1;
+  p_destination->CopyFrom(source, 0, 0, source.n_tot);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for copying one tile of a per-pixel array into an array covering the full image
+// Inputs:
+//   source: array for tile
+//   num_inner: number of values stored contiguously for each pixel
+// Outputs:
+//   *p_destination: values for tile pixels overwritten
+// Notes:
+//   With num_inner = 1, pixels are assumed to be the fastest-varying dimension of source, with any
+//       number of other dimensions. Otherwise source is assumed to have two dimensions, the slower
+//       of which is pixels.
+//   Allocates destination (which might have been reshaped for the previous write) for the first
+//       tile of this rank, replacing only the size of the pixel dimension of source with
+//       camera_num_pix.
+template<typename type> void OutputWriter::CopyTileArray(const Array<type> &source,
+    int num_inner, Array<type> *p_destination)
+{
+  // Prepare destination
+  int pix_start = p_geodesic_integrator->camera_pix_start;
+  int tile_num_pix = num_inner == 1 ? source.n1 : source.n2;
+  if (pix_start == camera_rank_pix_start)
+  {
+    p_destination->Deallocate();
+    if (num_inner == 1)
+      p_destination->Allocate(source.n5, source.n4, source.n3, source.n2, camera_num_pix);
+    else
+      p_destination->Allocate(camera_num_pix, num_inner);
+  }
+
+  // Copy values
+  long int num_outer = source.n_tot / (static_cast<long int>(tile_num_pix) * num_inner);
+  long int num_copy = static_cast<long int>(tile_num_pix) * num_inner;
+  for (long int n = 0; n < num_outer; n++)
+    p_destination->CopyFrom(source, n * num_copy,
+        (n * camera_num_pix + pix_start) * static_cast<long int>(num_inner), num_copy);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for collecting image tiles of all ranks onto rank 0
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes CopyTile() has been called for all tiles of this rank, with no reshaping done since.
+void OutputWriter::GatherTiles()
+{
+  // Gather camera data
+  if (output_format == OutputFormat::npz and output_camera and camera_type == Camera::plane)
+    GatherTileArray(4, &camera_pos[0]);
+  if (output_format == OutputFormat::npz and output_camera and camera_type == Camera::pinhole)
+    GatherTileArray(4, &camera_dir[0]);
+
+  // Gather image data
+  if (image_light or image_time or image_length or image_lambda or image_emission or image_tau
+      or image_lambda_ave or image_emission_ave or image_tau_int or image_crossings
+      or image_z_turnings)
+    GatherTileArray(1, &image[0]);
+
+  // Gather render data
+  if (render_num_images > 0)
+    GatherTileArray(1, &render[0]);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for collecting one per-pixel array of all ranks onto rank 0
+// Inputs:
+//   num_inner: number of values stored contiguously for each pixel
+//   p_array: array covering full image, with pixels of this rank filled in
+// Outputs:
+//   *p_array: pixels of all ranks filled in on rank 0
+// Notes:
+//   Uses the same layout assumptions as CopyTileArray().
+void OutputWriter::GatherTileArray(int num_inner, Array<double> *p_array)
+{
+  int num_outer = static_cast<int>(p_array->n_tot / (static_cast<long int>(camera_num_pix)
+      * num_inner));
+  CommGatherPixels(p_array->data, num_outer, camera_num_pix, num_inner, camera_rank_pix_start,
+      camera_rank_num_pix);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
 // Function to construct filename formatted with file number
 // Inputs:
 //   file_number: number of output file to construct
@@ -4,10 +4,12 @@
 #define OUTPUT_WRITER_H_
 
 // C++ headers
-#include <cstddef>  // size_t
-#include <cstdint>  // uint8_t, uint32_t
-#include <fstream>  // ofstream
-#include <string>   // string
+#include <cstddef>    // size_t
+#include <cstdint>    // uint8_t, uint32_t
+#include <exception>  // exception_ptr
+#include <fstream>    // ofstream
+#include <string>     // string
+#include <thread>     // thread
 
 // Blacklight headers
 #include "../blacklight.hpp"                                 // enums
@@ -40,16 +42,24 @@ struct OutputWriter
   OutputFormat output_format;
   std::string output_file;
   bool output_camera;
+  bool output_compression;
+  bool output_async;
+  bool output_append;
 
   // Input data - simulation parameters
   bool simulation_multiple;
   int simulation_start;
+  int simulation_num_snapshots;
 
   // Input data - camera parameters
   Camera camera_type;
   int camera_resolution;
   bool use_custom_pixels;
   int camera_num_pix;
+  bool camera_tiled;
+  bool camera_split;
+  int camera_rank_pix_start;
+  int camera_rank_num_pix;
 
   // Input data - image parameters
   bool image_light;
@@ -88,7 +98,25 @@ struct OutputWriter
   int adaptive_block_size;
 
   // File data
-  std::ofstream *p_output_stream;
+  std::ofstream *p_output_stream = nullptr;
+  std::thread write_thread;
+  std::exception_ptr write_exception;
+  std::size_t output_offset = 0;
+  int append_snapshot = 0;
+  static constexpr std::size_t npy_header_length = 128;
+  static constexpr long int npy_chunk_length = 1l << 22;
+  static constexpr long int npy_parallel_length = 1l << 16;
+
+  // CRC-32 data
+  uint32_t crc_32_tables[8][256];
+  uint32_t crc_32_powers[32];
+
+  // Compression data
+  static constexpr std::size_t deflate_piece_length = 1 << 20;
+  static constexpr std::size_t deflate_window_size = 1 << 15;
+  std::size_t record_stored_length = 0;
+  uint8_t deflate_window[deflate_window_size];
+  std::size_t deflate_window_length = 0;
 
   // Metadata
   Array<double> mass_msun_array;
@@ -114,29 +142,51 @@ struct OutputWriter
   const char *cell_names[CellValues::num_cell_values] =
       {"rho", "n_e", "p_gas", "Theta_e", "B", "sigma", "beta_inverse"};
 
-  // External function
+  // External functions
+  void CopyTile(const GeodesicIntegrator *p_geodesic_integrator_,
+      const RadiationIntegrator *p_radiation_integrator_);
   void Write(int snapshot);
+  void FinishWrite();
 
   // Internal functions - output_writer.cpp
+  void WriteFile();
+  template<typename type> void CopyArray(const Array<type> &source, Array<type> *p_destination);
+  template<typename type> void CopyTileArray(const Array<type> &source, int num_inner,
+      Array<type> *p_destination);
+  void GatherTiles();
+  void GatherTileArray(int num_inner, Array<double> *p_array);
   std::string FormatFilename(int file_number);
 
   // Internal functions - raw_format.cpp
   void WriteRaw();
+  void AppendRaw();
 
   // Internal functions - numpy_format.cpp
   void WriteNpy();
+  void AppendNpy();
   void WriteNpz();
-  std::size_t GenerateNpyFromArray(const Array<double> &array, int num_dims, uint8_t **p_buffer);
-  std::size_t GenerateNpyFromArray(const Array<int> &array, int num_dims, uint8_t **p_buffer);
+  template<typename type> std::size_t WriteNpzRecord(const Array<type> &array, int num_dims,
+      const char *record_name, uint8_t **p_central_header);
+  std::size_t GenerateNpyHeader(const Array<double> &array, int num_dims, uint8_t *buffer);
+  std::size_t GenerateNpyHeader(const Array<int> &array, int num_dims, uint8_t *buffer);
+  void WriteNpyData(const Array<double> &array, uint32_t *p_crc_32);
+  void WriteNpyData(const Array<int> &array, uint32_t *p_crc_32);
 
   // Internal functions - zip_format.cpp
-  std::size_t GenerateZIPLocalFileHeader(const uint8_t *record, std::size_t record_length,
-      const char *record_name, uint8_t **p_buffer);
+  std::size_t GenerateZIPLocalFileHeader(std::size_t record_length, const char *record_name,
+      uint8_t **p_buffer);
   std::size_t GenerateZIPCentralDirectoryHeader(const uint8_t *local_header,
-      std::size_t local_header_offset, uint8_t **p_buffer);
+      std::size_t record_length, std::size_t stored_length, std::size_t local_header_offset,
+      uint8_t **p_buffer);
   std::size_t GenerateZIPEndOfCentralDirectoryRecord(std::size_t central_directory_offset,
       std::size_t central_directory_length, int num_central_directory_entries, uint8_t **p_buffer);
-  uint32_t CalculateCRC32(const uint8_t *message, std::size_t message_length);
+  void WriteZIPRecordData(const uint8_t *data, std::size_t data_length, bool final);
+  void CalculateCRC32Tables();
+  uint32_t CalculateCRC32(uint32_t crc_32, const uint8_t *message, std::size_t message_length);
+  uint32_t CalculateCRC32Serial(uint32_t crc_32, const uint8_t *message,
+      std::size_t message_length);
+  uint32_t CombineCRC32(uint32_t crc_32_a, uint32_t crc_32_b, std::size_t length_b);
+  static uint32_t MultiplyCRC32(uint32_t a, uint32_t b);
 };
 
 #endif
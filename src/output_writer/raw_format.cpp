@@ -1,9 +1,14 @@
 // Blacklight output writer - raw output format
 
+// C++ headers
+#include <cstddef>  // size_t
+#include <ios>      // streamoff
+
 // Blacklight headers
 #include "output_writer.hpp"
-#include "../utils/array.hpp"    // Array
-#include "../utils/file_io.hpp"  // WriteBinary
+#include "../utils/array.hpp"       // Array
+#include "../utils/exceptions.hpp"  // BlacklightException
+#include "../utils/file_io.hpp"     // WriteBinary
 
 //--------------------------------------------------------------------------------------------------
 
@@ -18,3 +23,35 @@ void OutputWriter::WriteRaw()
   WriteBinary(p_output_stream, image[0].data, image[0].n_tot);
   return;
 }
+
+//--------------------------------------------------------------------------------------------------
+
+// Output writer for appending a snapshot to a raw binary cube without metadata
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Writes data to file.
+//   Output file endianness will match that of machine writing file.
+//   Snapshot n is placed n images into the file, so the file can be memory-mapped with a fixed
+//       layout.
+//   File is extended to hold all snapshots when the first is written.
+void OutputWriter::AppendRaw()
+{
+  // Extend file to hold all snapshots
+  std::size_t data_length = image[0].GetNumBytes();
+  if (append_snapshot == 0 and data_length > 0)
+  {
+    std::size_t file_length = static_cast<std::size_t>(simulation_num_snapshots) * data_length;
+    p_output_stream->seekp(static_cast<std::streamoff>(file_length - 1));
+    p_output_stream->put('\0');
+  }
+
+  // Write data
+  std::size_t data_offset = static_cast<std::size_t>(append_snapshot) * data_length;
+  p_output_stream->seekp(static_cast<std::streamoff>(data_offset));
+  WriteBinary(p_output_stream, image[0].data, image[0].n_tot);
+  p_output_stream->flush();
+  if (not p_output_stream->good())
+    throw BlacklightException("Could not write output file.");
+  return;
+}
@@ -2,9 +2,14 @@
 
 // C++ headers
 #include <cstddef>  // size_t
-#include <cstdint>  // uint8_t, uint16_t, uint32_t
-#include <cstring>  // memcpy, strlen
+#include <cstdint>  // uint8_t, uint16_t, uint32_t, uint64_t
+#include <cstring>  // memcpy, memmove, strlen
 #include <ctime>    // localtime, time, time_t, tm
+#include <ios>      // streamsize
+
+// Library headers
+#include <omp.h>   // omp_get_max_threads, omp_in_parallel
+#include <zlib.h>  // compressBound, deflate*, z_stream
 
 // Blacklight headers
 #include "output_writer.hpp"
@@ -14,8 +19,7 @@
 
 // Function for populating a buffer with a ZIP local file header
 // Inputs:
-//   record: buffer containing entire record to be written to ZIP archive
-//   record_length: size of record
+//   record_length: size of record to be written to ZIP archive
 //   record_name: name of record to encode in header
 // Outputs:
 //   p_buffer: value set to newly allocated buffer that has been initialized with header contents
@@ -23,12 +27,19 @@
 // Notes:
 //   Must be run on little-endian machine.
 //   Name in file will be given record_name + ".npy".
-std::size_t OutputWriter::GenerateZIPLocalFileHeader(const uint8_t *record,
-    std::size_t record_length, const char *record_name, uint8_t **p_buffer)
+//   CRC-32 and compressed size are left as 0 and record_length, respectively, to be filled in once
+//       the record has been streamed to file.
+//   Records too large for 32-bit sizes have both sizes recorded in a ZIP64 extra field. With
+//       compression, a small margin is left for data that does not compress.
+std::size_t OutputWriter::GenerateZIPLocalFileHeader(std::size_t record_length,
+    const char *record_name, uint8_t **p_buffer)
 {
   // Prepare buffer
+  std::size_t zip_64_limit = output_compression ? UINT32_MAX / 64 * 63 : UINT32_MAX;
+  bool zip_64 = record_length >= zip_64_limit;
   std::size_t name_length = std::strlen(record_name) + 4;
-  std::size_t buffer_length = 30 + name_length;
+  std::size_t extra_field_length = zip_64 ? 20 : 0;
+  std::size_t buffer_length = 30 + name_length + extra_field_length;
   *p_buffer = new uint8_t[buffer_length];
 
   // Write signature to buffer
@@ -39,9 +50,10 @@ std::size_t OutputWriter::GenerateZIPLocalFileHeader(const uint8_t *record,
 
   // Write version needed to buffer
   const uint8_t version_needed_compatibility = 0;
-  const uint8_t version_needed_major = 2;
-  const uint8_t version_needed_minor = 0;
-  const uint8_t version_needed_both = 10 * version_needed_major + version_needed_minor;
+  const uint8_t version_needed_major = zip_64 ? 4 : 2;
+  const uint8_t version_needed_minor = zip_64 ? 5 : 0;
+  const uint8_t version_needed_both =
+      static_cast<uint8_t>(10 * version_needed_major + version_needed_minor);
   std::memcpy(*p_buffer + length, &version_needed_both, 1);
   length += 1;
   std::memcpy(*p_buffer + length, &version_needed_compatibility, 1);
@@ -53,7 +65,7 @@ std::size_t OutputWriter::GenerateZIPLocalFileHeader(const uint8_t *record,
   length += 2;
 
   // Write compression method to buffer
-  const uint16_t compression = 0;
+  const uint16_t compression = output_compression ? 8 : 0;
   std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&compression), 2);
   length += 2;
 
@@ -71,15 +83,13 @@ std::size_t OutputWriter::GenerateZIPLocalFileHeader(const uint8_t *record,
   std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&date), 2);
   length += 2;
 
-  // Write CRC-32 to buffer
-  uint32_t crc_32 = CalculateCRC32(record, record_length);
+  // Write placeholder CRC-32 to buffer
+  const uint32_t crc_32 = 0;
   std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&crc_32), 4);
   length += 4;
 
   // Write compressed and uncompressed sizes to buffer
-  if (record_length > UINT32_MAX)
-    throw BlacklightException("Array and metadata too large for ZIP record.");
-  uint32_t record_length_32 = static_cast<uint32_t>(record_length);
+  uint32_t record_length_32 = zip_64 ? UINT32_MAX : static_cast<uint32_t>(record_length);
   std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&record_length_32), 4);
   length += 4;
   std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&record_length_32), 4);
@@ -89,10 +99,10 @@ std::size_t OutputWriter::GenerateZIPLocalFileHeader(const uint8_t *record,
   if (name_length > UINT16_MAX)
     throw BlacklightException("Array name too long for ZIP format.");
   uint16_t name_length_16 = static_cast<uint16_t>(name_length);
-  const uint16_t extra_field_length = 0;
+  uint16_t extra_field_length_16 = static_cast<uint16_t>(extra_field_length);
   std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&name_length_16), 2);
   length += 2;
-  std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&extra_field_length), 2);
+  std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&extra_field_length_16), 2);
   length += 2;
 
   // Write name to buffer
@@ -101,6 +111,22 @@ std::size_t OutputWriter::GenerateZIPLocalFileHeader(const uint8_t *record,
   length += name_length - 4;
   std::memcpy(*p_buffer + length, record_name_extension, 4);
   length += 4;
+
+  // Write ZIP64 extra field to buffer
+  if (zip_64)
+  {
+    const uint16_t header_id = 0x0001;
+    const uint16_t data_size = 16;
+    uint64_t record_length_64 = record_length;
+    std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&header_id), 2);
+    length += 2;
+    std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&data_size), 2);
+    length += 2;
+    std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&record_length_64), 8);
+    length += 8;
+    std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&record_length_64), 8);
+    length += 8;
+  }
   return buffer_length;
 }
 
@@ -108,7 +134,9 @@ std::size_t OutputWriter::GenerateZIPLocalFileHeader(const uint8_t *record,
 
 // Function for populating a buffer with a ZIP central directory header
 // Inputs:
-//   local_header: buffer containing local file header
+//   local_header: buffer containing local file header, with CRC-32 filled in
+//   record_length: uncompressed size of record following local file header
+//   stored_length: compressed size of record following local file header
 //   local_header_offset: offset of start of local file header from start of file
 // Outputs:
 //   p_buffer: value set to newly allocated buffer that has been initialized with header contents
@@ -117,14 +145,25 @@ std::size_t OutputWriter::GenerateZIPLocalFileHeader(const uint8_t *record,
 //   Must be run on little-endian machine.
 //   File attributes are not fully specified by ZIP standard. The values written match what NumPy
 //       writes on at least one system.
+//   Sizes and offsets too large for 32 bits are recorded in a ZIP64 extra field, which contains
+//       only those values that overflow.
 std::size_t OutputWriter::GenerateZIPCentralDirectoryHeader(const uint8_t *local_header,
-    std::size_t local_header_offset, uint8_t **p_buffer)
+    std::size_t record_length, std::size_t stored_length, std::size_t local_header_offset,
+    uint8_t **p_buffer)
 {
   // Extract length of file name
   uint16_t name_length = *reinterpret_cast<const uint16_t *>(local_header + 26);
 
+  // Determine which values need ZIP64 extension
+  bool zip_64_length = record_length >= UINT32_MAX or stored_length >= UINT32_MAX;
+  bool zip_64_offset = local_header_offset >= UINT32_MAX;
+  bool zip_64 = zip_64_length or zip_64_offset;
+  std::size_t extra_field_length = 0;
+  if (zip_64)
+    extra_field_length = 4u + (zip_64_length ? 16u : 0u) + (zip_64_offset ? 8u : 0u);
+
   // Prepare buffer
-  std::size_t buffer_length = static_cast<std::size_t>(46 + name_length);
+  std::size_t buffer_length = static_cast<std::size_t>(46 + name_length) + extra_field_length;
   *p_buffer = new uint8_t[buffer_length];
 
   // Write signature to buffer
@@ -135,17 +174,40 @@ std::size_t OutputWriter::GenerateZIPCentralDirectoryHeader(const uint8_t *local
 
   // Write version made by to buffer
   const uint8_t version_made_compatibility = 3;
-  const uint8_t version_made_major = 2;
-  const uint8_t version_made_minor = 0;
-  const uint8_t version_made_both = 10 * version_made_major + version_made_minor;
+  const uint8_t version_made_major = zip_64 ? 4 : 2;
+  const uint8_t version_made_minor = zip_64 ? 5 : 0;
+  const uint8_t version_made_both =
+      static_cast<uint8_t>(10 * version_made_major + version_made_minor);
   std::memcpy(*p_buffer + length, &version_made_both, 1);
   length += 1;
   std::memcpy(*p_buffer + length, &version_made_compatibility, 1);
   length += 1;
 
-  // Copy appropriate fields from local file header to buffer
-  std::memcpy(*p_buffer + length, local_header + 4, 26);
-  length += 26;
+  // Copy appropriate fields, through CRC-32, from local file header to buffer
+  std::memcpy(*p_buffer + length, local_header + 4, 14);
+  length += 14;
+  if (zip_64)
+  {
+    const uint8_t version_needed_both = 45;
+    std::memcpy(*p_buffer + 6, &version_needed_both, 1);
+  }
+
+  // Write compressed and uncompressed sizes to buffer
+  uint32_t stored_length_32 = zip_64_length ? UINT32_MAX : static_cast<uint32_t>(stored_length);
+  uint32_t record_length_32 = zip_64_length ? UINT32_MAX : static_cast<uint32_t>(record_length);
+  std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&stored_length_32), 4);
+  length += 4;
+  std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&record_length_32), 4);
+  length += 4;
+
+  // Copy name length from local file header to buffer
+  std::memcpy(*p_buffer + length, local_header + 26, 2);
+  length += 2;
+
+  // Write extra field length to buffer
+  uint16_t extra_field_length_16 = static_cast<uint16_t>(extra_field_length);
+  std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&extra_field_length_16), 2);
+  length += 2;
 
   // Write file comment length to buffer
   const uint16_t comment_length = 0;
@@ -166,13 +228,41 @@ std::size_t OutputWriter::GenerateZIPCentralDirectoryHeader(const uint8_t *local
   length += 4;
 
   // Write local header offset to buffer
-  uint32_t local_header_offset_32 = static_cast<uint32_t>(local_header_offset);
+  uint32_t local_header_offset_32 =
+      zip_64_offset ? UINT32_MAX : static_cast<uint32_t>(local_header_offset);
   std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&local_header_offset_32), 4);
   length += 4;
 
   // Write name to buffer
   std::memcpy(*p_buffer + length, local_header + 30, name_length);
   length += name_length;
+
+  // Write ZIP64 extra field to buffer
+  if (zip_64)
+  {
+    const uint16_t header_id = 0x0001;
+    uint16_t data_size = static_cast<uint16_t>(extra_field_length - 4);
+    std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&header_id), 2);
+    length += 2;
+    std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&data_size), 2);
+    length += 2;
+    if (zip_64_length)
+    {
+      uint64_t record_length_64 = record_length;
+      uint64_t stored_length_64 = stored_length;
+      std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&record_length_64), 8);
+      length += 8;
+      std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&stored_length_64), 8);
+      length += 8;
+    }
+    if (zip_64_offset)
+    {
+      uint64_t local_header_offset_64 = local_header_offset;
+      std::memcpy(*p_buffer + length, reinterpret_cast<const uint8_t *>(&local_header_offset_64),
+          8);
+      length += 8;
+    }
+  }
   return buffer_length;
 }
 
@@ -188,18 +278,65 @@ std::size_t OutputWriter::GenerateZIPCentralDirectoryHeader(const uint8_t *local
 //   returned value: length of allocated buffer
 // Notes:
 //   Must be run on little-endian machine.
+//   If any value overflows its field, the record is preceded by a ZIP64 end of central directory
+//       record and locator, and the overflowing fields are set to their maximum values.
 std::size_t OutputWriter::GenerateZIPEndOfCentralDirectoryRecord(
     std::size_t central_directory_offset, std::size_t central_directory_length,
     int num_central_directory_entries, uint8_t **p_buffer)
 {
   // Prepare buffer
-  const std::size_t buffer_length = 22;
+  bool zip_64 = num_central_directory_entries >= UINT16_MAX
+      or central_directory_length >= UINT32_MAX or central_directory_offset >= UINT32_MAX;
+  const std::size_t buffer_length = zip_64 ? 98 : 22;
   *p_buffer = new uint8_t[buffer_length];
+  std::size_t length = 0;
+
+  // Write ZIP64 end of central directory record and locator to buffer
+  if (zip_64)
+  {
+    const char *signature_64 = "\x50\x4b\x06\x06";
+    const uint64_t record_size = 44;
+    const uint16_t version = 45;
+    const uint32_t disk_number_32 = 0;
+    uint64_t num_entries_64 = static_cast<uint64_t>(num_central_directory_entries);
+    uint64_t central_directory_length_64 = central_directory_length;
+    uint64_t central_directory_offset_64 = central_directory_offset;
+    std::memcpy(*p_buffer + length, signature_64, 4);
+    length += 4;
+    std::memcpy(*p_buffer + length, &record_size, 8);
+    length += 8;
+    std::memcpy(*p_buffer + length, &version, 2);
+    length += 2;
+    std::memcpy(*p_buffer + length, &version, 2);
+    length += 2;
+    std::memcpy(*p_buffer + length, &disk_number_32, 4);
+    length += 4;
+    std::memcpy(*p_buffer + length, &disk_number_32, 4);
+    length += 4;
+    std::memcpy(*p_buffer + length, &num_entries_64, 8);
+    length += 8;
+    std::memcpy(*p_buffer + length, &num_entries_64, 8);
+    length += 8;
+    std::memcpy(*p_buffer + length, &central_directory_length_64, 8);
+    length += 8;
+    std::memcpy(*p_buffer + length, &central_directory_offset_64, 8);
+    length += 8;
+    const char *signature_locator = "\x50\x4b\x06\x07";
+    uint64_t record_offset_64 = central_directory_offset_64 + central_directory_length_64;
+    const uint32_t num_disks = 1;
+    std::memcpy(*p_buffer + length, signature_locator, 4);
+    length += 4;
+    std::memcpy(*p_buffer + length, &disk_number_32, 4);
+    length += 4;
+    std::memcpy(*p_buffer + length, &record_offset_64, 8);
+    length += 8;
+    std::memcpy(*p_buffer + length, &num_disks, 4);
+    length += 4;
+  }
 
   // Write signature to buffer
-  std::size_t length = 0;
   const char *signature = "\x50\x4b\x05\x06";
-  std::memcpy(*p_buffer, signature, 4);
+  std::memcpy(*p_buffer + length, signature, 4);
   length += 4;
 
   // Write disk numbers to buffer
@@ -210,23 +347,22 @@ std::size_t OutputWriter::GenerateZIPEndOfCentralDirectoryRecord(
   length += 2;
 
   // Write number of entries to buffer
-  uint16_t num_central_directory_entries_16 = static_cast<uint16_t>(num_central_directory_entries);
+  uint16_t num_central_directory_entries_16 = num_central_directory_entries >= UINT16_MAX
+      ? UINT16_MAX : static_cast<uint16_t>(num_central_directory_entries);
   std::memcpy(*p_buffer + length, &num_central_directory_entries_16, 2);
   length += 2;
   std::memcpy(*p_buffer + length, &num_central_directory_entries_16, 2);
   length += 2;
 
   // Write central directory size to buffer
-  if (central_directory_length > UINT32_MAX)
-    throw BlacklightException("Central directory too large for ZIP format.");
-  uint32_t central_directory_length_32 = static_cast<uint32_t>(central_directory_length);
+  uint32_t central_directory_length_32 = central_directory_length >= UINT32_MAX ? UINT32_MAX
+      : static_cast<uint32_t>(central_directory_length);
   std::memcpy(*p_buffer + length, &central_directory_length_32, 4);
   length += 4;
 
   // Write central directory offset to buffer
-  if (central_directory_offset > UINT32_MAX)
-    throw BlacklightException("File contents too large for ZIP format.");
-  uint32_t central_directory_offset_32 = static_cast<uint32_t>(central_directory_offset);
+  uint32_t central_directory_offset_32 = central_directory_offset >= UINT32_MAX ? UINT32_MAX
+      : static_cast<uint32_t>(central_directory_offset);
   std::memcpy(*p_buffer + length, &central_directory_offset_32, 4);
   length += 4;
 
@@ -239,12 +375,178 @@ std::size_t OutputWriter::GenerateZIPEndOfCentralDirectoryRecord(
 
 //--------------------------------------------------------------------------------------------------
 
+// Function for writing part of a ZIP record to file
+// Inputs:
+//   data: bytes to be written
+//   data_length: number of bytes to be written
+//   final: flag indicating data ends record
+// Outputs: (none)
+// Notes:
+//   Advances record_stored_length by the number of bytes actually written.
+//   Without output_compression, writes data unchanged.
+//   With output_compression, deflates data in pieces of deflate_piece_length bytes, each compressed
+//       by a separate thread into a raw deflate stream that is flushed to a byte boundary without
+//       ending, so that the pieces concatenate into a single stream. Each piece is primed with the
+//       preceding deflate_window_size bytes, including those passed in previous calls for the same
+//       record, so the compression ratio is nearly that of a serial stream.
+//   Record must be started with record_stored_length = 0 and deflate_window_length = 0.
+void OutputWriter::WriteZIPRecordData(const uint8_t *data, std::size_t data_length, bool final)
+{
+  // Write uncompressed data
+  if (not output_compression)
+  {
+    p_output_stream->write(reinterpret_cast<const char *>(data),
+        static_cast<std::streamsize>(data_length));
+    record_stored_length += data_length;
+    return;
+  }
+  if (data_length == 0 and not final)
+    return;
+
+  // Prepare buffers for compressed pieces
+  std::size_t num_pieces = (data_length + deflate_piece_length - 1) / deflate_piece_length;
+  if (num_pieces == 0)
+    num_pieces = 1;
+  std::size_t batch_length = static_cast<std::size_t>(omp_get_max_threads());
+  if (batch_length > num_pieces)
+    batch_length = num_pieces;
+  std::size_t piece_bound = compressBound(deflate_piece_length) + 16;
+  uint8_t *piece_buffers = new uint8_t[batch_length * piece_bound];
+  std::size_t *piece_lengths = new std::size_t[batch_length];
+
+  // Go through batches of pieces
+  bool deflate_error = false;
+  for (std::size_t batch_start = 0; batch_start < num_pieces; batch_start += batch_length)
+  {
+    std::size_t batch_end = batch_start + batch_length;
+    if (batch_end > num_pieces)
+      batch_end = num_pieces;
+
+    // Compress pieces in parallel
+    #pragma omp parallel for schedule(static) reduction(or:deflate_error)
+    for (std::size_t n = batch_start; n < batch_end; n++)
+    {
+      // Locate piece and preceding data
+      std::size_t piece_start = n * deflate_piece_length;
+      std::size_t length = data_length - piece_start;
+      if (length > deflate_piece_length)
+        length = deflate_piece_length;
+      const uint8_t *dictionary = deflate_window;
+      std::size_t dictionary_length = deflate_window_length;
+      if (n > 0)
+      {
+        dictionary_length = piece_start < deflate_window_size ? piece_start : deflate_window_size;
+        dictionary = data + piece_start - dictionary_length;
+      }
+
+      // Compress piece
+      z_stream stream = {};
+      if (deflateInit2(&stream, Z_DEFAULT_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 8,
+          Z_DEFAULT_STRATEGY) != Z_OK)
+      {
+        deflate_error = true;
+        continue;
+      }
+      if (dictionary_length > 0 and deflateSetDictionary(&stream, dictionary,
+          static_cast<uInt>(dictionary_length)) != Z_OK)
+        deflate_error = true;
+      uint8_t *piece_buffer = piece_buffers + (n - batch_start) * piece_bound;
+      stream.next_in = const_cast<Bytef *>(data + piece_start);
+      stream.avail_in = static_cast<uInt>(length);
+      stream.next_out = piece_buffer;
+      stream.avail_out = static_cast<uInt>(piece_bound);
+      bool finish = final and n == num_pieces - 1;
+      int status = deflate(&stream, finish ? Z_FINISH : Z_SYNC_FLUSH);
+      if (status != (finish ? Z_STREAM_END : Z_OK) or stream.avail_in != 0)
+        deflate_error = true;
+      piece_lengths[n-batch_start] = piece_bound - stream.avail_out;
+      deflateEnd(&stream);
+    }
+    if (deflate_error)
+    {
+      delete[] piece_buffers;
+      delete[] piece_lengths;
+      throw BlacklightException("Error compressing output data.");
+    }
+
+    // Write compressed pieces in order
+    for (std::size_t n = batch_start; n < batch_end; n++)
+    {
+      char *piece_buffer =
+          reinterpret_cast<char *>(piece_buffers + (n - batch_start) * piece_bound);
+      std::streamsize length = static_cast<std::streamsize>(piece_lengths[n-batch_start]);
+      p_output_stream->write(piece_buffer, length);
+      record_stored_length += piece_lengths[n-batch_start];
+    }
+  }
+  delete[] piece_buffers;
+  delete[] piece_lengths;
+
+  // Retain end of data to prime next call
+  if (data_length >= deflate_window_size)
+  {
+    std::memcpy(deflate_window, data + data_length - deflate_window_size, deflate_window_size);
+    deflate_window_length = deflate_window_size;
+  }
+  else
+  {
+    std::size_t num_kept = deflate_window_size - data_length;
+    if (num_kept > deflate_window_length)
+      num_kept = deflate_window_length;
+    std::memmove(deflate_window, deflate_window + deflate_window_length - num_kept, num_kept);
+    std::memcpy(deflate_window + num_kept, data, data_length);
+    deflate_window_length = num_kept + data_length;
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for preparing lookup tables for calculating CRC-32 values
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Sets crc_32_tables, where crc_32_tables[0][b] is the remainder of byte b (in reflected form,
+//       as described in CalculateCRC32()) and crc_32_tables[k][b] is the remainder of byte b
+//       followed by k zero bytes, allowing 8 bytes to be processed at once.
+//   Sets crc_32_powers, where crc_32_powers[k] is x^(2^k) modulo the CRC-32 polynomial in
+//       reflected form, for use in combining values from separate pieces of a message.
+void OutputWriter::CalculateCRC32Tables()
+{
+  // Calculate remainders of single bytes
+  const uint32_t polynomial = 0xEDB88320;
+  for (int input = 0; input < 256; input++)
+  {
+    uint32_t remainder = static_cast<uint32_t>(input);
+    for (int n = 0; n < 8; n++)
+      remainder = remainder & 1 ? remainder >> 1 ^ polynomial : remainder >> 1;
+    crc_32_tables[0][input] = remainder;
+  }
+
+  // Calculate remainders of bytes followed by zeros
+  for (int k = 1; k < 8; k++)
+    for (int input = 0; input < 256; input++)
+    {
+      uint32_t remainder = crc_32_tables[k-1][input];
+      crc_32_tables[k][input] = remainder >> 8 ^ crc_32_tables[0][remainder & 0xFF];
+    }
+
+  // Calculate repeated squares of x
+  crc_32_powers[0] = 0x40000000;
+  for (int k = 1; k < 32; k++)
+    crc_32_powers[k] = MultiplyCRC32(crc_32_powers[k-1], crc_32_powers[k-1]);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
 // Function for calculating cyclic redundancy check on a message
 // Inputs:
+//   crc_32: CRC-32 of data preceding message, or 0 if there is none
 //   message: message for which value should be calculated
 //   message_length: number of bytes in message
 // Outputs:
-//   returned value: CRC-32 of message
+//   returned value: CRC-32 of preceding data followed by message
 // Notes:
 //   Calculates CRC-32 as defined for ZIP format, effectively doing the following:
 //     Takes as input a message M understood to be first byte first, most significant bit first
@@ -274,89 +576,122 @@ std::size_t OutputWriter::GenerateZIPEndOfCentralDirectoryRecord(
 //     Returns R'', the little-endian, 4-byte int version of the remainder.
 //   As an example, if M consists of 32 0 bits, R' has the value 0x2144DF1C = 558161692, while R''
 //       has the bit pattern 0x1CDF4421 = 0b00011100110111110100010000100001.
-//   The ZIP standard refers to a "magic number" 0xDEBB20E3. This can be obtained as follows for any
-//       M:
-//     Calculate M' by bit-reversing M as above.
-//     Append inverted R (that is, invert all the bits of R as per the postconditioning above but do
-//         not reverse them) to M'.
-//     Append 32 0 bits to the end of M' as above.
-//     Invert the first 32 bits of M' as above.
-//     Calculate a new remainder S = M' % P as above.
-//     Calculate S' as S bit-reversed with no notion of bytes.
-//     S' will have the bit pattern 0xDEBB20E3 = 0b11011110101110110010000011100011.
+//   Rather than reversing bits, all arithmetic is done with the reflected polynomial 0xEDB88320,
+//       so that the least significant bit of each byte is the leading coefficient.
+//   Long messages are split into pieces whose values are calculated in parallel and then combined.
 //   Must be run on little-endian machine.
-//   Does not handle messages less than 4 bytes long.
-uint32_t OutputWriter::CalculateCRC32(const uint8_t *message, std::size_t message_length)
+uint32_t OutputWriter::CalculateCRC32(uint32_t crc_32, const uint8_t *message,
+    std::size_t message_length)
 {
-  // Check message length
-  if (message_length < 4)
-    throw BlacklightException("CRC-32 could not be calculated.");
-
-  // Calculate lookup table for reversing bits within a byte
-  uint8_t bit_reverse_table[256];
-  for (int input = 0; input < 256; input++)
+  // Determine number of pieces
+  const std::size_t min_piece_length = 1 << 20;
+  std::size_t num_pieces = message_length / min_piece_length;
+  std::size_t max_pieces = omp_in_parallel() ? 1 : static_cast<std::size_t>(omp_get_max_threads());
+  if (num_pieces > max_pieces)
+    num_pieces = max_pieces;
+  if (num_pieces <= 1)
+    return CalculateCRC32Serial(crc_32, message, message_length);
+
+  // Calculate values for pieces in parallel
+  std::size_t piece_length = message_length / num_pieces;
+  uint32_t *piece_values = new uint32_t[num_pieces];
+  #pragma omp parallel for schedule(static)
+  for (std::size_t n = 0; n < num_pieces; n++)
   {
-    uint8_t byte = static_cast<uint8_t>(input);
-    byte = static_cast<uint8_t>((byte & 0b11110000) >> 4 | (byte & 0b00001111) << 4);
-    byte = static_cast<uint8_t>((byte & 0b11001100) >> 2 | (byte & 0b00110011) << 2);
-    byte = static_cast<uint8_t>((byte & 0b10101010) >> 1 | (byte & 0b01010101) << 1);
-    bit_reverse_table[input] = byte;
+    std::size_t length = n == num_pieces - 1 ? message_length - n * piece_length : piece_length;
+    piece_values[n] = CalculateCRC32Serial(0, message + n * piece_length, length);
   }
 
-  // Calculate lookup table for dividing by polynomial
-  const uint64_t polynomial = 0x04C11DB700000000ULL;
-  uint32_t division_table[256] = {};
-  for (int input = 0; input < 256; input++)
+  // Combine values
+  for (std::size_t n = 0; n < num_pieces; n++)
   {
-    uint64_t scratch = static_cast<uint64_t>(input) << 56;
-    if (scratch & 0x8000000000000000ULL)
-      scratch ^= polynomial >> 1;
-    if (scratch & 0x4000000000000000ULL)
-      scratch ^= polynomial >> 2;
-    if (scratch & 0x2000000000000000ULL)
-      scratch ^= polynomial >> 3;
-    if (scratch & 0x1000000000000000ULL)
-      scratch ^= polynomial >> 4;
-    if (scratch & 0x0800000000000000ULL)
-      scratch ^= polynomial >> 5;
-    if (scratch & 0x0400000000000000ULL)
-      scratch ^= polynomial >> 6;
-    if (scratch & 0x0200000000000000ULL)
-      scratch ^= polynomial >> 7;
-    if (scratch & 0x0100000000000000ULL)
-      scratch ^= polynomial >> 8;
-    uint32_t output = static_cast<uint32_t>(scratch >> 24 & 0x00000000FFFFFFFFULL);
-    output = (output & 0xFFFF0000) >> 16 | (output & 0x0000FFFF) << 16;
-    output = (output & 0xFF00FF00) >> 8 | (output & 0x00FF00FF) << 8;
-    division_table[input] = output;
+    std::size_t length = n == num_pieces - 1 ? message_length - n * piece_length : piece_length;
+    crc_32 = CombineCRC32(crc_32, piece_values[n], length);
   }
+  delete[] piece_values;
+  return crc_32;
+}
 
-  // Perform division on preconditioned, bit-reversed message appended with 0's
-  uint8_t leading_byte;
-  uint32_t remainder = 0xFFFFFFFF;
-  uint8_t *remainder_bytes = reinterpret_cast<uint8_t *>(&remainder);
-  for (int b = 0; b < 4; b++)
-    remainder_bytes[b] ^= bit_reverse_table[message[b]];
-  for (std::size_t n = 4; n < message_length; n++)
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating cyclic redundancy check on a message in a single thread
+// Inputs:
+//   crc_32: CRC-32 of data preceding message, or 0 if there is none
+//   message: message for which value should be calculated
+//   message_length: number of bytes in message
+// Outputs:
+//   returned value: CRC-32 of preceding data followed by message
+// Notes:
+//   See CalculateCRC32().
+//   Processes 8 bytes at a time using crc_32_tables ("slicing-by-8").
+//   Must be run on little-endian machine.
+uint32_t OutputWriter::CalculateCRC32Serial(uint32_t crc_32, const uint8_t *message,
+    std::size_t message_length)
+{
+  // Undo postconditioning of preceding value
+  uint32_t remainder = crc_32 ^ 0xFFFFFFFF;
+
+  // Process 8 bytes at a time
+  std::size_t n = 0;
+  for (; n + 8 <= message_length; n += 8)
   {
-    leading_byte = remainder_bytes[0];
-    for (int b = 0; b < 3; b++)
-      remainder_bytes[b] = remainder_bytes[b+1];
-    remainder_bytes[3] = bit_reverse_table[message[n]];
-    remainder ^= division_table[leading_byte];
+    uint32_t low;
+    uint32_t high;
+    std::memcpy(&low, message + n, 4);
+    std::memcpy(&high, message + n + 4, 4);
+    low ^= remainder;
+    remainder = crc_32_tables[7][low & 0xFF] ^ crc_32_tables[6][low >> 8 & 0xFF]
+        ^ crc_32_tables[5][low >> 16 & 0xFF] ^ crc_32_tables[4][low >> 24]
+        ^ crc_32_tables[3][high & 0xFF] ^ crc_32_tables[2][high >> 8 & 0xFF]
+        ^ crc_32_tables[1][high >> 16 & 0xFF] ^ crc_32_tables[0][high >> 24];
   }
-  for (int n = 0; n < 4; n++)
+
+  // Process remaining bytes
+  for (; n < message_length; n++)
+    remainder = remainder >> 8 ^ crc_32_tables[0][(remainder ^ message[n]) & 0xFF];
+
+  // Apply postconditioning
+  return remainder ^ 0xFFFFFFFF;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for combining cyclic redundancy checks on consecutive messages
+// Inputs:
+//   crc_32_a: CRC-32 of first message
+//   crc_32_b: CRC-32 of second message
+//   length_b: number of bytes in second message
+// Outputs:
+//   returned value: CRC-32 of first message followed by second message
+// Notes:
+//   Shifts the first value by multiplying by x^(8 * length_b) modulo the polynomial, building the
+//       power out of crc_32_powers according to the binary representation of 8 * length_b.
+uint32_t OutputWriter::CombineCRC32(uint32_t crc_32_a, uint32_t crc_32_b, std::size_t length_b)
+{
+  uint32_t power = 0x80000000;
+  int k = 3;
+  for (std::size_t n = length_b; n > 0; n >>= 1, k++)
+    if (n & 1)
+      power = MultiplyCRC32(crc_32_powers[k & 31], power);
+  return MultiplyCRC32(power, crc_32_a) ^ crc_32_b;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for multiplying polynomials modulo the CRC-32 polynomial
+// Inputs:
+//   a, b: polynomials in reflected form (leading coefficient in least significant bit)
+// Outputs:
+//   returned value: product a * b modulo polynomial, in reflected form
+uint32_t OutputWriter::MultiplyCRC32(uint32_t a, uint32_t b)
+{
+  const uint32_t polynomial = 0xEDB88320;
+  uint32_t product = 0;
+  for (uint32_t mask = 0x80000000; mask != 0; mask >>= 1)
   {
-    leading_byte = remainder_bytes[0];
-    for (int b = 0; b < 3; b++)
-      remainder_bytes[b] = remainder_bytes[b+1];
-    remainder_bytes[3] = 0;
-    remainder ^= division_table[leading_byte];
+    if (a & mask)
+      product ^= b;
+    b = b & 1 ? b >> 1 ^ polynomial : b >> 1;
   }
-
-  // Modify remainder to account for bit reversing and postconditioning
-  for (int n = 0; n < 4; n++)
-    remainder_bytes[n] = bit_reverse_table[remainder_bytes[n]];
-  remainder ^= 0xFFFFFFFF;
-  return remainder;
+  return product;
 }
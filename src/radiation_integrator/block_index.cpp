@@ -0,0 +1,255 @@
+// Blacklight radiation integrator - spatial and logical indexing of simulation blocks
+
+// C++ headers
+#include <algorithm>  // lower_bound, max, min, nth_element, sort
+#include <tuple>      // make_tuple
+
+// Blacklight headers
+#include "radiation_integrator.hpp"
+#include "../blacklight.hpp"   // enums
+#include "../utils/array.hpp"  // Array
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for building indices used to locate simulation blocks
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes x1f, x2f, and x3f have been set, as well as levels and locations if
+//       simulation_block_interp == true with Athena++ or AthenaK data.
+//   Allocates and initializes block_tree_order, block_tree_ranges, and block_tree_bounds, forming
+//       a balanced bounding-volume tree over block extents:
+//     Node 0 covers all blocks, and node n has children 2n+1 and 2n+2.
+//     Each internal node splits its blocks at the median center along its longest axis.
+//     Nodes with at most block_tree_leaf_size blocks are leaves.
+//   Allocates and initializes block_location_order if levels and locations have been set, listing
+//       blocks sorted by level and then by logical location.
+//   Operates in serial since it only needs to run once.
+void RadiationIntegrator::BuildBlockIndex()
+{
+  // Extract grid data
+  int n_b = x1f.n2;
+  int n_i = x1v.n1;
+  int n_j = x2v.n1;
+  int n_k = x3v.n1;
+
+  // Calculate tree size
+  int num_nodes = 1;
+  for (int size = n_b; size > block_tree_leaf_size; size = (size + 1) / 2)
+    num_nodes = 2 * num_nodes + 1;
+
+  // Allocate tree
+  block_tree_order.Allocate(n_b);
+  block_tree_ranges.Allocate(num_nodes, 2);
+  block_tree_bounds.Allocate(num_nodes, 6);
+  block_tree_ranges.Zero();
+  for (int b = 0; b < n_b; b++)
+    block_tree_order(b) = b;
+  block_tree_ranges(0,1) = n_b;
+
+  // Partition blocks
+  for (int node = 0; node < num_nodes; node++)
+  {
+    // Check for leaf
+    int begin = block_tree_ranges(node,0);
+    int end = block_tree_ranges(node,1);
+    if (end - begin <= block_tree_leaf_size)
+      continue;
+
+    // Calculate extent of block centers
+    double center_min[3] = {x1f(block_tree_order(begin),0) + x1f(block_tree_order(begin),n_i),
+        x2f(block_tree_order(begin),0) + x2f(block_tree_order(begin),n_j),
+        x3f(block_tree_order(begin),0) + x3f(block_tree_order(begin),n_k)};
+    double center_max[3] = {center_min[0], center_min[1], center_min[2]};
+    for (int p = begin + 1; p < end; p++)
+    {
+      int b = block_tree_order(p);
+      double center[3] = {x1f(b,0) + x1f(b,n_i), x2f(b,0) + x2f(b,n_j), x3f(b,0) + x3f(b,n_k)};
+      for (int d = 0; d < 3; d++)
+      {
+        center_min[d] = std::min(center_min[d], center[d]);
+        center_max[d] = std::max(center_max[d], center[d]);
+      }
+    }
+
+    // Split at median along longest axis
+    int axis = 0;
+    for (int d = 1; d < 3; d++)
+      if (center_max[d] - center_min[d] > center_max[axis] - center_min[axis])
+        axis = d;
+    const Array<double> &xf = axis == 0 ? x1f : axis == 1 ? x2f : x3f;
+    int n_axis = axis == 0 ? n_i : axis == 1 ? n_j : n_k;
+    int mid = (begin + end + 1) / 2;
+    std::nth_element(block_tree_order.data + begin, block_tree_order.data + mid,
+        block_tree_order.data + end, [&xf, n_axis](int b_a, int b_b)
+        {
+          return xf(b_a,0) + xf(b_a,n_axis) < xf(b_b,0) + xf(b_b,n_axis);
+        });
+    block_tree_ranges(2*node+1,0) = begin;
+    block_tree_ranges(2*node+1,1) = mid;
+    block_tree_ranges(2*node+2,0) = mid;
+    block_tree_ranges(2*node+2,1) = end;
+  }
+
+  // Calculate bounds from leaves upward
+  for (int node = num_nodes - 1; node >= 0; node--)
+  {
+    int begin = block_tree_ranges(node,0);
+    int end = block_tree_ranges(node,1);
+    if (begin == end)
+      continue;
+    if (end - begin <= block_tree_leaf_size)
+    {
+      int b = block_tree_order(begin);
+      block_tree_bounds(node,0) = x1f(b,0);
+      block_tree_bounds(node,1) = x1f(b,n_i);
+      block_tree_bounds(node,2) = x2f(b,0);
+      block_tree_bounds(node,3) = x2f(b,n_j);
+      block_tree_bounds(node,4) = x3f(b,0);
+      block_tree_bounds(node,5) = x3f(b,n_k);
+      for (int p = begin + 1; p < end; p++)
+      {
+        b = block_tree_order(p);
+        block_tree_bounds(node,0) = std::min(block_tree_bounds(node,0), x1f(b,0));
+        block_tree_bounds(node,1) = std::max(block_tree_bounds(node,1), x1f(b,n_i));
+        block_tree_bounds(node,2) = std::min(block_tree_bounds(node,2), x2f(b,0));
+        block_tree_bounds(node,3) = std::max(block_tree_bounds(node,3), x2f(b,n_j));
+        block_tree_bounds(node,4) = std::min(block_tree_bounds(node,4), x3f(b,0));
+        block_tree_bounds(node,5) = std::max(block_tree_bounds(node,5), x3f(b,n_k));
+      }
+    }
+    else
+      for (int d = 0; d < 6; d += 2)
+      {
+        block_tree_bounds(node,d) =
+            std::min(block_tree_bounds(2*node+1,d), block_tree_bounds(2*node+2,d));
+        block_tree_bounds(node,d+1) =
+            std::max(block_tree_bounds(2*node+1,d+1), block_tree_bounds(2*node+2,d+1));
+      }
+  }
+
+  // Sort blocks by logical location
+  if (levels.allocated and locations.allocated)
+  {
+    block_location_order.Allocate(n_b);
+    for (int b = 0; b < n_b; b++)
+      block_location_order(b) = b;
+    std::sort(block_location_order.data, block_location_order.data + n_b,
+        [this](int b_a, int b_b)
+        {
+          return std::make_tuple(levels(b_a), locations(b_a,2), locations(b_a,1),
+              locations(b_a,0), b_a) < std::make_tuple(levels(b_b), locations(b_b,2),
+              locations(b_b,1), locations(b_b,0), b_b);
+        });
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for finding block containing a given point
+// Inputs:
+//   x1, x2, x3: coordinates of point
+// Outputs:
+//   returned value: index of block containing point, or number of blocks if no such block exists
+// Notes:
+//   Assumes BuildBlockIndex() has been called.
+//   Block bounds are inclusive; if multiple blocks contain the point, the one with the smallest
+//       index is returned.
+int RadiationIntegrator::FindBlock(double x1, double x2, double x3) const
+{
+  // Extract grid data
+  int n_b = x1f.n2;
+  int n_i = x1v.n1;
+  int n_j = x2v.n1;
+  int n_k = x3v.n1;
+
+  // Traverse tree
+  int b_found = n_b;
+  int stack[block_tree_max_depth];
+  int stack_size = 0;
+  stack[stack_size++] = 0;
+  while (stack_size > 0)
+  {
+    // Check node bounds
+    int node = stack[--stack_size];
+    int begin = block_tree_ranges(node,0);
+    int end = block_tree_ranges(node,1);
+    if (begin == end or not (x1 >= block_tree_bounds(node,0) and x1 <= block_tree_bounds(node,1)
+        and x2 >= block_tree_bounds(node,2) and x2 <= block_tree_bounds(node,3)
+        and x3 >= block_tree_bounds(node,4) and x3 <= block_tree_bounds(node,5)))
+      continue;
+
+    // Check blocks in leaf
+    if (end - begin <= block_tree_leaf_size)
+    {
+      for (int p = begin; p < end; p++)
+      {
+        int b = block_tree_order(p);
+        if (b < b_found and x1 >= x1f(b,0) and x1 <= x1f(b,n_i) and x2 >= x2f(b,0)
+            and x2 <= x2f(b,n_j) and x3 >= x3f(b,0) and x3 <= x3f(b,n_k))
+          b_found = b;
+      }
+      continue;
+    }
+
+    // Descend to children
+    stack[stack_size++] = 2 * node + 2;
+    stack[stack_size++] = 2 * node + 1;
+  }
+  return b_found;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for finding block at a given logical location
+// Inputs:
+//   level: refinement level
+//   location_i, location_j, location_k: logical location at given level
+// Outputs:
+//   returned value: index of block with given level and location, or -1 if no such block exists
+// Notes:
+//   Assumes BuildBlockIndex() has been called with levels and locations set.
+int RadiationIntegrator::FindBlockLocation(int level, int location_i, int location_j,
+    int location_k) const
+{
+  int n_b = levels.n1;
+  int *p_b = std::lower_bound(block_location_order.data, block_location_order.data + n_b, 0,
+      [this, level, location_i, location_j, location_k](int b, int)
+      {
+        return std::make_tuple(levels(b), locations(b,2), locations(b,1), locations(b,0))
+            < std::make_tuple(level, location_k, location_j, location_i);
+      });
+  if (p_b == block_location_order.data + n_b)
+    return -1;
+  int b = *p_b;
+  if (levels(b) != level or locations(b,0) != location_i or locations(b,1) != location_j
+      or locations(b,2) != location_k)
+    return -1;
+  return b;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for finding cell containing a given coordinate within a block
+// Inputs:
+//   xf: cell face coordinates
+//   b: block index
+//   n: number of cells in block along this direction
+//   x: coordinate
+// Outputs:
+//   returned value: smallest index i such that xf(b,i+1) >= x, or n if there is no such index
+// Notes:
+//   Starts from the index given by uniform spacing across the block, so that uniform blocks need
+//       no search, and then adjusts by comparing with faces, so that results are exact for
+//       nonuniform blocks as well.
+int RadiationIntegrator::FindCellIndex(const Array<double> &xf, int b, int n, double x) const
+{
+  double frac = (x - xf(b,0)) / (xf(b,n) - xf(b,0)) * n;
+  int ind = frac >= 0.0 ? (frac < n ? static_cast<int>(frac) : n - 1) : 0;
+  while (ind > 0 and xf(b,ind) >= x)
+    ind--;
+  while (ind < n and not (xf(b,ind+1) >= x))
+    ind++;
+  return ind;
+}
@@ -1,11 +1,9 @@
 // Blacklight radiation integrator - formula radiative transfer coefficients
 
 // C++ headers
-#include <cmath>   // abs, acos, atan, atan2, cos, exp, pow, sin, sqrt
-#include <limits>  // numeric_limits
-
-// Library headers
-#include <omp.h>  // pragmas
+#include <algorithm>  // max
+#include <cmath>      // abs, acos, atan, atan2, cos, exp, pow, sin, sqrt
+#include <limits>     // numeric_limits
 
 // Blacklight headers
 #include "radiation_integrator.hpp"
@@ -14,14 +12,16 @@
 
 //--------------------------------------------------------------------------------------------------
 
-// Function for integrating radiative transfer equation based on formula
+// Function for preparing to integrate radiative transfer equation based on formula
 // Inputs: (none)
 // Outputs: (none)
 // Notes:
-//   Assumes sample_flags[adaptive_level], sample_num[adaptive_level], sample_pos[adaptive_level],
-//       sample_dir[adaptive_level], and momentum_factors[adaptive_level] have been set.
-//   Allocates and initializes j_i[adaptive_level] and alpha_i[adaptive_level].
-//   References code comparison paper 2020 ApJ 897 148 (C).
+//   Assumes sample_num[adaptive_level] has been set.
+//   Allocates and initializes sample_offsets[adaptive_level], and allocates j_i[adaptive_level]
+//       and alpha_i[adaptive_level] with fused_num_records records for each thread, enough for any
+//       one ray.
+//   Coefficients are only calculated during integration, ray by ray with
+//       CalculateFormulaCoefficientsRay(), so that they never need to be stored for all samples.
 void RadiationIntegrator::CalculateFormulaCoefficients()
 {
   // Allocate arrays
@@ -30,153 +30,175 @@ void RadiationIntegrator::CalculateFormulaCoefficients()
     num_pix = block_counts[adaptive_level] * block_num_pix;
   if (first_time or adaptive_level > 0)
   {
-    j_i[adaptive_level].Allocate(image_num_frequencies, num_pix,
-        geodesic_num_steps[adaptive_level]);
-    alpha_i[adaptive_level].Allocate(image_num_frequencies, num_pix,
-        geodesic_num_steps[adaptive_level]);
+    CalculateSampleOffsets(num_pix);
+    fused_num_records = 0;
+    for (int m = 0; m < num_pix; m++)
+      fused_num_records = std::max(fused_num_records,
+          sample_offsets[adaptive_level](m+1) - sample_offsets[adaptive_level](m));
+    int num_records = std::max(num_threads * fused_num_records, 1);
+    j_i[adaptive_level].Allocate(num_records, image_num_frequencies);
+    alpha_i[adaptive_level].Allocate(num_records, image_num_frequencies);
   }
-  j_i[adaptive_level].Zero();
-  alpha_i[adaptive_level].Zero();
+  return;
+}
 
-  // Go through rays in parallel
-  #pragma omp parallel for schedule(static)
-  for (int m = 0; m < num_pix; m++)
-  {
-    // Check number of steps
-    int num_steps = sample_num[adaptive_level](m);
-    if (num_steps <= 0)
-      continue;
+//--------------------------------------------------------------------------------------------------
 
-    // Set pixel to NaN if ray has problem
-    if (fallback_nan and sample_flags[adaptive_level](m))
-    {
-      for (int n = 0; n < num_steps; n++)
+// Function for calculating radiative transfer coefficients based on formula along a single ray
+// Inputs:
+//   m: pixel index
+//   r_start: index of first record to fill in j_i[adaptive_level] and alpha_i[adaptive_level]
+// Outputs: (none)
+// Notes:
+//   Assumes sample_flags[adaptive_level], sample_num[adaptive_level], sample_pos[adaptive_level],
+//       sample_dir[adaptive_level], and momentum_factors[adaptive_level] have been set.
+//   Assumes CalculateFormulaCoefficients() has allocated arrays to be set, with room for all
+//       samples along the ray starting at r_start.
+//   Fills one record per sample in order of increasing sample index, with cut samples having no
+//       coupling.
+//   References code comparison paper 2020 ApJ 897 148 (C).
+void RadiationIntegrator::CalculateFormulaCoefficientsRay(int m, int r_start)
+{
+  // Check number of steps
+  int num_steps = sample_num[adaptive_level](m);
+  if (num_steps <= 0)
+    return;
+
+  // Set pixel to NaN if ray has problem
+  if (fallback_nan and sample_flags[adaptive_level](m))
+  {
+    for (int r_nan = r_start; r_nan < r_start + num_steps; r_nan++)
+      for (int l = 0; l < image_num_frequencies; l++)
       {
-        j_i[adaptive_level](m,n) = std::numeric_limits<double>::quiet_NaN();
-        alpha_i[adaptive_level](m,n) = std::numeric_limits<double>::quiet_NaN();
+        j_i[adaptive_level](r_nan,l) = std::numeric_limits<double>::quiet_NaN();
+        alpha_i[adaptive_level](r_nan,l) = std::numeric_limits<double>::quiet_NaN();
       }
-      continue;
+    return;
+  }
+
+  // Zero records
+  for (int r_zero = r_start; r_zero < r_start + num_steps; r_zero++)
+    for (int l = 0; l < image_num_frequencies; l++)
+    {
+      j_i[adaptive_level](r_zero,l) = 0.0;
+      alpha_i[adaptive_level](r_zero,l) = 0.0;
     }
 
-    // Go through samples
-    for (int n = 0; n < num_steps; n++)
+  // Go through samples
+  for (int n = 0; n < num_steps; n++)
+  {
+    // Locate record
+    int s = r_start + n;
+
+    // Extract geodesic position and momentum
+    double x = SamplePosition(m,n,1);
+    double y = SamplePosition(m,n,2);
+    double z = SamplePosition(m,n,3);
+    double k_0 = SampleDirection(m,n,0);
+    double k_1 = SampleDirection(m,n,1);
+    double k_2 = SampleDirection(m,n,2);
+    double k_3 = SampleDirection(m,n,3);
+
+    // Cut outside camera radius
+    double r = RadialGeodesicCoordinate(x, y, z);
+    if (r > camera_r)
+      continue;
+
+    // Cut camera plane
+    if (cut_omit_near or cut_omit_far)
     {
-      // Extract geodesic position and momentum
-      double x = sample_pos[adaptive_level](m,n,1);
-      double y = sample_pos[adaptive_level](m,n,2);
-      double z = sample_pos[adaptive_level](m,n,3);
-      double k_0 = sample_dir[adaptive_level](m,n,0);
-      double k_1 = sample_dir[adaptive_level](m,n,1);
-      double k_2 = sample_dir[adaptive_level](m,n,2);
-      double k_3 = sample_dir[adaptive_level](m,n,3);
-
-      // Cut outside camera radius
-      double r = RadialGeodesicCoordinate(x, y, z);
-      if (r > camera_r)
+      double dot_product = x * camera_x[1] + y * camera_x[2] + z * camera_x[3];
+      if ((cut_omit_near and dot_product > 0.0) or (cut_omit_far and dot_product < 0.0))
         continue;
+    }
 
-      // Cut camera plane
-      if (cut_omit_near or cut_omit_far)
-      {
-        double dot_product = x * camera_x[1] + y * camera_x[2] + z * camera_x[3];
-        if ((cut_omit_near and dot_product > 0.0) or (cut_omit_far and dot_product < 0.0))
-          continue;
-      }
+    // Cut spheres
+    if ((cut_omit_in >= 0.0 and r < cut_omit_in) or (cut_omit_out >= 0.0 and r > cut_omit_out))
+      continue;
 
-      // Cut spheres
-      if ((cut_omit_in >= 0.0 and r < cut_omit_in) or (cut_omit_out >= 0.0 and r > cut_omit_out))
+    // Cut with respect to midplane
+    if (cut_midplane_theta > 0.0 or cut_midplane_theta < 0.0)
+    {
+      double th = std::acos(z / r);
+      if ((cut_midplane_theta > 0.0 and std::abs(th - Math::pi / 2.0) > cut_midplane_theta)
+          or (cut_midplane_theta < 0.0 and std::abs(th - Math::pi / 2.0) < -cut_midplane_theta))
         continue;
+    }
+    if ((cut_midplane_z > 0.0 and std::abs(z) > cut_midplane_z)
+        or (cut_midplane_z < 0.0 and std::abs(z) < -cut_midplane_z))
+      continue;
 
-      // Cut with respect to midplane
-      if (cut_midplane_theta > 0.0 or cut_midplane_theta < 0.0)
-      {
-        double th = std::acos(z / r);
-        if ((cut_midplane_theta > 0.0 and std::abs(th - Math::pi / 2.0) > cut_midplane_theta)
-            or (cut_midplane_theta < 0.0 and std::abs(th - Math::pi / 2.0) < -cut_midplane_theta))
-        {
-          sample_cut[adaptive_level](m,n) = true;
-          continue;
-        }
-      }
-      if ((cut_midplane_z > 0.0 and std::abs(z) > cut_midplane_z)
-          or (cut_midplane_z < 0.0 and std::abs(z) < -cut_midplane_z))
-      {
-        sample_cut[adaptive_level](m,n) = true;
+    // Cut arbitrary plane
+    if (cut_plane)
+    {
+      double dot_product = (x - cut_plane_origin_x) * cut_plane_normal_x
+          + (y - cut_plane_origin_y) * cut_plane_normal_y
+          + (z - cut_plane_origin_z) * cut_plane_normal_z;
+      if (dot_product < 0.0)
         continue;
-      }
-
-      // Cut arbitrary plane
-      if (cut_plane)
-      {
-        double dot_product = (x - cut_plane_origin_x) * cut_plane_normal_x
-            + (y - cut_plane_origin_y) * cut_plane_normal_y
-            + (z - cut_plane_origin_z) * cut_plane_normal_z;
-        if (dot_product < 0.0)
-          continue;
-      }
+    }
 
-      // Calculate curvilinear coordinates
-      double rr = std::sqrt(r * r - z * z);
-      double cth = z / r;
-      double sth = std::sqrt(1.0 - cth * cth);
-      double ph = std::atan2(y, x) - std::atan(bh_a / r);
-      double sph = std::sin(ph);
-      double cph = std::cos(ph);
-
-      // Calculate metric
-      double delta = r * r - 2.0 * bh_m * r + bh_a * bh_a;
-      double sigma = r * r + bh_a * bh_a * cth * cth;
-      double gtt_bl = -(1.0 + 2.0 * bh_m * r * (r * r + bh_a * bh_a) / (delta * sigma));
-      double gtph_bl = -2.0 * bh_m * bh_a * r / (delta * sigma);
-      double grr_bl = delta / sigma;
-      double gthth_bl = 1.0 / sigma;
-      double gphph_bl = (sigma - 2.0 * bh_m * r) / (delta * sigma * sth * sth);
-
-      // Calculate angular momentum (C 6)
-      double ll = formula_l0 / (1.0 + rr) * std::pow(rr, 1.0 + formula_q);
-
-      // Calculate 4-velocity (C 7-8)
-      double u_norm = 1.0 / std::sqrt(-gtt_bl + 2.0 * gtph_bl * ll - gphph_bl * ll * ll);
-      double u_t_bl = -u_norm;
-      double u_r_bl = 0.0;
-      double u_th_bl = 0.0;
-      double u_ph_bl = u_norm * ll;
-      double ut_bl = gtt_bl * u_t_bl + gtph_bl * u_ph_bl;
-      double ur_bl = grr_bl * u_r_bl;
-      double uth_bl = gthth_bl * u_th_bl;
-      double uph_bl = gtph_bl * u_t_bl + gphph_bl * u_ph_bl;
-      double ut = ut_bl + 2.0 * bh_m * r / delta * ur_bl;
-      double ur = ur_bl;
-      double uth = uth_bl;
-      double uph = uph_bl + bh_a / delta * ur_bl;
-      double u0 = ut;
-      double u1 =
-          sth * cph * ur + cth * (r * cph - bh_a * sph) * uth + sth * (-r * sph - bh_a * cph) * uph;
-      double u2 =
-          sth * sph * ur + cth * (r * sph + bh_a * cph) * uth + sth * (r * cph - bh_a * sph) * uph;
-      double u3 = cth * ur - r * sth * uth;
-
-      // Calculate fluid-frame number density (C 5)
-      double n_n0_fluid =
-          std::exp(-0.5 * (r * r / (formula_r0 * formula_r0) + formula_h * formula_h * cth * cth));
-
-      // Go through frequencies
-      for (int l = 0; l < image_num_frequencies; l++)
-      {
-        // Calculate frequency in CGS units
-        double nu_fluid_cgs = -(u0 * k_0 + u1 * k_1 + u2 * k_2 + u3 * k_3) * image_frequencies(l)
-            * momentum_factors[adaptive_level](m);
-
-        // Calculate emission coefficient in CGS units (C 9-10)
-        double j_nu_fluid_cgs =
-            formula_cn0 * n_n0_fluid * std::pow(nu_fluid_cgs / formula_nup, -formula_alpha);
-        j_i[adaptive_level](l,m,n) = j_nu_fluid_cgs / (nu_fluid_cgs * nu_fluid_cgs);
-
-        // Calculate absorption coefficient in CGS units (C 11-12)
-        double alpha_nu_fluid_cgs = formula_a * formula_cn0 * n_n0_fluid
-            * std::pow(nu_fluid_cgs / formula_nup, -formula_beta - formula_alpha);
-        alpha_i[adaptive_level](l,m,n) = alpha_nu_fluid_cgs * nu_fluid_cgs;
-      }
+    // Calculate curvilinear coordinates
+    double rr = std::sqrt(r * r - z * z);
+    double cth = z / r;
+    double sth = std::sqrt(1.0 - cth * cth);
+    double ph = std::atan2(y, x) - std::atan(bh_a / r);
+    double sph = std::sin(ph);
+    double cph = std::cos(ph);
+
+    // Calculate metric
+    double delta = r * r - 2.0 * bh_m * r + bh_a * bh_a;
+    double sigma = r * r + bh_a * bh_a * cth * cth;
+    double gtt_bl = -(1.0 + 2.0 * bh_m * r * (r * r + bh_a * bh_a) / (delta * sigma));
+    double gtph_bl = -2.0 * bh_m * bh_a * r / (delta * sigma);
+    double grr_bl = delta / sigma;
+    double gthth_bl = 1.0 / sigma;
+    double gphph_bl = (sigma - 2.0 * bh_m * r) / (delta * sigma * sth * sth);
+
+    // Calculate angular momentum (C 6)
+    double ll = formula_l0 / (1.0 + rr) * std::pow(rr, 1.0 + formula_q);
+
+    // Calculate 4-velocity (C 7-8)
+    double u_norm = 1.0 / std::sqrt(-gtt_bl + 2.0 * gtph_bl * ll - gphph_bl * ll * ll);
+    double u_t_bl = -u_norm;
+    double u_r_bl = 0.0;
+    double u_th_bl = 0.0;
+    double u_ph_bl = u_norm * ll;
+    double ut_bl = gtt_bl * u_t_bl + gtph_bl * u_ph_bl;
+    double ur_bl = grr_bl * u_r_bl;
+    double uth_bl = gthth_bl * u_th_bl;
+    double uph_bl = gtph_bl * u_t_bl + gphph_bl * u_ph_bl;
+    double ut = ut_bl + 2.0 * bh_m * r / delta * ur_bl;
+    double ur = ur_bl;
+    double uth = uth_bl;
+    double uph = uph_bl + bh_a / delta * ur_bl;
+    double u0 = ut;
+    double u1 =
+        sth * cph * ur + cth * (r * cph - bh_a * sph) * uth + sth * (-r * sph - bh_a * cph) * uph;
+    double u2 =
+        sth * sph * ur + cth * (r * sph + bh_a * cph) * uth + sth * (r * cph - bh_a * sph) * uph;
+    double u3 = cth * ur - r * sth * uth;
+
+    // Calculate fluid-frame number density (C 5)
+    double n_n0_fluid =
+        std::exp(-0.5 * (r * r / (formula_r0 * formula_r0) + formula_h * formula_h * cth * cth));
+
+    // Go through frequencies
+    for (int l = 0; l < image_num_frequencies; l++)
+    {
+      // Calculate frequency in CGS units
+      double nu_fluid_cgs = -(u0 * k_0 + u1 * k_1 + u2 * k_2 + u3 * k_3) * image_frequencies(l)
+          * momentum_factors[adaptive_level](m);
+
+      // Calculate emission coefficient in CGS units (C 9-10)
+      double j_nu_fluid_cgs =
+          formula_cn0 * n_n0_fluid * std::pow(nu_fluid_cgs / formula_nup, -formula_alpha);
+      j_i[adaptive_level](s,l) = j_nu_fluid_cgs / (nu_fluid_cgs * nu_fluid_cgs);
+
+      // Calculate absorption coefficient in CGS units (C 11-12)
+      double alpha_nu_fluid_cgs = formula_a * formula_cn0 * n_n0_fluid
+          * std::pow(nu_fluid_cgs / formula_nup, -formula_beta - formula_alpha);
+      alpha_i[adaptive_level](s,l) = alpha_nu_fluid_cgs * nu_fluid_cgs;
     }
   }
   return;
@@ -0,0 +1,273 @@
+// Blacklight radiation integrator - tabulated synchrotron fitting functions
+
+// C++ headers
+#include <algorithm>  // min
+#include <cmath>      // abs, cos, exp, log, log1p, pow, sin, sqrt, tanh
+#include <cstring>    // memcmp
+#include <fstream>    // ifstream, ofstream
+#include <ios>        // ios_base
+
+// Blacklight headers
+#include "radiation_integrator.hpp"
+#include "../utils/array.hpp"       // Array
+#include "../utils/exceptions.hpp"  // BlacklightException, BlacklightWarning
+#include "../utils/file_io.hpp"     // ReadBinary, WriteBinary
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for tabulating synchrotron fitting functions
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes precalculated kappa_* values have been set if plasma_kappa_frac != 0.0.
+//   Allocates and initializes plasma_tables.
+//   All tables share the abscissa u = log(X), sampled uniformly on
+//       [-plasma_table_range, plasma_table_range], where X = nu / nu_s for thermal quantities and
+//       X = nu / nu_kappa for kappa-distribution quantities.
+//   Thermal tables hold f_m and Delta J_5 from (M 35-37), which depend only on X.
+//   Kappa-distribution emissivities and absorptivities combine low- and high-frequency power laws
+//       via (a^(-x) + b^(-x))^(-1/x); with prefactors depending only on the sample divided out,
+//       the logarithm of each such combination depends only on u and is tabulated.
+//   The V tables are tabulated without their pitch-angle factors, which enter as a shift in u.
+//   Kappa-distribution rotativities are tabulated as the kappa-interpolated bracketed factors of
+//       (M 51-54), excluding prefactors depending on the sample.
+//   Tables not needed for the requested images are left zeroed.
+void RadiationIntegrator::CalculatePlasmaTables()
+{
+  // Allocate tables
+  plasma_tables.Allocate(plasma_table_num, plasma_table_n);
+  plasma_tables.Zero();
+  double du = 2.0 * plasma_table_range / (plasma_table_n - 1);
+  bool polarized = image_light and image_polarization;
+
+  // Go through abscissas
+  for (int ind = 0; ind < plasma_table_n; ind++)
+  {
+    double u = -plasma_table_range + ind * du;
+    double xx = std::exp(u);
+
+    // Tabulate thermal rotativity factors (M 35-37)
+    if (plasma_thermal_frac != 0.0 and polarized)
+    {
+      double xx_neg_1_2 = 1.0 / std::sqrt(xx);
+      double var_a = 2.011 * std::exp(-19.78 * std::pow(xx, -0.5175));
+      double var_b = std::cos(39.89 * xx_neg_1_2) * std::exp(-70.16 * std::pow(xx, -0.6));
+      double var_c = 0.011 * std::exp(-1.69 * xx_neg_1_2);
+      double var_d = 0.003135 * std::pow(xx, 4.0 / 3.0);
+      double var_e = 0.5 * (1.0 + std::tanh(10.0 * std::log(0.6648 * xx_neg_1_2)));
+      double f_0 = var_a - var_b - var_c;
+      plasma_tables(plasma_table_thermal_rho_q,ind) = f_0 + (var_c - var_d) * var_e;
+      plasma_tables(plasma_table_thermal_rho_v,ind) =
+          0.4379 * std::log(1.0 + 1.3414 * std::pow(xx, -0.7515));
+    }
+
+    // Tabulate kappa-distribution emissivities and absorptivities (M 43-50)
+    if (plasma_kappa_frac != 0.0)
+    {
+      double jj_low = std::log(kappa_jj_low) + u / 3.0;
+      double jj_high = std::log(kappa_jj_high) - (plasma_kappa - 2.0) / 2.0 * u;
+      double aa_low = std::log(kappa_aa_low) - 2.0 / 3.0 * u;
+      double aa_high = std::log(kappa_aa_high) - (1.0 + plasma_kappa) / 2.0 * u;
+      plasma_tables(plasma_table_kappa_jj_i,ind) = CombineLogFits(jj_low, jj_high, kappa_jj_x_i);
+      plasma_tables(plasma_table_kappa_aa_i,ind) =
+          CombineLogFits(aa_low, aa_high + std::log(kappa_aa_high_i), kappa_aa_x_i);
+      if (polarized)
+      {
+        plasma_tables(plasma_table_kappa_jj_q,ind) = CombineLogFits(jj_low
+            + std::log(kappa_jj_low_q), jj_high + std::log(kappa_jj_high_q), kappa_jj_x_q);
+        plasma_tables(plasma_table_kappa_jj_v,ind) = CombineLogFits(jj_low
+            + std::log(kappa_jj_low_v) - 0.35 * u, jj_high + std::log(kappa_jj_high_v) - 0.5 * u,
+            kappa_jj_x_v);
+        plasma_tables(plasma_table_kappa_aa_q,ind) = CombineLogFits(aa_low
+            + std::log(kappa_aa_low_q), aa_high + std::log(kappa_aa_high_q), kappa_aa_x_q);
+        plasma_tables(plasma_table_kappa_aa_v,ind) = CombineLogFits(aa_low
+            + std::log(kappa_aa_low_v) - 0.35 * u, aa_high + std::log(kappa_aa_high_v) - 0.5 * u,
+            kappa_aa_x_v);
+      }
+    }
+
+    // Tabulate kappa-distribution rotativity factors (M 51-54)
+    if (plasma_kappa_frac != 0.0 and polarized)
+    {
+      double var_c = 1.0 / std::sqrt(xx);
+      double rho_q_low = kappa_rho_q_low_a * (1.0 - std::exp(kappa_rho_q_low_b
+          * std::pow(xx, 0.84)) - std::sin(kappa_rho_q_low_c * xx)
+          * std::exp(kappa_rho_q_low_d * std::pow(xx, kappa_rho_q_low_e)));
+      double rho_q_high = kappa_rho_q_high_a * (1.0 - std::exp(kappa_rho_q_high_b
+          * std::pow(xx, 0.84)) - std::sin(kappa_rho_q_high_c * xx)
+          * std::exp(kappa_rho_q_high_d * std::pow(xx, kappa_rho_q_high_e)));
+      double rho_v_low =
+          kappa_rho_v_low_a * (1.0 - 0.17 * std::log(1.0 + kappa_rho_v_low_b * var_c));
+      double rho_v_high =
+          kappa_rho_v_high_a * (1.0 - 0.17 * std::log(1.0 + kappa_rho_v_high_b * var_c));
+      plasma_tables(plasma_table_kappa_rho_q,ind) =
+          (1.0 - kappa_rho_frac) * rho_q_low + kappa_rho_frac * rho_q_high;
+      plasma_tables(plasma_table_kappa_rho_v,ind) =
+          (1.0 - kappa_rho_frac) * rho_v_low + kappa_rho_frac * rho_v_high;
+    }
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for loading tabulated synchrotron fitting functions from file
+// Inputs: (none)
+// Outputs:
+//   returned value: flag indicating tables were loaded
+// Notes:
+//   Assumes precalculated kappa_* values have been set if plasma_kappa_frac != 0.0.
+//   On success, allocates and sets plasma_tables.
+//   Returns false without changing state if file does not exist or was generated with different
+//       parameters.
+bool RadiationIntegrator::LoadPlasmaTables()
+{
+  // Open file
+  std::ifstream table_stream(plasma_table_file.value(), std::ios_base::in | std::ios_base::binary);
+  if (not table_stream.is_open())
+    return false;
+
+  // Check format
+  char magic[8] = {};
+  char magic_expected[8] = {'B', 'L', 'P', 'L', 'T', 'A', 'B', 'L'};
+  ReadBinary(&table_stream, magic, 8);
+  int byte_order = 0;
+  ReadBinary(&table_stream, &byte_order);
+  if (not table_stream.good() or std::memcmp(magic, magic_expected, 8) != 0
+      or byte_order != 0x01020304)
+  {
+    BlacklightWarning("Plasma table file has unrecognized format; generating new tables.");
+    return false;
+  }
+
+  // Check parameters
+  int num_params = 0;
+  ReadBinary(&table_stream, &num_params);
+  double params_file[plasma_table_num_params];
+  double params[plasma_table_num_params];
+  SetPlasmaTableParameters(params);
+  if (not table_stream.good() or num_params != plasma_table_num_params)
+  {
+    BlacklightWarning("Plasma table file has unrecognized format; generating new tables.");
+    return false;
+  }
+  ReadBinary(&table_stream, params_file, plasma_table_num_params);
+  if (not table_stream.good()
+      or std::memcmp(params_file, params, sizeof(double) * plasma_table_num_params) != 0)
+  {
+    BlacklightWarning("Plasma table file does not match plasma parameters; generating new tables.");
+    return false;
+  }
+
+  // Read tables
+  plasma_tables.Allocate(plasma_table_num, plasma_table_n);
+  ReadBinary(&table_stream, plasma_tables.data, plasma_tables.n_tot);
+  if (not table_stream.good())
+  {
+    plasma_tables.Deallocate();
+    BlacklightWarning("Plasma table file is incomplete; generating new tables.");
+    return false;
+  }
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for saving tabulated synchrotron fitting functions to file
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes plasma_tables has been set.
+//   Overwrites file specified by plasma_table_file.
+//   File contains magic string, byte-order check, parameters set by SetPlasmaTableParameters(),
+//       and plasma_tables data, whose dimensions are among the parameters.
+void RadiationIntegrator::SavePlasmaTables()
+{
+  // Open file
+  std::ofstream table_stream(plasma_table_file.value(),
+      std::ios_base::out | std::ios_base::binary);
+  if (not table_stream.is_open())
+    throw BlacklightException("Could not open plasma table file.");
+
+  // Write header
+  char magic[8] = {'B', 'L', 'P', 'L', 'T', 'A', 'B', 'L'};
+  WriteBinary(&table_stream, magic, 8);
+  WriteBinary(&table_stream, 0x01020304);
+  double params[plasma_table_num_params];
+  SetPlasmaTableParameters(params);
+  WriteBinary(&table_stream, plasma_table_num_params);
+  WriteBinary(&table_stream, params, plasma_table_num_params);
+
+  // Write tables
+  WriteBinary(&table_stream, plasma_tables.data, plasma_tables.n_tot);
+  if (not table_stream.good())
+    throw BlacklightException("Could not write plasma table file.");
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for collecting parameters that determine tabulated synchrotron fitting functions
+// Inputs: (none)
+// Outputs:
+//   params: values of parameters
+// Notes:
+//   Flags record which tables are populated.
+//   Power-law parameters do not enter any table and so are not included.
+void RadiationIntegrator::SetPlasmaTableParameters(double params[plasma_table_num_params]) const
+{
+  bool polarized = image_light and image_polarization;
+  int n = 0;
+  params[n++] = static_cast<double>(plasma_table_num);
+  params[n++] = static_cast<double>(plasma_table_n);
+  params[n++] = plasma_table_range;
+  params[n++] = plasma_thermal_frac != 0.0 and polarized ? 1.0 : 0.0;
+  params[n++] = plasma_kappa_frac != 0.0 ? (polarized ? 2.0 : 1.0) : 0.0;
+  params[n++] = plasma_kappa_frac != 0.0 ? plasma_kappa : 0.0;
+  params[n++] = plasma_kappa_frac != 0.0 ? plasma_w : 0.0;
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for evaluating tabulated synchrotron fitting function
+// Inputs:
+//   table: index of table
+//   u: logarithm of frequency ratio
+// Outputs:
+//   returned value: linearly interpolated table value
+// Notes:
+//   Assumes plasma_tables has been set.
+//   Values beyond the tabulated range are linearly extrapolated from the outermost two points.
+//     Combined power laws approach straight lines in u at both ends, with deviations smaller than
+//         exp(-x * plasma_table_range / 2) for the smallest fit exponent x.
+//     Rotativity factors approach constants or straight lines well within the tabulated range.
+//   Interpolation error is bounded by du^2 / 8 times the maximum second derivative in u.
+//     For the combined power laws this derivative is at most x * s^2 / 4, with s the difference
+//         in power-law slopes, giving relative errors under 10^-4 for kappa in [3.5, 5].
+//   NaN input produces NaN output.
+double RadiationIntegrator::PlasmaTableValue(int table, double u) const
+{
+  double pos = (u + plasma_table_range) / (2.0 * plasma_table_range) * (plasma_table_n - 1);
+  int ind = pos >= 1.0 ? (pos < plasma_table_n - 1 ? static_cast<int>(pos) : plasma_table_n - 2)
+      : 0;
+  double frac = pos - ind;
+  return (1.0 - frac) * plasma_tables(table,ind) + frac * plasma_tables(table,ind+1);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for combining power-law fits in logarithmic form
+// Inputs:
+//   log_low: logarithm of low-frequency fit a
+//   log_high: logarithm of high-frequency fit b
+//   x: combination exponent
+// Outputs:
+//   returned value: log((a^(-x) + b^(-x))^(-1/x))
+// Notes:
+//   Factors out the smaller of a and b so as not to overflow.
+double RadiationIntegrator::CombineLogFits(double log_low, double log_high, double x) const
+{
+  double log_min = std::min(log_low, log_high);
+  return log_min - std::log1p(std::exp(-x * std::abs(log_high - log_low))) / x;
+}
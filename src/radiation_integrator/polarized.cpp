@@ -6,12 +6,13 @@
 #include <complex>    // complex
 
 // Library headers
-#include <omp.h>  // pragmas
+#include <omp.h>  // pragmas, omp_get_thread_num, omp_get_wtime
 
 // Blacklight headers
 #include "radiation_integrator.hpp"
 #include "../blacklight.hpp"         // Math, Physics, enums
 #include "../utils/array.hpp"        // Array
+#include "../utils/profiler.hpp"     // profiling functions
 
 //--------------------------------------------------------------------------------------------------
 
@@ -21,20 +22,21 @@
 // Notes:
 //   Assumes camera_pos[adaptive_level], camera_dir[adaptive_level], sample_num[adaptive_level],
 //       sample_pos[adaptive_level], sample_dir[adaptive_level], sample_len[adaptive_level],
-//       sample_uu1[adaptive_level], sample_uu2[adaptive_level], sample_uu3[adaptive_level],
-//       sample_bb1[adaptive_level], sample_bb2[adaptive_level], sample_bb3[adaptive_level],
+//       sample_status[adaptive_level], sample_offsets[adaptive_level], sample_prim[adaptive_level],
 //       j_i[adaptive_level], j_q[adaptive_level], j_v[adaptive_level], alpha_i[adaptive_level],
 //       alpha_q[adaptive_level], alpha_v[adaptive_level], rho_q[adaptive_level],
 //       rho_v[adaptive_level], and momentum_factors[adaptive_level] have been set.
 //   Assumes cell_values[adaptive_level] has been set if image_lambda_ave == true or
 //       image_emission_ave == true or image_tau_int == true.
 //   Allocates and initializes image[adaptive_level].
-//   Dealllocates sample_uu1[adaptive_level], sample_uu2[adaptive_level],
-//       sample_uu3[adaptive_level], sample_bb1[adaptive_level], sample_bb2[adaptive_level],
-//       sample_bb3[adaptive_level], j_i[adaptive_level], j_q[adaptive_level], j_v[adaptive_level],
-//       alpha_i[adaptive_level], alpha_q[adaptive_level], alpha_v[adaptive_level],
-//       rho_q[adaptive_level], and rho_v[adaptive_level] if adaptive_level > 0.
-//   Deallocates cell_values[adaptive_level] if render_num_images <= 0 and adaptive_level > 0.
+//   If simulation_fused_coeffs == true, calculates coefficients along each ray just before
+//       integrating it, using records reserved for the thread handling the ray.
+//   Dealllocates sample_prim[adaptive_level], j_i[adaptive_level], j_q[adaptive_level],
+//       j_v[adaptive_level], alpha_i[adaptive_level], alpha_q[adaptive_level],
+//       alpha_v[adaptive_level], rho_q[adaptive_level], and rho_v[adaptive_level] if
+//       adaptive_level > 0.
+//   Deallocates cell_values[adaptive_level] and render_lengths[adaptive_level] if
+//       adaptive_level > 0.
 //   References grtrans paper 2016 MNRAS 462 115 (G)
 //   References symphony paper 2016 ApJ 822 34 (S).
 //     J_V in (S 31) has an overall sign error that is corrected here and in the symphony code.
@@ -51,6 +53,7 @@
 void RadiationIntegrator::IntegratePolarizedRadiation()
 {
   // Allocate image array
+  double time_start = omp_get_wtime();
   int num_pix = camera_num_pix;
   if (adaptive_level > 0)
     num_pix = block_counts[adaptive_level] * block_num_pix;
@@ -86,11 +89,14 @@ void RadiationIntegrator::IntegratePolarizedRadiation()
     int n_start;
 
     // Go through frequencies and pixels
-    #pragma omp for schedule(static)
+    ProfileCounts profile_counts;
+    double profile_time_start = omp_get_wtime();
+    #pragma omp for schedule(runtime) nowait
     for (int m = 0; m < num_pix; m++)
     {
       // Check number of steps
       int num_steps = sample_num[adaptive_level](m);
+      profile_counts.samples += num_steps;
       if (num_steps <= 0)
         continue;
       int n_start = -1;
@@ -99,6 +105,19 @@ void RadiationIntegrator::IntegratePolarizedRadiation()
         FindZTurnings(m, num_steps, n_start, z_turnings_count);
       if (n_start < 0)
         n_start = 0;
+      int s_start = sample_offsets[adaptive_level](m);
+      for (int n = 0; n < n_start; n++)
+        if (SampleKept(m, n))
+          s_start++;
+
+      // Calculate coefficients along ray
+      int record_shift = 0;
+      if (simulation_fused_coeffs)
+      {
+        int r_start = omp_get_thread_num() * fused_num_records;
+        CalculateSimulationCoefficientsRay(m, r_start);
+        record_shift = r_start - sample_offsets[adaptive_level](m);
+      }
 
       for (int l = 0; l < image_num_frequencies; l++)
       {
@@ -114,42 +133,48 @@ void RadiationIntegrator::IntegratePolarizedRadiation()
         // Prepare integrated quantities
         double integrated_lambda = 0.0;
         double integrated_emission = 0.0;
-        double x1_init = sample_pos[adaptive_level](m,0,1);
-        double x2_init = sample_pos[adaptive_level](m,0,2);
-        double x3_init = sample_pos[adaptive_level](m,0,3);
+        double x1_init = SamplePosition(m,0,1);
+        double x2_init = SamplePosition(m,0,2);
+        double x3_init = SamplePosition(m,0,3);
         bool plane_sign =
             camera_x[1] * x1_init + camera_x[2] * x2_init + camera_x[3] * x3_init > 0.0;
         int crossings_count = 0;
 
         // Go through samples
+        int s_next = s_start;
         for (int n = n_start; n < num_steps; n++)
         {
           // Extract affine step size
-          double delta_lambda = sample_len[adaptive_level](m,n);
+          double delta_lambda = SampleLength(m,n);
           double delta_lambda_new = delta_lambda;
           if (n < num_steps - 1)
-            delta_lambda_new = sample_len[adaptive_level](m,n+1);
+            delta_lambda_new = SampleLength(m,n+1);
           double delta_lambda_cgs =
               delta_lambda * x_unit / (image_frequencies(l) * momentum_factors[adaptive_level](m));
 
           // Extract geodesic position and covariant momentum
-          double t_cgs = sample_pos[adaptive_level](m,n,0) * t_unit;
-          double x1 = sample_pos[adaptive_level](m,n,1);
-          double x2 = sample_pos[adaptive_level](m,n,2);
-          double x3 = sample_pos[adaptive_level](m,n,3);
+          double t_cgs = SamplePosition(m,n,0) * t_unit;
+          double x1 = SamplePosition(m,n,1);
+          double x2 = SamplePosition(m,n,2);
+          double x3 = SamplePosition(m,n,3);
           double kcov[4];
-          kcov[0] = sample_dir[adaptive_level](m,n,0);
-          kcov[1] = sample_dir[adaptive_level](m,n,1);
-          kcov[2] = sample_dir[adaptive_level](m,n,2);
-          kcov[3] = sample_dir[adaptive_level](m,n,3);
-
-          // Extract model variables
-          double uu1_sim = sample_uu1[adaptive_level](m,n);
-          double uu2_sim = sample_uu2[adaptive_level](m,n);
-          double uu3_sim = sample_uu3[adaptive_level](m,n);
-          double bb1_sim = sample_bb1[adaptive_level](m,n);
-          double bb2_sim = sample_bb2[adaptive_level](m,n);
-          double bb3_sim = sample_bb3[adaptive_level](m,n);
+          kcov[0] = SampleDirection(m,n,0);
+          kcov[1] = SampleDirection(m,n,1);
+          kcov[2] = SampleDirection(m,n,2);
+          kcov[3] = SampleDirection(m,n,3);
+
+          // Extract model variables, treating cut samples as having vanishing values
+          bool kept = SampleKept(m, n);
+          int s = kept ? s_next++ : -1;
+          const float vanishing_vals[sample_ind_kappa+1] = {};
+          const float *sample_vals = kept ? &sample_prim[adaptive_level](s,0) : vanishing_vals;
+          int r = kept ? s + record_shift : -1;
+          double uu1_sim = sample_vals[sample_ind_uu1];
+          double uu2_sim = sample_vals[sample_ind_uu2];
+          double uu3_sim = sample_vals[sample_ind_uu3];
+          double bb1_sim = sample_vals[sample_ind_bb1];
+          double bb2_sim = sample_vals[sample_ind_bb2];
+          double bb3_sim = sample_vals[sample_ind_bb3];
 
           // Calculate geodesic metric and connection
           CovariantGeodesicMetric(x1, x2, x3, gcov);
@@ -301,20 +326,20 @@ void RadiationIntegrator::IntegratePolarizedRadiation()
 
           // Extract emissivity coefficients
           double j_s[4] = {};
-          j_s[0] = j_i[adaptive_level](l,m,n);
-          j_s[1] = j_q[adaptive_level](l,m,n);
-          j_s[3] = j_v[adaptive_level](l,m,n);
+          j_s[0] = kept ? j_i[adaptive_level](r,l) : 0.0;
+          j_s[1] = kept ? j_q[adaptive_level](r,l) : 0.0;
+          j_s[3] = kept ? j_v[adaptive_level](r,l) : 0.0;
 
           // Extract absorptivity coefficients
           double alpha_s[4] = {};
-          alpha_s[0] = alpha_i[adaptive_level](l,m,n);
-          alpha_s[1] = alpha_q[adaptive_level](l,m,n);
-          alpha_s[3] = alpha_v[adaptive_level](l,m,n);
+          alpha_s[0] = kept ? alpha_i[adaptive_level](r,l) : 0.0;
+          alpha_s[1] = kept ? alpha_q[adaptive_level](r,l) : 0.0;
+          alpha_s[3] = kept ? alpha_v[adaptive_level](r,l) : 0.0;
 
           // Extract rotativity coefficients
           double rho_s[4] = {};
-          rho_s[1] = rho_q[adaptive_level](l,m,n);
-          rho_s[3] = rho_v[adaptive_level](l,m,n);
+          rho_s[1] = kept ? rho_q[adaptive_level](r,l) : 0.0;
+          rho_s[3] = kept ? rho_v[adaptive_level](r,l) : 0.0;
 
           // Calculate optical depth
           double delta_tau = alpha_s[0] * delta_lambda_cgs;
@@ -343,21 +368,21 @@ void RadiationIntegrator::IntegratePolarizedRadiation()
             integrated_emission += j_s[0] * delta_lambda_cgs;
           if (image_tau)
             image[adaptive_level](image_offset_tau+l,m) += delta_tau;
-          if (image_lambda_ave and not std::isnan(cell_values[adaptive_level](0,m,n)))
+          if (image_lambda_ave and kept and not std::isnan(cell_values[adaptive_level](0,r)))
             for (int a = 0; a < CellValues::num_cell_values; a++)
             {
               int index = image_offset_lambda_ave + l * CellValues::num_cell_values + a;
               image[adaptive_level](index,m) +=
-                  cell_values[adaptive_level](a,m,n) * delta_lambda_cgs;
+                  cell_values[adaptive_level](a,r) * delta_lambda_cgs;
             }
-          if (image_emission_ave and not std::isnan(cell_values[adaptive_level](0,m,n)))
+          if (image_emission_ave and kept and not std::isnan(cell_values[adaptive_level](0,r)))
             for (int a = 0; a < CellValues::num_cell_values; a++)
             {
               int index = image_offset_emission_ave + l * CellValues::num_cell_values + a;
               image[adaptive_level](index,m) +=
-                  cell_values[adaptive_level](a,m,n) * j_s[0] * delta_lambda_cgs;
+                  cell_values[adaptive_level](a,r) * j_s[0] * delta_lambda_cgs;
             }
-          if (image_tau_int and not std::isnan(cell_values[adaptive_level](0,m,n)))
+          if (image_tau_int and kept and not std::isnan(cell_values[adaptive_level](0,r)))
           {
             if (optically_thin)
             {
@@ -367,14 +392,14 @@ void RadiationIntegrator::IntegratePolarizedRadiation()
               {
                 int index = image_offset_tau_int + l * CellValues::num_cell_values + a;
                 image[adaptive_level](index,m) = exp_neg
-                    * (image[adaptive_level](index,m) + cell_values[adaptive_level](a,m,n) * expm1);
+                    * (image[adaptive_level](index,m) + cell_values[adaptive_level](a,r) * expm1);
               }
             }
             else
               for (int a = 0; a < CellValues::num_cell_values; a++)
               {
                 int index = image_offset_tau_int + l * CellValues::num_cell_values + a;
-                image[adaptive_level](index,m) = cell_values[adaptive_level](a,m,n);
+                image[adaptive_level](index,m) = cell_values[adaptive_level](a,r);
               }
           }
           if (image_crossings and l == 0)
@@ -385,417 +410,9 @@ void RadiationIntegrator::IntegratePolarizedRadiation()
             plane_sign = plane_sign_new;
           }
 
-          // Prepare to couple to matter
-          double alpha_sq = alpha_s[1] * alpha_s[1] + alpha_s[3] * alpha_s[3];
-          double alpha_p = std::sqrt(alpha_sq);
-          double rho_sq = rho_s[1] * rho_s[1] + rho_s[3] * rho_s[3];
-          double rho_p = std::sqrt(rho_sq);
-          double ss_end[4] = {};
-
-          // Couple via splitting of rotativity from absorptivity/emissivity
-          if (image_rotation_split)
-          {
-            // Couple first half with no absorptivity
-            if (alpha_s[0] == 0.0)
-              for (int a = 0; a < 4; a++)
-                ss_end[a] = ss_start[a] + j_s[a] * delta_lambda_cgs / 2.0;
-
-            // Couple first half with no polarized absorptivity but with nonzero absorptivity
-            else if (alpha_p == 0.0)
-            {
-              // Optically thin case
-              if (optically_thin)
-              {
-                double exp_neg = std::exp(-delta_tau / 2.0);
-                double expm1 = std::expm1(delta_tau / 2.0);
-                for (int a = 0; a < 4; a++)
-                  ss_end[a] = exp_neg * (ss_start[a] + j_s[a] / alpha_s[0] * expm1);
-              }
-
-              // Optically thick case
-              else
-                for (int a = 0; a < 4; a++)
-                  ss_end[a] = j_s[a] / alpha_s[0];
-            }
-
-            // Couple first half with nonzero polarized absorptivity
-            else
-            {
-              // Optically thin case (I A14-A17)
-              if (optically_thin)
-              {
-                double exp_neg_i = std::exp(-delta_tau / 2.0);
-                double exp_neg_p = std::exp(-alpha_p * delta_lambda_cgs / 2.0);
-                double sinh_p = std::sinh(alpha_p * delta_lambda_cgs / 2.0);
-                double cosh_p = std::cosh(alpha_p * delta_lambda_cgs / 2.0);
-                double coshm1_p =
-                    0.5 * (std::expm1(alpha_p * delta_lambda_cgs / 2.0) + exp_neg_p - 1.0);
-                double alpha_ss = alpha_s[1] * ss_start[1] + alpha_s[3] * ss_start[3];
-                double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
-                double alpha_i_p_factor = 1.0 / (alpha_s[0] * alpha_s[0] - alpha_sq);
-                ss_end[0] = (ss_start[0] * cosh_p - alpha_ss / alpha_p * sinh_p) * exp_neg_i
-                    + alpha_j * alpha_i_p_factor * (-1.0 + (alpha_s[0] * sinh_p + alpha_p * cosh_p)
-                    / alpha_p * exp_neg_p) + alpha_s[0] * j_s[0] * alpha_i_p_factor * (1.0
-                    - (alpha_s[0] * cosh_p + alpha_p * sinh_p) / alpha_s[0] * exp_neg_p);
-
-                for (int a = 1; a < 4; a++)
-                {
-                  double term_1 = (ss_start[a] + alpha_s[a] * alpha_ss / alpha_sq * coshm1_p
-                      - ss_start[0] * alpha_s[a] / alpha_p * sinh_p) * exp_neg_i;
-                  double term_2 = j_s[a] * (1.0 - exp_neg_i) / alpha_s[0];
-                  double term_3 = alpha_j * alpha_s[a] / alpha_s[0] * alpha_i_p_factor * (1.0 - (1.0
-                      - alpha_s[0] * alpha_s[0] / alpha_sq - alpha_s[0] / alpha_sq * (alpha_s[0]
-                      * cosh_p + alpha_p * sinh_p)) * exp_neg_i);
-                  double term_4 = j_s[0] * alpha_s[a] / alpha_p * alpha_i_p_factor * (-alpha_p +
-                      (alpha_p * cosh_p + alpha_s[0] * sinh_p) * exp_neg_i);
-                  ss_end[a] = term_1 + term_2 + term_3 + term_4;
-                }
-              }
-
-              // Optically thick case
-              else
-              {
-                double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
-                ss_end[0] = (alpha_s[0] * j_s[0] - alpha_j) / (alpha_s[0] * alpha_s[0] - alpha_sq);
-                for (int a = 1; a < 4; a++)
-                  ss_end[a] = (j_s[a] - alpha_s[a] * ss_end[0]) / alpha_s[0];
-              }
-            }
-
-            // Ensure state is physically admissible
-            ss_end[0] = std::max(ss_end[0], 0.0);
-            double ss_pol = ss_end[1] * ss_end[1] + ss_end[2] * ss_end[2] + ss_end[3] * ss_end[3];
-            if (ss_pol > ss_end[0] * ss_end[0])
-            {
-              double factor = std::sqrt(ss_end[0] * ss_end[0] / ss_pol);
-              ss_end[1] *= factor;
-              ss_end[2] *= factor;
-              ss_end[3] *= factor;
-            }
-
-            // Reset starting Stokes parameters
-            for (int a = 0; a < 4; a++)
-              ss_start[a] = ss_end[a];
-
-            // Couple with no absorptivity but nonzero rotativity (I A2-A5)
-            if (rho_p != 0.0)
-            {
-              double cos_rho = std::cos(rho_p * delta_lambda_cgs);
-              double sin_rho = std::sin(rho_p * delta_lambda_cgs);
-              double sin_sq_rho = std::sin(rho_p * delta_lambda_cgs / 2.0);
-              sin_sq_rho = sin_sq_rho * sin_sq_rho;
-              double rho_ss = rho_s[1] * ss_start[1] + rho_s[3] * ss_start[3];
-              ss_end[0] = ss_start[0];
-              ss_end[1] = ss_start[1] * cos_rho + 2.0 * rho_s[1] * rho_ss / rho_sq * sin_sq_rho
-                  - rho_s[3] * ss_start[2] / rho_p * sin_rho;
-              ss_end[2] = ss_start[2] * cos_rho
-                  + (rho_s[3] * ss_start[1] - rho_s[1] * ss_start[3]) / rho_p * sin_rho;
-              ss_end[3] = ss_start[3] * cos_rho + 2.0 * rho_s[3] * rho_ss / rho_sq * sin_sq_rho
-                  + rho_s[1] * ss_start[2] / rho_p * sin_rho;
-            }
-
-            // Ensure state is physically admissible
-            ss_pol = ss_end[1] * ss_end[1] + ss_end[2] * ss_end[2] + ss_end[3] * ss_end[3];
-            if (ss_pol > ss_end[0] * ss_end[0])
-            {
-              double factor = std::sqrt(ss_end[0] * ss_end[0] / ss_pol);
-              ss_end[1] *= factor;
-              ss_end[2] *= factor;
-              ss_end[3] *= factor;
-            }
-
-            // Reset starting Stokes parameters
-            for (int a = 0; a < 4; a++)
-              ss_start[a] = ss_end[a];
-
-            // Couple second half with no absorptivity
-            if (alpha_s[0] == 0.0)
-              for (int a = 0; a < 4; a++)
-                ss_end[a] = ss_start[a] + j_s[a] * delta_lambda_cgs / 2.0;
-
-            // Couple second half with no polarized absorptivity but with nonzero absorptivity
-            else if (alpha_p == 0.0)
-            {
-              // Optically thin case
-              if (optically_thin)
-              {
-                double exp_neg = std::exp(-delta_tau / 2.0);
-                double expm1 = std::expm1(delta_tau / 2.0);
-                for (int a = 0; a < 4; a++)
-                  ss_end[a] = exp_neg * (ss_start[a] + j_s[a] / alpha_s[0] * expm1);
-              }
-
-              // Optically thick case
-              else
-                for (int a = 0; a < 4; a++)
-                  ss_end[a] = j_s[a] / alpha_s[0];
-            }
-
-            // Couple second half with nonzero polarized absorptivity
-            else
-            {
-              // Optically thin case (I A14-A17)
-              if (optically_thin)
-              {
-                double exp_neg_i = std::exp(-delta_tau / 2.0);
-                double exp_neg_p = std::exp(-alpha_p * delta_lambda_cgs / 2.0);
-                double sinh_p = std::sinh(alpha_p * delta_lambda_cgs / 2.0);
-                double cosh_p = std::cosh(alpha_p * delta_lambda_cgs / 2.0);
-                double coshm1_p =
-                    0.5 * (std::expm1(alpha_p * delta_lambda_cgs / 2.0) + exp_neg_p - 1.0);
-                double alpha_ss = alpha_s[1] * ss_start[1] + alpha_s[3] * ss_start[3];
-                double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
-                double alpha_i_p_factor = 1.0 / (alpha_s[0] * alpha_s[0] - alpha_sq);
-                ss_end[0] = (ss_start[0] * cosh_p - alpha_ss / alpha_p * sinh_p) * exp_neg_i
-                    + alpha_j * alpha_i_p_factor * (-1.0 + (alpha_s[0] * sinh_p + alpha_p * cosh_p)
-                    / alpha_p * exp_neg_p) + alpha_s[0] * j_s[0] * alpha_i_p_factor * (1.0
-                    - (alpha_s[0] * cosh_p + alpha_p * sinh_p) / alpha_s[0] * exp_neg_p);
-                for (int a = 1; a < 4; a++)
-                {
-                  double term_1 = (ss_start[a] + alpha_s[a] * alpha_ss / alpha_sq * coshm1_p
-                      - ss_start[0] * alpha_s[a] / alpha_p * sinh_p) * exp_neg_i;
-                  double term_2 = j_s[a] * (1.0 - exp_neg_i) / alpha_s[0];
-                  double term_3 = alpha_j * alpha_s[a] / alpha_s[0] * alpha_i_p_factor * (1.0 - (1.0
-                      - alpha_s[0] * alpha_s[0] / alpha_sq - alpha_s[0] / alpha_sq * (alpha_s[0]
-                      * cosh_p + alpha_p * sinh_p)) * exp_neg_i);
-                  double term_4 = j_s[0] * alpha_s[a] / alpha_p * alpha_i_p_factor * (-alpha_p +
-                      (alpha_p * cosh_p + alpha_s[0] * sinh_p) * exp_neg_i);
-                  ss_end[a] = term_1 + term_2 + term_3 + term_4;
-                }
-              }
-
-              // Optically thick case
-              else
-              {
-                double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
-                ss_end[0] = (alpha_s[0] * j_s[0] - alpha_j) / (alpha_s[0] * alpha_s[0] - alpha_sq);
-                for (int a = 1; a < 4; a++)
-                  ss_end[a] = (j_s[a] - alpha_s[a] * ss_end[0]) / alpha_s[0];
-              }
-            }
-          }
-
-          // Couple with no splitting
-          else
-          {
-            // Couple with no absorptivity or rotativity
-            if (alpha_s[0] == 0.0 and rho_p == 0.0)
-              for (int a = 0; a < 4; a++)
-                ss_end[a] = ss_start[a] + j_s[a] * delta_lambda_cgs;
-
-            // Couple with no polarized absorptivity or rotativity but with nonzero absorptivity
-            else if (alpha_p == 0.0 and rho_p == 0.0)
-            {
-              // Optically thin case
-              if (optically_thin)
-              {
-                double exp_neg = std::exp(-delta_tau);
-                double expm1 = std::expm1(delta_tau);
-                for (int a = 0; a < 4; a++)
-                  ss_end[a] = exp_neg * (ss_start[a] + j_s[a] / alpha_s[0] * expm1);
-              }
-
-              // Optically thick case
-              else
-                for (int a = 0; a < 4; a++)
-                  ss_end[a] = j_s[a] / alpha_s[0];
-            }
-
-            // Couple with no absorptivity but nonzero rotativity (I A2-A5)
-            else if (alpha_s[0] == 0.0)
-            {
-              double cos_rho = std::cos(rho_p * delta_lambda_cgs);
-              double sin_rho = std::sin(rho_p * delta_lambda_cgs);
-              double sin_sq_rho = std::sin(rho_p * delta_lambda_cgs / 2.0);
-              sin_sq_rho = sin_sq_rho * sin_sq_rho;
-              double rho_ss = rho_s[1] * ss_start[1] + rho_s[3] * ss_start[3];
-              ss_end[0] = ss_start[0];
-              ss_end[1] = ss_start[1] * cos_rho + 2.0 * rho_s[1] * rho_ss / rho_sq * sin_sq_rho
-                  - rho_s[3] * ss_start[2] / rho_p * sin_rho;
-              ss_end[2] = ss_start[2] * cos_rho
-                  + (rho_s[3] * ss_start[1] - rho_s[1] * ss_start[3]) / rho_p * sin_rho;
-              ss_end[3] = ss_start[3] * cos_rho + 2.0 * rho_s[3] * rho_ss / rho_sq * sin_sq_rho
-                  + rho_s[1] * ss_start[2] / rho_p * sin_rho;
-              for (int a = 0; a < 4; a++)
-                ss_end[a] += j_s[a] * delta_lambda_cgs;
-            }
-
-            // Couple with no rotativity but nonzero polarized absorptivity
-            else if (rho_p == 0.0)
-            {
-              // Optically thin case (I A14-A17)
-              if (optically_thin)
-              {
-                double exp_neg_i = std::exp(-delta_tau);
-                double exp_neg_p = std::exp(-alpha_p * delta_lambda_cgs);
-                double sinh_p = std::sinh(alpha_p * delta_lambda_cgs);
-                double cosh_p = std::cosh(alpha_p * delta_lambda_cgs);
-                double coshm1_p = 0.5 * (std::expm1(alpha_p * delta_lambda_cgs) + exp_neg_p - 1.0);
-                double alpha_ss = alpha_s[1] * ss_start[1] + alpha_s[3] * ss_start[3];
-                double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
-                double alpha_i_p_factor = 1.0 / (alpha_s[0] * alpha_s[0] - alpha_sq);
-                ss_end[0] = (ss_start[0] * cosh_p - alpha_ss / alpha_p * sinh_p) * exp_neg_i
-                    + alpha_j * alpha_i_p_factor * (-1.0 + (alpha_s[0] * sinh_p + alpha_p * cosh_p)
-                    / alpha_p * exp_neg_p) + alpha_s[0] * j_s[0] * alpha_i_p_factor * (1.0
-                    - (alpha_s[0] * cosh_p + alpha_p * sinh_p) / alpha_s[0] * exp_neg_p);
-                for (int a = 1; a < 4; a++)
-                {
-                  double term_1 = (ss_start[a] + alpha_s[a] * alpha_ss / alpha_sq * coshm1_p
-                      - ss_start[0] * alpha_s[a] / alpha_p * sinh_p) * exp_neg_i;
-                  double term_2 = j_s[a] * (1.0 - exp_neg_i) / alpha_s[0];
-                  double term_3 = alpha_j * alpha_s[a] / alpha_s[0] * alpha_i_p_factor * (1.0 - (1.0
-                      - alpha_s[0] * alpha_s[0] / alpha_sq - alpha_s[0] / alpha_sq * (alpha_s[0]
-                      * cosh_p + alpha_p * sinh_p)) * exp_neg_i);
-                  double term_4 = j_s[0] * alpha_s[a] / alpha_p * alpha_i_p_factor * (-alpha_p +
-                      (alpha_p * cosh_p + alpha_s[0] * sinh_p) * exp_neg_i);
-                  ss_end[a] = term_1 + term_2 + term_3 + term_4;
-                }
-              }
-
-              // Optically thick case
-              else
-              {
-                double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
-                ss_end[0] = (alpha_s[0] * j_s[0] - alpha_j) / (alpha_s[0] * alpha_s[0] - alpha_sq);
-                for (int a = 1; a < 4; a++)
-                  ss_end[a] = (j_s[a] - alpha_s[a] * ss_end[0]) / alpha_s[0];
-              }
-            }
-
-            // Couple with nonzero absorptivity and rotativity
-            else
-            {
-              // Calculate coefficients needed for coupling matrices
-              double alpha_rho = alpha_s[1] * rho_s[1] + alpha_s[3] * rho_s[3];
-              double alpha_sq_rho_sq = alpha_sq - rho_sq;
-              double lambda_a =
-                  std::sqrt(alpha_sq_rho_sq * alpha_sq_rho_sq / 4.0 + alpha_rho * alpha_rho);
-              double lambda_b = alpha_sq_rho_sq / 2.0;
-              double lambda_1 = std::sqrt(lambda_a + lambda_b);
-              double lambda_2 = std::sqrt(lambda_a - lambda_b);
-              double coefficient_theta = lambda_1 * lambda_1 + lambda_2 * lambda_2;
-              double s = alpha_rho >= 0.0 ? 1.0 : -1.0;
-
-              // Calculate coupling matrix 1
-              double mm_1[4][4] = {};
-              for (int a = 0; a < 4; a++)
-                mm_1[a][a] = 1.0;
-
-              // Calculate coupling matrix 2
-              double mm_2[4][4] = {};
-              mm_2[0][1] = lambda_2 * alpha_s[1] - s * lambda_1 * rho_s[1];
-              mm_2[0][3] = lambda_2 * alpha_s[3] - s * lambda_1 * rho_s[3];
-              mm_2[1][2] = s * lambda_1 * alpha_s[3] + lambda_2 * rho_s[3];
-              mm_2[1][2] = s * lambda_1 * alpha_s[1] + lambda_2 * rho_s[1];
-              mm_2[1][0] = mm_2[0][1];
-              mm_2[2][0] = mm_2[0][2];
-              mm_2[3][0] = mm_2[0][3];
-              mm_2[2][1] = -mm_2[1][2];
-              mm_2[3][1] = -mm_2[1][3];
-              mm_2[3][2] = -mm_2[2][3];
-              for (int a = 0; a < 4; a++)
-                for (int b = 0; b < 4; b++)
-                  mm_2[a][b] *= 1.0 / coefficient_theta;
-
-              // Calculate coupling matrix 3
-              double mm_3[4][4] = {};
-              mm_3[0][1] = lambda_1 * alpha_s[1] + s * lambda_2 * rho_s[1];
-              mm_3[0][3] = lambda_1 * alpha_s[3] + s * lambda_2 * rho_s[3];
-              mm_3[1][2] = -(s * lambda_2 * alpha_s[3] - lambda_1 * rho_s[3]);
-              mm_3[1][2] = -(s * lambda_2 * alpha_s[1] - lambda_1 * rho_s[1]);
-              mm_3[1][0] = mm_3[0][1];
-              mm_3[2][0] = mm_3[0][2];
-              mm_3[3][0] = mm_3[0][3];
-              mm_3[2][1] = -mm_3[1][2];
-              mm_3[3][1] = -mm_3[1][3];
-              mm_3[3][2] = -mm_3[2][3];
-              for (int a = 0; a < 4; a++)
-                for (int b = 0; b < 4; b++)
-                  mm_3[a][b] *= 1.0 / coefficient_theta;
-
-              // Calculate coupling matrix 4
-              double mm_4[4][4] = {};
-              mm_4[0][0] = (alpha_sq + rho_sq) / 2.0;
-              mm_4[1][1] =
-                  alpha_s[1] * alpha_s[1] + rho_s[1] * rho_s[1] - (alpha_sq + rho_sq) / 2.0;
-              mm_4[2][2] = -(alpha_sq + rho_sq) / 2.0;
-              mm_4[3][3] =
-                  alpha_s[3] * alpha_s[3] + rho_s[3] * rho_s[3] - (alpha_sq + rho_sq) / 2.0;
-              mm_4[0][2] = alpha_s[1] * rho_s[3] - alpha_s[3] * rho_s[1];
-              mm_4[1][3] = alpha_s[3] * alpha_s[1] + rho_s[3] * rho_s[1];
-              mm_4[1][0] = -mm_4[0][1];
-              mm_4[2][0] = -mm_4[0][2];
-              mm_4[3][0] = -mm_4[0][3];
-              mm_4[2][1] = mm_4[1][2];
-              mm_4[3][1] = mm_4[1][3];
-              mm_4[3][2] = mm_4[2][3];
-              for (int a = 0; a < 4; a++)
-                for (int b = 0; b < 4; b++)
-                  mm_4[a][b] *= 2.0 / coefficient_theta;
-
-              // Calculate coupling polynomial O (L 10)
-              double exp, sin, cos, sinh, cosh;
-              double oo[4][4] = {};
-              if (optically_thin)
-              {
-                exp = std::exp(-delta_tau);
-                sin = std::sin(lambda_2 * delta_lambda_cgs);
-                cos = std::cos(lambda_2 * delta_lambda_cgs);
-                sinh = std::sinh(lambda_1 * delta_lambda_cgs);
-                cosh = std::cosh(lambda_1 * delta_lambda_cgs);
-                for (int a = 0; a < 4; a++)
-                  for (int b = 0; b < 4; b++)
-                    oo[a][b] = exp * (0.5 * (mm_1[a][b] + mm_4[a][b]) * cosh
-                        + 0.5 * (mm_1[a][b] - mm_4[a][b]) * cos - mm_2[a][b] * sin
-                        - mm_3[a][b] * sinh);
-              }
-
-              // Calculate coupling polynomial integral P (I 24)
-              double pp[4][4] = {};
-              double f_1 = 1.0 / (alpha_s[0] * alpha_s[0] - lambda_1 * lambda_1);
-              double f_2 = 1.0 / (alpha_s[0] * alpha_s[0] + lambda_2 * lambda_2);
-              for (int a = 0; a < 4; a++)
-                for (int b = 0; b < 4; b++)
-                {
-                  double cosh_term = -lambda_1 * f_1 * mm_3[a][b]
-                      + 0.5 * alpha_s[0] * f_1 * (mm_1[a][b] + mm_4[a][b]);
-                  double cos_term = -lambda_2 * f_2 * mm_2[a][b]
-                      + 0.5 * alpha_s[0] * f_2 * (mm_1[a][b] - mm_4[a][b]);
-                  pp[a][b] = cosh_term + cos_term;
-                  if (optically_thin)
-                  {
-                    double sin_term = -alpha_s[0] * f_2 * mm_2[a][b]
-                        - 0.5 * lambda_2 * f_2 * (mm_1[a][b] - mm_4[a][b]);
-                    double sinh_term = -alpha_s[0] * f_1 * mm_3[a][b]
-                        + 0.5 * lambda_1 * f_1 * (mm_1[a][b] + mm_4[a][b]);
-                    pp[a][b] -= exp
-                        * (cosh_term * cosh + cos_term * cos + sin_term * sin + sinh_term * sinh);
-                  }
-                }
-
-
-              // Apply coupling polynomials
-              if (optically_thin)
-                for (int a = 0; a < 4; a++)
-                  for (int b = 0; b < 4; b++)
-                    ss_end[a] += pp[a][b] * j_s[b] + oo[a][b] * ss_start[b];
-              else
-                for (int a = 0; a < 4; a++)
-                  for (int b = 0; b < 4; b++)
-                    ss_end[a] += pp[a][b] * j_s[b];
-            }
-          }
-
-          // Ensure state is physically admissible
-          ss_end[0] = std::max(ss_end[0], 0.0);
-          double ss_pol = ss_end[1] * ss_end[1] + ss_end[2] * ss_end[2] + ss_end[3] * ss_end[3];
-          if (ss_pol > ss_end[0] * ss_end[0])
-          {
-            double factor = std::sqrt(ss_end[0] * ss_end[0] / ss_pol);
-            ss_end[1] *= factor;
-            ss_end[2] *= factor;
-            ss_end[3] *= factor;
-          }
+          // Couple to matter
+          double ss_end[4];
+          CouplePolarizedStokes(j_s, alpha_s, rho_s, delta_lambda_cgs, ss_start, ss_end);
 
           // Calculate orthonormal-frame N after coupling to fluid (I 13)
           for (int mu = 0; mu < 4; mu++)
@@ -878,6 +495,9 @@ void RadiationIntegrator::IntegratePolarizedRadiation()
           }
       }
     }
+    ProfileRecordThread("IntegrateRadiation", ProfileSnapshot(), adaptive_level,
+        profile_time_start, omp_get_wtime(), profile_counts);
+    #pragma omp barrier
 
     // Go through pixels, transforming into camera frame
     #pragma omp for schedule(static) collapse(2)
@@ -961,12 +581,7 @@ void RadiationIntegrator::IntegratePolarizedRadiation()
   // Free memory
   if (adaptive_level > 0)
   {
-    sample_uu1[adaptive_level].Deallocate();
-    sample_uu2[adaptive_level].Deallocate();
-    sample_uu3[adaptive_level].Deallocate();
-    sample_bb1[adaptive_level].Deallocate();
-    sample_bb2[adaptive_level].Deallocate();
-    sample_bb3[adaptive_level].Deallocate();
+    sample_prim[adaptive_level].Deallocate();
     j_i[adaptive_level].Deallocate();
     j_q[adaptive_level].Deallocate();
     j_v[adaptive_level].Deallocate();
@@ -975,8 +590,450 @@ void RadiationIntegrator::IntegratePolarizedRadiation()
     alpha_v[adaptive_level].Deallocate();
     rho_q[adaptive_level].Deallocate();
     rho_v[adaptive_level].Deallocate();
-    if (render_num_images <= 0)
-      cell_values[adaptive_level].Deallocate();
+    cell_values[adaptive_level].Deallocate();
+    render_lengths[adaptive_level].Deallocate();
+  }
+  ProfileCounts profile_counts;
+  profile_counts.rays = num_pix;
+  ProfileRecord("IntegrateRadiation", ProfileSnapshot(), adaptive_level, time_start,
+      omp_get_wtime(), profile_counts);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for coupling orthonormal-frame Stokes quantities to matter over a single step
+// Inputs:
+//   j_s: invariant emissivities (I, Q, U, V)
+//   alpha_s: invariant absorptivities (I, Q, U, V)
+//   rho_s: invariant rotativities (I, Q, U, V)
+//   delta_lambda_cgs: step length in units where coefficients combine into optical depths
+//   ss_start: invariant Stokes quantities before coupling
+// Outputs:
+//   ss_start: overwritten
+//   ss_end: invariant Stokes quantities after coupling, made physically admissible
+// Notes:
+//   Assumes tetrad is chosen such that j_U, alpha_U, rho_U = 0.
+//   Optionally splits rotativity from emissivity and absorptivity; see
+//       IntegratePolarizedRadiation().
+void RadiationIntegrator::CouplePolarizedStokes(const double j_s[4], const double alpha_s[4],
+    const double rho_s[4], double delta_lambda_cgs, double ss_start[4], double ss_end[4]) const
+{
+  // Calculate optical depth
+  double delta_tau = alpha_s[0] * delta_lambda_cgs;
+  bool optically_thin = delta_tau <= delta_tau_max;
+
+  // Prepare to couple to matter
+  double alpha_sq = alpha_s[1] * alpha_s[1] + alpha_s[3] * alpha_s[3];
+  double alpha_p = std::sqrt(alpha_sq);
+  double rho_sq = rho_s[1] * rho_s[1] + rho_s[3] * rho_s[3];
+  double rho_p = std::sqrt(rho_sq);
+  for (int a = 0; a < 4; a++)
+    ss_end[a] = 0.0;
+
+  // Couple via splitting of rotativity from absorptivity/emissivity
+  if (image_rotation_split)
+  {
+    // Couple first half with no absorptivity
+    if (alpha_s[0] == 0.0)
+      for (int a = 0; a < 4; a++)
+        ss_end[a] = ss_start[a] + j_s[a] * delta_lambda_cgs / 2.0;
+
+    // Couple first half with no polarized absorptivity but with nonzero absorptivity
+    else if (alpha_p == 0.0)
+    {
+      // Optically thin case
+      if (optically_thin)
+      {
+        double exp_neg = std::exp(-delta_tau / 2.0);
+        double expm1 = std::expm1(delta_tau / 2.0);
+        for (int a = 0; a < 4; a++)
+          ss_end[a] = exp_neg * (ss_start[a] + j_s[a] / alpha_s[0] * expm1);
+      }
+
+      // Optically thick case
+      else
+        for (int a = 0; a < 4; a++)
+          ss_end[a] = j_s[a] / alpha_s[0];
+    }
+
+    // Couple first half with nonzero polarized absorptivity
+    else
+    {
+      // Optically thin case (I A14-A17)
+      if (optically_thin)
+      {
+        double exp_neg_i = std::exp(-delta_tau / 2.0);
+        double exp_neg_p = std::exp(-alpha_p * delta_lambda_cgs / 2.0);
+        double sinh_p = std::sinh(alpha_p * delta_lambda_cgs / 2.0);
+        double cosh_p = std::cosh(alpha_p * delta_lambda_cgs / 2.0);
+        double coshm1_p =
+            0.5 * (std::expm1(alpha_p * delta_lambda_cgs / 2.0) + exp_neg_p - 1.0);
+        double alpha_ss = alpha_s[1] * ss_start[1] + alpha_s[3] * ss_start[3];
+        double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
+        double alpha_i_p_factor = 1.0 / (alpha_s[0] * alpha_s[0] - alpha_sq);
+        ss_end[0] = (ss_start[0] * cosh_p - alpha_ss / alpha_p * sinh_p) * exp_neg_i
+            + alpha_j * alpha_i_p_factor * (-1.0 + (alpha_s[0] * sinh_p + alpha_p * cosh_p)
+            / alpha_p * exp_neg_p) + alpha_s[0] * j_s[0] * alpha_i_p_factor * (1.0
+            - (alpha_s[0] * cosh_p + alpha_p * sinh_p) / alpha_s[0] * exp_neg_p);
+
+        for (int a = 1; a < 4; a++)
+        {
+          double term_1 = (ss_start[a] + alpha_s[a] * alpha_ss / alpha_sq * coshm1_p
+              - ss_start[0] * alpha_s[a] / alpha_p * sinh_p) * exp_neg_i;
+          double term_2 = j_s[a] * (1.0 - exp_neg_i) / alpha_s[0];
+          double term_3 = alpha_j * alpha_s[a] / alpha_s[0] * alpha_i_p_factor * (1.0 - (1.0
+              - alpha_s[0] * alpha_s[0] / alpha_sq - alpha_s[0] / alpha_sq * (alpha_s[0]
+              * cosh_p + alpha_p * sinh_p)) * exp_neg_i);
+          double term_4 = j_s[0] * alpha_s[a] / alpha_p * alpha_i_p_factor * (-alpha_p +
+              (alpha_p * cosh_p + alpha_s[0] * sinh_p) * exp_neg_i);
+          ss_end[a] = term_1 + term_2 + term_3 + term_4;
+        }
+      }
+
+      // Optically thick case
+      else
+      {
+        double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
+        ss_end[0] = (alpha_s[0] * j_s[0] - alpha_j) / (alpha_s[0] * alpha_s[0] - alpha_sq);
+        for (int a = 1; a < 4; a++)
+          ss_end[a] = (j_s[a] - alpha_s[a] * ss_end[0]) / alpha_s[0];
+      }
+    }
+
+    // Ensure state is physically admissible
+    ss_end[0] = std::max(ss_end[0], 0.0);
+    double ss_pol = ss_end[1] * ss_end[1] + ss_end[2] * ss_end[2] + ss_end[3] * ss_end[3];
+    if (ss_pol > ss_end[0] * ss_end[0])
+    {
+      double factor = std::sqrt(ss_end[0] * ss_end[0] / ss_pol);
+      ss_end[1] *= factor;
+      ss_end[2] *= factor;
+      ss_end[3] *= factor;
+    }
+
+    // Reset starting Stokes parameters
+    for (int a = 0; a < 4; a++)
+      ss_start[a] = ss_end[a];
+
+    // Couple with no absorptivity but nonzero rotativity (I A2-A5)
+    if (rho_p != 0.0)
+    {
+      double cos_rho = std::cos(rho_p * delta_lambda_cgs);
+      double sin_rho = std::sin(rho_p * delta_lambda_cgs);
+      double sin_sq_rho = std::sin(rho_p * delta_lambda_cgs / 2.0);
+      sin_sq_rho = sin_sq_rho * sin_sq_rho;
+      double rho_ss = rho_s[1] * ss_start[1] + rho_s[3] * ss_start[3];
+      ss_end[0] = ss_start[0];
+      ss_end[1] = ss_start[1] * cos_rho + 2.0 * rho_s[1] * rho_ss / rho_sq * sin_sq_rho
+          - rho_s[3] * ss_start[2] / rho_p * sin_rho;
+      ss_end[2] = ss_start[2] * cos_rho
+          + (rho_s[3] * ss_start[1] - rho_s[1] * ss_start[3]) / rho_p * sin_rho;
+      ss_end[3] = ss_start[3] * cos_rho + 2.0 * rho_s[3] * rho_ss / rho_sq * sin_sq_rho
+          + rho_s[1] * ss_start[2] / rho_p * sin_rho;
+    }
+
+    // Ensure state is physically admissible
+    ss_pol = ss_end[1] * ss_end[1] + ss_end[2] * ss_end[2] + ss_end[3] * ss_end[3];
+    if (ss_pol > ss_end[0] * ss_end[0])
+    {
+      double factor = std::sqrt(ss_end[0] * ss_end[0] / ss_pol);
+      ss_end[1] *= factor;
+      ss_end[2] *= factor;
+      ss_end[3] *= factor;
+    }
+
+    // Reset starting Stokes parameters
+    for (int a = 0; a < 4; a++)
+      ss_start[a] = ss_end[a];
+
+    // Couple second half with no absorptivity
+    if (alpha_s[0] == 0.0)
+      for (int a = 0; a < 4; a++)
+        ss_end[a] = ss_start[a] + j_s[a] * delta_lambda_cgs / 2.0;
+
+    // Couple second half with no polarized absorptivity but with nonzero absorptivity
+    else if (alpha_p == 0.0)
+    {
+      // Optically thin case
+      if (optically_thin)
+      {
+        double exp_neg = std::exp(-delta_tau / 2.0);
+        double expm1 = std::expm1(delta_tau / 2.0);
+        for (int a = 0; a < 4; a++)
+          ss_end[a] = exp_neg * (ss_start[a] + j_s[a] / alpha_s[0] * expm1);
+      }
+
+      // Optically thick case
+      else
+        for (int a = 0; a < 4; a++)
+          ss_end[a] = j_s[a] / alpha_s[0];
+    }
+
+    // Couple second half with nonzero polarized absorptivity
+    else
+    {
+      // Optically thin case (I A14-A17)
+      if (optically_thin)
+      {
+        double exp_neg_i = std::exp(-delta_tau / 2.0);
+        double exp_neg_p = std::exp(-alpha_p * delta_lambda_cgs / 2.0);
+        double sinh_p = std::sinh(alpha_p * delta_lambda_cgs / 2.0);
+        double cosh_p = std::cosh(alpha_p * delta_lambda_cgs / 2.0);
+        double coshm1_p =
+            0.5 * (std::expm1(alpha_p * delta_lambda_cgs / 2.0) + exp_neg_p - 1.0);
+        double alpha_ss = alpha_s[1] * ss_start[1] + alpha_s[3] * ss_start[3];
+        double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
+        double alpha_i_p_factor = 1.0 / (alpha_s[0] * alpha_s[0] - alpha_sq);
+        ss_end[0] = (ss_start[0] * cosh_p - alpha_ss / alpha_p * sinh_p) * exp_neg_i
+            + alpha_j * alpha_i_p_factor * (-1.0 + (alpha_s[0] * sinh_p + alpha_p * cosh_p)
+            / alpha_p * exp_neg_p) + alpha_s[0] * j_s[0] * alpha_i_p_factor * (1.0
+            - (alpha_s[0] * cosh_p + alpha_p * sinh_p) / alpha_s[0] * exp_neg_p);
+        for (int a = 1; a < 4; a++)
+        {
+          double term_1 = (ss_start[a] + alpha_s[a] * alpha_ss / alpha_sq * coshm1_p
+              - ss_start[0] * alpha_s[a] / alpha_p * sinh_p) * exp_neg_i;
+          double term_2 = j_s[a] * (1.0 - exp_neg_i) / alpha_s[0];
+          double term_3 = alpha_j * alpha_s[a] / alpha_s[0] * alpha_i_p_factor * (1.0 - (1.0
+              - alpha_s[0] * alpha_s[0] / alpha_sq - alpha_s[0] / alpha_sq * (alpha_s[0]
+              * cosh_p + alpha_p * sinh_p)) * exp_neg_i);
+          double term_4 = j_s[0] * alpha_s[a] / alpha_p * alpha_i_p_factor * (-alpha_p +
+              (alpha_p * cosh_p + alpha_s[0] * sinh_p) * exp_neg_i);
+          ss_end[a] = term_1 + term_2 + term_3 + term_4;
+        }
+      }
+
+      // Optically thick case
+      else
+      {
+        double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
+        ss_end[0] = (alpha_s[0] * j_s[0] - alpha_j) / (alpha_s[0] * alpha_s[0] - alpha_sq);
+        for (int a = 1; a < 4; a++)
+          ss_end[a] = (j_s[a] - alpha_s[a] * ss_end[0]) / alpha_s[0];
+      }
+    }
+  }
+
+  // Couple with no splitting
+  else
+  {
+    // Couple with no absorptivity or rotativity
+    if (alpha_s[0] == 0.0 and rho_p == 0.0)
+      for (int a = 0; a < 4; a++)
+        ss_end[a] = ss_start[a] + j_s[a] * delta_lambda_cgs;
+
+    // Couple with no polarized absorptivity or rotativity but with nonzero absorptivity
+    else if (alpha_p == 0.0 and rho_p == 0.0)
+    {
+      // Optically thin case
+      if (optically_thin)
+      {
+        double exp_neg = std::exp(-delta_tau);
+        double expm1 = std::expm1(delta_tau);
+        for (int a = 0; a < 4; a++)
+          ss_end[a] = exp_neg * (ss_start[a] + j_s[a] / alpha_s[0] * expm1);
+      }
+
+      // Optically thick case
+      else
+        for (int a = 0; a < 4; a++)
+          ss_end[a] = j_s[a] / alpha_s[0];
+    }
+
+    // Couple with no absorptivity but nonzero rotativity (I A2-A5)
+    else if (alpha_s[0] == 0.0)
+    {
+      double cos_rho = std::cos(rho_p * delta_lambda_cgs);
+      double sin_rho = std::sin(rho_p * delta_lambda_cgs);
+      double sin_sq_rho = std::sin(rho_p * delta_lambda_cgs / 2.0);
+      sin_sq_rho = sin_sq_rho * sin_sq_rho;
+      double rho_ss = rho_s[1] * ss_start[1] + rho_s[3] * ss_start[3];
+      ss_end[0] = ss_start[0];
+      ss_end[1] = ss_start[1] * cos_rho + 2.0 * rho_s[1] * rho_ss / rho_sq * sin_sq_rho
+          - rho_s[3] * ss_start[2] / rho_p * sin_rho;
+      ss_end[2] = ss_start[2] * cos_rho
+          + (rho_s[3] * ss_start[1] - rho_s[1] * ss_start[3]) / rho_p * sin_rho;
+      ss_end[3] = ss_start[3] * cos_rho + 2.0 * rho_s[3] * rho_ss / rho_sq * sin_sq_rho
+          + rho_s[1] * ss_start[2] / rho_p * sin_rho;
+      for (int a = 0; a < 4; a++)
+        ss_end[a] += j_s[a] * delta_lambda_cgs;
+    }
+
+    // Couple with no rotativity but nonzero polarized absorptivity
+    else if (rho_p == 0.0)
+    {
+      // Optically thin case (I A14-A17)
+      if (optically_thin)
+      {
+        double exp_neg_i = std::exp(-delta_tau);
+        double exp_neg_p = std::exp(-alpha_p * delta_lambda_cgs);
+        double sinh_p = std::sinh(alpha_p * delta_lambda_cgs);
+        double cosh_p = std::cosh(alpha_p * delta_lambda_cgs);
+        double coshm1_p = 0.5 * (std::expm1(alpha_p * delta_lambda_cgs) + exp_neg_p - 1.0);
+        double alpha_ss = alpha_s[1] * ss_start[1] + alpha_s[3] * ss_start[3];
+        double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
+        double alpha_i_p_factor = 1.0 / (alpha_s[0] * alpha_s[0] - alpha_sq);
+        ss_end[0] = (ss_start[0] * cosh_p - alpha_ss / alpha_p * sinh_p) * exp_neg_i
+            + alpha_j * alpha_i_p_factor * (-1.0 + (alpha_s[0] * sinh_p + alpha_p * cosh_p)
+            / alpha_p * exp_neg_p) + alpha_s[0] * j_s[0] * alpha_i_p_factor * (1.0
+            - (alpha_s[0] * cosh_p + alpha_p * sinh_p) / alpha_s[0] * exp_neg_p);
+        for (int a = 1; a < 4; a++)
+        {
+          double term_1 = (ss_start[a] + alpha_s[a] * alpha_ss / alpha_sq * coshm1_p
+              - ss_start[0] * alpha_s[a] / alpha_p * sinh_p) * exp_neg_i;
+          double term_2 = j_s[a] * (1.0 - exp_neg_i) / alpha_s[0];
+          double term_3 = alpha_j * alpha_s[a] / alpha_s[0] * alpha_i_p_factor * (1.0 - (1.0
+              - alpha_s[0] * alpha_s[0] / alpha_sq - alpha_s[0] / alpha_sq * (alpha_s[0]
+              * cosh_p + alpha_p * sinh_p)) * exp_neg_i);
+          double term_4 = j_s[0] * alpha_s[a] / alpha_p * alpha_i_p_factor * (-alpha_p +
+              (alpha_p * cosh_p + alpha_s[0] * sinh_p) * exp_neg_i);
+          ss_end[a] = term_1 + term_2 + term_3 + term_4;
+        }
+      }
+
+      // Optically thick case
+      else
+      {
+        double alpha_j = alpha_s[1] * j_s[1] + alpha_s[3] * j_s[3];
+        ss_end[0] = (alpha_s[0] * j_s[0] - alpha_j) / (alpha_s[0] * alpha_s[0] - alpha_sq);
+        for (int a = 1; a < 4; a++)
+          ss_end[a] = (j_s[a] - alpha_s[a] * ss_end[0]) / alpha_s[0];
+      }
+    }
+
+    // Couple with nonzero absorptivity and rotativity
+    else
+    {
+      // Calculate coefficients needed for coupling matrices
+      double alpha_rho = alpha_s[1] * rho_s[1] + alpha_s[3] * rho_s[3];
+      double alpha_sq_rho_sq = alpha_sq - rho_sq;
+      double lambda_a =
+          std::sqrt(alpha_sq_rho_sq * alpha_sq_rho_sq / 4.0 + alpha_rho * alpha_rho);
+      double lambda_b = alpha_sq_rho_sq / 2.0;
+      double lambda_1 = std::sqrt(lambda_a + lambda_b);
+      double lambda_2 = std::sqrt(lambda_a - lambda_b);
+      double coefficient_theta = lambda_1 * lambda_1 + lambda_2 * lambda_2;
+      double s = alpha_rho >= 0.0 ? 1.0 : -1.0;
+
+      // Calculate coupling matrix 1
+      double mm_1[4][4] = {};
+      for (int a = 0; a < 4; a++)
+        mm_1[a][a] = 1.0;
+
+      // Calculate coupling matrix 2
+      double mm_2[4][4] = {};
+      mm_2[0][1] = lambda_2 * alpha_s[1] - s * lambda_1 * rho_s[1];
+      mm_2[0][3] = lambda_2 * alpha_s[3] - s * lambda_1 * rho_s[3];
+      mm_2[1][2] = s * lambda_1 * alpha_s[3] + lambda_2 * rho_s[3];
+      mm_2[1][2] = s * lambda_1 * alpha_s[1] + lambda_2 * rho_s[1];
+      mm_2[1][0] = mm_2[0][1];
+      mm_2[2][0] = mm_2[0][2];
+      mm_2[3][0] = mm_2[0][3];
+      mm_2[2][1] = -mm_2[1][2];
+      mm_2[3][1] = -mm_2[1][3];
+      mm_2[3][2] = -mm_2[2][3];
+      for (int a = 0; a < 4; a++)
+        for (int b = 0; b < 4; b++)
+          mm_2[a][b] *= 1.0 / coefficient_theta;
+
+      // Calculate coupling matrix 3
+      double mm_3[4][4] = {};
+      mm_3[0][1] = lambda_1 * alpha_s[1] + s * lambda_2 * rho_s[1];
+      mm_3[0][3] = lambda_1 * alpha_s[3] + s * lambda_2 * rho_s[3];
+      mm_3[1][2] = -(s * lambda_2 * alpha_s[3] - lambda_1 * rho_s[3]);
+      mm_3[1][2] = -(s * lambda_2 * alpha_s[1] - lambda_1 * rho_s[1]);
+      mm_3[1][0] = mm_3[0][1];
+      mm_3[2][0] = mm_3[0][2];
+      mm_3[3][0] = mm_3[0][3];
+      mm_3[2][1] = -mm_3[1][2];
+      mm_3[3][1] = -mm_3[1][3];
+      mm_3[3][2] = -mm_3[2][3];
+      for (int a = 0; a < 4; a++)
+        for (int b = 0; b < 4; b++)
+          mm_3[a][b] *= 1.0 / coefficient_theta;
+
+      // Calculate coupling matrix 4
+      double mm_4[4][4] = {};
+      mm_4[0][0] = (alpha_sq + rho_sq) / 2.0;
+      mm_4[1][1] =
+          alpha_s[1] * alpha_s[1] + rho_s[1] * rho_s[1] - (alpha_sq + rho_sq) / 2.0;
+      mm_4[2][2] = -(alpha_sq + rho_sq) / 2.0;
+      mm_4[3][3] =
+          alpha_s[3] * alpha_s[3] + rho_s[3] * rho_s[3] - (alpha_sq + rho_sq) / 2.0;
+      mm_4[0][2] = alpha_s[1] * rho_s[3] - alpha_s[3] * rho_s[1];
+      mm_4[1][3] = alpha_s[3] * alpha_s[1] + rho_s[3] * rho_s[1];
+      mm_4[1][0] = -mm_4[0][1];
+      mm_4[2][0] = -mm_4[0][2];
+      mm_4[3][0] = -mm_4[0][3];
+      mm_4[2][1] = mm_4[1][2];
+      mm_4[3][1] = mm_4[1][3];
+      mm_4[3][2] = mm_4[2][3];
+      for (int a = 0; a < 4; a++)
+        for (int b = 0; b < 4; b++)
+          mm_4[a][b] *= 2.0 / coefficient_theta;
+
+      // Calculate coupling polynomial O (L 10)
+      double exp, sin, cos, sinh, cosh;
+      double oo[4][4] = {};
+      if (optically_thin)
+      {
+        exp = std::exp(-delta_tau);
+        sin = std::sin(lambda_2 * delta_lambda_cgs);
+        cos = std::cos(lambda_2 * delta_lambda_cgs);
+        sinh = std::sinh(lambda_1 * delta_lambda_cgs);
+        cosh = std::cosh(lambda_1 * delta_lambda_cgs);
+        for (int a = 0; a < 4; a++)
+          for (int b = 0; b < 4; b++)
+            oo[a][b] = exp * (0.5 * (mm_1[a][b] + mm_4[a][b]) * cosh
+                + 0.5 * (mm_1[a][b] - mm_4[a][b]) * cos - mm_2[a][b] * sin
+                - mm_3[a][b] * sinh);
+      }
+
+      // Calculate coupling polynomial integral P (I 24)
+      double pp[4][4] = {};
+      double f_1 = 1.0 / (alpha_s[0] * alpha_s[0] - lambda_1 * lambda_1);
+      double f_2 = 1.0 / (alpha_s[0] * alpha_s[0] + lambda_2 * lambda_2);
+      for (int a = 0; a < 4; a++)
+        for (int b = 0; b < 4; b++)
+        {
+          double cosh_term = -lambda_1 * f_1 * mm_3[a][b]
+              + 0.5 * alpha_s[0] * f_1 * (mm_1[a][b] + mm_4[a][b]);
+          double cos_term = -lambda_2 * f_2 * mm_2[a][b]
+              + 0.5 * alpha_s[0] * f_2 * (mm_1[a][b] - mm_4[a][b]);
+          pp[a][b] = cosh_term + cos_term;
+          if (optically_thin)
+          {
+            double sin_term = -alpha_s[0] * f_2 * mm_2[a][b]
+                - 0.5 * lambda_2 * f_2 * (mm_1[a][b] - mm_4[a][b]);
+            double sinh_term = -alpha_s[0] * f_1 * mm_3[a][b]
+                + 0.5 * lambda_1 * f_1 * (mm_1[a][b] + mm_4[a][b]);
+            pp[a][b] -= exp
+                * (cosh_term * cosh + cos_term * cos + sin_term * sin + sinh_term * sinh);
+          }
+        }
+
+
+      // Apply coupling polynomials
+      if (optically_thin)
+        for (int a = 0; a < 4; a++)
+          for (int b = 0; b < 4; b++)
+            ss_end[a] += pp[a][b] * j_s[b] + oo[a][b] * ss_start[b];
+      else
+        for (int a = 0; a < 4; a++)
+          for (int b = 0; b < 4; b++)
+            ss_end[a] += pp[a][b] * j_s[b];
+    }
+  }
+
+  // Ensure state is physically admissible
+  ss_end[0] = std::max(ss_end[0], 0.0);
+  double ss_pol = ss_end[1] * ss_end[1] + ss_end[2] * ss_end[2] + ss_end[3] * ss_end[3];
+  if (ss_pol > ss_end[0] * ss_end[0])
+  {
+    double factor = std::sqrt(ss_end[0] * ss_end[0] / ss_pol);
+    ss_end[1] *= factor;
+    ss_end[2] *= factor;
+    ss_end[3] *= factor;
   }
   return;
 }
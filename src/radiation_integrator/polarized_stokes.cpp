@@ -0,0 +1,583 @@
+// Blacklight radiation integrator - polarized radiation integration with real Stokes transport
+
+// C++ headers
+#include <algorithm>  // min
+#include <cmath>      // exp, expm1, isnan, sqrt
+
+// Library headers
+#include <omp.h>  // pragmas, omp_get_thread_num, omp_get_wtime
+
+// Blacklight headers
+#include "radiation_integrator.hpp"
+#include "../blacklight.hpp"         // Physics, enums
+#include "../utils/array.hpp"        // Array
+#include "../utils/profiler.hpp"     // profiling functions
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for integrating polarized radiative transfer equation by transporting Stokes quantities
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Makes the same assumptions and allocations, and frees the same memory, as
+//       IntegratePolarizedRadiation().
+//   Rather than transporting a complex coherency tensor N for each frequency, transports a single
+//       pair of real polarization basis vectors f_1 and f_2 along each ray, together with real
+//       invariant Stokes quantities (I, Q, U, V) for each frequency relative to that basis:
+//     N^{mu nu} = (I + Q) f_1^mu f_1^nu + (I - Q) f_2^mu f_2^nu + (U - i V) f_1^mu f_2^nu
+//         + (U + i V) f_2^mu f_1^nu.
+//   Parallel transport uses the same midpoint scheme applied to N in IntegratePolarizedRadiation(),
+//       with the basis vectors transported in place of N; the two agree to the same order.
+//   At each sample, the basis is projected onto the orthonormal tetrad with the 2x2 matrix
+//       R_{a p} = e_a . f_p, giving Stokes quantities in the tetrad as the real parts of R n R^T
+//       for n = ((I + Q, U), (U, I - Q)) and V det(R).
+//   After coupling, the basis is set to the spatial tetrad vectors e_1 and e_2, exactly as N is
+//       reconstructed in the tetrad in IntegratePolarizedRadiation().
+//   Since the geometry, tetrad, and basis are independent of frequency, they are calculated once
+//       per sample, and only the projection and coupling are done for each frequency.
+void RadiationIntegrator::IntegratePolarizedStokes()
+{
+  // Allocate image array
+  double time_start = omp_get_wtime();
+  int num_pix = camera_num_pix;
+  if (adaptive_level > 0)
+    num_pix = block_counts[adaptive_level] * block_num_pix;
+  if (first_time or adaptive_level > 0)
+    image[adaptive_level].Allocate(image_num_quantities, num_pix);
+  image[adaptive_level].Zero();
+
+  // Allocate Stokes and polarization basis arrays
+  Array<double> stokes(num_pix, image_num_frequencies, 4);
+  Array<double> basis(num_pix, 2, 4);
+  stokes.Zero();
+  basis.Zero();
+
+  // Calculate units
+  double x_unit = Physics::gg_msun * mass_msun / (Physics::c * Physics::c);
+  double t_unit = x_unit / Physics::c;
+
+  // Work in parallel
+  #pragma omp parallel
+  {
+    // Allocate scratch space
+    double delta_lambda_old;
+    double kcon_old[4] = {};
+    double gcov[4][4];
+    double gcon[4][4];
+    double gcov_sim[4][4];
+    double gcon_sim[4][4];
+    double connection[4][4][4];
+    double connection_old[4][4][4];
+    double tetrad[4][4];
+    double jacobian[4][4];
+    double ff[2][4];
+    double ff_temp[2][4];
+    Array<double> frequency_factors(image_num_frequencies);
+    Array<double> integrated_lambdas(image_num_frequencies);
+    Array<double> integrated_emissions(image_num_frequencies);
+
+    // Go through pixels
+    ProfileCounts profile_counts;
+    double profile_time_start = omp_get_wtime();
+    #pragma omp for schedule(runtime) nowait
+    for (int m = 0; m < num_pix; m++)
+    {
+      // Check number of steps
+      int num_steps = sample_num[adaptive_level](m);
+      profile_counts.samples += num_steps;
+      if (num_steps <= 0)
+        continue;
+      int n_start = -1;
+      int z_turnings_count = 0;
+      if (image_z_turnings)
+        FindZTurnings(m, num_steps, n_start, z_turnings_count);
+      if (n_start < 0)
+        n_start = 0;
+      int s_start = sample_offsets[adaptive_level](m);
+      for (int n = 0; n < n_start; n++)
+        if (SampleKept(m, n))
+          s_start++;
+
+      // Calculate coefficients along ray
+      int record_shift = 0;
+      if (simulation_fused_coeffs)
+      {
+        int r_start = omp_get_thread_num() * fused_num_records;
+        CalculateSimulationCoefficientsRay(m, r_start);
+        record_shift = r_start - sample_offsets[adaptive_level](m);
+      }
+
+      // Zero registers
+      delta_lambda_old = 0.0;
+      for (int p = 0; p < 2; p++)
+        for (int mu = 0; mu < 4; mu++)
+        {
+          ff[p][mu] = 0.0;
+          ff_temp[p][mu] = 0.0;
+        }
+
+      // Prepare integrated quantities
+      for (int l = 0; l < image_num_frequencies; l++)
+      {
+        frequency_factors(l) = image_frequencies(l) * momentum_factors[adaptive_level](m);
+        integrated_lambdas(l) = 0.0;
+        integrated_emissions(l) = 0.0;
+      }
+      double x1_init = SamplePosition(m,0,1);
+      double x2_init = SamplePosition(m,0,2);
+      double x3_init = SamplePosition(m,0,3);
+      bool plane_sign = camera_x[1] * x1_init + camera_x[2] * x2_init + camera_x[3] * x3_init > 0.0;
+      int crossings_count = 0;
+
+      // Go through samples
+      int s_next = s_start;
+      for (int n = n_start; n < num_steps; n++)
+      {
+        // Extract affine step size
+        double delta_lambda = SampleLength(m,n);
+        double delta_lambda_new = delta_lambda;
+        if (n < num_steps - 1)
+          delta_lambda_new = SampleLength(m,n+1);
+        double delta_lambda_x = delta_lambda * x_unit;
+
+        // Extract geodesic position and covariant momentum
+        double t_cgs = SamplePosition(m,n,0) * t_unit;
+        double x1 = SamplePosition(m,n,1);
+        double x2 = SamplePosition(m,n,2);
+        double x3 = SamplePosition(m,n,3);
+        double kcov[4];
+        kcov[0] = SampleDirection(m,n,0);
+        kcov[1] = SampleDirection(m,n,1);
+        kcov[2] = SampleDirection(m,n,2);
+        kcov[3] = SampleDirection(m,n,3);
+
+        // Extract model variables, treating cut samples as having vanishing values
+        bool kept = SampleKept(m, n);
+        int s = kept ? s_next++ : -1;
+        const float vanishing_vals[sample_ind_kappa+1] = {};
+        const float *sample_vals = kept ? &sample_prim[adaptive_level](s,0) : vanishing_vals;
+        int r = kept ? s + record_shift : -1;
+        double uu1_sim = sample_vals[sample_ind_uu1];
+        double uu2_sim = sample_vals[sample_ind_uu2];
+        double uu3_sim = sample_vals[sample_ind_uu3];
+        double bb1_sim = sample_vals[sample_ind_bb1];
+        double bb2_sim = sample_vals[sample_ind_bb2];
+        double bb3_sim = sample_vals[sample_ind_bb3];
+
+        // Calculate geodesic metric and connection
+        CovariantGeodesicMetric(x1, x2, x3, gcov);
+        ContravariantGeodesicMetric(x1, x2, x3, gcon);
+        GeodesicConnection(x1, x2, x3, connection);
+        if (n == n_start)
+          for (int mu = 0; mu < 4; mu++)
+            for (int alpha = 0; alpha < 4; alpha++)
+              for (int beta = 0; beta < 4; beta++)
+                connection_old[mu][alpha][beta] = connection[mu][alpha][beta];
+        else
+          for (int mu = 0; mu < 4; mu++)
+            for (int alpha = 0; alpha < 4; alpha++)
+              for (int beta = 0; beta < 4; beta++)
+                connection_old[mu][alpha][beta] =
+                    0.5 * (connection_old[mu][alpha][beta] + connection[mu][alpha][beta]);
+
+        // Calculate geodesic contravariant momentum
+        double kcon[4] = {};
+        for (int mu = 0; mu < 4; mu++)
+          for (int nu = 0; nu < 4; nu++)
+            kcon[mu] += gcon[mu][nu] * kcov[nu];
+        if (n == n_start)
+          for (int mu = 0; mu < 4; mu++)
+            kcon_old[mu] = kcon[mu];
+        else
+          for (int mu = 0; mu < 4; mu++)
+            kcon_old[mu] = 0.5 * (kcon_old[mu] + kcon[mu]);
+
+        // Parallel-transport basis by first half step
+        double temp_a[4][4] = {};
+        for (int mu = 0; mu < 4; mu++)
+          for (int beta = 0; beta < 4; beta++)
+            for (int alpha = 0; alpha < 4; alpha++)
+              temp_a[mu][beta] += kcon_old[alpha] * connection_old[mu][alpha][beta];
+        double delta_lambda_local = (delta_lambda_old + delta_lambda) / 2.0;
+        for (int p = 0; p < 2; p++)
+          for (int mu = 0; mu < 4; mu++)
+          {
+            double dff_dlambda = 0.0;
+            for (int beta = 0; beta < 4; beta++)
+              dff_dlambda -= temp_a[mu][beta] * ff[p][beta];
+            ff_temp[p][mu] += dff_dlambda * delta_lambda_local;
+          }
+        for (int p = 0; p < 2; p++)
+          for (int mu = 0; mu < 4; mu++)
+            ff[p][mu] = ff_temp[p][mu];
+
+        // Calculate simulation metric
+        CovariantSimulationMetric(x1, x2, x3, gcov_sim);
+        ContravariantSimulationMetric(x1, x2, x3, gcon_sim);
+
+        // Calculate simulation velocity
+        double uu0_sim = std::sqrt(1.0 + gcov_sim[1][1] * uu1_sim * uu1_sim
+            + 2.0 * gcov_sim[1][2] * uu1_sim * uu2_sim + 2.0 * gcov_sim[1][3] * uu1_sim * uu3_sim
+            + gcov_sim[2][2] * uu2_sim * uu2_sim + 2.0 * gcov_sim[2][3] * uu2_sim * uu3_sim
+            + gcov_sim[3][3] * uu3_sim * uu3_sim);
+        double lapse_sim = 1.0 / std::sqrt(-gcon_sim[0][0]);
+        double shift1_sim = -gcon_sim[0][1] / gcon_sim[0][0];
+        double shift2_sim = -gcon_sim[0][2] / gcon_sim[0][0];
+        double shift3_sim = -gcon_sim[0][3] / gcon_sim[0][0];
+        double ucon_sim[4];
+        ucon_sim[0] = uu0_sim / lapse_sim;
+        ucon_sim[1] = uu1_sim - shift1_sim * uu0_sim / lapse_sim;
+        ucon_sim[2] = uu2_sim - shift2_sim * uu0_sim / lapse_sim;
+        ucon_sim[3] = uu3_sim - shift3_sim * uu0_sim / lapse_sim;
+        double ucov_sim[4] = {};
+        for (int mu = 0; mu < 4; mu++)
+          for (int nu = 0; nu < 4; nu++)
+            ucov_sim[mu] += gcov_sim[mu][nu] * ucon_sim[nu];
+
+        // Calculate simulation magnetic field
+        double bcon_sim[4];
+        bcon_sim[0] = ucov_sim[1] * bb1_sim + ucov_sim[2] * bb2_sim + ucov_sim[3] * bb3_sim;
+        bcon_sim[1] = (bb1_sim + bcon_sim[0] * ucon_sim[1]) / ucon_sim[0];
+        bcon_sim[2] = (bb2_sim + bcon_sim[0] * ucon_sim[2]) / ucon_sim[0];
+        bcon_sim[3] = (bb3_sim + bcon_sim[0] * ucon_sim[3]) / ucon_sim[0];
+
+        // Calculate Jacobian of transformation from simulation to geodesic coordinates
+        CoordinateJacobian(x1, x2, x3, jacobian);
+
+        // Transform contravariant velocity and magnetic field to geodesic coordinates
+        double ucon[4] = {};
+        for (int mu = 0; mu < 4; mu++)
+          for (int nu = 0; nu < 4; nu++)
+            ucon[mu] += jacobian[mu][nu] * ucon_sim[nu];
+        double bcon[4] = {};
+        for (int mu = 0; mu < 4; mu++)
+          for (int nu = 0; nu < 4; nu++)
+            bcon[mu] += jacobian[mu][nu] * bcon_sim[nu];
+
+        // Calculate covariant velocity
+        double ucov[4] = {};
+        for (int mu = 0; mu < 4; mu++)
+          for (int nu = 0; nu < 4; nu++)
+            ucov[mu] += gcov[mu][nu] * ucon[nu];
+
+        // Calculate orthonormal tetrad
+        double upcon[4] = {};
+        if (bb1_sim == 0.0 and bb2_sim == 0.0 and bb3_sim == 0.0)
+          upcon[3] = 1.0;
+        else
+          for (int mu = 0; mu < 4; mu++)
+            upcon[mu] = bcon[mu];
+        Tetrad(ucon, ucov, kcon, kcov, upcon, gcov, gcon, tetrad);
+
+        // Project basis onto orthonormal frame
+        double proj[2][2];
+        for (int p = 0; p < 2; p++)
+        {
+          double ff_cov[4] = {};
+          for (int mu = 0; mu < 4; mu++)
+            for (int nu = 0; nu < 4; nu++)
+              ff_cov[mu] += gcov[mu][nu] * ff[p][nu];
+          for (int a = 0; a < 2; a++)
+          {
+            proj[a][p] = 0.0;
+            for (int mu = 0; mu < 4; mu++)
+              proj[a][p] += tetrad[a+1][mu] * ff_cov[mu];
+          }
+        }
+        double proj_det = proj[0][0] * proj[1][1] - proj[0][1] * proj[1][0];
+
+        // Accumulate frequency-independent image quantities
+        if (image_time)
+          image[adaptive_level](image_offset_time,m) =
+              std::min(image[adaptive_level](image_offset_time,m), t_cgs);
+        if (image_length)
+        {
+          double temp_b[4] = {};
+          for (int a = 1; a < 4; a++)
+            for (int mu = 0; mu < 4; mu++)
+              temp_b[a] += (gcon[a][mu] - gcon[0][a] * gcon[0][mu] / gcon[0][0]) * kcov[mu];
+          double dl_dlambda_sq = 0.0;
+          for (int a = 1; a < 4; a++)
+            for (int b = 1; b < 4; b++)
+              dl_dlambda_sq += gcov[a][b] * temp_b[a] * temp_b[b];
+          image[adaptive_level](image_offset_length,m) +=
+              std::sqrt(dl_dlambda_sq) * delta_lambda * x_unit;
+        }
+        if (image_crossings)
+        {
+          bool plane_sign_new = camera_x[1] * x1 + camera_x[2] * x2 + camera_x[3] * x3 > 0.0;
+          if (plane_sign_new != plane_sign)
+            crossings_count++;
+          plane_sign = plane_sign_new;
+        }
+
+        // Go through frequencies
+        for (int l = 0; l < image_num_frequencies; l++)
+        {
+          double delta_lambda_cgs = delta_lambda_x / frequency_factors(l);
+
+          // Calculate orthonormal-frame Stokes quantities before coupling to fluid
+          double *ss = &stokes(m,l,0);
+          double ss_start[4];
+          ProjectStokes(proj, proj_det, ss, ss_start);
+
+          // Extract coefficients
+          double j_s[4] = {};
+          double alpha_s[4] = {};
+          double rho_s[4] = {};
+          if (kept)
+          {
+            j_s[0] = j_i[adaptive_level](r,l);
+            j_s[1] = j_q[adaptive_level](r,l);
+            j_s[3] = j_v[adaptive_level](r,l);
+            alpha_s[0] = alpha_i[adaptive_level](r,l);
+            alpha_s[1] = alpha_q[adaptive_level](r,l);
+            alpha_s[3] = alpha_v[adaptive_level](r,l);
+            rho_s[1] = rho_q[adaptive_level](r,l);
+            rho_s[3] = rho_v[adaptive_level](r,l);
+          }
+
+          // Accumulate alternative image quantities
+          double delta_tau = alpha_s[0] * delta_lambda_cgs;
+          if (image_lambda or image_lambda_ave)
+            integrated_lambdas(l) += delta_lambda_cgs;
+          if (image_emission or image_emission_ave)
+            integrated_emissions(l) += j_s[0] * delta_lambda_cgs;
+          if (image_tau)
+            image[adaptive_level](image_offset_tau+l,m) += delta_tau;
+          if (image_lambda_ave and kept and not std::isnan(cell_values[adaptive_level](0,r)))
+            for (int a = 0; a < CellValues::num_cell_values; a++)
+            {
+              int index = image_offset_lambda_ave + l * CellValues::num_cell_values + a;
+              image[adaptive_level](index,m) +=
+                  cell_values[adaptive_level](a,r) * delta_lambda_cgs;
+            }
+          if (image_emission_ave and kept and not std::isnan(cell_values[adaptive_level](0,r)))
+            for (int a = 0; a < CellValues::num_cell_values; a++)
+            {
+              int index = image_offset_emission_ave + l * CellValues::num_cell_values + a;
+              image[adaptive_level](index,m) +=
+                  cell_values[adaptive_level](a,r) * j_s[0] * delta_lambda_cgs;
+            }
+          if (image_tau_int and kept and not std::isnan(cell_values[adaptive_level](0,r)))
+          {
+            if (delta_tau <= delta_tau_max)
+            {
+              double exp_neg = std::exp(-delta_tau);
+              double expm1 = std::expm1(delta_tau);
+              for (int a = 0; a < CellValues::num_cell_values; a++)
+              {
+                int index = image_offset_tau_int + l * CellValues::num_cell_values + a;
+                image[adaptive_level](index,m) = exp_neg
+                    * (image[adaptive_level](index,m) + cell_values[adaptive_level](a,r) * expm1);
+              }
+            }
+            else
+              for (int a = 0; a < CellValues::num_cell_values; a++)
+              {
+                int index = image_offset_tau_int + l * CellValues::num_cell_values + a;
+                image[adaptive_level](index,m) = cell_values[adaptive_level](a,r);
+              }
+          }
+
+          // Couple to matter
+          CouplePolarizedStokes(j_s, alpha_s, rho_s, delta_lambda_cgs, ss_start, ss);
+        }
+
+        // Reset basis to orthonormal frame after coupling
+        for (int p = 0; p < 2; p++)
+          for (int mu = 0; mu < 4; mu++)
+            ff[p][mu] = tetrad[p+1][mu];
+
+        // Parallel-transport basis by second half step
+        for (int p = 0; p < 2; p++)
+          for (int mu = 0; mu < 4; mu++)
+            ff_temp[p][mu] = ff[p][mu];
+        double temp_c[4][4] = {};
+        for (int mu = 0; mu < 4; mu++)
+          for (int beta = 0; beta < 4; beta++)
+            for (int alpha = 0; alpha < 4; alpha++)
+              temp_c[mu][beta] += kcon[alpha] * connection[mu][alpha][beta];
+        delta_lambda_local = (delta_lambda + delta_lambda_new) / 4.0;
+        for (int p = 0; p < 2; p++)
+          for (int mu = 0; mu < 4; mu++)
+          {
+            double dff_dlambda = 0.0;
+            for (int beta = 0; beta < 4; beta++)
+              dff_dlambda -= temp_c[mu][beta] * ff_temp[p][beta];
+            ff[p][mu] += dff_dlambda * delta_lambda_local;
+          }
+
+        // Store values in registers for next step
+        delta_lambda_old = delta_lambda;
+        for (int mu = 0; mu < 4; mu++)
+          kcon_old[mu] = kcon[mu];
+        for (int mu = 0; mu < 4; mu++)
+          for (int alpha = 0; alpha < 4; alpha++)
+            for (int beta = 0; beta < 4; beta++)
+              connection_old[mu][alpha][beta] = connection[mu][alpha][beta];
+      }
+
+      // Store basis
+      for (int p = 0; p < 2; p++)
+        for (int mu = 0; mu < 4; mu++)
+          basis(m,p,mu) = ff[p][mu];
+
+      // Store integrated quantities
+      for (int l = 0; l < image_num_frequencies; l++)
+      {
+        if (image_lambda)
+          image[adaptive_level](image_offset_lambda+l,m) = integrated_lambdas(l);
+        if (image_emission)
+          image[adaptive_level](image_offset_emission+l,m) = integrated_emissions(l);
+
+        // Normalize integrated quantities
+        if (image_lambda_ave)
+          for (int a = 0; a < CellValues::num_cell_values; a++)
+          {
+            int index = image_offset_lambda_ave + l * CellValues::num_cell_values + a;
+            image[adaptive_level](index,m) /= integrated_lambdas(l);
+          }
+        if (image_emission_ave)
+          for (int a = 0; a < CellValues::num_cell_values; a++)
+          {
+            int index = image_offset_emission_ave + l * CellValues::num_cell_values + a;
+            image[adaptive_level](index,m) /= integrated_emissions(l);
+          }
+      }
+      if (image_crossings)
+        image[adaptive_level](image_offset_crossings,m) = static_cast<double>(crossings_count);
+    }
+    ProfileRecordThread("IntegrateRadiation", ProfileSnapshot(), adaptive_level,
+        profile_time_start, omp_get_wtime(), profile_counts);
+    #pragma omp barrier
+
+    // Go through pixels, transforming into camera frame
+    #pragma omp for schedule(static)
+    for (int m = 0; m < num_pix; m++)
+    {
+      // Extract geodesic position and covariant momentum
+      double x = camera_pos[adaptive_level](m,1);
+      double y = camera_pos[adaptive_level](m,2);
+      double z = camera_pos[adaptive_level](m,3);
+      double kcov[4];
+      kcov[0] = camera_dir[adaptive_level](m,0);
+      kcov[1] = camera_dir[adaptive_level](m,1);
+      kcov[2] = camera_dir[adaptive_level](m,2);
+      kcov[3] = camera_dir[adaptive_level](m,3);
+
+      // Calculate metric
+      CovariantGeodesicMetric(x, y, z, gcov);
+      ContravariantGeodesicMetric(x, y, z, gcon);
+
+      // Calculate geodesic contravariant momentum
+      double kcon[4] = {};
+      for (int mu = 0; mu < 4; mu++)
+        for (int nu = 0; nu < 4; nu++)
+          kcon[mu] += gcon[mu][nu] * kcov[nu];
+
+      // Calculate orientation
+      double up_con[4];
+      up_con[0] = camera_u_con[0] * camera_vert_con_c[0] - (camera_u_cov[1] * camera_vert_con_c[1]
+          + camera_u_cov[2] * camera_vert_con_c[2] + camera_u_cov[3] * camera_vert_con_c[3])
+          / camera_u_cov[0];
+      up_con[1] = camera_vert_con_c[1] + camera_u_con[1] * camera_vert_con_c[0];
+      up_con[2] = camera_vert_con_c[2] + camera_u_con[2] * camera_vert_con_c[0];
+      up_con[3] = camera_vert_con_c[3] + camera_u_con[3] * camera_vert_con_c[0];
+
+      // Calculate orthonormal tetrad
+      Tetrad(camera_u_con, camera_u_cov, kcon, kcov, up_con, gcov, gcon, tetrad);
+
+      // Project basis onto orthonormal frame
+      double proj[2][2];
+      for (int p = 0; p < 2; p++)
+      {
+        double ff_cov[4] = {};
+        for (int mu = 0; mu < 4; mu++)
+          for (int nu = 0; nu < 4; nu++)
+            ff_cov[mu] += gcov[mu][nu] * basis(m,p,nu);
+        for (int a = 0; a < 2; a++)
+        {
+          proj[a][p] = 0.0;
+          for (int mu = 0; mu < 4; mu++)
+            proj[a][p] += tetrad[a+1][mu] * ff_cov[mu];
+        }
+      }
+      double proj_det = proj[0][0] * proj[1][1] - proj[0][1] * proj[1][0];
+
+      // Calculate orthonormal-frame Stokes quantities at camera location
+      for (int l = 0; l < image_num_frequencies; l++)
+      {
+        double ss_camera[4];
+        ProjectStokes(proj, proj_det, &stokes(m,l,0), ss_camera);
+        for (int a = 0; a < 4; a++)
+          image[adaptive_level](l*4+a,m) = ss_camera[a];
+      }
+    }
+
+    // Transform invariant Stokes quantities (e.g. I_nu/nu^3) to standard ones (e.g. I_nu)
+    #pragma omp for schedule(static) collapse(3)
+    for (int l = 0; l < image_num_frequencies; l++)
+      for (int a = 0; a < 4; a++)
+        for (int m = 0; m < num_pix; m++)
+        {
+          double nu_cu = image_frequencies(l) * image_frequencies(l) * image_frequencies(l);
+          image[adaptive_level](l*4+a,m) *= nu_cu;
+        }
+  }
+
+  // Free memory
+  if (adaptive_level > 0)
+  {
+    sample_prim[adaptive_level].Deallocate();
+    j_i[adaptive_level].Deallocate();
+    j_q[adaptive_level].Deallocate();
+    j_v[adaptive_level].Deallocate();
+    alpha_i[adaptive_level].Deallocate();
+    alpha_q[adaptive_level].Deallocate();
+    alpha_v[adaptive_level].Deallocate();
+    rho_q[adaptive_level].Deallocate();
+    rho_v[adaptive_level].Deallocate();
+    cell_values[adaptive_level].Deallocate();
+    render_lengths[adaptive_level].Deallocate();
+  }
+  ProfileCounts profile_counts;
+  profile_counts.rays = num_pix;
+  ProfileRecord("IntegrateRadiation", ProfileSnapshot(), adaptive_level, time_start,
+      omp_get_wtime(), profile_counts);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for projecting Stokes quantities from transported basis onto orthonormal frame
+// Inputs:
+//   proj: projections e_a . f_p of basis vectors f_p onto spatial tetrad vectors e_a
+//   proj_det: determinant of proj
+//   ss_basis: invariant Stokes quantities (I, Q, U, V) relative to basis
+// Outputs:
+//   ss_frame: invariant Stokes quantities (I, Q, U, V) relative to orthonormal frame
+// Notes:
+//   Evaluates the orthonormal-frame coherency matrix R n R^T, where n has real part
+//       ((I + Q, U), (U, I - Q)) and imaginary part V ((0, -1), (1, 0)); the latter transforms to
+//       V det(R) ((0, -1), (1, 0)).
+void RadiationIntegrator::ProjectStokes(const double proj[2][2], double proj_det,
+    const double ss_basis[4], double ss_frame[4]) const
+{
+  double nn_real[2][2];
+  nn_real[0][0] = ss_basis[0] + ss_basis[1];
+  nn_real[0][1] = ss_basis[2];
+  nn_real[1][0] = ss_basis[2];
+  nn_real[1][1] = ss_basis[0] - ss_basis[1];
+  double nn_frame[2][2] = {};
+  for (int a = 0; a < 2; a++)
+    for (int b = 0; b < 2; b++)
+      for (int p = 0; p < 2; p++)
+        for (int q = 0; q < 2; q++)
+          nn_frame[a][b] += proj[a][p] * nn_real[p][q] * proj[b][q];
+  ss_frame[0] = 0.5 * (nn_frame[0][0] + nn_frame[1][1]);
+  ss_frame[1] = 0.5 * (nn_frame[0][0] - nn_frame[1][1]);
+  ss_frame[2] = 0.5 * (nn_frame[0][1] + nn_frame[1][0]);
+  ss_frame[3] = ss_basis[3] * proj_det;
+  return;
+}
@@ -1,10 +1,12 @@
 // Blacklight radiation integrator - adaptive ray tracing
 
 // C++ headers
-#include <cmath>  // abs, hypot, isfinite
+#include <algorithm>  // max, min, sort
+#include <cmath>      // abs, floor, hypot, isfinite
+#include <limits>     // numeric_limits
 
 // Library headers
-#include <omp.h>  // pragmas, omp_get_thread_num
+#include <omp.h>  // omp_get_wtime, pragmas
 
 // Blacklight headers
 #include "radiation_integrator.hpp"
@@ -16,6 +18,9 @@
 // Inputs: (none)
 // Outputs:
 //   returned value: flag indicating no additional geodesics need to be run for this snapshot
+// Notes:
+//   If refining all flagged blocks would exceed a positive adaptive_ray_budget or
+//       adaptive_time_budget, only the highest-priority blocks that fit are refined.
 bool RadiationIntegrator::CheckAdaptiveRefinement()
 {
   // Handle case where no further refinement can be done
@@ -39,13 +44,10 @@ bool RadiationIntegrator::CheckAdaptiveRefinement()
   int num_refined_blocks = 0;
   #pragma omp parallel
   {
-    // Determine thread number
-    int thread = omp_get_thread_num();
-
     // Go through blocks at root level
     if (adaptive_level == 0)
     {
-      #pragma omp for schedule(static)
+      #pragma omp for schedule(runtime)
       for (int block = 0; block < block_counts[0]; block++)
       {
         // Check forced refinement
@@ -69,27 +71,20 @@ bool RadiationIntegrator::CheckAdaptiveRefinement()
         }
 
         // Check remaining refinement conditions
-        int s_full_start = adaptive_frequency_num
+        int s_full = adaptive_frequency_num
             * (model_type == ModelType::simulation and image_polarization ? 4 : 1);
-        int s_full_end =
-            s_full_start + (model_type == ModelType::simulation and image_polarization ? 4 : 1);
         int j_full_start = block / linear_root_blocks * adaptive_block_size;
         int i_full_start = block % linear_root_blocks * adaptive_block_size;
-        for (int s = 0, s_full = s_full_start; s_full < s_full_end; s++, s_full++)
-          for (int j = 0, j_full = j_full_start; j < adaptive_block_size; j++, j_full++)
-            for (int i = 0, i_full = i_full_start; i < adaptive_block_size; i++, i_full++)
-            {
-              int m = j_full * camera_resolution + i_full;
-              image_blocks[thread](s,j,i) = image[0](s_full,m);
-            }
-        refinement_flags[0](block) = EvaluateBlock(thread);
+        int m_start = j_full_start * camera_resolution + i_full_start;
+        refinement_flags[0](block) =
+            EvaluateBlock(&image[0](s_full,m_start), camera_resolution, nullptr);
       }
     }
 
     // Go through blocks beyond root level
     else
     {
-      #pragma omp for schedule(static)
+      #pragma omp for schedule(runtime)
       for (int block = 0; block < block_counts[adaptive_level]; block++)
       {
         // Check forced refinement
@@ -113,16 +108,11 @@ bool RadiationIntegrator::CheckAdaptiveRefinement()
         }
 
         // Check remaining refinement conditions
-        int s_full_start = adaptive_frequency_num
+        int s_full = adaptive_frequency_num
             * (model_type == ModelType::simulation and image_polarization ? 4 : 1);
-        int s_full_end =
-            s_full_start + (model_type == ModelType::simulation and image_polarization ? 4 : 1);
         int m_start = block * block_num_pix;
-        for (int s = 0, s_full = s_full_start; s_full < s_full_end; s++, s_full++)
-          for (int j = 0, m = m_start; j < adaptive_block_size; j++)
-            for (int i = 0; i < adaptive_block_size; i++, m++)
-              image_blocks[thread](s,j,i) = image[adaptive_level](s_full,m);
-        refinement_flags[adaptive_level](block) = EvaluateBlock(thread);
+        refinement_flags[adaptive_level](block) =
+            EvaluateBlock(&image[adaptive_level](s_full,m_start), adaptive_block_size, nullptr);
       }
     }
 
@@ -133,6 +123,14 @@ bool RadiationIntegrator::CheckAdaptiveRefinement()
         num_refined_blocks++;
   }
 
+  // Restrict refinement to budget
+  if (adaptive_ray_budget > 0 or adaptive_time_budget > 0.0)
+  {
+    int max_refined_blocks = RefinementBudget();
+    if (num_refined_blocks > max_refined_blocks)
+      num_refined_blocks = LimitRefinement(max_refined_blocks);
+  }
+
   // Record number of blocks needed for next level
   block_counts[adaptive_level+1] = num_refined_blocks * 4;
   return num_refined_blocks == 0;
@@ -140,11 +138,16 @@ bool RadiationIntegrator::CheckAdaptiveRefinement()
 
 //--------------------------------------------------------------------------------------------------
 
+
 // Function for determining if a block needs to be refined
 // Inputs:
-//   thread: thread number indicating which block should be examined
+//   intensity: pointer to first pixel of block within image
+//   stride: separation in memory between consecutive rows of block
+//   p_priority: pointer for storing priority, or nullptr
 // Outputs:
 //   returned value: flag indicating block needs to be refined
+//   *p_priority: largest amount by which k/n exceeds F over all tests run, if p_priority is not
+//       nullptr
 // Notes:
 //   There are up to 5 similar evaluations. In each case, a quantity Q is computed on n points or
 //       (overlapping) chunks of points. Let k be the number of times Q > C for the user-specified
@@ -160,153 +163,294 @@ bool RadiationIntegrator::CheckAdaptiveRefinement()
 //     (5) |lapl(I_nu) / I_nu|.
 //   Lengths used in the above derivatives are taken to be units of separation between points; that
 //       is, options (2)-(4) should decrease as refinement level increases.
-bool RadiationIntegrator::EvaluateBlock(int thread)
+//   All tests are evaluated together in a single pass over the rows of the block, reading the image
+//       in place.
+//   After each row, a test whose count k already exceeds F times the largest possible n triggers
+//       refinement without examining the rest of the block, unless a priority is requested.
+//   The priority is used to rank blocks when not all flagged blocks can be refined.
+bool RadiationIntegrator::EvaluateBlock(const double *intensity, int stride, double *p_priority)
+    const
 {
-  // Extract intensity
-  Array<double> intensity = image_blocks[thread];
-  intensity.Slice(3, 0, 0);
+  // Determine which tests to run
+  bool test_val = adaptive_val_frac >= 0.0;
+  bool test_abs_grad = adaptive_abs_grad_frac >= 0.0;
+  bool test_rel_grad = adaptive_rel_grad_frac >= 0.0;
+  bool test_abs_lapl = adaptive_abs_lapl_frac >= 0.0;
+  bool test_rel_lapl = adaptive_rel_lapl_frac >= 0.0;
+  bool test_lapl = test_abs_lapl or test_rel_lapl;
+  if (not (test_val or test_abs_grad or test_rel_grad or test_lapl))
+  {
+    if (p_priority != nullptr)
+      *p_priority = -std::numeric_limits<double>::infinity();
+    return false;
+  }
+
+  // Calculate largest possible numbers of points examined
+  int n = adaptive_block_size;
+  double num_points = static_cast<double>(n * n);
+  double num_points_lapl = static_cast<double>((n - 2) * (n - 2));
 
-  // Test value of intensity
-  if (adaptive_val_frac >= 0.0)
+  // Prepare counters
+  int val_examined = 0, val_exceeded = 0;
+  int abs_grad_examined = 0, abs_grad_exceeded = 0;
+  int rel_grad_examined = 0, rel_grad_exceeded = 0;
+  int abs_lapl_examined = 0, abs_lapl_exceeded = 0;
+  int rel_lapl_examined = 0, rel_lapl_exceeded = 0;
+
+  // Go through rows
+  for (int i = 0; i < n; i++)
   {
-    int num_examined = 0;
-    int num_exceeded = 0;
-    for (int i = 0; i < adaptive_block_size; i++)
-      for (int j = 0; j < adaptive_block_size; j++)
+    // Locate neighboring rows, using one-sided differences at edges
+    const double *row = intensity + i * stride;
+    const double *row_lo = i > 0 ? row - stride : row;
+    const double *row_hi = i < n - 1 ? row + stride : row;
+    bool y_interior = i > 0 and i < n - 1;
+    double grad_scale_y = y_interior ? 0.5 : 1.0;
+
+    // Go through points in row
+    #pragma omp simd reduction(+: val_examined, val_exceeded, abs_grad_examined, \
+        abs_grad_exceeded, rel_grad_examined, rel_grad_exceeded, abs_lapl_examined, \
+        abs_lapl_exceeded, rel_lapl_examined, rel_lapl_exceeded)
+    for (int j = 0; j < n; j++)
+    {
+      // Locate neighboring points, using one-sided differences at edges
+      int j_lo = j > 0 ? j - 1 : j;
+      int j_hi = j < n - 1 ? j + 1 : j;
+      bool x_interior = j > 0 and j < n - 1;
+      double grad_scale_x = x_interior ? 0.5 : 1.0;
+      double val_c = row[j];
+      double val_x_lo = row[j_lo];
+      double val_x_hi = row[j_hi];
+      double val_y_lo = row_lo[j];
+      double val_y_hi = row_hi[j];
+
+      // Test value of intensity
+      if (test_val)
       {
-        double q = std::abs(intensity(i,j));
-        if (std::isfinite(q))
-          num_examined++;
-        else
-          continue;
-        if (q > adaptive_val_cut)
-          num_exceeded++;
+        double q = std::abs(val_c);
+        bool finite = std::isfinite(q);
+        val_examined += finite ? 1 : 0;
+        val_exceeded += finite and q > adaptive_val_cut ? 1 : 0;
       }
-    double frac = static_cast<double>(num_exceeded) / static_cast<double>(num_examined);
-    if (frac > adaptive_val_frac)
-      return true;
-  }
 
-  // Test absolute gradient of intensity
-  if (adaptive_abs_grad_frac >= 0.0)
-  {
-    int num_examined = 0;
-    int num_exceeded = 0;
-    for (int i = 0; i < adaptive_block_size; i++)
-      for (int j = 0; j < adaptive_block_size; j++)
+      // Test absolute gradient of intensity
+      if (test_abs_grad)
       {
-        double q_x;
-        if (j == 0)
-          q_x = intensity(i,j+1) - intensity(i,j);
-        else if (j == adaptive_block_size - 1)
-          q_x = intensity(i,j) - intensity(i,j-1);
-        else
-          q_x = 0.5 * (intensity(i,j+1) - intensity(i,j-1));
-        double q_y;
-        if (i == 0)
-          q_y = intensity(i+1,j) - intensity(i,j);
-        else if (i == adaptive_block_size - 1)
-          q_y = intensity(i,j) - intensity(i-1,j);
-        else
-          q_y = 0.5 * (intensity(i+1,j) - intensity(i-1,j));
+        double q_x = grad_scale_x * (val_x_hi - val_x_lo);
+        double q_y = grad_scale_y * (val_y_hi - val_y_lo);
         double q = std::hypot(q_x, q_y);
-        if (std::isfinite(q))
-          num_examined++;
-        else
-          continue;
-        if (q > adaptive_abs_grad_cut)
-          num_exceeded++;
+        bool finite = std::isfinite(q);
+        abs_grad_examined += finite ? 1 : 0;
+        abs_grad_exceeded += finite and q > adaptive_abs_grad_cut ? 1 : 0;
       }
-    double frac = static_cast<double>(num_exceeded) / static_cast<double>(num_examined);
-    if (frac > adaptive_abs_grad_frac)
-      return true;
-  }
 
-  // Test relative gradient of intensity
-  if (adaptive_rel_grad_frac >= 0.0)
-  {
-    int num_examined = 0;
-    int num_exceeded = 0;
-    for (int i = 0; i < adaptive_block_size; i++)
-      for (int j = 0; j < adaptive_block_size; j++)
+      // Test relative gradient of intensity
+      if (test_rel_grad)
       {
-        double q_x;
-        if (j == 0)
-          q_x = 2.0 * (intensity(i,j+1) - intensity(i,j)) / (intensity(i,j) + intensity(i,j+1));
-        else if (j == adaptive_block_size - 1)
-          q_x = 2.0 * (intensity(i,j) - intensity(i,j-1)) / (intensity(i,j-1) + intensity(i,j));
-        else
-          q_x = 2.0 * (intensity(i,j+1) - intensity(i,j-1))
-              / (intensity(i,j-1) + 2.0 * intensity(i,j) + intensity(i,j+1));
-        double q_y;
-        if (i == 0)
-          q_y = 2.0 * (intensity(i+1,j) - intensity(i,j)) / (intensity(i,j) + intensity(i+1,j));
-        else if (i == adaptive_block_size - 1)
-          q_y = 2.0 * (intensity(i,j) - intensity(i-1,j)) / (intensity(i-1,j) + intensity(i,j));
-        else
-          q_y = 2.0 * (intensity(i+1,j) - intensity(i-1,j))
-              / (intensity(i-1,j) + 2.0 * intensity(i,j) + intensity(i+1,j));
+        double sum_x = x_interior ? val_x_lo + 2.0 * val_c + val_x_hi : val_x_lo + val_x_hi;
+        double sum_y = y_interior ? val_y_lo + 2.0 * val_c + val_y_hi : val_y_lo + val_y_hi;
+        double q_x = 2.0 * (val_x_hi - val_x_lo) / sum_x;
+        double q_y = 2.0 * (val_y_hi - val_y_lo) / sum_y;
         double q = std::hypot(q_x, q_y);
-        if (std::isfinite(q))
-          num_examined++;
-        else
-          continue;
-        if (q > adaptive_rel_grad_cut)
-          num_exceeded++;
+        bool finite = std::isfinite(q);
+        rel_grad_examined += finite ? 1 : 0;
+        rel_grad_exceeded += finite and q > adaptive_rel_grad_cut ? 1 : 0;
       }
-    double frac = static_cast<double>(num_exceeded) / static_cast<double>(num_examined);
-    if (frac > adaptive_rel_grad_frac)
-      return true;
-  }
 
-  // Test absolute Laplacian of intensity
-  if (adaptive_abs_lapl_frac >= 0.0)
-  {
-    int num_examined = 0;
-    int num_exceeded = 0;
-    for (int i = 1; i < adaptive_block_size - 1; i++)
-      for (int j = 1; j < adaptive_block_size - 1; j++)
+      // Test Laplacian of intensity away from edges
+      if (test_lapl and x_interior and y_interior)
       {
-        double q_x = intensity(i,j-1) - 2.0 * intensity(i,j) + intensity(i,j+1);
-        double q_y = intensity(i-1,j) - 2.0 * intensity(i,j) + intensity(i+1,j);
-        double q = std::abs(q_x + q_y);
-        if (std::isfinite(q))
-          num_examined++;
-        else
-          continue;
-        if (q > adaptive_abs_lapl_cut)
-          num_exceeded++;
+        double diff_x = val_x_lo - 2.0 * val_c + val_x_hi;
+        double diff_y = val_y_lo - 2.0 * val_c + val_y_hi;
+        if (test_abs_lapl)
+        {
+          double q = std::abs(diff_x + diff_y);
+          bool finite = std::isfinite(q);
+          abs_lapl_examined += finite ? 1 : 0;
+          abs_lapl_exceeded += finite and q > adaptive_abs_lapl_cut ? 1 : 0;
+        }
+        if (test_rel_lapl)
+        {
+          double q_x = 4.0 * diff_x / (val_x_lo + 2.0 * val_c + val_x_hi);
+          double q_y = 4.0 * diff_y / (val_y_lo + 2.0 * val_c + val_y_hi);
+          double q = std::abs(q_x + q_y);
+          bool finite = std::isfinite(q);
+          rel_lapl_examined += finite ? 1 : 0;
+          rel_lapl_exceeded += finite and q > adaptive_rel_lapl_cut ? 1 : 0;
+        }
       }
-    double frac = static_cast<double>(num_exceeded) / static_cast<double>(num_examined);
-    if (frac > adaptive_abs_lapl_frac)
+    }
+
+    // Check for early exit
+    if (p_priority == nullptr
+        and ((test_val and static_cast<double>(val_exceeded) / num_points > adaptive_val_frac)
+        or (test_abs_grad
+        and static_cast<double>(abs_grad_exceeded) / num_points > adaptive_abs_grad_frac)
+        or (test_rel_grad
+        and static_cast<double>(rel_grad_exceeded) / num_points > adaptive_rel_grad_frac)
+        or (test_abs_lapl
+        and static_cast<double>(abs_lapl_exceeded) / num_points_lapl > adaptive_abs_lapl_frac)
+        or (test_rel_lapl
+        and static_cast<double>(rel_lapl_exceeded) / num_points_lapl > adaptive_rel_lapl_frac)))
       return true;
   }
 
-  // Test relative Laplacian of intensity
-  if (adaptive_rel_lapl_frac >= 0.0)
+  // Evaluate tests, ignoring those with no finite points
+  double margin = -std::numeric_limits<double>::infinity();
+  if (test_val)
+    margin = std::max(margin, static_cast<double>(val_exceeded)
+        / static_cast<double>(val_examined) - adaptive_val_frac);
+  if (test_abs_grad)
+    margin = std::max(margin, static_cast<double>(abs_grad_exceeded)
+        / static_cast<double>(abs_grad_examined) - adaptive_abs_grad_frac);
+  if (test_rel_grad)
+    margin = std::max(margin, static_cast<double>(rel_grad_exceeded)
+        / static_cast<double>(rel_grad_examined) - adaptive_rel_grad_frac);
+  if (test_abs_lapl)
+    margin = std::max(margin, static_cast<double>(abs_lapl_exceeded)
+        / static_cast<double>(abs_lapl_examined) - adaptive_abs_lapl_frac);
+  if (test_rel_lapl)
+    margin = std::max(margin, static_cast<double>(rel_lapl_exceeded)
+        / static_cast<double>(rel_lapl_examined) - adaptive_rel_lapl_frac);
+  if (p_priority != nullptr)
+    *p_priority = margin;
+  return margin > 0.0;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for determining how many blocks can be refined within budget
+// Inputs: (none)
+// Outputs:
+//   returned value: largest number of blocks at current level that can be refined
+// Notes:
+//   Counts every pixel at every level integrated so far as a ray, including rays reused from
+//       parents with adaptive_reuse_rays.
+//   Extrapolates the cost of the next level from the average wall-clock time per ray since the
+//       root level began, which need not include the root geodesics. Since refined levels also
+//       integrate geodesics, the last level may overrun adaptive_time_budget.
+int RadiationIntegrator::RefinementBudget() const
+{
+  // Count rays
+  double num_rays = 0.0;
+  for (int level = 0; level <= adaptive_level; level++)
+    num_rays += static_cast<double>(block_counts[level]) * block_num_pix;
+  double block_rays = 4.0 * block_num_pix;
+
+  // Apply ray budget
+  double max_refined_blocks = std::numeric_limits<int>::max();
+  if (adaptive_ray_budget > 0)
+    max_refined_blocks =
+        std::min(max_refined_blocks, (adaptive_ray_budget - num_rays) / block_rays);
+
+  // Apply time budget
+  if (adaptive_time_budget > 0.0)
+  {
+    double time_elapsed = omp_get_wtime() - adaptive_time_start;
+    double time_per_ray = time_elapsed / num_rays;
+    if (time_elapsed >= adaptive_time_budget)
+      max_refined_blocks = 0.0;
+    else if (time_per_ray > 0.0)
+      max_refined_blocks = std::min(max_refined_blocks,
+          (adaptive_time_budget - time_elapsed) / time_per_ray / block_rays);
+  }
+  return static_cast<int>(std::max(std::floor(max_refined_blocks), 0.0));
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for keeping only the highest-priority refinement flags at current level
+// Inputs:
+//   max_refined_blocks: number of flagged blocks to keep
+// Outputs:
+//   returned value: number of blocks still flagged for refinement
+// Notes:
+//   Assumes more than max_refined_blocks blocks are flagged.
+//   Blocks are ranked by the priority from EvaluateBlock(), with blocks flagged only by forced
+//       refinement regions ranked first, and ties broken by block index.
+int RadiationIntegrator::LimitRefinement(int max_refined_blocks)
+{
+  // Collect flagged blocks
+  int num_blocks = block_counts[adaptive_level];
+  Array<int> flagged_blocks(num_blocks);
+  int num_flagged_blocks = 0;
+  for (int block = 0; block < num_blocks; block++)
+    if (refinement_flags[adaptive_level](block))
+      flagged_blocks(num_flagged_blocks++) = block;
+
+  // Rank flagged blocks
+  if (max_refined_blocks > 0)
   {
-    int num_examined = 0;
-    int num_exceeded = 0;
-    for (int i = 1; i < adaptive_block_size - 1; i++)
-      for (int j = 1; j < adaptive_block_size - 1; j++)
+    // Calculate priorities
+    Array<double> priorities(num_blocks);
+    int s_full = adaptive_frequency_num
+        * (model_type == ModelType::simulation and image_polarization ? 4 : 1);
+    #pragma omp parallel for schedule(runtime)
+    for (int n = 0; n < num_flagged_blocks; n++)
+    {
+      int block = flagged_blocks(n);
+      int m_start = block * block_num_pix;
+      int stride = adaptive_block_size;
+      if (adaptive_level == 0)
       {
-        double q_x = 4.0 * (intensity(i,j-1) - 2.0 * intensity(i,j) + intensity(i,j+1))
-            / (intensity(i,j-1) + 2.0 * intensity(i,j) + intensity(i,j+1));
-        double q_y = 4.0 * (intensity(i-1,j) - 2.0 * intensity(i,j) + intensity(i+1,j))
-            / (intensity(i-1,j) + 2.0 * intensity(i,j) + intensity(i+1,j));
-        double q = std::abs(q_x + q_y);
-        if (std::isfinite(q))
-          num_examined++;
-        else
-          continue;
-        if (q > adaptive_rel_lapl_cut)
-          num_exceeded++;
+        int j_full_start = block / linear_root_blocks * adaptive_block_size;
+        int i_full_start = block % linear_root_blocks * adaptive_block_size;
+        m_start = j_full_start * camera_resolution + i_full_start;
+        stride = camera_resolution;
       }
-    double frac = static_cast<double>(num_exceeded) / static_cast<double>(num_examined);
-    if (frac > adaptive_rel_lapl_frac)
-      return true;
+      double priority = 0.0;
+      if (not EvaluateBlock(&image[adaptive_level](s_full,m_start), stride, &priority))
+        priority = std::numeric_limits<double>::infinity();
+      priorities(block) = priority;
+    }
+
+    // Sort blocks by priority
+    std::sort(flagged_blocks.data, flagged_blocks.data + num_flagged_blocks,
+        [&priorities](int block_a, int block_b)
+        {
+          if (priorities(block_a) != priorities(block_b))
+            return priorities(block_a) > priorities(block_b);
+          return block_a < block_b;
+        });
   }
 
-  // Conclude no refinement is needed
-  return false;
+  // Clear flags of remaining blocks
+  for (int n = max_refined_blocks; n < num_flagged_blocks; n++)
+    refinement_flags[adaptive_level](flagged_blocks(n)) = false;
+  return max_refined_blocks;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for freeing data from refined levels
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Deallocates image, rendering, and any remaining working data at all levels beyond the root, so
+//       that the next snapshot can refine different blocks.
+//   Should only be called once output has been written for the current snapshot.
+void RadiationIntegrator::ReleaseLevels()
+{
+  for (int level = 1; level <= adaptive_max_level; level++)
+  {
+    sample_offsets[level].Deallocate();
+    sample_inds[level].Deallocate();
+    sample_fracs[level].Deallocate();
+    sample_status[level].Deallocate();
+    sample_prim[level].Deallocate();
+    j_i[level].Deallocate();
+    j_q[level].Deallocate();
+    j_v[level].Deallocate();
+    alpha_i[level].Deallocate();
+    alpha_q[level].Deallocate();
+    alpha_v[level].Deallocate();
+    rho_q[level].Deallocate();
+    rho_v[level].Deallocate();
+    cell_values[level].Deallocate();
+    image[level].Deallocate();
+    render[level].Deallocate();
+    render_lengths[level].Deallocate();
+    refinement_flags[level].Deallocate();
+  }
+  return;
 }
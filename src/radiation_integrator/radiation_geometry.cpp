@@ -133,13 +133,42 @@ void RadiationIntegrator::CoordinateJacobian(double x, double y, double z, doubl
 // Outputs:
 //   gcov: components set
 // Notes:
+//   Dispatches to version specialized for metric_type.
+//   Coefficient and transfer loops call this and the other dispatching geometry functions rather
+//       than being templated on the metric. The branch is on a member fixed for the run, so it is
+//       perfectly predicted, and it is taken once per metric evaluation, whose cost dwarfs it;
+//       hardwiring the specialized kernel changes image integration time by less than run-to-run
+//       noise. Templating the loops would instead instantiate the large polarized and unpolarized
+//       integrators once per metric.
+void RadiationIntegrator::CovariantGeodesicMetric(double x, double y, double z, double gcov[4][4])
+    const
+{
+  if (metric_type == MetricType::schwarzschild)
+    CovariantGeodesicMetric<MetricType::schwarzschild>(x, y, z, gcov);
+  else if (metric_type == MetricType::kerr)
+    CovariantGeodesicMetric<MetricType::kerr>(x, y, z, gcov);
+  else
+    CovariantGeodesicMetric<MetricType::flat>(x, y, z, gcov);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating covariant metric components in geodesic coordinates,
+//     specialized for given metric
+// Inputs:
+//   x, y, z: Cartesian Kerr-Schild coordinates
+// Outputs:
+//   gcov: components set
+// Notes:
 //   Assumes gcov is allocated to be 4*4.
-//   Assumes Minkowski coordinates if ray_flat == true.
+//   Assumes Minkowski coordinates for flat metric.
+template<MetricType metric>
 void RadiationIntegrator::CovariantGeodesicMetric(double x, double y, double z, double gcov[4][4])
     const
 {
   // Handle flat case
-  if (ray_flat)
+  if constexpr (metric == MetricType::flat)
   {
     gcov[0][0] = -1.0;
     gcov[0][1] = 0.0;
@@ -160,18 +189,28 @@ void RadiationIntegrator::CovariantGeodesicMetric(double x, double y, double z,
     return;
   }
 
-  // Calculate useful quantities
-  double a2 = bh_a * bh_a;
-  double rr2 = x * x + y * y + z * z;
-  double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
-  double r = std::sqrt(r2);
-  double f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
-
-  // Calculate null vector
+  // Calculate useful quantities and null vector
+  double f, l_1, l_2, l_3;
+  if constexpr (metric == MetricType::schwarzschild)
+  {
+    double r = std::sqrt(x * x + y * y + z * z);
+    f = 2.0 * bh_m / r;
+    l_1 = x / r;
+    l_2 = y / r;
+    l_3 = z / r;
+  }
+  else
+  {
+    double a2 = bh_a * bh_a;
+    double rr2 = x * x + y * y + z * z;
+    double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
+    double r = std::sqrt(r2);
+    f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
+    l_1 = (r * x + bh_a * y) / (r2 + a2);
+    l_2 = (r * y - bh_a * x) / (r2 + a2);
+    l_3 = z / r;
+  }
   double l_0 = 1.0;
-  double l_1 = (r * x + bh_a * y) / (r2 + a2);
-  double l_2 = (r * y - bh_a * x) / (r2 + a2);
-  double l_3 = z / r;
 
   // Calculate metric components
   gcov[0][0] = f * l_0 * l_0 - 1.0;
@@ -201,13 +240,36 @@ void RadiationIntegrator::CovariantGeodesicMetric(double x, double y, double z,
 // Outputs:
 //   gcon: components set
 // Notes:
+//   Dispatches to version specialized for metric_type, as in CovariantGeodesicMetric().
+void RadiationIntegrator::ContravariantGeodesicMetric(double x, double y, double z,
+    double gcon[4][4]) const
+{
+  if (metric_type == MetricType::schwarzschild)
+    ContravariantGeodesicMetric<MetricType::schwarzschild>(x, y, z, gcon);
+  else if (metric_type == MetricType::kerr)
+    ContravariantGeodesicMetric<MetricType::kerr>(x, y, z, gcon);
+  else
+    ContravariantGeodesicMetric<MetricType::flat>(x, y, z, gcon);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating contravariant metric components in geodesic coordinates,
+//     specialized for given metric
+// Inputs:
+//   x, y, z: Cartesian Kerr-Schild coordinates
+// Outputs:
+//   gcon: components set
+// Notes:
 //   Assumes gcon is allocated to be 4*4.
-//   Assumes Minkowski coordinates if ray_flat == true.
+//   Assumes Minkowski coordinates for flat metric.
+template<MetricType metric>
 void RadiationIntegrator::ContravariantGeodesicMetric(double x, double y, double z,
     double gcon[4][4]) const
 {
   // Handle flat case
-  if (ray_flat)
+  if constexpr (metric == MetricType::flat)
   {
     gcon[0][0] = -1.0;
     gcon[0][1] = 0.0;
@@ -228,18 +290,28 @@ void RadiationIntegrator::ContravariantGeodesicMetric(double x, double y, double
     return;
   }
 
-  // Calculate useful quantities
-  double a2 = bh_a * bh_a;
-  double rr2 = x * x + y * y + z * z;
-  double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
-  double r = std::sqrt(r2);
-  double f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
-
-  // Calculate null vector
+  // Calculate useful quantities and null vector
+  double f, l1, l2, l3;
+  if constexpr (metric == MetricType::schwarzschild)
+  {
+    double r = std::sqrt(x * x + y * y + z * z);
+    f = 2.0 * bh_m / r;
+    l1 = x / r;
+    l2 = y / r;
+    l3 = z / r;
+  }
+  else
+  {
+    double a2 = bh_a * bh_a;
+    double rr2 = x * x + y * y + z * z;
+    double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
+    double r = std::sqrt(r2);
+    f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
+    l1 = (r * x + bh_a * y) / (r2 + a2);
+    l2 = (r * y - bh_a * x) / (r2 + a2);
+    l3 = z / r;
+  }
   double l0 = -1.0;
-  double l1 = (r * x + bh_a * y) / (r2 + a2);
-  double l2 = (r * y - bh_a * x) / (r2 + a2);
-  double l3 = z / r;
 
   // Calculate metric components
   gcon[0][0] = -f * l0 * l0 - 1.0;
@@ -269,13 +341,37 @@ void RadiationIntegrator::ContravariantGeodesicMetric(double x, double y, double
 // Outputs:
 //   connection: components set
 // Notes:
+//   Dispatches to version specialized for metric_type, as in CovariantGeodesicMetric().
+void RadiationIntegrator::GeodesicConnection(double x, double y, double z,
+    double connection[4][4][4]) const
+{
+  if (metric_type == MetricType::schwarzschild)
+    GeodesicConnection<MetricType::schwarzschild>(x, y, z, connection);
+  else if (metric_type == MetricType::kerr)
+    GeodesicConnection<MetricType::kerr>(x, y, z, connection);
+  else
+    GeodesicConnection<MetricType::flat>(x, y, z, connection);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating Christoffel connection components in geodesic coordinates,
+//     specialized for given metric
+// Inputs:
+//   x, y, z: Cartesian Kerr-Schild coordinates
+// Outputs:
+//   connection: components set
+// Notes:
 //   Assumes connection is allocated to be 4*4*4.
-//   Assumes Minkowski coordinates if ray_flat == true.
+//   Assumes Minkowski coordinates for flat metric.
+//   Schwarzschild case uses d(l^i) / d(x^j) = (delta^i_j - l^i l^j) / r.
+template<MetricType metric>
 void RadiationIntegrator::GeodesicConnection(double x, double y, double z,
     double connection[4][4][4]) const
 {
   // Handle flat case
-  if (ray_flat)
+  if constexpr (metric == MetricType::flat)
   {
     for (int mu = 0; mu < 4; mu++)
       for (int alpha = 0; alpha < 4; alpha++)
@@ -284,18 +380,75 @@ void RadiationIntegrator::GeodesicConnection(double x, double y, double z,
     return;
   }
 
-  // Calculate useful quantities
-  double a2 = bh_a * bh_a;
-  double rr2 = x * x + y * y + z * z;
-  double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
-  double r = std::sqrt(r2);
-  double f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
+  // Calculate null vector and its derivatives
+  double f, l1, l2, l3;
+  double df_dx, df_dy, df_dz;
+  double dl1_dx, dl1_dy, dl1_dz, dl2_dx, dl2_dy, dl2_dz, dl3_dx, dl3_dy, dl3_dz;
+  if constexpr (metric == MetricType::schwarzschild)
+  {
+    // Calculate useful quantities
+    double r = std::sqrt(x * x + y * y + z * z);
+    f = 2.0 * bh_m / r;
+
+    // Calculate null vector
+    l1 = x / r;
+    l2 = y / r;
+    l3 = z / r;
+
+    // Calculate scalar derivatives
+    df_dx = -f * l1 / r;
+    df_dy = -f * l2 / r;
+    df_dz = -f * l3 / r;
+
+    // Calculate vector derivatives
+    dl1_dx = (1.0 - l1 * l1) / r;
+    dl1_dy = -l1 * l2 / r;
+    dl1_dz = -l1 * l3 / r;
+    dl2_dx = -l2 * l1 / r;
+    dl2_dy = (1.0 - l2 * l2) / r;
+    dl2_dz = -l2 * l3 / r;
+    dl3_dx = -l3 * l1 / r;
+    dl3_dy = -l3 * l2 / r;
+    dl3_dz = (1.0 - l3 * l3) / r;
+  }
+  else
+  {
+    // Calculate useful quantities
+    double a2 = bh_a * bh_a;
+    double rr2 = x * x + y * y + z * z;
+    double r2 = 0.5 * (rr2 - a2 + std::hypot(rr2 - a2, 2.0 * bh_a * z));
+    double r = std::sqrt(r2);
+    f = 2.0 * bh_m * r2 * r / (r2 * r2 + a2 * z * z);
 
-  // Calculate null vector
+    // Calculate null vector
+    l1 = (r * x + bh_a * y) / (r2 + a2);
+    l2 = (r * y - bh_a * x) / (r2 + a2);
+    l3 = z / r;
+
+    // Calculate scalar derivatives
+    double dr_dx = r * x / (2.0 * r2 - rr2 + a2);
+    double dr_dy = r * y / (2.0 * r2 - rr2 + a2);
+    double dr_dz = (r * z + a2 * z / r) / (2.0 * r2 - rr2 + a2);
+    df_dx = -(r2 * r2 - 3.0 * a2 * z * z) * dr_dx / (r * (r2 * r2 + a2 * z * z)) * f;
+    df_dy = -(r2 * r2 - 3.0 * a2 * z * z) * dr_dy / (r * (r2 * r2 + a2 * z * z)) * f;
+    df_dz = -((r2 * r2 - 3.0 * a2 * z * z) * dr_dz + 2.0 * a2 * r * z)
+        / (r * (r2 * r2 + a2 * z * z)) * f;
+
+    // Calculate vector derivatives
+    dl1_dx = ((x - 2.0 * r * l1) * dr_dx + r) / (r2 + a2);
+    dl1_dy = ((x - 2.0 * r * l1) * dr_dy + bh_a) / (r2 + a2);
+    dl1_dz = (x - 2.0 * r * l1) * dr_dz / (r2 + a2);
+    dl2_dx = ((y - 2.0 * r * l2) * dr_dx - bh_a) / (r2 + a2);
+    dl2_dy = ((y - 2.0 * r * l2) * dr_dy + r) / (r2 + a2);
+    dl2_dz = (y - 2.0 * r * l2) * dr_dz / (r2 + a2);
+    dl3_dx = -z / r2 * dr_dx;
+    dl3_dy = -z / r2 * dr_dy;
+    dl3_dz = -z / r2 * dr_dz + 1.0 / r;
+  }
   double l0 = -1.0;
-  double l1 = (r * x + bh_a * y) / (r2 + a2);
-  double l2 = (r * y - bh_a * x) / (r2 + a2);
-  double l3 = z / r;
+  double dl0_dx = 0.0;
+  double dl0_dy = 0.0;
+  double dl0_dz = 0.0;
 
   // Calculate metric components
   double gcon[4][4];
@@ -316,29 +469,6 @@ void RadiationIntegrator::GeodesicConnection(double x, double y, double z,
   gcon[3][2] = -f * l3 * l2;
   gcon[3][3] = -f * l3 * l3 + 1.0;
 
-  // Calculate scalar derivatives
-  double dr_dx = r * x / (2.0 * r2 - rr2 + a2);
-  double dr_dy = r * y / (2.0 * r2 - rr2 + a2);
-  double dr_dz = (r * z + a2 * z / r) / (2.0 * r2 - rr2 + a2);
-  double df_dx = -(r2 * r2 - 3.0 * a2 * z * z) * dr_dx / (r * (r2 * r2 + a2 * z * z)) * f;
-  double df_dy = -(r2 * r2 - 3.0 * a2 * z * z) * dr_dy / (r * (r2 * r2 + a2 * z * z)) * f;
-  double df_dz = -((r2 * r2 - 3.0 * a2 * z * z) * dr_dz + 2.0 * a2 * r * z)
-      / (r * (r2 * r2 + a2 * z * z)) * f;
-
-  // Calculate vector derivatives
-  double dl0_dx = 0.0;
-  double dl0_dy = 0.0;
-  double dl0_dz = 0.0;
-  double dl1_dx = ((x - 2.0 * r * l1) * dr_dx + r) / (r2 + a2);
-  double dl1_dy = ((x - 2.0 * r * l1) * dr_dy + bh_a) / (r2 + a2);
-  double dl1_dz = (x - 2.0 * r * l1) * dr_dz / (r2 + a2);
-  double dl2_dx = ((y - 2.0 * r * l2) * dr_dx - bh_a) / (r2 + a2);
-  double dl2_dy = ((y - 2.0 * r * l2) * dr_dy + r) / (r2 + a2);
-  double dl2_dz = (y - 2.0 * r * l2) * dr_dz / (r2 + a2);
-  double dl3_dx = -z / r2 * dr_dx;
-  double dl3_dy = -z / r2 * dr_dy;
-  double dl3_dz = -z / r2 * dr_dz + 1.0 / r;
-
   // Prepare array for covariant metric component derivatives
   double dgcov[4][4][4] = {};
 
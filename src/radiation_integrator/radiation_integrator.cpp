@@ -2,6 +2,7 @@
 
 // C++ headers
 #include <algorithm>  // max
+#include <cstddef>    // size_t
 #include <optional>   // optional
 
 // Library headers
@@ -15,6 +16,7 @@
 #include "../simulation_reader/simulation_reader.hpp"      // SimulationReader
 #include "../utils/array.hpp"                              // Array
 #include "../utils/exceptions.hpp"                         // BlacklightException, BlacklightWarning
+#include "../utils/profiler.hpp"                           // profiling functions
 
 //--------------------------------------------------------------------------------------------------
 
@@ -64,21 +66,30 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
       simulation_block_interp = p_input_reader->simulation_block_interp.value();
     else if (p_input_reader->simulation_block_interp.has_value())
       BlacklightWarning("Ignoring simulation_block_interp selection.");
+    simulation_geom_cache = false;
+    if (p_input_reader->simulation_geom_cache.has_value())
+      simulation_geom_cache = p_input_reader->simulation_geom_cache.value();
+    simulation_fused_coeffs = false;
+    if (p_input_reader->simulation_fused_coeffs.has_value())
+      simulation_fused_coeffs = p_input_reader->simulation_fused_coeffs.value();
+    simulation_precision = PrimitivePrecision::single;
+  }
+  else
+  {
+    if (p_input_reader->simulation_geom_cache.has_value()
+        and p_input_reader->simulation_geom_cache.value())
+      BlacklightWarning("Ignoring simulation_geom_cache selection.");
+    simulation_fused_coeffs = false;
+    if (p_input_reader->simulation_fused_coeffs.has_value()
+        and p_input_reader->simulation_fused_coeffs.value())
+      BlacklightWarning("Ignoring simulation_fused_coeffs selection.");
   }
 
   // Copy formula parameters
   if (model_type == ModelType::formula)
   {
     formula_mass = p_input_reader->formula_mass.value();
-    formula_r0 = p_input_reader->formula_r0.value();
-    formula_h = p_input_reader->formula_h.value();
-    formula_l0 = p_input_reader->formula_l0.value();
-    formula_q = p_input_reader->formula_q.value();
-    formula_nup = p_input_reader->formula_nup.value();
-    formula_cn0 = p_input_reader->formula_cn0.value();
-    formula_alpha = p_input_reader->formula_alpha.value();
-    formula_a = p_input_reader->formula_a.value();
-    formula_beta = p_input_reader->formula_beta.value();
+    CopyFormulaModel(p_input_reader);
   }
 
   // Copy camera parameters
@@ -94,6 +105,8 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
   // Copy image parameters
   image_light = p_input_reader->image_light.value();
   image_num_frequencies = p_input_reader->image_num_frequencies.value();
+  image_polarization = false;
+  image_stokes_transport = false;
   if (image_light)
   {
     if (model_type == ModelType::simulation)
@@ -102,11 +115,18 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
         and p_input_reader->image_polarization.value())
       BlacklightWarning("Ignoring image_polarization selection.");
     if (image_polarization)
+    {
       image_rotation_split = p_input_reader->image_rotation_split.value();
+      if (p_input_reader->image_stokes_transport.has_value())
+        image_stokes_transport = p_input_reader->image_stokes_transport.value();
+    }
   }
   else if (p_input_reader->image_polarization.has_value()
       and p_input_reader->image_polarization.value())
     BlacklightWarning("Ignoring image_polarization selection.");
+  if (not image_polarization and p_input_reader->image_stokes_transport.has_value()
+      and p_input_reader->image_stokes_transport.value())
+    BlacklightWarning("Ignoring image_stokes_transport selection.");
   image_time = p_input_reader->image_time.value();
   image_length = p_input_reader->image_length.value();
   image_lambda = p_input_reader->image_lambda.value();
@@ -181,6 +201,7 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
         render_types[n_i][n_f] = p_input_reader->render_types[n_i][n_f].value();
         if (render_types[n_i][n_f] == RenderType::fill)
         {
+          render_fill_present = true;
           render_min_vals[n_i][n_f] = p_input_reader->render_min_vals[n_i][n_f].value();
           render_max_vals[n_i][n_f] = p_input_reader->render_max_vals[n_i][n_f].value();
           render_tau_scales[n_i][n_f] = p_input_reader->render_tau_scales[n_i][n_f].value();
@@ -253,6 +274,12 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
     adaptive_rel_lapl_frac = p_input_reader->adaptive_rel_lapl_frac.value();
     if (adaptive_rel_lapl_frac >= 0.0)
       adaptive_rel_lapl_cut = p_input_reader->adaptive_rel_lapl_cut.value();
+    adaptive_time_budget = 0.0;
+    if (p_input_reader->adaptive_time_budget.has_value())
+      adaptive_time_budget = p_input_reader->adaptive_time_budget.value();
+    adaptive_ray_budget = 0;
+    if (p_input_reader->adaptive_ray_budget.has_value())
+      adaptive_ray_budget = p_input_reader->adaptive_ray_budget.value();
     adaptive_num_regions = p_input_reader->adaptive_num_regions.value();
     if (adaptive_num_regions > 0)
     {
@@ -279,40 +306,18 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
     plasma_ne_ni = p_input_reader->plasma_ne_ni.value();
     plasma_model = p_input_reader->plasma_model.value();
     if (plasma_model == PlasmaModel::ti_te_beta)
-    {
       plasma_use_p = p_input_reader->plasma_use_p.value();
-      plasma_rat_low = p_input_reader->plasma_rat_low.value();
-      plasma_rat_high = p_input_reader->plasma_rat_high.value();
-    }
-    plasma_power_frac = p_input_reader->plasma_power_frac.value();
-    if (plasma_power_frac < 0.0 or plasma_power_frac > 1.0)
-      BlacklightWarning("Fraction of power-law electrons outside [0, 1].");
-    if (plasma_power_frac != 0.0)
-    {
-      plasma_p = p_input_reader->plasma_p.value();
-      plasma_gamma_min = p_input_reader->plasma_gamma_min.value();
-      plasma_gamma_max = p_input_reader->plasma_gamma_max.value();
-    }
-    plasma_kappa_frac = p_input_reader->plasma_kappa_frac.value();
-    if (plasma_kappa_frac < 0.0 or plasma_kappa_frac > 1.0)
-      BlacklightWarning("Fraction of kappa-distribution electrons outside [0, 1].");
-    if (plasma_kappa_frac != 0.0)
-    {
-      plasma_kappa = p_input_reader->plasma_kappa.value();
-      if (image_light and image_polarization)
-      {
-        if (plasma_kappa < 3.5 or plasma_kappa > 5.0)
-          throw BlacklightException("Polarized transport only supports kappa in [3.5, 5].");
-        else if (plasma_kappa != 3.5 and plasma_kappa != 4.0 and plasma_kappa != 4.5
-            and plasma_kappa != 5.0)
-          BlacklightWarning("Polarized transport will interpolate formulas based on kappa.");
-      }
-      plasma_w = p_input_reader->plasma_w.value();
-    }
-    plasma_thermal_frac = 1.0 - (plasma_power_frac + plasma_kappa_frac);
-    if (plasma_thermal_frac < 0.0 or plasma_thermal_frac > 1.0)
-      BlacklightWarning("Fraction of thermal electrons outside [0, 1].");
+    CopyPlasmaModel(p_input_reader);
+    plasma_table = false;
+    if (p_input_reader->plasma_table.has_value())
+      plasma_table = p_input_reader->plasma_table.value();
+    if (plasma_table)
+      plasma_table_file = p_input_reader->plasma_table_file;
+    else if (p_input_reader->plasma_table_file.has_value())
+      BlacklightWarning("Ignoring plasma_table_file selection.");
   }
+  else if (p_input_reader->plasma_table.has_value() and p_input_reader->plasma_table.value())
+    BlacklightWarning("Ignoring plasma_table selection.");
 
   // Copy cut parameters
   if (model_type == ModelType::simulation)
@@ -331,6 +336,11 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
     cut_sigma_max = p_input_reader->cut_sigma_max.value();
     cut_beta_inverse_min = p_input_reader->cut_beta_inverse_min.value();
     cut_beta_inverse_max = p_input_reader->cut_beta_inverse_max.value();
+    cut_cell_values = cut_rho_min >= 0.0 or cut_rho_max >= 0.0 or cut_n_e_min >= 0.0
+        or cut_n_e_max >= 0.0 or cut_p_gas_min >= 0.0 or cut_p_gas_max >= 0.0
+        or cut_theta_e_min >= 0.0 or cut_theta_e_max >= 0.0 or cut_b_min >= 0.0
+        or cut_b_max >= 0.0 or cut_sigma_min >= 0.0 or cut_sigma_max >= 0.0
+        or cut_beta_inverse_min >= 0.0 or cut_beta_inverse_max >= 0.0;
   }
   cut_omit_near = p_input_reader->cut_omit_near.value();
   cut_omit_far = p_input_reader->cut_omit_far.value();
@@ -349,6 +359,21 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
     cut_plane_normal_z = p_input_reader->cut_plane_normal_z.value();
   }
   cut_z_turnings = p_input_reader->cut_z_turnings.value();
+  cut_tau_max = -1.0;
+  if (model_type == ModelType::simulation and p_input_reader->cut_tau_max.has_value())
+    cut_tau_max = p_input_reader->cut_tau_max.value();
+  if (cut_tau_max >= 0.0 and not (image_light or image_tau or image_tau_int))
+  {
+    BlacklightWarning("Ignoring cut_tau_max selection.");
+    cut_tau_max = -1.0;
+  }
+
+  // Coefficients must be stored for every sample if they are needed beyond integration
+  if (simulation_fused_coeffs and cut_tau_max >= 0.0)
+  {
+    BlacklightWarning("Ignoring simulation_fused_coeffs selection.");
+    simulation_fused_coeffs = false;
+  }
 
   // image_z_turnings should be true if cut_z_turnings >= set
   if (cut_z_turnings >= 0 && !image_z_turnings)
@@ -395,22 +420,17 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
   sample_pos = p_geodesic_integrator->sample_pos;
   sample_dir = p_geodesic_integrator->sample_dir;
   sample_len = p_geodesic_integrator->sample_len;
+  sample_float = p_geodesic_integrator->ray_sample_float;
+  sample_pos_float = p_geodesic_integrator->sample_pos_float;
+  sample_dir_float = p_geodesic_integrator->sample_dir_float;
+  sample_len_float = p_geodesic_integrator->sample_len_float;
 
   // Allocate space for sample data
+  sample_offsets = new Array<int>[adaptive_max_level+1];
   sample_inds = new Array<int>[adaptive_max_level+1];
   sample_fracs = new Array<double>[adaptive_max_level+1];
-  sample_nan = new Array<bool>[adaptive_max_level+1];
-  sample_cut = new Array<bool>[adaptive_max_level+1];
-  sample_fallback = new Array<bool>[adaptive_max_level+1];
-  sample_rho = new Array<float>[adaptive_max_level+1];
-  sample_pgas = new Array<float>[adaptive_max_level+1];
-  sample_kappa = new Array<float>[adaptive_max_level+1];
-  sample_uu1 = new Array<float>[adaptive_max_level+1];
-  sample_uu2 = new Array<float>[adaptive_max_level+1];
-  sample_uu3 = new Array<float>[adaptive_max_level+1];
-  sample_bb1 = new Array<float>[adaptive_max_level+1];
-  sample_bb2 = new Array<float>[adaptive_max_level+1];
-  sample_bb3 = new Array<float>[adaptive_max_level+1];
+  sample_status = new Array<unsigned char>[adaptive_max_level+1];
+  sample_prim = new Array<float>[adaptive_max_level+1];
 
   // Allocate space for coefficient data
   j_i = new Array<double>[adaptive_max_level+1];
@@ -440,6 +460,12 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
     bh_a = p_input_reader->formula_spin.value();
     mass_msun = formula_mass * Physics::c * Physics::c / Physics::gg_msun;
   }
+  if (ray_flat)
+    metric_type = MetricType::flat;
+  else if (bh_a == 0.0)
+    metric_type = MetricType::schwarzschild;
+  else
+    metric_type = MetricType::kerr;
 
   // Allocate space for image data
   image = new Array<double>[adaptive_max_level+1];
@@ -545,7 +571,16 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
     image_num_quantities++;
 
   // Allocate space for rendering data
-  render = new Array<double>[adaptive_max_level+1];
+  if (adaptive_max_level < 0)
+    throw BlacklightException("Must have nonnegative adaptive_max_level.");
+  std::size_t num_levels = static_cast<std::size_t>(adaptive_max_level) + 1;
+  render = new Array<double>[num_levels];
+  render_lengths = new Array<double>[num_levels];
+  if (render_num_images > 0)
+  {
+    render_thread_times.Allocate(num_threads);
+    render_thread_times.Zero();
+  }
 
   // Allocate space for calculating adaptive refinement
   if (adaptive_max_level > 0)
@@ -556,12 +591,6 @@ RadiationIntegrator::RadiationIntegrator(const InputReader *p_input_reader,
     block_counts[0] = linear_root_blocks * linear_root_blocks;
     refinement_flags = new Array<bool>[adaptive_max_level+1];
     refinement_flags[0].Allocate(block_counts[0]);
-    image_blocks = new Array<double>[num_threads];
-    for (int thread = 0; thread < num_threads; thread++)
-      if (model_type == ModelType::simulation and image_polarization)
-        image_blocks[thread].Allocate(4, adaptive_block_size, adaptive_block_size);
-      else
-        image_blocks[thread].Allocate(adaptive_block_size, adaptive_block_size);
   }
 }
 
@@ -606,35 +635,19 @@ RadiationIntegrator::~RadiationIntegrator()
   // Free memory - sample data
   for (int level = 0; level <= adaptive_max_level; level++)
   {
+    sample_offsets[level].Deallocate();
     sample_inds[level].Deallocate();
     sample_fracs[level].Deallocate();
-    sample_nan[level].Deallocate();
-    sample_cut[level].Deallocate();
-    sample_fallback[level].Deallocate();
-    sample_rho[level].Deallocate();
-    sample_pgas[level].Deallocate();
-    sample_kappa[level].Deallocate();
-    sample_uu1[level].Deallocate();
-    sample_uu2[level].Deallocate();
-    sample_uu3[level].Deallocate();
-    sample_bb1[level].Deallocate();
-    sample_bb2[level].Deallocate();
-    sample_bb3[level].Deallocate();
+    sample_status[level].Deallocate();
+    sample_prim[level].Deallocate();
   }
+  delete[] sample_offsets;
   delete[] sample_inds;
   delete[] sample_fracs;
-  delete[] sample_nan;
-  delete[] sample_cut;
-  delete[] sample_fallback;
-  delete[] sample_rho;
-  delete[] sample_pgas;
-  delete[] sample_kappa;
-  delete[] sample_uu1;
-  delete[] sample_uu2;
-  delete[] sample_uu3;
-  delete[] sample_bb1;
-  delete[] sample_bb2;
-  delete[] sample_bb3;
+  delete[] sample_status;
+  delete[] sample_prim;
+  sample_geom.Deallocate();
+  plasma_tables.Deallocate();
 
   // Free memory - coefficient data
   for (int level = 0; level <= adaptive_max_level; level++)
@@ -668,17 +681,18 @@ RadiationIntegrator::~RadiationIntegrator()
   for (int level = 0; level <= adaptive_max_level; level++)
     render[level].Deallocate();
   delete[] render;
+  for (int level = 0; level <= adaptive_max_level; level++)
+    render_lengths[level].Deallocate();
+  delete[] render_lengths;
+  render_thread_times.Deallocate();
 
   // Free memory - adaptive data
   if (adaptive_max_level > 0)
   {
     for (int level = 0; level <= adaptive_max_level; level++)
       refinement_flags[level].Deallocate();
-    for (int thread = 0; thread < num_threads; thread++)
-      image_blocks[thread].Deallocate();
     delete[] block_counts;
     delete[] refinement_flags;
-    delete[] image_blocks;
   }
 }
 
@@ -698,6 +712,10 @@ RadiationIntegrator::~RadiationIntegrator()
 //   returned value: flag indicating no additional geodesics need to be run for this snapshot
 // Notes:
 //   Assumes all data arrays have been set.
+//   Sets adaptive_num_levels to the number of levels beyond the root integrated so far, so that the
+//       image can be written after any level.
+//   Rendering is done during coefficient calculation, so its time is estimated by
+//       CollectRenderTime() and removed from the image integration time.
 bool RadiationIntegrator::Integrate(int snapshot, double *p_time_sample, double *p_time_image,
     double *p_time_render)
 {
@@ -706,10 +724,10 @@ bool RadiationIntegrator::Integrate(int snapshot, double *p_time_sample, double
   double time_sample_end = 0.0;
   double time_image_start = 0.0;
   double time_image_end = 0.0;
-  double time_render_start = 0.0;
-  double time_render_end = 0.0;
   double time_refine_start = 0.0;
   double time_refine_end = 0.0;
+  if (adaptive_level == 0)
+    adaptive_time_start = omp_get_wtime();
 
   // Sample simulation data
   if (model_type == ModelType::simulation)
@@ -729,7 +747,7 @@ bool RadiationIntegrator::Integrate(int snapshot, double *p_time_sample, double
         SaveSampling();
     }
     else if (slow_light_on)
-      CalculateSimulationSampling(snapshot);
+      CalculateSampleTimes(snapshot);
     SampleSimulation();
     time_sample_end = omp_get_wtime();
   }
@@ -738,20 +756,8 @@ bool RadiationIntegrator::Integrate(int snapshot, double *p_time_sample, double
   if (model_type == ModelType::simulation)
   {
     time_image_start = time_sample_end;
-    CalculateSimulationCoefficients();
-    if (image_light and image_polarization)
-      IntegratePolarizedRadiation();
-    else if (image_light or image_time or image_length or image_lambda or image_emission
-        or image_tau or image_lambda_ave or image_emission_ave or image_tau_int or image_crossings
-        or image_z_turnings)
-      IntegrateUnpolarizedRadiation();
+    IntegrateSimulationRadiation();
     time_image_end = omp_get_wtime();
-    if (render_num_images > 0)
-    {
-      time_render_start = time_image_end;
-      Render();
-      time_render_end = omp_get_wtime();
-    }
   }
 
   // Integrate according to formula
@@ -763,16 +769,25 @@ bool RadiationIntegrator::Integrate(int snapshot, double *p_time_sample, double
     time_image_end = omp_get_wtime();
   }
 
+  // Free memory shared by all stages
+  if (adaptive_level > 0)
+  {
+    sample_offsets[adaptive_level].Deallocate();
+    sample_status[adaptive_level].Deallocate();
+  }
+
   // Check for adaptive refinement
   time_refine_start = omp_get_wtime();
   bool adaptive_complete = true;
   if (adaptive_max_level > 0)
+  {
     adaptive_complete = CheckAdaptiveRefinement();
+    ProfileRecord("CheckAdaptiveRefinement", snapshot, adaptive_level, time_refine_start,
+        omp_get_wtime(), ProfileCounts());
+  }
+  adaptive_num_levels = adaptive_level;
   if (adaptive_complete)
-  {
-    adaptive_num_levels = adaptive_level;
     adaptive_level = 0;
-  }
   else
     adaptive_level++;
   time_refine_end = omp_get_wtime();
@@ -781,8 +796,288 @@ bool RadiationIntegrator::Integrate(int snapshot, double *p_time_sample, double
   first_time = false;
 
   // Calculate elapsed time
+  double time_render = CollectRenderTime();
   *p_time_sample += time_sample_end - time_sample_start;
-  *p_time_image += time_image_end - time_image_start + time_refine_end - time_refine_start;
-  *p_time_render += time_render_end - time_render_start;
+  *p_time_image += time_image_end - time_image_start + time_refine_end - time_refine_start
+      - time_render;
+  *p_time_render += time_render;
   return adaptive_complete;
 }
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for switching to a different plasma model
+// Inputs:
+//   p_input_reader: pointer to object containing input parameters for new plasma model
+// Outputs: (none)
+// Notes:
+//   Copies simulation_rho_cgs and plasma model parameters, or formula parameters for formula
+//       models, to be used by subsequent calls to Integrate() or IntegratePlasmaModel().
+//   Marks distribution constants for recalculation, and frees plasma_tables if the new model
+//       changes the tabulated distributions, in which case plasma_table_file ends up holding the
+//       tables for the last such model.
+void RadiationIntegrator::SelectPlasmaModel(const InputReader *p_input_reader)
+{
+  if (model_type == ModelType::formula)
+  {
+    CopyFormulaModel(p_input_reader);
+    return;
+  }
+  double params_old[plasma_table_num_params];
+  SetPlasmaTableParameters(params_old);
+  simulation_rho_cgs = p_input_reader->simulation_rho_cgs.value();
+  CopyPlasmaModel(p_input_reader);
+  double params_new[plasma_table_num_params];
+  SetPlasmaTableParameters(params_new);
+  for (int n = 0; n < plasma_table_num_params; n++)
+    if (params_new[n] != params_old[n])
+      plasma_tables.Deallocate();
+  plasma_precalculated = false;
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for processing already sampled geodesics with current plasma model
+// Inputs:
+//   *p_time_image: amount of time already taken for integrating image
+//   *p_time_render: amount of time already taken for rendering
+// Outputs:
+//   *p_time_image: incremented by additional time taken for integrating image
+//   *p_time_render: incremented by additional time taken for rendering
+// Notes:
+//   Assumes Integrate() has completed for the current snapshot with adaptive_max_level == 0, so
+//       that root-level samples, including sample_prim[0] for simulations, are still available.
+//   Recalculates only the transfer coefficients, image, and rendering; geodesics and simulation
+//       sampling are reused.
+void RadiationIntegrator::IntegratePlasmaModel(double *p_time_image, double *p_time_render)
+{
+  // Prepare timers
+  double time_image_start = omp_get_wtime();
+
+  // Integrate according to simulation data
+  if (model_type == ModelType::simulation)
+    IntegrateSimulationRadiation();
+
+  // Integrate according to formula
+  if (model_type == ModelType::formula)
+  {
+    CalculateFormulaCoefficients();
+    IntegrateUnpolarizedRadiation();
+  }
+
+  // Calculate elapsed time
+  double time_render = CollectRenderTime();
+  *p_time_image += omp_get_wtime() - time_image_start - time_render;
+  *p_time_render += time_render;
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for copying plasma model parameters
+// Inputs:
+//   p_input_reader: pointer to object containing input parameters
+// Outputs: (none)
+// Notes:
+//   Assumes plasma_model, image_light, and image_polarization have been set.
+//   Covers the parameters that can vary between plasma models in a sweep.
+void RadiationIntegrator::CopyPlasmaModel(const InputReader *p_input_reader)
+{
+  if (plasma_model == PlasmaModel::ti_te_beta)
+  {
+    plasma_rat_low = p_input_reader->plasma_rat_low.value();
+    plasma_rat_high = p_input_reader->plasma_rat_high.value();
+  }
+  plasma_power_frac = p_input_reader->plasma_power_frac.value();
+  if (plasma_power_frac < 0.0 or plasma_power_frac > 1.0)
+    BlacklightWarning("Fraction of power-law electrons outside [0, 1].");
+  if (plasma_power_frac != 0.0)
+  {
+    plasma_p = p_input_reader->plasma_p.value();
+    plasma_gamma_min = p_input_reader->plasma_gamma_min.value();
+    plasma_gamma_max = p_input_reader->plasma_gamma_max.value();
+  }
+  plasma_kappa_frac = p_input_reader->plasma_kappa_frac.value();
+  if (plasma_kappa_frac < 0.0 or plasma_kappa_frac > 1.0)
+    BlacklightWarning("Fraction of kappa-distribution electrons outside [0, 1].");
+  if (plasma_kappa_frac != 0.0)
+  {
+    plasma_kappa = p_input_reader->plasma_kappa.value();
+    if (image_light and image_polarization)
+    {
+      if (plasma_kappa < 3.5 or plasma_kappa > 5.0)
+        throw BlacklightException("Polarized transport only supports kappa in [3.5, 5].");
+      else if (plasma_kappa != 3.5 and plasma_kappa != 4.0 and plasma_kappa != 4.5
+          and plasma_kappa != 5.0)
+        BlacklightWarning("Polarized transport will interpolate formulas based on kappa.");
+    }
+    plasma_w = p_input_reader->plasma_w.value();
+  }
+  plasma_thermal_frac = 1.0 - (plasma_power_frac + plasma_kappa_frac);
+  if (plasma_thermal_frac < 0.0 or plasma_thermal_frac > 1.0)
+    BlacklightWarning("Fraction of thermal electrons outside [0, 1].");
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for copying formula parameters
+// Inputs:
+//   p_input_reader: pointer to object containing input parameters
+// Outputs: (none)
+// Notes:
+//   Covers the parameters that can vary between formula models in a sweep; formula_mass and
+//       formula_spin determine the geodesics and so are shared.
+void RadiationIntegrator::CopyFormulaModel(const InputReader *p_input_reader)
+{
+  formula_r0 = p_input_reader->formula_r0.value();
+  formula_h = p_input_reader->formula_h.value();
+  formula_l0 = p_input_reader->formula_l0.value();
+  formula_q = p_input_reader->formula_q.value();
+  formula_nup = p_input_reader->formula_nup.value();
+  formula_cn0 = p_input_reader->formula_cn0.value();
+  formula_alpha = p_input_reader->formula_alpha.value();
+  formula_a = p_input_reader->formula_a.value();
+  formula_beta = p_input_reader->formula_beta.value();
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating transfer coefficients and integrating image from sampled data
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes SampleSimulation() has been called at the current level.
+void RadiationIntegrator::IntegrateSimulationRadiation()
+{
+  double time_start = omp_get_wtime();
+  CalculateSimulationCoefficients();
+  ProfileRecord("CalculateSimulationCoefficients", ProfileSnapshot(), adaptive_level, time_start,
+      omp_get_wtime(), ProfileCounts());
+  if (image_light and image_polarization and image_stokes_transport)
+    IntegratePolarizedStokes();
+  else if (image_light and image_polarization)
+    IntegratePolarizedRadiation();
+  else if (image_light or image_time or image_length or image_lambda or image_emission
+      or image_tau or image_lambda_ave or image_emission_ave or image_tau_int or image_crossings
+      or image_z_turnings)
+    IntegrateUnpolarizedRadiation();
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for reading geodesic sample position at current level
+// Inputs:
+//   m: pixel index
+//   n: sample index
+//   mu: component index
+// Outputs:
+//   returned value: x^mu
+// Notes:
+//   Reads from single-precision storage if ray_sample_float is in effect.
+double RadiationIntegrator::SamplePosition(int m, int n, int mu) const
+{
+  if (sample_float)
+    return static_cast<double>(sample_pos_float[adaptive_level](m,n,mu));
+  return sample_pos[adaptive_level](m,n,mu);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for reading geodesic sample covariant momentum at current level
+// Inputs:
+//   m: pixel index
+//   n: sample index
+//   mu: component index
+// Outputs:
+//   returned value: k_mu
+// Notes:
+//   Reads from single-precision storage if ray_sample_float is in effect.
+double RadiationIntegrator::SampleDirection(int m, int n, int mu) const
+{
+  if (sample_float)
+    return static_cast<double>(sample_dir_float[adaptive_level](m,n,mu));
+  return sample_dir[adaptive_level](m,n,mu);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for reading geodesic sample step length at current level
+// Inputs:
+//   m: pixel index
+//   n: sample index
+// Outputs:
+//   returned value: affine parameter step length
+// Notes:
+//   Reads from single-precision storage if ray_sample_float is in effect.
+double RadiationIntegrator::SampleLength(int m, int n) const
+{
+  if (sample_float)
+    return static_cast<double>(sample_len_float[adaptive_level](m,n));
+  return sample_len[adaptive_level](m,n);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for locating non-cut samples in compacted storage at current level
+// Inputs:
+//   num_pix: number of pixels at current level
+// Outputs: (none)
+// Notes:
+//   Assumes sample_num[adaptive_level] has been set, as well as sample_status[adaptive_level] if
+//       model_type == ModelType::simulation.
+//   Allocates and initializes sample_offsets[adaptive_level] if not already allocated.
+//   Records for ray m occupy indices sample_offsets[adaptive_level](m) through
+//       sample_offsets[adaptive_level](m+1) - 1 of sample_inds, sample_fracs, sample_prim, the
+//       transfer coefficients, and cell_values, in order of increasing sample index and omitting
+//       samples flagged with sample_status_cut.
+void RadiationIntegrator::CalculateSampleOffsets(int num_pix)
+{
+  if (not sample_offsets[adaptive_level].allocated)
+    sample_offsets[adaptive_level].Allocate(num_pix + 1);
+  sample_offsets[adaptive_level](0) = 0;
+  for (int m = 0; m < num_pix; m++)
+  {
+    int num_steps = sample_num[adaptive_level](m);
+    int num_kept = 0;
+    for (int n = 0; n < num_steps; n++)
+      if (SampleKept(m, n))
+        num_kept++;
+    sample_offsets[adaptive_level](m+1) = sample_offsets[adaptive_level](m) + num_kept;
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for checking whether geodesic sample has a record in compacted storage
+// Inputs:
+//   m: pixel index
+//   n: sample index
+// Outputs:
+//   returned value: true unless sample was cut from simulation data
+// Notes:
+//   Formula models cut no samples.
+bool RadiationIntegrator::SampleKept(int m, int n) const
+{
+  return model_type != ModelType::simulation
+      or not (sample_status[adaptive_level](m,n) & sample_status_cut);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for counting records needed for compacted sample storage at current level
+// Inputs: (none)
+// Outputs:
+//   returned value: number of non-cut samples, or 1 if there are none
+// Notes:
+//   Assumes sample_offsets[adaptive_level] has been set.
+//   Never returns 0, so that arrays can always be allocated.
+int RadiationIntegrator::NumSampleRecords() const
+{
+  int num_pix = sample_offsets[adaptive_level].n1 - 1;
+  return std::max(sample_offsets[adaptive_level](num_pix), 1);
+}
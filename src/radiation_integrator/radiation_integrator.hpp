@@ -3,6 +3,10 @@
 #ifndef RADIATION_INTEGRATOR_H_
 #define RADIATION_INTEGRATOR_H_
 
+// C++ headers
+#include <optional>  // optional
+#include <string>    // string
+
 // Blacklight headers
 #include "../blacklight.hpp"                               // enums
 #include "../geodesic_integrator/geodesic_integrator.hpp"  // GeodesicIntegrator
@@ -42,6 +46,9 @@ struct RadiationIntegrator
   double simulation_rho_cgs;
   bool simulation_interp;
   bool simulation_block_interp;
+  bool simulation_geom_cache;
+  bool simulation_fused_coeffs;
+  PrimitivePrecision simulation_precision;
 
   // Input data - formula parameters
   double formula_mass;
@@ -68,6 +75,7 @@ struct RadiationIntegrator
   int image_num_frequencies;
   bool image_polarization;
   bool image_rotation_split;
+  bool image_stokes_transport;
   bool image_time;
   bool image_length;
   bool image_lambda;
@@ -92,6 +100,7 @@ struct RadiationIntegrator
   double **render_x_vals = nullptr;
   double **render_y_vals = nullptr;
   double **render_z_vals = nullptr;
+  bool render_fill_present = false;
 
   // Input data - slow-light parameters
   bool slow_light_on;
@@ -114,6 +123,8 @@ struct RadiationIntegrator
   double adaptive_abs_lapl_frac;
   double adaptive_rel_lapl_cut;
   double adaptive_rel_lapl_frac;
+  double adaptive_time_budget;
+  int adaptive_ray_budget;
   int adaptive_num_regions;
   int *adaptive_region_levels = nullptr;
   double *adaptive_region_x_min_vals = nullptr;
@@ -139,6 +150,8 @@ struct RadiationIntegrator
   double plasma_kappa_frac;
   double plasma_kappa;
   double plasma_w;
+  bool plasma_table;
+  std::optional<std::string> plasma_table_file;
 
   // Input data - cut parameters
   double cut_rho_min;
@@ -155,6 +168,7 @@ struct RadiationIntegrator
   double cut_sigma_max;
   double cut_beta_inverse_min;
   double cut_beta_inverse_max;
+  bool cut_cell_values = false;
   bool cut_omit_near;
   bool cut_omit_far;
   double cut_omit_in;
@@ -165,6 +179,7 @@ struct RadiationIntegrator
   double cut_plane_origin_x, cut_plane_origin_y, cut_plane_origin_z;
   double cut_plane_normal_x, cut_plane_normal_y, cut_plane_normal_z;
   int cut_z_turnings;
+  double cut_tau_max;
 
   // Input data - fallback parameters
   bool fallback_nan;
@@ -172,13 +187,15 @@ struct RadiationIntegrator
   float fallback_pgas;
   float fallback_kappa;
 
-  // Flag for tracking function calls
+  // Flags for tracking function calls
   bool first_time = true;
+  bool plasma_precalculated = false;
 
   // Geometry data
   double bh_m;
   double bh_a;
   double mass_msun;
+  MetricType metric_type;
 
   // Fallback data
   const float fallback_uu1 = 0.0f;
@@ -208,6 +225,10 @@ struct RadiationIntegrator
   Array<double> *sample_pos = nullptr;
   Array<double> *sample_dir = nullptr;
   Array<double> *sample_len = nullptr;
+  bool sample_float;
+  Array<float> *sample_pos_float = nullptr;
+  Array<float> *sample_dir_float = nullptr;
+  Array<float> *sample_len_float = nullptr;
 
   // Grid data
   int n_3_root;
@@ -215,10 +236,18 @@ struct RadiationIntegrator
   Array<int> n_3_level;
   Array<int> levels;
   Array<int> locations;
+  Array<int> block_tree_order;
+  Array<int> block_tree_ranges;
+  Array<double> block_tree_bounds;
+  Array<int> block_location_order;
+  static constexpr int block_tree_leaf_size = 8;
+  static constexpr int block_tree_max_depth = 64;
   Array<double> x1f, x2f, x3f;
   Array<double> x1v, x2v, x3v;
   double *time;
   Array<float> *grid_prim;
+  Array<unsigned short int> *grid_compact;
+  Array<float> *grid_scale;
   int ind_rho, ind_pgas, ind_kappa;
   int ind_uu1, ind_uu2, ind_uu3;
   int ind_bb1, ind_bb2, ind_bb3;
@@ -229,20 +258,31 @@ struct RadiationIntegrator
   Array<double> sks_map;
 
   // Sample data
+  Array<int> *sample_offsets = nullptr;
   Array<int> *sample_inds = nullptr;
   Array<double> *sample_fracs = nullptr;
-  Array<bool> *sample_nan = nullptr;
-  Array<bool> *sample_cut = nullptr;
-  Array<bool> *sample_fallback = nullptr;
-  Array<float> *sample_rho = nullptr;
-  Array<float> *sample_pgas = nullptr;
-  Array<float> *sample_kappa = nullptr;
-  Array<float> *sample_uu1 = nullptr;
-  Array<float> *sample_uu2 = nullptr;
-  Array<float> *sample_uu3 = nullptr;
-  Array<float> *sample_bb1 = nullptr;
-  Array<float> *sample_bb2 = nullptr;
-  Array<float> *sample_bb3 = nullptr;
+  Array<unsigned char> *sample_status = nullptr;
+  Array<float> *sample_prim = nullptr;
+  static constexpr unsigned char sample_status_nan = 1;
+  static constexpr unsigned char sample_status_cut = 2;
+  static constexpr unsigned char sample_status_fallback = 4;
+  static constexpr int sample_ind_rho = SampleValues::rho;
+  static constexpr int sample_ind_pgas = SampleValues::pgas;
+  static constexpr int sample_ind_uu1 = SampleValues::uu1;
+  static constexpr int sample_ind_uu2 = SampleValues::uu2;
+  static constexpr int sample_ind_uu3 = SampleValues::uu3;
+  static constexpr int sample_ind_bb1 = SampleValues::bb1;
+  static constexpr int sample_ind_bb2 = SampleValues::bb2;
+  static constexpr int sample_ind_bb3 = SampleValues::bb3;
+  static constexpr int sample_ind_kappa = SampleValues::kappa;
+  Array<double> sample_geom;
+  static constexpr int sample_geom_gcov_sim = SampleGeometry::gcov_sim;
+  static constexpr int sample_geom_lapse_shift_sim = SampleGeometry::lapse_shift_sim;
+  static constexpr int sample_geom_jacobian = SampleGeometry::jacobian;
+  static constexpr int sample_geom_gcov = SampleGeometry::gcov;
+  static constexpr int sample_geom_gcon = SampleGeometry::gcon;
+  static constexpr int sample_geom_kcon = SampleGeometry::kcon;
+  static constexpr int sample_geom_num = SampleGeometry::num_sample_geometry;
   double extrapolation_tolerance;
 
   // Coefficient data
@@ -255,6 +295,7 @@ struct RadiationIntegrator
   Array<double> *rho_q = nullptr;
   Array<double> *rho_v = nullptr;
   Array<double> *cell_values = nullptr;
+  int fused_num_records = 0;
 
   // Image data
   Array<double> *image = nullptr;
@@ -274,15 +315,17 @@ struct RadiationIntegrator
 
   // Rendering data
   Array<double> *render = nullptr;
+  Array<double> *render_lengths = nullptr;
+  Array<double> render_thread_times;
 
   // Adaptive data
   int adaptive_level = 0;
   int adaptive_num_levels;
+  double adaptive_time_start;
   int linear_root_blocks;
   int block_num_pix;
   int *block_counts = nullptr;
   Array<bool> *refinement_flags = nullptr;
-  Array<double> *image_blocks = nullptr;
 
   // Precalculated values
   double power_jj, power_jj_q, power_jj_v;
@@ -303,53 +346,128 @@ struct RadiationIntegrator
   double kappa_rho_v_low_a, kappa_rho_v_low_b;
   double kappa_rho_v_high_a, kappa_rho_v_high_b;
 
-  // External function
+  // Coefficient table data
+  Array<double> plasma_tables;
+  const int plasma_table_n = 4097;
+  const double plasma_table_range = 64.0;
+  static constexpr int plasma_table_thermal_rho_q = 0;
+  static constexpr int plasma_table_thermal_rho_v = 1;
+  static constexpr int plasma_table_kappa_jj_i = 2;
+  static constexpr int plasma_table_kappa_jj_q = 3;
+  static constexpr int plasma_table_kappa_jj_v = 4;
+  static constexpr int plasma_table_kappa_aa_i = 5;
+  static constexpr int plasma_table_kappa_aa_q = 6;
+  static constexpr int plasma_table_kappa_aa_v = 7;
+  static constexpr int plasma_table_kappa_rho_q = 8;
+  static constexpr int plasma_table_kappa_rho_v = 9;
+  static constexpr int plasma_table_num = 10;
+  static constexpr int plasma_table_num_params = 7;
+
+  // External functions
   bool Integrate(int snapshot, double *p_time_sample, double *p_time_image, double *p_time_render);
+  void SelectPlasmaModel(const InputReader *p_input_reader);
+  void IntegratePlasmaModel(double *p_time_image, double *p_time_render);
+  void MarkSampledBlocks(Array<bool> &block_flags) const;
+  void ReleaseLevels();
+
+  // Internal functions - radiation_integrator.cpp
+  void CopyPlasmaModel(const InputReader *p_input_reader);
+  void CopyFormulaModel(const InputReader *p_input_reader);
+  void IntegrateSimulationRadiation();
+  double SamplePosition(int m, int n, int mu) const;
+  double SampleDirection(int m, int n, int mu) const;
+  double SampleLength(int m, int n) const;
+  void CalculateSampleOffsets(int num_pix);
+  bool SampleKept(int m, int n) const;
+  int NumSampleRecords() const;
 
   // Internal functions - sample_checkpoint.cpp
   void SaveSampling();
   void LoadSampling();
 
+  // Internal functions - block_index.cpp
+  void BuildBlockIndex();
+  int FindBlock(double x1, double x2, double x3) const;
+  int FindBlockLocation(int level, int location_i, int location_j, int location_k) const;
+  int FindCellIndex(const Array<double> &xf, int b, int n, double x) const;
+
   // Internal functions - simulation_sampling.cpp
   void ObtainGridData();
   void CalculateSimulationSampling(int snapshot);
+  void CalculateSampleTimes(int snapshot);
   void SampleSimulation();
+  void SampleSimulationPoint(int m, int n, int s);
   void FindNearbyInds(int b, int k, int j, int i, int k_c, int j_c, int i_c, double x3, double x2,
       double x1, int inds[4]);
-  double InterpolateSimple(const Array<float> &grid_vals, int grid_ind, int b, int k, int j, int i,
-      double f_k, double f_j, double f_i);
-  double InterpolateAdvanced(const Array<float> &grid_vals, int grid_ind, int m, int n);
+  void CalculateStencil(const Array<float> &grid_vals, int s, long int offsets[8],
+      double weights[8]) const;
+  void InterpolateStencil(const Array<float> &grid_vals, const int *grid_inds, int num_vals,
+      const long int offsets[8], const double weights[8], double *vals) const;
+  void SampleCompactPoint(int s, float *sample_vals) const;
+  void InterpolateCompact(int t, const int *grid_inds, int num_vals, int num_cells,
+      const long int offsets[8], const double weights[8], double *vals) const;
+  float CompactGridValue(int t, int v, long int offset) const;
 
   // Internal functions - simulation_coefficients.cpp
   void CalculateSimulationCoefficients();
+  void CalculateSimulationCoefficientsRay(int m, int r);
+  void CalculateSimulationCoefficientsPoint(int m, int n, int s, int r);
+  template<bool generic> void CalculateSimulationCoefficientsPoint(int m, int n, int s, int r);
+  void CalculateSampleGeometry();
   double Hypergeometric(double alpha, double beta, double gamma, double z);
 
+  // Internal functions - plasma_tables.cpp
+  void CalculatePlasmaTables();
+  bool LoadPlasmaTables();
+  void SavePlasmaTables();
+  void SetPlasmaTableParameters(double params[plasma_table_num_params]) const;
+  double PlasmaTableValue(int table, double u) const;
+  double CombineLogFits(double log_low, double log_high, double x) const;
+
   // Internal functions - formula_coefficients.cpp
   void CalculateFormulaCoefficients();
+  void CalculateFormulaCoefficientsRay(int m, int r_start);
 
   // Internal functions - unpolarized.cpp
   void IntegrateUnpolarizedRadiation();
+  template<bool generic> void IntegrateUnpolarizedRadiation();
 
   // Internal functions - polarized.cpp
   void IntegratePolarizedRadiation();
+  void CouplePolarizedStokes(const double j_s[4], const double alpha_s[4], const double rho_s[4],
+      double delta_lambda_cgs, double ss_start[4], double ss_end[4]) const;
+
+  // Internal functions - polarized_stokes.cpp
+  void IntegratePolarizedStokes();
+  void ProjectStokes(const double proj[2][2], double proj_det, const double ss_basis[4],
+      double ss_frame[4]) const;
 
   // Internal functions - turnings.cpp
   void FindZTurnings(int m, int num_steps, int &n_start, int &z_turnings_count);
 
   // Internal functions - rendering.cpp
-  void Render();
+  void RenderRay(int m, int r);
+  double CollectRenderTime();
 
   // Internal functions - radiation_adaptive.cpp
   bool CheckAdaptiveRefinement();
-  bool EvaluateBlock(int thread);
+  bool EvaluateBlock(const double *intensity, int stride, double *p_priority) const;
+  int RefinementBudget() const;
+  int LimitRefinement(int max_refined_blocks);
 
   // Internal functions - radiation_geometry.cpp
   double RadialGeodesicCoordinate(double x, double y, double z) const;
   void ConvertFromCKS(double *p_x1, double *p_x2, double *p_x3) const;
   void CoordinateJacobian(double x, double y, double z, double jacobian[4][4]) const;
   void CovariantGeodesicMetric(double x, double y, double z, double gcov[4][4]) const;
+  template<MetricType metric> void CovariantGeodesicMetric(double x, double y, double z,
+      double gcov[4][4]) const;
   void ContravariantGeodesicMetric(double x, double y, double z, double gcon[4][4]) const;
+  template<MetricType metric> void ContravariantGeodesicMetric(double x, double y, double z,
+      double gcon[4][4]) const;
   void GeodesicConnection(double x, double y, double z, double connection[4][4][4]) const;
+  template<MetricType metric> void GeodesicConnection(double x, double y, double z,
+      double connection[4][4][4]) const;
   void CovariantSimulationMetric(double x, double y, double z, double gcov[4][4]) const;
   void ContravariantSimulationMetric(double x, double y, double z, double gcon[4][4]) const;
   void Tetrad(const double ucon[4], const double ucov[4], const double kcon[4],
@@ -17,8 +17,8 @@
 // Outputs: (none)
 // Notes:
 //   Overwrites file specified by checkpoint_sample_file.
-//   Saves certain sample data (sample_inds[0], sample_fracs[0] (if needed), sample_nan[0], and
-//       sample_fallback[0]).
+//   Saves certain sample data (sample_inds[0], sample_fracs[0] (if needed), sample_status[0],
+//       sample_offsets[0], and sample_geom (if needed)).
 void RadiationIntegrator::SaveSampling()
 {
   // Open checkpoint file for writing
@@ -31,8 +31,10 @@ void RadiationIntegrator::SaveSampling()
   WriteBinary(&checkpoint_stream, sample_inds[0]);
   if (simulation_interp)
     WriteBinary(&checkpoint_stream, sample_fracs[0]);
-  WriteBinary(&checkpoint_stream, sample_nan[0]);
-  WriteBinary(&checkpoint_stream, sample_fallback[0]);
+  WriteBinary(&checkpoint_stream, sample_status[0]);
+  WriteBinary(&checkpoint_stream, sample_offsets[0]);
+  if (simulation_geom_cache)
+    WriteBinary(&checkpoint_stream, sample_geom);
   return;
 }
 
@@ -43,8 +45,8 @@ void RadiationIntegrator::SaveSampling()
 // Outputs: (none)
 // Notes:
 //   Reads file specified by checkpoint_sample_file.
-//   Saves certain sample data (sample_inds[0], sample_fracs[0] (if needed), sample_nan[0], and
-//       sample_fallback[0]), allocating arrays.
+//   Loads certain sample data (sample_inds[0], sample_fracs[0] (if needed), sample_status[0],
+//       sample_offsets[0], and sample_geom (if needed)), allocating arrays.
 void RadiationIntegrator::LoadSampling()
 {
   // Open checkpoint file for readiing
@@ -57,7 +59,9 @@ void RadiationIntegrator::LoadSampling()
   ReadBinary(&checkpoint_stream, &sample_inds[0]);
   if (simulation_interp)
     ReadBinary(&checkpoint_stream, &sample_fracs[0]);
-  ReadBinary(&checkpoint_stream, &sample_nan[0]);
-  ReadBinary(&checkpoint_stream, &sample_fallback[0]);
+  ReadBinary(&checkpoint_stream, &sample_status[0]);
+  ReadBinary(&checkpoint_stream, &sample_offsets[0]);
+  if (simulation_geom_cache)
+    ReadBinary(&checkpoint_stream, &sample_geom);
   return;
 }
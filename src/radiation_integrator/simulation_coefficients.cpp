@@ -1,17 +1,18 @@
 // Blacklight radiation integrator - simulation radiative transfer coefficients
 
 // C++ headers
-#include <algorithm>  // min
-#include <cmath>      // cbrt, cos, cyl_bessel_k, exp, expm1, pow, sin, sinh, sqrt, tanh, tgamma
+#include <algorithm>  // max, min
+#include <cmath>      // cbrt, cos, cyl_bessel_k, exp, expm1, log, pow, sin, sinh, sqrt, tanh, tgamma
 #include <limits>     // numeric_limits
 
 // Library headers
-#include <omp.h>  // pragmas
+#include <omp.h>  // omp_get_wtime, pragmas
 
 // Blacklight headers
 #include "radiation_integrator.hpp"
 #include "../blacklight.hpp"         // Math, Physics, enums
 #include "../utils/array.hpp"        // Array
+#include "../utils/profiler.hpp"     // profiling functions
 
 //--------------------------------------------------------------------------------------------------
 
@@ -20,11 +21,13 @@
 // Outputs: (none)
 // Notes:
 //   Assumes geodesic_num_steps[adaptive_level], sample_num[adaptive_level],
-//       sample_pos[adaptive_level], sample_dir[adaptive_level], sample_cut[adaptive_level],
-//       sample_rho[adaptive_level], sample_pgas[adaptive_level], sample_kappa[adaptive_level] (if
-//       needed), sample_uu1[adaptive_level], sample_uu2[adaptive_level],
-//       sample_uu3[adaptive_level], sample_bb1[adaptive_level], sample_bb2[adaptive_level],
-//       sample_bb3[adaptive_level], and momentum_factors[adaptive_level] have been set.
+//       sample_pos[adaptive_level], sample_dir[adaptive_level], sample_status[adaptive_level],
+//       sample_offsets[adaptive_level], sample_prim[adaptive_level], and
+//       momentum_factors[adaptive_level] have been set.
+//   Coefficient arrays and cell_values[adaptive_level] hold one record per non-cut sample, laid
+//       out as in sample_prim[adaptive_level]; cut samples have no coupling.
+//   Coefficient records are contiguous, holding all frequencies for a sample, so that
+//       integration can walk each ray once.
 //   Allocates and initializes j_i[adaptive_level] if image_light == true or image_emission == true
 //       or image_emission_ave == true.
 //   Allocates and initializes alpha_i[adaptive_level] if image_light == true or image_tau == true
@@ -34,6 +37,10 @@
 //       image_light == true and image_polarization == true.
 //   Allocates and initializes cell_values[adaptive_level] if image_lambda_ave == true
 //       or image_emission_ave == true or image_tau_int == true or render_num_images > 0.
+//   Allocates and initializes render_lengths[adaptive_level] with proper lengths of samples if
+//       render_fill_present == true, using the metric already needed for coefficients.
+//   Allocates and initializes render[adaptive_level] if render_num_images > 0, rendering each ray
+//       as soon as its cell values are known rather than in a separate pass over all samples.
 //   References beta-dependent temperature ratio electron model from 2016 AA 586 A38 (E1).
 //   References entropy-based electron model from 2017 MNRAS 466 705 (E2).
 //   References 2021 ApJ 921 17 (M) for transfer coefficients.
@@ -43,15 +50,25 @@
 //       given by cold-plasma rotation measure considerations, but numerically one might get NaN,
 //       and the rho_V formula has the wrong asymptotic behavior.
 //   Tetrad is chosen such that j_U, alpha_U, rho_U = 0.
-//   Deallocates sample_cut[adaptive_level], sample_rho[adaptive_level],
-//       sample_pgas[adaptive_level], and sample_kappa[adaptive_level] if adaptive_level > 0.
-//   Dealllocates sample_uu1[adaptive_level], sample_uu2[adaptive_level],
-//       sample_uu3[adaptive_level], sample_bb1[adaptive_level], sample_bb2[adaptive_level], and
-//       sample_bb3[adaptive_level] if image_polarization == false and adaptive_level > 0.
+//   Deallocates sample_prim[adaptive_level] if adaptive_level > 0, unless polarized integration
+//       still needs velocities and magnetic fields.
+//   If cut_tau_max >= 0, samples are resampled from the simulation here rather than in
+//       SampleSimulation(), proceeding from the camera and stopping once the optical depth at every
+//       frequency exceeds cut_tau_max; any remaining samples are left with vanishing coefficients.
+//   If cut_tau_max >= 0, deallocates sample_inds[adaptive_level] and sample_fracs[adaptive_level]
+//       if adaptive_level > 0.
+//   Precalculates distribution constants the first time through for each plasma model.
+//   If plasma_table == true, prepares plasma_tables if they are not already allocated, loading
+//       them from or saving them to plasma_table_file if it is set.
+//   If simulation_fused_coeffs == true, coefficient arrays, cell_values[adaptive_level], and
+//       render_lengths[adaptive_level] instead hold fused_num_records records for each thread,
+//       enough for any one ray, and are only allocated here; integration fills them and renders
+//       ray by ray with CalculateSimulationCoefficientsRay(), and sample_prim[adaptive_level] is
+//       not deallocated.
 void RadiationIntegrator::CalculateSimulationCoefficients()
 {
   // Precalculate power-law values (M 38-42)
-  if (first_time and plasma_power_frac != 0.0)
+  if (not plasma_precalculated and plasma_power_frac != 0.0)
   {
     double var_a = std::pow(3.0, plasma_p / 2.0) * (plasma_p - 1.0);
     double var_b = 2.0 * (plasma_p + 1.0);
@@ -80,7 +97,7 @@ void RadiationIntegrator::CalculateSimulationCoefficients()
   }
 
   // Precalculate kappa-distribution values (M 43,44,46-48,50-54)
-  if (first_time and plasma_kappa_frac != 0.0)
+  if (not plasma_precalculated and plasma_kappa_frac != 0.0)
   {
     double var_a = 4.0 * Math::pi * std::tgamma(plasma_kappa - 4.0 / 3.0);
     double var_b = std::pow(3.0, 7.0 / 3.0) * std::tgamma(plasma_kappa - 2.0);
@@ -192,36 +209,50 @@ void RadiationIntegrator::CalculateSimulationCoefficients()
     }
   }
 
+  // Prepare tabulated fitting functions
+  if (plasma_table and not plasma_tables.allocated
+      and not (plasma_table_file.has_value() and LoadPlasmaTables()))
+  {
+    CalculatePlasmaTables();
+    if (plasma_table_file.has_value())
+      SavePlasmaTables();
+  }
+  plasma_precalculated = true;
+
   // Allocate arrays
   int num_pix = camera_num_pix;
   if (adaptive_level > 0)
     num_pix = block_counts[adaptive_level] * block_num_pix;
   if (first_time or adaptive_level > 0)
   {
+    int num_records = NumSampleRecords();
+    if (simulation_fused_coeffs)
+    {
+      fused_num_records = 0;
+      for (int m = 0; m < num_pix; m++)
+        fused_num_records = std::max(fused_num_records,
+            sample_offsets[adaptive_level](m+1) - sample_offsets[adaptive_level](m));
+      num_records = num_threads * fused_num_records;
+    }
     if (image_light or image_emission or image_emission_ave)
-      j_i[adaptive_level].Allocate(image_num_frequencies, num_pix,
-          geodesic_num_steps[adaptive_level]);
+      j_i[adaptive_level].Allocate(num_records, image_num_frequencies);
     if (image_light or image_tau or image_tau_int)
-      alpha_i[adaptive_level].Allocate(image_num_frequencies, num_pix,
-          geodesic_num_steps[adaptive_level]);
+      alpha_i[adaptive_level].Allocate(num_records, image_num_frequencies);
     if (image_light and image_polarization)
     {
-      j_q[adaptive_level].Allocate(image_num_frequencies, num_pix,
-          geodesic_num_steps[adaptive_level]);
-      j_v[adaptive_level].Allocate(image_num_frequencies, num_pix,
-          geodesic_num_steps[adaptive_level]);
-      alpha_q[adaptive_level].Allocate(image_num_frequencies, num_pix,
-          geodesic_num_steps[adaptive_level]);
-      alpha_v[adaptive_level].Allocate(image_num_frequencies, num_pix,
-          geodesic_num_steps[adaptive_level]);
-      rho_q[adaptive_level].Allocate(image_num_frequencies, num_pix,
-          geodesic_num_steps[adaptive_level]);
-      rho_v[adaptive_level].Allocate(image_num_frequencies, num_pix,
-          geodesic_num_steps[adaptive_level]);
+      j_q[adaptive_level].Allocate(num_records, image_num_frequencies);
+      j_v[adaptive_level].Allocate(num_records, image_num_frequencies);
+      alpha_q[adaptive_level].Allocate(num_records, image_num_frequencies);
+      alpha_v[adaptive_level].Allocate(num_records, image_num_frequencies);
+      rho_q[adaptive_level].Allocate(num_records, image_num_frequencies);
+      rho_v[adaptive_level].Allocate(num_records, image_num_frequencies);
     }
     if (image_lambda_ave or image_emission_ave or image_tau_int or render_num_images > 0)
-      cell_values[adaptive_level].Allocate(CellValues::num_cell_values, num_pix,
-          geodesic_num_steps[adaptive_level]);
+      cell_values[adaptive_level].Allocate(CellValues::num_cell_values, num_records);
+    if (render_fill_present)
+      render_lengths[adaptive_level].Allocate(num_records);
+    if (render_num_images > 0)
+      render[adaptive_level].Allocate(render_num_images, 3, num_pix);
   }
   j_i[adaptive_level].Zero();
   j_q[adaptive_level].Zero();
@@ -232,490 +263,864 @@ void RadiationIntegrator::CalculateSimulationCoefficients()
   rho_q[adaptive_level].Zero();
   rho_v[adaptive_level].Zero();
   cell_values[adaptive_level].SetNaN();
+  render_lengths[adaptive_level].Zero();
+  render[adaptive_level].Zero();
 
-  // Calculate units
-  double d_unit = simulation_rho_cgs;
-  double e_unit = d_unit * Physics::c * Physics::c;
-  double b_unit = std::sqrt(4.0 * Math::pi * e_unit);
+  // Defer calculations to integration
+  if (simulation_fused_coeffs)
+    return;
+
+  // Prepare optical depth accumulators
+  double x_unit = Physics::gg_msun * mass_msun / (Physics::c * Physics::c);
+  Array<double> tau_vals;
+  if (cut_tau_max >= 0.0)
+    tau_vals.Allocate(image_num_frequencies, num_pix);
 
   // Work in parallel
   #pragma omp parallel
   {
-    // Allocate scratch space
-    double gcov_sim[4][4];
-    double gcon_sim[4][4];
-    double gcov[4][4];
-    double gcon[4][4];
-    double jacobian[4][4];
-    double tetrad[4][4];
-
-    // Go through rays and samples
-    #pragma omp for schedule(static)
+    ProfileCounts profile_counts;
+    double profile_time_start = omp_get_wtime();
+    #pragma omp for schedule(runtime) nowait
     for (int m = 0; m < num_pix; m++)
     {
       int num_steps = sample_num[adaptive_level](m);
-      for (int n = 0; n < num_steps; n++)
-      {
-        // Skip coupling if in cut region
-        if (sample_cut[adaptive_level](m,n))
-          continue;
+      profile_counts.samples += num_steps;
 
-        // Extract geodesic position and covariant momentum
-        double x1 = sample_pos[adaptive_level](m,n,1);
-        double x2 = sample_pos[adaptive_level](m,n,2);
-        double x3 = sample_pos[adaptive_level](m,n,3);
-        double kcov[4];
-        kcov[0] = sample_dir[adaptive_level](m,n,0);
-        kcov[1] = sample_dir[adaptive_level](m,n,1);
-        kcov[2] = sample_dir[adaptive_level](m,n,2);
-        kcov[3] = sample_dir[adaptive_level](m,n,3);
-
-        // Extract model variables
-        double rho = sample_rho[adaptive_level](m,n);
-        double pgas = sample_pgas[adaptive_level](m,n);
-        double kappa = 0.0;
-        if (plasma_model == PlasmaModel::code_kappa)
-          kappa = sample_kappa[adaptive_level](m,n);
-        double uu1_sim = sample_uu1[adaptive_level](m,n);
-        double uu2_sim = sample_uu2[adaptive_level](m,n);
-        double uu3_sim = sample_uu3[adaptive_level](m,n);
-        double bb1_sim = sample_bb1[adaptive_level](m,n);
-        double bb2_sim = sample_bb2[adaptive_level](m,n);
-        double bb3_sim = sample_bb3[adaptive_level](m,n);
-
-        // Calculate densities and pressures
-        double rho_cgs = rho * d_unit;
-        double pgas_cgs = pgas * e_unit;
-        double n_cgs = rho_cgs / (plasma_mu * Physics::m_p);
-        double n_e_cgs = n_cgs / (1.0 + 1.0 / plasma_ne_ni);
-
-        // Calculate simulation metric
-        CovariantSimulationMetric(x1, x2, x3, gcov_sim);
-        ContravariantSimulationMetric(x1, x2, x3, gcon_sim);
-
-        // Calculate simulation velocity
-        double uu0_sim = std::sqrt(1.0 + gcov_sim[1][1] * uu1_sim * uu1_sim
-            + 2.0 * gcov_sim[1][2] * uu1_sim * uu2_sim + 2.0 * gcov_sim[1][3] * uu1_sim * uu3_sim
-            + gcov_sim[2][2] * uu2_sim * uu2_sim + 2.0 * gcov_sim[2][3] * uu2_sim * uu3_sim
-            + gcov_sim[3][3] * uu3_sim * uu3_sim);
-        double lapse_sim = 1.0 / std::sqrt(-gcon_sim[0][0]);
-        double shift1_sim = -gcon_sim[0][1] / gcon_sim[0][0];
-        double shift2_sim = -gcon_sim[0][2] / gcon_sim[0][0];
-        double shift3_sim = -gcon_sim[0][3] / gcon_sim[0][0];
-        double ucon_sim[4];
-        ucon_sim[0] = uu0_sim / lapse_sim;
-        ucon_sim[1] = uu1_sim - shift1_sim * uu0_sim / lapse_sim;
-        ucon_sim[2] = uu2_sim - shift2_sim * uu0_sim / lapse_sim;
-        ucon_sim[3] = uu3_sim - shift3_sim * uu0_sim / lapse_sim;
-        double ucov_sim[4] = {};
-        for (int mu = 0; mu < 4; mu++)
-          for (int nu = 0; nu < 4; nu++)
-            ucov_sim[mu] += gcov_sim[mu][nu] * ucon_sim[nu];
-
-        // Calculate simulation magnetic field
-        double bcon_sim[4];
-        bcon_sim[0] = ucov_sim[1] * bb1_sim + ucov_sim[2] * bb2_sim + ucov_sim[3] * bb3_sim;
-        bcon_sim[1] = (bb1_sim + bcon_sim[0] * ucon_sim[1]) / ucon_sim[0];
-        bcon_sim[2] = (bb2_sim + bcon_sim[0] * ucon_sim[2]) / ucon_sim[0];
-        bcon_sim[3] = (bb3_sim + bcon_sim[0] * ucon_sim[3]) / ucon_sim[0];
-        double bcov_sim[4] = {};
-        for (int mu = 0; mu < 4; mu++)
-          for (int nu = 0; nu < 4; nu++)
-            bcov_sim[mu] += gcov_sim[mu][nu] * bcon_sim[nu];
-        double b_sq = 0.0;
-        for (int mu = 0; mu < 4; mu++)
-          b_sq += bcov_sim[mu] * bcon_sim[mu];
-        double bb_cgs = std::sqrt(b_sq) * b_unit;
-        double sigma = b_sq / rho;
-        double beta_inv = b_sq / (2.0 * pgas);
-
-        // Calculate electron temperature for model with T_i/T_e a function of beta (E1 1)
-        double kb_tt_e_cgs = std::numeric_limits<double>::quiet_NaN();
-        double theta_e = std::numeric_limits<double>::quiet_NaN();
-        if (plasma_thermal_frac != 0.0 and plasma_model == PlasmaModel::ti_te_beta)
-        {
-          double tti_tte = (plasma_rat_high + plasma_rat_low * beta_inv * beta_inv)
-              / (1.0 + beta_inv * beta_inv);
-          double kb_tt_tot_cgs = plasma_mu * Physics::m_p * pgas_cgs / rho_cgs;
-          if (plasma_use_p)
-            kb_tt_e_cgs = (1.0 + plasma_ne_ni) / (tti_tte + plasma_ne_ni) * kb_tt_tot_cgs;
-          else
+      // Go through all samples
+      if (cut_tau_max < 0.0)
+      {
+        int s_next = sample_offsets[adaptive_level](m);
+        for (int n = 0; n < num_steps; n++)
+          if (SampleKept(m, n))
           {
-            kb_tt_e_cgs = (1.0 + plasma_ne_ni) * kb_tt_tot_cgs / (plasma_gamma - 1.0);
-            kb_tt_e_cgs /= tti_tte / (plasma_gamma_i - 1.0) + plasma_ne_ni / (plasma_gamma_e - 1.0);
+            int s = s_next++;
+            CalculateSimulationCoefficientsPoint(m, n, s, s);
           }
-          theta_e = kb_tt_e_cgs / (Physics::m_e * Physics::c * Physics::c);
-        }
+        if (render_num_images > 0)
+          RenderRay(m, sample_offsets[adaptive_level](m));
+        continue;
+      }
 
-        // Calculate electron temperature for given electron entropy (E2 13)
-        if (plasma_thermal_frac != 0.0 and plasma_model == PlasmaModel::code_kappa)
+      // Go from camera until optically thick at all frequencies
+      for (int l = 0; l < image_num_frequencies; l++)
+        tau_vals(l,m) = 0.0;
+      int s_next = sample_offsets[adaptive_level](m+1);
+      for (int n = num_steps - 1; n >= 0; n--)
+      {
+        if (not SampleKept(m, n))
+          continue;
+        int s = --s_next;
+        SampleSimulationPoint(m, n, s);
+        CalculateSimulationCoefficientsPoint(m, n, s, s);
+        bool optically_thick = true;
+        for (int l = 0; l < image_num_frequencies; l++)
         {
-          double mu_e = plasma_mu * (1.0 + 1.0 / plasma_ne_ni);
-          double rho_e = rho * Physics::m_e / (mu_e * Physics::m_p);
-          double rho_kappa_e_cbrt = std::cbrt(rho_e * kappa);
-          theta_e = 1.0 / 5.0 * (std::sqrt(1.0 + 25.0 * rho_kappa_e_cbrt * rho_kappa_e_cbrt) - 1.0);
-          kb_tt_e_cgs = theta_e * Physics::m_e * Physics::c * Physics::c;
+          double delta_lambda_cgs = SampleLength(m,n) * x_unit
+              / (image_frequencies(l) * momentum_factors[adaptive_level](m));
+          tau_vals(l,m) += alpha_i[adaptive_level](s,l) * delta_lambda_cgs;
+          optically_thick = optically_thick and tau_vals(l,m) > cut_tau_max;
         }
+        if (optically_thick)
+          break;
+      }
+      if (render_num_images > 0)
+        RenderRay(m, sample_offsets[adaptive_level](m));
+    }
+    ProfileRecordThread("CalculateSimulationCoefficients", ProfileSnapshot(), adaptive_level,
+        profile_time_start, omp_get_wtime(), profile_counts);
+  }
 
-        // Skip coupling based on cell values
-        if ((cut_rho_min >= 0.0 and rho_cgs < cut_rho_min)
-            or (cut_rho_max >= 0.0 and rho_cgs > cut_rho_max)
-            or (cut_n_e_min >= 0.0 and n_e_cgs < cut_n_e_min)
-            or (cut_n_e_max >= 0.0 and n_e_cgs > cut_n_e_max)
-            or (cut_p_gas_min >= 0.0 and pgas_cgs < cut_p_gas_min)
-            or (cut_p_gas_max >= 0.0 and pgas_cgs > cut_p_gas_max)
-            or (cut_theta_e_min >= 0.0 and theta_e < cut_theta_e_min)
-            or (cut_theta_e_max >= 0.0 and theta_e > cut_theta_e_max)
-            or (cut_b_min >= 0.0 and bb_cgs < cut_b_min)
-            or (cut_b_max >= 0.0 and bb_cgs > cut_b_max)
-            or (cut_sigma_min >= 0.0 and sigma < cut_sigma_min)
-            or (cut_sigma_max >= 0.0 and sigma > cut_sigma_max)
-            or (cut_beta_inverse_min >= 0.0 and beta_inv < cut_beta_inverse_min)
-            or (cut_beta_inverse_max >= 0.0 and beta_inv > cut_beta_inverse_max))
-          continue;
+  // Free memory
+  if (adaptive_level > 0 and not (image_light and image_polarization))
+    sample_prim[adaptive_level].Deallocate();
 
-        // Record cell values
-        if (image_lambda_ave or image_emission_ave or image_tau_int or render_num_images > 0)
-        {
-          cell_values[adaptive_level](static_cast<int>(CellValues::rho),m,n) = rho_cgs;
-          cell_values[adaptive_level](static_cast<int>(CellValues::n_e),m,n) = n_e_cgs;
-          cell_values[adaptive_level](static_cast<int>(CellValues::p_gas),m,n) = pgas_cgs;
-          cell_values[adaptive_level](static_cast<int>(CellValues::theta_e),m,n) = theta_e;
-          cell_values[adaptive_level](static_cast<int>(CellValues::bb),m,n) = bb_cgs;
-          cell_values[adaptive_level](static_cast<int>(CellValues::sigma),m,n) = sigma;
-          cell_values[adaptive_level](static_cast<int>(CellValues::beta_inv),m,n) = beta_inv;
-        }
+  // Free memory deferred from sampling
+  if (adaptive_level > 0 and cut_tau_max >= 0.0)
+  {
+    sample_inds[adaptive_level].Deallocate();
+    sample_fracs[adaptive_level].Deallocate();
+  }
+  return;
+}
 
-        // Skip remaining calculations if possible
-        if (not (image_light or image_emission or image_tau or image_emission_ave or image_tau_int))
-          continue;
+//--------------------------------------------------------------------------------------------------
 
-        // Skip coupling if magnetic field vanishes
-        if (bb1_sim == 0.0 and bb2_sim == 0.0 and bb3_sim == 0.0)
-          continue;
+// Function for calculating radiative transfer coefficients along a single ray
+// Inputs:
+//   m: pixel index
+//   r: index of first record to fill in coefficient arrays and cell_values[adaptive_level]
+// Outputs: (none)
+// Notes:
+//   Assumes CalculateSimulationCoefficients() has allocated arrays to be set, with room for all
+//       non-cut samples along the ray starting at r.
+//   Zeroes the records used and then fills them in order of increasing sample index.
+//   Renders ray if render_num_images > 0.
+//   Used when simulation_fused_coeffs == true, so that integration can use coefficients as soon as
+//       they are calculated.
+void RadiationIntegrator::CalculateSimulationCoefficientsRay(int m, int r)
+{
+  // Zero records
+  int s_begin = sample_offsets[adaptive_level](m);
+  int r_end = r + sample_offsets[adaptive_level](m+1) - s_begin;
+  Array<double> *coefficients[] = {&j_i[adaptive_level], &j_q[adaptive_level],
+      &j_v[adaptive_level], &alpha_i[adaptive_level], &alpha_q[adaptive_level],
+      &alpha_v[adaptive_level], &rho_q[adaptive_level], &rho_v[adaptive_level]};
+  for (Array<double> *p_coefficients : coefficients)
+    if (p_coefficients->allocated)
+      for (int r_zero = r; r_zero < r_end; r_zero++)
+        for (int l = 0; l < image_num_frequencies; l++)
+          (*p_coefficients)(r_zero,l) = 0.0;
+  if (cell_values[adaptive_level].allocated)
+    for (int r_zero = r; r_zero < r_end; r_zero++)
+      for (int a = 0; a < CellValues::num_cell_values; a++)
+        cell_values[adaptive_level](a,r_zero) = std::numeric_limits<double>::quiet_NaN();
+  if (render_lengths[adaptive_level].allocated)
+    for (int r_zero = r; r_zero < r_end; r_zero++)
+      render_lengths[adaptive_level](r_zero) = 0.0;
+
+  // Go through all samples
+  int num_steps = sample_num[adaptive_level](m);
+  int s_next = s_begin;
+  int r_next = r;
+  for (int n = 0; n < num_steps; n++)
+    if (SampleKept(m, n))
+    {
+      int s = s_next++;
+      CalculateSimulationCoefficientsPoint(m, n, s, r_next++);
+    }
+
+  // Render ray
+  if (render_num_images > 0)
+    RenderRay(m, r);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating transfer coefficients at a single geodesic sample
+// Inputs:
+//   m: pixel index
+//   n: sample index
+//   s: index of sample in compacted storage
+//   r: index of record in coefficient arrays and cell_values[adaptive_level]
+// Outputs: (none)
+// Notes:
+//   Assumes arrays to be set have been allocated and zeroed.
+//   Assumes sample is not cut.
+//   Uses sample_geom in place of metric and Jacobian calculations if it has been set and
+//       adaptive_level == 0.
+//   Records proper length of sample in render_lengths[adaptive_level] if
+//       render_fill_present == true.
+//   If plasma_table == true, uses plasma_tables in place of kappa-distribution fitting functions
+//       and thermal Faraday fitting functions of frequency; see CalculatePlasmaTables().
+//   See CalculateSimulationCoefficients().
+//   Dispatches to version specialized for the common case of plasma_model ==
+//       PlasmaModel::ti_te_beta, plasma_use_p == true, and no cuts based on cell values.
+void RadiationIntegrator::CalculateSimulationCoefficientsPoint(int m, int n, int s, int r)
+{
+  if (plasma_model == PlasmaModel::ti_te_beta and plasma_use_p and not cut_cell_values)
+    CalculateSimulationCoefficientsPoint<false>(m, n, s, r);
+  else
+    CalculateSimulationCoefficientsPoint<true>(m, n, s, r);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for calculating transfer coefficients at a single geodesic sample, specialized for
+//     plasma model and cuts
+// Inputs:
+//   m: pixel index
+//   n: sample index
+//   s: index of sample in compacted storage
+//   r: index of record in coefficient arrays and cell_values[adaptive_level]
+// Outputs: (none)
+// Notes:
+//   See CalculateSimulationCoefficientsPoint().
+//   If generic == false, assumes plasma_model == PlasmaModel::ti_te_beta, plasma_use_p == true, and
+//       cut_cell_values == false.
+template<bool generic>
+void RadiationIntegrator::CalculateSimulationCoefficientsPoint(int m, int n, int s, int r)
+{
+  // Calculate units
+  double d_unit = simulation_rho_cgs;
+  double e_unit = d_unit * Physics::c * Physics::c;
+  double b_unit = std::sqrt(4.0 * Math::pi * e_unit);
+
+  // Allocate scratch space
+  double gcov_sim[4][4];
+  double gcon_sim[4][4];
+  double gcov[4][4];
+  double gcon[4][4];
+  double jacobian[4][4];
+  double tetrad[4][4];
+
+  // Extract geodesic position and covariant momentum
+  double x1 = SamplePosition(m,n,1);
+  double x2 = SamplePosition(m,n,2);
+  double x3 = SamplePosition(m,n,3);
+  double kcov[4];
+  kcov[0] = SampleDirection(m,n,0);
+  kcov[1] = SampleDirection(m,n,1);
+  kcov[2] = SampleDirection(m,n,2);
+  kcov[3] = SampleDirection(m,n,3);
+
+  // Extract model variables
+  const float *sample_vals = &sample_prim[adaptive_level](s,0);
+  double rho = sample_vals[sample_ind_rho];
+  double pgas = sample_vals[sample_ind_pgas];
+  double kappa = 0.0;
+  if (generic and plasma_model == PlasmaModel::code_kappa)
+    kappa = sample_vals[sample_ind_kappa];
+  double uu1_sim = sample_vals[sample_ind_uu1];
+  double uu2_sim = sample_vals[sample_ind_uu2];
+  double uu3_sim = sample_vals[sample_ind_uu3];
+  double bb1_sim = sample_vals[sample_ind_bb1];
+  double bb2_sim = sample_vals[sample_ind_bb2];
+  double bb3_sim = sample_vals[sample_ind_bb3];
+
+  // Calculate densities and pressures
+  double rho_cgs = rho * d_unit;
+  double pgas_cgs = pgas * e_unit;
+  double n_cgs = rho_cgs / (plasma_mu * Physics::m_p);
+  double n_e_cgs = n_cgs / (1.0 + 1.0 / plasma_ne_ni);
+
+  // Locate cached geometric quantities
+  const double *geom = nullptr;
+  if (adaptive_level == 0 and sample_geom.allocated)
+    geom = &sample_geom(s,0);
+
+  // Calculate simulation metric
+  double lapse_sim, shift1_sim, shift2_sim, shift3_sim;
+  if (geom != nullptr)
+  {
+    for (int mu = 0; mu < 4; mu++)
+      for (int nu = 0; nu < 4; nu++)
+        gcov_sim[mu][nu] = geom[sample_geom_gcov_sim+4*mu+nu];
+    lapse_sim = geom[sample_geom_lapse_shift_sim];
+    shift1_sim = geom[sample_geom_lapse_shift_sim+1];
+    shift2_sim = geom[sample_geom_lapse_shift_sim+2];
+    shift3_sim = geom[sample_geom_lapse_shift_sim+3];
+  }
+  else
+  {
+    CovariantSimulationMetric(x1, x2, x3, gcov_sim);
+    ContravariantSimulationMetric(x1, x2, x3, gcon_sim);
+    lapse_sim = 1.0 / std::sqrt(-gcon_sim[0][0]);
+    shift1_sim = -gcon_sim[0][1] / gcon_sim[0][0];
+    shift2_sim = -gcon_sim[0][2] / gcon_sim[0][0];
+    shift3_sim = -gcon_sim[0][3] / gcon_sim[0][0];
+  }
+
+  // Calculate simulation velocity
+  double uu0_sim = std::sqrt(1.0 + gcov_sim[1][1] * uu1_sim * uu1_sim
+      + 2.0 * gcov_sim[1][2] * uu1_sim * uu2_sim + 2.0 * gcov_sim[1][3] * uu1_sim * uu3_sim
+      + gcov_sim[2][2] * uu2_sim * uu2_sim + 2.0 * gcov_sim[2][3] * uu2_sim * uu3_sim
+      + gcov_sim[3][3] * uu3_sim * uu3_sim);
+  double ucon_sim[4];
+  ucon_sim[0] = uu0_sim / lapse_sim;
+  ucon_sim[1] = uu1_sim - shift1_sim * uu0_sim / lapse_sim;
+  ucon_sim[2] = uu2_sim - shift2_sim * uu0_sim / lapse_sim;
+  ucon_sim[3] = uu3_sim - shift3_sim * uu0_sim / lapse_sim;
+  double ucov_sim[4] = {};
+  for (int mu = 0; mu < 4; mu++)
+    for (int nu = 0; nu < 4; nu++)
+      ucov_sim[mu] += gcov_sim[mu][nu] * ucon_sim[nu];
+
+  // Calculate simulation magnetic field
+  double bcon_sim[4];
+  bcon_sim[0] = ucov_sim[1] * bb1_sim + ucov_sim[2] * bb2_sim + ucov_sim[3] * bb3_sim;
+  bcon_sim[1] = (bb1_sim + bcon_sim[0] * ucon_sim[1]) / ucon_sim[0];
+  bcon_sim[2] = (bb2_sim + bcon_sim[0] * ucon_sim[2]) / ucon_sim[0];
+  bcon_sim[3] = (bb3_sim + bcon_sim[0] * ucon_sim[3]) / ucon_sim[0];
+  double bcov_sim[4] = {};
+  for (int mu = 0; mu < 4; mu++)
+    for (int nu = 0; nu < 4; nu++)
+      bcov_sim[mu] += gcov_sim[mu][nu] * bcon_sim[nu];
+  double b_sq = 0.0;
+  for (int mu = 0; mu < 4; mu++)
+    b_sq += bcov_sim[mu] * bcon_sim[mu];
+  double bb_cgs = std::sqrt(b_sq) * b_unit;
+  double sigma = b_sq / rho;
+  double beta_inv = b_sq / (2.0 * pgas);
+
+  // Calculate electron temperature for model with T_i/T_e a function of beta (E1 1)
+  double kb_tt_e_cgs = std::numeric_limits<double>::quiet_NaN();
+  double theta_e = std::numeric_limits<double>::quiet_NaN();
+  if (plasma_thermal_frac != 0.0 and (not generic or plasma_model == PlasmaModel::ti_te_beta))
+  {
+    double tti_tte = (plasma_rat_high + plasma_rat_low * beta_inv * beta_inv)
+        / (1.0 + beta_inv * beta_inv);
+    double kb_tt_tot_cgs = plasma_mu * Physics::m_p * pgas_cgs / rho_cgs;
+    if (not generic or plasma_use_p)
+      kb_tt_e_cgs = (1.0 + plasma_ne_ni) / (tti_tte + plasma_ne_ni) * kb_tt_tot_cgs;
+    else
+    {
+      kb_tt_e_cgs = (1.0 + plasma_ne_ni) * kb_tt_tot_cgs / (plasma_gamma - 1.0);
+      kb_tt_e_cgs /= tti_tte / (plasma_gamma_i - 1.0) + plasma_ne_ni / (plasma_gamma_e - 1.0);
+    }
+    theta_e = kb_tt_e_cgs / (Physics::m_e * Physics::c * Physics::c);
+  }
 
-        // Calculate Jacobian of transformation from simulation to geodesic coordinates
-        CoordinateJacobian(x1, x2, x3, jacobian);
-
-        // Transform contravariant velocity and magnetic field to geodesic coordinates
-        double ucon[4] = {};
-        for (int mu = 0; mu < 4; mu++)
-          for (int nu = 0; nu < 4; nu++)
-            ucon[mu] += jacobian[mu][nu] * ucon_sim[nu];
-        double bcon[4] = {};
-        for (int mu = 0; mu < 4; mu++)
-          for (int nu = 0; nu < 4; nu++)
-            bcon[mu] += jacobian[mu][nu] * bcon_sim[nu];
-
-        // Calculate geodesic metric
-        CovariantGeodesicMetric(x1, x2, x3, gcov);
-        ContravariantGeodesicMetric(x1, x2, x3, gcon);
-
-        // Calculate geodesic contravariant momentum
-        double kcon[4] = {};
-        for (int mu = 0; mu < 4; mu++)
-          for (int nu = 0; nu < 4; nu++)
-            kcon[mu] += gcon[mu][nu] * kcov[nu];
-
-        // Calculate covariant velocity and magnetic field
-        double ucov[4] = {};
-        for (int mu = 0; mu < 4; mu++)
-          for (int nu = 0; nu < 4; nu++)
-            ucov[mu] += gcov[mu][nu] * ucon[nu];
-        double bcov[4] = {};
-        for (int mu = 0; mu < 4; mu++)
-          for (int nu = 0; nu < 4; nu++)
-            bcov[mu] += gcov[mu][nu] * bcon[nu];
-
-        // Calculate orthonormal tetrad
-        Tetrad(ucon, ucov, kcon, kcov, bcon, gcov, gcon, tetrad);
-
-        // Calculate orthonormal-frame angle between wavevector and magnetic field
-        double k_tet_1 = 0.0;
-        double k_tet_2 = 0.0;
-        double k_tet_3 = 0.0;
-        double b_tet_1 = 0.0;
-        double b_tet_2 = 0.0;
-        double b_tet_3 = 0.0;
-        for (int mu = 0; mu < 4; mu++)
+  // Calculate electron temperature for given electron entropy (E2 13)
+  if (generic and plasma_thermal_frac != 0.0 and plasma_model == PlasmaModel::code_kappa)
+  {
+    double mu_e = plasma_mu * (1.0 + 1.0 / plasma_ne_ni);
+    double rho_e = rho * Physics::m_e / (mu_e * Physics::m_p);
+    double rho_kappa_e_cbrt = std::cbrt(rho_e * kappa);
+    theta_e = 1.0 / 5.0 * (std::sqrt(1.0 + 25.0 * rho_kappa_e_cbrt * rho_kappa_e_cbrt) - 1.0);
+    kb_tt_e_cgs = theta_e * Physics::m_e * Physics::c * Physics::c;
+  }
+
+  // Skip coupling based on cell values
+  if (generic and cut_cell_values and ((cut_rho_min >= 0.0 and rho_cgs < cut_rho_min)
+      or (cut_rho_max >= 0.0 and rho_cgs > cut_rho_max)
+      or (cut_n_e_min >= 0.0 and n_e_cgs < cut_n_e_min)
+      or (cut_n_e_max >= 0.0 and n_e_cgs > cut_n_e_max)
+      or (cut_p_gas_min >= 0.0 and pgas_cgs < cut_p_gas_min)
+      or (cut_p_gas_max >= 0.0 and pgas_cgs > cut_p_gas_max)
+      or (cut_theta_e_min >= 0.0 and theta_e < cut_theta_e_min)
+      or (cut_theta_e_max >= 0.0 and theta_e > cut_theta_e_max)
+      or (cut_b_min >= 0.0 and bb_cgs < cut_b_min)
+      or (cut_b_max >= 0.0 and bb_cgs > cut_b_max)
+      or (cut_sigma_min >= 0.0 and sigma < cut_sigma_min)
+      or (cut_sigma_max >= 0.0 and sigma > cut_sigma_max)
+      or (cut_beta_inverse_min >= 0.0 and beta_inv < cut_beta_inverse_min)
+      or (cut_beta_inverse_max >= 0.0 and beta_inv > cut_beta_inverse_max)))
+    return;
+
+  // Determine if coupling is needed, skipping it if magnetic field vanishes
+  bool coupled = (image_light or image_emission or image_tau or image_emission_ave
+      or image_tau_int) and not (bb1_sim == 0.0 and bb2_sim == 0.0 and bb3_sim == 0.0);
+
+  // Calculate geodesic metric and contravariant momentum
+  double kcon[4] = {};
+  if (coupled or render_fill_present)
+  {
+    if (geom != nullptr)
+      for (int mu = 0; mu < 4; mu++)
+      {
+        for (int nu = 0; nu < 4; nu++)
         {
-          k_tet_1 += tetrad[1][mu] * kcov[mu];
-          k_tet_2 += tetrad[2][mu] * kcov[mu];
-          k_tet_3 += tetrad[3][mu] * kcov[mu];
-          b_tet_1 += tetrad[1][mu] * bcov[mu];
-          b_tet_2 += tetrad[2][mu] * bcov[mu];
-          b_tet_3 += tetrad[3][mu] * bcov[mu];
+          gcov[mu][nu] = geom[sample_geom_gcov+4*mu+nu];
+          gcon[mu][nu] = geom[sample_geom_gcon+4*mu+nu];
         }
-        double k_sq_tet = k_tet_1 * k_tet_1 + k_tet_2 * k_tet_2 + k_tet_3 * k_tet_3;
-        double b_sq_tet = b_tet_1 * b_tet_1 + b_tet_2 * b_tet_2 + b_tet_3 * b_tet_3;
-        double k_b_tet = k_tet_1 * b_tet_1 + k_tet_2 * b_tet_2 + k_tet_3 * b_tet_3;
-        double cos2_theta_b = std::min(k_b_tet * k_b_tet / (k_sq_tet * b_sq_tet), 1.0);
-        double sin2_theta_b = 1.0 - cos2_theta_b;
-        double sin_theta_b = std::sqrt(sin2_theta_b);
-        double cos_theta_b = std::sqrt(cos2_theta_b) * (k_b_tet >= 0.0 ? 1.0 : -1.0);
-
-        // Go through frequencies
-        for (int l = 0; l < image_num_frequencies; l++)
-        {
-          // Calculate orthonormal-frame frequencies
-          double nu_cgs = 0.0;
-          for (int mu = 0; mu < 4; mu++)
-            nu_cgs -= kcov[mu] * ucon[mu];
-          nu_cgs *= image_frequencies(l) * momentum_factors[adaptive_level](m);
-          double nu_2_cgs = nu_cgs * nu_cgs;
-          double nu_c_cgs = Physics::e * bb_cgs / (2.0 * Math::pi * Physics::m_e * Physics::c);
-          double nu_s_cgs = 2.0 / 9.0 * nu_c_cgs * theta_e * theta_e * sin_theta_b;
-
-          // Calculate thermal synchrotron emissivities (M 28,30)
-          double j_i_val;
-          if (plasma_thermal_frac != 0.0)
-          {
-            double xx = nu_cgs / nu_s_cgs;
-            double xx_1_2 = std::sqrt(xx);
-            double xx_1_3 = std::cbrt(xx);
-            double xx_1_6 = std::sqrt(xx_1_3);
-            double coefficient = plasma_thermal_frac * n_e_cgs * Physics::e * Physics::e * nu_c_cgs
-                / (Physics::c * nu_2_cgs) * std::exp(-xx_1_3);
-            double var_a = Math::sqrt2 * Math::pi / 27.0 * sin_theta_b;
-            double var_b = std::pow(2.0, 11.0 / 12.0);
-            double var_c = xx_1_2 + var_b * xx_1_6;
-            j_i_val = coefficient * var_a * var_c * var_c;
-            if (image_light or image_emission or image_emission_ave)
-              j_i[adaptive_level](l,m,n) = j_i_val;
-            if (image_light and image_polarization)
-            {
-              double var_d = (7.0 * std::pow(theta_e, 0.96) + 35.0)
-                  / (10.0 * std::pow(theta_e, 0.96) + 75.0) * var_b;
-              double var_e = xx_1_2 + var_d * xx_1_6;
-              double var_f = cos_theta_b / theta_e;
-              double var_g = Math::pi / 3.0 + Math::pi / 3.0 * xx_1_3 + 2.0 / 300.0 * xx_1_2
-                  + 2.0 / 19.0 * Math::pi * xx_1_3 * xx_1_3;
-              j_q[adaptive_level](l,m,n) = -coefficient * var_a * var_e * var_e;
-              j_v[adaptive_level](l,m,n) = coefficient * var_f * var_g;
-            }
-          }
+        kcon[mu] = geom[sample_geom_kcon+mu];
+      }
+    else
+    {
+      CovariantGeodesicMetric(x1, x2, x3, gcov);
+      ContravariantGeodesicMetric(x1, x2, x3, gcon);
+      for (int mu = 0; mu < 4; mu++)
+        for (int nu = 0; nu < 4; nu++)
+          kcon[mu] += gcon[mu][nu] * kcov[nu];
+    }
+  }
 
-          // Calculate thermal synchrotron absorptivities from Kirchoff's law (M 31)
-          if (plasma_thermal_frac != 0.0)
-          {
-            // Calculate absorptivities
-            double b_nu_nu_3_cgs = 2.0 * Physics::h / (Physics::c * Physics::c)
-                / std::expm1(Physics::h * nu_cgs / kb_tt_e_cgs);
-            if (image_light or image_tau or image_tau_int)
-              alpha_i[adaptive_level](l,m,n) = j_i_val / b_nu_nu_3_cgs;
-            if (image_light and image_polarization)
-            {
-              alpha_q[adaptive_level](l,m,n) = j_q[adaptive_level](l,m,n) / b_nu_nu_3_cgs;
-              alpha_v[adaptive_level](l,m,n) = j_v[adaptive_level](l,m,n) / b_nu_nu_3_cgs;
-            }
-
-            // Account for numerical issues later arising from absorptivities being too small
-            if ((image_light or image_tau or image_tau_int)
-                and 1.0 / (alpha_i[adaptive_level](l,m,n) * alpha_i[adaptive_level](l,m,n))
-                == std::numeric_limits<double>::infinity())
-            {
-              alpha_i[adaptive_level](l,m,n) = 0.0;
-              if (image_light and image_polarization)
-              {
-                alpha_q[adaptive_level](l,m,n) = 0.0;
-                alpha_v[adaptive_level](l,m,n) = 0.0;
-              }
-            }
-          }
+  // Record cell values
+  if (image_lambda_ave or image_emission_ave or image_tau_int or render_num_images > 0)
+  {
+    cell_values[adaptive_level](static_cast<int>(CellValues::rho),r) = rho_cgs;
+    cell_values[adaptive_level](static_cast<int>(CellValues::n_e),r) = n_e_cgs;
+    cell_values[adaptive_level](static_cast<int>(CellValues::p_gas),r) = pgas_cgs;
+    cell_values[adaptive_level](static_cast<int>(CellValues::theta_e),r) = theta_e;
+    cell_values[adaptive_level](static_cast<int>(CellValues::bb),r) = bb_cgs;
+    cell_values[adaptive_level](static_cast<int>(CellValues::sigma),r) = sigma;
+    cell_values[adaptive_level](static_cast<int>(CellValues::beta_inv),r) = beta_inv;
+  }
 
-          // Calculate thermal synchrotron rotativities (M 33-37)
-          if (plasma_thermal_frac != 0.0 and image_light and image_polarization)
-          {
-            double coefficient_q = -plasma_thermal_frac * n_e_cgs * Physics::e * Physics::e
-                * nu_c_cgs * nu_c_cgs * sin2_theta_b / (Physics::m_e * Physics::c * nu_2_cgs);
-            double coefficient_v = plasma_thermal_frac * 2.0 * n_e_cgs * Physics::e * Physics::e
-                * nu_c_cgs * cos_theta_b / (Physics::m_e * Physics::c * nu_cgs);
-            double factor_q = 0.0;
-            double factor_v = 1.0;
-            if (theta_e >= theta_e_zero)
-            {
-              double kk_0 = std::cyl_bessel_k(0.0, 1.0 / theta_e);
-              double kk_1 = std::cyl_bessel_k(1.0, 1.0 / theta_e);
-              double kk_2 = std::cyl_bessel_k(2.0, 1.0 / theta_e);
-              double xx = nu_cgs / nu_s_cgs;
-              double xx_neg_1_2 = 1.0 / std::sqrt(xx);
-              double var_a = 2.011 * std::exp(-19.78 * std::pow(xx, -0.5175));
-              double var_b = std::cos(39.89 * xx_neg_1_2) * std::exp(-70.16 * std::pow(xx, -0.6));
-              double var_c = 0.011 * std::exp(-1.69 * xx_neg_1_2);
-              double var_d = 0.003135 * std::pow(xx, 4.0 / 3.0);
-              double var_e = 0.5 * (1.0 + std::tanh(10.0 * std::log(0.6648 * xx_neg_1_2)));
-              double f_0 = var_a - var_b - var_c;
-              double f_m = f_0 + (var_c - var_d) * var_e;
-              double delta_jj_5 = 0.4379 * std::log(1.0 + 1.3414 * std::pow(xx, -0.7515));
-              factor_q = f_m * (kk_1 / kk_2 + 6.0 * theta_e);
-              factor_v = (kk_0 - delta_jj_5) / kk_2;
-              factor_v = factor_v < 0.0 or factor_v > 1.0 ? 1.0 : factor_v;
-            }
-            rho_q[adaptive_level](l,m,n) = coefficient_q * factor_q;
-            rho_v[adaptive_level](l,m,n) = coefficient_v * factor_v;
-          }
+  // Record proper length for rendering
+  if (render_fill_present)
+  {
+    double x_unit = Physics::gg_msun * mass_msun / (Physics::c * Physics::c);
+    double temp_a[4] = {};
+    for (int a = 1; a < 4; a++)
+      for (int mu = 0; mu < 4; mu++)
+        temp_a[a] += (gcon[a][mu] - gcon[0][a] * gcon[0][mu] / gcon[0][0]) * kcov[mu];
+    double dl_dlambda_sq = 0.0;
+    for (int a = 1; a < 4; a++)
+      for (int b = 1; b < 4; b++)
+        dl_dlambda_sq += gcov[a][b] * temp_a[a] * temp_a[b];
+    render_lengths[adaptive_level](r) = std::sqrt(dl_dlambda_sq) * SampleLength(m,n) * x_unit;
+  }
 
-          // Calculate power-law synchrotron emissivities (M 28,38)
-          if (plasma_power_frac != 0.0 and (image_light or image_emission or image_emission_ave))
-          {
-            double var_a = std::pow(nu_cgs / (nu_c_cgs * sin_theta_b), -(plasma_p - 1.0) / 2.0);
-            double coefficient = plasma_power_frac * n_e_cgs * Physics::e * Physics::e * nu_c_cgs
-                / (Physics::c * nu_2_cgs) * power_jj * sin_theta_b * var_a;
-            j_i[adaptive_level](l,m,n) += coefficient;
-            if (image_light and image_polarization)
-            {
-              double var_b = cos_theta_b / sin_theta_b;
-              double var_c = 1.0 / std::sqrt(nu_cgs / (3.0 * nu_c_cgs * sin_theta_b));
-              j_q[adaptive_level](l,m,n) += coefficient * power_jj_q;
-              j_v[adaptive_level](l,m,n) += coefficient * power_jj_v * var_b * var_c;
-            }
-          }
+  // Skip remaining calculations if possible
+  if (not coupled)
+    return;
 
-          // Calculate power-law synchrotron absorptivities (M 29,39)
-          if (plasma_power_frac != 0.0 and (image_light or image_tau or image_tau_int))
-          {
-            double var_a = std::pow(nu_cgs / (nu_c_cgs * sin_theta_b), -(plasma_p + 2.0) / 2.0);
-            double coefficient = plasma_power_frac * n_e_cgs * Physics::e * Physics::e
-                / (Physics::m_e * Physics::c) * power_aa * var_a;
-            alpha_i[adaptive_level](l,m,n) += coefficient;
-            if (image_light and image_polarization)
-            {
-              double var_b = std::pow(3.1 * std::pow(sin_theta_b, -1.92) - 3.1, 0.512);
-              double var_c = 1.0 / std::sqrt(nu_cgs / (nu_c_cgs * sin_theta_b));
-              double var_d = cos_theta_b >= 0.0 ? 1.0 : -1.0;
-              alpha_q[adaptive_level](l,m,n) += coefficient * power_aa_q;
-              alpha_v[adaptive_level](l,m,n) += coefficient * power_aa_v * var_b * var_c * var_d;
-            }
-          }
+  // Calculate Jacobian of transformation from simulation to geodesic coordinates
+  if (geom != nullptr)
+    for (int mu = 0; mu < 4; mu++)
+      for (int nu = 0; nu < 4; nu++)
+        jacobian[mu][nu] = geom[sample_geom_jacobian+4*mu+nu];
+  else
+    CoordinateJacobian(x1, x2, x3, jacobian);
 
-          // Calculate power-law synchrotron rotativities (M 40-42)
-          if (plasma_power_frac != 0.0 and image_light and image_polarization)
-          {
-            double var_a = n_e_cgs * Physics::e * Physics::e * nu_cgs
-                / (Physics::m_e * Physics::c * nu_c_cgs * sin_theta_b);
-            double var_b = nu_c_cgs * sin_theta_b / nu_cgs;
-            double var_c = var_b * var_b;
-            double var_d = var_c * var_b;
-            double var_e = 1.0 - std::pow(2.0 * nu_c_cgs * plasma_gamma_min * plasma_gamma_min
-                * sin_theta_b / (3.0 * nu_cgs), plasma_p / 2.0 - 1.0);
-            double var_f = cos_theta_b / sin_theta_b;
-            double coefficient = plasma_power_frac * power_rho * var_a;
-            rho_q[adaptive_level](l,m,n) += coefficient * power_rho_q * var_d * var_e;
-            rho_v[adaptive_level](l,m,n) += coefficient * power_rho_v * var_c * var_f;
-          }
+  // Transform contravariant velocity and magnetic field to geodesic coordinates
+  double ucon[4] = {};
+  for (int mu = 0; mu < 4; mu++)
+    for (int nu = 0; nu < 4; nu++)
+      ucon[mu] += jacobian[mu][nu] * ucon_sim[nu];
+  double bcon[4] = {};
+  for (int mu = 0; mu < 4; mu++)
+    for (int nu = 0; nu < 4; nu++)
+      bcon[mu] += jacobian[mu][nu] * bcon_sim[nu];
 
-          // Calculate kappa-distribution synchrotron emissivities (M 28,43-46)
-          if (plasma_kappa_frac != 0.0 and (image_light or image_emission or image_emission_ave))
-          {
-            double nu_kappa_cgs =
-                nu_c_cgs * plasma_w * plasma_w * plasma_kappa * plasma_kappa * sin_theta_b;
-            double xx = nu_cgs / nu_kappa_cgs;
-            double var_a = plasma_kappa_frac * n_e_cgs * Physics::e * Physics::e * nu_c_cgs
-                / (Physics::c * nu_2_cgs);
-            double var_b = std::cbrt(xx) * sin_theta_b;
-            double var_c = std::pow(xx, -(plasma_kappa - 2.0) / 2.0) * sin_theta_b;
-            double coefficient_low = kappa_jj_low * var_a * var_b;
-            double coefficient_high = kappa_jj_high * var_a * var_c;
-            j_i[adaptive_level](l,m,n) += std::pow(std::pow(coefficient_low, -kappa_jj_x_i)
-                + std::pow(coefficient_high, -kappa_jj_x_i), -1.0 / kappa_jj_x_i);
-            if (image_light and image_polarization)
-            {
-              double var_d = std::pow(std::pow(sin_theta_b, -2.4) - 1.0, 0.48);
-              double var_e = std::pow(xx, -0.35);
-              double var_f = std::pow(std::pow(sin_theta_b, -2.5) - 1.0, 0.44);
-              double var_g = 1.0 / std::sqrt(xx);
-              double var_h = cos_theta_b >= 0.0 ? 1.0 : -1.0;
-              double jj_q_low = coefficient_low * kappa_jj_low_q;
-              double jj_v_low = coefficient_low * kappa_jj_low_v * var_d * var_e;
-              double jj_q_high = coefficient_high * kappa_jj_high_q;
-              double jj_v_high = coefficient_high * kappa_jj_high_v * var_f * var_g;
-              j_q[adaptive_level](l,m,n) -= std::pow(std::pow(jj_q_low, -kappa_jj_x_q)
-                  + std::pow(jj_q_high, -kappa_jj_x_q), -1.0 / kappa_jj_x_q);
-              j_v[adaptive_level](l,m,n) += std::pow(std::pow(jj_v_low, -kappa_jj_x_v)
-                  + std::pow(jj_v_high, -kappa_jj_x_v), -1.0 / kappa_jj_x_v) * var_h;
-            }
-          }
+  // Calculate covariant velocity and magnetic field
+  double ucov[4] = {};
+  for (int mu = 0; mu < 4; mu++)
+    for (int nu = 0; nu < 4; nu++)
+      ucov[mu] += gcov[mu][nu] * ucon[nu];
+  double bcov[4] = {};
+  for (int mu = 0; mu < 4; mu++)
+    for (int nu = 0; nu < 4; nu++)
+      bcov[mu] += gcov[mu][nu] * bcon[nu];
 
-          // Calculate kappa-distribution synchrotron absoptivities (M 29,47-50)
-          if (plasma_kappa_frac != 0.0 and (image_light or image_tau or image_tau_int))
-          {
-            double nu_kappa_cgs =
-                nu_c_cgs * plasma_w * plasma_w * plasma_kappa * plasma_kappa * sin_theta_b;
-            double xx = nu_cgs / nu_kappa_cgs;
-            double var_a =
-                plasma_kappa_frac * n_e_cgs * Physics::e * Physics::e / (Physics::m_e * Physics::c);
-            double var_b = std::pow(xx, -2.0 / 3.0);
-            double var_c = std::pow(xx, -(1.0 + plasma_kappa) / 2.0);
-            double coefficient_low = kappa_aa_low * var_a * var_b;
-            double coefficient_high = kappa_aa_high * var_a * var_c;
-            double aa_i_low = coefficient_low;
-            double aa_i_high = coefficient_high * kappa_aa_high_i;
-            alpha_i[adaptive_level](l,m,n) += std::pow(std::pow(aa_i_low, -kappa_aa_x_i)
-                + std::pow(aa_i_high, -kappa_aa_x_i), -1.0 / kappa_aa_x_i);
-            if (image_light and image_polarization)
-            {
-              double var_d = std::pow(std::pow(sin_theta_b, -2.28) - 1.0, 0.446);
-              double var_e = std::pow(xx, -0.35);
-              double var_f = std::sqrt(std::pow(sin_theta_b, -2.05) - 1.0);
-              double var_g = 1.0 / std::sqrt(xx);
-              double var_h = cos_theta_b >= 0.0 ? 1.0 : -1.0;
-              double aa_q_low = coefficient_low * kappa_aa_low_q;
-              double aa_v_low = coefficient_low * kappa_aa_low_v * var_d * var_e;
-              double aa_q_high = coefficient_high * kappa_aa_high_q;
-              double aa_v_high = coefficient_high * kappa_aa_high_v * var_f * var_g;
-              alpha_q[adaptive_level](l,m,n) -= std::pow(std::pow(aa_q_low, -kappa_aa_x_q)
-                  + std::pow(aa_q_high, -kappa_aa_x_q), -1.0 / kappa_aa_x_q);
-              alpha_v[adaptive_level](l,m,n) += std::pow(std::pow(aa_v_low, -kappa_aa_x_v)
-                  + std::pow(aa_v_high, -kappa_aa_x_v), -1.0 / kappa_aa_x_v) * var_h;
-            }
-          }
+  // Calculate orthonormal tetrad
+  Tetrad(ucon, ucov, kcon, kcov, bcon, gcov, gcon, tetrad);
 
-          // Calculate kappa-distribution synchrotron rotativities (M 51-54)
-          if (plasma_kappa_frac != 0.0 and image_light and image_polarization)
-          {
-            double nu_kappa_cgs =
-                nu_c_cgs * plasma_w * plasma_w * plasma_kappa * plasma_kappa * sin_theta_b;
-            double xx = nu_cgs / nu_kappa_cgs;
-            double var_a = -plasma_kappa_frac * n_e_cgs * Physics::e * Physics::e * nu_c_cgs
-                * nu_c_cgs * sin2_theta_b / (Physics::m_e * Physics::c * nu_2_cgs);
-            double var_b = plasma_kappa_frac * 2.0 * n_e_cgs * Physics::e * Physics::e * nu_c_cgs
-                * cos_theta_b / (Physics::m_e * Physics::c * nu_cgs);
-            double var_c = 1.0 / std::sqrt(xx);
-            double rho_q_low = var_a * kappa_rho_q_low_a * (1.0 - std::exp(kappa_rho_q_low_b
-                * std::pow(xx, 0.84)) - std::sin(kappa_rho_q_low_c * xx)
-                * std::exp(kappa_rho_q_low_d * std::pow(xx, kappa_rho_q_low_e)));
-            double rho_q_high = var_a * kappa_rho_q_high_a * (1.0 - std::exp(kappa_rho_q_high_b
-                * std::pow(xx, 0.84)) - std::sin(kappa_rho_q_high_c * xx)
-                * std::exp(kappa_rho_q_high_d * std::pow(xx, kappa_rho_q_high_e)));
-            double rho_v_low = kappa_rho_v * var_b * kappa_rho_v_low_a
-                * (1.0 - 0.17 * std::log(1.0 + kappa_rho_v_low_b * var_c));
-            double rho_v_high = kappa_rho_v * var_b * kappa_rho_v_high_a
-                * (1.0 - 0.17 * std::log(1.0 + kappa_rho_v_high_b * var_c));
-            rho_q[adaptive_level](l,m,n) +=
-                (1.0 - kappa_rho_frac) * rho_q_low + kappa_rho_frac * rho_q_high;
-            rho_v[adaptive_level](l,m,n) +=
-                (1.0 - kappa_rho_frac) * rho_v_low + kappa_rho_frac * rho_v_high;
-          }
+  // Calculate orthonormal-frame angle between wavevector and magnetic field
+  double k_tet_1 = 0.0;
+  double k_tet_2 = 0.0;
+  double k_tet_3 = 0.0;
+  double b_tet_1 = 0.0;
+  double b_tet_2 = 0.0;
+  double b_tet_3 = 0.0;
+  for (int mu = 0; mu < 4; mu++)
+  {
+    k_tet_1 += tetrad[1][mu] * kcov[mu];
+    k_tet_2 += tetrad[2][mu] * kcov[mu];
+    k_tet_3 += tetrad[3][mu] * kcov[mu];
+    b_tet_1 += tetrad[1][mu] * bcov[mu];
+    b_tet_2 += tetrad[2][mu] * bcov[mu];
+    b_tet_3 += tetrad[3][mu] * bcov[mu];
+  }
+  double k_sq_tet = k_tet_1 * k_tet_1 + k_tet_2 * k_tet_2 + k_tet_3 * k_tet_3;
+  double b_sq_tet = b_tet_1 * b_tet_1 + b_tet_2 * b_tet_2 + b_tet_3 * b_tet_3;
+  double k_b_tet = k_tet_1 * b_tet_1 + k_tet_2 * b_tet_2 + k_tet_3 * b_tet_3;
+  double cos2_theta_b = std::min(k_b_tet * k_b_tet / (k_sq_tet * b_sq_tet), 1.0);
+  double sin2_theta_b = 1.0 - cos2_theta_b;
+  double sin_theta_b = std::sqrt(sin2_theta_b);
+  double cos_theta_b = std::sqrt(cos2_theta_b) * (k_b_tet >= 0.0 ? 1.0 : -1.0);
+
+  // Calculate frequency-independent thermal Faraday factors
+  double kk_0 = 0.0;
+  double kk_1 = 0.0;
+  double kk_2 = 0.0;
+  if (plasma_thermal_frac != 0.0 and image_light and image_polarization
+      and theta_e >= theta_e_zero)
+  {
+    kk_0 = std::cyl_bessel_k(0.0, 1.0 / theta_e);
+    kk_1 = std::cyl_bessel_k(1.0, 1.0 / theta_e);
+    kk_2 = std::cyl_bessel_k(2.0, 1.0 / theta_e);
+  }
+
+  // Calculate frequency-independent kappa-distribution pitch-angle factors for tables
+  bool kappa_v_nonzero = false;
+  double jj_v_shift = 0.0;
+  double jj_v_offset = 0.0;
+  double aa_v_shift = 0.0;
+  double aa_v_offset = 0.0;
+  if (plasma_table and plasma_kappa_frac != 0.0 and image_light and image_polarization)
+  {
+    double var_a = std::pow(std::pow(sin_theta_b, -2.4) - 1.0, 0.48);
+    double var_b = std::pow(std::pow(sin_theta_b, -2.5) - 1.0, 0.44);
+    double var_c = std::pow(std::pow(sin_theta_b, -2.28) - 1.0, 0.446);
+    double var_d = std::sqrt(std::pow(sin_theta_b, -2.05) - 1.0);
+    kappa_v_nonzero = var_a > 0.0 and var_b > 0.0 and var_c > 0.0 and var_d > 0.0;
+    if (kappa_v_nonzero)
+    {
+      double slope_low = 1.0 / 3.0 - 0.35;
+      double slope_high = -(plasma_kappa - 2.0) / 2.0 - 0.5;
+      jj_v_shift = std::log(var_b / var_a) / (slope_high - slope_low);
+      jj_v_offset = std::log(var_a) - slope_low * jj_v_shift;
+      slope_low = -2.0 / 3.0 - 0.35;
+      slope_high = -(1.0 + plasma_kappa) / 2.0 - 0.5;
+      aa_v_shift = std::log(var_d / var_c) / (slope_high - slope_low);
+      aa_v_offset = std::log(var_c) - slope_low * aa_v_shift;
+    }
+  }
+
+  // Go through frequencies
+  for (int l = 0; l < image_num_frequencies; l++)
+  {
+    // Calculate orthonormal-frame frequencies
+    double nu_cgs = 0.0;
+    for (int mu = 0; mu < 4; mu++)
+      nu_cgs -= kcov[mu] * ucon[mu];
+    nu_cgs *= image_frequencies(l) * momentum_factors[adaptive_level](m);
+    double nu_2_cgs = nu_cgs * nu_cgs;
+    double nu_c_cgs = Physics::e * bb_cgs / (2.0 * Math::pi * Physics::m_e * Physics::c);
+    double nu_s_cgs = 2.0 / 9.0 * nu_c_cgs * theta_e * theta_e * sin_theta_b;
+
+    // Calculate thermal synchrotron emissivities (M 28,30)
+    double j_i_val;
+    if (plasma_thermal_frac != 0.0)
+    {
+      double xx = nu_cgs / nu_s_cgs;
+      double xx_1_2 = std::sqrt(xx);
+      double xx_1_3 = std::cbrt(xx);
+      double xx_1_6 = std::sqrt(xx_1_3);
+      double coefficient = plasma_thermal_frac * n_e_cgs * Physics::e * Physics::e * nu_c_cgs
+          / (Physics::c * nu_2_cgs) * std::exp(-xx_1_3);
+      double var_a = Math::sqrt2 * Math::pi / 27.0 * sin_theta_b;
+      double var_b = std::pow(2.0, 11.0 / 12.0);
+      double var_c = xx_1_2 + var_b * xx_1_6;
+      j_i_val = coefficient * var_a * var_c * var_c;
+      if (image_light or image_emission or image_emission_ave)
+        j_i[adaptive_level](r,l) = j_i_val;
+      if (image_light and image_polarization)
+      {
+        double var_d = (7.0 * std::pow(theta_e, 0.96) + 35.0)
+            / (10.0 * std::pow(theta_e, 0.96) + 75.0) * var_b;
+        double var_e = xx_1_2 + var_d * xx_1_6;
+        double var_f = cos_theta_b / theta_e;
+        double var_g = Math::pi / 3.0 + Math::pi / 3.0 * xx_1_3 + 2.0 / 300.0 * xx_1_2
+            + 2.0 / 19.0 * Math::pi * xx_1_3 * xx_1_3;
+        j_q[adaptive_level](r,l) = -coefficient * var_a * var_e * var_e;
+        j_v[adaptive_level](r,l) = coefficient * var_f * var_g;
+      }
+    }
+
+    // Calculate thermal synchrotron absorptivities from Kirchoff's law (M 31)
+    if (plasma_thermal_frac != 0.0)
+    {
+      // Calculate absorptivities
+      double b_nu_nu_3_cgs = 2.0 * Physics::h / (Physics::c * Physics::c)
+          / std::expm1(Physics::h * nu_cgs / kb_tt_e_cgs);
+      if (image_light or image_tau or image_tau_int)
+        alpha_i[adaptive_level](r,l) = j_i_val / b_nu_nu_3_cgs;
+      if (image_light and image_polarization)
+      {
+        alpha_q[adaptive_level](r,l) = j_q[adaptive_level](r,l) / b_nu_nu_3_cgs;
+        alpha_v[adaptive_level](r,l) = j_v[adaptive_level](r,l) / b_nu_nu_3_cgs;
+      }
+
+      // Account for numerical issues later arising from absorptivities being too small
+      if ((image_light or image_tau or image_tau_int)
+          and 1.0 / (alpha_i[adaptive_level](r,l) * alpha_i[adaptive_level](r,l))
+          == std::numeric_limits<double>::infinity())
+      {
+        alpha_i[adaptive_level](r,l) = 0.0;
+        if (image_light and image_polarization)
+        {
+          alpha_q[adaptive_level](r,l) = 0.0;
+          alpha_v[adaptive_level](r,l) = 0.0;
+        }
+      }
+    }
+
+    // Calculate thermal synchrotron rotativities (M 33-37)
+    if (plasma_thermal_frac != 0.0 and image_light and image_polarization)
+    {
+      double coefficient_q = -plasma_thermal_frac * n_e_cgs * Physics::e * Physics::e
+          * nu_c_cgs * nu_c_cgs * sin2_theta_b / (Physics::m_e * Physics::c * nu_2_cgs);
+      double coefficient_v = plasma_thermal_frac * 2.0 * n_e_cgs * Physics::e * Physics::e
+          * nu_c_cgs * cos_theta_b / (Physics::m_e * Physics::c * nu_cgs);
+      double factor_q = 0.0;
+      double factor_v = 1.0;
+      if (theta_e >= theta_e_zero)
+      {
+        double xx = nu_cgs / nu_s_cgs;
+        double f_m;
+        double delta_jj_5;
+        if (plasma_table)
+        {
+          double u = std::log(xx);
+          f_m = PlasmaTableValue(plasma_table_thermal_rho_q, u);
+          delta_jj_5 = PlasmaTableValue(plasma_table_thermal_rho_v, u);
+        }
+        else
+        {
+          double xx_neg_1_2 = 1.0 / std::sqrt(xx);
+          double var_a = 2.011 * std::exp(-19.78 * std::pow(xx, -0.5175));
+          double var_b = std::cos(39.89 * xx_neg_1_2) * std::exp(-70.16 * std::pow(xx, -0.6));
+          double var_c = 0.011 * std::exp(-1.69 * xx_neg_1_2);
+          double var_d = 0.003135 * std::pow(xx, 4.0 / 3.0);
+          double var_e = 0.5 * (1.0 + std::tanh(10.0 * std::log(0.6648 * xx_neg_1_2)));
+          double f_0 = var_a - var_b - var_c;
+          f_m = f_0 + (var_c - var_d) * var_e;
+          delta_jj_5 = 0.4379 * std::log(1.0 + 1.3414 * std::pow(xx, -0.7515));
         }
+        factor_q = f_m * (kk_1 / kk_2 + 6.0 * theta_e);
+        factor_v = (kk_0 - delta_jj_5) / kk_2;
+        factor_v = factor_v < 0.0 or factor_v > 1.0 ? 1.0 : factor_v;
+      }
+      rho_q[adaptive_level](r,l) = coefficient_q * factor_q;
+      rho_v[adaptive_level](r,l) = coefficient_v * factor_v;
+    }
+
+    // Calculate power-law synchrotron emissivities (M 28,38)
+    if (plasma_power_frac != 0.0 and (image_light or image_emission or image_emission_ave))
+    {
+      double var_a = std::pow(nu_cgs / (nu_c_cgs * sin_theta_b), -(plasma_p - 1.0) / 2.0);
+      double coefficient = plasma_power_frac * n_e_cgs * Physics::e * Physics::e * nu_c_cgs
+          / (Physics::c * nu_2_cgs) * power_jj * sin_theta_b * var_a;
+      j_i[adaptive_level](r,l) += coefficient;
+      if (image_light and image_polarization)
+      {
+        double var_b = cos_theta_b / sin_theta_b;
+        double var_c = 1.0 / std::sqrt(nu_cgs / (3.0 * nu_c_cgs * sin_theta_b));
+        j_q[adaptive_level](r,l) += coefficient * power_jj_q;
+        j_v[adaptive_level](r,l) += coefficient * power_jj_v * var_b * var_c;
+      }
+    }
+
+    // Calculate power-law synchrotron absorptivities (M 29,39)
+    if (plasma_power_frac != 0.0 and (image_light or image_tau or image_tau_int))
+    {
+      double var_a = std::pow(nu_cgs / (nu_c_cgs * sin_theta_b), -(plasma_p + 2.0) / 2.0);
+      double coefficient = plasma_power_frac * n_e_cgs * Physics::e * Physics::e
+          / (Physics::m_e * Physics::c) * power_aa * var_a;
+      alpha_i[adaptive_level](r,l) += coefficient;
+      if (image_light and image_polarization)
+      {
+        double var_b = std::pow(3.1 * std::pow(sin_theta_b, -1.92) - 3.1, 0.512);
+        double var_c = 1.0 / std::sqrt(nu_cgs / (nu_c_cgs * sin_theta_b));
+        double var_d = cos_theta_b >= 0.0 ? 1.0 : -1.0;
+        alpha_q[adaptive_level](r,l) += coefficient * power_aa_q;
+        alpha_v[adaptive_level](r,l) += coefficient * power_aa_v * var_b * var_c * var_d;
+      }
+    }
+
+    // Calculate power-law synchrotron rotativities (M 40-42)
+    if (plasma_power_frac != 0.0 and image_light and image_polarization)
+    {
+      double var_a = n_e_cgs * Physics::e * Physics::e * nu_cgs
+          / (Physics::m_e * Physics::c * nu_c_cgs * sin_theta_b);
+      double var_b = nu_c_cgs * sin_theta_b / nu_cgs;
+      double var_c = var_b * var_b;
+      double var_d = var_c * var_b;
+      double var_e = 1.0 - std::pow(2.0 * nu_c_cgs * plasma_gamma_min * plasma_gamma_min
+          * sin_theta_b / (3.0 * nu_cgs), plasma_p / 2.0 - 1.0);
+      double var_f = cos_theta_b / sin_theta_b;
+      double coefficient = plasma_power_frac * power_rho * var_a;
+      rho_q[adaptive_level](r,l) += coefficient * power_rho_q * var_d * var_e;
+      rho_v[adaptive_level](r,l) += coefficient * power_rho_v * var_c * var_f;
+    }
+
+    // Calculate kappa-distribution synchrotron emissivities (M 28,43-46)
+    if (plasma_kappa_frac != 0.0 and (image_light or image_emission or image_emission_ave))
+    {
+      double nu_kappa_cgs =
+          nu_c_cgs * plasma_w * plasma_w * plasma_kappa * plasma_kappa * sin_theta_b;
+      double xx = nu_cgs / nu_kappa_cgs;
+      double var_a = plasma_kappa_frac * n_e_cgs * Physics::e * Physics::e * nu_c_cgs
+          / (Physics::c * nu_2_cgs);
+      if (plasma_table)
+      {
+        double u = std::log(xx);
+        double coefficient = var_a * sin_theta_b;
+        j_i[adaptive_level](r,l) +=
+            coefficient * std::exp(PlasmaTableValue(plasma_table_kappa_jj_i, u));
+        if (image_light and image_polarization)
+        {
+          double var_h = cos_theta_b >= 0.0 ? 1.0 : -1.0;
+          j_q[adaptive_level](r,l) -=
+              coefficient * std::exp(PlasmaTableValue(plasma_table_kappa_jj_q, u));
+          if (kappa_v_nonzero)
+            j_v[adaptive_level](r,l) += coefficient * std::exp(jj_v_offset
+                + PlasmaTableValue(plasma_table_kappa_jj_v, u + jj_v_shift)) * var_h;
+        }
+      }
+      else
+      {
+        double var_b = std::cbrt(xx) * sin_theta_b;
+        double var_c = std::pow(xx, -(plasma_kappa - 2.0) / 2.0) * sin_theta_b;
+        double coefficient_low = kappa_jj_low * var_a * var_b;
+        double coefficient_high = kappa_jj_high * var_a * var_c;
+        j_i[adaptive_level](r,l) += std::pow(std::pow(coefficient_low, -kappa_jj_x_i)
+            + std::pow(coefficient_high, -kappa_jj_x_i), -1.0 / kappa_jj_x_i);
+        if (image_light and image_polarization)
+        {
+          double var_d = std::pow(std::pow(sin_theta_b, -2.4) - 1.0, 0.48);
+          double var_e = std::pow(xx, -0.35);
+          double var_f = std::pow(std::pow(sin_theta_b, -2.5) - 1.0, 0.44);
+          double var_g = 1.0 / std::sqrt(xx);
+          double var_h = cos_theta_b >= 0.0 ? 1.0 : -1.0;
+          double jj_q_low = coefficient_low * kappa_jj_low_q;
+          double jj_v_low = coefficient_low * kappa_jj_low_v * var_d * var_e;
+          double jj_q_high = coefficient_high * kappa_jj_high_q;
+          double jj_v_high = coefficient_high * kappa_jj_high_v * var_f * var_g;
+          j_q[adaptive_level](r,l) -= std::pow(std::pow(jj_q_low, -kappa_jj_x_q)
+              + std::pow(jj_q_high, -kappa_jj_x_q), -1.0 / kappa_jj_x_q);
+          j_v[adaptive_level](r,l) += std::pow(std::pow(jj_v_low, -kappa_jj_x_v)
+              + std::pow(jj_v_high, -kappa_jj_x_v), -1.0 / kappa_jj_x_v) * var_h;
+        }
+      }
+    }
+
+    // Calculate kappa-distribution synchrotron absoptivities (M 29,47-50)
+    if (plasma_kappa_frac != 0.0 and (image_light or image_tau or image_tau_int))
+    {
+      double nu_kappa_cgs =
+          nu_c_cgs * plasma_w * plasma_w * plasma_kappa * plasma_kappa * sin_theta_b;
+      double xx = nu_cgs / nu_kappa_cgs;
+      double var_a =
+          plasma_kappa_frac * n_e_cgs * Physics::e * Physics::e / (Physics::m_e * Physics::c);
+      if (plasma_table)
+      {
+        double u = std::log(xx);
+        alpha_i[adaptive_level](r,l) +=
+            var_a * std::exp(PlasmaTableValue(plasma_table_kappa_aa_i, u));
+        if (image_light and image_polarization)
+        {
+          double var_h = cos_theta_b >= 0.0 ? 1.0 : -1.0;
+          alpha_q[adaptive_level](r,l) -=
+              var_a * std::exp(PlasmaTableValue(plasma_table_kappa_aa_q, u));
+          if (kappa_v_nonzero)
+            alpha_v[adaptive_level](r,l) += var_a * std::exp(aa_v_offset
+                + PlasmaTableValue(plasma_table_kappa_aa_v, u + aa_v_shift)) * var_h;
+        }
+      }
+      else
+      {
+        double var_b = std::pow(xx, -2.0 / 3.0);
+        double var_c = std::pow(xx, -(1.0 + plasma_kappa) / 2.0);
+        double coefficient_low = kappa_aa_low * var_a * var_b;
+        double coefficient_high = kappa_aa_high * var_a * var_c;
+        double aa_i_low = coefficient_low;
+        double aa_i_high = coefficient_high * kappa_aa_high_i;
+        alpha_i[adaptive_level](r,l) += std::pow(std::pow(aa_i_low, -kappa_aa_x_i)
+            + std::pow(aa_i_high, -kappa_aa_x_i), -1.0 / kappa_aa_x_i);
+        if (image_light and image_polarization)
+        {
+          double var_d = std::pow(std::pow(sin_theta_b, -2.28) - 1.0, 0.446);
+          double var_e = std::pow(xx, -0.35);
+          double var_f = std::sqrt(std::pow(sin_theta_b, -2.05) - 1.0);
+          double var_g = 1.0 / std::sqrt(xx);
+          double var_h = cos_theta_b >= 0.0 ? 1.0 : -1.0;
+          double aa_q_low = coefficient_low * kappa_aa_low_q;
+          double aa_v_low = coefficient_low * kappa_aa_low_v * var_d * var_e;
+          double aa_q_high = coefficient_high * kappa_aa_high_q;
+          double aa_v_high = coefficient_high * kappa_aa_high_v * var_f * var_g;
+          alpha_q[adaptive_level](r,l) -= std::pow(std::pow(aa_q_low, -kappa_aa_x_q)
+              + std::pow(aa_q_high, -kappa_aa_x_q), -1.0 / kappa_aa_x_q);
+          alpha_v[adaptive_level](r,l) += std::pow(std::pow(aa_v_low, -kappa_aa_x_v)
+              + std::pow(aa_v_high, -kappa_aa_x_v), -1.0 / kappa_aa_x_v) * var_h;
+        }
+      }
+    }
+
+    // Calculate kappa-distribution synchrotron rotativities (M 51-54)
+    if (plasma_kappa_frac != 0.0 and image_light and image_polarization)
+    {
+      double nu_kappa_cgs =
+          nu_c_cgs * plasma_w * plasma_w * plasma_kappa * plasma_kappa * sin_theta_b;
+      double xx = nu_cgs / nu_kappa_cgs;
+      double var_a = -plasma_kappa_frac * n_e_cgs * Physics::e * Physics::e * nu_c_cgs
+          * nu_c_cgs * sin2_theta_b / (Physics::m_e * Physics::c * nu_2_cgs);
+      double var_b = plasma_kappa_frac * 2.0 * n_e_cgs * Physics::e * Physics::e * nu_c_cgs
+          * cos_theta_b / (Physics::m_e * Physics::c * nu_cgs);
+      if (plasma_table)
+      {
+        double u = std::log(xx);
+        rho_q[adaptive_level](r,l) += var_a * PlasmaTableValue(plasma_table_kappa_rho_q, u);
+        rho_v[adaptive_level](r,l) +=
+            kappa_rho_v * var_b * PlasmaTableValue(plasma_table_kappa_rho_v, u);
+      }
+      else
+      {
+        double var_c = 1.0 / std::sqrt(xx);
+        double rho_q_low = var_a * kappa_rho_q_low_a * (1.0 - std::exp(kappa_rho_q_low_b
+            * std::pow(xx, 0.84)) - std::sin(kappa_rho_q_low_c * xx)
+            * std::exp(kappa_rho_q_low_d * std::pow(xx, kappa_rho_q_low_e)));
+        double rho_q_high = var_a * kappa_rho_q_high_a * (1.0 - std::exp(kappa_rho_q_high_b
+            * std::pow(xx, 0.84)) - std::sin(kappa_rho_q_high_c * xx)
+            * std::exp(kappa_rho_q_high_d * std::pow(xx, kappa_rho_q_high_e)));
+        double rho_v_low = kappa_rho_v * var_b * kappa_rho_v_low_a
+            * (1.0 - 0.17 * std::log(1.0 + kappa_rho_v_low_b * var_c));
+        double rho_v_high = kappa_rho_v * var_b * kappa_rho_v_high_a
+            * (1.0 - 0.17 * std::log(1.0 + kappa_rho_v_high_b * var_c));
+        rho_q[adaptive_level](r,l) +=
+            (1.0 - kappa_rho_frac) * rho_q_low + kappa_rho_frac * rho_q_high;
+        rho_v[adaptive_level](r,l) +=
+            (1.0 - kappa_rho_frac) * rho_v_low + kappa_rho_frac * rho_v_high;
       }
     }
   }
+  return;
+}
 
-  // Free memory
-  if (adaptive_level > 0)
+//--------------------------------------------------------------------------------------------------
+
+// Function for caching geometric quantities used in calculating transfer coefficients
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes sample_num[0], sample_pos[0], sample_dir[0], sample_status[0], and sample_offsets[0]
+//       have been set.
+//   Allocates and initializes sample_geom, holding for each non-cut sample at the root level a
+//       record of the simulation metric, simulation lapse and shift, Jacobian, geodesic metric
+//       (covariant and contravariant), and contravariant momentum, located via sample_geom_*.
+//   Values are calculated exactly as in CalculateSimulationCoefficientsPoint(), so that results
+//       do not depend on whether the cache is used.
+void RadiationIntegrator::CalculateSampleGeometry()
+{
+  // Allocate array
+  int num_pix = camera_num_pix;
+  sample_geom.Allocate(NumSampleRecords(), sample_geom_num);
+
+  // Go through samples in parallel
+  #pragma omp parallel for schedule(runtime)
+  for (int m = 0; m < num_pix; m++)
   {
-    sample_cut[adaptive_level].Deallocate();
-    sample_rho[adaptive_level].Deallocate();
-    sample_pgas[adaptive_level].Deallocate();
-    sample_kappa[adaptive_level].Deallocate();
-    if (image_light and not image_polarization)
+    int num_steps = sample_num[0](m);
+    int s_next = sample_offsets[0](m);
+    for (int n = 0; n < num_steps; n++)
     {
-      sample_uu1[adaptive_level].Deallocate();
-      sample_uu2[adaptive_level].Deallocate();
-      sample_uu3[adaptive_level].Deallocate();
-      sample_bb1[adaptive_level].Deallocate();
-      sample_bb2[adaptive_level].Deallocate();
-      sample_bb3[adaptive_level].Deallocate();
+      // Locate record
+      if (not SampleKept(m, n))
+        continue;
+      double *geom = &sample_geom(s_next++,0);
+
+      // Extract geodesic position and covariant momentum
+      double x1 = SamplePosition(m,n,1);
+      double x2 = SamplePosition(m,n,2);
+      double x3 = SamplePosition(m,n,3);
+      double kcov[4];
+      kcov[0] = SampleDirection(m,n,0);
+      kcov[1] = SampleDirection(m,n,1);
+      kcov[2] = SampleDirection(m,n,2);
+      kcov[3] = SampleDirection(m,n,3);
+
+      // Calculate simulation metric, lapse, and shift
+      double gcov_sim[4][4];
+      double gcon_sim[4][4];
+      CovariantSimulationMetric(x1, x2, x3, gcov_sim);
+      ContravariantSimulationMetric(x1, x2, x3, gcon_sim);
+      geom[sample_geom_lapse_shift_sim] = 1.0 / std::sqrt(-gcon_sim[0][0]);
+      geom[sample_geom_lapse_shift_sim+1] = -gcon_sim[0][1] / gcon_sim[0][0];
+      geom[sample_geom_lapse_shift_sim+2] = -gcon_sim[0][2] / gcon_sim[0][0];
+      geom[sample_geom_lapse_shift_sim+3] = -gcon_sim[0][3] / gcon_sim[0][0];
+
+      // Calculate Jacobian and geodesic metric
+      double jacobian[4][4];
+      double gcov[4][4];
+      double gcon[4][4];
+      CoordinateJacobian(x1, x2, x3, jacobian);
+      CovariantGeodesicMetric(x1, x2, x3, gcov);
+      ContravariantGeodesicMetric(x1, x2, x3, gcon);
+
+      // Calculate geodesic contravariant momentum
+      double kcon[4] = {};
+      for (int mu = 0; mu < 4; mu++)
+        for (int nu = 0; nu < 4; nu++)
+          kcon[mu] += gcon[mu][nu] * kcov[nu];
+
+      // Store values
+      for (int mu = 0; mu < 4; mu++)
+      {
+        for (int nu = 0; nu < 4; nu++)
+        {
+          geom[sample_geom_gcov_sim+4*mu+nu] = gcov_sim[mu][nu];
+          geom[sample_geom_jacobian+4*mu+nu] = jacobian[mu][nu];
+          geom[sample_geom_gcov+4*mu+nu] = gcov[mu][nu];
+          geom[sample_geom_gcon+4*mu+nu] = gcon[mu][nu];
+        }
+        geom[sample_geom_kcon+mu] = kcon[mu];
+      }
     }
   }
   return;
@@ -7,7 +7,7 @@
 #include <sstream>    // ostringstream
 
 // Library headers
-#include <omp.h>  // pragmas
+#include <omp.h>  // omp_get_wtime, pragmas
 
 // Blacklight headers
 #include "radiation_integrator.hpp"
@@ -15,6 +15,7 @@
 #include "../simulation_reader/simulation_reader.hpp"  // SimulationReader
 #include "../utils/array.hpp"                          // Array
 #include "../utils/exceptions.hpp"                     // BlacklightException, BlacklightWarning
+#include "../utils/profiler.hpp"                       // profiling functions
 
 //--------------------------------------------------------------------------------------------------
 
@@ -23,6 +24,7 @@
 // Outputs: (none)
 // Notes:
 //   Acquires values from SimulationReader that were not available at construction.
+//   Builds indices for locating blocks by position and by logical location.
 void RadiationIntegrator::ObtainGridData()
 {
   // Copy grid metadata
@@ -51,7 +53,10 @@ void RadiationIntegrator::ObtainGridData()
   time = p_simulation_reader->time;
 
   // Copy cell values
+  simulation_precision = p_simulation_reader->simulation_precision;
   grid_prim = p_simulation_reader->prim;
+  grid_compact = p_simulation_reader->prim_compact;
+  grid_scale = p_simulation_reader->prim_scale;
 
   // Copy indices
   ind_rho = p_simulation_reader->ind_rho;
@@ -91,6 +96,9 @@ void RadiationIntegrator::ObtainGridData()
     for (int level = 1; level <= max_level; level++)
       n_3_level(level) = n_3_level(level-1) * 2;
   }
+
+  // Prepare block lookups
+  BuildBlockIndex();
   return;
 }
 
@@ -103,10 +111,15 @@ void RadiationIntegrator::ObtainGridData()
 // Notes:
 //   Assumes geodesic_num_steps[adaptive_level], sample_flags[adaptive_level],
 //       sample_num[adaptive_level], and sample_pos[adaptive_level] have been set.
-//   Allocates and initializes sample_inds[adaptive_level], sample_nan[adaptive_level],
-//       sample_cut[adaptive_level], and sample_fallback[adaptive_level].
+//   Allocates and initializes sample_status[adaptive_level], sample_offsets[adaptive_level], and
+//       sample_inds[adaptive_level] if first_time == true or adaptive_level > 0.
 //   Allocates and initializes sample_fracs[adaptive_level] if simulation_interp == true or if
-//       slow_light_on == true and slow_interp == true.
+//       slow_light_on == true and slow_interp == true, on the same schedule.
+//   Flags cut samples first, so that sample_inds[adaptive_level] and sample_fracs[adaptive_level]
+//       hold records only for the remaining samples, located via sample_offsets[adaptive_level].
+//   Cuts depend only on geodesic positions, so flags and offsets are reused for later snapshots.
+//   Allocates and initializes sample_geom if simulation_geom_cache == true, first_time == true, and
+//       adaptive_level == 0.
 //   If simulation_interp == false, locates cell containing geodesic sample point.
 //   If simulation_interp == true and simulation_block_interp == false, prepares trilinear
 //       interpolation to geodesic sample point from cell centers, using only data within the same
@@ -114,19 +127,15 @@ void RadiationIntegrator::ObtainGridData()
 //   If simulation_interp == true and simulation_block_interp == true, prepares trilinear
 //       interpolation after obtaining anchor points possibly from neighboring blocks, even at
 //       different refinement levels, or across the periodic boundary in spherical coordinates.
-//   If slow_light_on == true, chooses from multiple available time slices for each point.
-//   If slow_light_on == true and slow_interp == true, prepares interpolation between adjacent (or
-//       sometimes identical) time slices.
+//   If slow_light_on == true, leaves choosing among available time slices to
+//       CalculateSampleTimes(), which it calls once the spatial sampling is complete.
 //   When the simulation uses Coordinates::fmks, indices and fractions are found via simple scaling
 //       for uniform grids with no bounds checking.
+//   Blocks are located with FindBlock() and cells within blocks with FindCellIndex().
 void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
 {
-  // Calculate time of snapshot
-  double snapshot_time = 0.0;
-  if (slow_light_on)
-    snapshot_time = slow_t_start + slow_dt * snapshot;
-
   // Allocate arrays
+  double time_start = omp_get_wtime();
   int num_pix = camera_num_pix;
   int num_interp_inds = 4;
   if (slow_light_on)
@@ -140,68 +149,10 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
     num_pix = block_counts[adaptive_level] * block_num_pix;
   if (first_time or adaptive_level > 0)
   {
-    if ((simulation_format == SimulationFormat::athena
-        or simulation_format == SimulationFormat::athenak) and simulation_interp
-        and simulation_block_interp)
-      sample_inds[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level], 8,
-          num_interp_inds);
-    else
-      sample_inds[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level],
-          num_interp_inds);
-    if (num_interp_fracs > 0)
-      sample_fracs[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level],
-          num_interp_fracs);
-    sample_nan[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
-    sample_cut[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
-    sample_fallback[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
-  }
-  sample_nan[adaptive_level].Zero();
-  sample_cut[adaptive_level].Zero();
-  sample_fallback[adaptive_level].Zero();
-
-  // Prepare bookkeeping for warnings and errors
-  int num_extrap_camera_small = 0;
-  int num_extrap_camera_large = 0;
-  int num_extrap_source_small = 0;
-  int num_extrap_source_large = 0;
-  double val_extrap_camera_small = 0.0;
-  double val_extrap_camera_large = 0.0;
-  double val_extrap_source_small = 0.0;
-  double val_extrap_source_large = 0.0;
-
-  // Work in parallel
-  #pragma omp parallel
-  {
-    // Prepare bookkeeping
-    int n_b = x1f.n2;
-    int n_i = x1v.n1;
-    int n_j = x2v.n1;
-    int n_k = x3v.n1;
-    int b = 0;
-    int i = 0;
-    int j = 0;
-    int k = 0;
-    double x1_min_block = x1f(b,0);
-    double x1_max_block = x1f(b,n_i);
-    double x2_min_block = x2f(b,0);
-    double x2_max_block = x2f(b,n_j);
-    double x3_min_block = x3f(b,0);
-    double x3_max_block = x3f(b,n_k);
-    if (simulation_coord == Coordinates::fmks)
-    {
-      x1_min_block = simulation_bounds(0);
-      x1_max_block = simulation_bounds(1);
-      x2_min_block = simulation_bounds(2);
-      x2_max_block = simulation_bounds(3);
-      x3_min_block = simulation_bounds(4);
-      x3_max_block = simulation_bounds(5);
-    }
-
-    // Resample cell data onto geodesics
-    #pragma omp for schedule(static) reduction(+: num_extrap_camera_small, \
-        num_extrap_camera_large, num_extrap_source_small, num_extrap_source_large) reduction(max: \
-        val_extrap_camera_small, val_extrap_camera_large, val_extrap_source_small, \
-        val_extrap_source_large)
+    // Flag cut samples
+    sample_status[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
+    sample_status[adaptive_level].Zero();
+    #pragma omp parallel for schedule(runtime)
     for (int m = 0; m < num_pix; m++)
     {
       // Extract number of steps along this geodesic
@@ -211,34 +162,23 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
       if (fallback_nan and sample_flags[adaptive_level](m))
       {
         for (int n = 0; n < num_steps; n++)
-          sample_nan[adaptive_level](m,n) = true;
+          sample_status[adaptive_level](m,n) = sample_status_nan;
         continue;
       }
 
-      // Prepare bookkeeping for extrapolation
-      bool extrap_camera_small = false;
-      bool extrap_camera_large = false;
-      bool extrap_source_small = false;
-      bool extrap_source_large = false;
-      double val_extrap_camera_small_local = 0.0;
-      double val_extrap_camera_large_local = 0.0;
-      double val_extrap_source_small_local = 0.0;
-      double val_extrap_source_large_local = 0.0;
-
       // Go along geodesic
       for (int n = 0; n < num_steps; n++)
       {
         // Extract coordinates
-        double x0 = sample_pos[adaptive_level](m,n,0) + snapshot_time;
-        double x1 = sample_pos[adaptive_level](m,n,1);
-        double x2 = sample_pos[adaptive_level](m,n,2);
-        double x3 = sample_pos[adaptive_level](m,n,3);
+        double x1 = SamplePosition(m,n,1);
+        double x2 = SamplePosition(m,n,2);
+        double x3 = SamplePosition(m,n,3);
 
         // Cut outside camera radius
         double r = RadialGeodesicCoordinate(x1, x2, x3);
         if (r > camera_r)
         {
-          sample_cut[adaptive_level](m,n) = true;
+          sample_status[adaptive_level](m,n) = sample_status_cut;
           continue;
         }
 
@@ -248,7 +188,7 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
           double dot_product = x1 * camera_x[1] + x2 * camera_x[2] + x3 * camera_x[3];
           if ((cut_omit_near and dot_product > 0.0) or (cut_omit_far and dot_product < 0.0))
           {
-            sample_cut[adaptive_level](m,n) = true;
+            sample_status[adaptive_level](m,n) = sample_status_cut;
             continue;
           }
         }
@@ -256,7 +196,7 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
         // Cut spheres
         if ((cut_omit_in >= 0.0 and r < cut_omit_in) or (cut_omit_out >= 0.0 and r > cut_omit_out))
         {
-          sample_cut[adaptive_level](m,n) = true;
+          sample_status[adaptive_level](m,n) = sample_status_cut;
           continue;
         }
 
@@ -267,14 +207,14 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
           if ((cut_midplane_theta > 0.0 and std::abs(th - Math::pi / 2.0) > cut_midplane_theta)
               or (cut_midplane_theta < 0.0 and std::abs(th - Math::pi / 2.0) < -cut_midplane_theta))
           {
-            sample_cut[adaptive_level](m,n) = true;
+            sample_status[adaptive_level](m,n) = sample_status_cut;
             continue;
           }
         }
         if ((cut_midplane_z > 0.0 and std::abs(x3) > cut_midplane_z)
             or (cut_midplane_z < 0.0 and std::abs(x3) < -cut_midplane_z))
         {
-          sample_cut[adaptive_level](m,n) = true;
+          sample_status[adaptive_level](m,n) = sample_status_cut;
           continue;
         }
 
@@ -286,111 +226,115 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
               + (x3 - cut_plane_origin_z) * cut_plane_normal_z;
           if (dot_product < 0.0)
           {
-            sample_cut[adaptive_level](m,n) = true;
+            sample_status[adaptive_level](m,n) = sample_status_cut;
             continue;
           }
         }
+      }
+    }
+
+    // Allocate compacted storage for remaining samples
+    CalculateSampleOffsets(num_pix);
+    int num_records = NumSampleRecords();
+    if ((simulation_format == SimulationFormat::athena
+        or simulation_format == SimulationFormat::athenak) and simulation_interp
+        and simulation_block_interp)
+      sample_inds[adaptive_level].Allocate(num_records, 8, num_interp_inds);
+    else
+      sample_inds[adaptive_level].Allocate(num_records, num_interp_inds);
+    if (num_interp_fracs > 0)
+      sample_fracs[adaptive_level].Allocate(num_records, num_interp_fracs);
+
+    // Cache geometry for reuse with all snapshots
+    if (simulation_geom_cache and adaptive_level == 0)
+      CalculateSampleGeometry();
+  }
+
+  // Work in parallel
+  #pragma omp parallel
+  {
+    // Prepare bookkeeping
+    int n_b = x1f.n2;
+    int n_i = x1v.n1;
+    int n_j = x2v.n1;
+    int n_k = x3v.n1;
+    int b = 0;
+    int i = 0;
+    int j = 0;
+    int k = 0;
+    double x1_min_block = x1f(b,0);
+    double x1_max_block = x1f(b,n_i);
+    double x2_min_block = x2f(b,0);
+    double x2_max_block = x2f(b,n_j);
+    double x3_min_block = x3f(b,0);
+    double x3_max_block = x3f(b,n_k);
+    if (simulation_coord == Coordinates::fmks)
+    {
+      x1_min_block = simulation_bounds(0);
+      x1_max_block = simulation_bounds(1);
+      x2_min_block = simulation_bounds(2);
+      x2_max_block = simulation_bounds(3);
+      x3_min_block = simulation_bounds(4);
+      x3_max_block = simulation_bounds(5);
+    }
+
+    // Resample cell data onto geodesics
+    ProfileCounts profile_counts;
+    double profile_time_start = omp_get_wtime();
+    #pragma omp for schedule(runtime) nowait
+    for (int m = 0; m < num_pix; m++)
+    {
+      // Extract number of steps along this geodesic
+      int num_steps = sample_num[adaptive_level](m);
+      profile_counts.samples += num_steps;
+
+      // Skip geodesics already set to NaN fallback values
+      if (fallback_nan and sample_flags[adaptive_level](m))
+        continue;
+
+      // Go along geodesic
+      int s_next = sample_offsets[adaptive_level](m);
+      for (int n = 0; n < num_steps; n++)
+      {
+        // Skip cut samples
+        if (sample_status[adaptive_level](m,n) & sample_status_cut)
+          continue;
+        int s = s_next++;
+        sample_status[adaptive_level](m,n) = 0;
+
+        // Extract coordinates
+        double x1 = SamplePosition(m,n,1);
+        double x2 = SamplePosition(m,n,2);
+        double x3 = SamplePosition(m,n,3);
 
         // Convert coordinates
         ConvertFromCKS(&x1, &x2, &x3);
 
-        // Calculate time interpolation
-        int t_ind = 0;
-        double t_frac = 0.0;
-        if (slow_light_on)
-        {
-          if (x0 >= time[0])
-          {
-            if (x0 > time[0] + extrapolation_tolerance)
-            {
-              extrap_camera_large = true;
-              val_extrap_camera_large_local = std::max(val_extrap_camera_large_local, x0 - time[0]);
-            }
-            else if (x0 > time[0])
-            {
-              extrap_camera_small = true;
-              val_extrap_camera_small_local = std::max(val_extrap_camera_small_local, x0 - time[0]);
-            }
-          }
-          else if (x0 <= time[slow_chunk_size-1])
-          {
-            if (x0 < time[slow_chunk_size-1] - extrapolation_tolerance)
-            {
-              extrap_source_large = true;
-              val_extrap_source_large_local =
-                  std::max(val_extrap_source_large_local, time[slow_chunk_size-1] - x0);
-            }
-            else if (x0 < time[slow_chunk_size-1])
-            {
-              extrap_source_small = true;
-              val_extrap_source_small_local =
-                  std::max(val_extrap_source_small_local, time[slow_chunk_size-1] - x0);
-            }
-            if (slow_interp)
-            {
-              t_ind = slow_chunk_size - 2;
-              t_frac = 1.0;
-            }
-            else
-              t_ind = slow_chunk_size - 1;
-          }
-          else
-          {
-            while (time[t_ind++] > x0);
-            t_ind--;
-            if (slow_interp)
-            {
-              t_ind--;
-              t_frac = (x0 - time[t_ind]) / (time[t_ind+1] - time[t_ind]);
-            }
-            else if (time[t_ind-1] - x0 <= x0 - time[t_ind])
-              t_ind--;
-          }
-        }
-
         // Determine block
         if (x1 < x1_min_block or x1 > x1_max_block or x2 < x2_min_block or x2 > x2_max_block
             or x3 < x3_min_block or x3 > x3_max_block)
         {
-          // Check if block contains position
-          int b_new;
-          double x1_min_temp = x1_min_block;
-          double x1_max_temp = x1_max_block;
-          double x2_min_temp = x2_min_block;
-          double x2_max_temp = x2_max_block;
-          double x3_min_temp = x3_min_block;
-          double x3_max_temp = x3_max_block;
-          for (b_new = 0; b_new < n_b; b_new++)
-          {
-            x1_min_temp = x1f(b_new,0);
-            x1_max_temp = x1f(b_new,n_i);
-            x2_min_temp = x2f(b_new,0);
-            x2_max_temp = x2f(b_new,n_j);
-            x3_min_temp = x3f(b_new,0);
-            x3_max_temp = x3f(b_new,n_k);
-            if (x1 >= x1_min_temp and x1 <= x1_max_temp and x2 >= x2_min_temp and x2 <= x2_max_temp
-                and x3 >= x3_min_temp and x3 <= x3_max_temp)
-              break;
-          }
+          // Find block containing position
+          int b_new = FindBlock(x1, x2, x3);
 
           // Set fallback values if off grid
           if (b_new == n_b)
           {
             if (fallback_nan)
-              sample_nan[adaptive_level](m,n) = true;
+              sample_status[adaptive_level](m,n) = sample_status_nan;
             else
-              sample_fallback[adaptive_level](m,n) = true;
+              sample_status[adaptive_level](m,n) = sample_status_fallback;
             continue;
           }
 
           // Set newly found block as one to search
           b = b_new;
-          x1_min_block = x1_min_temp;
-          x1_max_block = x1_max_temp;
-          x2_min_block = x2_min_temp;
-          x2_max_block = x2_max_temp;
-          x3_min_block = x3_min_temp;
-          x3_max_block = x3_max_temp;
+          x1_min_block = x1f(b,0);
+          x1_max_block = x1f(b,n_i);
+          x2_min_block = x2f(b,0);
+          x2_max_block = x2f(b,n_j);
+          x3_min_block = x3f(b,0);
+          x3_max_block = x3f(b,n_k);
         }
 
         // Prepare to sample values in FMKS case
@@ -415,39 +359,29 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
           int j_m = static_cast<int>(j_ind);
 
           // Calculate phi coordinate as usual
-          for (k = 0; k < n_k; k++)
-            if (x3f(b,k+1) >= x3)
-              break;
+          k = FindCellIndex(x3f, b, n_k, x3);
           int k_m = k == 0 or (k != n_k - 1 and x3 >= x3v(b,k)) ? k : k - 1;
           double f_k = (x3 - x3v(b,k_m)) / (x3v(b,k_m+1) - x3v(b,k_m));
 
           // Prepare to sample values without interpolation
           if (not simulation_interp)
           {
-            sample_inds[adaptive_level](m,n,0) = b;
-            sample_inds[adaptive_level](m,n,1) = k;
-            sample_inds[adaptive_level](m,n,2) = f_j >= 0.5 ? j_m + 1 : j_m;
-            sample_inds[adaptive_level](m,n,3) = f_i >= 0.5 ? i_m + 1 : i_m;
-            if (slow_light_on)
-              sample_inds[adaptive_level](m,n,4) = t_ind;
-            if (slow_light_on and slow_interp)
-              sample_fracs[adaptive_level](m,n,0) = t_frac;
+            sample_inds[adaptive_level](s,0) = b;
+            sample_inds[adaptive_level](s,1) = k;
+            sample_inds[adaptive_level](s,2) = f_j >= 0.5 ? j_m + 1 : j_m;
+            sample_inds[adaptive_level](s,3) = f_i >= 0.5 ? i_m + 1 : i_m;
           }
 
           // Prepare to sample values with interpolation
           else
           {
-            sample_inds[adaptive_level](m,n,0) = b;
-            sample_inds[adaptive_level](m,n,1) = k_m;
-            sample_inds[adaptive_level](m,n,2) = j_m;
-            sample_inds[adaptive_level](m,n,3) = i_m;
-            if (slow_light_on)
-              sample_inds[adaptive_level](m,n,4) = t_ind;
-            sample_fracs[adaptive_level](m,n,0) = f_k;
-            sample_fracs[adaptive_level](m,n,1) = f_j;
-            sample_fracs[adaptive_level](m,n,2) = f_i;
-            if (slow_light_on and slow_interp)
-              sample_fracs[adaptive_level](m,n,3) = t_frac;
+            sample_inds[adaptive_level](s,0) = b;
+            sample_inds[adaptive_level](s,1) = k_m;
+            sample_inds[adaptive_level](s,2) = j_m;
+            sample_inds[adaptive_level](s,3) = i_m;
+            sample_fracs[adaptive_level](s,0) = f_k;
+            sample_fracs[adaptive_level](s,1) = f_j;
+            sample_fracs[adaptive_level](s,2) = f_i;
           }
         }
 
@@ -455,27 +389,17 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
         else
         {
           // Determine cell
-          for (i = 0; i < n_i; i++)
-            if (x1f(b,i+1) >= x1)
-              break;
-          for (j = 0; j < n_j; j++)
-            if (x2f(b,j+1) >= x2)
-              break;
-          for (k = 0; k < n_k; k++)
-            if (x3f(b,k+1) >= x3)
-              break;
+          i = FindCellIndex(x1f, b, n_i, x1);
+          j = FindCellIndex(x2f, b, n_j, x2);
+          k = FindCellIndex(x3f, b, n_k, x3);
 
           // Prepare to sample values without interpolation
           if (not simulation_interp)
           {
-            sample_inds[adaptive_level](m,n,0) = b;
-            sample_inds[adaptive_level](m,n,1) = k;
-            sample_inds[adaptive_level](m,n,2) = j;
-            sample_inds[adaptive_level](m,n,3) = i;
-            if (slow_light_on)
-              sample_inds[adaptive_level](m,n,4) = t_ind;
-            if (slow_light_on and slow_interp)
-              sample_fracs[adaptive_level](m,n,0) = t_frac;
+            sample_inds[adaptive_level](s,0) = b;
+            sample_inds[adaptive_level](s,1) = k;
+            sample_inds[adaptive_level](s,2) = j;
+            sample_inds[adaptive_level](s,3) = i;
           }
 
           // Prepare to sample values with intrablock interpolation
@@ -488,17 +412,13 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
             double f_i = (x1 - x1v(b,i_m)) / (x1v(b,i_m+1) - x1v(b,i_m));
             double f_j = (x2 - x2v(b,j_m)) / (x2v(b,j_m+1) - x2v(b,j_m));
             double f_k = (x3 - x3v(b,k_m)) / (x3v(b,k_m+1) - x3v(b,k_m));
-            sample_inds[adaptive_level](m,n,0) = b;
-            sample_inds[adaptive_level](m,n,1) = k_m;
-            sample_inds[adaptive_level](m,n,2) = j_m;
-            sample_inds[adaptive_level](m,n,3) = i_m;
-            if (slow_light_on)
-              sample_inds[adaptive_level](m,n,4) = t_ind;
-            sample_fracs[adaptive_level](m,n,0) = f_k;
-            sample_fracs[adaptive_level](m,n,1) = f_j;
-            sample_fracs[adaptive_level](m,n,2) = f_i;
-            if (slow_light_on and slow_interp)
-              sample_fracs[adaptive_level](m,n,3) = t_frac;
+            sample_inds[adaptive_level](s,0) = b;
+            sample_inds[adaptive_level](s,1) = k_m;
+            sample_inds[adaptive_level](s,2) = j_m;
+            sample_inds[adaptive_level](s,3) = i_m;
+            sample_fracs[adaptive_level](s,0) = f_k;
+            sample_fracs[adaptive_level](s,1) = f_j;
+            sample_fracs[adaptive_level](s,2) = f_i;
           }
 
           // Prepare to sample values with interblock interpolation
@@ -536,42 +456,183 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
 
             // Store results
             for (int p = 0; p < 8; p++)
-            {
               for (int q = 0; q < 4; q++)
-                sample_inds[adaptive_level](m,n,p,q) = inds[p][q];
-              if (slow_light_on)
-                sample_inds[adaptive_level](m,n,p,4) = t_ind;
-            }
-            sample_fracs[adaptive_level](m,n,0) = f_k;
-            sample_fracs[adaptive_level](m,n,1) = f_j;
-            sample_fracs[adaptive_level](m,n,2) = f_i;
-            if (slow_light_on and slow_interp)
-              sample_fracs[adaptive_level](m,n,3) = t_frac;
+                sample_inds[adaptive_level](s,p,q) = inds[p][q];
+            sample_fracs[adaptive_level](s,0) = f_k;
+            sample_fracs[adaptive_level](s,1) = f_j;
+            sample_fracs[adaptive_level](s,2) = f_i;
           }
         }
       }
+    }
+    ProfileRecordThread("CalculateSimulationSampling", ProfileSnapshot(), adaptive_level,
+        profile_time_start, omp_get_wtime(), profile_counts);
+  }
+  ProfileRecord("CalculateSimulationSampling", snapshot, adaptive_level, time_start,
+      omp_get_wtime(), ProfileCounts());
 
-      // Add to accounting of warnings and errors
-      if (extrap_camera_small)
-      {
-        num_extrap_camera_small++;
-        val_extrap_camera_small = std::max(val_extrap_camera_small, val_extrap_camera_small_local);
-      }
-      if (extrap_camera_large)
+  // Choose time slices
+  if (slow_light_on)
+    CalculateSampleTimes(snapshot);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for determining which time slices to sample onto rays.
+// Inputs:
+//   snapshot: index (starting at 0) of which snapshot is about to be processed
+// Outputs: (none)
+// Notes:
+//   Assumes slow_light_on == true.
+//   Assumes sample_status[adaptive_level] and sample_offsets[adaptive_level], as well as the
+//       spatial parts of sample_inds[adaptive_level] and sample_fracs[adaptive_level], have been
+//       set by CalculateSimulationSampling().
+//   Sets the time index in sample_inds[adaptive_level] and, if slow_interp == true, the time
+//       fraction in sample_fracs[adaptive_level], relative to the current window of time slices.
+//   Only the time coordinate of each sample changes from one snapshot to the next, so this is the
+//       only part of sampling redone for later snapshots at the root level.
+void RadiationIntegrator::CalculateSampleTimes(int snapshot)
+{
+  // Calculate time of snapshot
+  double time_start = omp_get_wtime();
+  double snapshot_time = slow_t_start + slow_dt * snapshot;
+
+  // Prepare layout of records
+  int num_pix = camera_num_pix;
+  if (adaptive_level > 0)
+    num_pix = block_counts[adaptive_level] * block_num_pix;
+  bool anchors_stored = (simulation_format == SimulationFormat::athena
+      or simulation_format == SimulationFormat::athenak) and simulation_interp
+      and simulation_block_interp;
+  int ind_t_frac = simulation_interp ? 3 : 0;
+
+  // Prepare bookkeeping for warnings and errors
+  int num_extrap_camera_small = 0;
+  int num_extrap_camera_large = 0;
+  int num_extrap_source_small = 0;
+  int num_extrap_source_large = 0;
+  double val_extrap_camera_small = 0.0;
+  double val_extrap_camera_large = 0.0;
+  double val_extrap_source_small = 0.0;
+  double val_extrap_source_large = 0.0;
+
+  // Go through geodesics in parallel
+  #pragma omp parallel for schedule(runtime) reduction(+: num_extrap_camera_small, \
+      num_extrap_camera_large, num_extrap_source_small, num_extrap_source_large) reduction(max: \
+      val_extrap_camera_small, val_extrap_camera_large, val_extrap_source_small, \
+      val_extrap_source_large)
+  for (int m = 0; m < num_pix; m++)
+  {
+    // Skip geodesics already set to NaN fallback values
+    if (fallback_nan and sample_flags[adaptive_level](m))
+      continue;
+
+    // Prepare bookkeeping for extrapolation
+    bool extrap_camera_small = false;
+    bool extrap_camera_large = false;
+    bool extrap_source_small = false;
+    bool extrap_source_large = false;
+    double val_extrap_camera_small_local = 0.0;
+    double val_extrap_camera_large_local = 0.0;
+    double val_extrap_source_small_local = 0.0;
+    double val_extrap_source_large_local = 0.0;
+
+    // Go along geodesic
+    int num_steps = sample_num[adaptive_level](m);
+    int s_next = sample_offsets[adaptive_level](m);
+    for (int n = 0; n < num_steps; n++)
+    {
+      // Skip cut samples
+      unsigned char status = sample_status[adaptive_level](m,n);
+      if (status & sample_status_cut)
+        continue;
+      int s = s_next++;
+
+      // Calculate time interpolation
+      double x0 = SamplePosition(m,n,0) + snapshot_time;
+      int t_ind = 0;
+      double t_frac = 0.0;
+      if (x0 >= time[0])
       {
-        num_extrap_camera_large++;
-        val_extrap_camera_large = std::max(val_extrap_camera_large, val_extrap_camera_large_local);
+        if (x0 > time[0] + extrapolation_tolerance)
+        {
+          extrap_camera_large = true;
+          val_extrap_camera_large_local = std::max(val_extrap_camera_large_local, x0 - time[0]);
+        }
+        else if (x0 > time[0])
+        {
+          extrap_camera_small = true;
+          val_extrap_camera_small_local = std::max(val_extrap_camera_small_local, x0 - time[0]);
+        }
       }
-      if (extrap_source_small)
+      else if (x0 <= time[slow_chunk_size-1])
       {
-        num_extrap_source_small++;
-        val_extrap_source_small = std::max(val_extrap_source_small, val_extrap_source_small_local);
+        if (x0 < time[slow_chunk_size-1] - extrapolation_tolerance)
+        {
+          extrap_source_large = true;
+          val_extrap_source_large_local =
+              std::max(val_extrap_source_large_local, time[slow_chunk_size-1] - x0);
+        }
+        else if (x0 < time[slow_chunk_size-1])
+        {
+          extrap_source_small = true;
+          val_extrap_source_small_local =
+              std::max(val_extrap_source_small_local, time[slow_chunk_size-1] - x0);
+        }
+        if (slow_interp)
+        {
+          t_ind = slow_chunk_size - 2;
+          t_frac = 1.0;
+        }
+        else
+          t_ind = slow_chunk_size - 1;
       }
-      if (extrap_source_large)
+      else
       {
-        num_extrap_source_large++;
-        val_extrap_source_large = std::max(val_extrap_source_large, val_extrap_source_large_local);
+        while (time[t_ind++] > x0);
+        t_ind--;
+        if (slow_interp)
+        {
+          t_ind--;
+          t_frac = (x0 - time[t_ind]) / (time[t_ind+1] - time[t_ind]);
+        }
+        else if (time[t_ind-1] - x0 <= x0 - time[t_ind])
+          t_ind--;
       }
+
+      // Store results for samples on grid
+      if (status != 0)
+        continue;
+      if (anchors_stored)
+        for (int p = 0; p < 8; p++)
+          sample_inds[adaptive_level](s,p,4) = t_ind;
+      else
+        sample_inds[adaptive_level](s,4) = t_ind;
+      if (slow_interp)
+        sample_fracs[adaptive_level](s,ind_t_frac) = t_frac;
+    }
+
+    // Add to accounting of warnings and errors
+    if (extrap_camera_small)
+    {
+      num_extrap_camera_small++;
+      val_extrap_camera_small = std::max(val_extrap_camera_small, val_extrap_camera_small_local);
+    }
+    if (extrap_camera_large)
+    {
+      num_extrap_camera_large++;
+      val_extrap_camera_large = std::max(val_extrap_camera_large, val_extrap_camera_large_local);
+    }
+    if (extrap_source_small)
+    {
+      num_extrap_source_small++;
+      val_extrap_source_small = std::max(val_extrap_source_small, val_extrap_source_small_local);
+    }
+    if (extrap_source_large)
+    {
+      num_extrap_source_large++;
+      val_extrap_source_large = std::max(val_extrap_source_large, val_extrap_source_large_local);
     }
   }
 
@@ -614,6 +675,56 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
     message << " gravitational times).";
     BlacklightWarning(message.str().c_str());
   }
+  ProfileRecord("CalculateSampleTimes", snapshot, adaptive_level, time_start, omp_get_wtime(),
+      ProfileCounts());
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for recording which simulation blocks are needed for resampling.
+// Inputs: (none)
+// Outputs:
+//   block_flags: entries set to true for each block used by any sample point at root level, other
+//       entries left unchanged
+// Notes:
+//   Assumes sample_num[0], sample_status[0], sample_offsets[0], and sample_inds[0] have been set.
+//   Accounts for all anchor points if simulation_interp == true and
+//       simulation_block_interp == true.
+void RadiationIntegrator::MarkSampledBlocks(Array<bool> &block_flags) const
+{
+  // Prepare bookkeeping
+  int num_pix = sample_inds[0].allocated ? camera_num_pix : 0;
+  int num_anchors = 1;
+  if ((simulation_format == SimulationFormat::athena
+      or simulation_format == SimulationFormat::athenak) and simulation_interp
+      and simulation_block_interp)
+    num_anchors = 8;
+  int n_b = block_flags.n1;
+
+  // Go through samples in parallel
+  #pragma omp parallel for schedule(static)
+  for (int m = 0; m < num_pix; m++)
+  {
+    int s_next = sample_offsets[0](m);
+    for (int n = 0; n < sample_num[0](m); n++)
+    {
+      if (sample_status[0](m,n) & sample_status_cut)
+        continue;
+      int s = s_next++;
+      if (sample_status[0](m,n) != 0)
+        continue;
+      for (int p = 0; p < num_anchors; p++)
+      {
+        int b = num_anchors > 1 ? sample_inds[0](s,p,0) : sample_inds[0](s,0);
+        if (b >= 0 and b < n_b)
+        {
+          #pragma omp atomic write
+          block_flags(b) = true;
+        }
+      }
+    }
+  }
   return;
 }
 
@@ -623,422 +734,263 @@ void RadiationIntegrator::CalculateSimulationSampling(int snapshot)
 // Inputs: (none)
 // Outputs: (none)
 // Notes:
-//   Assumes geodesic_num_steps[adaptive_level], sample_num[adaptive_level],
-//       sample_inds[adaptive_level], sample_nan[adaptive_level], sample_cut[adaptive_level],
-//       and sample_fallback[adaptive_level] have been set.
+//   Assumes sample_num[adaptive_level], sample_status[adaptive_level],
+//       sample_offsets[adaptive_level], and sample_inds[adaptive_level] have been set.
 //   Assumes sample_fracs[adaptive_level] has been set if simulation_interp == true.
-//   Allocates and initializes sample_rho[adaptive_level], sample_pgas[adaptive_level],
-//       sample_kappa[adaptive_level] (if needed), sample_uu1[adaptive_level],
-//       sample_uu2[adaptive_level], sample_uu3[adaptive_level], sample_bb1[adaptive_level],
-//       sample_bb2[adaptive_level], and sample_bb3[adaptive_level].
-//   Deallocates sample_inds[adaptive_level], sample_fracs[adaptive_level],
-//       sample_nan[adaptive_level], and sample_fallback[adaptive_level] if adaptive_level > 0.
+//   Allocates and initializes sample_prim[adaptive_level], holding for each non-cut sample a record
+//       of values indexed by sample_ind_rho, sample_ind_pgas, sample_ind_uu1, sample_ind_uu2,
+//       sample_ind_uu3, sample_ind_bb1, sample_ind_bb2, sample_ind_bb3, and (if needed)
+//       sample_ind_kappa.
+//   Deallocates sample_inds[adaptive_level] and sample_fracs[adaptive_level] if adaptive_level > 0.
+//   If cut_tau_max >= 0, only allocates and zeros arrays, leaving resampling and deallocation to
+//       CalculateSimulationCoefficients().
+//   Otherwise every record along each ray is written, so the arrays are not zeroed.
 void RadiationIntegrator::SampleSimulation()
 {
   // Allocate arrays
+  double time_start = omp_get_wtime();
   int num_pix = camera_num_pix;
   if (adaptive_level > 0)
     num_pix = block_counts[adaptive_level] * block_num_pix;
   if (first_time or adaptive_level > 0)
   {
-    sample_rho[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
-    sample_pgas[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
+    int num_prim = sample_ind_kappa;
     if (plasma_model == PlasmaModel::code_kappa)
-      sample_kappa[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
-    sample_uu1[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
-    sample_uu2[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
-    sample_uu3[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
-    sample_bb1[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
-    sample_bb2[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
-    sample_bb3[adaptive_level].Allocate(num_pix, geodesic_num_steps[adaptive_level]);
+      num_prim++;
+    sample_prim[adaptive_level].Allocate(NumSampleRecords(), num_prim);
   }
-  sample_rho[adaptive_level].Zero();
-  sample_pgas[adaptive_level].Zero();
-  sample_kappa[adaptive_level].Zero();
-  sample_uu1[adaptive_level].Zero();
-  sample_uu2[adaptive_level].Zero();
-  sample_uu3[adaptive_level].Zero();
-  sample_bb1[adaptive_level].Zero();
-  sample_bb2[adaptive_level].Zero();
-  sample_bb3[adaptive_level].Zero();
+  if (cut_tau_max >= 0.0)
+    sample_prim[adaptive_level].Zero();
 
   // Resample cell data onto geodesics in parallel
-  #pragma omp parallel for schedule(static)
-  for (int m = 0; m < num_pix; m++)
+  if (cut_tau_max < 0.0)
   {
-    // Extract number of steps along this geodesic
-    int num_steps = sample_num[adaptive_level](m);
-
-    // Go along geodesic
-    for (int n = 0; n < num_steps; n++)
+    #pragma omp parallel
     {
-      // Set NaN values
-      if (sample_nan[adaptive_level](m,n))
+      ProfileCounts profile_counts;
+      double profile_time_start = omp_get_wtime();
+      #pragma omp for schedule(runtime) nowait
+      for (int m = 0; m < num_pix; m++)
       {
-        sample_rho[adaptive_level](m,n) = std::numeric_limits<float>::quiet_NaN();
-        sample_pgas[adaptive_level](m,n) = std::numeric_limits<float>::quiet_NaN();
-        if (plasma_model == PlasmaModel::code_kappa)
-          sample_kappa[adaptive_level](m,n) = std::numeric_limits<float>::quiet_NaN();
-        sample_uu1[adaptive_level](m,n) = std::numeric_limits<float>::quiet_NaN();
-        sample_uu2[adaptive_level](m,n) = std::numeric_limits<float>::quiet_NaN();
-        sample_uu3[adaptive_level](m,n) = std::numeric_limits<float>::quiet_NaN();
-        sample_bb1[adaptive_level](m,n) = std::numeric_limits<float>::quiet_NaN();
-        sample_bb2[adaptive_level](m,n) = std::numeric_limits<float>::quiet_NaN();
-        sample_bb3[adaptive_level](m,n) = std::numeric_limits<float>::quiet_NaN();
+        int num_steps = sample_num[adaptive_level](m);
+        int s_next = sample_offsets[adaptive_level](m);
+        for (int n = 0; n < num_steps; n++)
+          if (SampleKept(m, n))
+            SampleSimulationPoint(m, n, s_next++);
+        profile_counts.samples += s_next - sample_offsets[adaptive_level](m);
       }
+      ProfileRecordThread("SampleSimulation", ProfileSnapshot(), adaptive_level,
+          profile_time_start, omp_get_wtime(), profile_counts);
+    }
+  }
 
-      // Skip cut regions
-      else if (sample_cut[adaptive_level](m,n))
-        continue;
-
-      // Set fallback values
-      else if (sample_fallback[adaptive_level](m,n))
-      {
-        sample_rho[adaptive_level](m,n) = fallback_rho;
-        sample_pgas[adaptive_level](m,n) = fallback_pgas;
-        if (plasma_model == PlasmaModel::code_kappa)
-          sample_kappa[adaptive_level](m,n) = fallback_kappa;
-        sample_uu1[adaptive_level](m,n) = fallback_uu1;
-        sample_uu2[adaptive_level](m,n) = fallback_uu2;
-        sample_uu3[adaptive_level](m,n) = fallback_uu3;
-        sample_bb1[adaptive_level](m,n) = fallback_bb1;
-        sample_bb2[adaptive_level](m,n) = fallback_bb2;
-        sample_bb3[adaptive_level](m,n) = fallback_bb3;
-      }
+  // Free memory
+  if (adaptive_level > 0 and cut_tau_max < 0.0)
+  {
+    sample_inds[adaptive_level].Deallocate();
+    sample_fracs[adaptive_level].Deallocate();
+  }
+  ProfileRecord("SampleSimulation", ProfileSnapshot(), adaptive_level, time_start,
+      omp_get_wtime(), ProfileCounts());
+  return;
+}
 
-      // Set nearest values
-      else if (not simulation_interp)
-      {
-        // Extract indices
-        int b = sample_inds[adaptive_level](m,n,0);
-        int k = sample_inds[adaptive_level](m,n,1);
-        int j = sample_inds[adaptive_level](m,n,2);
-        int i = sample_inds[adaptive_level](m,n,3);
-        int t = 0;
-        if (slow_light_on)
-          t = sample_inds[adaptive_level](m,n,4);
-
-        // Calculate values without temporal interpolation
-        if (not (slow_light_on and slow_interp))
-        {
-          sample_rho[adaptive_level](m,n) = grid_prim[t](ind_rho,b,k,j,i);
-          sample_pgas[adaptive_level](m,n) = grid_prim[t](ind_pgas,b,k,j,i);
-          if (plasma_model == PlasmaModel::code_kappa)
-            sample_kappa[adaptive_level](m,n) = grid_prim[t](ind_kappa,b,k,j,i);
-          sample_uu1[adaptive_level](m,n) = grid_prim[t](ind_uu1,b,k,j,i);
-          sample_uu2[adaptive_level](m,n) = grid_prim[t](ind_uu2,b,k,j,i);
-          sample_uu3[adaptive_level](m,n) = grid_prim[t](ind_uu3,b,k,j,i);
-          sample_bb1[adaptive_level](m,n) = grid_prim[t](ind_bb1,b,k,j,i);
-          sample_bb2[adaptive_level](m,n) = grid_prim[t](ind_bb2,b,k,j,i);
-          sample_bb3[adaptive_level](m,n) = grid_prim[t](ind_bb3,b,k,j,i);
-        }
+//--------------------------------------------------------------------------------------------------
 
-        // Calculate values with temporal interpolation
-        else
-        {
-          // Perform spatial interpolation on first slice
-          double rho_1 = static_cast<double>(grid_prim[t](ind_rho,b,k,j,i));
-          double pgas_1 = static_cast<double>(grid_prim[t](ind_pgas,b,k,j,i));
-          double kappa_1 = 0.0;
-          if (plasma_model == PlasmaModel::code_kappa)
-            kappa_1 = static_cast<double>(grid_prim[t](ind_kappa,b,k,j,i));
-          double uu1_1 = static_cast<double>(grid_prim[t](ind_uu1,b,k,j,i));
-          double uu2_1 = static_cast<double>(grid_prim[t](ind_uu2,b,k,j,i));
-          double uu3_1 = static_cast<double>(grid_prim[t](ind_uu3,b,k,j,i));
-          double bb1_1 = static_cast<double>(grid_prim[t](ind_bb1,b,k,j,i));
-          double bb2_1 = static_cast<double>(grid_prim[t](ind_bb2,b,k,j,i));
-          double bb3_1 = static_cast<double>(grid_prim[t](ind_bb3,b,k,j,i));
-
-          // Perform spatial interpolation on second slice
-          double rho_2 = static_cast<double>(grid_prim[t+1](ind_rho,b,k,j,i));
-          double pgas_2 = static_cast<double>(grid_prim[t+1](ind_pgas,b,k,j,i));
-          double kappa_2 = 0.0;
-          if (plasma_model == PlasmaModel::code_kappa)
-            kappa_2 = static_cast<double>(grid_prim[t+1](ind_kappa,b,k,j,i));
-          double uu1_2 = static_cast<double>(grid_prim[t+1](ind_uu1,b,k,j,i));
-          double uu2_2 = static_cast<double>(grid_prim[t+1](ind_uu2,b,k,j,i));
-          double uu3_2 = static_cast<double>(grid_prim[t+1](ind_uu3,b,k,j,i));
-          double bb1_2 = static_cast<double>(grid_prim[t+1](ind_bb1,b,k,j,i));
-          double bb2_2 = static_cast<double>(grid_prim[t+1](ind_bb2,b,k,j,i));
-          double bb3_2 = static_cast<double>(grid_prim[t+1](ind_bb3,b,k,j,i));
-
-          // Assign interpolated values
-          double t_frac = sample_fracs[adaptive_level](m,n,0);
-          sample_rho[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * rho_1 + t_frac * rho_2);
-          sample_pgas[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * pgas_1 + t_frac * pgas_2);
-          if (plasma_model == PlasmaModel::code_kappa)
-            sample_kappa[adaptive_level](m,n) =
-                static_cast<float>((1.0 - t_frac) * kappa_1 + t_frac * kappa_2);
-          sample_uu1[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * uu1_1 + t_frac * uu1_2);
-          sample_uu2[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * uu2_1 + t_frac * uu2_2);
-          sample_uu3[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * uu3_1 + t_frac * uu3_2);
-          sample_bb1[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * bb1_1 + t_frac * bb1_2);
-          sample_bb2[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * bb2_1 + t_frac * bb2_2);
-          sample_bb3[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * bb3_1 + t_frac * bb3_2);
-        }
-      }
+// Function for resampling simulation cell data onto a single geodesic sample.
+// Inputs:
+//   m: pixel index
+//   n: sample index
+//   s: index of sample in compacted storage
+// Outputs: (none)
+// Notes:
+//   Assumes sample_prim[adaptive_level] has been allocated.
+//   Assumes sample is not cut.
+//   Writes all values in record.
+//   See SampleSimulation().
+void RadiationIntegrator::SampleSimulationPoint(int m, int n, int s)
+{
+  // Locate record
+  float *sample_vals = &sample_prim[adaptive_level](s,0);
+  unsigned char status = sample_status[adaptive_level](m,n);
 
-      // Set intrablock interpolated values
-      else if (not ((simulation_format == SimulationFormat::athena
-          or simulation_format == SimulationFormat::athenak) and simulation_block_interp))
-      {
-        // Extract indices and coefficients
-        int b = sample_inds[adaptive_level](m,n,0);
-        int k = sample_inds[adaptive_level](m,n,1);
-        int j = sample_inds[adaptive_level](m,n,2);
-        int i = sample_inds[adaptive_level](m,n,3);
-        int t = 0;
-        if (slow_light_on)
-          t = sample_inds[adaptive_level](m,n,4);
-        double f_k = sample_fracs[adaptive_level](m,n,0);
-        double f_j = sample_fracs[adaptive_level](m,n,1);
-        double f_i = sample_fracs[adaptive_level](m,n,2);
-
-        // Calculate values without temporal interpolation
-        if (not (slow_light_on and slow_interp))
-        {
-          // Perform spatial interpolation
-          double rho = InterpolateSimple(grid_prim[t], ind_rho, b, k, j, i, f_k, f_j, f_i);
-          double pgas = InterpolateSimple(grid_prim[t], ind_pgas, b, k, j, i, f_k, f_j, f_i);
-          double kappa = 0.0;
-          if (plasma_model == PlasmaModel::code_kappa)
-            kappa = InterpolateSimple(grid_prim[t], ind_kappa, b, k, j, i, f_k, f_j, f_i);
-          double uu1 = InterpolateSimple(grid_prim[t], ind_uu1, b, k, j, i, f_k, f_j, f_i);
-          double uu2 = InterpolateSimple(grid_prim[t], ind_uu2, b, k, j, i, f_k, f_j, f_i);
-          double uu3 = InterpolateSimple(grid_prim[t], ind_uu3, b, k, j, i, f_k, f_j, f_i);
-          double bb1 = InterpolateSimple(grid_prim[t], ind_bb1, b, k, j, i, f_k, f_j, f_i);
-          double bb2 = InterpolateSimple(grid_prim[t], ind_bb2, b, k, j, i, f_k, f_j, f_i);
-          double bb3 = InterpolateSimple(grid_prim[t], ind_bb3, b, k, j, i, f_k, f_j, f_i);
-
-          // Account for possible invalid values
-          if (rho <= 0.0)
-            rho = static_cast<double>(grid_prim[t](ind_rho,b,k,j,i));
-          if (pgas <= 0.0)
-            pgas = static_cast<double>(grid_prim[t](ind_pgas,b,k,j,i));
-          if (plasma_model == PlasmaModel::code_kappa and kappa <= 0.0)
-            kappa = static_cast<double>(grid_prim[t](ind_kappa,b,k,j,i));
-
-          // Assign values
-          sample_rho[adaptive_level](m,n) = static_cast<float>(rho);
-          sample_pgas[adaptive_level](m,n) = static_cast<float>(pgas);
-          if (plasma_model == PlasmaModel::code_kappa)
-            sample_kappa[adaptive_level](m,n) = static_cast<float>(kappa);
-          sample_uu1[adaptive_level](m,n) = static_cast<float>(uu1);
-          sample_uu2[adaptive_level](m,n) = static_cast<float>(uu2);
-          sample_uu3[adaptive_level](m,n) = static_cast<float>(uu3);
-          sample_bb1[adaptive_level](m,n) = static_cast<float>(bb1);
-          sample_bb2[adaptive_level](m,n) = static_cast<float>(bb2);
-          sample_bb3[adaptive_level](m,n) = static_cast<float>(bb3);
-        }
+  // Set NaN values
+  if (status & sample_status_nan)
+  {
+    sample_vals[sample_ind_rho] = std::numeric_limits<float>::quiet_NaN();
+    sample_vals[sample_ind_pgas] = std::numeric_limits<float>::quiet_NaN();
+    if (plasma_model == PlasmaModel::code_kappa)
+      sample_vals[sample_ind_kappa] = std::numeric_limits<float>::quiet_NaN();
+    sample_vals[sample_ind_uu1] = std::numeric_limits<float>::quiet_NaN();
+    sample_vals[sample_ind_uu2] = std::numeric_limits<float>::quiet_NaN();
+    sample_vals[sample_ind_uu3] = std::numeric_limits<float>::quiet_NaN();
+    sample_vals[sample_ind_bb1] = std::numeric_limits<float>::quiet_NaN();
+    sample_vals[sample_ind_bb2] = std::numeric_limits<float>::quiet_NaN();
+    sample_vals[sample_ind_bb3] = std::numeric_limits<float>::quiet_NaN();
+  }
 
-        // Calculate values with temporal interpolation
-        else
-        {
-          // Perform spatial interpolation on first slice
-          double rho_1 = InterpolateSimple(grid_prim[t], ind_rho, b, k, j, i, f_k, f_j, f_i);
-          double pgas_1 = InterpolateSimple(grid_prim[t], ind_pgas, b, k, j, i, f_k, f_j, f_i);
-          double kappa_1 = 0.0;
-          if (plasma_model == PlasmaModel::code_kappa)
-            kappa_1 = InterpolateSimple(grid_prim[t], ind_kappa, b, k, j, i, f_k, f_j, f_i);
-          double uu1_1 = InterpolateSimple(grid_prim[t], ind_uu1, b, k, j, i, f_k, f_j, f_i);
-          double uu2_1 = InterpolateSimple(grid_prim[t], ind_uu2, b, k, j, i, f_k, f_j, f_i);
-          double uu3_1 = InterpolateSimple(grid_prim[t], ind_uu3, b, k, j, i, f_k, f_j, f_i);
-          double bb1_1 = InterpolateSimple(grid_prim[t], ind_bb1, b, k, j, i, f_k, f_j, f_i);
-          double bb2_1 = InterpolateSimple(grid_prim[t], ind_bb2, b, k, j, i, f_k, f_j, f_i);
-          double bb3_1 = InterpolateSimple(grid_prim[t], ind_bb3, b, k, j, i, f_k, f_j, f_i);
-
-          // Account for possible invalid values
-          if (rho_1 <= 0.0)
-            rho_1 = static_cast<double>(grid_prim[t](ind_rho,b,k,j,i));
-          if (pgas_1 <= 0.0)
-            pgas_1 = static_cast<double>(grid_prim[t](ind_pgas,b,k,j,i));
-          if (plasma_model == PlasmaModel::code_kappa and kappa_1 <= 0.0)
-            kappa_1 = static_cast<double>(grid_prim[t](ind_kappa,b,k,j,i));
-
-          // Perform spatial interpolation on second slice
-          double rho_2 = InterpolateSimple(grid_prim[t+1], ind_rho, b, k, j, i, f_k, f_j, f_i);
-          double pgas_2 = InterpolateSimple(grid_prim[t+1], ind_pgas, b, k, j, i, f_k, f_j, f_i);
-          double kappa_2 = 0.0;
-          if (plasma_model == PlasmaModel::code_kappa)
-            kappa_2 = InterpolateSimple(grid_prim[t+1], ind_kappa, b, k, j, i, f_k, f_j, f_i);
-          double uu1_2 = InterpolateSimple(grid_prim[t+1], ind_uu1, b, k, j, i, f_k, f_j, f_i);
-          double uu2_2 = InterpolateSimple(grid_prim[t+1], ind_uu2, b, k, j, i, f_k, f_j, f_i);
-          double uu3_2 = InterpolateSimple(grid_prim[t+1], ind_uu3, b, k, j, i, f_k, f_j, f_i);
-          double bb1_2 = InterpolateSimple(grid_prim[t+1], ind_bb1, b, k, j, i, f_k, f_j, f_i);
-          double bb2_2 = InterpolateSimple(grid_prim[t+1], ind_bb2, b, k, j, i, f_k, f_j, f_i);
-          double bb3_2 = InterpolateSimple(grid_prim[t+1], ind_bb3, b, k, j, i, f_k, f_j, f_i);
-
-          // Account for possible invalid values
-          if (rho_2 <= 0.0)
-            rho_2 = static_cast<double>(grid_prim[t+1](ind_rho,b,k,j,i));
-          if (pgas_2 <= 0.0)
-            pgas_2 = static_cast<double>(grid_prim[t+1](ind_pgas,b,k,j,i));
-          if (plasma_model == PlasmaModel::code_kappa and kappa_2 <= 0.0)
-            kappa_2 = static_cast<double>(grid_prim[t+1](ind_kappa,b,k,j,i));
-
-          // Assign interpolated values
-          double t_frac = sample_fracs[adaptive_level](m,n,3);
-          sample_rho[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * rho_1 + t_frac * rho_2);
-          sample_pgas[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * pgas_1 + t_frac * pgas_2);
-          if (plasma_model == PlasmaModel::code_kappa)
-            sample_kappa[adaptive_level](m,n) =
-                static_cast<float>((1.0 - t_frac) * kappa_1 + t_frac * kappa_2);
-          sample_uu1[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * uu1_1 + t_frac * uu1_2);
-          sample_uu2[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * uu2_1 + t_frac * uu2_2);
-          sample_uu3[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * uu3_1 + t_frac * uu3_2);
-          sample_bb1[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * bb1_1 + t_frac * bb1_2);
-          sample_bb2[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * bb2_1 + t_frac * bb2_2);
-          sample_bb3[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * bb3_1 + t_frac * bb3_2);
-        }
-      }
+  // Set fallback values
+  else if (status & sample_status_fallback)
+  {
+    sample_vals[sample_ind_rho] = fallback_rho;
+    sample_vals[sample_ind_pgas] = fallback_pgas;
+    if (plasma_model == PlasmaModel::code_kappa)
+      sample_vals[sample_ind_kappa] = fallback_kappa;
+    sample_vals[sample_ind_uu1] = fallback_uu1;
+    sample_vals[sample_ind_uu2] = fallback_uu2;
+    sample_vals[sample_ind_uu3] = fallback_uu3;
+    sample_vals[sample_ind_bb1] = fallback_bb1;
+    sample_vals[sample_ind_bb2] = fallback_bb2;
+    sample_vals[sample_ind_bb3] = fallback_bb3;
+  }
 
-      // Set interblock interpolated values
-      else
-      {
-        // Extract index
-        int t = 0;
-        if (slow_light_on)
-          t = sample_inds[adaptive_level](m,n,4);
+  // Set values from reduced-precision data
+  else if (simulation_precision != PrimitivePrecision::single)
+    SampleCompactPoint(s, sample_vals);
 
-        // Calculate values without temporal interpolation
-        if (not (slow_light_on and slow_interp))
-        {
-          // Perform spatial interpolation
-          double rho = InterpolateAdvanced(grid_prim[t], ind_rho, m, n);
-          double pgas = InterpolateAdvanced(grid_prim[t], ind_pgas, m, n);
-          double kappa = 0.0;
-          if (plasma_model == PlasmaModel::code_kappa)
-            kappa = InterpolateAdvanced(grid_prim[t], ind_kappa, m, n);
-          double uu1 = InterpolateAdvanced(grid_prim[t], ind_uu1, m, n);
-          double uu2 = InterpolateAdvanced(grid_prim[t], ind_uu2, m, n);
-          double uu3 = InterpolateAdvanced(grid_prim[t], ind_uu3, m, n);
-          double bb1 = InterpolateAdvanced(grid_prim[t], ind_bb1, m, n);
-          double bb2 = InterpolateAdvanced(grid_prim[t], ind_bb2, m, n);
-          double bb3 = InterpolateAdvanced(grid_prim[t], ind_bb3, m, n);
-
-          // Account for possible invalid values
-          int b = sample_inds[adaptive_level](m,n,0,0);
-          int k = sample_inds[adaptive_level](m,n,0,1);
-          int j = sample_inds[adaptive_level](m,n,0,2);
-          int i = sample_inds[adaptive_level](m,n,0,3);
-          if (rho <= 0.0)
-            rho = static_cast<double>(grid_prim[t](ind_rho,b,k,j,i));
-          if (pgas <= 0.0)
-            pgas = static_cast<double>(grid_prim[t](ind_pgas,b,k,j,i));
-          if (plasma_model == PlasmaModel::code_kappa and kappa <= 0.0)
-            kappa = static_cast<double>(grid_prim[t](ind_kappa,b,k,j,i));
-
-          // Assign values
-          sample_rho[adaptive_level](m,n) = static_cast<float>(rho);
-          sample_pgas[adaptive_level](m,n) = static_cast<float>(pgas);
-          if (plasma_model == PlasmaModel::code_kappa)
-            sample_kappa[adaptive_level](m,n) = static_cast<float>(kappa);
-          sample_uu1[adaptive_level](m,n) = static_cast<float>(uu1);
-          sample_uu2[adaptive_level](m,n) = static_cast<float>(uu2);
-          sample_uu3[adaptive_level](m,n) = static_cast<float>(uu3);
-          sample_bb1[adaptive_level](m,n) = static_cast<float>(bb1);
-          sample_bb2[adaptive_level](m,n) = static_cast<float>(bb2);
-          sample_bb3[adaptive_level](m,n) = static_cast<float>(bb3);
-        }
+  // Set nearest values
+  else if (not simulation_interp)
+  {
+    // Extract indices
+    int b = sample_inds[adaptive_level](s,0);
+    int k = sample_inds[adaptive_level](s,1);
+    int j = sample_inds[adaptive_level](s,2);
+    int i = sample_inds[adaptive_level](s,3);
+    int t = 0;
+    if (slow_light_on)
+      t = sample_inds[adaptive_level](s,4);
+
+    // Calculate values without temporal interpolation
+    if (not (slow_light_on and slow_interp))
+    {
+      sample_vals[sample_ind_rho] = grid_prim[t](ind_rho,b,k,j,i);
+      sample_vals[sample_ind_pgas] = grid_prim[t](ind_pgas,b,k,j,i);
+      if (plasma_model == PlasmaModel::code_kappa)
+        sample_vals[sample_ind_kappa] = grid_prim[t](ind_kappa,b,k,j,i);
+      sample_vals[sample_ind_uu1] = grid_prim[t](ind_uu1,b,k,j,i);
+      sample_vals[sample_ind_uu2] = grid_prim[t](ind_uu2,b,k,j,i);
+      sample_vals[sample_ind_uu3] = grid_prim[t](ind_uu3,b,k,j,i);
+      sample_vals[sample_ind_bb1] = grid_prim[t](ind_bb1,b,k,j,i);
+      sample_vals[sample_ind_bb2] = grid_prim[t](ind_bb2,b,k,j,i);
+      sample_vals[sample_ind_bb3] = grid_prim[t](ind_bb3,b,k,j,i);
+    }
 
-        // Calculate values with temporal interpolation
-        else
-        {
-          // Perform spatial interpolation on first slice
-          double rho_1 = InterpolateAdvanced(grid_prim[t], ind_rho, m, n);
-          double pgas_1 = InterpolateAdvanced(grid_prim[t], ind_pgas, m, n);
-          double kappa_1 = 0.0;
-          if (plasma_model == PlasmaModel::code_kappa)
-            kappa_1 = InterpolateAdvanced(grid_prim[t], ind_kappa, m, n);
-          double uu1_1 = InterpolateAdvanced(grid_prim[t], ind_uu1, m, n);
-          double uu2_1 = InterpolateAdvanced(grid_prim[t], ind_uu2, m, n);
-          double uu3_1 = InterpolateAdvanced(grid_prim[t], ind_uu3, m, n);
-          double bb1_1 = InterpolateAdvanced(grid_prim[t], ind_bb1, m, n);
-          double bb2_1 = InterpolateAdvanced(grid_prim[t], ind_bb2, m, n);
-          double bb3_1 = InterpolateAdvanced(grid_prim[t], ind_bb3, m, n);
-
-          // Account for possible invalid values
-          int b = sample_inds[adaptive_level](m,n,0,0);
-          int k = sample_inds[adaptive_level](m,n,0,1);
-          int j = sample_inds[adaptive_level](m,n,0,2);
-          int i = sample_inds[adaptive_level](m,n,0,3);
-          if (rho_1 <= 0.0)
-            rho_1 = static_cast<double>(grid_prim[t](ind_rho,b,k,j,i));
-          if (pgas_1 <= 0.0)
-            pgas_1 = static_cast<double>(grid_prim[t](ind_pgas,b,k,j,i));
-          if (plasma_model == PlasmaModel::code_kappa and kappa_1 <= 0.0)
-            kappa_1 = static_cast<double>(grid_prim[t](ind_kappa,b,k,j,i));
-
-          // Perform spatial interpolation on second slice
-          double rho_2 = InterpolateAdvanced(grid_prim[t+1], ind_rho, m, n);
-          double pgas_2 = InterpolateAdvanced(grid_prim[t+1], ind_pgas, m, n);
-          double kappa_2 = 0.0;
-          if (plasma_model == PlasmaModel::code_kappa)
-            kappa_2 = InterpolateAdvanced(grid_prim[t+1], ind_kappa, m, n);
-          double uu1_2 = InterpolateAdvanced(grid_prim[t+1], ind_uu1, m, n);
-          double uu2_2 = InterpolateAdvanced(grid_prim[t+1], ind_uu2, m, n);
-          double uu3_2 = InterpolateAdvanced(grid_prim[t+1], ind_uu3, m, n);
-          double bb1_2 = InterpolateAdvanced(grid_prim[t+1], ind_bb1, m, n);
-          double bb2_2 = InterpolateAdvanced(grid_prim[t+1], ind_bb2, m, n);
-          double bb3_2 = InterpolateAdvanced(grid_prim[t+1], ind_bb3, m, n);
-
-          // Account for possible invalid values
-          if (rho_2 <= 0.0)
-            rho_2 = static_cast<double>(grid_prim[t+1](ind_rho,b,k,j,i));
-          if (pgas_2 <= 0.0)
-            pgas_2 = static_cast<double>(grid_prim[t+1](ind_pgas,b,k,j,i));
-          if (plasma_model == PlasmaModel::code_kappa and kappa_2 <= 0.0)
-            kappa_2 = static_cast<double>(grid_prim[t+1](ind_kappa,b,k,j,i));
-
-          // Assign interpolated values
-          double t_frac = sample_fracs[adaptive_level](m,n,3);
-          sample_rho[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * rho_1 + t_frac * rho_2);
-          sample_pgas[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * pgas_1 + t_frac * pgas_2);
-          if (plasma_model == PlasmaModel::code_kappa)
-            sample_kappa[adaptive_level](m,n) =
-                static_cast<float>((1.0 - t_frac) * kappa_1 + t_frac * kappa_2);
-          sample_uu1[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * uu1_1 + t_frac * uu1_2);
-          sample_uu2[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * uu2_1 + t_frac * uu2_2);
-          sample_uu3[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * uu3_1 + t_frac * uu3_2);
-          sample_bb1[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * bb1_1 + t_frac * bb1_2);
-          sample_bb2[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * bb2_1 + t_frac * bb2_2);
-          sample_bb3[adaptive_level](m,n) =
-              static_cast<float>((1.0 - t_frac) * bb3_1 + t_frac * bb3_2);
-        }
-      }
+    // Calculate values with temporal interpolation
+    else
+    {
+      // Perform spatial interpolation on first slice
+      double rho_1 = static_cast<double>(grid_prim[t](ind_rho,b,k,j,i));
+      double pgas_1 = static_cast<double>(grid_prim[t](ind_pgas,b,k,j,i));
+      double kappa_1 = 0.0;
+      if (plasma_model == PlasmaModel::code_kappa)
+        kappa_1 = static_cast<double>(grid_prim[t](ind_kappa,b,k,j,i));
+      double uu1_1 = static_cast<double>(grid_prim[t](ind_uu1,b,k,j,i));
+      double uu2_1 = static_cast<double>(grid_prim[t](ind_uu2,b,k,j,i));
+      double uu3_1 = static_cast<double>(grid_prim[t](ind_uu3,b,k,j,i));
+      double bb1_1 = static_cast<double>(grid_prim[t](ind_bb1,b,k,j,i));
+      double bb2_1 = static_cast<double>(grid_prim[t](ind_bb2,b,k,j,i));
+      double bb3_1 = static_cast<double>(grid_prim[t](ind_bb3,b,k,j,i));
+
+      // Perform spatial interpolation on second slice
+      double rho_2 = static_cast<double>(grid_prim[t+1](ind_rho,b,k,j,i));
+      double pgas_2 = static_cast<double>(grid_prim[t+1](ind_pgas,b,k,j,i));
+      double kappa_2 = 0.0;
+      if (plasma_model == PlasmaModel::code_kappa)
+        kappa_2 = static_cast<double>(grid_prim[t+1](ind_kappa,b,k,j,i));
+      double uu1_2 = static_cast<double>(grid_prim[t+1](ind_uu1,b,k,j,i));
+      double uu2_2 = static_cast<double>(grid_prim[t+1](ind_uu2,b,k,j,i));
+      double uu3_2 = static_cast<double>(grid_prim[t+1](ind_uu3,b,k,j,i));
+      double bb1_2 = static_cast<double>(grid_prim[t+1](ind_bb1,b,k,j,i));
+      double bb2_2 = static_cast<double>(grid_prim[t+1](ind_bb2,b,k,j,i));
+      double bb3_2 = static_cast<double>(grid_prim[t+1](ind_bb3,b,k,j,i));
+
+      // Assign interpolated values
+      double t_frac = sample_fracs[adaptive_level](s,0);
+      sample_vals[sample_ind_rho] = static_cast<float>((1.0 - t_frac) * rho_1 + t_frac * rho_2);
+      sample_vals[sample_ind_pgas] = static_cast<float>((1.0 - t_frac) * pgas_1 + t_frac * pgas_2);
+      if (plasma_model == PlasmaModel::code_kappa)
+        sample_vals[sample_ind_kappa] =
+            static_cast<float>((1.0 - t_frac) * kappa_1 + t_frac * kappa_2);
+      sample_vals[sample_ind_uu1] = static_cast<float>((1.0 - t_frac) * uu1_1 + t_frac * uu1_2);
+      sample_vals[sample_ind_uu2] = static_cast<float>((1.0 - t_frac) * uu2_1 + t_frac * uu2_2);
+      sample_vals[sample_ind_uu3] = static_cast<float>((1.0 - t_frac) * uu3_1 + t_frac * uu3_2);
+      sample_vals[sample_ind_bb1] = static_cast<float>((1.0 - t_frac) * bb1_1 + t_frac * bb1_2);
+      sample_vals[sample_ind_bb2] = static_cast<float>((1.0 - t_frac) * bb2_1 + t_frac * bb2_2);
+      sample_vals[sample_ind_bb3] = static_cast<float>((1.0 - t_frac) * bb3_1 + t_frac * bb3_2);
     }
   }
 
-  // Free memory
-  if (adaptive_level > 0)
+  // Set interpolated values
+  else
   {
-    sample_inds[adaptive_level].Deallocate();
-    sample_fracs[adaptive_level].Deallocate();
-    sample_nan[adaptive_level].Deallocate();
-    sample_fallback[adaptive_level].Deallocate();
+    // Calculate stencil
+    int t = 0;
+    if (slow_light_on)
+      t = sample_inds[adaptive_level](s,4);
+    long int offsets[8];
+    double weights[8];
+    CalculateStencil(grid_prim[t], s, offsets, weights);
+
+    // Select quantities to interpolate, in record order
+    int num_vals = plasma_model == PlasmaModel::code_kappa ? 9 : 8;
+    int grid_inds[9] = {};
+    grid_inds[sample_ind_rho] = ind_rho;
+    grid_inds[sample_ind_pgas] = ind_pgas;
+    grid_inds[sample_ind_uu1] = ind_uu1;
+    grid_inds[sample_ind_uu2] = ind_uu2;
+    grid_inds[sample_ind_uu3] = ind_uu3;
+    grid_inds[sample_ind_bb1] = ind_bb1;
+    grid_inds[sample_ind_bb2] = ind_bb2;
+    grid_inds[sample_ind_bb3] = ind_bb3;
+    if (plasma_model == PlasmaModel::code_kappa)
+      grid_inds[sample_ind_kappa] = ind_kappa;
+
+    // Perform spatial interpolation on first slice
+    double vals_1[9] = {};
+    InterpolateStencil(grid_prim[t], grid_inds, num_vals, offsets, weights, vals_1);
+
+    // Account for possible invalid values
+    long int plane_size = grid_prim[t].n_tot / grid_prim[t].n5;
+    if (vals_1[sample_ind_rho] <= 0.0)
+      vals_1[sample_ind_rho] =
+          static_cast<double>(grid_prim[t].data[ind_rho*plane_size+offsets[0]]);
+    if (vals_1[sample_ind_pgas] <= 0.0)
+      vals_1[sample_ind_pgas] =
+          static_cast<double>(grid_prim[t].data[ind_pgas*plane_size+offsets[0]]);
+    if (plasma_model == PlasmaModel::code_kappa and vals_1[sample_ind_kappa] <= 0.0)
+      vals_1[sample_ind_kappa] =
+          static_cast<double>(grid_prim[t].data[ind_kappa*plane_size+offsets[0]]);
+
+    // Assign values without temporal interpolation
+    if (not (slow_light_on and slow_interp))
+    {
+      for (int v = 0; v < num_vals; v++)
+        sample_vals[v] = static_cast<float>(vals_1[v]);
+    }
+
+    // Assign values with temporal interpolation
+    else
+    {
+      // Perform spatial interpolation on second slice
+      double vals_2[9] = {};
+      InterpolateStencil(grid_prim[t+1], grid_inds, num_vals, offsets, weights, vals_2);
+
+      // Account for possible invalid values
+      if (vals_2[sample_ind_rho] <= 0.0)
+        vals_2[sample_ind_rho] =
+            static_cast<double>(grid_prim[t+1].data[ind_rho*plane_size+offsets[0]]);
+      if (vals_2[sample_ind_pgas] <= 0.0)
+        vals_2[sample_ind_pgas] =
+            static_cast<double>(grid_prim[t+1].data[ind_pgas*plane_size+offsets[0]]);
+      if (plasma_model == PlasmaModel::code_kappa and vals_2[sample_ind_kappa] <= 0.0)
+        vals_2[sample_ind_kappa] =
+            static_cast<double>(grid_prim[t+1].data[ind_kappa*plane_size+offsets[0]]);
+
+      // Assign interpolated values
+      double t_frac = sample_fracs[adaptive_level](s,3);
+      for (int v = 0; v < num_vals; v++)
+        sample_vals[v] = static_cast<float>((1.0 - t_frac) * vals_1[v] + t_frac * vals_2[v]);
+    }
   }
   return;
 }
@@ -1069,7 +1021,6 @@ void RadiationIntegrator::FindNearbyInds(int b, int k, int j, int i, int k_c, in
     double x3, double x2, double x1, int inds[4])
 {
   // Extract location data
-  int n_b = x1f.n2;
   int n_i = x1v.n1;
   int n_j = x2v.n1;
   int n_k = x3v.n1;
@@ -1098,126 +1049,71 @@ void RadiationIntegrator::FindNearbyInds(int b, int k, int j, int i, int k_c, in
   bool x1_off_grid = true;
   bool x2_off_grid = true;
   bool x3_off_grid = true;
-  for (int b_alt = 0; b_alt < n_b; b_alt++)
+  int location_i_fine = upper_i ? location_i * 2 + 1 : location_i * 2;
+  int location_j_fine = upper_j ? location_j * 2 + 1 : location_j * 2;
+  int location_k_fine = upper_k ? location_k * 2 + 1 : location_k * 2;
+
+  // Check x^1-direction
+  if (i != i_safe)
   {
-    // Extract data for block
-    int level_alt = levels(b_alt);
-    int location_i_alt = locations(b_alt,0);
-    int location_j_alt = locations(b_alt,1);
-    int location_k_alt = locations(b_alt,2);
-
-    // Check x^1-direction
-    if (x1_off_grid and i != i_safe)
-    {
-      bool same_level_exists = level_alt == level;
-      same_level_exists =
-          same_level_exists and location_i_alt == (i == -1 ? location_i - 1 : location_i + 1);
-      same_level_exists = same_level_exists and location_j_alt == location_j;
-      same_level_exists = same_level_exists and location_k_alt == location_k;
-      bool coarser_level_exists = level_alt == level - 1;
-      coarser_level_exists = coarser_level_exists
-          and location_i_alt == (i == -1 ? (location_i - 1) / 2 : (location_i + 1) / 2);
-      coarser_level_exists = coarser_level_exists and location_j_alt == location_j / 2;
-      coarser_level_exists = coarser_level_exists and location_k_alt == location_k / 2;
-      bool finer_level_exists = level_alt == level + 1;
-      finer_level_exists = finer_level_exists
-          and location_i_alt == (i == -1 ? location_i * 2 - 1 : location_i * 2 + 2);
-      finer_level_exists =
-          finer_level_exists and location_j_alt == (upper_j ? location_j * 2 + 1 : location_j * 2);
-      finer_level_exists =
-          finer_level_exists and location_k_alt == (upper_k ? location_k * 2 + 1 : location_k * 2);
-      if (same_level_exists or coarser_level_exists or finer_level_exists)
-        x1_off_grid = false;
-    }
+    bool same_level_exists = FindBlockLocation(level,
+        i == -1 ? location_i - 1 : location_i + 1, location_j, location_k) >= 0;
+    bool coarser_level_exists = FindBlockLocation(level - 1,
+        i == -1 ? (location_i - 1) / 2 : (location_i + 1) / 2, location_j / 2, location_k / 2) >= 0;
+    bool finer_level_exists = FindBlockLocation(level + 1,
+        i == -1 ? location_i * 2 - 1 : location_i * 2 + 2, location_j_fine, location_k_fine) >= 0;
+    if (same_level_exists or coarser_level_exists or finer_level_exists)
+      x1_off_grid = false;
+  }
 
-    // Check x^2-direction
-    if (x2_off_grid and j != j_safe)
-    {
-      bool same_level_exists = level_alt == level;
-      same_level_exists = same_level_exists and location_i_alt == location_i;
-      same_level_exists =
-          same_level_exists and location_j_alt == (j == -1 ? location_j - 1 : location_j + 1);
-      same_level_exists = same_level_exists and location_k_alt == location_k;
-      bool coarser_level_exists = level_alt == level - 1;
-      coarser_level_exists = coarser_level_exists and location_i_alt == location_i / 2;
-      coarser_level_exists = coarser_level_exists
-          and location_j_alt == (j == -1 ? (location_j - 1) / 2 : (location_j + 1) / 2);
-      coarser_level_exists = coarser_level_exists and location_k_alt == location_k / 2;
-      bool finer_level_exists = level_alt == level + 1;
-      finer_level_exists =
-          finer_level_exists and location_i_alt == (upper_i ? location_i * 2 + 1 : location_i * 2);
-      finer_level_exists = finer_level_exists
-          and location_j_alt == (j == -1 ? location_j * 2 - 1 : location_j * 2 + 2);
-      finer_level_exists =
-          finer_level_exists and location_k_alt == (upper_k ? location_k * 2 + 1 : location_k * 2);
-      if (same_level_exists or coarser_level_exists or finer_level_exists)
-        x2_off_grid = false;
-    }
+  // Check x^2-direction
+  if (j != j_safe)
+  {
+    bool same_level_exists = FindBlockLocation(level, location_i,
+        j == -1 ? location_j - 1 : location_j + 1, location_k) >= 0;
+    bool coarser_level_exists = FindBlockLocation(level - 1, location_i / 2,
+        j == -1 ? (location_j - 1) / 2 : (location_j + 1) / 2, location_k / 2) >= 0;
+    bool finer_level_exists = FindBlockLocation(level + 1, location_i_fine,
+        j == -1 ? location_j * 2 - 1 : location_j * 2 + 2, location_k_fine) >= 0;
+    if (same_level_exists or coarser_level_exists or finer_level_exists)
+      x2_off_grid = false;
+  }
 
-    // Check x^3-direction
-    if (x3_off_grid and k != k_safe)
-    {
-      bool same_level_exists = level_alt == level;
-      same_level_exists = same_level_exists and location_i_alt == location_i;
-      same_level_exists = same_level_exists and location_j_alt == location_j;
-      same_level_exists =
-          same_level_exists and location_k_alt == (k == -1 ? location_k - 1 : location_k + 1);
-      bool coarser_level_exists = level_alt == level - 1;
-      coarser_level_exists = coarser_level_exists and location_i_alt == location_i / 2;
-      coarser_level_exists = coarser_level_exists and location_j_alt == location_j / 2;
-      coarser_level_exists = coarser_level_exists
-          and location_k_alt == (k == -1 ? (location_k - 1) / 2 : (location_k + 1) / 2);
-      bool finer_level_exists = level_alt == level + 1;
-      finer_level_exists =
-          finer_level_exists and location_i_alt == (upper_i ? location_i * 2 + 1 : location_i * 2);
-      finer_level_exists =
-          finer_level_exists and location_j_alt == (upper_j ? location_j * 2 + 1 : location_j * 2);
-      finer_level_exists = finer_level_exists
-          and location_k_alt == (k == -1 ? location_k * 2 - 1 : location_k * 2 + 2);
-      if (same_level_exists or coarser_level_exists or finer_level_exists)
-        x3_off_grid = false;
-    }
+  // Check x^3-direction
+  if (k != k_safe)
+  {
+    bool same_level_exists = FindBlockLocation(level, location_i, location_j,
+        k == -1 ? location_k - 1 : location_k + 1) >= 0;
+    bool coarser_level_exists = FindBlockLocation(level - 1, location_i / 2, location_j / 2,
+        k == -1 ? (location_k - 1) / 2 : (location_k + 1) / 2) >= 0;
+    bool finer_level_exists = FindBlockLocation(level + 1, location_i_fine, location_j_fine,
+        k == -1 ? location_k * 2 - 1 : location_k * 2 + 2) >= 0;
+    if (same_level_exists or coarser_level_exists or finer_level_exists)
+      x3_off_grid = false;
+  }
 
-    // Check x^3-direction across periodic boundary
-    if (x3_off_grid and simulation_coord == Coordinates::sks and k == -1 and location_k == 0)
-    {
-      bool same_level_exists = level_alt == level;
-      same_level_exists = same_level_exists and location_i_alt == location_i;
-      same_level_exists = same_level_exists and location_j_alt == location_j;
-      same_level_exists = same_level_exists and location_k_alt == n_3_level(level_alt) - 1;
-      bool coarser_level_exists = level_alt == level - 1;
-      coarser_level_exists = coarser_level_exists and location_i_alt == location_i / 2;
-      coarser_level_exists = coarser_level_exists and location_j_alt == location_j / 2;
-      coarser_level_exists = coarser_level_exists and location_k_alt == n_3_level(level_alt) - 1;
-      bool finer_level_exists = level_alt == level + 1;
-      finer_level_exists =
-          finer_level_exists and location_i_alt == (upper_i ? location_i * 2 + 1 : location_i * 2);
-      finer_level_exists =
-          finer_level_exists and location_j_alt == (upper_j ? location_j * 2 + 1 : location_j * 2);
-      finer_level_exists = finer_level_exists and location_k_alt == n_3_level(level_alt) - 1;
-      if (same_level_exists or coarser_level_exists or finer_level_exists)
-        x3_off_grid = false;
-    }
-    if (x3_off_grid and simulation_coord == Coordinates::sks and k == n_k
-        and location_k == n_3_level(level) - 1)
-    {
-      bool same_level_exists = level_alt == level;
-      same_level_exists = same_level_exists and location_i_alt == location_i;
-      same_level_exists = same_level_exists and location_j_alt == location_j;
-      same_level_exists = same_level_exists and location_k_alt == 0;
-      bool coarser_level_exists = level_alt == level - 1;
-      coarser_level_exists = coarser_level_exists and location_i_alt == location_i / 2;
-      coarser_level_exists = coarser_level_exists and location_j_alt == location_j / 2;
-      coarser_level_exists = coarser_level_exists and location_k_alt == 0;
-      bool finer_level_exists = level_alt == level + 1;
-      finer_level_exists =
-          finer_level_exists and location_i_alt == (upper_i ? location_i * 2 + 1 : location_i * 2);
-      finer_level_exists =
-          finer_level_exists and location_j_alt == (upper_j ? location_j * 2 + 1 : location_j * 2);
-      finer_level_exists = finer_level_exists and location_k_alt == 0;
-      if (same_level_exists or coarser_level_exists or finer_level_exists)
-        x3_off_grid = false;
-    }
+  // Check x^3-direction across periodic boundary
+  if (x3_off_grid and simulation_coord == Coordinates::sks and k == -1 and location_k == 0)
+  {
+    bool same_level_exists =
+        FindBlockLocation(level, location_i, location_j, n_3_level(level) - 1) >= 0;
+    bool coarser_level_exists = level > 0 and FindBlockLocation(level - 1, location_i / 2,
+        location_j / 2, n_3_level(level - 1) - 1) >= 0;
+    bool finer_level_exists = level < max_level and FindBlockLocation(level + 1,
+        location_i_fine, location_j_fine, n_3_level(level + 1) - 1) >= 0;
+    if (same_level_exists or coarser_level_exists or finer_level_exists)
+      x3_off_grid = false;
+  }
+  if (x3_off_grid and simulation_coord == Coordinates::sks and k == n_k
+      and location_k == n_3_level(level) - 1)
+  {
+    bool same_level_exists = FindBlockLocation(level, location_i, location_j, 0) >= 0;
+    bool coarser_level_exists =
+        FindBlockLocation(level - 1, location_i / 2, location_j / 2, 0) >= 0;
+    bool finer_level_exists =
+        FindBlockLocation(level + 1, location_i_fine, location_j_fine, 0) >= 0;
+    if (same_level_exists or coarser_level_exists or finer_level_exists)
+      x3_off_grid = false;
   }
 
   // Account for grid existing in simple cases
@@ -1248,16 +1144,16 @@ void RadiationIntegrator::FindNearbyInds(int b, int k, int j, int i, int k_c, in
   int i_sought = i == i_safe ? i : i == -1 ? n_i - 1 : 0;
   int j_sought = j == j_safe ? j : j == -1 ? n_j - 1 : 0;
   int k_sought = k == k_safe ? k : k == -1 ? n_k - 1 : 0;
-  for (int b_alt = 0; b_alt < n_b; b_alt++)
-    if (levels(b_alt) == level_sought and locations(b_alt,0) == location_i_sought
-        and locations(b_alt,1) == location_j_sought and locations(b_alt,2) == location_k_sought)
-    {
-      inds[0] = b_alt;
-      inds[1] = k_sought;
-      inds[2] = j_sought;
-      inds[3] = i_sought;
-      return;
-    }
+  int b_alt = FindBlockLocation(level_sought, location_i_sought, location_j_sought,
+      location_k_sought);
+  if (b_alt >= 0)
+  {
+    inds[0] = b_alt;
+    inds[1] = k_sought;
+    inds[2] = j_sought;
+    inds[3] = i_sought;
+    return;
+  }
 
   // Find cell at coarser level
   level_sought = level - 1;
@@ -1276,16 +1172,16 @@ void RadiationIntegrator::FindNearbyInds(int b, int k, int j, int i, int k_c, in
     i_sought = i == i_safe ? (location_i % 2 * n_i + i) / 2 : i == -1 ? n_i - 1 : 0;
     j_sought = j == j_safe ? (location_j % 2 * n_j + j) / 2 : j == -1 ? n_j - 1 : 0;
     k_sought = k == k_safe ? (location_k % 2 * n_k + k) / 2 : k == -1 ? n_k - 1 : 0;
-    for (int b_alt = 0; b_alt < n_b; b_alt++)
-      if (levels(b_alt) == level_sought and locations(b_alt,0) == location_i_sought
-          and locations(b_alt,1) == location_j_sought and locations(b_alt,2) == location_k_sought)
-      {
-        inds[0] = b_alt;
-        inds[1] = k_sought;
-        inds[2] = j_sought;
-        inds[3] = i_sought;
-        return;
-      }
+    b_alt = FindBlockLocation(level_sought, location_i_sought, location_j_sought,
+        location_k_sought);
+    if (b_alt >= 0)
+    {
+      inds[0] = b_alt;
+      inds[1] = k_sought;
+      inds[2] = j_sought;
+      inds[3] = i_sought;
+      return;
+    }
   }
 
   // Find cell at finer level
@@ -1301,19 +1197,19 @@ void RadiationIntegrator::FindNearbyInds(int b, int k, int j, int i, int k_c, in
   i_sought = i == i_safe ? (upper_i ? (i - n_i / 2) * 2 : i * 2) : i == -1 ? n_i - 2 : 0;
   j_sought = j == j_safe ? (upper_j ? (j - n_j / 2) * 2 : j * 2) : j == -1 ? n_j - 2 : 0;
   k_sought = k == k_safe ? (upper_k ? (k - n_k / 2) * 2 : k * 2) : k == -1 ? n_k - 2 : 0;
-  for (int b_alt = 0; b_alt < n_b; b_alt++)
-    if (levels(b_alt) == level_sought and locations(b_alt,0) == location_i_sought
-        and locations(b_alt,1) == location_j_sought and locations(b_alt,2) == location_k_sought)
-    {
-      inds[0] = b_alt;
-      inds[1] = k_sought;
-      inds[2] = j_sought;
-      inds[3] = i_sought;
-      inds[1] += k < k_c or (k == k_c and x3 > x3v(b,k_c)) ? 1 : 0;
-      inds[2] += j < j_c or (j == j_c and x2 > x2v(b,j_c)) ? 1 : 0;
-      inds[3] += i < i_c or (i == i_c and x1 > x1v(b,i_c)) ? 1 : 0;
-      return;
-    }
+  b_alt = FindBlockLocation(level_sought, location_i_sought, location_j_sought,
+      location_k_sought);
+  if (b_alt >= 0)
+  {
+    inds[0] = b_alt;
+    inds[1] = k_sought;
+    inds[2] = j_sought;
+    inds[3] = i_sought;
+    inds[1] += k < k_c or (k == k_c and x3 > x3v(b,k_c)) ? 1 : 0;
+    inds[2] += j < j_c or (j == j_c and x2 > x2v(b,j_c)) ? 1 : 0;
+    inds[3] += i < i_c or (i == i_c and x1 > x1v(b,i_c)) ? 1 : 0;
+    return;
+  }
 
   // Report grid inconsistency
   throw BlacklightException("Grid interpolation failed.");
@@ -1322,65 +1218,235 @@ void RadiationIntegrator::FindNearbyInds(int b, int k, int j, int i, int k_c, in
 
 //--------------------------------------------------------------------------------------------------
 
-// Function for performing simple interpolation near a given cell
+// Function for calculating interpolation stencil for a sample
 // Inputs:
-//   grid_vals: full array of values on grid
-//   grid_ind: index of quantity to be interpolated
-//   b: block index
-//   k, j, i: cell indices
-//   f_k, f_j, f_i: interpolation fractions
+//   grid_vals: full array of values on grid, used only for its dimensions
+//   s: index of sample in compacted storage
 // Outputs:
-//   returned value: interpolated value from grid
-double RadiationIntegrator::InterpolateSimple(const Array<float> &grid_vals, int grid_ind, int b,
-    int k, int j, int i, double f_k, double f_j, double f_i)
+//   offsets: locations of 8 cells within a single quantity of grid_vals
+//   weights: trilinear weights of 8 cells
+// Notes:
+//   Assumes sample_inds[adaptive_level] and sample_fracs[adaptive_level] have been set.
+//   Cells are ordered with i varying fastest and k slowest, with the cell used for fallback values
+//       first.
+//   Uses cells adjacent within the base block unless simulation_block_interp == true with
+//       Athena++ or AthenaK data, in which case the cells found by FindNearbyInds() are used.
+void RadiationIntegrator::CalculateStencil(const Array<float> &grid_vals, int s,
+    long int offsets[8], double weights[8]) const
 {
-  double val_mmm = static_cast<double>(grid_vals(grid_ind,b,k,j,i));
-  double val_mmp = static_cast<double>(grid_vals(grid_ind,b,k,j,i+1));
-  double val_mpm = static_cast<double>(grid_vals(grid_ind,b,k,j+1,i));
-  double val_mpp = static_cast<double>(grid_vals(grid_ind,b,k,j+1,i+1));
-  double val_pmm = static_cast<double>(grid_vals(grid_ind,b,k+1,j,i));
-  double val_pmp = static_cast<double>(grid_vals(grid_ind,b,k+1,j,i+1));
-  double val_ppm = static_cast<double>(grid_vals(grid_ind,b,k+1,j+1,i));
-  double val_ppp = static_cast<double>(grid_vals(grid_ind,b,k+1,j+1,i+1));
-  double val = (1.0 - f_k) * (1.0 - f_j) * (1.0 - f_i) * val_mmm
-      + (1.0 - f_k) * (1.0 - f_j) * f_i * val_mmp + (1.0 - f_k) * f_j * (1.0 - f_i) * val_mpm
-      + (1.0 - f_k) * f_j * f_i * val_mpp + f_k * (1.0 - f_j) * (1.0 - f_i) * val_pmm
-      + f_k * (1.0 - f_j) * f_i * val_pmp + f_k * f_j * (1.0 - f_i) * val_ppm
-      + f_k * f_j * f_i * val_ppp;
-  return val;
+  // Extract grid dimensions
+  long int n_k = grid_vals.n3;
+  long int n_j = grid_vals.n2;
+  long int n_i = grid_vals.n1;
+
+  // Calculate offsets
+  if (not ((simulation_format == SimulationFormat::athena
+      or simulation_format == SimulationFormat::athenak) and simulation_block_interp))
+  {
+    long int b = sample_inds[adaptive_level](s,0);
+    long int k = sample_inds[adaptive_level](s,1);
+    long int j = sample_inds[adaptive_level](s,2);
+    long int i = sample_inds[adaptive_level](s,3);
+    long int offset = i + n_i * (j + n_j * (k + n_k * b));
+    for (int p = 0; p < 8; p++)
+      offsets[p] = offset + (p & 1) + (p >> 1 & 1) * n_i + (p >> 2) * n_j * n_i;
+  }
+  else
+    for (int p = 0; p < 8; p++)
+    {
+      long int b = sample_inds[adaptive_level](s,p,0);
+      long int k = sample_inds[adaptive_level](s,p,1);
+      long int j = sample_inds[adaptive_level](s,p,2);
+      long int i = sample_inds[adaptive_level](s,p,3);
+      offsets[p] = i + n_i * (j + n_j * (k + n_k * b));
+    }
+
+  // Calculate weights
+  double f_k = sample_fracs[adaptive_level](s,0);
+  double f_j = sample_fracs[adaptive_level](s,1);
+  double f_i = sample_fracs[adaptive_level](s,2);
+  weights[0] = (1.0 - f_k) * (1.0 - f_j) * (1.0 - f_i);
+  weights[1] = (1.0 - f_k) * (1.0 - f_j) * f_i;
+  weights[2] = (1.0 - f_k) * f_j * (1.0 - f_i);
+  weights[3] = (1.0 - f_k) * f_j * f_i;
+  weights[4] = f_k * (1.0 - f_j) * (1.0 - f_i);
+  weights[5] = f_k * (1.0 - f_j) * f_i;
+  weights[6] = f_k * f_j * (1.0 - f_i);
+  weights[7] = f_k * f_j * f_i;
+  return;
 }
 
 //--------------------------------------------------------------------------------------------------
 
-// Function for performing advanced interpolation among 8 cells
+// Function for interpolating several quantities with a common stencil
 // Inputs:
 //   grid_vals: full array of values on grid
-//   grid_ind: index of quantity to be interpolated
-//   m: ray index
-//   n: index along ray
+//   grid_inds: indices of quantities to be interpolated
+//   num_vals: number of quantities to be interpolated
+//   offsets: locations of 8 cells within a single quantity of grid_vals
+//   weights: trilinear weights of 8 cells
 // Outputs:
-//   returned value: interpolated value from grid
+//   vals: interpolated values
 // Notes:
-//   Assumes sample_inds[adaptive_level] and sample_fracs[adaptive_level] have been set.
-double RadiationIntegrator::InterpolateAdvanced(const Array<float> &grid_vals, int grid_ind, int m,
-    int n)
+//   See CalculateStencil().
+//   Gathers each cell across all quantities at once, so that the 8 cells need only be located
+//       once per sample rather than once per quantity.
+//   Sums contributions in cell order, matching interpolation performed one quantity at a time.
+void RadiationIntegrator::InterpolateStencil(const Array<float> &grid_vals, const int *grid_inds,
+    int num_vals, const long int offsets[8], const double weights[8], double *vals) const
 {
-  double vals[8] = {};
-  for (int p = 0; p < 8; p++)
+  long int plane_size = grid_vals.n_tot / grid_vals.n5;
+  #pragma omp simd
+  for (int v = 0; v < num_vals; v++)
+    vals[v] = weights[0] * static_cast<double>(grid_vals.data[grid_inds[v]*plane_size+offsets[0]]);
+  for (int p = 1; p < 8; p++)
+  {
+    #pragma omp simd
+    for (int v = 0; v < num_vals; v++)
+      vals[v] +=
+          weights[p] * static_cast<double>(grid_vals.data[grid_inds[v]*plane_size+offsets[p]]);
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for resampling reduced-precision simulation cell data onto a single geodesic sample
+// Inputs:
+//   s: index of sample in compacted storage
+// Outputs:
+//   sample_vals: values in record set
+// Notes:
+//   Assumes simulation_precision != PrimitivePrecision::single.
+//   Uses the nearest cell or the stencil from CalculateStencil(), taking dimensions from
+//       grid_prim[0], which is allocated as a staging buffer with the same shape as the
+//       reduced-precision data.
+//   Otherwise follows SampleSimulationPoint(), decoding values with CompactGridValue().
+void RadiationIntegrator::SampleCompactPoint(int s, float *sample_vals) const
+{
+  // Calculate stencil
+  int t = 0;
+  if (slow_light_on)
+    t = sample_inds[adaptive_level](s,4);
+  long int offsets[8];
+  double weights[8];
+  int num_cells = 8;
+  if (simulation_interp)
+    CalculateStencil(grid_prim[0], s, offsets, weights);
+  else
   {
-    int b = sample_inds[adaptive_level](m,n,p,0);
-    int k = sample_inds[adaptive_level](m,n,p,1);
-    int j = sample_inds[adaptive_level](m,n,p,2);
-    int i = sample_inds[adaptive_level](m,n,p,3);
-    vals[p] = static_cast<double>(grid_vals(grid_ind,b,k,j,i));
+    long int n_k = grid_prim[0].n3;
+    long int n_j = grid_prim[0].n2;
+    long int n_i = grid_prim[0].n1;
+    long int b = sample_inds[adaptive_level](s,0);
+    long int k = sample_inds[adaptive_level](s,1);
+    long int j = sample_inds[adaptive_level](s,2);
+    long int i = sample_inds[adaptive_level](s,3);
+    offsets[0] = i + n_i * (j + n_j * (k + n_k * b));
+    weights[0] = 1.0;
+    num_cells = 1;
   }
-  double f_k = sample_fracs[adaptive_level](m,n,0);
-  double f_j = sample_fracs[adaptive_level](m,n,1);
-  double f_i = sample_fracs[adaptive_level](m,n,2);
-  double val = (1.0 - f_k) * (1.0 - f_j) * (1.0 - f_i) * vals[0]
-      + (1.0 - f_k) * (1.0 - f_j) * f_i * vals[1] + (1.0 - f_k) * f_j * (1.0 - f_i) * vals[2]
-      + (1.0 - f_k) * f_j * f_i * vals[3] + f_k * (1.0 - f_j) * (1.0 - f_i) * vals[4]
-      + f_k * (1.0 - f_j) * f_i * vals[5] + f_k * f_j * (1.0 - f_i) * vals[6]
-      + f_k * f_j * f_i * vals[7];
-  return val;
+
+  // Select quantities to interpolate, in record order
+  int num_vals = plasma_model == PlasmaModel::code_kappa ? 9 : 8;
+  int grid_inds[9] = {};
+  grid_inds[sample_ind_rho] = ind_rho;
+  grid_inds[sample_ind_pgas] = ind_pgas;
+  grid_inds[sample_ind_uu1] = ind_uu1;
+  grid_inds[sample_ind_uu2] = ind_uu2;
+  grid_inds[sample_ind_uu3] = ind_uu3;
+  grid_inds[sample_ind_bb1] = ind_bb1;
+  grid_inds[sample_ind_bb2] = ind_bb2;
+  grid_inds[sample_ind_bb3] = ind_bb3;
+  if (plasma_model == PlasmaModel::code_kappa)
+    grid_inds[sample_ind_kappa] = ind_kappa;
+
+  // Perform spatial interpolation on first slice
+  double vals_1[9] = {};
+  InterpolateCompact(t, grid_inds, num_vals, num_cells, offsets, weights, vals_1);
+
+  // Account for possible invalid values
+  if (vals_1[sample_ind_rho] <= 0.0)
+    vals_1[sample_ind_rho] = static_cast<double>(CompactGridValue(t, ind_rho, offsets[0]));
+  if (vals_1[sample_ind_pgas] <= 0.0)
+    vals_1[sample_ind_pgas] = static_cast<double>(CompactGridValue(t, ind_pgas, offsets[0]));
+  if (plasma_model == PlasmaModel::code_kappa and vals_1[sample_ind_kappa] <= 0.0)
+    vals_1[sample_ind_kappa] = static_cast<double>(CompactGridValue(t, ind_kappa, offsets[0]));
+
+  // Assign values without temporal interpolation
+  if (not (slow_light_on and slow_interp))
+  {
+    for (int v = 0; v < num_vals; v++)
+      sample_vals[v] = static_cast<float>(vals_1[v]);
+    return;
+  }
+
+  // Perform spatial interpolation on second slice
+  double vals_2[9] = {};
+  InterpolateCompact(t + 1, grid_inds, num_vals, num_cells, offsets, weights, vals_2);
+
+  // Account for possible invalid values
+  if (vals_2[sample_ind_rho] <= 0.0)
+    vals_2[sample_ind_rho] = static_cast<double>(CompactGridValue(t + 1, ind_rho, offsets[0]));
+  if (vals_2[sample_ind_pgas] <= 0.0)
+    vals_2[sample_ind_pgas] = static_cast<double>(CompactGridValue(t + 1, ind_pgas, offsets[0]));
+  if (plasma_model == PlasmaModel::code_kappa and vals_2[sample_ind_kappa] <= 0.0)
+    vals_2[sample_ind_kappa] =
+        static_cast<double>(CompactGridValue(t + 1, ind_kappa, offsets[0]));
+
+  // Assign interpolated values
+  double t_frac = sample_fracs[adaptive_level](s, simulation_interp ? 3 : 0);
+  for (int v = 0; v < num_vals; v++)
+    sample_vals[v] = static_cast<float>((1.0 - t_frac) * vals_1[v] + t_frac * vals_2[v]);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for interpolating several reduced-precision quantities with a common stencil
+// Inputs:
+//   t: index of time slice
+//   grid_inds: indices of quantities to be interpolated
+//   num_vals: number of quantities to be interpolated
+//   num_cells: number of cells in stencil
+//   offsets: locations of cells within a single quantity
+//   weights: weights of cells
+// Outputs:
+//   vals: interpolated values
+// Notes:
+//   Sums contributions in cell order, as in InterpolateStencil().
+void RadiationIntegrator::InterpolateCompact(int t, const int *grid_inds, int num_vals,
+    int num_cells, const long int offsets[8], const double weights[8], double *vals) const
+{
+  for (int v = 0; v < num_vals; v++)
+    vals[v] = weights[0] * static_cast<double>(CompactGridValue(t, grid_inds[v], offsets[0]));
+  for (int p = 1; p < num_cells; p++)
+    for (int v = 0; v < num_vals; v++)
+      vals[v] += weights[p] * static_cast<double>(CompactGridValue(t, grid_inds[v], offsets[p]));
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for decoding a single reduced-precision cell value
+// Inputs:
+//   t: index of time slice
+//   v: index of quantity
+//   offset: location of cell within a single quantity
+// Outputs:
+//   returned value: value in single precision
+// Notes:
+//   Uses logarithmic scaling for density and pressure, matching
+//       SimulationReader::CompressPrimitives().
+float RadiationIntegrator::CompactGridValue(int t, int v, long int offset) const
+{
+  const Array<unsigned short int> &codes = grid_compact[t];
+  long int plane_size = codes.n_tot / codes.n5;
+  unsigned short int code = codes.data[v*plane_size+offset];
+  if (simulation_precision == PrimitivePrecision::bf16)
+    return SimulationReader::DecodeBF16(code);
+  int b = static_cast<int>(offset / (plane_size / codes.n4));
+  bool log_scale = v == ind_rho or v == ind_pgas;
+  return SimulationReader::DecodeScaled16(code, grid_scale[t](v,b,0), grid_scale[t](v,b,1),
+      log_scale);
 }
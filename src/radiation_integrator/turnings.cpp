@@ -9,8 +9,8 @@ void RadiationIntegrator::FindZTurnings(int m, int num_steps, int &n_start, int
 
   for (int n = num_steps - MIN_DIFF_N - 1; n >= MIN_DIFF_N; n--)
   {
-    find_1 = (sample_pos[adaptive_level](m, n + 1, 3) - sample_pos[adaptive_level](m, n, 3)) *
-             (sample_pos[adaptive_level](m, n, 3) - sample_pos[adaptive_level](m, n - 1, 3));
+    find_1 = (SamplePosition(m, n + 1, 3) - SamplePosition(m, n, 3)) *
+             (SamplePosition(m, n, 3) - SamplePosition(m, n - 1, 3));
     if (find_1 < 0.)
     {
       z_turnings_count++;
@@ -18,10 +18,10 @@ void RadiationIntegrator::FindZTurnings(int m, int num_steps, int &n_start, int
     }
     else if (find_1 == 0.)
     {
-      find_n = (sample_pos[adaptive_level](m, n + MIN_DIFF_N, 3) -
-                sample_pos[adaptive_level](m, n, 3)) *
-               (sample_pos[adaptive_level](m, n, 3) -
-                sample_pos[adaptive_level](m, n - MIN_DIFF_N, 3));
+      find_n = (SamplePosition(m, n + MIN_DIFF_N, 3) -
+                SamplePosition(m, n, 3)) *
+               (SamplePosition(m, n, 3) -
+                SamplePosition(m, n - MIN_DIFF_N, 3));
       if (find_n < 0.)
       {
         z_turnings_count++;
@@ -6,12 +6,13 @@
 #include <limits>     // numeric_limits
 
 // Library headers
-#include <omp.h>  // pragmas
+#include <omp.h>  // pragmas, omp_get_thread_num, omp_get_wtime
 
 // Blacklight headers
 #include "radiation_integrator.hpp"
 #include "../blacklight.hpp"         // Physics, enums
 #include "../utils/array.hpp"        // Array
+#include "../utils/profiler.hpp"     // profiling functions
 
 //--------------------------------------------------------------------------------------------------
 
@@ -19,15 +20,54 @@
 // Inputs: (none)
 // Outputs: (none)
 // Notes:
-//   Assumes sample_num[adaptive_level], sample_len[adaptive_level], j_i[adaptive_level],
-//       alpha_i[adaptive_level], and momentum_factors[adaptive_level] have been set.
+//   Assumes sample_num[adaptive_level], sample_len[adaptive_level], sample_offsets[adaptive_level],
+//       j_i[adaptive_level], alpha_i[adaptive_level], and momentum_factors[adaptive_level] have
+//       been set.
+//   Assumes sample_status[adaptive_level] has been set if model_type == ModelType::simulation.
 //   Assumes sample_pos[adaptive_level] has been set if image_time == true or image_length == true.
 //   Assumes sample_dir[adaptive_level] has been set if image_length == true.
 //   Assumes cell_values[adaptive_level] has been set if image_lambda_ave == true or
 //       image_emission_ave == true or image_tau_int == true.
 //   Allocates and initializes image[adaptive_level].
+//   If simulation_fused_coeffs == true or model_type == ModelType::formula, calculates
+//       coefficients along each ray just before integrating it, using records reserved for the
+//       thread handling the ray.
 //   Deallocates j_i[adaptive_level] and alpha_i[adaptive_level] if adaptive_level > 0.
-//   Deallocates cell_values[adaptive_level] if render_num_images <= 0 and adaptive_level > 0.
+//   Deallocates sample_prim[adaptive_level] if simulation_fused_coeffs == true and
+//       adaptive_level > 0.
+//   Deallocates cell_values[adaptive_level] and render_lengths[adaptive_level] if
+//       adaptive_level > 0.
+//   Dispatches to version specialized for images with no quantities other than image_light.
+void RadiationIntegrator::IntegrateUnpolarizedRadiation()
+{
+  double time_start = omp_get_wtime();
+  if (image_light and not (image_time or image_length or image_lambda or image_emission
+      or image_tau or image_lambda_ave or image_emission_ave or image_tau_int or image_crossings
+      or image_z_turnings))
+    IntegrateUnpolarizedRadiation<false>();
+  else
+    IntegrateUnpolarizedRadiation<true>();
+  int num_pix = camera_num_pix;
+  if (adaptive_level > 0)
+    num_pix = block_counts[adaptive_level] * block_num_pix;
+  ProfileCounts profile_counts;
+  profile_counts.rays = num_pix;
+  ProfileRecord("IntegrateRadiation", ProfileSnapshot(), adaptive_level, time_start,
+      omp_get_wtime(), profile_counts);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for integrating unpolarized radiative transfer equation, specialized for image
+//     quantities
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   See IntegrateUnpolarizedRadiation().
+//   If generic == false, assumes image_light == true and no other image quantities are needed, so
+//       that all other branches are removed from the loop over samples.
+template<bool generic>
 void RadiationIntegrator::IntegrateUnpolarizedRadiation()
 {
   // Allocate image array
@@ -48,177 +88,259 @@ void RadiationIntegrator::IntegrateUnpolarizedRadiation()
     // Allocate scratch space
     double gcov[4][4];
     double gcon[4][4];
+    Array<double> frequency_factors(image_num_frequencies);
+    Array<double> intensities(image_num_frequencies);
+    Array<double> integrated_lambdas(image_num_frequencies);
+    Array<double> integrated_emissions(image_num_frequencies);
+    Array<double> taus(image_num_frequencies);
+    Array<double> vanishing_vals(image_num_frequencies);
+    vanishing_vals.Zero();
 
-    // Go through frequencies and pixels
-    #pragma omp for schedule(static)
+    // Go through pixels
+    ProfileCounts profile_counts;
+    double profile_time_start = omp_get_wtime();
+    #pragma omp for schedule(runtime) nowait
     for (int m = 0; m < num_pix; m++)
     {
       // Extract number of steps
       int num_steps = sample_num[adaptive_level](m);
+      profile_counts.samples += num_steps;
       int n_start = -1;
       int z_turnings_count = 0;
-      if (image_z_turnings)
+      if (generic and image_z_turnings)
         FindZTurnings(m, num_steps, n_start, z_turnings_count);
       if (n_start < 0)
         n_start = 0;
+      int s_start = sample_offsets[adaptive_level](m);
+      for (int n = 0; n < n_start; n++)
+        if (SampleKept(m, n))
+          s_start++;
 
+      // Calculate coefficients along ray
+      int record_shift = 0;
+      if (simulation_fused_coeffs)
+      {
+        int r_start = omp_get_thread_num() * fused_num_records;
+        CalculateSimulationCoefficientsRay(m, r_start);
+        record_shift = r_start - sample_offsets[adaptive_level](m);
+      }
+      else if (model_type == ModelType::formula)
+      {
+        int r_start = omp_get_thread_num() * fused_num_records;
+        CalculateFormulaCoefficientsRay(m, r_start);
+        record_shift = r_start - sample_offsets[adaptive_level](m);
+      }
+
+      // Prepare integrated quantities
       for (int l = 0; l < image_num_frequencies; l++)
       {
-        // Prepare integrated quantities
-        double integrated_lambda = 0.0;
-        double integrated_emission = 0.0;
-        double x1_init = sample_pos[adaptive_level](m,0,1);
-        double x2_init = sample_pos[adaptive_level](m,0,2);
-        double x3_init = sample_pos[adaptive_level](m,0,3);
-        bool plane_sign =
-            camera_x[1] * x1_init + camera_x[2] * x2_init + camera_x[3] * x3_init > 0.0;
-        int crossings_count = 0;
-
-        // Go through samples
-        for (int n = n_start; n < num_steps; n++)
+        frequency_factors(l) = image_frequencies(l) * momentum_factors[adaptive_level](m);
+        intensities(l) = 0.0;
+        integrated_lambdas(l) = 0.0;
+        integrated_emissions(l) = 0.0;
+        taus(l) = 0.0;
+      }
+      bool plane_sign = false;
+      if (generic and image_crossings)
+      {
+        double x1_init = SamplePosition(m,0,1);
+        double x2_init = SamplePosition(m,0,2);
+        double x3_init = SamplePosition(m,0,3);
+        plane_sign = camera_x[1] * x1_init + camera_x[2] * x2_init + camera_x[3] * x3_init > 0.0;
+      }
+      int crossings_count = 0;
+
+      // Go through samples
+      int s_next = s_start;
+      for (int n = n_start; n < num_steps; n++)
+      {
+        // Locate record, treating cut samples as having no coupling
+        bool kept = SampleKept(m, n);
+        int s = kept ? s_next++ : -1;
+        int r = kept ? s + record_shift : -1;
+        const double *j_vals = vanishing_vals.data;
+        if (kept and (not generic or j_i[adaptive_level].allocated))
+          j_vals = &j_i[adaptive_level](r,0);
+        const double *alpha_vals = vanishing_vals.data;
+        if (kept and (not generic or alpha_i[adaptive_level].allocated))
+          alpha_vals = &alpha_i[adaptive_level](r,0);
+
+        // Extract and calculate useful values
+        double delta_lambda = SampleLength(m,n);
+        double delta_lambda_x = delta_lambda * x_unit;
+
+        // Integrate light at all frequencies
+        if (not generic or image_light)
         {
-          // Extract and calculate useful values
-          double delta_lambda = sample_len[adaptive_level](m,n);
-          double delta_lambda_cgs =
-              delta_lambda * x_unit / (image_frequencies(l) * momentum_factors[adaptive_level](m));
-          double t_cgs = sample_pos[adaptive_level](m,n,0) * t_unit;
-          double x1 = sample_pos[adaptive_level](m,n,1);
-          double x2 = sample_pos[adaptive_level](m,n,2);
-          double x3 = sample_pos[adaptive_level](m,n,3);
-          double kcov[4];
-          kcov[0] = sample_dir[adaptive_level](m,n,0);
-          kcov[1] = sample_dir[adaptive_level](m,n,1);
-          kcov[2] = sample_dir[adaptive_level](m,n,2);
-          kcov[3] = sample_dir[adaptive_level](m,n,3);
-          double j = std::numeric_limits<double>::quiet_NaN();
-          if (image_light or image_emission or image_emission_ave)
-            j = j_i[adaptive_level](l,m,n);
-          double alpha = std::numeric_limits<double>::quiet_NaN();
-          if (image_light or image_tau or image_tau_int)
-            alpha = alpha_i[adaptive_level](l,m,n);
-          double ss = j / alpha;
-          double delta_tau = alpha * delta_lambda_cgs;
-          double exp_neg = std::exp(-delta_tau);
-          double expm1 = std::expm1(delta_tau);
-          bool optically_thin = delta_tau <= delta_tau_max;
-
-          // Integrate light
-          if (image_light)
+          #pragma omp simd
+          for (int l = 0; l < image_num_frequencies; l++)
           {
+            double delta_lambda_cgs = delta_lambda_x / frequency_factors.data[l];
+            double j = j_vals[l];
+            double alpha = alpha_vals[l];
+            double delta_tau = alpha * delta_lambda_cgs;
             if (alpha > 0.0)
             {
-              if (optically_thin)
-                image[adaptive_level](l,m) = exp_neg * (image[adaptive_level](l,m) + ss * expm1);
+              double ss = j / alpha;
+              if (delta_tau <= delta_tau_max)
+                intensities.data[l] =
+                    std::exp(-delta_tau) * (intensities.data[l] + ss * std::expm1(delta_tau));
               else
-                image[adaptive_level](l,m) = ss;
+                intensities.data[l] = ss;
             }
             else
-              image[adaptive_level](l,m) += j * delta_lambda_cgs;
+              intensities.data[l] += j * delta_lambda_cgs;
           }
+        }
 
-          // Integrate alternative image quantities
-          if (image_time and l == 0)
-            image[adaptive_level](image_offset_time,m) =
-                std::min(image[adaptive_level](image_offset_time,m), t_cgs);
-          if (image_length and l == 0)
-          {
-            CovariantGeodesicMetric(x1, x2, x3, gcov);
-            ContravariantGeodesicMetric(x1, x2, x3, gcon);
-            double temp_a[4] = {};
-            for (int a = 1; a < 4; a++)
-              for (int mu = 0; mu < 4; mu++)
-                temp_a[a] += (gcon[a][mu] - gcon[0][a] * gcon[0][mu] / gcon[0][0]) * kcov[mu];
-            double dl_dlambda_sq = 0.0;
-            for (int a = 1; a < 4; a++)
-              for (int b = 1; b < 4; b++)
-                dl_dlambda_sq += gcov[a][b] * temp_a[a] * temp_a[b];
-            image[adaptive_level](image_offset_length,m) +=
-                std::sqrt(dl_dlambda_sq) * delta_lambda * x_unit;
-          }
-          if (image_lambda or image_lambda_ave)
-            integrated_lambda += delta_lambda_cgs;
-          if (image_emission or image_emission_ave)
-            integrated_emission += j * delta_lambda_cgs;
-          if (image_tau)
-            image[adaptive_level](image_offset_tau+l,m) += delta_tau;
-          if (image_lambda_ave and not std::isnan(cell_values[adaptive_level](0,m,n)))
-            for (int a = 0; a < CellValues::num_cell_values; a++)
-            {
-              int index = image_offset_lambda_ave + l * CellValues::num_cell_values + a;
-              image[adaptive_level](index,m) +=
-                  cell_values[adaptive_level](a,m,n) * delta_lambda_cgs;
-            }
-          if (image_emission_ave and not std::isnan(cell_values[adaptive_level](0,m,n)))
-            for (int a = 0; a < CellValues::num_cell_values; a++)
-            {
-              int index = image_offset_emission_ave + l * CellValues::num_cell_values + a;
-              image[adaptive_level](index,m) +=
-                  cell_values[adaptive_level](a,m,n) * j * delta_lambda_cgs;
-            }
-          if (image_tau_int and not std::isnan(cell_values[adaptive_level](0,m,n)))
+        // Skip remaining quantities if possible
+        if constexpr (not generic)
+          continue;
+
+        // Integrate alternative image quantities at all frequencies
+        if (image_lambda or image_lambda_ave or image_emission or image_emission_ave or image_tau
+            or image_tau_int)
+          for (int l = 0; l < image_num_frequencies; l++)
           {
-            if (optically_thin)
+            double delta_lambda_cgs = delta_lambda_x / frequency_factors(l);
+            double j = std::numeric_limits<double>::quiet_NaN();
+            if (image_light or image_emission or image_emission_ave)
+              j = j_vals[l];
+            double alpha = std::numeric_limits<double>::quiet_NaN();
+            if (image_light or image_tau or image_tau_int)
+              alpha = alpha_vals[l];
+            double delta_tau = alpha * delta_lambda_cgs;
+            if (image_lambda or image_lambda_ave)
+              integrated_lambdas(l) += delta_lambda_cgs;
+            if (image_emission or image_emission_ave)
+              integrated_emissions(l) += j * delta_lambda_cgs;
+            if (image_tau)
+              taus(l) += delta_tau;
+            if (image_lambda_ave and kept and not std::isnan(cell_values[adaptive_level](0,r)))
               for (int a = 0; a < CellValues::num_cell_values; a++)
               {
-                int index = image_offset_tau_int + l * CellValues::num_cell_values + a;
-                image[adaptive_level](index,m) = exp_neg
-                    * (image[adaptive_level](index,m) + cell_values[adaptive_level](a,m,n) * expm1);
+                int index = image_offset_lambda_ave + l * CellValues::num_cell_values + a;
+                image[adaptive_level](index,m) +=
+                    cell_values[adaptive_level](a,r) * delta_lambda_cgs;
               }
-            else
+            if (image_emission_ave and kept and not std::isnan(cell_values[adaptive_level](0,r)))
               for (int a = 0; a < CellValues::num_cell_values; a++)
               {
-                int index = image_offset_tau_int + l * CellValues::num_cell_values + a;
-                image[adaptive_level](index,m) = cell_values[adaptive_level](a,m,n);
+                int index = image_offset_emission_ave + l * CellValues::num_cell_values + a;
+                image[adaptive_level](index,m) +=
+                    cell_values[adaptive_level](a,r) * j * delta_lambda_cgs;
               }
+            if (image_tau_int and kept and not std::isnan(cell_values[adaptive_level](0,r)))
+            {
+              if (delta_tau <= delta_tau_max)
+              {
+                double exp_neg = std::exp(-delta_tau);
+                double expm1 = std::expm1(delta_tau);
+                for (int a = 0; a < CellValues::num_cell_values; a++)
+                {
+                  int index = image_offset_tau_int + l * CellValues::num_cell_values + a;
+                  image[adaptive_level](index,m) = exp_neg
+                      * (image[adaptive_level](index,m) + cell_values[adaptive_level](a,r) * expm1);
+                }
+              }
+              else
+                for (int a = 0; a < CellValues::num_cell_values; a++)
+                {
+                  int index = image_offset_tau_int + l * CellValues::num_cell_values + a;
+                  image[adaptive_level](index,m) = cell_values[adaptive_level](a,r);
+                }
+            }
           }
-          if (image_crossings and l == 0)
-          {
-            bool plane_sign_new = camera_x[1] * x1 + camera_x[2] * x2 + camera_x[3] * x3 > 0.0;
-            if (plane_sign_new != plane_sign)
-              crossings_count++;
-            plane_sign = plane_sign_new;
-          }
+
+        // Integrate frequency-independent image quantities
+        if (image_time)
+        {
+          double t_cgs = SamplePosition(m,n,0) * t_unit;
+          image[adaptive_level](image_offset_time,m) =
+              std::min(image[adaptive_level](image_offset_time,m), t_cgs);
+        }
+        double x1 = SamplePosition(m,n,1);
+        double x2 = SamplePosition(m,n,2);
+        double x3 = SamplePosition(m,n,3);
+        if (image_length)
+        {
+          double kcov[4];
+          kcov[0] = SampleDirection(m,n,0);
+          kcov[1] = SampleDirection(m,n,1);
+          kcov[2] = SampleDirection(m,n,2);
+          kcov[3] = SampleDirection(m,n,3);
+          CovariantGeodesicMetric(x1, x2, x3, gcov);
+          ContravariantGeodesicMetric(x1, x2, x3, gcon);
+          double temp_a[4] = {};
+          for (int a = 1; a < 4; a++)
+            for (int mu = 0; mu < 4; mu++)
+              temp_a[a] += (gcon[a][mu] - gcon[0][a] * gcon[0][mu] / gcon[0][0]) * kcov[mu];
+          double dl_dlambda_sq = 0.0;
+          for (int a = 1; a < 4; a++)
+            for (int b = 1; b < 4; b++)
+              dl_dlambda_sq += gcov[a][b] * temp_a[a] * temp_a[b];
+          image[adaptive_level](image_offset_length,m) +=
+              std::sqrt(dl_dlambda_sq) * delta_lambda * x_unit;
         }
+        if (image_crossings)
+        {
+          bool plane_sign_new = camera_x[1] * x1 + camera_x[2] * x2 + camera_x[3] * x3 > 0.0;
+          if (plane_sign_new != plane_sign)
+            crossings_count++;
+          plane_sign = plane_sign_new;
+        }
+      }
 
-        // Store integrated quantities
+      // Store integrated quantities
+      for (int l = 0; l < image_num_frequencies; l++)
+      {
+        // Transform I_nu/nu^3 to I_nu
+        if (not generic or image_light)
+        {
+          double nu_cu = image_frequencies(l) * image_frequencies(l) * image_frequencies(l);
+          image[adaptive_level](l,m) = intensities(l) * nu_cu;
+        }
+        if constexpr (not generic)
+          continue;
+
+        // Store alternative image quantities
         if (image_lambda)
-          image[adaptive_level](image_offset_lambda+l,m) = integrated_lambda;
+          image[adaptive_level](image_offset_lambda+l,m) = integrated_lambdas(l);
         if (image_emission)
-          image[adaptive_level](image_offset_emission+l,m) = integrated_emission;
-        if (image_crossings and l == 0)
-          image[adaptive_level](image_offset_crossings,m) = static_cast<double>(crossings_count);
+          image[adaptive_level](image_offset_emission+l,m) = integrated_emissions(l);
+        if (image_tau)
+          image[adaptive_level](image_offset_tau+l,m) = taus(l);
 
         // Normalize integrated quantities
         if (image_lambda_ave)
           for (int a = 0; a < CellValues::num_cell_values; a++)
           {
             int index = image_offset_lambda_ave + l * CellValues::num_cell_values + a;
-            image[adaptive_level](index,m) /= integrated_lambda;
+            image[adaptive_level](index,m) /= integrated_lambdas(l);
           }
         if (image_emission_ave)
           for (int a = 0; a < CellValues::num_cell_values; a++)
           {
             int index = image_offset_emission_ave + l * CellValues::num_cell_values + a;
-            image[adaptive_level](index,m) /= integrated_emission;
+            image[adaptive_level](index,m) /= integrated_emissions(l);
           }
-
-        // Transform I_nu/nu^3 to I_nu
-        if (image_light)
-        {
-          double nu_cu = image_frequencies(l) * image_frequencies(l) * image_frequencies(l);
-          image[adaptive_level](l,m) *= nu_cu;
-        }
       }
+      if (generic and image_crossings)
+        image[adaptive_level](image_offset_crossings,m) = static_cast<double>(crossings_count);
     }
+    ProfileRecordThread("IntegrateRadiation", ProfileSnapshot(), adaptive_level,
+        profile_time_start, omp_get_wtime(), profile_counts);
   }
 
   // Free memory
   if (adaptive_level > 0)
   {
+    if (simulation_fused_coeffs)
+      sample_prim[adaptive_level].Deallocate();
     j_i[adaptive_level].Deallocate();
     alpha_i[adaptive_level].Deallocate();
-    if (render_num_images <= 0)
-      cell_values[adaptive_level].Deallocate();
+    cell_values[adaptive_level].Deallocate();
+    render_lengths[adaptive_level].Deallocate();
   }
   return;
 }
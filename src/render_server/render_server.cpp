@@ -0,0 +1,295 @@
+// Blacklight render server
+
+// C++ headers
+#include <algorithm>     // sort
+#include <chrono>        // duration
+#include <filesystem>    // directory_iterator, is_directory, path, rename
+#include <fstream>       // ofstream
+#include <ios>           // ios_base
+#include <iostream>      // cout
+#include <iomanip>       // setprecision
+#include <string>        // string
+#include <system_error>  // error_code
+#include <thread>        // sleep_for
+#include <vector>        // vector
+
+// Library headers
+#include <omp.h>  // omp_get_wtime
+
+// Blacklight headers
+#include "render_server.hpp"
+#include "../blacklight.hpp"                                 // enums
+#include "../geodesic_integrator/geodesic_integrator.hpp"    // GeodesicIntegrator
+#include "../input_reader/input_reader.hpp"                  // InputReader
+#include "../output_writer/output_writer.hpp"                // OutputWriter
+#include "../radiation_integrator/radiation_integrator.hpp"  // RadiationIntegrator
+#include "../simulation_reader/simulation_reader.hpp"        // SimulationReader
+#include "../utils/exceptions.hpp"                           // BlacklightException
+#include "../utils/profiler.hpp"                             // ProfileSetSnapshot
+
+//--------------------------------------------------------------------------------------------------
+
+// Render server constructor
+// Inputs:
+//   p_input_reader_: pointer to object containing input parameters, to be updated by jobs
+//   p_p_geodesic_integrator_: pointer to pointer to object containing ray paths
+//   p_simulation_reader_: pointer to object containing raw simulation data
+//   p_p_radiation_integrator_: pointer to pointer to object containing radiation integrator
+// Notes:
+//   Takes pointers to the pointers of the geodesic and radiation integrators, since jobs changing
+//       frequencies replace both objects.
+//   Assumes objects have been constructed and geodesics integrated, but no simulation data read.
+RenderServer::RenderServer(InputReader *p_input_reader_,
+    GeodesicIntegrator **p_p_geodesic_integrator_, SimulationReader *p_simulation_reader_,
+    RadiationIntegrator **p_p_radiation_integrator_)
+  : p_input_reader(p_input_reader_), p_p_geodesic_integrator(p_p_geodesic_integrator_),
+    p_simulation_reader(p_simulation_reader_), p_p_radiation_integrator(p_p_radiation_integrator_)
+{
+  // Copy general input data
+  model_type = p_input_reader->model_type.value();
+
+  // Copy server parameters
+  server_job_dir = p_input_reader->server_job_dir.value();
+  server_poll = p_input_reader->server_poll.value();
+  if (not std::filesystem::is_directory(server_job_dir))
+    throw BlacklightException("Could not find server_job_dir.");
+
+  // Copy adaptive parameters
+  adaptive_max_level = 0;
+  if (p_input_reader->adaptive_max_level.has_value())
+    adaptive_max_level = p_input_reader->adaptive_max_level.value();
+  adaptive_progressive = false;
+  if (p_input_reader->adaptive_progressive.has_value())
+    adaptive_progressive = p_input_reader->adaptive_progressive.value();
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for processing jobs until told to stop
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Polls server_job_dir every server_poll seconds for files ending in ".job", processing them in
+//       lexicographic order.
+//   Job files should be written under another name and then renamed into place, so that they are
+//       complete when found.
+//   Returns after processing a job with server_stop = true.
+void RenderServer::Serve()
+{
+  std::cout << "Serving jobs from " << server_job_dir << ".\n" << std::flush;
+  while (true)
+  {
+    std::vector<std::string> job_files = FindJobs();
+    for (const std::string &job_file : job_files)
+      if (not RunJob(job_file))
+        return;
+    if (job_files.empty())
+      std::this_thread::sleep_for(std::chrono::duration<double>(server_poll));
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for listing waiting jobs
+// Inputs: (none)
+// Outputs:
+//   returned value: sorted names of files in server_job_dir ending in ".job"
+std::vector<std::string> RenderServer::FindJobs() const
+{
+  std::vector<std::string> job_files;
+  std::error_code error;
+  for (const std::filesystem::directory_entry &entry
+      : std::filesystem::directory_iterator(server_job_dir, error))
+    if (entry.path().extension() == ".job" and entry.is_regular_file(error))
+      job_files.push_back(entry.path().string());
+  if (error)
+    throw BlacklightException("Could not list server_job_dir.");
+  std::sort(job_files.begin(), job_files.end());
+  return job_files;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for processing a single job
+// Inputs:
+//   job_file: name of file containing job
+// Outputs:
+//   returned value: flag indicating server should continue
+// Notes:
+//   Renames job file to end in ".rejected" if it cannot be read, in which case no values are
+//       changed and the server continues.
+//   Renames job file to end in ".failed" and rethrows if any stage fails, since the resident
+//       objects may then be inconsistent.
+//   Otherwise renames job file to end in ".done".
+//   Reruns only the stages whose inputs changed:
+//     Frequencies: geodesics, sampling, and radiation, replacing both integrators.
+//     Snapshot: reading, sampling, and radiation.
+//     Plasma or formula parameters: radiation, reusing samples when there is no adaptive
+//         refinement.
+//     Output file only: radiation is reused when there is no adaptive refinement.
+bool RenderServer::RunJob(const std::string &job_file)
+{
+  // Read job
+  double time_start = omp_get_wtime();
+  try
+  {
+    p_input_reader->ReadServerJob(job_file);
+  }
+  catch (const BlacklightException &exception)
+  {
+    FileJob(job_file, ".rejected", exception.what());
+    return true;
+  }
+  catch (...)
+  {
+    FileJob(job_file, ".rejected", "Error: Could not read server job.\n");
+    return true;
+  }
+
+  // Stop server
+  if (p_input_reader->server_job_stop)
+  {
+    FileJob(job_file, ".done", nullptr);
+    return false;
+  }
+
+  // Determine stages to run
+  int snapshot_new = snapshot;
+  if (p_input_reader->server_job_snapshot.has_value())
+    snapshot_new = p_input_reader->server_job_snapshot.value();
+  else if (snapshot < 0)
+    snapshot_new = 0;
+  bool new_geodesics = p_input_reader->server_job_geodesics;
+  bool new_snapshot = snapshot_new != snapshot;
+  bool new_plasma = p_input_reader->server_job_plasma;
+  bool new_image = new_geodesics or new_snapshot or not image_ready;
+
+  // Run stages
+  try
+  {
+    // Integrate geodesics for new frequencies, without checkpoints made for old ones
+    if (new_geodesics)
+    {
+      delete *p_p_radiation_integrator;
+      *p_p_radiation_integrator = nullptr;
+      delete *p_p_geodesic_integrator;
+      *p_p_geodesic_integrator = nullptr;
+      p_input_reader->checkpoint_geodesic_load = false;
+      p_input_reader->checkpoint_geodesic_save = false;
+      p_input_reader->checkpoint_sample_load = false;
+      p_input_reader->checkpoint_sample_save = false;
+      *p_p_geodesic_integrator = new GeodesicIntegrator(p_input_reader);
+      time_geodesic += (*p_p_geodesic_integrator)->Integrate();
+      *p_p_radiation_integrator = new RadiationIntegrator(p_input_reader,
+          *p_p_geodesic_integrator, p_simulation_reader);
+    }
+
+    // Read simulation file
+    if (new_snapshot)
+    {
+      ProfileSetSnapshot(snapshot_new);
+      time_read += p_simulation_reader->Read(snapshot_new);
+      snapshot = snapshot_new;
+    }
+
+    // Select plasma model for existing radiation integrator
+    if (new_plasma and not new_geodesics)
+      (*p_p_radiation_integrator)->SelectPlasmaModel(p_input_reader);
+
+    // Integrate radiation
+    OutputWriter output_writer(p_input_reader, *p_p_geodesic_integrator,
+        *p_p_radiation_integrator);
+    if (new_image or new_plasma)
+      IntegrateImage(not new_image, &output_writer);
+    image_ready = adaptive_max_level == 0;
+
+    // Write output
+    output_writer.Write(snapshot);
+    output_writer.FinishWrite();
+
+    // Free refined levels and restrict subsequent reads to sampled blocks
+    (*p_p_radiation_integrator)->ReleaseLevels();
+    (*p_p_geodesic_integrator)->ReleaseLevels();
+    p_simulation_reader->SelectBlocks(p_p_radiation_integrator, 1);
+  }
+  catch (...)
+  {
+    FileJob(job_file, ".failed", nullptr);
+    throw;
+  }
+
+  // Report job
+  std::cout << std::setprecision(7);
+  std::cout << "Job " << std::filesystem::path(job_file).filename().string() << " completed in "
+      << omp_get_wtime() - time_start << " s (geodesics " << (new_geodesics ? "new" : "reused")
+      << ", simulation " << (new_snapshot ? "read" : "reused") << ", radiation "
+      << (new_image ? "new" : new_plasma ? "new with reused samples" : "reused") << ").\n"
+      << std::flush;
+  FileJob(job_file, ".done", nullptr);
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for integrating radiation for a job
+// Inputs:
+//   plasma_only: flag indicating only the plasma model has changed since the last image
+//   p_output_writer: pointer to object for writing job output
+// Outputs: (none)
+// Notes:
+//   Reuses samples with RadiationIntegrator::IntegratePlasmaModel() if plasma_only == true and
+//       there is no adaptive refinement, and otherwise iterates with adaptive refinement as for any
+//       run.
+//   With adaptive_progressive, writes the image after each level but the last, leaving the final
+//       write to the caller.
+void RenderServer::IntegrateImage(bool plasma_only, OutputWriter *p_output_writer)
+{
+  // Reuse samples
+  if (plasma_only and adaptive_max_level == 0)
+  {
+    (*p_p_radiation_integrator)->IntegratePlasmaModel(&time_image, &time_render);
+    return;
+  }
+
+  // Iterate with adaptive refinement
+  bool adaptive_complete = false;
+  while (not adaptive_complete)
+  {
+    adaptive_complete =
+        (*p_p_radiation_integrator)->Integrate(snapshot, &time_sample, &time_image, &time_render);
+    if (adaptive_progressive and not adaptive_complete)
+      p_output_writer->Write(snapshot);
+    if (not adaptive_complete)
+      time_geodesic += (*p_p_geodesic_integrator)->AddGeodesics(*p_p_radiation_integrator);
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for marking job as processed
+// Inputs:
+//   job_file: name of file containing job
+//   extension: new extension for file
+//   message: message to report and append to file, or nullptr
+// Outputs: (none)
+void RenderServer::FileJob(const std::string &job_file, const std::string &extension,
+    const char *message)
+{
+  std::filesystem::path job_path(job_file);
+  std::filesystem::path filed_path = job_path;
+  filed_path.replace_extension(extension);
+  if (message != nullptr)
+  {
+    std::cout << "Job " << job_path.filename().string() << " rejected.\n" << message
+        << std::flush;
+    std::ofstream job_stream(job_file, std::ios_base::app);
+    job_stream << "\n# " << message;
+  }
+  std::error_code error;
+  std::filesystem::rename(job_path, filed_path, error);
+  if (error)
+    throw BlacklightException("Could not rename server job file.");
+  return;
+}
@@ -0,0 +1,69 @@
+// Blacklight render server header
+
+#ifndef RENDER_SERVER_H_
+#define RENDER_SERVER_H_
+
+// C++ headers
+#include <string>  // string
+#include <vector>  // vector
+
+// Blacklight headers
+#include "../blacklight.hpp"                                 // enums
+#include "../geodesic_integrator/geodesic_integrator.hpp"    // GeodesicIntegrator
+#include "../input_reader/input_reader.hpp"                  // InputReader
+#include "../output_writer/output_writer.hpp"                // OutputWriter
+#include "../radiation_integrator/radiation_integrator.hpp"  // RadiationIntegrator
+#include "../simulation_reader/simulation_reader.hpp"        // SimulationReader
+
+//--------------------------------------------------------------------------------------------------
+
+// Render server
+struct RenderServer
+{
+  // Constructors and destructor
+  RenderServer(InputReader *p_input_reader_, GeodesicIntegrator **p_p_geodesic_integrator_,
+      SimulationReader *p_simulation_reader_, RadiationIntegrator **p_p_radiation_integrator_);
+  RenderServer(const RenderServer &source) = delete;
+  RenderServer &operator=(const RenderServer &source) = delete;
+  ~RenderServer() = default;
+
+  // Pointers to other objects
+  InputReader *p_input_reader;
+  GeodesicIntegrator **p_p_geodesic_integrator;
+  SimulationReader *p_simulation_reader;
+  RadiationIntegrator **p_p_radiation_integrator;
+
+  // Input data - general
+  ModelType model_type;
+
+  // Input data - server parameters
+  std::string server_job_dir;
+  double server_poll;
+
+  // Input data - adaptive parameters
+  int adaptive_max_level;
+  bool adaptive_progressive;
+
+  // State
+  int snapshot = -1;
+  bool image_ready = false;
+
+  // Timing data
+  double time_geodesic = 0.0;
+  double time_read = 0.0;
+  double time_sample = 0.0;
+  double time_image = 0.0;
+  double time_render = 0.0;
+
+  // External functions
+  void Serve();
+
+  // Internal functions
+  std::vector<std::string> FindJobs() const;
+  bool RunJob(const std::string &job_file);
+  void IntegrateImage(bool plasma_only, OutputWriter *p_output_writer);
+  static void FileJob(const std::string &job_file, const std::string &extension,
+      const char *message);
+};
+
+#endif
@@ -0,0 +1,50 @@
+// Blacklight simulation reader - selection of blocks to read
+
+// C++ headers
+#include <iostream>  // cout
+
+// Blacklight headers
+#include "simulation_reader.hpp"
+#include "../blacklight.hpp"                                 // enums
+#include "../radiation_integrator/radiation_integrator.hpp"  // RadiationIntegrator
+#include "../utils/array.hpp"                                // Array
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for restricting subsequent reads to blocks needed by cameras
+// Inputs:
+//   p_radiation_integrators: array of pointers to objects that have sampled simulation
+//   num_cameras: number of radiation integrators
+// Outputs: (none)
+// Notes:
+//   Does nothing unless simulation_block_select == true, and only acts on first call.
+//   Assumes each radiation integrator has calculated its root-level sampling.
+//   Allocates and initializes block_selection.
+//   Blocks not selected will keep stale values in later snapshots, and they must not be sampled.
+void SimulationReader::SelectBlocks(const RadiationIntegrator *const *p_radiation_integrators,
+    int num_cameras)
+{
+  // Only proceed if needed
+  if (model_type != ModelType::simulation or not simulation_block_select or block_selection_set)
+    return;
+
+  // Wait for any reading in progress
+  FinishPrefetch();
+
+  // Collect blocks sampled by any camera
+  int num_blocks = levels.n1;
+  block_selection.Allocate(num_blocks);
+  block_selection.Zero();
+  for (int camera_num = 0; camera_num < num_cameras; camera_num++)
+    p_radiation_integrators[camera_num]->MarkSampledBlocks(block_selection);
+  block_selection_set = true;
+
+  // Report selection
+  int num_selected = 0;
+  for (int block = 0; block < num_blocks; block++)
+    if (block_selection(block))
+      num_selected++;
+  std::cout << "Reading " << num_selected << " of " << num_blocks;
+  std::cout << " blocks from subsequent files.\n";
+  return;
+}
@@ -0,0 +1,374 @@
+// Blacklight simulation reader - reduced-precision storage of primitives
+
+// C++ headers
+#include <algorithm>  // max, min
+#include <cmath>      // abs, exp, isfinite, isnan, log, round
+#include <cstdint>    // uint32_t
+#include <cstring>    // memcpy
+#include <iostream>   // cout
+#include <limits>     // numeric_limits
+#include <string>     // string, to_string
+
+// Library headers
+#include <omp.h>  // pragmas
+
+// Blacklight headers
+#include "simulation_reader.hpp"
+#include "../blacklight.hpp"   // enums
+#include "../utils/array.hpp"  // Array
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for allocating arrays of primitives
+// Inputs:
+//   n5, n4, n3, n2, n1: dimensions of array of primitives
+// Outputs: (none)
+// Notes:
+//   If simulation_precision == PrimitivePrecision::single, allocates all num_buffers prim arrays.
+//   Otherwise allocates prim[0] as staging buffer for reading, as well as all num_buffers
+//       prim_compact arrays, plus all num_buffers prim_scale arrays if
+//       simulation_precision == PrimitivePrecision::scaled16.
+void SimulationReader::AllocatePrimitives(int n5, int n4, int n3, int n2, int n1)
+{
+  // Allocate full-precision arrays
+  if (simulation_precision == PrimitivePrecision::single)
+  {
+    for (int n = 0; n < num_buffers; n++)
+      prim[n].Allocate(n5, n4, n3, n2, n1);
+    return;
+  }
+
+  // Allocate reduced-precision arrays
+  prim[0].Allocate(n5, n4, n3, n2, n1);
+  for (int n = 0; n < num_buffers; n++)
+  {
+    prim_compact[n].Allocate(n5, n4, n3, n2, n1);
+    if (simulation_precision == PrimitivePrecision::scaled16)
+      prim_scale[n].Allocate(n5, n4, 2);
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for exchanging two slots of primitives
+// Inputs:
+//   n_a, n_b: indices of slots to exchange
+// Outputs: (none)
+// Notes:
+//   Swaps prim arrays if simulation_precision == PrimitivePrecision::single, and otherwise swaps
+//       prim_compact (and if needed prim_scale) arrays, leaving staging buffer prim[0] in place.
+void SimulationReader::SwapPrimitives(int n_a, int n_b)
+{
+  if (simulation_precision == PrimitivePrecision::single)
+    prim[n_a].Swap(prim[n_b]);
+  else
+  {
+    prim_compact[n_a].Swap(prim_compact[n_b]);
+    if (simulation_precision == PrimitivePrecision::scaled16)
+      prim_scale[n_a].Swap(prim_scale[n_b]);
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for compressing primitives that have just been read
+// Inputs:
+//   n: index of prim_compact and prim_scale arrays to fill
+// Outputs: (none)
+// Notes:
+//   Assumes prim[0] has been filled with primitives in single precision.
+//   Skips blocks not selected if block_selection_set == true, leaving their values stale.
+//   For PrimitivePrecision::bf16, rounds each value to nearest bfloat16 (1 sign, 8 exponent, and
+//       7 mantissa bits), ties to even.
+//   For PrimitivePrecision::scaled16, quantizes each quantity in each block separately to 16 bits:
+//     Density and pressure are scaled logarithmically between their extreme positive values, with
+//         code 0 reserved for nonpositive and non-finite values, which decode to 0.
+//     Other quantities are scaled linearly between their extreme finite values, with non-finite
+//         values mapped to the minimum.
+//     Offsets and steps are stored in prim_scale[n].
+//   Reports accuracy of compression on first call.
+void SimulationReader::CompressPrimitives(int n)
+{
+  // Extract dimensions
+  const Array<float> &values = prim[0];
+  Array<unsigned short int> &codes = prim_compact[n];
+  int n_v = values.n5;
+  int n_b = values.n4;
+  int n_k = values.n3;
+  long int row_size = static_cast<long int>(values.n2) * values.n1;
+
+  // Round to bfloat16
+  if (simulation_precision == PrimitivePrecision::bf16)
+  {
+    #pragma omp parallel for schedule(static) collapse(3)
+    for (int v = 0; v < n_v; v++)
+      for (int b = 0; b < n_b; b++)
+        for (int k = 0; k < n_k; k++)
+        {
+          if (block_selection_set and not block_selection(b))
+            continue;
+          long int row_offset = ((static_cast<long int>(v) * n_b + b) * n_k + k) * row_size;
+          const float *p_values = values.data + row_offset;
+          unsigned short int *p_codes = codes.data + row_offset;
+          for (long int ind = 0; ind < row_size; ind++)
+            p_codes[ind] = EncodeBF16(p_values[ind]);
+        }
+  }
+
+  // Quantize with per-block scaling
+  else
+  {
+    // Find extrema of each row
+    Array<float> row_extrema;
+    row_extrema.Allocate(n_v, n_b, n_k, 2);
+    #pragma omp parallel for schedule(static) collapse(3)
+    for (int v = 0; v < n_v; v++)
+      for (int b = 0; b < n_b; b++)
+        for (int k = 0; k < n_k; k++)
+        {
+          if (block_selection_set and not block_selection(b))
+            continue;
+          bool log_scale = v == ind_rho or v == ind_pgas;
+          long int row_offset = ((static_cast<long int>(v) * n_b + b) * n_k + k) * row_size;
+          const float *p_values = values.data + row_offset;
+          float val_min = std::numeric_limits<float>::infinity();
+          float val_max = -std::numeric_limits<float>::infinity();
+          for (long int ind = 0; ind < row_size; ind++)
+          {
+            float val = p_values[ind];
+            if (not std::isfinite(val) or (log_scale and val <= 0.0f))
+              continue;
+            val_min = std::min(val_min, val);
+            val_max = std::max(val_max, val);
+          }
+          row_extrema(v,b,k,0) = val_min;
+          row_extrema(v,b,k,1) = val_max;
+        }
+
+    // Calculate scaling for each block
+    Array<float> &scales = prim_scale[n];
+    for (int v = 0; v < n_v; v++)
+      for (int b = 0; b < n_b; b++)
+      {
+        if (block_selection_set and not block_selection(b))
+          continue;
+        bool log_scale = v == ind_rho or v == ind_pgas;
+        float val_min = std::numeric_limits<float>::infinity();
+        float val_max = -std::numeric_limits<float>::infinity();
+        for (int k = 0; k < n_k; k++)
+        {
+          val_min = std::min(val_min, row_extrema(v,b,k,0));
+          val_max = std::max(val_max, row_extrema(v,b,k,1));
+        }
+        double offset = 0.0;
+        double step = 0.0;
+        if (val_min <= val_max and log_scale)
+        {
+          offset = std::log(static_cast<double>(val_min));
+          step = (std::log(static_cast<double>(val_max)) - offset) / 65534.0;
+        }
+        else if (val_min <= val_max)
+        {
+          offset = static_cast<double>(val_min);
+          step = (static_cast<double>(val_max) - offset) / 65535.0;
+        }
+        scales(v,b,0) = static_cast<float>(offset);
+        scales(v,b,1) = static_cast<float>(step);
+      }
+    row_extrema.Deallocate();
+
+    // Quantize values
+    #pragma omp parallel for schedule(static) collapse(3)
+    for (int v = 0; v < n_v; v++)
+      for (int b = 0; b < n_b; b++)
+        for (int k = 0; k < n_k; k++)
+        {
+          if (block_selection_set and not block_selection(b))
+            continue;
+          bool log_scale = v == ind_rho or v == ind_pgas;
+          double offset = static_cast<double>(scales(v,b,0));
+          double step = static_cast<double>(scales(v,b,1));
+          double code_max = log_scale ? 65534.0 : 65535.0;
+          double code_start = log_scale ? 1.0 : 0.0;
+          long int row_offset = ((static_cast<long int>(v) * n_b + b) * n_k + k) * row_size;
+          const float *p_values = values.data + row_offset;
+          unsigned short int *p_codes = codes.data + row_offset;
+          for (long int ind = 0; ind < row_size; ind++)
+          {
+            float val = p_values[ind];
+            if (not std::isfinite(val) or (log_scale and val <= 0.0f))
+            {
+              p_codes[ind] = 0;
+              continue;
+            }
+            double val_scaled = static_cast<double>(val);
+            if (log_scale)
+              val_scaled = std::log(val_scaled);
+            double code = step > 0.0 ? std::round((val_scaled - offset) / step) : 0.0;
+            code = std::min(std::max(code, 0.0), code_max) + code_start;
+            p_codes[ind] = static_cast<unsigned short int>(code);
+          }
+        }
+  }
+
+  // Report accuracy
+  if (first_time)
+    ReportCompression(n);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for reporting accuracy of compressed primitives
+// Inputs:
+//   n: index of prim_compact and prim_scale arrays to check
+// Outputs: (none)
+// Notes:
+//   Assumes prim[0] still holds values compressed into prim_compact[n] and prim_scale[n].
+//   Reports maximum relative error for density and pressure, and maximum error relative to
+//       largest magnitude for other quantities, considering only finite values.
+void SimulationReader::ReportCompression(int n) const
+{
+  // Extract dimensions
+  const Array<float> &values = prim[0];
+  const Array<unsigned short int> &codes = prim_compact[n];
+  int n_v = values.n5;
+  int n_b = values.n4;
+  long int block_size = static_cast<long int>(values.n3) * values.n2 * values.n1;
+
+  // Report memory
+  std::cout << "Storing primitives in "
+      << (simulation_precision == PrimitivePrecision::bf16 ? "bf16" : "scaled16")
+      << " format: 2 bytes per value rather than 4.\n";
+
+  // Calculate errors for each quantity
+  for (int v = 0; v < n_v; v++)
+  {
+    bool relative = v == ind_rho or v == ind_pgas;
+    double err_max = 0.0;
+    double val_max = 0.0;
+    #pragma omp parallel for schedule(static) reduction(max: err_max, val_max)
+    for (int b = 0; b < n_b; b++)
+    {
+      if (block_selection_set and not block_selection(b))
+        continue;
+      long int block_offset = (static_cast<long int>(v) * n_b + b) * block_size;
+      const float *p_values = values.data + block_offset;
+      const unsigned short int *p_codes = codes.data + block_offset;
+      for (long int ind = 0; ind < block_size; ind++)
+      {
+        double val = static_cast<double>(p_values[ind]);
+        if (not std::isfinite(val))
+          continue;
+        double val_decoded = static_cast<double>(simulation_precision == PrimitivePrecision::bf16
+            ? DecodeBF16(p_codes[ind])
+            : DecodeScaled16(p_codes[ind], prim_scale[n](v,b,0), prim_scale[n](v,b,1), relative));
+        double err = std::abs(val_decoded - val);
+        if (relative and val > 0.0)
+          err /= val;
+        err_max = std::max(err_max, err);
+        val_max = std::max(val_max, std::abs(val));
+      }
+    }
+    if (not relative and val_max > 0.0)
+      err_max /= val_max;
+    std::cout << "  " << PrimitiveName(v) << ": maximum " << (relative ? "relative" : "scaled")
+        << " error " << err_max << "\n";
+  }
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for naming a primitive variable
+// Inputs:
+//   v: index of variable in prim arrays
+// Outputs:
+//   returned value: name of variable, following ind_* names
+// Notes:
+//   Assumes primitive indices have been set by reading the data file.
+//   Falls back to "variable v" for any index not used for a known quantity.
+std::string SimulationReader::PrimitiveName(int v) const
+{
+  if (v == ind_rho)
+    return "rho";
+  if (v == ind_pgas)
+    return "pgas";
+  if (v == ind_uu1)
+    return "uu1";
+  if (v == ind_uu2)
+    return "uu2";
+  if (v == ind_uu3)
+    return "uu3";
+  if (v == ind_bb1)
+    return "bb1";
+  if (v == ind_bb2)
+    return "bb2";
+  if (v == ind_bb3)
+    return "bb3";
+  if (plasma_model == PlasmaModel::code_kappa and v == ind_kappa)
+    return "kappa";
+  if (simulation_format == SimulationFormat::harm3d and v == ind_u0)
+    return "u0";
+  if (simulation_format == SimulationFormat::harm3d and v == ind_b0)
+    return "b0";
+  return "variable " + std::to_string(v);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for rounding a value to bfloat16
+// Inputs:
+//   value: value to round
+// Outputs:
+//   returned value: upper 16 bits of nearest representable value
+// Notes:
+//   Rounds ties to even, and keeps NaN values as quiet NaN values.
+unsigned short int SimulationReader::EncodeBF16(float value)
+{
+  std::uint32_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  if (std::isnan(value))
+    return static_cast<unsigned short int>(bits >> 16 | 0x0040u);
+  bits += 0x7fffu + (bits >> 16 & 1u);
+  return static_cast<unsigned short int>(bits >> 16);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for expanding a bfloat16 value
+// Inputs:
+//   code: upper 16 bits of value
+// Outputs:
+//   returned value: value in single precision
+float SimulationReader::DecodeBF16(unsigned short int code)
+{
+  std::uint32_t bits = static_cast<std::uint32_t>(code) << 16;
+  float value = 0.0f;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for expanding a value quantized with per-block scaling
+// Inputs:
+//   code: quantized value
+//   offset: value (or logarithm of value) corresponding to lowest code
+//   step: spacing of codes
+//   log_scale: flag indicating codes are spaced logarithmically
+// Outputs:
+//   returned value: value in single precision
+// Notes:
+//   See CompressPrimitives().
+float SimulationReader::DecodeScaled16(unsigned short int code, float offset, float step,
+    bool log_scale)
+{
+  if (not log_scale)
+    return offset + step * static_cast<float>(code);
+  if (code == 0)
+    return 0.0f;
+  return std::exp(offset + step * static_cast<float>(code - 1));
+}
@@ -1,7 +1,8 @@
 // Blacklight simulation reader - HDF5 interface for reading arrays
 
 // C++ headers
-#include <cstring>  // memcpy
+#include <cstring>  // memcpy, size_t
+#include <ios>      // streamoff
 #include <string>   // string
 
 // Library headers
@@ -79,6 +80,7 @@ void SimulationReader::ReadHDF5IntArray(const char *name, Array<int> &int_array)
 //   float_array: array allocated and set (indirectly)
 // Notes:
 //   Changes stream pointer.
+//   Reads raw data directly into array memory, without an intermediate buffer.
 void SimulationReader::ReadHDF5FloatArray(const char *name, Array<float> &float_array)
 {
   // Locate header
@@ -86,19 +88,139 @@ void SimulationReader::ReadHDF5FloatArray(const char *name, Array<float> &float_
       ReadHDF5DatasetHeaderAddress(name, root_btree_address, root_data_segment_address);
 
   // Read header
-  unsigned char *datatype_raw, *dataspace_raw, *data_raw;
-  ReadHDF5DataObjectHeader(header_address, &datatype_raw, &dataspace_raw, &data_raw);
+  unsigned char *datatype_raw, *dataspace_raw;
+  unsigned long int data_address, data_size;
+  ReadHDF5DataObjectHeader(header_address, &datatype_raw, &dataspace_raw, &data_address,
+      &data_size);
 
-  // Set array
-  SetHDF5FloatArray(datatype_raw, dataspace_raw, data_raw, float_array);
+  // Prepare array
+  bool rev_endian = PrepareHDF5FloatArray(datatype_raw, dataspace_raw, float_array);
   delete[] datatype_raw;
   delete[] dataspace_raw;
-  delete[] data_raw;
+  if (data_size != static_cast<unsigned long int>(float_array.n_tot) * sizeof(float))
+    throw BlacklightException("HDF5 dataset size inconsistent with dataspace.");
+
+  // Read data
+  data_stream.seekg(static_cast<std::streamoff>(data_address));
+  data_stream.read(reinterpret_cast<char *>(float_array.data),
+      static_cast<std::streamoff>(data_size));
+  if (not data_stream)
+    throw BlacklightException("Could not read HDF5 dataset.");
+  if (rev_endian)
+    ReverseHDF5FloatBytes(float_array);
   return;
 }
 
 //--------------------------------------------------------------------------------------------------
 
+// Function to read selected blocks of float array dataset from HDF5 file by name
+// Inputs:
+//   name: name of dataset
+//   block_flags: flags indicating which blocks (second-slowest index) should be read
+// Outputs:
+//   float_array: array set (indirectly)
+// Notes:
+//   Changes stream pointer.
+//   Assumes float_array has already been allocated with 5 dimensions matching the dataset.
+//   Reads each contiguous run of selected blocks for each variable directly into array memory;
+//       values for other blocks are left unchanged, up to byte reversal.
+void SimulationReader::ReadHDF5FloatArray(const char *name, Array<float> &float_array,
+    const Array<bool> &block_flags)
+{
+  // Locate header
+  unsigned long int header_address =
+      ReadHDF5DatasetHeaderAddress(name, root_btree_address, root_data_segment_address);
+
+  // Read header
+  unsigned char *datatype_raw, *dataspace_raw;
+  unsigned long int data_address, data_size;
+  ReadHDF5DataObjectHeader(header_address, &datatype_raw, &dataspace_raw, &data_address,
+      &data_size);
+
+  // Check array
+  if (not float_array.allocated or float_array.n4 != block_flags.n1)
+    throw BlacklightException("Array dimension mismatch.");
+  bool rev_endian = PrepareHDF5FloatArray(datatype_raw, dataspace_raw, float_array);
+  delete[] datatype_raw;
+  delete[] dataspace_raw;
+  if (data_size != static_cast<unsigned long int>(float_array.n_tot) * sizeof(float))
+    throw BlacklightException("HDF5 dataset size inconsistent with dataspace.");
+
+  // Read data
+  int num_vars = float_array.n5;
+  int num_blocks = float_array.n4;
+  long int block_size = static_cast<long int>(float_array.n3) * float_array.n2 * float_array.n1;
+  for (int n_variable = 0; n_variable < num_vars; n_variable++)
+    for (int block_start = 0; block_start < num_blocks; block_start++)
+    {
+      if (not block_flags(block_start))
+        continue;
+      int block_end = block_start + 1;
+      while (block_end < num_blocks and block_flags(block_end))
+        block_end++;
+      long int offset = (static_cast<long int>(n_variable) * num_blocks + block_start) * block_size;
+      long int length = (block_end - block_start) * block_size;
+      data_stream.seekg(static_cast<std::streamoff>(data_address
+          + static_cast<unsigned long int>(offset) * sizeof(float)));
+      data_stream.read(reinterpret_cast<char *>(float_array.data + offset),
+          static_cast<std::streamoff>(static_cast<unsigned long int>(length) * sizeof(float)));
+      block_start = block_end;
+    }
+  if (not data_stream)
+    throw BlacklightException("Could not read HDF5 dataset.");
+  if (rev_endian)
+    ReverseHDF5FloatBytes(float_array);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function to locate 4D float array dataset in HDF5 file by name without reading it
+// Inputs:
+//   name: name of dataset
+//   n4, n3, n2, n1: expected dimensions of dataset, from slowest to fastest
+// Outputs:
+//   returned value: flag indicating data has reversed byte order
+//   *p_data_address: file offset of first byte of contiguous data
+// Notes:
+//   Changes stream pointer.
+//   Allows callers to read raw data directly from the file in their own order.
+bool SimulationReader::LocateHDF5FloatArray(const char *name, int n4, int n3, int n2, int n1,
+    unsigned long int *p_data_address)
+{
+  // Locate header
+  unsigned long int header_address =
+      ReadHDF5DatasetHeaderAddress(name, root_btree_address, root_data_segment_address);
+
+  // Read header
+  unsigned char *datatype_raw, *dataspace_raw;
+  unsigned long int data_address, data_size;
+  ReadHDF5DataObjectHeader(header_address, &datatype_raw, &dataspace_raw, &data_address,
+      &data_size);
+
+  // Check datatype and dimensions
+  bool rev_endian = CheckHDF5FloatDatatype(datatype_raw);
+  unsigned long int *dims;
+  int num_dims;
+  ReadHDF5DataspaceDims(dataspace_raw, &dims, &num_dims);
+  delete[] datatype_raw;
+  delete[] dataspace_raw;
+  bool dims_match = num_dims == 4 and dims[0] == static_cast<unsigned long int>(n4)
+      and dims[1] == static_cast<unsigned long int>(n3)
+      and dims[2] == static_cast<unsigned long int>(n2)
+      and dims[3] == static_cast<unsigned long int>(n1);
+  delete[] dims;
+  if (not dims_match)
+    throw BlacklightException("Array dimension mismatch.");
+  if (data_size != static_cast<unsigned long int>(n4) * static_cast<unsigned long int>(n3)
+      * static_cast<unsigned long int>(n2) * static_cast<unsigned long int>(n1) * sizeof(float))
+    throw BlacklightException("HDF5 dataset size inconsistent with dataspace.");
+  *p_data_address = data_address;
+  return rev_endian;
+}
+
+//--------------------------------------------------------------------------------------------------
+
 // Function to read float array dataset into double Array from HDF5 file by name
 // Inputs:
 //   name: name of dataset
@@ -352,11 +474,33 @@ void SimulationReader::SetHDF5IntArray(const unsigned char *datatype_raw,
 // Outputs:
 //   float_array: array allocated (if not already allocated) and set
 // Notes:
+//   Same restrictions as PrepareHDF5FloatArray() apply.
+void SimulationReader::SetHDF5FloatArray(const unsigned char *datatype_raw,
+    const unsigned char *dataspace_raw, const unsigned char *data_raw, Array<float> &float_array)
+{
+  // Prepare array
+  bool rev_endian = PrepareHDF5FloatArray(datatype_raw, dataspace_raw, float_array);
+
+  // Initialize array
+  std::memcpy(float_array.data, data_raw,
+      static_cast<std::size_t>(float_array.n_tot) * sizeof(float));
+  if (rev_endian)
+    ReverseHDF5FloatBytes(float_array);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function to check 4-byte floating point datatype of HDF5 dataset
+// Inputs:
+//   datatype_raw: raw datatype description
+// Outputs:
+//   returned value: flag indicating data has reversed byte order
+// Notes:
 //   Must have datatype version 1.
 //   Must be standard 4-byte floats.
 //   Must be run on little-endian machine.
-void SimulationReader::SetHDF5FloatArray(const unsigned char *datatype_raw,
-    const unsigned char *dataspace_raw, const unsigned char *data_raw, Array<float> &float_array)
+bool SimulationReader::CheckHDF5FloatDatatype(const unsigned char *datatype_raw)
 {
   // Check datatype version and class
   int offset = 0;
@@ -402,6 +546,25 @@ void SimulationReader::SetHDF5FloatArray(const unsigned char *datatype_raw,
   if (class_2 != 31 or bit_offset != 0 or bit_precision != 32 or exp_loc != 23 or exp_size != 8
       or man_loc != 0 or man_size != 23 or exp_bias != 127)
     throw BlacklightException("Unexpected HDF5 single-precision floating-point bit layout.");
+  return rev_endian;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function to check and allocate 4-byte floating point array for HDF5 dataset
+// Inputs:
+//   datatype_raw: raw datatype description
+//   dataspace_raw: raw dataspace description
+// Outputs:
+//   returned value: flag indicating data has reversed byte order
+//   float_array: array allocated (if not already allocated)
+// Notes:
+//   Datatype must satisfy CheckHDF5FloatDatatype().
+bool SimulationReader::PrepareHDF5FloatArray(const unsigned char *datatype_raw,
+    const unsigned char *dataspace_raw, Array<float> &float_array)
+{
+  // Check datatype
+  bool rev_endian = CheckHDF5FloatDatatype(datatype_raw);
 
   // Read dimensions
   unsigned long int *dims;
@@ -447,27 +610,31 @@ void SimulationReader::SetHDF5FloatArray(const unsigned char *datatype_raw,
   else
     throw BlacklightException("Unexpected HDF5 floating-point array size.");
   delete[] dims;
+  return rev_endian;
+}
 
-  // Work in parallel
-  #pragma omp parallel
-  {
-    // Allocate buffer
-    char *buffer = new char[size];
-
-    // Initialize array
-    #pragma omp for schedule(static)
-    for (unsigned int n = 0; n < num_elements; n++)
-    {
-      if (rev_endian)
-        for (unsigned int m = 0; m < size; m++)
-          std::memcpy(buffer + size - 1 - m, data_raw + n * size + m, 1);
-      else
-        std::memcpy(buffer, data_raw + n * size, size);
-      float_array(n) = *reinterpret_cast<float *>(buffer);
-    }
+//--------------------------------------------------------------------------------------------------
 
-    // Free buffer
-    delete[] buffer;
+// Function to reverse byte order of 4-byte floating point array in place
+// Inputs:
+//   float_array: array with reversed byte order
+// Outputs:
+//   float_array: array with native byte order
+// Notes:
+//   Works on individual bytes so as to be safe under strict aliasing and vectorizable.
+void SimulationReader::ReverseHDF5FloatBytes(Array<float> &float_array)
+{
+  unsigned char *bytes = reinterpret_cast<unsigned char *>(float_array.data);
+  long int num_elements = float_array.n_tot;
+  #pragma omp parallel for simd schedule(static)
+  for (long int n = 0; n < num_elements; n++)
+  {
+    unsigned char byte_0 = bytes[4*n];
+    unsigned char byte_1 = bytes[4*n+1];
+    bytes[4*n] = bytes[4*n+3];
+    bytes[4*n+1] = bytes[4*n+2];
+    bytes[4*n+2] = byte_1;
+    bytes[4*n+3] = byte_0;
   }
   return;
 }
@@ -3,6 +3,10 @@
 // C++ headers
 #include <algorithm>  // min
 #include <cmath>      // abs, cos, exp, log, pow, sin, sqrt
+#include <cstring>    // memcmp
+#include <fstream>    // ifstream, ofstream
+#include <ios>        // ios_base
+#include <string>     // string
 
 // Library headers
 #include <omp.h>  // pragmas
@@ -11,7 +15,8 @@
 #include "simulation_reader.hpp"
 #include "../blacklight.hpp"        // Math
 #include "../utils/array.hpp"       // Array
-#include "../utils/exceptions.hpp"  // BlacklightException
+#include "../utils/exceptions.hpp"  // BlacklightException, BlacklightWarning
+#include "../utils/file_io.hpp"     // ReadBinary, WriteBinary
 
 //--------------------------------------------------------------------------------------------------
 
@@ -326,9 +331,16 @@ void SimulationReader::ConvertPrimitives4(Array<float> &primitives)
 // Notes:
 //   Assumes all metric parameters have been loaded.
 //   Allocates and sets sks_map to save mapping.
-//   Operates in serial since it only needs to run once and is 2D.
+//   If simulation_sks_map_file is set, loads map from that file when it was generated with the same
+//       parameters, and otherwise saves newly generated map to that file.
+//   Bisection terminates after a data-dependent number of steps, so points are distributed over
+//       threads rather than vectorized.
 void SimulationReader::GenerateSKSMap(double r_in, double r_out)
 {
+  // Load map if possible
+  if (simulation_sks_map_file.has_value() and LoadSKSMap(r_in, r_out))
+    return;
+
   // Allocate map
   sks_map.Allocate(2, sks_map_n2, sks_map_n1);
 
@@ -342,16 +354,15 @@ void SimulationReader::GenerateSKSMap(double r_in, double r_out)
   sks_map_dr = dr;
   sks_map_dtheta = dtheta;
 
-  // Go through sample points in r
+  // Go through sample points
+  #pragma omp parallel for schedule(static) collapse(2)
   for (int i = 0; i < sks_map_n1; ++i)
-  {
-    // Calculate radial coordinates
-    double r = r_in + i * dr;
-    double x1 = log(r);
-
-    // Go through sample points in theta
     for (int j = 0; j < sks_map_n2; ++j)
     {
+      // Calculate radial coordinates
+      double r = r_in + i * dr;
+      double x1 = log(r);
+
       // Calculate polar coordinates
       double theta = std::min(j * dtheta, Math::pi);
       double x2 = 0.5;
@@ -402,7 +413,144 @@ void SimulationReader::GenerateSKSMap(double r_in, double r_out)
       sks_map(0,j,i) = x1;
       sks_map(1,j,i) = x2;
     }
+
+  // Save map
+  if (simulation_sks_map_file.has_value())
+    SaveSKSMap();
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for loading map between SKS and FMKS from file
+// Inputs:
+//   r_in: radial SKS coordinate for "inner edge" of coordinate map
+//   r_out: radial SKS coordinate for "outer edge" of coordinate map
+// Outputs:
+//   returned value: flag indicating map was loaded
+// Notes:
+//   Assumes all metric parameters have been loaded.
+//   On success, allocates and sets sks_map and sets sks_map_r_in, sks_map_r_out, sks_map_dr, and
+//       sks_map_dtheta.
+//   Returns false without changing state if file does not exist or was generated with different
+//       parameters.
+bool SimulationReader::LoadSKSMap(double r_in, double r_out)
+{
+  // Open file
+  std::ifstream map_stream(simulation_sks_map_file.value(),
+      std::ios_base::in | std::ios_base::binary);
+  if (not map_stream.is_open())
+    return false;
+
+  // Check format
+  char magic[8] = {};
+  char magic_expected[8] = {'B', 'L', 'S', 'K', 'S', 'M', 'A', 'P'};
+  ReadBinary(&map_stream, magic, 8);
+  int byte_order = 0;
+  ReadBinary(&map_stream, &byte_order);
+  if (not map_stream.good() or std::memcmp(magic, magic_expected, 8) != 0
+      or byte_order != 0x01020304)
+  {
+    BlacklightWarning("SKS map file has unrecognized format; generating new map.");
+    return false;
   }
+
+  // Check parameters
+  int num_params = 0;
+  ReadBinary(&map_stream, &num_params);
+  double params_file[sks_map_num_params];
+  double params[sks_map_num_params];
+  SetSKSMapParameters(r_in, r_out, params);
+  if (not map_stream.good() or num_params != sks_map_num_params)
+  {
+    BlacklightWarning("SKS map file has unrecognized format; generating new map.");
+    return false;
+  }
+  ReadBinary(&map_stream, params_file, sks_map_num_params);
+  if (not map_stream.good()
+      or std::memcmp(params_file, params, sizeof(double) * sks_map_num_params) != 0)
+  {
+    BlacklightWarning("SKS map file does not match metric; generating new map.");
+    return false;
+  }
+
+  // Read map
+  sks_map.Allocate(2, sks_map_n2, sks_map_n1);
+  ReadBinary(&map_stream, sks_map.data, sks_map.n_tot);
+  if (not map_stream.good())
+  {
+    sks_map.Deallocate();
+    BlacklightWarning("SKS map file is incomplete; generating new map.");
+    return false;
+  }
+
+  // Store parameters
+  sks_map_r_in = r_in;
+  sks_map_r_out = r_out;
+  sks_map_dr = (r_out - r_in) / (sks_map_n1 - 1);
+  sks_map_dtheta = Math::pi / (sks_map_n2 - 1);
+  return true;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for saving map between SKS and FMKS to file
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Assumes sks_map, sks_map_r_in, and sks_map_r_out have been set.
+//   Overwrites file specified by simulation_sks_map_file.
+//   File contains magic string, byte-order check, parameters set by SetSKSMapParameters(), and
+//       sks_map data, whose dimensions are among the parameters.
+void SimulationReader::SaveSKSMap()
+{
+  // Open file
+  std::ofstream map_stream(simulation_sks_map_file.value(),
+      std::ios_base::out | std::ios_base::binary);
+  if (not map_stream.is_open())
+    throw BlacklightException("Could not open SKS map file.");
+
+  // Write header
+  char magic[8] = {'B', 'L', 'S', 'K', 'S', 'M', 'A', 'P'};
+  WriteBinary(&map_stream, magic, 8);
+  WriteBinary(&map_stream, 0x01020304);
+  double params[sks_map_num_params];
+  SetSKSMapParameters(sks_map_r_in, sks_map_r_out, params);
+  WriteBinary(&map_stream, sks_map_num_params);
+  WriteBinary(&map_stream, params, sks_map_num_params);
+
+  // Write map
+  WriteBinary(&map_stream, sks_map.data, sks_map.n_tot);
+  if (not map_stream.good())
+    throw BlacklightException("Could not write SKS map file.");
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for collecting parameters that determine map between SKS and FMKS
+// Inputs:
+//   r_in: radial SKS coordinate for "inner edge" of coordinate map
+//   r_out: radial SKS coordinate for "outer edge" of coordinate map
+// Outputs:
+//   params: values of parameters
+// Notes:
+//   Spin does not enter the map and so is not included.
+void SimulationReader::SetSKSMapParameters(double r_in, double r_out,
+    double params[sks_map_num_params])
+{
+  int n = 0;
+  params[n++] = static_cast<double>(sks_map_n1);
+  params[n++] = static_cast<double>(sks_map_n2);
+  params[n++] = static_cast<double>(sks_map_max_iter);
+  params[n++] = sks_map_tol;
+  params[n++] = r_in;
+  params[n++] = r_out;
+  params[n++] = metric_h;
+  params[n++] = metric_r_in;
+  params[n++] = metric_poly_xt;
+  params[n++] = metric_poly_alpha;
+  params[n++] = metric_mks_smooth;
   return;
 }
 
@@ -1,21 +1,25 @@
 // Blacklight simulation reader
 
 // C++ headers
-#include <algorithm>  // remove
+#include <algorithm>  // min, remove
 #include <cctype>     // tolower
 #include <cmath>      // abs, pow
+#include <cstddef>    // size_t
 #include <cstdint>    // int32_t
 #include <cstdio>     // snprintf
-#include <cstring>    // strncmp, strtok
+#include <cstring>    // memcpy, strncmp, strtok
+#include <exception>  // current_exception, rethrow_exception
 #include <fstream>    // ifstream
 #include <ios>        // ios_base, streamoff
 #include <iosfwd>     // streampos
 #include <optional>   // optional
 #include <sstream>    // ostringstream
 #include <string>     // getline, stod, stoi, string
+#include <thread>     // thread
+#include <utility>    // swap
 
 // Library headers
-#include <omp.h>  // pragmas, omp_get_wtime
+#include <omp.h>  // pragmas, omp_get_wtime, omp_set_num_threads
 
 // Blacklight headers
 #include "simulation_reader.hpp"
@@ -23,7 +27,8 @@
 #include "../input_reader/input_reader.hpp"  // InputReader
 #include "../utils/array.hpp"                // Array
 #include "../utils/exceptions.hpp"           // BlacklightException, BlacklightWarning
-#include "../utils/file_io.hpp"              // ReadBinary
+#include "../utils/file_io.hpp"              // MapFile, OpenFileDescriptor, ReadFileRange
+#include "../utils/profiler.hpp"             // ProfileCounts, ProfileRecord, ProfileSnapshot
 
 //--------------------------------------------------------------------------------------------------
 
@@ -55,7 +60,29 @@ SimulationReader::SimulationReader(const InputReader *p_input_reader_)
         throw
             BlacklightException("Must have simulation_end at least as large as simulation_start.");
     }
+    simulation_block_select = false;
+    if (p_input_reader->simulation_block_select.has_value()
+        and p_input_reader->simulation_block_select.value())
+    {
+      if (simulation_multiple and (simulation_format == SimulationFormat::athena
+          or simulation_format == SimulationFormat::athenak)
+          and not (p_input_reader->adaptive_max_level.has_value()
+          and p_input_reader->adaptive_max_level.value() > 0))
+        simulation_block_select = true;
+      else
+        BlacklightWarning("Ignoring simulation_block_select selection.");
+    }
+    simulation_prefetch = false;
+    if (p_input_reader->simulation_prefetch.has_value())
+    {
+      if (simulation_multiple)
+        simulation_prefetch = p_input_reader->simulation_prefetch.value();
+      else if (p_input_reader->simulation_prefetch.value())
+        BlacklightWarning("Ignoring simulation_prefetch selection.");
+    }
     simulation_coord = p_input_reader->simulation_coord.value();
+    if (simulation_coord == Coordinates::fmks)
+      simulation_sks_map_file = p_input_reader->simulation_sks_map_file;
     simulation_a = p_input_reader->simulation_a.value();
     simulation_m_msun = p_input_reader->simulation_m_msun.value();
     simulation_rho_cgs = p_input_reader->simulation_rho_cgs.value();
@@ -84,6 +111,17 @@ SimulationReader::SimulationReader(const InputReader *p_input_reader_)
       and p_input_reader->slow_light_on.value())
     throw BlacklightException("Can only use slow light with simulation data.");
 
+  // Copy primitive storage parameters
+  simulation_precision = PrimitivePrecision::single;
+  if (p_input_reader->simulation_precision.has_value()
+      and p_input_reader->simulation_precision.value() != PrimitivePrecision::single)
+  {
+    if (model_type == ModelType::simulation and slow_light_on)
+      simulation_precision = p_input_reader->simulation_precision.value();
+    else
+      BlacklightWarning("Ignoring simulation_precision selection.");
+  }
+
   // Copy plasma parameters
   if (model_type == ModelType::simulation)
   {
@@ -151,14 +189,22 @@ SimulationReader::SimulationReader(const InputReader *p_input_reader_)
   num_arrays = 0;
   if (model_type == ModelType::simulation)
     num_arrays = slow_light_on ? slow_chunk_size : 1;
+  num_buffers = num_arrays;
+  if (model_type == ModelType::simulation and simulation_prefetch)
+    num_buffers++;
 
   // Allocate array of time values
-  if (num_arrays > 0)
-    time = new double[num_arrays];
+  if (num_buffers > 0)
+    time = new double[num_buffers];
 
   // Allocate arrays of Arrays of cell variables
-  if (num_arrays > 0)
-    prim = new Array<float>[num_arrays];
+  if (num_buffers > 0)
+  {
+    std::size_t num_buffers_alloc = static_cast<std::size_t>(num_buffers);
+    prim = new Array<float>[num_buffers_alloc];
+    prim_compact = new Array<unsigned short int>[num_buffers_alloc];
+    prim_scale = new Array<float>[num_buffers_alloc];
+  }
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -166,19 +212,24 @@ SimulationReader::SimulationReader(const InputReader *p_input_reader_)
 // Simulation reader destructor
 SimulationReader::~SimulationReader()
 {
-  if (model_type == ModelType::simulation and simulation_format == SimulationFormat::athenak
-      and athenak_variable_size == 8)
-    delete[] athenak_cell_data_double;
+  if (prefetch_thread.joinable())
+    prefetch_thread.join();
   if (num_dataset_names > 0)
     delete[] dataset_names;
   if (num_variable_names > 0)
     delete[] variable_names;
-  if (num_arrays > 0)
+  if (num_buffers > 0)
   {
-    for (int n = 0; n < num_arrays; n++)
+    for (int n = 0; n < num_buffers; n++)
+    {
       prim[n].Deallocate();
+      prim_compact[n].Deallocate();
+      prim_scale[n].Deallocate();
+    }
     delete[] time;
     delete[] prim;
+    delete[] prim_compact;
+    delete[] prim_scale;
   }
 }
 
@@ -197,6 +248,8 @@ SimulationReader::~SimulationReader()
 //   Initializes all member objects.
 //   Implements a subset of the HDF5 standard:
 //       portal.hdfgroup.org/display/HDF5/File+Format+Specification
+//   With simulation_prefetch, waits for any background read to finish, uses its data if it is the
+//       file needed, and before returning begins reading the next file in the background.
 double SimulationReader::Read(int snapshot)
 {
   // Only proceed if needed
@@ -204,6 +257,9 @@ double SimulationReader::Read(int snapshot)
     return 0.0;
   double time_start = omp_get_wtime();
 
+  // Wait for any file being read in the background
+  FinishPrefetch();
+
   // Prepare default number of files to read
   int num_read = 1;
 
@@ -292,7 +348,7 @@ double SimulationReader::Read(int snapshot)
       num_read = latest_file_number - latest_file_number_old;
       for (int n = slow_chunk_size - 1; n >= num_read; n--)
       {
-        prim[n].Swap(prim[n-num_read]);
+        SwapPrimitives(n, n - num_read);
         time[n] = time[n-num_read];
       }
     }
@@ -310,562 +366,506 @@ double SimulationReader::Read(int snapshot)
   else
     latest_file_number = -1;
 
-  // Read new files
+  // Read new files, using prefetched data where available
   for (int n = 0; n < num_read; n++)
   {
-    // Determine file name
-    std::string simulation_file_formatted = simulation_file;
-    if (latest_file_number >= 0)
-      simulation_file_formatted = FormatFilename(latest_file_number - n);
-
-    // Open input file
-    data_stream =
-        std::ifstream(simulation_file_formatted, std::ios_base::in | std::ios_base::binary);
-    if (not data_stream.is_open())
-      throw BlacklightException("Could not open file for reading.");
-
-    // Read basic data about file
-    if (simulation_format == SimulationFormat::athena
-        or simulation_format == SimulationFormat::iharm3d)
-    {
-      ReadHDF5Superblock();
-      root_data_segment_address = ReadHDF5Heap(root_name_heap_address);
-      ReadHDF5RootObjectHeader();
-    }
-    else if (simulation_format == SimulationFormat::athenak)
+    // Swap in file read in background
+    int file_number = latest_file_number >= 0 ? latest_file_number - n : -1;
+    if (prefetch_ready and file_number == prefetch_file_number)
     {
-      ReadAthenaKHeader();
-      if (first_time)
-      {
-        VerifyVariablesAthenaK();
-        ReadAthenaKInputs();
-      }
+      SwapPrimitives(n, num_arrays);
+      time[n] = time[num_arrays];
+      prefetch_ready = false;
+      continue;
     }
 
-    // Read time
-    if (simulation_format == SimulationFormat::athena)
-    {
-      float time_temp;
-      ReadHDF5FloatAttribute("Time", &time_temp);
-      time[n] = time_temp;
-    }
-    else if (simulation_format == SimulationFormat::athenak)
-      time[n] = athenak_time;
-    else if (simulation_format == SimulationFormat::iharm3d)
+    // Read file directly
+    std::string simulation_file_formatted = simulation_file;
+    if (file_number >= 0)
+      simulation_file_formatted = FormatFilename(file_number);
+    ReadFile(n, simulation_file_formatted);
+  }
+
+  // Begin reading next file needed
+  if (simulation_prefetch and latest_file_number < simulation_end)
+    StartPrefetch(latest_file_number + 1);
+
+  // Calculate elapsed time
+  double time_end = omp_get_wtime();
+  ProfileRecord("Read", snapshot, -1, time_start, time_end, ProfileCounts());
+  return time_end - time_start;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for reading a single simulation file
+// Inputs:
+//   n: index of prim and time arrays to fill
+//   file_name: name of file to read
+// Outputs: (none)
+// Notes:
+//   Opens and closes stream for reading.
+//   On first call, initializes all member objects and allocates primitive arrays with
+//       AllocatePrimitives().
+//   If simulation_precision != PrimitivePrecision::single, reads into prim[0] and then compresses
+//       the values into prim_compact[n] and prim_scale[n].
+void SimulationReader::ReadFile(int n, const std::string &file_name)
+{
+  // Select array to read into
+  double time_start = omp_get_wtime();
+  int n_prim = simulation_precision == PrimitivePrecision::single ? n : 0;
+
+  // Open input file
+  data_stream = std::ifstream(file_name, std::ios_base::in | std::ios_base::binary);
+  if (not data_stream.is_open())
+    throw BlacklightException("Could not open file for reading.");
+
+  // Read basic data about file
+  if (simulation_format == SimulationFormat::athena
+      or simulation_format == SimulationFormat::iharm3d)
+  {
+    ReadHDF5Superblock();
+    root_data_segment_address = ReadHDF5Heap(root_name_heap_address);
+    ReadHDF5RootObjectHeader();
+  }
+  else if (simulation_format == SimulationFormat::athenak)
+  {
+    ReadAthenaKHeader();
+    if (first_time)
     {
-      Array<double> time_temp(1);
-      ReadHDF5DoubleArray("t", time_temp);
-      time[n] = time_temp(0);
+      VerifyVariablesAthenaK();
+      ReadAthenaKInputs();
     }
-    else if (simulation_format == SimulationFormat::harm3d)
-      data_stream >> time[n];
+  }
 
-    // Read metric
-    if (first_time and simulation_format == SimulationFormat::iharm3d)
+  // Read time
+  if (simulation_format == SimulationFormat::athena)
+  {
+    float time_temp;
+    ReadHDF5FloatAttribute("Time", &time_temp);
+    time[n] = time_temp;
+  }
+  else if (simulation_format == SimulationFormat::athenak)
+    time[n] = athenak_time;
+  else if (simulation_format == SimulationFormat::iharm3d)
+  {
+    Array<double> time_temp(1);
+    ReadHDF5DoubleArray("t", time_temp);
+    time[n] = time_temp(0);
+  }
+  else if (simulation_format == SimulationFormat::harm3d)
+    data_stream >> time[n];
+
+  // Read metric
+  if (first_time and simulation_format == SimulationFormat::iharm3d)
+  {
+    std::string *p_temp_metric;
+    int temp_count;
+    ReadHDF5StringArray("header/metric", true, &p_temp_metric, &temp_count);
+    metric = *p_temp_metric;
+    delete[] p_temp_metric;
+    if (simulation_coord == Coordinates::sks or simulation_coord == Coordinates::fmks)
     {
-      std::string *p_temp_metric;
-      int temp_count;
-      ReadHDF5StringArray("header/metric", true, &p_temp_metric, &temp_count);
-      metric = *p_temp_metric;
-      delete[] p_temp_metric;
-      if (simulation_coord == Coordinates::sks or simulation_coord == Coordinates::fmks)
+      std::string metric_lower = metric;
+      for (unsigned int c = 0; c < metric_lower.size(); c++)
+        metric_lower[c] = static_cast<char>(std::tolower(metric_lower[c]));
+      if (metric != "MKS" and metric != "MMKS" and metric != "FMKS")
       {
-        std::string metric_lower = metric;
-        for (unsigned int c = 0; c < metric_lower.size(); c++)
-          metric_lower[c] = static_cast<char>(std::tolower(metric_lower[c]));
-        if (metric != "MKS" and metric != "MMKS" and metric != "FMKS")
-        {
-          std::ostringstream message;
-          message << "Given metric mks does not match file value of " << metric;
-          message << "; ignoring the latter.";
-          BlacklightWarning(message.str().c_str());
-        }
-        Array<double> a_temp, h_temp;
-        ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/a").c_str(), a_temp);
-        ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/hslope").c_str(), h_temp);
-        metric_a = a_temp(0);
-        if (metric_a != simulation_a)
+        std::ostringstream message;
+        message << "Given metric mks does not match file value of " << metric;
+        message << "; ignoring the latter.";
+        BlacklightWarning(message.str().c_str());
+      }
+      Array<double> a_temp, h_temp;
+      ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/a").c_str(), a_temp);
+      ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/hslope").c_str(), h_temp);
+      metric_a = a_temp(0);
+      if (metric_a != simulation_a)
+      {
+        std::ostringstream message;
+        message << "Given spin of " << simulation_a << " does not match file value of ";
+        message << metric_a << "; ignoring the latter.";
+        BlacklightWarning(message.str().c_str());
+      }
+      metric_h = h_temp(0);
+      if (metric == "MMKS" or metric == "FMKS")
+      {
+        Array<double> rin_temp, poly_xt_temp, poly_alpha_temp, mks_smooth_temp;
+        try
         {
-          std::ostringstream message;
-          message << "Given spin of " << simulation_a << " does not match file value of ";
-          message << metric_a << "; ignoring the latter.";
-          BlacklightWarning(message.str().c_str());
+          ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/r_in").c_str(), rin_temp);
         }
-        metric_h = h_temp(0);
-        if (metric == "MMKS" or metric == "FMKS")
+        catch (...)
         {
-          Array<double> rin_temp, poly_xt_temp, poly_alpha_temp, mks_smooth_temp;
           try
           {
-            ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/r_in").c_str(), rin_temp);
+            ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/Rin").c_str(), rin_temp);
           }
           catch (...)
           {
-            try
-            {
-              ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/Rin").c_str(), rin_temp);
-            }
-            catch (...)
-            {
-              throw BlacklightException(
-                  "Unable to identify r_in parameter for iharm3d-format file.");
-            }
+            throw BlacklightException(
+                "Unable to identify r_in parameter for iharm3d-format file.");
           }
-          ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/poly_xt").c_str(), poly_xt_temp);
-          ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/poly_alpha").c_str(),
-              poly_alpha_temp);
-          ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/mks_smooth").c_str(),
-              mks_smooth_temp);
-          metric_r_in = rin_temp(0);
-          metric_poly_xt = poly_xt_temp(0);
-          metric_poly_alpha = poly_alpha_temp(0);
-          metric_mks_smooth = mks_smooth_temp(0);
-          metric_derived_poly_norm =
-              (metric_poly_alpha + 1.0) * std::pow(metric_poly_xt, metric_poly_alpha);
-          metric_derived_poly_norm =
-              0.5 * Math::pi * metric_derived_poly_norm / (metric_derived_poly_norm + 1.0);
         }
+        ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/poly_xt").c_str(), poly_xt_temp);
+        ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/poly_alpha").c_str(),
+            poly_alpha_temp);
+        ReadHDF5DoubleArray(("header/geom/" + metric_lower + "/mks_smooth").c_str(),
+            mks_smooth_temp);
+        metric_r_in = rin_temp(0);
+        metric_poly_xt = poly_xt_temp(0);
+        metric_poly_alpha = poly_alpha_temp(0);
+        metric_mks_smooth = mks_smooth_temp(0);
+        metric_derived_poly_norm =
+            (metric_poly_alpha + 1.0) * std::pow(metric_poly_xt, metric_poly_alpha);
+        metric_derived_poly_norm =
+            0.5 * Math::pi * metric_derived_poly_norm / (metric_derived_poly_norm + 1.0);
       }
-      else
-        throw BlacklightException("Invalid simulation_coord for Harm format.");
     }
+    else
+      throw BlacklightException("Invalid simulation_coord for Harm format.");
+  }
+
+  // Read AthenaK data
+  if (simulation_format == SimulationFormat::athenak)
+  {
+    // Read blocks
+    ReadAthenaKData(n_prim, file_name);
+
+    // Convert internal energy to pressure
+    #pragma omp parallel for schedule(static) collapse(3)
+    for (int block = 0; block < athenak_num_blocks; block++)
+      for (int k = 0; k < athenak_block_nz; k++)
+        for (int j = 0; j < athenak_block_ny; j++)
+          for (int i = 0; i < athenak_block_nx; i++)
+            if (not block_selection_set or block_selection(block))
+              prim[n_prim](ind_pgas,block,k,j,i) *= static_cast<float>(plasma_gamma - 1.0);
+  }
+
+  // Read block layout
+  if (first_time)
+  {
+    if (simulation_format == SimulationFormat::athena)
+    {
+      ReadHDF5IntArray("Levels", levels);
+      ReadHDF5IntArray("LogicalLocations", locations);
+    }
+    else if (simulation_format == SimulationFormat::iharm3d
+        or simulation_format == SimulationFormat::harm3d)
+    {
+      levels.Allocate(1);
+      levels(0) = 0;
+      locations.Allocate(1, 3);
+      locations(0,0) = 0;
+      locations(0,1) = 0;
+      locations(0,2) = 0;
+    }
+  }
 
-    // Read AthenaK data
-    if (simulation_format == SimulationFormat::athenak)
+  // Read coordinates
+  if (first_time)
+  {
+    if (simulation_format == SimulationFormat::athena)
     {
-      // Count blocks
-      if (first_time)
+      ReadHDF5FloatArray("x1f", x1f);
+      ReadHDF5FloatArray("x2f", x2f);
+      ReadHDF5FloatArray("x3f", x3f);
+      ReadHDF5FloatArray("x1v", x1v);
+      ReadHDF5FloatArray("x2v", x2v);
+      ReadHDF5FloatArray("x3v", x3v);
+    }
+    else if (simulation_format == SimulationFormat::iharm3d)
+    {
+      Array<int> num_cells;
+      Array<double> x_start, dx;
+      ReadHDF5IntArray("header/n1", num_cells);
+      ReadHDF5DoubleArray("header/geom/startx1", x_start);
+      ReadHDF5DoubleArray("header/geom/dx1", dx);
+      x1f.Allocate(1, num_cells(0) + 1);
+      x1v.Allocate(1, num_cells(0));
+      x1f(0,0) = x_start(0);
+      for (int i = 0; i < num_cells(0); i++)
       {
-        data_stream.seekg(athenak_data_offset);
-        int32_t block_indices[6];
-        data_stream.read(reinterpret_cast<char *>(block_indices), 24);
-        athenak_block_nx = block_indices[1] - block_indices[0] + 1;
-        athenak_block_ny = block_indices[3] - block_indices[2] + 1;
-        athenak_block_nz = block_indices[5] - block_indices[4] + 1;
-        athenak_cells_per_block = athenak_block_nz * athenak_block_ny * athenak_block_nx;
-        athenak_block_size_bytes = 24 + 16 + 6 * athenak_location_size
-            + num_variable_names * athenak_cells_per_block * athenak_variable_size;
-        athenak_num_blocks = 0;
-        data_stream.seekg(athenak_data_offset);
-        while (not data_stream.eof())
-        {
-          data_stream.ignore(athenak_block_size_bytes);
-          athenak_num_blocks++;
-        }
+        x1f(0,i+1) = x_start(0) + (i + 1) * dx(0);
+        x1v(0,i) = 0.5 * (x1f(0,i) + x1f(0,i+1));
       }
-
-      // Allocate arrays
-      if (first_time)
+      ReadHDF5IntArray("header/n2", num_cells);
+      ReadHDF5DoubleArray("header/geom/startx2", x_start);
+      ReadHDF5DoubleArray("header/geom/dx2", dx);
+      x2f.Allocate(1, num_cells(0) + 1);
+      x2v.Allocate(1, num_cells(0));
+      x2f(0,0) = x_start(0);
+      for (int j = 0; j < num_cells(0); j++)
       {
-        levels.Allocate(athenak_num_blocks);
-        locations.Allocate(athenak_num_blocks, 3);
-        x1f.Allocate(athenak_num_blocks, athenak_block_nx + 1);
-        x2f.Allocate(athenak_num_blocks, athenak_block_ny + 1);
-        x3f.Allocate(athenak_num_blocks, athenak_block_nz + 1);
-        x1v.Allocate(athenak_num_blocks, athenak_block_nx);
-        x2v.Allocate(athenak_num_blocks, athenak_block_ny);
-        x3v.Allocate(athenak_num_blocks, athenak_block_nz);
-        int n5 = plasma_model == PlasmaModel::code_kappa ? 9 : 8;
-        for (int nn = 0; nn < num_read; nn++)
-          prim[nn].Allocate(n5, athenak_num_blocks, athenak_block_nz, athenak_block_ny,
-              athenak_block_nx);
+        x2f(0,j+1) = x_start(0) + (j + 1) * dx(0);
+        x2v(0,j) = 0.5 * (x2f(0,j) + x2f(0,j+1));
       }
-
-      // Go through blocks
-      for (int block = 0; block < athenak_num_blocks; block++)
+      ReadHDF5IntArray("header/n3", num_cells);
+      ReadHDF5DoubleArray("header/geom/startx3", x_start);
+      ReadHDF5DoubleArray("header/geom/dx3", dx);
+      x3f.Allocate(1, num_cells(0) + 1);
+      x3v.Allocate(1, num_cells(0));
+      x3f(0,0) = x_start(0);
+      for (int k = 0; k < num_cells(0); k++)
       {
-
-        // Seek to beginning of block
-        data_stream.seekg(athenak_data_offset);
-        std::streamoff offset = block * static_cast<std::streamoff>(athenak_block_size_bytes);
-        data_stream.seekg(offset, std::ios_base::cur);
-
-        // Skip block indices
-        data_stream.ignore(24);
-
-        // Read block layout
-        if (first_time)
-        {
-          data_stream.read(reinterpret_cast<char *>(&locations(block,0)), 12);
-          data_stream.read(reinterpret_cast<char *>(&levels(block)), 4);
-        }
-        else
-          data_stream.ignore(16);
-
-        // Read coordinates
-        if (first_time)
-        {
-          double face_coordinates[6];
-          if (athenak_location_size == 4)
-          {
-            float face_coordinates_single[6];
-            data_stream.read(reinterpret_cast<char *>(face_coordinates_single), 24);
-            for (int ind = 0; ind < 6; ind++)
-              face_coordinates[ind] = face_coordinates_single[ind];
-          }
-          else if (athenak_location_size == 8)
-            data_stream.read(reinterpret_cast<char *>(face_coordinates), 48);
-          x1f(block,0) = face_coordinates[0];
-          x1f(block,athenak_block_nx) = face_coordinates[1];
-          double dx = (face_coordinates[1] - face_coordinates[0]) / athenak_block_nx;
-          for (int i = 1; i < athenak_block_nx; i++)
-            x1f(block,i) = face_coordinates[0] + i * dx;
-          for (int i = 0; i < athenak_block_nx; i++)
-            x1v(block,i) = 0.5 * (x1f(block,i) + x1f(block,i+1));
-          x2f(block,0) = face_coordinates[2];
-          x2f(block,athenak_block_ny) = face_coordinates[3];
-          double dy = (face_coordinates[3] - face_coordinates[2]) / athenak_block_ny;
-          for (int j = 1; j < athenak_block_ny; j++)
-            x2f(block,j) = face_coordinates[2] + j * dy;
-          for (int j = 0; j < athenak_block_ny; j++)
-            x2v(block,j) = 0.5 * (x2f(block,j) + x2f(block,j+1));
-          x3f(block,0) = face_coordinates[4];
-          x3f(block,athenak_block_nz) = face_coordinates[5];
-          double dz = (face_coordinates[5] - face_coordinates[4]) / athenak_block_nz;
-          for (int k = 1; k < athenak_block_nz; k++)
-            x3f(block,k) = face_coordinates[4] + k * dz;
-          for (int k = 0; k < athenak_block_nz; k++)
-            x3v(block,k) = 0.5 * (x3f(block,k) + x3f(block,k+1));
-        }
-        else
-          data_stream.ignore(6 * athenak_location_size);
-
-        // Read cell data
-        if (first_time and athenak_variable_size == 8)
-          athenak_cell_data_double = new double[athenak_cells_per_block];
-        std::streampos cell_data_begin = data_stream.tellg();
-        int athenak_inds[8] = {athenak_ind_rho, athenak_ind_uu1, athenak_ind_uu2, athenak_ind_uu3,
-            athenak_ind_pgas, athenak_ind_bb1, athenak_ind_bb2, athenak_ind_bb3};
-        int prim_inds[8] =
-            {ind_rho, ind_uu1, ind_uu2, ind_uu3, ind_pgas, ind_bb1, ind_bb2, ind_bb3};
-        for (int ind_ind = 0; ind_ind < 8; ind_ind++)
-        {
-          data_stream.seekg(cell_data_begin);
-          offset = athenak_inds[ind_ind] * athenak_cells_per_block * athenak_variable_size;
-          data_stream.seekg(offset, std::ios_base::cur);
-          if (athenak_variable_size == 4)
-            data_stream.read(reinterpret_cast<char *>(&prim[n](prim_inds[ind_ind],block,0,0,0)),
-                athenak_cells_per_block * 4);
-          else if (athenak_variable_size == 8)
-          {
-            data_stream.read(reinterpret_cast<char *>(athenak_cell_data_double),
-                athenak_cells_per_block * 8);
-            for (int k = 0, ind = 0; k < athenak_block_nz; k++)
-              for (int j = 0; j < athenak_block_ny; j++)
-                for (int i = 0; i < athenak_block_nx; i++, ind++)
-                  prim[n](prim_inds[ind_ind],block,k,j,i) =
-                      static_cast<float>(athenak_cell_data_double[ind]);
-          }
-        }
-        if (plasma_model == PlasmaModel::code_kappa)
-        {
-          data_stream.seekg(cell_data_begin);
-          offset = athenak_ind_kappa * athenak_cells_per_block * athenak_variable_size;
-          data_stream.seekg(offset, std::ios_base::cur);
-          if (athenak_variable_size == 4)
-            data_stream.read(reinterpret_cast<char *>(&prim[n](ind_kappa,block,0,0,0)),
-                athenak_cells_per_block * 4);
-          else if (athenak_variable_size == 8)
-          {
-            data_stream.read(reinterpret_cast<char *>(athenak_cell_data_double),
-                athenak_cells_per_block * 8);
-            for (int k = 0, ind = 0; k < athenak_block_nz; k++)
-              for (int j = 0; j < athenak_block_ny; j++)
-                for (int i = 0; i < athenak_block_nx; i++, ind++)
-                  prim[n](ind_kappa,block,k,j,i) =
-                      static_cast<float>(athenak_cell_data_double[ind]);
-          }
-        }
+        x3f(0,k+1) = x_start(0) + (k + 1) * dx(0);
+        x3v(0,k) = 0.5 * (x3f(0,k) + x3f(0,k+1));
       }
-
-      // Convert internal energy to pressure
-      #pragma omp parallel for schedule(static) collapse(3)
-      for (int block = 0; block < athenak_num_blocks; block++)
-        for (int k = 0; k < athenak_block_nz; k++)
-          for (int j = 0; j < athenak_block_ny; j++)
-            for (int i = 0; i < athenak_block_nx; i++)
-              prim[n](ind_pgas,block,k,j,i) *= static_cast<float>(plasma_gamma - 1.0);
+      ConvertCoordinates();
     }
-
-    // Read block layout
-    if (first_time)
+    else if (simulation_format == SimulationFormat::harm3d)
     {
-      if (simulation_format == SimulationFormat::athena)
+      int num_cells_1, num_cells_2, num_cells_3;
+      data_stream >> num_cells_1 >> num_cells_2 >> num_cells_3;
+      double x1_start, x2_start, x3_start;
+      data_stream >> x1_start >> x2_start >> x3_start;
+      double dx1, dx2, dx3;
+      data_stream >> dx1 >> dx2 >> dx3;
+      x1f.Allocate(1, num_cells_1 + 1);
+      x1v.Allocate(1, num_cells_1);
+      x1f(0,0) = x1_start;
+      for (int i = 0; i < num_cells_1; i++)
       {
-        ReadHDF5IntArray("Levels", levels);
-        ReadHDF5IntArray("LogicalLocations", locations);
+        x1f(0,i+1) = x1_start + (i + 1) * dx1;
+        x1v(0,i) = 0.5 * (x1f(0,i) + x1f(0,i+1));
       }
-      else if (simulation_format == SimulationFormat::iharm3d
-          or simulation_format == SimulationFormat::harm3d)
+      x2f.Allocate(1, num_cells_2 + 1);
+      x2v.Allocate(1, num_cells_2);
+      x2f(0,0) = x2_start;
+      for (int j = 0; j < num_cells_2; j++)
       {
-        levels.Allocate(1);
-        levels(0) = 0;
-        locations.Allocate(1, 3);
-        locations(0,0) = 0;
-        locations(0,1) = 0;
-        locations(0,2) = 0;
+        x2f(0,j+1) = x2_start + (j + 1) * dx2;
+        x2v(0,j) = 0.5 * (x2f(0,j) + x2f(0,j+1));
       }
-    }
-
-    // Read coordinates
-    if (first_time)
-    {
-      if (simulation_format == SimulationFormat::athena)
+      x3f.Allocate(1, num_cells_3 + 1);
+      x3v.Allocate(1, num_cells_3);
+      x3f(0,0) = x3_start;
+      for (int k = 0; k < num_cells_3; k++)
       {
-        ReadHDF5FloatArray("x1f", x1f);
-        ReadHDF5FloatArray("x2f", x2f);
-        ReadHDF5FloatArray("x3f", x3f);
-        ReadHDF5FloatArray("x1v", x1v);
-        ReadHDF5FloatArray("x2v", x2v);
-        ReadHDF5FloatArray("x3v", x3v);
+        x3f(0,k+1) = x3_start + (k + 1) * dx3;
+        x3v(0,k) = 0.5 * (x3f(0,k) + x3f(0,k+1));
       }
-      else if (simulation_format == SimulationFormat::iharm3d)
+      data_stream >> metric_a;
+      if (metric_a != simulation_a)
       {
-        Array<int> num_cells;
-        Array<double> x_start, dx;
-        ReadHDF5IntArray("header/n1", num_cells);
-        ReadHDF5DoubleArray("header/geom/startx1", x_start);
-        ReadHDF5DoubleArray("header/geom/dx1", dx);
-        x1f.Allocate(1, num_cells(0) + 1);
-        x1v.Allocate(1, num_cells(0));
-        x1f(0,0) = x_start(0);
-        for (int i = 0; i < num_cells(0); i++)
-        {
-          x1f(0,i+1) = x_start(0) + (i + 1) * dx(0);
-          x1v(0,i) = 0.5 * (x1f(0,i) + x1f(0,i+1));
-        }
-        ReadHDF5IntArray("header/n2", num_cells);
-        ReadHDF5DoubleArray("header/geom/startx2", x_start);
-        ReadHDF5DoubleArray("header/geom/dx2", dx);
-        x2f.Allocate(1, num_cells(0) + 1);
-        x2v.Allocate(1, num_cells(0));
-        x2f(0,0) = x_start(0);
-        for (int j = 0; j < num_cells(0); j++)
-        {
-          x2f(0,j+1) = x_start(0) + (j + 1) * dx(0);
-          x2v(0,j) = 0.5 * (x2f(0,j) + x2f(0,j+1));
-        }
-        ReadHDF5IntArray("header/n3", num_cells);
-        ReadHDF5DoubleArray("header/geom/startx3", x_start);
-        ReadHDF5DoubleArray("header/geom/dx3", dx);
-        x3f.Allocate(1, num_cells(0) + 1);
-        x3v.Allocate(1, num_cells(0));
-        x3f(0,0) = x_start(0);
-        for (int k = 0; k < num_cells(0); k++)
-        {
-          x3f(0,k+1) = x_start(0) + (k + 1) * dx(0);
-          x3v(0,k) = 0.5 * (x3f(0,k) + x3f(0,k+1));
-        }
-        ConvertCoordinates();
+        std::ostringstream message;
+        message << "Given spin of " << simulation_a << " does not match file value of ";
+        message << metric_a << "; ignoring the latter.";
+        BlacklightWarning(message.str().c_str());
       }
-      else if (simulation_format == SimulationFormat::harm3d)
+      double temp_val;
+      data_stream >> temp_val;
+      if (not gamma_set)
+        plasma_gamma = temp_val;
+      else if (plasma_gamma != temp_val)
       {
-        int num_cells_1, num_cells_2, num_cells_3;
-        data_stream >> num_cells_1 >> num_cells_2 >> num_cells_3;
-        double x1_start, x2_start, x3_start;
-        data_stream >> x1_start >> x2_start >> x3_start;
-        double dx1, dx2, dx3;
-        data_stream >> dx1 >> dx2 >> dx3;
-        x1f.Allocate(1, num_cells_1 + 1);
-        x1v.Allocate(1, num_cells_1);
-        x1f(0,0) = x1_start;
-        for (int i = 0; i < num_cells_1; i++)
-        {
-          x1f(0,i+1) = x1_start + (i + 1) * dx1;
-          x1v(0,i) = 0.5 * (x1f(0,i) + x1f(0,i+1));
-        }
-        x2f.Allocate(1, num_cells_2 + 1);
-        x2v.Allocate(1, num_cells_2);
-        x2f(0,0) = x2_start;
-        for (int j = 0; j < num_cells_2; j++)
-        {
-          x2f(0,j+1) = x2_start + (j + 1) * dx2;
-          x2v(0,j) = 0.5 * (x2f(0,j) + x2f(0,j+1));
-        }
-        x3f.Allocate(1, num_cells_3 + 1);
-        x3v.Allocate(1, num_cells_3);
-        x3f(0,0) = x3_start;
-        for (int k = 0; k < num_cells_3; k++)
-        {
-          x3f(0,k+1) = x3_start + (k + 1) * dx3;
-          x3v(0,k) = 0.5 * (x3f(0,k) + x3f(0,k+1));
-        }
-        data_stream >> metric_a;
-        if (metric_a != simulation_a)
-        {
-          std::ostringstream message;
-          message << "Given spin of " << simulation_a << " does not match file value of ";
-          message << metric_a << "; ignoring the latter.";
-          BlacklightWarning(message.str().c_str());
-        }
-        double temp_val;
-        data_stream >> temp_val;
-        if (not gamma_set)
-          plasma_gamma = temp_val;
-        else if (plasma_gamma != temp_val)
-        {
-          std::ostringstream message;
-          message << "Given total adiabatic index of " << plasma_gamma;
-          message << " does not match file value of " << temp_val << "; ignoring the latter.";
-          BlacklightWarning(message.str().c_str());
-        }
-        data_stream >> temp_val;
-        data_stream >> metric_h;
-        data_stream >> temp_val;
-        data_stream.seekg(1, std::ios_base::cur);
-        cell_data_address = data_stream.tellg();
-        ConvertCoordinates();
+        std::ostringstream message;
+        message << "Given total adiabatic index of " << plasma_gamma;
+        message << " does not match file value of " << temp_val << "; ignoring the latter.";
+        BlacklightWarning(message.str().c_str());
       }
+      data_stream >> temp_val;
+      data_stream >> metric_h;
+      data_stream >> temp_val;
+      data_stream.seekg(1, std::ios_base::cur);
+      cell_data_address = data_stream.tellg();
+      ConvertCoordinates();
     }
+  }
 
-    // Check coordinates
-    if (first_time)
+  // Check coordinates
+  if (first_time)
+  {
+    if (simulation_coord == Coordinates::sks and x2f.n2 == 1)
     {
-      if (simulation_coord == Coordinates::sks and x2f.n2 == 1)
+      bool error_low = std::abs(x2f(0,0)) > (x2f(0,1) - x2f(0,0)) * angular_domain_tolerance;
+      bool error_high = std::abs(x2f(0,x2f.n1-1) - Math::pi)
+          > (x2f(0,x2f.n1-1) - x2f(0,x2f.n1-2)) * angular_domain_tolerance;
+      if (error_low or error_high)
       {
-        bool error_low = std::abs(x2f(0,0)) > (x2f(0,1) - x2f(0,0)) * angular_domain_tolerance;
-        bool error_high = std::abs(x2f(0,x2f.n1-1) - Math::pi)
-            > (x2f(0,x2f.n1-1) - x2f(0,x2f.n1-2)) * angular_domain_tolerance;
-        if (error_low or error_high)
-        {
-          std::ostringstream message;
-          message.setf(std::ios_base::scientific);
-          message.precision(16);
-          message << "Changing theta range from [" << x2f(0,0) << ", " << x2f(0,x2f.n1-1);
-          message << "] to [0, pi].";
-          BlacklightWarning(message.str().c_str());
-          x2f(0,0) = 0.0;
-          x2f(0,x2f.n1-1) = Math::pi;
-        }
+        std::ostringstream message;
+        message.setf(std::ios_base::scientific);
+        message.precision(16);
+        message << "Changing theta range from [" << x2f(0,0) << ", " << x2f(0,x2f.n1-1);
+        message << "] to [0, pi].";
+        BlacklightWarning(message.str().c_str());
+        x2f(0,0) = 0.0;
+        x2f(0,x2f.n1-1) = Math::pi;
       }
-      if ((simulation_coord == Coordinates::sks or simulation_coord == Coordinates::fmks)
-          and x3f.n2 == 1)
+    }
+    if ((simulation_coord == Coordinates::sks or simulation_coord == Coordinates::fmks)
+        and x3f.n2 == 1)
+    {
+      bool error_low = std::abs(x3f(0,0)) > (x3f(0,1) - x3f(0,0)) * angular_domain_tolerance;
+      bool error_high = std::abs(x3f(0,x3f.n1-1) - 2.0 * Math::pi)
+          > (x3f(0,x3f.n1-1) - x3f(0,x3f.n1-2)) * angular_domain_tolerance;
+      if (error_low or error_high)
       {
-        bool error_low = std::abs(x3f(0,0)) > (x3f(0,1) - x3f(0,0)) * angular_domain_tolerance;
-        bool error_high = std::abs(x3f(0,x3f.n1-1) - 2.0 * Math::pi)
-            > (x3f(0,x3f.n1-1) - x3f(0,x3f.n1-2)) * angular_domain_tolerance;
-        if (error_low or error_high)
-        {
-          std::ostringstream message;
-          message.setf(std::ios_base::scientific);
-          message.precision(16);
-          message << "Changing phi range from [" << x3f(0,0) << ", " << x3f(0,x3f.n1-1);
-          message << "] to [0, 2*pi].";
-          BlacklightWarning(message.str().c_str());
-          x3f(0,0) = 0.0;
-          x3f(0,x3f.n1-1) = 2.0 * Math::pi;
-        }
+        std::ostringstream message;
+        message.setf(std::ios_base::scientific);
+        message.precision(16);
+        message << "Changing phi range from [" << x3f(0,0) << ", " << x3f(0,x3f.n1-1);
+        message << "] to [0, 2*pi].";
+        BlacklightWarning(message.str().c_str());
+        x3f(0,0) = 0.0;
+        x3f(0,x3f.n1-1) = 2.0 * Math::pi;
       }
     }
+  }
 
-    // Read cell data
-    if (simulation_format == SimulationFormat::athena)
+  // Read cell data
+  if (simulation_format == SimulationFormat::athena)
+  {
+    if (first_time)
+    {
+      VerifyVariablesAthena();
+      int n5 = num_variables(ind_hydro) + num_variables(ind_bb);
+      int n4 = levels.n1;
+      int n3 = x3v.n1;
+      int n2 = x2v.n1;
+      int n1 = x1v.n1;
+      AllocatePrimitives(n5, n4, n3, n2, n1);
+    }
+    Array<float> hydro(prim[n_prim]);
+    hydro.Slice(5, 0, num_variables(ind_hydro) - 1);
+    Array<float> bb(prim[n_prim]);
+    bb.Slice(5, num_variables(ind_hydro), num_variables(ind_hydro) + num_variables(ind_bb) - 1);
+    if (block_selection_set)
+    {
+      ReadHDF5FloatArray("prim", hydro, block_selection);
+      ReadHDF5FloatArray("B", bb, block_selection);
+    }
+    else
     {
-      if (first_time)
-      {
-        VerifyVariablesAthena();
-        int n5 = num_variables(ind_hydro) + num_variables(ind_bb);
-        int n4 = levels.n1;
-        int n3 = x3v.n1;
-        int n2 = x2v.n1;
-        int n1 = x1v.n1;
-        for (int nn = 0; nn < num_read; nn++)
-          prim[nn].Allocate(n5, n4, n3, n2, n1);
-      }
-      Array<float> hydro(prim[n]);
-      hydro.Slice(5, 0, num_variables(ind_hydro) - 1);
       ReadHDF5FloatArray("prim", hydro);
-      Array<float> bb(prim[n]);
-      bb.Slice(5, num_variables(ind_hydro), num_variables(ind_hydro) + num_variables(ind_bb) - 1);
       ReadHDF5FloatArray("B", bb);
     }
-    else if (simulation_format == SimulationFormat::iharm3d)
+  }
+  else if (simulation_format == SimulationFormat::iharm3d)
+  {
+    if (first_time)
     {
-      if (first_time)
-      {
-        VerifyVariablesHarm();
-        int n5 = num_variables(0);
-        int n4 = levels.n1;
-        int n3 = x3v.n1;
-        int n2 = x2v.n1;
-        int n1 = x1v.n1;
-        for (int nn = 0; nn < num_read; nn++)
-          prim[nn].Allocate(n5, n4, n3, n2, n1);
-        prim_transpose.Allocate(n1, n2, n3, n5);
-      }
-      ReadHDF5FloatArray("prims", prim_transpose);
-      for (int n_variable = 0; n_variable < num_variables(0); n_variable++)
-        for (int k = 0; k < x3v.n1; k++)
-          for (int j = 0; j < x2v.n1; j++)
-            for (int i = 0; i < x1v.n1; i++)
-              prim[n](n_variable,0,k,j,i) = prim_transpose(i,j,k,n_variable);
-      for (int k = 0; k < x3v.n1; k++)
-        for (int j = 0; j < x2v.n1; j++)
-          for (int i = 0; i < x1v.n1; i++)
-            prim[n](ind_pgas,0,k,j,i) *= static_cast<float>(plasma_gamma - 1.0);
-      ConvertPrimitives3(prim[n]);
+      VerifyVariablesHarm();
+      int n5 = num_variables(0);
+      int n4 = levels.n1;
+      int n3 = x3v.n1;
+      int n2 = x2v.n1;
+      int n1 = x1v.n1;
+      AllocatePrimitives(n5, n4, n3, n2, n1);
     }
-    else if (simulation_format == SimulationFormat::harm3d)
+    unsigned long int prims_address;
+    bool rev_endian = LocateHDF5FloatArray("prims", x1v.n1, x2v.n1, x3v.n1, num_variables(0),
+        &prims_address);
+    TransposePrimitives(file_name, prims_address, num_variables(0), 0, rev_endian, prim[n_prim]);
+    double time_convert = omp_get_wtime();
+    ConvertPrimitives3(prim[n_prim]);
+    ProfileRecord("ConvertPrimitives", ProfileSnapshot(), -1, time_convert, omp_get_wtime(),
+        ProfileCounts());
+  }
+  else if (simulation_format == SimulationFormat::harm3d)
+  {
+    if (first_time)
     {
-      if (first_time)
-      {
-        int n5 = plasma_model == PlasmaModel::code_kappa ? 11 : 10;
-        int n4 = levels.n1;
-        int n3 = x3v.n1;
-        int n2 = x2v.n1;
-        int n1 = x1v.n1;
-        for (int nn = 0; nn < num_read; nn++)
-          prim[nn].Allocate(n5, n4, n3, n2, n1);
-        prim_transpose.Allocate(n1, n2, n3, n5 + 6);
-        ind_rho = 0;
-        ind_pgas = 1;
-        ind_kappa = 10;
-        ind_u0 = 2;
-        ind_uu1 = 3;
-        ind_uu2 = 4;
-        ind_uu3 = 5;
-        ind_b0 = 6;
-        ind_bb1 = 7;
-        ind_bb2 = 8;
-        ind_bb3 = 9;
-      }
-      else
-        data_stream.seekg(cell_data_address);
-      std::cout << "Reading raw data begins." << std::endl;
-      double time_harm3d = omp_get_wtime();
-      ReadBinary(&data_stream, prim_transpose.data, prim_transpose.n_tot);
-      #pragma omp parallel
-      {
-        #pragma omp for schedule(static) collapse(3)
-        for (int n_variable = 0; n_variable < prim[n].n5; n_variable++)
-          for (int k = 0; k < x3v.n1; k++)
-            for (int j = 0; j < x2v.n1; j++)
-              for (int i = 0; i < x1v.n1; i++)
-                prim[n](n_variable,0,k,j,i) = prim_transpose(i,j,k,n_variable+6);
-        #pragma omp for schedule(static) collapse(2)
-        for (int k = 0; k < x3v.n1; k++)
-          for (int j = 0; j < x2v.n1; j++)
-            for (int i = 0; i < x1v.n1; i++)
-              prim[n](ind_pgas,0,k,j,i) *= static_cast<float>(plasma_gamma - 1.0);
-      }
-      std::cout << "Reading raw data ends. Elapsed time:\t" << omp_get_wtime() - time_harm3d;
-      std::cout << " s" << std::endl;
-      // std::cout << "ConvertPrimitives4 begins." << std::endl;
-      // time_harm3d = omp_get_wtime();
-      ConvertPrimitives4(prim[n]);
-      // std::cout << "ConvertPrimitives4 ends. Elapsed time:\t" << omp_get_wtime() - time_harm3d;
-      // std::cout << " s" << std::endl;
+      int n5 = plasma_model == PlasmaModel::code_kappa ? 11 : 10;
+      int n4 = levels.n1;
+      int n3 = x3v.n1;
+      int n2 = x2v.n1;
+      int n1 = x1v.n1;
+      AllocatePrimitives(n5, n4, n3, n2, n1);
+      ind_rho = 0;
+      ind_pgas = 1;
+      ind_kappa = 10;
+      ind_u0 = 2;
+      ind_uu1 = 3;
+      ind_uu2 = 4;
+      ind_uu3 = 5;
+      ind_b0 = 6;
+      ind_bb1 = 7;
+      ind_bb2 = 8;
+      ind_bb3 = 9;
     }
+    std::cout << "Reading raw data begins." << std::endl;
+    double time_harm3d = omp_get_wtime();
+    TransposePrimitives(file_name, static_cast<unsigned long int>(cell_data_address),
+        prim[n_prim].n5 + 6, 6, false, prim[n_prim]);
+    std::cout << "Reading raw data ends. Elapsed time:\t" << omp_get_wtime() - time_harm3d;
+    std::cout << " s" << std::endl;
+    // std::cout << "ConvertPrimitives4 begins." << std::endl;
+    // time_harm3d = omp_get_wtime();
+    double time_convert = omp_get_wtime();
+    ConvertPrimitives4(prim[n_prim]);
+    ProfileRecord("ConvertPrimitives", ProfileSnapshot(), -1, time_convert, omp_get_wtime(),
+        ProfileCounts());
+    // std::cout << "ConvertPrimitives4 ends. Elapsed time:\t" << omp_get_wtime() - time_harm3d;
+    // std::cout << " s" << std::endl;
+  }
 
-    // Close input file
-    data_stream.close();
+  // Close input file
+  data_stream.close();
+  ProfileCounts profile_counts;
+  profile_counts.bytes_read = static_cast<long int>(prim[n_prim].GetNumBytes());
+  ProfileRecord("ReadFile", ProfileSnapshot(), -1, time_start, omp_get_wtime(), profile_counts);
 
-    // Update first time flag
-    first_time = false;
-  }
+  // Compress primitives
+  if (simulation_precision != PrimitivePrecision::single)
+    CompressPrimitives(n);
 
-  // Calculate elapsed time
-  return omp_get_wtime() - time_start;
+  // Update first time flag
+  first_time = false;
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for beginning to read a simulation file in the background
+// Inputs:
+//   file_number: number of simulation file to read
+// Outputs: (none)
+// Notes:
+//   Assumes first file has already been read, so that metadata is set and all prim arrays are
+//       allocated.
+//   Reads into prim[num_arrays] and time[num_arrays] on a separate thread, which uses its own
+//       OpenMP thread team.
+//   Data stream and scratch arrays must not be used until FinishPrefetch() is called.
+void SimulationReader::StartPrefetch(int file_number)
+{
+  prefetch_file_number = file_number;
+  prefetch_ready = false;
+  prefetch_exception = nullptr;
+  std::string file_name = FormatFilename(file_number);
+  int num_threads = p_input_reader->num_threads.value();
+  prefetch_thread = std::thread([this, file_name, num_threads]()
+  {
+    try
+    {
+      omp_set_num_threads(num_threads);
+      ReadFile(num_arrays, file_name);
+    }
+    catch (...)
+    {
+      prefetch_exception = std::current_exception();
+    }
+  });
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for completing any background read of a simulation file
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Does nothing if no read is in progress.
+//   Rethrows any exception encountered by the background thread.
+void SimulationReader::FinishPrefetch()
+{
+  if (not prefetch_thread.joinable())
+    return;
+  prefetch_thread.join();
+  if (prefetch_exception)
+    std::rethrow_exception(prefetch_exception);
+  prefetch_ready = true;
+  return;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -1140,6 +1140,235 @@ void SimulationReader::ReadAthenaKInputs()
 
 //--------------------------------------------------------------------------------------------------
 
+// Function for reading mesh and cell data from AthenaK dump
+// Inputs:
+//   n: index of prim array to fill
+//   file_name: name of file being read
+// Outputs: (none)
+// Notes:
+//   Assumes ReadAthenaKHeader() has been called on data_stream for the same file.
+//   Assumes VerifyVariablesAthenaK() has been called.
+//   On first call, determines block layout and allocates levels, locations, x1f, x2f, x3f, x1v,
+//       x2v, x3v, and prim arrays. Block count is inferred from the size of the file.
+//   Reads blocks in parallel with positioned reads, each variable of each block being read with a
+//       single contiguous call directly into prim[n] (or into a per-thread buffer for conversion if
+//       the file stores doubles).
+void SimulationReader::ReadAthenaKData(int n, const std::string &file_name)
+{
+  // Determine block layout
+  if (first_time)
+  {
+    data_stream.seekg(athenak_data_offset);
+    int32_t block_indices[6];
+    data_stream.read(reinterpret_cast<char *>(block_indices), 24);
+    athenak_block_nx = block_indices[1] - block_indices[0] + 1;
+    athenak_block_ny = block_indices[3] - block_indices[2] + 1;
+    athenak_block_nz = block_indices[5] - block_indices[4] + 1;
+    athenak_cells_per_block = athenak_block_nz * athenak_block_ny * athenak_block_nx;
+    athenak_block_size_bytes = 24 + 16 + 6 * athenak_location_size
+        + num_variable_names * athenak_cells_per_block * athenak_variable_size;
+    data_stream.seekg(0, std::ios_base::end);
+    std::streamoff data_size = data_stream.tellg() - athenak_data_offset;
+    if (data_size <= 0 or data_size % athenak_block_size_bytes != 0)
+      throw BlacklightException("AthenaK file size inconsistent with block layout.");
+    athenak_num_blocks = static_cast<int>(data_size / athenak_block_size_bytes);
+  }
+
+  // Allocate arrays
+  if (first_time)
+  {
+    levels.Allocate(athenak_num_blocks);
+    locations.Allocate(athenak_num_blocks, 3);
+    x1f.Allocate(athenak_num_blocks, athenak_block_nx + 1);
+    x2f.Allocate(athenak_num_blocks, athenak_block_ny + 1);
+    x3f.Allocate(athenak_num_blocks, athenak_block_nz + 1);
+    x1v.Allocate(athenak_num_blocks, athenak_block_nx);
+    x2v.Allocate(athenak_num_blocks, athenak_block_ny);
+    x3v.Allocate(athenak_num_blocks, athenak_block_nz);
+    int n5 = plasma_model == PlasmaModel::code_kappa ? 9 : 8;
+    AllocatePrimitives(n5, athenak_num_blocks, athenak_block_nz, athenak_block_ny,
+        athenak_block_nx);
+  }
+
+  // Prepare list of variables to read
+  int num_inds = plasma_model == PlasmaModel::code_kappa ? 9 : 8;
+  int athenak_inds[9] = {athenak_ind_rho, athenak_ind_uu1, athenak_ind_uu2, athenak_ind_uu3,
+      athenak_ind_pgas, athenak_ind_bb1, athenak_ind_bb2, athenak_ind_bb3, athenak_ind_kappa};
+  int prim_inds[9] =
+      {ind_rho, ind_uu1, ind_uu2, ind_uu3, ind_pgas, ind_bb1, ind_bb2, ind_bb3, ind_kappa};
+
+  // Prepare sizes
+  long int data_offset = static_cast<std::streamoff>(athenak_data_offset);
+  long int block_size = athenak_block_size_bytes;
+  int layout_size = 24 + 16 + 6 * athenak_location_size;
+  long int variable_size = static_cast<long int>(athenak_cells_per_block) * athenak_variable_size;
+
+  // Read blocks in parallel
+  int file_descriptor = OpenFileDescriptor(file_name);
+  bool read_success = true;
+  #pragma omp parallel
+  {
+    // Allocate scratch space
+    char layout[24 + 16 + 6 * 8];
+    Array<double> cell_data_double;
+    if (athenak_variable_size == 8)
+      cell_data_double.Allocate(athenak_cells_per_block);
+
+    // Go through blocks
+    #pragma omp for schedule(static) reduction(&&: read_success)
+    for (int block = 0; block < athenak_num_blocks; block++)
+    {
+      if (block_selection_set and not block_selection(block))
+        continue;
+      long int block_offset = data_offset + block * block_size;
+
+      // Read block layout and coordinates
+      if (first_time)
+      {
+        read_success = read_success
+            and ReadFileRange(file_descriptor, block_offset, layout_size, layout);
+        std::memcpy(&locations(block,0), layout + 24, 12);
+        std::memcpy(&levels(block), layout + 36, 4);
+        double face_coordinates[6];
+        if (athenak_location_size == 4)
+        {
+          float face_coordinates_single[6];
+          std::memcpy(face_coordinates_single, layout + 40, 24);
+          for (int ind = 0; ind < 6; ind++)
+            face_coordinates[ind] = static_cast<double>(face_coordinates_single[ind]);
+        }
+        else
+          std::memcpy(face_coordinates, layout + 40, 48);
+        x1f(block,0) = face_coordinates[0];
+        x1f(block,athenak_block_nx) = face_coordinates[1];
+        double dx = (face_coordinates[1] - face_coordinates[0]) / athenak_block_nx;
+        for (int i = 1; i < athenak_block_nx; i++)
+          x1f(block,i) = face_coordinates[0] + i * dx;
+        for (int i = 0; i < athenak_block_nx; i++)
+          x1v(block,i) = 0.5 * (x1f(block,i) + x1f(block,i+1));
+        x2f(block,0) = face_coordinates[2];
+        x2f(block,athenak_block_ny) = face_coordinates[3];
+        double dy = (face_coordinates[3] - face_coordinates[2]) / athenak_block_ny;
+        for (int j = 1; j < athenak_block_ny; j++)
+          x2f(block,j) = face_coordinates[2] + j * dy;
+        for (int j = 0; j < athenak_block_ny; j++)
+          x2v(block,j) = 0.5 * (x2f(block,j) + x2f(block,j+1));
+        x3f(block,0) = face_coordinates[4];
+        x3f(block,athenak_block_nz) = face_coordinates[5];
+        double dz = (face_coordinates[5] - face_coordinates[4]) / athenak_block_nz;
+        for (int k = 1; k < athenak_block_nz; k++)
+          x3f(block,k) = face_coordinates[4] + k * dz;
+        for (int k = 0; k < athenak_block_nz; k++)
+          x3v(block,k) = 0.5 * (x3f(block,k) + x3f(block,k+1));
+      }
+
+      // Read cell data
+      for (int ind_ind = 0; ind_ind < num_inds; ind_ind++)
+      {
+        long int offset = block_offset + layout_size + athenak_inds[ind_ind] * variable_size;
+        float *p_prim = &prim[n](prim_inds[ind_ind],block,0,0,0);
+        if (athenak_variable_size == 4)
+          read_success = read_success and ReadFileRange(file_descriptor, offset, variable_size,
+              reinterpret_cast<char *>(p_prim));
+        else
+        {
+          read_success = read_success and ReadFileRange(file_descriptor, offset, variable_size,
+              reinterpret_cast<char *>(cell_data_double.data));
+          for (int ind = 0; ind < athenak_cells_per_block; ind++)
+            p_prim[ind] = static_cast<float>(cell_data_double(ind));
+        }
+      }
+    }
+  }
+  CloseFileDescriptor(file_descriptor);
+  if (not read_success)
+    throw BlacklightException("Could not read AthenaK data.");
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for reading cell-major primitives from file directly into variable-major layout
+// Inputs:
+//   file_name: name of file being read
+//   data_address: file offset of first byte of cell data
+//   num_file_variables: number of 4-byte floats stored for each cell
+//   variable_offset: number of leading floats in each cell that are not primitives
+//   rev_endian: flag indicating data has reversed byte order
+// Outputs:
+//   primitives: array set
+// Notes:
+//   Assumes file data has shape (x1v.n1, x2v.n1, x3v.n1, num_file_variables) and primitives has
+//       been allocated with shape (n5, 1, x3v.n1, x2v.n1, x1v.n1), with n5 primitives following
+//       variable_offset in each cell.
+//   Assumes ind_pgas is set; scales this variable by plasma_gamma - 1 to convert internal energy
+//       to pressure.
+//   Maps the file rather than staging it in a transposed copy, going through blocks of i and k for
+//       each j in parallel so that both the strided reads and the strided writes stay in cache.
+void SimulationReader::TransposePrimitives(const std::string &file_name,
+    unsigned long int data_address, int num_file_variables, int variable_offset, bool rev_endian,
+    Array<float> &primitives)
+{
+  // Extract parameters
+  int n1 = x1v.n1;
+  int n2 = x2v.n1;
+  int n3 = x3v.n1;
+  int num_prims = primitives.n5;
+  int ind_scale = ind_pgas;
+  float scale = static_cast<float>(plasma_gamma - 1.0);
+
+  // Map file
+  std::size_t file_size = 0;
+  char *buffer = MapFile(file_name, &file_size);
+  unsigned long int data_size = static_cast<unsigned long int>(n3)
+      * static_cast<unsigned long int>(n2) * static_cast<unsigned long int>(n1)
+      * static_cast<unsigned long int>(num_file_variables) * sizeof(float);
+  if (data_address + data_size > file_size)
+  {
+    UnmapFile(buffer, file_size);
+    throw BlacklightException("Primitive data extends beyond end of file.");
+  }
+  const unsigned char *data = reinterpret_cast<const unsigned char *>(buffer + data_address);
+
+  // Go through blocks in parallel
+  #pragma omp parallel for schedule(static) collapse(3)
+  for (int k_start = 0; k_start < n3; k_start += transpose_block_size)
+    for (int j = 0; j < n2; j++)
+      for (int i_start = 0; i_start < n1; i_start += transpose_block_size)
+      {
+        int k_end = std::min(k_start + transpose_block_size, n3);
+        int i_end = std::min(i_start + transpose_block_size, n1);
+        for (int i = i_start; i < i_end; i++)
+          for (int k = k_start; k < k_end; k++)
+          {
+            long int cell = (static_cast<long int>(i) * n2 + j) * n3 + k;
+            const unsigned char *p_cell =
+                data + (cell * num_file_variables + variable_offset) * 4;
+            for (int n_variable = 0; n_variable < num_prims; n_variable++)
+            {
+              unsigned char bytes[4];
+              std::memcpy(bytes, p_cell + 4 * n_variable, 4);
+              if (rev_endian)
+              {
+                std::swap(bytes[0], bytes[3]);
+                std::swap(bytes[1], bytes[2]);
+              }
+              float value;
+              std::memcpy(&value, bytes, 4);
+              if (n_variable == ind_scale)
+                value *= scale;
+              primitives(n_variable,0,k,j,i) = value;
+            }
+          }
+      }
+
+  // Unmap file
+  UnmapFile(buffer, file_size);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
 // Function to check that needed Athena++ variables are located as expected
 // Inputs: (none)
 // Outputs: (none)
@@ -4,15 +4,21 @@
 #define SIMULATION_READER_H_
 
 // C++ headers
-#include <fstream>  // ifstream
-#include <iosfwd>   // streampos
-#include <string>   // string
+#include <exception>  // exception_ptr
+#include <fstream>    // ifstream
+#include <iosfwd>     // streampos
+#include <optional>   // optional
+#include <string>     // string
+#include <thread>     // thread
 
 // Blacklight headers
 #include "../blacklight.hpp"                 // enums
 #include "../input_reader/input_reader.hpp"  // InputReader
 #include "../utils/array.hpp"                // Array
 
+// Forward declarations
+struct RadiationIntegrator;
+
 //--------------------------------------------------------------------------------------------------
 
 // Simulation reader
@@ -36,11 +42,15 @@ struct SimulationReader
   bool simulation_multiple;
   int simulation_start;
   int simulation_end;
+  bool simulation_prefetch;
+  bool simulation_block_select;
+  std::optional<std::string> simulation_sks_map_file;
   Coordinates simulation_coord;
   double simulation_a;
   double simulation_m_msun;
   double simulation_rho_cgs;
   std::string simulation_kappa_name;
+  PrimitivePrecision simulation_precision;
 
   // Input data - slow-light parameters
   bool slow_light_on;
@@ -79,7 +89,6 @@ struct SimulationReader
   int athenak_block_size_bytes;
   int athenak_num_blocks;
   double athenak_time;
-  double *athenak_cell_data_double;
   std::string metric;
   double metric_a, metric_h, metric_r_in;
   double metric_poly_xt, metric_poly_alpha, metric_mks_smooth, metric_derived_poly_norm;
@@ -95,6 +104,7 @@ struct SimulationReader
   int ind_u0, ind_uu1, ind_uu2, ind_uu3;
   int ind_b0, ind_bb1, ind_bb2, ind_bb3;
   int num_arrays;
+  int num_buffers;
   int latest_file_number;
   const double extrapolation_tolerance = 1.0;
   const double angular_domain_tolerance = 0.1;
@@ -110,6 +120,7 @@ struct SimulationReader
   const int sks_map_n2 = 2048;
   const int sks_map_max_iter = 1000;
   const double sks_map_tol = 1.0e-8;
+  static constexpr int sks_map_num_params = 11;
 
   // Data
   int n_3_root;
@@ -120,24 +131,56 @@ struct SimulationReader
   Array<double> x2v_alt;
   double *time;
   Array<float> *prim;
-  Array<float> prim_transpose;
+  Array<unsigned short int> *prim_compact;
+  Array<float> *prim_scale;
+  static constexpr int transpose_block_size = 16;
+
+  // Block selection data
+  Array<bool> block_selection;
+  bool block_selection_set = false;
+
+  // Background reading data
+  std::thread prefetch_thread;
+  int prefetch_file_number = -1;
+  bool prefetch_ready = false;
+  std::exception_ptr prefetch_exception;
 
-  // External function
+  // External functions
   double Read(int snapshot);
+  void SelectBlocks(const RadiationIntegrator *const *p_radiation_integrators, int num_cameras);
+  static float DecodeBF16(unsigned short int code);
+  static float DecodeScaled16(unsigned short int code, float offset, float step, bool log_scale);
 
   // Internal functions - simulation_reader.cpp
+  void ReadFile(int n, const std::string &file_name);
+  void StartPrefetch(int file_number);
+  void FinishPrefetch();
   std::string FormatFilename(int file_number);
   void ReadAthenaKHeader();
   void ReadAthenaKInputs();
+  void ReadAthenaKData(int n, const std::string &file_name);
+  void TransposePrimitives(const std::string &file_name, unsigned long int data_address,
+      int num_file_variables, int variable_offset, bool rev_endian, Array<float> &primitives);
   void VerifyVariablesAthena();
   void VerifyVariablesAthenaK();
   void VerifyVariablesHarm();
 
+  // Internal functions - compact_primitives.cpp
+  void AllocatePrimitives(int n5, int n4, int n3, int n2, int n1);
+  void SwapPrimitives(int n_a, int n_b);
+  void CompressPrimitives(int n);
+  void ReportCompression(int n) const;
+  std::string PrimitiveName(int v) const;
+  static unsigned short int EncodeBF16(float value);
+
   // Internal functions - simulation_geometry.cpp
   void ConvertCoordinates();
   void ConvertPrimitives3(Array<float> &primitives);
   void ConvertPrimitives4(Array<float> &primitives);
   void GenerateSKSMap(double r_in, double r_out);
+  bool LoadSKSMap(double r_in, double r_out);
+  void SaveSKSMap();
+  void SetSKSMapParameters(double r_in, double r_out, double params[sks_map_num_params]);
   void GetSKSCoordinates(double x1, double x2, double x3, double *p_r, double *p_theta,
       double *p_phi);
   void SetJacobianFactors(double x1, double x2, double *p_dr_dx1, double *p_dth_dx1,
@@ -155,6 +198,9 @@ struct SimulationReader
       unsigned long int data_segment_address);
   void ReadHDF5DataObjectHeader(unsigned long int data_object_header_address,
       unsigned char **p_datatype_raw, unsigned char **p_dataspace_raw, unsigned char **p_data_raw);
+  void ReadHDF5DataObjectHeader(unsigned long int data_object_header_address,
+      unsigned char **p_datatype_raw, unsigned char **p_dataspace_raw,
+      unsigned long int *p_data_address, unsigned long int *p_data_size);
   static void ReadHDF5DataspaceDims(const unsigned char *dataspace_raw, unsigned long int **p_dims,
       int *p_num_dims);
 
@@ -163,8 +209,12 @@ struct SimulationReader
       int *p_array_length);
   void ReadHDF5IntArray(const char *name, Array<int> &int_array);
   void ReadHDF5FloatArray(const char *name, Array<float> &float_array);
+  void ReadHDF5FloatArray(const char *name, Array<float> &float_array,
+      const Array<bool> &block_flags);
   void ReadHDF5FloatArray(const char *name, Array<double> &double_array);
   void ReadHDF5DoubleArray(const char *name, Array<double> &double_array);
+  bool LocateHDF5FloatArray(const char *name, int n4, int n3, int n2, int n1,
+      unsigned long int *p_data_address);
   static void SetHDF5StringArray(const unsigned char *datatype_raw,
       const unsigned char *dataspace_raw, const unsigned char *data_raw, bool allocate,
       std::string **string_array, int *p_array_length);
@@ -172,6 +222,10 @@ struct SimulationReader
       const unsigned char *data_raw, Array<int> &int_array);
   static void SetHDF5FloatArray(const unsigned char *datatype_raw,
       const unsigned char *dataspace_raw, const unsigned char *data_raw, Array<float> &float_array);
+  static bool CheckHDF5FloatDatatype(const unsigned char *datatype_raw);
+  static bool PrepareHDF5FloatArray(const unsigned char *datatype_raw,
+      const unsigned char *dataspace_raw, Array<float> &float_array);
+  static void ReverseHDF5FloatBytes(Array<float> &float_array);
   static void SetHDF5FloatArray(const unsigned char *datatype_raw,
       const unsigned char *dataspace_raw, const unsigned char *data_raw,
       Array<double> &double_array);
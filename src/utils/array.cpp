@@ -1,10 +1,19 @@
 // Blacklight multidimensional array
 
 // C++ headers
-#include <complex>  // complex
-#include <cstddef>  // size_t
-#include <cstring>  // memcpy
-#include <limits>   // numeric_limits
+#include <complex>      // complex
+#include <cstddef>      // size_t
+#include <cstdlib>      // free, posix_memalign
+#include <cstring>      // memcpy
+#include <limits>       // numeric_limits
+#include <memory>       // destroy_n, uninitialized_default_construct_n
+#include <type_traits>  // is_trivial_v
+
+// System headers
+#include <sys/mman.h>  // madvise, MADV_HUGEPAGE
+
+// Library headers
+#include <omp.h>  // omp_in_parallel
 
 // Blacklight headers
 #include "array.hpp"
@@ -13,10 +22,24 @@
 // Instantiations
 template struct Array<bool>;
 template struct Array<char>;
+template struct Array<unsigned char>;
+template struct Array<unsigned short int>;
 template struct Array<int>;
 template struct Array<float>;
 template struct Array<double>;
 template struct Array<std::complex<double>>;
+template struct ArrayView<bool>;
+template struct ArrayView<char>;
+template struct ArrayView<unsigned char>;
+template struct ArrayView<unsigned short int>;
+template struct ArrayView<int>;
+template struct ArrayView<float>;
+template struct ArrayView<double>;
+template struct ArrayView<std::complex<double>>;
+
+// Memory options
+static bool array_reuse = false;
+static bool array_huge_pages = false;
 
 //--------------------------------------------------------------------------------------------------
 
@@ -125,8 +148,14 @@ template<typename type> Array<type>::Array(const Array<type> &source)
 //--------------------------------------------------------------------------------------------------
 
 // Multidimensional array copy assignment constructor
+// Notes:
+//   Frees any memory retained from a previous allocation, which would otherwise be lost.
 template<typename type> Array<type> &Array<type>::operator=(const Array<type> &source)
 {
+  if (&source == this)
+    return *this;
+  if (not allocated)
+    Release();
   data = source.data;
   n1 = source.n1;
   n2 = source.n2;
@@ -134,6 +163,7 @@ template<typename type> Array<type> &Array<type>::operator=(const Array<type> &s
   n4 = source.n4;
   n5 = source.n5;
   n_tot = source.n_tot;
+  capacity = 0;
   allocated = source.allocated;
   is_copy = true;
   return *this;
@@ -141,10 +171,61 @@ template<typename type> Array<type> &Array<type>::operator=(const Array<type> &s
 
 //--------------------------------------------------------------------------------------------------
 
+// Multidimensional array move constructor
+// Notes:
+//   Takes ownership of any memory owned by source, leaving source empty.
+template<typename type> Array<type>::Array(Array<type> &&source) noexcept
+{
+  data = source.data;
+  n1 = source.n1;
+  n2 = source.n2;
+  n3 = source.n3;
+  n4 = source.n4;
+  n5 = source.n5;
+  n_tot = source.n_tot;
+  capacity = source.capacity;
+  allocated = source.allocated;
+  is_copy = source.is_copy;
+  source.data = nullptr;
+  source.capacity = 0;
+  source.allocated = false;
+  source.is_copy = false;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Multidimensional array move assignment constructor
+// Notes:
+//   Frees any memory owned by this array before taking ownership of any memory owned by source,
+//       leaving source empty.
+template<typename type> Array<type> &Array<type>::operator=(Array<type> &&source) noexcept
+{
+  if (&source == this)
+    return *this;
+  Release();
+  data = source.data;
+  n1 = source.n1;
+  n2 = source.n2;
+  n3 = source.n3;
+  n4 = source.n4;
+  n5 = source.n5;
+  n_tot = source.n_tot;
+  capacity = source.capacity;
+  allocated = source.allocated;
+  is_copy = source.is_copy;
+  source.data = nullptr;
+  source.capacity = 0;
+  source.allocated = false;
+  source.is_copy = false;
+  return *this;
+}
+
+//--------------------------------------------------------------------------------------------------
+
 // Multidimensional array destructor
 template<typename type> Array<type>::~Array()
 {
-  Deallocate();
+  Release();
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -152,16 +233,41 @@ template<typename type> Array<type>::~Array()
 // Multidimensional array allocator (general)
 // Inputs: (none)
 // Outputs: (none)
+// Notes:
+//   Reuses memory retained by Deallocate() if it is large enough.
+//   Aligns data to alignment bytes, or to huge_page_size bytes for large arrays with huge pages,
+//       which are requested but not guaranteed.
+//   Does not initialize trivial types, leaving pages to be first touched by whichever threads use
+//       them.
 template<typename type> void Array<type>::Allocate()
 {
   if (allocated)
     throw BlacklightException("Attempting to reallocate array.");
-  allocated = true;
   n_tot = static_cast<long int>(n1) * static_cast<long int>(n2) * static_cast<long int>(n3)
       * static_cast<long int>(n4) * static_cast<long int>(n5);
   if (n_tot <= 0l)
     throw BlacklightException("Attempting to allocate empty array.");
-  data = new type[n_tot];
+  if (not is_copy and n_tot <= capacity)
+  {
+    allocated = true;
+    return;
+  }
+  Release();
+  std::size_t num_bytes = static_cast<std::size_t>(n_tot) * sizeof(type);
+  bool huge = array_huge_pages and num_bytes >= huge_page_size;
+  void *buffer = nullptr;
+  if (posix_memalign(&buffer, huge ? huge_page_size : alignment, num_bytes) != 0)
+    throw BlacklightException("Could not allocate array.");
+#ifdef MADV_HUGEPAGE
+  if (huge)
+    madvise(buffer, num_bytes, MADV_HUGEPAGE);
+#endif
+  data = static_cast<type *>(buffer);
+  if constexpr (not std::is_trivial_v<type>)
+    std::uninitialized_default_construct_n(data, n_tot);
+  capacity = n_tot;
+  allocated = true;
+  is_copy = false;
 }
 
 //--------------------------------------------------------------------------------------------------
@@ -256,10 +362,34 @@ template<typename type> void Array<type>::Allocate(int n5_, int n4_, int n3_, in
 // Multidimensional array deallocator
 // Inputs: (none)
 // Outputs: (none)
+// Notes:
+//   Retains memory for reuse by later allocations if reuse is enabled, freeing it otherwise.
 template<typename type> void Array<type>::Deallocate()
 {
-  if (allocated and not is_copy)
-    delete[] data;
+  if (array_reuse)
+    allocated = false;
+  else
+    Release();
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Multidimensional array memory release
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Frees any memory owned by array, whether in use or retained.
+template<typename type> void Array<type>::Release()
+{
+  if (not is_copy and capacity > 0)
+  {
+    if constexpr (not std::is_trivial_v<type>)
+      std::destroy_n(data, capacity);
+    std::free(data);
+  }
+  data = nullptr;
+  capacity = 0;
   allocated = false;
   return;
 }
@@ -570,6 +700,7 @@ template<typename type> void Array<type>::Swap(Array<type> &other)
 
   // Make temporary shallow copy of other
   bool other_is_copy = other.is_copy;
+  long int other_capacity = other.capacity;
   Array<type> temp(other);
 
   // Copy data from this to other
@@ -580,6 +711,7 @@ template<typename type> void Array<type>::Swap(Array<type> &other)
   other.n4 = n4;
   other.n5 = n5;
   other.n_tot = n_tot;
+  other.capacity = capacity;
   other.is_copy = is_copy;
 
   // Copy data from tmp to this
@@ -590,6 +722,7 @@ template<typename type> void Array<type>::Swap(Array<type> &other)
   n4 = temp.n4;
   n5 = temp.n5;
   n_tot = temp.n_tot;
+  capacity = other_capacity;
   is_copy = other_is_copy;
   return;
 }
@@ -717,11 +850,17 @@ template<typename type> void Array<type>::CopyFrom(const Array<type> &other, lon
 // Outputs: (none)
 // Notes:
 //   Sets any allocated array to be zero.
+//   Divides large arrays statically among threads, so that memory is first touched by roughly the
+//       same threads that process the corresponding pixels in static per-pixel loops.
 template<typename type> void Array<type>::Zero()
 {
   if (allocated)
+  {
+    bool parallel = n_tot >= parallel_length and not omp_in_parallel();
+    #pragma omp parallel for schedule(static) if (parallel)
     for (long int n = 0; n < n_tot; n++)
       data[n] = static_cast<type>(0);
+  }
   return;
 }
 
@@ -732,11 +871,16 @@ template<typename type> void Array<type>::Zero()
 // Outputs: (none)
 // Notes:
 //   Sets any allocated array to be NaN.
+//   Divides large arrays statically among threads, as in Zero().
 template<> void Array<float>::SetNaN()
 {
   if (allocated)
+  {
+    bool parallel = n_tot >= parallel_length and not omp_in_parallel();
+    #pragma omp parallel for schedule(static) if (parallel)
     for (long int n = 0; n < n_tot; n++)
       data[n] = std::numeric_limits<float>::quiet_NaN();
+  }
   return;
 }
 
@@ -747,11 +891,16 @@ template<> void Array<float>::SetNaN()
 // Outputs: (none)
 // Notes:
 //   Sets any allocated array to be NaN.
+//   Divides large arrays statically among threads, as in Zero().
 template<> void Array<double>::SetNaN()
 {
   if (allocated)
+  {
+    bool parallel = n_tot >= parallel_length and not omp_in_parallel();
+    #pragma omp parallel for schedule(static) if (parallel)
     for (long int n = 0; n < n_tot; n++)
       data[n] = std::numeric_limits<double>::quiet_NaN();
+  }
   return;
 }
 
@@ -765,3 +914,131 @@ template<typename type> std::size_t Array<type>::GetNumBytes() const
 {
   return static_cast<std::size_t>(n_tot) * sizeof(type);
 }
+
+//--------------------------------------------------------------------------------------------------
+
+// Multidimensional array view constructor (empty)
+// Inputs: (none)
+template<typename type> ArrayView<type>::ArrayView() {}
+
+//--------------------------------------------------------------------------------------------------
+
+// Multidimensional array view constructor (full array)
+// Inputs:
+//   array: array to be viewed
+// Notes:
+//   View does not own data, and it becomes invalid if array is deallocated.
+template<typename type> ArrayView<type>::ArrayView(const Array<type> &array)
+  : data(array.data),
+    n1(array.n1),
+    n2(array.n2),
+    n3(array.n3),
+    n4(array.n4),
+    n5(array.n5)
+{
+  stride2 = static_cast<long int>(n1);
+  stride3 = stride2 * static_cast<long int>(n2);
+  stride4 = stride3 * static_cast<long int>(n3);
+  stride5 = stride4 * static_cast<long int>(n4);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Multidimensional array view read/write accessors
+// Inputs:
+//   i5, i4, i3, i2: outer indices, where given
+//   i1: innermost index
+// Outputs:
+//   returned value: reference to element
+// Notes:
+//   Uses strides calculated when view was constructed.
+template<typename type> type &ArrayView<type>::operator()(int i1) const
+{
+  return data[i1];
+}
+template<typename type> type &ArrayView<type>::operator()(int i2, int i1) const
+{
+  return data[i1 + stride2 * i2];
+}
+template<typename type> type &ArrayView<type>::operator()(int i3, int i2, int i1) const
+{
+  return data[i1 + stride2 * i2 + stride3 * i3];
+}
+template<typename type> type &ArrayView<type>::operator()(int i4, int i3, int i2, int i1) const
+{
+  return data[i1 + stride2 * i2 + stride3 * i3 + stride4 * i4];
+}
+template<typename type> type &ArrayView<type>::operator()(int i5, int i4, int i3, int i2, int i1)
+    const
+{
+  return data[i1 + stride2 * i2 + stride3 * i3 + stride4 * i4 + stride5 * i5];
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Multidimensional array view subview
+// Inputs:
+//   dimension: dimension to be fixed, starting at 1 for innermost dimension
+//   index: index in given dimension
+// Outputs:
+//   returned value: view of all dimensions inside given one at given index
+// Notes:
+//   For example, Subview(3, m) of an (n3, n2, n1) view is the contiguous (n2, n1) view at m.
+template<typename type> ArrayView<type> ArrayView<type>::Subview(int dimension, int index) const
+{
+  // Locate subview
+  long int stride = 1;
+  int n = n1;
+  if (dimension == 2)
+  {
+    stride = stride2;
+    n = n2;
+  }
+  else if (dimension == 3)
+  {
+    stride = stride3;
+    n = n3;
+  }
+  else if (dimension == 4)
+  {
+    stride = stride4;
+    n = n4;
+  }
+  else if (dimension == 5)
+  {
+    stride = stride5;
+    n = n5;
+  }
+  else
+    throw BlacklightException("Attempting to take subview at invalid dimension.");
+  if (index < 0 or index >= n)
+    throw BlacklightException("Attempting to take subview outside array bounds.");
+
+  // Prepare subview
+  ArrayView<type> subview(*this);
+  subview.data += stride * index;
+  if (dimension <= 2)
+    subview.n2 = 1;
+  if (dimension <= 3)
+    subview.n3 = 1;
+  if (dimension <= 4)
+    subview.n4 = 1;
+  subview.n5 = 1;
+  return subview;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for setting memory options shared by all arrays
+// Inputs:
+//   reuse: flag indicating deallocated arrays should retain memory for later allocations
+//   huge_pages: flag indicating large arrays should request transparent huge pages
+// Outputs: (none)
+// Notes:
+//   Should be called before any threads allocate arrays.
+void SetArrayMemoryOptions(bool reuse, bool huge_pages)
+{
+  array_reuse = reuse;
+  array_huge_pages = huge_pages;
+  return;
+}
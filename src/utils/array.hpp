@@ -20,15 +20,21 @@ template<typename type> struct Array
   Array(int n5_, int n4_, int n3_, int n2_, int n1_);
   Array(const Array<type> &source);
   Array &operator=(const Array<type> &source);
+  Array(Array<type> &&source) noexcept;
+  Array &operator=(Array<type> &&source) noexcept;
   ~Array();
 
   // Data
-  type *data;
+  type *data = nullptr;
   int n1, n2, n3, n4, n5;
   long int n_tot;
+  long int capacity = 0;
   bool allocated = false;
   bool is_copy = false;
   static constexpr int max_dims = 5;
+  static constexpr std::size_t alignment = 64;
+  static constexpr std::size_t huge_page_size = 1 << 21;
+  static constexpr long int parallel_length = 1l << 16;
 
   // Functions - allocators and deallocator
   void Allocate();
@@ -38,6 +44,7 @@ template<typename type> struct Array
   void Allocate(int n4_, int n3_, int n2_, int n1_);
   void Allocate(int n5_, int n4_, int n3_, int n2_, int n1_);
   void Deallocate();
+  void Release();
 
   // Functions - read accessors
   type operator()(int i1_) const;
@@ -75,4 +82,34 @@ template<typename type> struct Array
   std::size_t GetNumBytes() const;
 };
 
+//--------------------------------------------------------------------------------------------------
+
+// Non-owning view of multidimensional array
+template<typename type> struct ArrayView
+{
+  // Constructors
+  ArrayView();
+  explicit ArrayView(const Array<type> &array);
+
+  // Data
+  type *data = nullptr;
+  int n1 = 1, n2 = 1, n3 = 1, n4 = 1, n5 = 1;
+  long int stride2 = 1, stride3 = 1, stride4 = 1, stride5 = 1;
+
+  // Functions - read/write accessors
+  type &operator()(int i1_) const;
+  type &operator()(int i2_, int i1_) const;
+  type &operator()(int i3_, int i2_, int i1_) const;
+  type &operator()(int i4_, int i3_, int i2_, int i1_) const;
+  type &operator()(int i5_, int i4_, int i3_, int i2_, int i1_) const;
+
+  // Functions - miscellaneous
+  ArrayView<type> Subview(int dimension, int index) const;
+};
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for setting memory options shared by all arrays
+void SetArrayMemoryOptions(bool reuse, bool huge_pages);
+
 #endif
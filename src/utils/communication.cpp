@@ -0,0 +1,169 @@
+// Blacklight communication
+
+// C++ headers
+#include <cstddef>  // size_t
+#include <vector>   // vector
+
+// Library headers
+#ifdef MPI_PARALLEL
+#include <mpi.h>  // MPI_*
+#endif
+
+// Blacklight headers
+#include "communication.hpp"
+#include "exceptions.hpp"  // BlacklightException
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for starting communication among ranks
+// Inputs:
+//   p_argc: pointer to number of command-line arguments
+//   p_argv: pointer to array of command-line argument strings
+// Outputs: (none)
+// Notes:
+//   Does nothing unless compiled with MPI_PARALLEL.
+//   Only requests that the main thread be able to communicate, since OpenMP threads and background
+//       output threads never do.
+void CommStart([[maybe_unused]] int *p_argc, [[maybe_unused]] char ***p_argv)
+{
+#ifdef MPI_PARALLEL
+  int provided = MPI_THREAD_SINGLE;
+  if (MPI_Init_thread(p_argc, p_argv, MPI_THREAD_FUNNELED, &provided) != MPI_SUCCESS)
+    throw BlacklightException("Could not initialize MPI.");
+  if (provided < MPI_THREAD_FUNNELED)
+    throw BlacklightException("MPI does not support threads.");
+#endif
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for ending communication among ranks
+// Inputs: (none)
+// Outputs: (none)
+// Notes:
+//   Does nothing unless compiled with MPI_PARALLEL.
+//   Should be called by all ranks, after all other communication.
+void CommEnd()
+{
+#ifdef MPI_PARALLEL
+  MPI_Finalize();
+#endif
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for getting index of this rank
+// Inputs: (none)
+// Outputs:
+//   returned value: index (0-indexed) of rank, or 0 without MPI_PARALLEL
+int CommRank()
+{
+  int rank = 0;
+#ifdef MPI_PARALLEL
+  MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+#endif
+  return rank;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for getting number of ranks
+// Inputs: (none)
+// Outputs:
+//   returned value: number of ranks, or 1 without MPI_PARALLEL
+int CommSize()
+{
+  int size = 1;
+#ifdef MPI_PARALLEL
+  MPI_Comm_size(MPI_COMM_WORLD, &size);
+#endif
+  return size;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for waiting for all ranks
+// Inputs: (none)
+// Outputs: (none)
+void CommBarrier()
+{
+#ifdef MPI_PARALLEL
+  MPI_Barrier(MPI_COMM_WORLD);
+#endif
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for finding maximum of a value over ranks
+// Inputs:
+//   value: value on this rank
+// Outputs:
+//   returned value: maximum over all ranks
+// Notes:
+//   Should be called by all ranks.
+double CommMax(double value)
+{
+  double value_max = value;
+#ifdef MPI_PARALLEL
+  MPI_Allreduce(&value, &value_max, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+#endif
+  return value_max;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for collecting per-pixel values from all ranks onto rank 0
+// Inputs:
+//   data: values, with only pixels belonging to this rank filled in
+//   num_outer: number of slices of pixels
+//   num_pix: number of pixels in full image
+//   num_inner: number of values stored contiguously for each pixel
+//   pix_start: first pixel belonging to this rank
+//   pix_count: number of pixels belonging to this rank
+// Outputs:
+//   data: values for pixels of other ranks filled in on rank 0
+// Notes:
+//   Assumes data has shape (num_outer, num_pix, num_inner), with the pixels of different ranks
+//       forming disjoint contiguous ranges.
+//   Should be called by all ranks.
+//   Does nothing unless compiled with MPI_PARALLEL.
+void CommGatherPixels([[maybe_unused]] double *data, [[maybe_unused]] int num_outer,
+    [[maybe_unused]] int num_pix, [[maybe_unused]] int num_inner, [[maybe_unused]] int pix_start,
+    [[maybe_unused]] int pix_count)
+{
+#ifdef MPI_PARALLEL
+  // Share ranges of pixels
+  int rank = CommRank();
+  int size = CommSize();
+  int range[2] = {pix_start * num_inner, pix_count * num_inner};
+  std::vector<int> ranges(static_cast<std::size_t>(2 * size));
+  MPI_Allgather(range, 2, MPI_INT, ranges.data(), 2, MPI_INT, MPI_COMM_WORLD);
+  std::vector<int> displacements(static_cast<std::size_t>(size));
+  std::vector<int> counts(static_cast<std::size_t>(size));
+  for (int n = 0; n < size; n++)
+  {
+    displacements[static_cast<std::size_t>(n)] = ranges[static_cast<std::size_t>(2 * n)];
+    counts[static_cast<std::size_t>(n)] = ranges[static_cast<std::size_t>(2 * n + 1)];
+  }
+
+  // Gather each slice, with rank 0 sending a copy of its values to avoid aliasing
+  long int slice_size = static_cast<long int>(num_pix) * num_inner;
+  std::vector<double> values_root;
+  for (int n = 0; n < num_outer; n++)
+  {
+    double *slice = data + n * slice_size;
+    double *values = slice + range[0];
+    if (rank == 0)
+    {
+      values_root.assign(values, values + range[1]);
+      values = values_root.data();
+    }
+    MPI_Gatherv(values, range[1], MPI_DOUBLE, slice, counts.data(), displacements.data(),
+        MPI_DOUBLE, 0, MPI_COMM_WORLD);
+  }
+#endif
+  return;
+}
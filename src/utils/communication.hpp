@@ -0,0 +1,22 @@
+// Blacklight communication header
+
+#ifndef COMMUNICATION_H_
+#define COMMUNICATION_H_
+
+//--------------------------------------------------------------------------------------------------
+
+// Functions for starting and ending communication
+void CommStart(int *p_argc, char ***p_argv);
+void CommEnd();
+
+// Functions for identifying ranks
+int CommRank();
+int CommSize();
+
+// Functions for combining work of ranks
+void CommBarrier();
+double CommMax(double value);
+void CommGatherPixels(double *data, int num_outer, int num_pix, int num_inner, int pix_start,
+    int pix_count);
+
+#endif
@@ -1,26 +1,51 @@
 // Blacklight file I/O
 
 // C++ headers
+#include <cerrno>   // errno, EINTR
 #include <cstddef>  // size_t
 #include <fstream>  // ifstream, ofstream
 #include <ios>      // streamsize
+#include <string>   // string
+
+// Library headers
+#include <fcntl.h>     // open, O_RDONLY
+#include <sys/mman.h>  // mmap, munmap, MAP_FAILED, MAP_PRIVATE, PROT_READ, PROT_WRITE
+#include <sys/stat.h>  // fstat, stat
+#include <unistd.h>    // close, pread
 
 // Blacklight headers
 #include "file_io.hpp"
-#include "array.hpp"    // Array
+#include "array.hpp"       // Array
+#include "exceptions.hpp"  // BlacklightException
 
 // Instantiations
 template void WriteBinary<int>(std::ofstream *p_stream, int val);
+template void WriteBinary<long int>(std::ofstream *p_stream, long int val);
+template void WriteBinary<bool>(std::ofstream *p_stream, bool vals[], long int num);
+template void WriteBinary<char>(std::ofstream *p_stream, char vals[], long int num);
+template void WriteBinary<int>(std::ofstream *p_stream, int vals[], long int num);
 template void WriteBinary<double>(std::ofstream *p_stream, double vals[], long int num);
 template void WriteBinary<bool>(std::ofstream *p_stream, const Array<bool> &array);
+template void WriteBinary<unsigned char>(std::ofstream *p_stream,
+    const Array<unsigned char> &array);
 template void WriteBinary<int>(std::ofstream *p_stream, const Array<int> &array);
 template void WriteBinary<double>(std::ofstream *p_stream, const Array<double> &array);
 template void ReadBinary<int>(std::ifstream *p_stream, int *p_val);
+template void ReadBinary<long int>(std::ifstream *p_stream, long int *p_val);
+template void ReadBinary<char>(std::ifstream *p_stream, char vals[], long int num);
+template void ReadBinary<long int>(std::ifstream *p_stream, long int vals[], long int num);
 template void ReadBinary<float>(std::ifstream *p_stream, float vals[], long int num);
 template void ReadBinary<double>(std::ifstream *p_stream, double vals[], long int num);
 template void ReadBinary<bool>(std::ifstream *p_stream, Array<bool> *p_array);
+template void ReadBinary<unsigned char>(std::ifstream *p_stream, Array<unsigned char> *p_array);
 template void ReadBinary<int>(std::ifstream *p_stream, Array<int> *p_array);
 template void ReadBinary<double>(std::ifstream *p_stream, Array<double> *p_array);
+template void MapBinary<bool>(char *buffer, long int offset, int n5, int n4, int n3, int n2, int n1,
+    Array<bool> *p_array);
+template void MapBinary<int>(char *buffer, long int offset, int n5, int n4, int n3, int n2, int n1,
+    Array<int> *p_array);
+template void MapBinary<double>(char *buffer, long int offset, int n5, int n4, int n3, int n2,
+    int n1, Array<double> *p_array);
 
 //--------------------------------------------------------------------------------------------------
 
@@ -127,3 +152,141 @@ template<typename type> void ReadBinary(std::ifstream *p_stream, Array<type> *p_
   p_stream->read(data_pointer, data_size);
   return;
 }
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for memory-mapping file
+// Inputs:
+//   file_name: name of file to map
+// Outputs:
+//   *p_size: size of file in bytes
+//   returned value: start of mapped memory
+// Notes:
+//   Maps file privately, so pages are read from disk only when first touched, and any writes to
+//       the memory are not propagated back to the file.
+//   Mapping must be released with UnmapFile().
+char *MapFile(const std::string &file_name, std::size_t *p_size)
+{
+  int file_descriptor = open(file_name.c_str(), O_RDONLY);
+  if (file_descriptor < 0)
+    throw BlacklightException("Could not open file for mapping.");
+  struct stat file_stat;
+  if (fstat(file_descriptor, &file_stat) != 0 or file_stat.st_size <= 0)
+  {
+    close(file_descriptor);
+    throw BlacklightException("Could not determine size of file for mapping.");
+  }
+  *p_size = static_cast<std::size_t>(file_stat.st_size);
+  void *buffer =
+      mmap(nullptr, *p_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, file_descriptor, 0);
+  close(file_descriptor);
+  if (buffer == MAP_FAILED)
+    throw BlacklightException("Could not map file.");
+  return static_cast<char *>(buffer);
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for releasing memory-mapped file
+// Inputs:
+//   buffer: start of mapped memory, as returned by MapFile()
+//   size: size of mapping in bytes
+// Outputs: (none)
+void UnmapFile(char *buffer, std::size_t size)
+{
+  if (buffer != nullptr)
+    munmap(buffer, size);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for using memory-mapped data as backing store of Array
+// Inputs:
+//   buffer: start of mapped memory
+//   offset: offset in bytes of data from start of buffer
+//   n5, n4, n3, n2, n1: dimensions of Array
+// Outputs:
+//   *p_array: Array pointing to mapped data
+// Notes:
+//   Array is marked as a copy, so it never frees the mapped memory.
+//   Any memory retained by Array from a previous allocation is freed.
+//   Assumes data is suitably aligned for type.
+template<typename type> void MapBinary(char *buffer, long int offset, int n5, int n4, int n3,
+    int n2, int n1, Array<type> *p_array)
+{
+  if (p_array->allocated)
+    throw BlacklightException("Attempting to reallocate array.");
+  p_array->Release();
+  p_array->data = reinterpret_cast<type *>(buffer + offset);
+  p_array->n1 = n1;
+  p_array->n2 = n2;
+  p_array->n3 = n3;
+  p_array->n4 = n4;
+  p_array->n5 = n5;
+  p_array->n_tot = static_cast<long int>(n1) * static_cast<long int>(n2)
+      * static_cast<long int>(n3) * static_cast<long int>(n4) * static_cast<long int>(n5);
+  p_array->allocated = true;
+  p_array->is_copy = true;
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for opening file for positioned reads
+// Inputs:
+//   file_name: name of file to open
+// Outputs:
+//   returned value: file descriptor
+// Notes:
+//   Descriptor must be released with CloseFileDescriptor().
+int OpenFileDescriptor(const std::string &file_name)
+{
+  int file_descriptor = open(file_name.c_str(), O_RDONLY);
+  if (file_descriptor < 0)
+    throw BlacklightException("Could not open file for reading.");
+  return file_descriptor;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for closing file opened for positioned reads
+// Inputs:
+//   file_descriptor: descriptor returned by OpenFileDescriptor()
+// Outputs: (none)
+void CloseFileDescriptor(int file_descriptor)
+{
+  if (file_descriptor >= 0)
+    close(file_descriptor);
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for reading contiguous range of bytes from file
+// Inputs:
+//   file_descriptor: descriptor returned by OpenFileDescriptor()
+//   offset: offset in bytes from start of file
+//   num_bytes: number of bytes to read
+// Outputs:
+//   buffer: filled with data
+//   returned value: flag indicating all bytes were read
+// Notes:
+//   Does not move any shared file position, so it may be called concurrently from multiple threads
+//       on the same descriptor.
+//   Does not throw, so it may be called inside parallel regions.
+bool ReadFileRange(int file_descriptor, long int offset, long int num_bytes, char *buffer)
+{
+  while (num_bytes > 0)
+  {
+    ssize_t num_read = pread(file_descriptor, buffer, static_cast<std::size_t>(num_bytes), offset);
+    if (num_read < 0 and errno == EINTR)
+      continue;
+    if (num_read <= 0)
+      return false;
+    buffer += num_read;
+    offset += num_read;
+    num_bytes -= num_read;
+  }
+  return true;
+}
@@ -4,7 +4,9 @@
 #define FILE_IO_H_
 
 // C++ headers
+#include <cstddef>  // size_t
 #include <fstream>  // ifstream, ofstream
+#include <string>   // string
 
 // Blacklight headers
 #include "array.hpp"  // Array
@@ -21,4 +23,15 @@ template<typename type> void ReadBinary(std::ifstream *p_stream, type *p_val);
 template<typename type> void ReadBinary(std::ifstream *p_stream, type vals[], long int num);
 template<typename type> void ReadBinary(std::ifstream *p_stream, Array<type> *p_array);
 
+// Functions for memory-mapping binary data
+char *MapFile(const std::string &file_name, std::size_t *p_size);
+void UnmapFile(char *buffer, std::size_t size);
+template<typename type> void MapBinary(char *buffer, long int offset, int n5, int n4, int n3,
+    int n2, int n1, Array<type> *p_array);
+
+// Functions for positioned reading of binary data
+int OpenFileDescriptor(const std::string &file_name);
+void CloseFileDescriptor(int file_descriptor);
+bool ReadFileRange(int file_descriptor, long int offset, long int num_bytes, char *buffer);
+
 #endif
@@ -0,0 +1,380 @@
+// Blacklight profiler
+
+// C++ headers
+#include <algorithm>  // max
+#include <atomic>     // atomic
+#include <cstddef>    // size_t
+#include <fstream>    // ofstream
+#include <ios>        // ios_base
+#include <iomanip>    // setprecision
+#include <mutex>      // lock_guard, mutex
+#include <string>     // string
+#include <thread>     // this_thread, thread
+#include <vector>     // vector
+
+// Library headers
+#include <omp.h>  // omp_get_max_threads, omp_get_thread_num, omp_get_wtime
+
+// Blacklight headers
+#include "profiler.hpp"
+#include "exceptions.hpp"  // BlacklightException
+
+//--------------------------------------------------------------------------------------------------
+
+// Profiled interval
+struct ProfileEvent
+{
+  std::string stage;
+  int snapshot;
+  int level;
+  int thread;
+  double time_start;
+  double time_end;
+  ProfileCounts counts;
+};
+
+// Profiled intervals combined by stage, snapshot, and level
+struct ProfileSummary
+{
+  std::string stage;
+  int snapshot;
+  int level;
+  int num_calls = 0;
+  double time = 0.0;
+  std::vector<double> thread_times;
+  ProfileCounts counts;
+};
+
+// Profiler state
+static bool profile_active = false;
+static bool profile_trace = false;
+static std::atomic<int> profile_snapshot(-1);
+static int profile_num_threads = 1;
+static double profile_time_start = 0.0;
+static std::thread::id profile_main_thread;
+static std::vector<ProfileEvent> profile_events;
+static std::mutex profile_mutex;
+
+// Thread labels for intervals not belonging to a single OpenMP thread
+static constexpr int profile_thread_main = -1;
+static constexpr int profile_thread_background = -2;
+
+// Internal functions
+static void AddProfileEvent(const ProfileEvent &event, std::vector<ProfileSummary> *p_summaries,
+    bool combine_snapshots);
+static void WriteProfileSummary(std::ofstream &stream, const ProfileSummary &summary,
+    bool write_indices);
+static void WriteProfileIndex(std::ofstream &stream, int index);
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for starting to record timings
+// Inputs:
+//   trace: flag indicating individual intervals should be kept for trace output
+// Outputs: (none)
+// Notes:
+//   Should be called from the main thread after the number of threads has been set.
+//   Until this function is called, recording functions do nothing.
+void ProfileStart(bool trace)
+{
+  profile_active = true;
+  profile_trace = trace;
+  profile_num_threads = omp_get_max_threads();
+  profile_time_start = omp_get_wtime();
+  profile_main_thread = std::this_thread::get_id();
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for checking whether timings are being recorded
+// Inputs: (none)
+// Outputs:
+//   returned value: flag indicating ProfileStart() has been called
+bool ProfileActive()
+{
+  return profile_active;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for setting snapshot currently being processed
+// Inputs:
+//   snapshot: index (starting at 0) of snapshot, or -1 for setup before any snapshot
+// Outputs: (none)
+// Notes:
+//   Background threads reading the value see the snapshot being processed when they record.
+void ProfileSetSnapshot(int snapshot)
+{
+  profile_snapshot = snapshot;
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for getting snapshot currently being processed
+// Inputs: (none)
+// Outputs:
+//   returned value: index of snapshot, or -1 for setup before any snapshot
+int ProfileSnapshot()
+{
+  return profile_snapshot;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for recording a stage
+// Inputs:
+//   stage: name of stage
+//   snapshot: index of snapshot, or -1 if not applicable
+//   level: adaptive level, or -1 if not applicable
+//   time_start, time_end: wall-clock times bounding stage
+//   counts: work done in stage
+// Outputs: (none)
+// Notes:
+//   Should be called outside of parallel regions, possibly from a background thread.
+//   Counts should only be given for work not also counted by ProfileRecordThread().
+void ProfileRecord(const char *stage, int snapshot, int level, double time_start, double time_end,
+    const ProfileCounts &counts)
+{
+  if (not profile_active)
+    return;
+  int thread = std::this_thread::get_id() == profile_main_thread ? profile_thread_main
+      : profile_thread_background;
+  std::lock_guard<std::mutex> lock(profile_mutex);
+  profile_events.push_back({stage, snapshot, level, thread, time_start, time_end, counts});
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for recording the work done by one thread in a parallel stage
+// Inputs:
+//   stage: name of stage
+//   snapshot: index of snapshot, or -1 if not applicable
+//   level: adaptive level, or -1 if not applicable
+//   time_start, time_end: wall-clock times bounding thread's share of stage, excluding barrier
+//   counts: work done by thread
+// Outputs: (none)
+// Notes:
+//   Should be called by each thread of a parallel region, after a worksharing loop with nowait
+//       and before the barrier.
+void ProfileRecordThread(const char *stage, int snapshot, int level, double time_start,
+    double time_end, const ProfileCounts &counts)
+{
+  if (not profile_active)
+    return;
+  int thread = omp_get_thread_num();
+  std::lock_guard<std::mutex> lock(profile_mutex);
+  profile_events.push_back({stage, snapshot, level, thread, time_start, time_end, counts});
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for writing recorded timings
+// Inputs:
+//   file_name: name of JSON file to write with summary
+//   trace_file_name: name of JSON file to write with individual intervals, or empty string
+// Outputs: (none)
+// Notes:
+//   Does nothing if ProfileStart() has not been called.
+//   Summary lists stages in order of first appearance, both for each snapshot and adaptive level
+//       and in total. Time is the sum of wall-clock times of stage calls; thread times are the
+//       sums of times each thread spent in its share of parallel loops before waiting for others;
+//       and imbalance is the ratio of maximum to mean thread time.
+//   Snapshots and levels of -1 are written as null.
+//   Trace follows the Chrome trace event format, viewable with chrome://tracing or Perfetto, with
+//       stages on the main thread as thread 0, OpenMP threads offset by 1, and stages on
+//       background threads last.
+void ProfileWrite(const std::string &file_name, const std::string &trace_file_name)
+{
+  // Only proceed if needed
+  if (not profile_active)
+    return;
+  double time_total = omp_get_wtime() - profile_time_start;
+  std::lock_guard<std::mutex> lock(profile_mutex);
+
+  // Combine intervals
+  std::vector<ProfileSummary> summaries;
+  std::vector<ProfileSummary> totals;
+  for (const ProfileEvent &event : profile_events)
+  {
+    AddProfileEvent(event, &summaries, false);
+    AddProfileEvent(event, &totals, true);
+  }
+
+  // Write summary
+  std::ofstream summary_stream(file_name, std::ios_base::out);
+  if (not summary_stream.is_open())
+    throw BlacklightException("Could not open profile file.");
+  summary_stream << std::setprecision(9);
+  summary_stream << "{\n  \"num_threads\": " << profile_num_threads << ",\n";
+  summary_stream << "  \"time\": " << time_total << ",\n";
+  summary_stream << "  \"stages\": [";
+  for (std::size_t n = 0; n < summaries.size(); n++)
+  {
+    summary_stream << (n == 0 ? "\n" : ",\n");
+    WriteProfileSummary(summary_stream, summaries[n], true);
+  }
+  summary_stream << "\n  ],\n  \"totals\": [";
+  for (std::size_t n = 0; n < totals.size(); n++)
+  {
+    summary_stream << (n == 0 ? "\n" : ",\n");
+    WriteProfileSummary(summary_stream, totals[n], false);
+  }
+  summary_stream << "\n  ]\n}\n";
+  if (not summary_stream.good())
+    throw BlacklightException("Could not write profile file.");
+
+  // Write trace
+  if (not profile_trace or trace_file_name.empty())
+    return;
+  std::ofstream trace_stream(trace_file_name, std::ios_base::out);
+  if (not trace_stream.is_open())
+    throw BlacklightException("Could not open profile trace file.");
+  trace_stream << std::setprecision(15);
+  trace_stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+  for (std::size_t n = 0; n < profile_events.size(); n++)
+  {
+    const ProfileEvent &event = profile_events[n];
+    int thread = event.thread + 1;
+    if (event.thread == profile_thread_background)
+      thread = profile_num_threads + 1;
+    trace_stream << (n == 0 ? "\n" : ",\n");
+    trace_stream << "{\"name\": \"" << event.stage << "\", \"ph\": \"X\", \"pid\": 0, \"tid\": "
+        << thread << ", \"ts\": " << (event.time_start - profile_time_start) * 1.0e6
+        << ", \"dur\": " << (event.time_end - event.time_start) * 1.0e6 << ", \"args\": {"
+        << "\"snapshot\": ";
+    WriteProfileIndex(trace_stream, event.snapshot);
+    trace_stream << ", \"level\": ";
+    WriteProfileIndex(trace_stream, event.level);
+    trace_stream << ", \"rays\": " << event.counts.rays << ", \"samples\": "
+        << event.counts.samples << ", \"bytes_read\": " << event.counts.bytes_read
+        << ", \"bytes_written\": " << event.counts.bytes_written << ", \"retries\": "
+        << event.counts.retries << "}}";
+  }
+  trace_stream << "\n]}\n";
+  if (not trace_stream.good())
+    throw BlacklightException("Could not write profile trace file.");
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for combining an interval into summaries
+// Inputs:
+//   event: interval to be combined
+//   p_summaries: pointer to summaries
+//   combine_snapshots: flag indicating intervals should be combined across snapshots and levels
+// Outputs:
+//   *p_summaries: appropriate summary updated, possibly after being appended
+static void AddProfileEvent(const ProfileEvent &event, std::vector<ProfileSummary> *p_summaries,
+    bool combine_snapshots)
+{
+  // Locate summary
+  int snapshot = combine_snapshots ? -1 : event.snapshot;
+  int level = combine_snapshots ? -1 : event.level;
+  ProfileSummary *p_summary = nullptr;
+  for (ProfileSummary &summary : *p_summaries)
+    if (summary.stage == event.stage and summary.snapshot == snapshot and summary.level == level)
+    {
+      p_summary = &summary;
+      break;
+    }
+  if (p_summary == nullptr)
+  {
+    p_summaries->emplace_back();
+    p_summary = &p_summaries->back();
+    p_summary->stage = event.stage;
+    p_summary->snapshot = snapshot;
+    p_summary->level = level;
+  }
+
+  // Add interval
+  double time = event.time_end - event.time_start;
+  if (event.thread >= 0)
+  {
+    std::size_t thread = static_cast<std::size_t>(event.thread);
+    if (p_summary->thread_times.size() <= thread)
+      p_summary->thread_times.resize(thread + 1, 0.0);
+    p_summary->thread_times[thread] += time;
+  }
+  else
+  {
+    p_summary->num_calls++;
+    p_summary->time += time;
+  }
+  p_summary->counts.rays += event.counts.rays;
+  p_summary->counts.samples += event.counts.samples;
+  p_summary->counts.bytes_read += event.counts.bytes_read;
+  p_summary->counts.bytes_written += event.counts.bytes_written;
+  p_summary->counts.retries += event.counts.retries;
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for writing a summary as a JSON object
+// Inputs:
+//   stream: stream to write to
+//   summary: summary to write
+//   write_indices: flag indicating snapshot and level should be written
+// Outputs: (none)
+static void WriteProfileSummary(std::ofstream &stream, const ProfileSummary &summary,
+    bool write_indices)
+{
+  // Write stage
+  stream << "    {\"stage\": \"" << summary.stage << "\"";
+  if (write_indices)
+  {
+    stream << ", \"snapshot\": ";
+    WriteProfileIndex(stream, summary.snapshot);
+    stream << ", \"level\": ";
+    WriteProfileIndex(stream, summary.level);
+  }
+  stream << ", \"calls\": " << summary.num_calls << ", \"time\": " << summary.time;
+
+  // Write thread times
+  if (not summary.thread_times.empty())
+  {
+    double time_max = 0.0;
+    double time_sum = 0.0;
+    stream << ", \"thread_times\": [";
+    for (std::size_t n = 0; n < summary.thread_times.size(); n++)
+    {
+      stream << (n == 0 ? "" : ", ") << summary.thread_times[n];
+      time_max = std::max(time_max, summary.thread_times[n]);
+      time_sum += summary.thread_times[n];
+    }
+    double time_mean = time_sum / static_cast<double>(summary.thread_times.size());
+    stream << "], \"imbalance\": ";
+    if (time_mean > 0.0)
+      stream << time_max / time_mean;
+    else
+      stream << "null";
+  }
+
+  // Write counts
+  stream << ", \"rays\": " << summary.counts.rays << ", \"samples\": "
+      << summary.counts.samples << ", \"bytes_read\": " << summary.counts.bytes_read
+      << ", \"bytes_written\": " << summary.counts.bytes_written << ", \"retries\": "
+      << summary.counts.retries << "}";
+  return;
+}
+
+//--------------------------------------------------------------------------------------------------
+
+// Function for writing a snapshot or level index to JSON
+// Inputs:
+//   stream: stream to write to
+//   index: index to write, or -1 for null
+// Outputs: (none)
+static void WriteProfileIndex(std::ofstream &stream, int index)
+{
+  if (index < 0)
+    stream << "null";
+  else
+    stream << index;
+  return;
+}
@@ -0,0 +1,36 @@
+// Blacklight profiler header
+
+#ifndef PROFILER_H_
+#define PROFILER_H_
+
+// C++ headers
+#include <string>  // string
+
+//--------------------------------------------------------------------------------------------------
+
+// Counts attached to profiled intervals
+struct ProfileCounts
+{
+  long int rays = 0;
+  long int samples = 0;
+  long int bytes_read = 0;
+  long int bytes_written = 0;
+  long int retries = 0;
+};
+
+//--------------------------------------------------------------------------------------------------
+
+// Functions for recording timings
+void ProfileStart(bool trace);
+bool ProfileActive();
+void ProfileSetSnapshot(int snapshot);
+int ProfileSnapshot();
+void ProfileRecord(const char *stage, int snapshot, int level, double time_start, double time_end,
+    const ProfileCounts &counts);
+void ProfileRecordThread(const char *stage, int snapshot, int level, double time_start,
+    double time_end, const ProfileCounts &counts);
+
+// Functions for reporting timings
+void ProfileWrite(const std::string &file_name, const std::string &trace_file_name);
+
+#endif